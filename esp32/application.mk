@@ -110,6 +110,7 @@ APP_MAIN_SRC_C = \
 	main.c \
 	mptask.c \
 	serverstask.c \
+	serverscore.c \
 	fatfs_port.c \
 	pycom_config.c \
 	mpthreadport.c \
@@ -191,8 +192,10 @@ endif
 
 ifeq ($(DIFF_UPDATE_ENABLED), 1)
 APP_INC += -Ibzlib/
+APP_INC += -Ibsdiff
 APP_MODS_SRC_C += $(addprefix bsdiff/,\
 	bspatch.c \
+	bspatch_stream.c \
 	)
 APP_MODS_SRC_C += $(addprefix bzlib/,\
 	blocksort.c \
@@ -234,6 +237,7 @@ APP_UTIL_SRC_C = $(addprefix util/,\
 APP_FATFS_SRC_C = $(addprefix fatfs/src/,\
 	drivers/sflash_diskio.c \
 	drivers/sd_diskio.c \
+	drivers/sd_xfer.c \
 	)
 
 APP_LITTLEFS_SRC_C = $(addprefix littlefs/,\
@@ -242,6 +246,8 @@ APP_LITTLEFS_SRC_C = $(addprefix littlefs/,\
 	vfs_littlefs.c \
 	vfs_littlefs_file.c \
 	sflash_diskio_littlefs.c \
+	lfs_freemap.c \
+	littlefs_lock.c \
 	)
 
 APP_LORA_SRC_C = $(addprefix lora/,\
@@ -304,6 +310,7 @@ APP_PYGATE_SRC_C = $(addprefix pygate/,\
 	lora_pkt_fwd/jitqueue.c \
 	lora_pkt_fwd/lora_pkt_fwd.c \
 	lora_pkt_fwd/parson.c \
+	lora_pkt_fwd/pktjson.c \
 	lora_pkt_fwd/timersync.c \
 	)
 
@@ -371,6 +378,7 @@ APP_TELNET_SRC_C = $(addprefix telnet/,\
 
 APP_FTP_SRC_C = $(addprefix ftp/,\
 	ftp.c \
+	ftpfs.c \
 	updater.c \
 	)
 
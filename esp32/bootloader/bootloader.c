@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <limits.h>
 #include <sys/param.h>
 
@@ -262,7 +263,7 @@ bool load_partition_table(bootloader_state_t* bs)
 
 static uint32_t ota_select_crc(const boot_info_t *s)
 {
-  return crc32_le(UINT32_MAX, (uint8_t*)&s->ActiveImg, sizeof(boot_info_t) - sizeof(s->crc));
+  return crc32_le(UINT32_MAX, (uint8_t*)&s->ActiveImg, offsetof(boot_info_t, crc));
 }
 
 static bool ota_select_valid(const boot_info_t *s)
@@ -30,6 +30,16 @@ typedef struct {
     uint32_t crc; /* CRC32 of ota_seq field only */
 } ota_select;
 
+/* Progress of a resumable OTA download, see updater_start_resumable().
+   It follows the crc of the boot info and has its own, so the bootloaders
+   which only know the fields before it keep working */
+typedef struct {
+  uint32_t  magic;
+  uint32_t  offset;       /* bytes of the image written and verified */
+  uint8_t   manifest[12]; /* start of the SHA-256 of the image manifest */
+  uint32_t  crc;
+} ota_progress_t;
+
 typedef struct _boot_info_t
 {
   uint32_t  ActiveImg;
@@ -38,7 +48,8 @@ typedef struct _boot_info_t
   uint32_t  size;
   uint32_t  safeboot;
   uint8_t   signature[16];
-  uint32_t  crc;
+  uint32_t  crc;          /* CRC32 of the fields above */
+  ota_progress_t progress;
 } boot_info_t;
 
 #define IMG_SIZE_8MB                            (1980 * 1024)
@@ -62,6 +73,8 @@ typedef struct _boot_info_t
 #define IMG_ACT_UPDATE1                     1
 #define IMG_ACT_UPDATE2                     2
 
+#define OTA_PROGRESS_MAGIC                  0x4F544150  // "OTAP"
+
 #define BOOT_VERSION                        "V0.3"
 #define SPI_SEC_SIZE                        0x1000
 
@@ -2,6 +2,8 @@
 
 #define __BSDIFF_API__
 
-off_t offtin(u_char *buf);
+#include <stdint.h>
+
+int64_t offtin(const uint8_t *buf);
 
 #endif
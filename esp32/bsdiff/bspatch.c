@@ -28,11 +28,11 @@
 __FBSDID("$FreeBSD: src/usr.bin/bsdiff/bspatch/bspatch.c,v 1.1 2005/08/06 01:59:06 cperciva Exp $");
 #endif
 
-#include <bzlib.h>
+#include "bsdiff_api.h"
 
-int offtin(unsigned char *buf)
+int64_t offtin(const uint8_t *buf)
 {
-	int y;
+	int64_t y;
 
 	y=buf[7]&0x7F;
 	y=y*256;y+=buf[6];
@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bspatch_stream.h"
+#include "bsdiff_api.h"
+#include "bzlib.h"
+#include "esp_heap_caps.h"
+
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+#define BSPATCH_MAGIC_LEN                   8
+#define BSPATCH_CTRLLEN_OFFSET              8
+#define BSPATCH_DATALEN_OFFSET              16
+#define BSPATCH_NEWSIZE_OFFSET              24
+#define BSPATCH_LZ_FRAME_HEADER             4
+
+// bzip2 small mode halves the memory of the decoder (2.5 instead of 4 bytes
+// per byte of block) at the cost of speed, there are 3 decoders alive
+#ifndef BSPATCH_BZ2_SMALL
+#define BSPATCH_BZ2_SMALL                   1
+#endif
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+// one of the control, diff or extra blocks, read through its own window
+typedef struct {
+    const bspatch_io_t *io;
+    uint32_t pos;                   // next patch byte to load into the window
+    uint32_t end;                   // end of the block in the patch
+    uint8_t *in;
+    uint32_t in_pos;
+    uint32_t in_len;
+    // bzip2
+    bz_stream bz;
+    bool bz_ready;
+    // LZ frames
+    uint8_t *frame;
+    uint32_t frame_pos;
+    uint32_t frame_len;
+} bspatch_block_t;
+
+typedef struct {
+    const bspatch_io_t *io;
+    bool lz;
+    bspatch_block_t ctrl;
+    bspatch_block_t diff;
+    bspatch_block_t xtra;
+    uint8_t *lz_scratch;            // for the LZ frames that straddle a window
+    uint8_t *old;                   // cached window of the old image
+    int64_t old_base;
+    uint32_t old_len;
+    uint8_t *out;                   // write combining buffer of the new image
+    uint32_t out_len;
+    uint32_t newpos;
+    uint32_t newsize;
+} bspatch_t;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void *bspatch_bz_alloc (void *opaque, int items, int size) {
+    return heap_caps_malloc(items * size, MALLOC_CAP_SPIRAM);
+}
+
+static void bspatch_bz_free (void *opaque, void *addr) {
+    heap_caps_free(addr);
+}
+
+// loads the next part of the block into the window, false at its end
+static bool bspatch_block_fill (bspatch_block_t *b, bspatch_result_t *res) {
+    // up to the next aligned boundary, so that all but the first read are whole
+    uint32_t size = BSPATCH_IO_SIZE - (b->pos % BSPATCH_IO_SIZE);
+
+    if (b->pos == b->end) {
+        return false;
+    }
+    if (size > b->end - b->pos) {
+        size = b->end - b->pos;
+    }
+    if (!b->io->read_patch(b->io->ctx, b->pos, b->in, size)) {
+        *res = BSPATCH_ERR_READ;
+        return false;
+    }
+    b->pos += size;
+    b->in_pos = 0;
+    b->in_len = size;
+    return true;
+}
+
+static bspatch_result_t bspatch_bz_read (bspatch_block_t *b, uint8_t *dst, uint32_t len) {
+    bspatch_result_t res = BSPATCH_ERR_CORRUPT;
+
+    b->bz.next_out = (char *)dst;
+    b->bz.avail_out = len;
+    while (b->bz.avail_out > 0) {
+        if (b->bz.avail_in == 0) {
+            if (bspatch_block_fill(b, &res)) {
+                b->bz.next_in = (char *)b->in;
+                b->bz.avail_in = b->in_len;
+            } else if (res != BSPATCH_ERR_CORRUPT) {
+                return res;
+            }
+        }
+        uint32_t avail_out = b->bz.avail_out;
+        uint32_t avail_in = b->bz.avail_in;
+        int ret = BZ2_bzDecompress(&b->bz);
+        if (ret == BZ_STREAM_END && b->bz.avail_out > 0) {
+            return BSPATCH_ERR_CORRUPT;
+        } else if (ret != BZ_OK && ret != BZ_STREAM_END) {
+            return BSPATCH_ERR_CORRUPT;
+        } else if (b->bz.avail_out == avail_out && b->bz.avail_in == avail_in) {
+            // no progress and nothing left to feed it
+            return res;
+        }
+    }
+    return BSPATCH_OK;
+}
+
+// copies len bytes of the raw block, across windows
+static bspatch_result_t bspatch_block_take (bspatch_block_t *b, uint8_t *dst, uint32_t len) {
+    bspatch_result_t res = BSPATCH_ERR_CORRUPT;
+
+    while (len > 0) {
+        if (b->in_pos == b->in_len && !bspatch_block_fill(b, &res)) {
+            return res;
+        }
+        uint32_t n = b->in_len - b->in_pos;
+        n = (n > len) ? len : n;
+        memcpy(dst, b->in + b->in_pos, n);
+        b->in_pos += n;
+        dst += n;
+        len -= n;
+    }
+    return BSPATCH_OK;
+}
+
+// decodes one LZ4 block, which must expand to exactly dst_len bytes
+static bool bspatch_lz_decode (const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len) {
+    const uint8_t *s_end = src + src_len;
+    uint8_t *d = dst;
+    uint8_t *d_end = dst + dst_len;
+
+    while (src < s_end) {
+        uint32_t token = *src++;
+        uint32_t n = token >> 4;
+        if (n == 15) {
+            uint32_t b;
+            do {
+                if (src == s_end) {
+                    return false;
+                }
+                b = *src++;
+                n += b;
+            } while (b == 255);
+        }
+        if (n > (uint32_t)(s_end - src) || n > (uint32_t)(d_end - d)) {
+            return false;
+        }
+        memcpy(d, src, n);
+        src += n;
+        d += n;
+        if (src == s_end) {
+            // the last sequence has no match
+            break;
+        }
+
+        if (s_end - src < 2) {
+            return false;
+        }
+        uint32_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        if (offset == 0 || offset > (uint32_t)(d - dst)) {
+            return false;
+        }
+        n = token & 0x0F;
+        if (n == 15) {
+            uint32_t b;
+            do {
+                if (src == s_end) {
+                    return false;
+                }
+                b = *src++;
+                n += b;
+            } while (b == 255);
+        }
+        n += 4;
+        if (n > (uint32_t)(d_end - d)) {
+            return false;
+        }
+        // byte by byte, the match may overlap what it is copying
+        const uint8_t *m = d - offset;
+        while (n--) {
+            *d++ = *m++;
+        }
+    }
+    return d == d_end;
+}
+
+static bspatch_result_t bspatch_lz_next_frame (bspatch_t *p, bspatch_block_t *b) {
+    uint8_t header[BSPATCH_LZ_FRAME_HEADER];
+    bspatch_result_t res;
+
+    if ((res = bspatch_block_take(b, header, sizeof(header))) != BSPATCH_OK) {
+        return res;
+    }
+    uint32_t raw_len = header[0] | (header[1] << 8);
+    uint32_t lz_len = header[2] | (header[3] << 8);
+    if (raw_len == 0 || raw_len > BSPATCH_LZ_FRAME_SIZE || lz_len >= raw_len) {
+        return BSPATCH_ERR_CORRUPT;
+    }
+
+    if (lz_len == 0) {
+        res = bspatch_block_take(b, b->frame, raw_len);
+    } else if (b->in_len - b->in_pos >= lz_len) {
+        // decode in place when the window holds the whole frame
+        if (!bspatch_lz_decode(b->in + b->in_pos, lz_len, b->frame, raw_len)) {
+            return BSPATCH_ERR_CORRUPT;
+        }
+        b->in_pos += lz_len;
+    } else if ((res = bspatch_block_take(b, p->lz_scratch, lz_len)) == BSPATCH_OK) {
+        if (!bspatch_lz_decode(p->lz_scratch, lz_len, b->frame, raw_len)) {
+            return BSPATCH_ERR_CORRUPT;
+        }
+    }
+    b->frame_pos = 0;
+    b->frame_len = raw_len;
+    return res;
+}
+
+static bspatch_result_t bspatch_read (bspatch_t *p, bspatch_block_t *b, uint8_t *dst, uint32_t len) {
+    bspatch_result_t res;
+
+    if (!p->lz) {
+        return bspatch_bz_read(b, dst, len);
+    }
+    while (len > 0) {
+        if (b->frame_pos == b->frame_len && (res = bspatch_lz_next_frame(p, b)) != BSPATCH_OK) {
+            return res;
+        }
+        uint32_t n = b->frame_len - b->frame_pos;
+        n = (n > len) ? len : n;
+        memcpy(dst, b->frame + b->frame_pos, n);
+        b->frame_pos += n;
+        dst += n;
+        len -= n;
+    }
+    return BSPATCH_OK;
+}
+
+static bspatch_result_t bspatch_block_init (bspatch_t *p, bspatch_block_t *b, uint32_t start, uint32_t len) {
+    memset(b, 0, sizeof(*b));
+    b->io = p->io;
+    b->pos = start;
+    b->end = start + len;
+    if ((b->in = malloc(BSPATCH_IO_SIZE)) == NULL) {
+        return BSPATCH_ERR_NOMEM;
+    }
+    if (p->lz) {
+        if ((b->frame = malloc(BSPATCH_LZ_FRAME_SIZE)) == NULL) {
+            return BSPATCH_ERR_NOMEM;
+        }
+    } else {
+        b->bz.bzalloc = bspatch_bz_alloc;
+        b->bz.bzfree = bspatch_bz_free;
+        if (BZ2_bzDecompressInit(&b->bz, 0, BSPATCH_BZ2_SMALL) != BZ_OK) {
+            return BSPATCH_ERR_NOMEM;
+        }
+        b->bz_ready = true;
+    }
+    return BSPATCH_OK;
+}
+
+static void bspatch_block_deinit (bspatch_block_t *b) {
+    if (b->bz_ready) {
+        BZ2_bzDecompressEnd(&b->bz);
+    }
+    free(b->in);
+    free(b->frame);
+}
+
+static bspatch_result_t bspatch_flush (bspatch_t *p) {
+    if (p->out_len > 0) {
+        if (!p->io->write_new(p->io->ctx, p->out, p->out_len)) {
+            return BSPATCH_ERR_WRITE;
+        }
+        p->newpos += p->out_len;
+        p->out_len = 0;
+        if (p->io->progress) {
+            p->io->progress(p->io->ctx, p->newpos, p->newsize);
+        }
+    }
+    return BSPATCH_OK;
+}
+
+// adds the old image from oldpos on to len bytes of the output
+static bspatch_result_t bspatch_add_old (bspatch_t *p, uint8_t *dst, int64_t oldpos, uint32_t len) {
+    while (len > 0) {
+        if (oldpos < 0 || oldpos >= p->io->old_size) {
+            // outside of the old image, nothing to add
+            uint32_t skip = len;
+            if (oldpos < 0 && -oldpos < skip) {
+                skip = -oldpos;
+            }
+            dst += skip;
+            oldpos += skip;
+            len -= skip;
+            continue;
+        }
+        if (oldpos < p->old_base || oldpos >= p->old_base + p->old_len) {
+            p->old_base = oldpos - (oldpos % BSPATCH_IO_SIZE);
+            p->old_len = p->io->old_size - p->old_base;
+            p->old_len = (p->old_len > BSPATCH_IO_SIZE) ? BSPATCH_IO_SIZE : p->old_len;
+            if (!p->io->read_old(p->io->ctx, p->old_base, p->old, p->old_len)) {
+                p->old_len = 0;
+                return BSPATCH_ERR_READ;
+            }
+        }
+        uint32_t offset = oldpos - p->old_base;
+        uint32_t n = p->old_len - offset;
+        n = (n > len) ? len : n;
+        const uint8_t *old = p->old + offset;
+        for (uint32_t i = 0; i < n; i++) {
+            dst[i] += old[i];
+        }
+        dst += n;
+        oldpos += n;
+        len -= n;
+    }
+    return BSPATCH_OK;
+}
+
+static bspatch_result_t bspatch_run (bspatch_t *p) {
+    bspatch_result_t res;
+    uint8_t buf[24];
+    int64_t oldpos = 0;
+
+    while (p->newpos + p->out_len < p->newsize) {
+        if ((res = bspatch_read(p, &p->ctrl, buf, sizeof(buf))) != BSPATCH_OK) {
+            return res;
+        }
+        int64_t add = offtin(buf);
+        int64_t copy = offtin(buf + 8);
+        int64_t seek = offtin(buf + 16);
+        uint32_t left = p->newsize - (p->newpos + p->out_len);
+        if (add < 0 || copy < 0 || add > left || copy > left - add) {
+            return BSPATCH_ERR_CORRUPT;
+        }
+
+        // decode straight into the write buffer and add the old bytes there
+        while (add > 0) {
+            uint32_t n = BSPATCH_IO_SIZE - p->out_len;
+            n = (n > add) ? add : n;
+            uint8_t *dst = p->out + p->out_len;
+            if ((res = bspatch_read(p, &p->diff, dst, n)) != BSPATCH_OK ||
+                (res = bspatch_add_old(p, dst, oldpos, n)) != BSPATCH_OK) {
+                return res;
+            }
+            oldpos += n;
+            add -= n;
+            if ((p->out_len += n) == BSPATCH_IO_SIZE && (res = bspatch_flush(p)) != BSPATCH_OK) {
+                return res;
+            }
+        }
+        while (copy > 0) {
+            uint32_t n = BSPATCH_IO_SIZE - p->out_len;
+            n = (n > copy) ? copy : n;
+            if ((res = bspatch_read(p, &p->xtra, p->out + p->out_len, n)) != BSPATCH_OK) {
+                return res;
+            }
+            copy -= n;
+            if ((p->out_len += n) == BSPATCH_IO_SIZE && (res = bspatch_flush(p)) != BSPATCH_OK) {
+                return res;
+            }
+        }
+        oldpos += seek;
+    }
+    return bspatch_flush(p);
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+bool bspatch_is_patch (const uint8_t *header) {
+    return memcmp(header, BSPATCH_MAGIC_BZ2, BSPATCH_MAGIC_LEN) == 0 ||
+           memcmp(header, BSPATCH_MAGIC_LZ, BSPATCH_MAGIC_LEN) == 0;
+}
+
+int32_t bspatch_new_size (const uint8_t *header) {
+    int64_t size = offtin(header + BSPATCH_NEWSIZE_OFFSET);
+    return (size < 0 || size > INT32_MAX) ? -1 : size;
+}
+
+bspatch_result_t bspatch_apply (const bspatch_io_t *io) {
+    uint8_t header[BSPATCH_HEADER_SIZE];
+    bspatch_result_t res;
+    bspatch_t p;
+
+    // File format:
+    //     0   8   "BSDIFF40" (or "BSDIFFLZ")
+    //     8   8   X
+    //     16  8   Y
+    //     24  8   sizeof(newfile)
+    //     32  X   bzip2(control block)
+    //     32+X    Y   bzip2(diff block)
+    //     32+X+Y  ??? bzip2(extra block)
+    // with control block a set of triples (x,y,z) meaning "add x bytes
+    // from oldfile to x bytes from the diff block; copy y bytes from the
+    // extra block; seek forwards in oldfile by z bytes".
+    if (io->patch_size < BSPATCH_HEADER_SIZE) {
+        return BSPATCH_ERR_HEADER;
+    }
+    if (!io->read_patch(io->ctx, 0, header, sizeof(header))) {
+        return BSPATCH_ERR_READ;
+    }
+    if (!bspatch_is_patch(header)) {
+        return BSPATCH_ERR_HEADER;
+    }
+    int64_t ctrllen = offtin(header + BSPATCH_CTRLLEN_OFFSET);
+    int64_t datalen = offtin(header + BSPATCH_DATALEN_OFFSET);
+    int32_t newsize = bspatch_new_size(header);
+    uint32_t blocks = io->patch_size - BSPATCH_HEADER_SIZE;
+    if (ctrllen < 0 || datalen < 0 || newsize < 0 || ctrllen > blocks || datalen > blocks - ctrllen) {
+        return BSPATCH_ERR_HEADER;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.io = io;
+    p.lz = (memcmp(header, BSPATCH_MAGIC_LZ, BSPATCH_MAGIC_LEN) == 0);
+    p.newsize = newsize;
+    if ((p.old = malloc(BSPATCH_IO_SIZE)) == NULL || (p.out = malloc(BSPATCH_IO_SIZE)) == NULL ||
+        (p.lz && (p.lz_scratch = malloc(BSPATCH_LZ_FRAME_SIZE)) == NULL)) {
+        res = BSPATCH_ERR_NOMEM;
+        goto exit;
+    }
+    uint32_t offset = BSPATCH_HEADER_SIZE;
+    if ((res = bspatch_block_init(&p, &p.ctrl, offset, ctrllen)) != BSPATCH_OK ||
+        (res = bspatch_block_init(&p, &p.diff, offset + ctrllen, datalen)) != BSPATCH_OK ||
+        (res = bspatch_block_init(&p, &p.xtra, offset + ctrllen + datalen, blocks - ctrllen - datalen)) != BSPATCH_OK) {
+        goto exit;
+    }
+    res = bspatch_run(&p);
+
+exit:
+    bspatch_block_deinit(&p.ctrl);
+    bspatch_block_deinit(&p.diff);
+    bspatch_block_deinit(&p.xtra);
+    free(p.lz_scratch);
+    free(p.old);
+    free(p.out);
+    return res;
+}
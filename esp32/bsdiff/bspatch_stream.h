@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef BSPATCH_STREAM_H_
+#define BSPATCH_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define BSPATCH_HEADER_SIZE                 32
+
+// the classic patch, the three blocks are bzip2 streams
+#define BSPATCH_MAGIC_BZ2                   "BSDIFF40"
+// same layout, the blocks are sequences of LZ frames: a 16 bit little endian
+// decoded length (1 to BSPATCH_LZ_FRAME_SIZE), a 16 bit coded length and an
+// LZ4 block of that many bytes, or the data as it is when the coded length is 0.
+// Much cheaper to decode than bzip2, the diff block is mostly zeros anyway
+#define BSPATCH_MAGIC_LZ                    "BSDIFFLZ"
+#define BSPATCH_LZ_FRAME_SIZE               4096
+
+// flash reads of the old image and writes of the new one are done in units
+// of this size, aligned to it
+#ifndef BSPATCH_IO_SIZE
+#define BSPATCH_IO_SIZE                     4096
+#endif
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef enum {
+    BSPATCH_OK = 0,
+    BSPATCH_ERR_HEADER,
+    BSPATCH_ERR_NOMEM,
+    BSPATCH_ERR_READ,
+    BSPATCH_ERR_WRITE,
+    BSPATCH_ERR_CORRUPT
+} bspatch_result_t;
+
+// Where the patch and the old image come from and where the new one goes.
+// The patch and the old image are read at any offset, the new image is
+// written in order, BSPATCH_IO_SIZE bytes at a time except for the tail.
+typedef struct {
+    bool (*read_patch) (void *ctx, uint32_t offset, void *buf, uint32_t size);
+    bool (*read_old) (void *ctx, uint32_t offset, void *buf, uint32_t size);
+    bool (*write_new) (void *ctx, const void *buf, uint32_t size);
+    // optional, called after each write
+    void (*progress) (void *ctx, uint32_t done, uint32_t total);
+    void *ctx;
+    uint32_t patch_size;
+    // bytes of old image that can be read, positions past it count as zeros
+    uint32_t old_size;
+} bspatch_io_t;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern bool bspatch_is_patch (const uint8_t *header);
+extern int32_t bspatch_new_size (const uint8_t *header);
+extern bspatch_result_t bspatch_apply (const bspatch_io_t *io);
+
+#endif /* BSPATCH_STREAM_H_ */
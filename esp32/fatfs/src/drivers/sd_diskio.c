@@ -16,9 +16,11 @@
 #include "sdmmc_cmd.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
 #include "lib/oofatfs/ff.h"
 #include "lib/oofatfs/diskio.h"
 #include "sd_diskio.h"
+#include "sd_xfer.h"
 #include "stdcmd.h"
 
 //*****************************************************************************
@@ -42,6 +44,29 @@
 sdmmc_card_t sdmmc_card_info;
 static DSTATUS sd_card_status = STA_NOINIT;
 
+static int sd_disk_read_sectors (void *ctx, void *buf, uint32_t sector, uint32_t count) {
+    return sdmmc_read_sectors(ctx, buf, sector, count);
+}
+
+static int sd_disk_write_sectors (void *ctx, const void *buf, uint32_t sector, uint32_t count) {
+    return sdmmc_write_sectors(ctx, buf, sector, count);
+}
+
+// as sdmmc_read_sectors() and sdmmc_write_sectors() have it
+static bool sd_disk_dma_capable (const void *buf) {
+    return esp_ptr_dma_capable(buf) && ((uintptr_t)buf & 3) == 0;
+}
+
+static sd_xfer_t sd_xfer = {
+    .read = sd_disk_read_sectors,
+    .write = sd_disk_write_sectors,
+    .dma_capable = sd_disk_dma_capable,
+    .ctx = &sdmmc_card_info,
+    .bounce = NULL,
+    .bounce_sectors = SD_XFER_BOUNCE_SECTORS,
+    .sector_size = SD_SECTOR_SIZE,
+};
+
 //*****************************************************************************
 //
 //! Initializes physical drive
@@ -76,6 +101,11 @@ DSTATUS sd_disk_init (void) {
         sd_card_status = STA_NOINIT;
     }
 
+    // kept from then on, without it the buffers in the PSRAM go a sector at a time
+    if (sd_xfer.bounce == NULL) {
+        sd_xfer.bounce = heap_caps_malloc(SD_XFER_BOUNCE_SECTORS * SD_SECTOR_SIZE, MALLOC_CAP_DMA);
+    }
+
     return sd_card_status;
 }
 
@@ -102,7 +132,7 @@ void sd_disk_deinit (void) {
 //*****************************************************************************
 DRESULT sd_disk_read (BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
     if (SectorCount > 0) {
-        if (ESP_OK == sdmmc_read_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
+        if (ESP_OK == sd_xfer_read(&sd_xfer, pBuffer, ulSectorNumber, SectorCount)) {
             return RES_OK;
         }
     }
@@ -121,7 +151,7 @@ DRESULT sd_disk_read (BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
 //*****************************************************************************
 DRESULT sd_disk_write (const BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
     if (SectorCount > 0) {
-        if (ESP_OK == sdmmc_write_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
+        if (ESP_OK == sd_xfer_write(&sd_xfer, pBuffer, ulSectorNumber, SectorCount)) {
             return RES_OK;
         }
     }
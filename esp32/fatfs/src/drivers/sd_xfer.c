@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "sd_xfer.h"
+
+static bool sd_xfer_direct(const sd_xfer_t *xfer, const void *buf)
+{
+    return xfer->bounce == NULL || xfer->dma_capable(buf);
+}
+
+int sd_xfer_read(const sd_xfer_t *xfer, void *buf, uint32_t sector, uint32_t count)
+{
+    if (sd_xfer_direct(xfer, buf)) {
+        return xfer->read(xfer->ctx, buf, sector, count);
+    }
+
+    uint8_t *dst = buf;
+    while (count > 0) {
+        uint32_t n = (count < xfer->bounce_sectors) ? count : xfer->bounce_sectors;
+        int err = xfer->read(xfer->ctx, xfer->bounce, sector, n);
+        if (err != 0) {
+            return err;
+        }
+        memcpy(dst, xfer->bounce, n * xfer->sector_size);
+        dst += n * xfer->sector_size;
+        sector += n;
+        count -= n;
+    }
+    return 0;
+}
+
+int sd_xfer_write(const sd_xfer_t *xfer, const void *buf, uint32_t sector, uint32_t count)
+{
+    if (sd_xfer_direct(xfer, buf)) {
+        return xfer->write(xfer->ctx, buf, sector, count);
+    }
+
+    const uint8_t *src = buf;
+    while (count > 0) {
+        uint32_t n = (count < xfer->bounce_sectors) ? count : xfer->bounce_sectors;
+        memcpy(xfer->bounce, src, n * xfer->sector_size);
+        int err = xfer->write(xfer->ctx, xfer->bounce, sector, n);
+        if (err != 0) {
+            return err;
+        }
+        src += n * xfer->sector_size;
+        sector += n;
+        count -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef SD_XFER_H_
+#define SD_XFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The host controller moves the data of a transfer by DMA, from and to the
+ * internal RAM only. Given a buffer it can't reach, the driver goes through
+ * one of its own a sector at a time, with a command (and for writes, a wait
+ * for the card to program it) for each. Such buffers are copied through the
+ * bounce buffer here instead, as many sectors as it holds at once, so that
+ * they still go in multiple block commands (CMD18 / CMD25). */
+
+#define SD_XFER_BOUNCE_SECTORS                  (8)
+
+typedef struct _sd_xfer_t {
+    // count sectors in one command, 0 or an error that's passed on
+    int (*read)(void *ctx, void *buf, uint32_t sector, uint32_t count);
+    int (*write)(void *ctx, const void *buf, uint32_t sector, uint32_t count);
+    // if the controller can move the data from and to buf itself
+    bool (*dma_capable)(const void *buf);
+    void *ctx;
+    uint8_t *bounce;            // NULL leaves every buffer to the driver
+    uint32_t bounce_sectors;
+    uint32_t sector_size;
+} sd_xfer_t;
+
+extern int sd_xfer_read(const sd_xfer_t *xfer, void *buf, uint32_t sector, uint32_t count);
+extern int sd_xfer_write(const sd_xfer_t *xfer, const void *buf, uint32_t sector, uint32_t count);
+
+#endif /* SD_XFER_H_ */
@@ -141,15 +141,15 @@ DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count) {
     return RES_OK;
 }
 
-int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t size)
+int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t off, uint32_t size)
 {
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
 
-    if(block >= lfscfg->block_count) {
+    if(block >= lfscfg->block_count || off + size > SFLASH_BLOCK_SIZE) {
         ret = LFS_ERR_IO;
     }
-    else if (ESP_OK != spi_flash_read(sflash_start_address + block*SFLASH_BLOCK_SIZE, buff, size)) {
+    else if (ESP_OK != spi_flash_read(sflash_start_address + block*SFLASH_BLOCK_SIZE + off, buff, size)) {
         ret = LFS_ERR_IO;
     }
 
@@ -173,15 +173,15 @@ int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block)
     return ret;
 }
 
-int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff, uint32_t block, uint32_t size) {
+int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff, uint32_t block, uint32_t off, uint32_t size) {
 
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
 
-    if(block >= lfscfg->block_count) {
+    if(block >= lfscfg->block_count || off + size > SFLASH_BLOCK_SIZE) {
         ret = LFS_ERR_IO;
     }
-    else if(ESP_OK != spi_flash_write((sflash_start_address + block*SFLASH_BLOCK_SIZE), buff, size)) {
+    else if(ESP_OK != spi_flash_write((sflash_start_address + block*SFLASH_BLOCK_SIZE + off), buff, size)) {
         ret = LFS_ERR_IO;
     }
 
@@ -200,6 +200,28 @@ DRESULT sflash_disk_flush (void) {
     return RES_OK;
 }
 
+bool sflash_disk_mmap(uint32_t offset, uint32_t len, const void **ptr, uint32_t *handle) {
+    // the MMU maps whole pages
+    uint32_t addr = sflash_start_address + offset;
+    uint32_t page = addr & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+    spi_flash_mmap_handle_t mmap_handle;
+    const void *base;
+
+    if (len == 0 || offset + len > sflash_fs_sector_count * SFLASH_FS_SECTOR_SIZE) {
+        return false;
+    }
+    if (ESP_OK != spi_flash_mmap(page, addr + len - page, SPI_FLASH_MMAP_DATA, &base, &mmap_handle)) {
+        return false;
+    }
+    *ptr = (const uint8_t *)base + (addr - page);
+    *handle = mmap_handle;
+    return true;
+}
+
+void sflash_disk_munmap(uint32_t handle) {
+    spi_flash_munmap(handle);
+}
+
 uint32_t sflash_get_sector_count(void) {
     return sflash_fs_sector_count;
 }
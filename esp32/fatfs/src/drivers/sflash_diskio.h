@@ -33,9 +33,13 @@ DRESULT sflash_disk_read(BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_flush(void);
 uint32_t sflash_get_sector_count(void);
+// len bytes from offset in the file system, read through the flash cache, which
+// decrypts them if the flash is encrypted; what's written is seen right away
+bool sflash_disk_mmap(uint32_t offset, uint32_t len, const void **ptr, uint32_t *handle);
+void sflash_disk_munmap(uint32_t handle);
 
-extern int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t size);
-extern int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void* buff, uint32_t block, uint32_t size);
+extern int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t off, uint32_t size);
+extern int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void* buff, uint32_t block, uint32_t off, uint32_t size);
 extern int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block);
 
 #endif /* SFLASH_DISKIO_H_ */
@@ -8,49 +8,24 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <errno.h>
 
-#include "py/mpstate.h"
 #include "py/obj.h"
 
-//#include "pybrtc.h"
 #include "ftp.h"
+#include "ftpfs.h"
 #include "updater.h"
-#include "modnetwork.h"
-//#include "modwlan.h"
 #include "modusocket.h"
-//#include "debug.h"
 #include "serverstask.h"
-#include "lib/oofatfs/ff.h"
-#include "extmod/vfs.h"
-#include "extmod/vfs_fat.h"
-#include "vfs_littlefs.h"
-#include "lfs.h"
-#include "fifo.h"
-#include "socketfifo.h"
+#include "serverscore.h"
 #include "timeutils.h"
-#include "moduos.h"
-
-#include "esp_heap_caps.h"
-#include "sdkconfig.h"
-#include "esp_system.h"
-#include "esp_spi_flash.h"
-#include "nvs_flash.h"
-
-#include "esp_wifi.h"
-
-#include "lwip/sockets.h"
-#include "lwip/dns.h"
-#include "lwip/netdb.h"
-
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-
 #include "machrtc.h"
 
-#include "mptask.h"
+#include "lwip/sockets.h"
 
 #include "esp32_mphal.h"
 //#define MSG(fmt, ...) printf("[%u] ftp: " fmt, mp_hal_ticks_ms(), ##__VA_ARGS__)
@@ -59,21 +34,35 @@
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
+#ifndef FTP_CMD_PORT
 #define FTP_CMD_PORT                        21
+#endif
 #define FTP_ACTIVE_DATA_PORT                20
-#define FTP_PASIVE_DATA_PORT                2024
-#define FTP_BUFFER_SIZE                     512
-#define FTP_TX_RETRIES_MAX                  50
+#ifndef FTP_PASIVE_DATA_PORT
+#define FTP_PASIVE_DATA_PORT                2024            // plus the session index
+#endif
+#ifndef FTP_BUFFER_SIZE
+#define FTP_BUFFER_SIZE                     4096            // per session, used as two halves
+#endif
+#ifndef FTP_CMD_CLIENTS_MAX
+#define FTP_CMD_CLIENTS_MAX                 2               // concurrent sessions
+#endif
+#define FTP_DATA_CLIENTS_MAX                1               // per session
+#define FTP_BURST_SIZE                      (FTP_BUFFER_SIZE * 4)
 #define FTP_CMD_SIZE_MAX                    6
-#define FTP_CMD_CLIENTS_MAX                 1
-#define FTP_DATA_CLIENTS_MAX                1
 #define FTP_MAX_PARAM_SIZE                  (MICROPY_ALLOC_PATH_MAX + 1)
+#define FTP_CMD_BUFFER_SIZE                 (FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX)
+#define FTP_REPLY_BUFFER_SIZE               (2 * (FTP_MAX_PARAM_SIZE + 8))
 #define FTP_UNIX_TIME_20000101              946684800ll
 #define FTP_UNIX_TIME_20150101              1420070400ll
 #define FTP_UNIX_SECONDS_180_DAYS           15552000ll
 #define FTP_DATA_TIMEOUT_MS                 10000            // 10 seconds
-#define FTP_SOCKETFIFO_ELEMENTS_MAX         5
-#define FTP_CYCLE_TIME_MS                   (SERVERS_CYCLE_TIME_MS * 2)
+
+// a directory entry must fit in half a buffer, and the updater erases only
+// one flash sector ahead of the chunk being written
+#if FTP_BUFFER_SIZE < 1024 || FTP_BUFFER_SIZE > 8192
+#error "FTP_BUFFER_SIZE must be between 1024 and 8192 bytes"
+#endif
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -117,51 +106,48 @@ typedef enum {
     E_FTP_CLOSE_CMD_AND_DATA,
 } ftp_e_closesocket_t;
 
-typedef struct {
-    union {
-    FIL                   fp_fat;
-    pycom_lfs_file_t      fp_lfs;
-    } u;
-}ftp_file_t;
-
-typedef struct {
-    union {
-        FF_DIR          dp_fat;
-        lfs_dir_t       dp_lfs;
-    } u;
-}ftp_dir_t;
-
-typedef struct {
-    union {
-        FILINFO                fpinfo_fat;
-        lfs_ftp_file_stat_t    fpinfo_lfs;
-    } u;
-}ftp_fileinfo_t;
-
+// One FTP client. The data buffer is a two halves ring: while the socket
+// drains one half the next block of the file is read into the other one
+// (or the received half is written to the file while the other one fills).
+// dhead and dtail count the bytes put into and taken out of the ring.
 typedef struct {
     uint8_t             *dBuffer;
-    uint32_t            ctimeout;
-    union {
-        ftp_file_t fp;
-        ftp_dir_t  dp;
-    }u;
-    int32_t             lc_sd;
+    char                *path;
+    char                *prev;
+    char                *scratch;
+    char                *cmd;
+    ftpfs_handle_t      *fh;
+    uint32_t            cactive;        // ticks of the last control and data activity
     int32_t             ld_sd;
     int32_t             c_sd;
     int32_t             d_sd;
-    int32_t             dtimeout;
+    uint32_t            dactive;
+    uint32_t            dhead;
+    uint32_t            dtail;
     uint32_t            volcount;
     uint32_t            ip_addr;
+    uint16_t            dport;
+    uint16_t            rlen;
+    uint16_t            rsent;
     uint8_t             state;
     uint8_t             substate;
-    uint8_t             txRetries;
-    uint8_t             logginRetries;
+    uint8_t             closesockets;
     ftp_loggin_t        loggin;
     uint8_t             e_open;
     bool                closechild;
-    bool                enabled;
     bool                special_file;
     bool                listroot;
+    bool                listpending;
+    bool                deof;
+    ftpfs_info_t        listinfo;
+    char                reply[FTP_REPLY_BUFFER_SIZE];
+} ftp_session_t;
+
+typedef struct {
+    ftp_session_t       session[FTP_CMD_CLIENTS_MAX];
+    int32_t             lc_sd;
+    uint8_t             state;
+    bool                enabled;
 } ftp_data_t;
 
 typedef struct {
@@ -203,9 +189,6 @@ typedef enum {
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static ftp_data_t ftp_data;
-static char *ftp_path;
-static char *ftp_scratch_buffer;
-static char *ftp_cmd_buffer;
 static const ftp_cmd_t ftp_cmd_table[] = { { "FEAT" }, { "SYST" }, { "CDUP" }, { "CWD"  },
                                            { "PWD"  }, { "XPWD" }, { "SIZE" }, { "MDTM" },
                                            { "TYPE" }, { "USER" }, { "PASS" }, { "PASV" },
@@ -217,568 +200,105 @@ static const ftp_month_t ftp_month[] = { { "Jan" }, { "Feb" }, { "Mar" }, { "Apr
                                          { "May" }, { "Jun" }, { "Jul" }, { "Ago" },
                                          { "Sep" }, { "Oct" }, { "Nov" }, { "Dec" } };
 
-static SocketFifoElement_t ftp_fifoelements[FTP_SOCKETFIFO_ELEMENTS_MAX];
-static FIFO_t ftp_socketfifo;
-static uint32_t ftp_last_dir_idx;
-static const TCHAR *path_relative;
-
-/******************************************************************************
- DEFINE VFS WRAPPER FUNCTIONS
- ******************************************************************************/
-
-// These wrapper functions are used so that the FTP server can access the
-// mounted FATFS devices directly without going through the costly mp_vfs_XXX
-// functions.  The latter may raise exceptions and we would then need to wrap
-// all calls in an nlr handler.  The wrapper functions below assume that there
-// are only FATFS filesystems mounted.
-
-
-STATIC FRESULT f_open_helper(ftp_file_t *fp, const TCHAR *path, BYTE mode) {
-
-    if(isLittleFs(path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = littlefs_open_common_helper(&littlefs->lfs, path_relative, &fp->u.fp_lfs.fp, fatFsModetoLittleFsMode(mode), &fp->u.fp_lfs.cfg, &fp->u.fp_lfs.timestamp_update);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_open(fs, &fp->u.fp_fat, path_relative, mode);
-    }
-}
-
-STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize ) {
-
-    if(isLittleFs(ftp_path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            *actualsize = lfs_file_read(&littlefs->lfs, &fp->u.fp_lfs.fp, buff, desiredsize);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(*actualsize);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_read(&fp->u.fp_fat, buff, desiredsize, actualsize);
-    }
-}
-
-STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize) {
-
-    if(isLittleFs(ftp_path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            *actualsize = lfs_file_write(&littlefs->lfs, &fp->u.fp_lfs.fp, buff, desiredsize);
-            // Request timestamp update if file has been written successfully
-            if(*actualsize >= 0) {
-                fp->u.fp_lfs.timestamp_update = true;
-            }
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(*actualsize);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_write(&fp->u.fp_fat, buff, desiredsize, actualsize);
-    }
-}
-
-STATIC FRESULT f_readdir_helper(ftp_dir_t *dp, ftp_fileinfo_t *fno ) {
-
-    if(isLittleFs(ftp_path))
-    {
-
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-
-            int lfs_ret = lfs_dir_read(&littlefs->lfs, &dp->u.dp_lfs, &fno->u.fpinfo_lfs.info);
-
-            // Fetch the timestamp for valid files, filter out empty, "." and ".." entries
-            if((lfs_ret >= LFS_ERR_OK) &&
-               !(fno->u.fpinfo_lfs.info.name[0] == 0) &&
-               !(fno->u.fpinfo_lfs.info.name[0] == '.' && fno->u.fpinfo_lfs.info.name[1] == 0) &&
-               !(fno->u.fpinfo_lfs.info.name[0] == '.' && fno->u.fpinfo_lfs.info.name[1] == '.' && fno->u.fpinfo_lfs.info.name[2] == 0))
-            {
-                // Length of the relative path
-                size_t length_of_relative_path = strlen(path_relative);
-
-                // Calculate the length of the relative path of the file with the name of the file plus closing /0
-                size_t path_length = length_of_relative_path + strlen(fno->u.fpinfo_lfs.info.name) + 1;
-
-                // If the current directory is not root directory need to append extra "/" at the end of relative path
-                if(length_of_relative_path > 1) {
-                    path_length++;
-                }
-                char* file_relative_path = malloc(path_length);
-
-                // Copy the current working directory (relative path)
-                memcpy(file_relative_path, path_relative, length_of_relative_path);
-
-                // Append the "/" at the end of current working directory path if needed
-                if(length_of_relative_path > 1) {
-                    memcpy(&file_relative_path[length_of_relative_path], "/", 1);
-                    // Modify the length of relative path to include the closing "/"
-                    length_of_relative_path++;
-                }
-                // Copy the name of the file after the current working directory, this will copy the closing /0
-                strcpy(&file_relative_path[length_of_relative_path], fno->u.fpinfo_lfs.info.name);
-
-                int lfs_getattr_ret = lfs_getattr(&littlefs->lfs, file_relative_path, LFS_ATTRIBUTE_TIMESTAMP, &fno->u.fpinfo_lfs.timestamp, sizeof(lfs_timestamp_attribute_t));
-                // If no timestamp is saved for this entry, fill it with 0
-                if(lfs_getattr_ret < LFS_ERR_OK) {
-                    fno->u.fpinfo_lfs.timestamp.fdate = 0;
-                    fno->u.fpinfo_lfs.timestamp.ftime = 0;
-                }
-
-                free(file_relative_path);
-            }
-
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_readdir(&dp->u.dp_fat, &fno->u.fpinfo_fat);
-    }
-}
-
-STATIC FRESULT f_opendir_helper(ftp_dir_t *dp, const TCHAR *path) {
-
-    if(isLittleFs(path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(path, &path_relative);
-
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = lfs_dir_open(&littlefs->lfs, &dp->u.dp_lfs, path_relative);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(path, &path_relative);
-
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_opendir(fs, &dp->u.dp_fat, path_relative);
-    }
-}
-
-STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
-
-    if(isLittleFs(ftp_path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = littlefs_close_common_helper(&littlefs->lfs, &fp->u.fp_lfs.fp, &fp->u.fp_lfs.cfg, &fp->u.fp_lfs.timestamp_update);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_close(&fp->u.fp_fat);
-    }
-}
-
-STATIC FRESULT f_closedir_helper(ftp_dir_t *dp) {
-
-    if(isLittleFs(ftp_path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = lfs_dir_close(&littlefs->lfs, &dp->u.dp_lfs);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_closedir(&dp->u.dp_fat);
-    }
-}
-
-STATIC FRESULT f_stat_helper(const TCHAR *path, ftp_fileinfo_t *fno) {
-
-    if(isLittleFs(path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = littlefs_stat_common_helper(&littlefs->lfs, path_relative, &fno->u.fpinfo_lfs.info, &fno->u.fpinfo_lfs.timestamp);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_stat(fs, path_relative, &fno->u.fpinfo_fat);
-    }
-}
-
-STATIC FRESULT f_mkdir_helper(const TCHAR *path) {
-
-    if(isLittleFs(path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = lfs_mkdir(&littlefs->lfs, path_relative);
-            if(lfs_ret == LFS_ERR_OK) {
-                littlefs_update_timestamp(&littlefs->lfs, path_relative);
-            }
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_mkdir(fs, path_relative);
-    }
-
-}
-
-STATIC FRESULT f_unlink_helper(const TCHAR *path) {
-
-    if(isLittleFs(path))
-    {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(path, &path_relative);
-        if (littlefs == NULL) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            int lfs_ret = lfs_remove(&littlefs->lfs, path_relative);
-        xSemaphoreGive(littlefs->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs = lookup_path_fatfs(path, &path_relative);
-        if (fs == NULL) {
-            return FR_NO_PATH;
-        }
-        return f_unlink(fs, path_relative);
-    }
-}
-
-STATIC FRESULT f_rename_helper(const TCHAR *path_old, const TCHAR *path_new) {
-
-    const TCHAR *path_relative_old;
-    const TCHAR *path_relative_new;
-
-    if(isLittleFs(path_old))
-    {
-        vfs_lfs_struct_t* littlefs_old = lookup_path_littlefs(path_old, &path_relative_old);
-        vfs_lfs_struct_t* littlefs_new = lookup_path_littlefs(path_new, &path_relative_new);
-
-        if (littlefs_old == NULL) {
-            return FR_NO_PATH;
-        }
-        if (littlefs_new == NULL) {
-            return FR_NO_PATH;
-        }
-        if (littlefs_old != littlefs_new) {
-            return FR_NO_PATH;
-        }
-
-        xSemaphoreTake(littlefs_new->mutex, portMAX_DELAY);
-            int lfs_ret = lfs_rename(&littlefs_new->lfs, path_relative_old, path_relative_new);
-        xSemaphoreGive(littlefs_new->mutex);
-
-        return lfsErrorToFatFsError(lfs_ret);
-    }
-    else
-    {
-        FATFS *fs_old = lookup_path_fatfs(path_old, &path_relative_old);
-
-        FATFS *fs_new = lookup_path_fatfs(path_new, &path_relative_new);
-
-        if (fs_old == NULL) {
-            return FR_NO_PATH;
-        }
-        if (fs_new == NULL) {
-            return FR_NO_PATH;
-        }
-        if (fs_old != fs_new) {
-            return FR_NO_PATH;
-        }
-
-        return f_rename(fs_new, path_relative_old, path_relative_new);
-    }
-
-}
-
+static const char ftp_reply_busy[] = "421 Too many connections\r\n";
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
 static void ftp_wait_for_enabled (void);
 static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t backlog);
-static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr);
-static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len);
-static void ftp_send_reply (uint32_t status, char *message);
-static void ftp_send_data (uint32_t datasize);
-static void ftp_send_from_fifo (void);
+static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd);
+static void ftp_accept_session (void);
+static bool ftp_open_session (ftp_session_t *s, int32_t sd);
+static void ftp_close_session (ftp_session_t *s);
+static void ftp_run_session (ftp_session_t *s);
+static void ftp_prepare_session_wait (ftp_session_t *s, servers_wait_t *w);
+static void ftp_send_reply (ftp_session_t *s, uint32_t status, char *message);
+static void ftp_send_pending_reply (ftp_session_t *s);
+static void ftp_transfer_tx (ftp_session_t *s);
+static void ftp_transfer_rx (ftp_session_t *s);
+static void ftp_end_transfer (ftp_session_t *s, uint32_t status);
 static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxlen, int32_t *rxLen);
-static void ftp_process_cmd (void);
-static void ftp_close_files (void);
-static void ftp_close_filesystem_on_error (void);
-static void ftp_close_cmd_data (void);
+static void ftp_process_cmd (ftp_session_t *s);
+static void ftp_close_files (ftp_session_t *s);
+static void ftp_close_filesystem_on_error (ftp_session_t *s);
+static bool ftp_updater_in_use (void);
 static ftp_cmd_index_t ftp_pop_command (char **str);
-static void ftp_pop_param (char **str, char *param, bool stop_on_space);
-static int ftp_print_eplf_item (char *dest, uint32_t destsize, ftp_fileinfo_t *fno);
+static void ftp_pop_param (char **str, char *param, uint32_t size, bool stop_on_space);
+static int ftp_print_eplf_item (char *dest, uint32_t destsize, const ftpfs_info_t *fno);
 static int ftp_print_eplf_drive (char *dest, uint32_t destsize, const char *name);
-static bool ftp_open_file (const char *path, int mode);
-static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t *actualsize);
-static ftp_result_t ftp_write_file (char *filebuf, uint32_t size);
-static ftp_result_t ftp_open_dir_for_listing (const char *path);
-static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *listsize);
+static void ftp_start_transfer (ftp_session_t *s, ftp_state_t state);
+static bool ftp_open_file (ftp_session_t *s, const char *path, bool write);
+static ftp_result_t ftp_read_file (ftp_session_t *s, char *filebuf, uint32_t desiredsize, uint32_t *actualsize);
+static bool ftp_write_file (ftp_session_t *s, uint8_t *filebuf, uint32_t size);
+static ftp_result_t ftp_open_dir_for_listing (ftp_session_t *s, const char *path);
+static ftp_result_t ftp_list_dir (ftp_session_t *s, char *list, uint32_t maxlistsize, uint32_t *listsize);
 static void ftp_open_child (char *pwd, char *dir);
 static void ftp_close_child (char *pwd);
-static void ftp_return_to_previous_path (char *pwd, char *dir);
 
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
 void ftp_init (void) {
-    // allocate memory for the data buffer, and the file system structs (from the RTOS heap)
-    ftp_data.dBuffer = malloc(FTP_BUFFER_SIZE);
-    ftp_path = malloc(FTP_MAX_PARAM_SIZE);
-    ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
-    ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    SOCKETFIFO_Init (&ftp_socketfifo, (void *)ftp_fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
+    // the session buffers are allocated when a client connects
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_session_t *s = &ftp_data.session[i];
+        memset(s, 0, sizeof(ftp_session_t));
+        s->c_sd  = -1;
+        s->d_sd  = -1;
+        s->ld_sd = -1;
+        s->dport = FTP_PASIVE_DATA_PORT + i;
+    }
     ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
     ftp_data.state = E_FTP_STE_DISABLED;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.special_file = false;
-    ftp_data.volcount = 0;
-    ftp_last_dir_idx = 0;
 }
 
 void ftp_run (void) {
     switch (ftp_data.state) {
         case E_FTP_STE_DISABLED:
             ftp_wait_for_enabled();
-            break;
+            if (ftp_data.state != E_FTP_STE_START) {
+                break;
+            }
+            // fall through, to start listening right away
         case E_FTP_STE_START:
-            if (/*wlan_is_connected() && */ ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
+            if (/*wlan_is_connected() && */ ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX)) {
                 ftp_data.state = E_FTP_STE_READY;
             }
             break;
         case E_FTP_STE_READY:
-            if (ftp_data.c_sd < 0 && ftp_data.substate == E_FTP_STE_SUB_DISCONNECTED) {
-                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.lc_sd, &ftp_data.c_sd, &ftp_data.ip_addr)) {
-                    ftp_data.txRetries = 0;
-                    ftp_data.logginRetries = 0;
-                    ftp_data.ctimeout = 0;
-                    ftp_data.loggin.uservalid = false;
-                    ftp_data.loggin.passvalid = false;
-                    strcpy (ftp_path, "/");
-                    ftp_send_reply (220, "Micropython FTP Server");
-                    break;
-                }
-            }
-            if (SOCKETFIFO_IsEmpty()) {
-                if (ftp_data.c_sd > 0 && ftp_data.substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
-                    ftp_process_cmd();
-                    if (ftp_data.state != E_FTP_STE_READY) {
-                        break;
-                    }
+            ftp_accept_session();
+            for (int i = 0; i < FTP_CMD_CLIENTS_MAX && ftp_data.state == E_FTP_STE_READY; i++) {
+                if (ftp_data.session[i].c_sd > 0) {
+                    ftp_run_session(&ftp_data.session[i]);
                 }
             }
             break;
-        case E_FTP_STE_END_TRANSFER:
-            break;
-        case E_FTP_STE_CONTINUE_LISTING:
-            // go on with listing only if the transmit buffer is empty
-            if (SOCKETFIFO_IsEmpty()) {
-                uint32_t listsize;
-                ftp_list_dir((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &listsize);
-                if (listsize > 0) {
-                    ftp_send_data(listsize);
-                } else {
-                    ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                }
-                ftp_data.ctimeout = 0;
-            }
+        default:
             break;
-        case E_FTP_STE_CONTINUE_FILE_TX:
-            // read the next block from the file only if the previous one has been sent
-            if (SOCKETFIFO_IsEmpty()) {
-                uint32_t readsize;
-                ftp_result_t result;
-                ftp_data.ctimeout = 0;
-                result = ftp_read_file ((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &readsize);
-                if (result == E_FTP_RESULT_FAILED) {
-                    ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                } else {
-                    if (readsize > 0) {
-                        ftp_send_data(readsize);
-                    }
-                    if (result == E_FTP_RESULT_OK) {
-                        ftp_send_reply(226, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
-                    }
-                }
+    }
+}
+
+void ftp_prepare_wait (servers_wait_t *w) {
+    switch (ftp_data.state) {
+        case E_FTP_STE_DISABLED:
+            if (ftp_data.enabled) {
+                servers_wait_timeout(w, 0);
             }
             break;
-        case E_FTP_STE_CONTINUE_FILE_RX:
-            if (SOCKETFIFO_IsEmpty()) {
-                int32_t len;
-                ftp_result_t result;
-                if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.d_sd, ftp_data.dBuffer, FTP_BUFFER_SIZE, &len))) {
-                    ftp_data.dtimeout = 0;
-                    ftp_data.ctimeout = 0;
-                    // its a software update
-                    if (ftp_data.special_file) {
-                        if (updater_write(ftp_data.dBuffer, len)) {
-                            break;
-                        }
-                    }
-                    // user file being received
-                    else if (E_FTP_RESULT_OK == ftp_write_file ((char *)ftp_data.dBuffer, len)) {
-                        break;
-                    }
-                    ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                } else if (result == E_FTP_RESULT_CONTINUE) {
-                    if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
-                        ftp_close_files();
-                        ftp_send_reply(426, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
-                    }
-                } else {
-                    if (ftp_data.special_file) {
-                        ftp_data.special_file = false;
-                        updater_finish();
-                    }
-                    ftp_close_files();
-                    ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+        case E_FTP_STE_READY:
+            servers_wait_read(w, ftp_data.lc_sd);
+            for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+                if (ftp_data.session[i].c_sd > 0) {
+                    ftp_prepare_session_wait(&ftp_data.session[i], w);
                 }
             }
             break;
         default:
+            // retry the listening socket after an idle period
             break;
     }
-
-    switch (ftp_data.substate) {
-    case E_FTP_STE_SUB_DISCONNECTED:
-        break;
-    case E_FTP_STE_SUB_LISTEN_FOR_DATA:
-        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.ld_sd, &ftp_data.d_sd, NULL)) {
-            ftp_data.dtimeout = 0;
-            ftp_data.substate = E_FTP_STE_SUB_DATA_CONNECTED;
-        } else if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
-            ftp_data.dtimeout = 0;
-            // close the listening socket
-            servers_close_socket(&ftp_data.ld_sd);
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        }
-        break;
-    case E_FTP_STE_SUB_DATA_CONNECTED:
-        if (ftp_data.state == E_FTP_STE_READY && ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
-            // close the listening and the data socket
-            servers_close_socket(&ftp_data.ld_sd);
-            servers_close_socket(&ftp_data.d_sd);
-            ftp_close_filesystem_on_error ();
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        }
-        break;
-    default:
-        break;
-    }
-
-    // send data pending in the queue
-    ftp_send_from_fifo();
-
-    // check the state of the data sockets
-    if (ftp_data.d_sd < 0 && (ftp_data.state > E_FTP_STE_READY)) {
-        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        ftp_data.state = E_FTP_STE_READY;
-    }
 }
 
 void ftp_enable (void) {
@@ -794,12 +314,10 @@ void ftp_disable (void) {
 void ftp_reset (void) {
     // close all connections and start all over again
     servers_close_socket(&ftp_data.lc_sd);
-    servers_close_socket(&ftp_data.ld_sd);
-    ftp_close_cmd_data();
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_close_session(&ftp_data.session[i]);
+    }
     ftp_data.state = E_FTP_STE_START;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.volcount = 0;
-    SOCKETFIFO_Flush();
 }
 
 /******************************************************************************
@@ -835,9 +353,9 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
         result = setsockopt(_sd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
 
         // bind the socket to a port number
+        memset(&sServerAddress, 0, sizeof(sServerAddress));
         sServerAddress.sin_family = AF_INET;
         sServerAddress.sin_addr.s_addr = INADDR_ANY;
-        sServerAddress.sin_len = sizeof(sServerAddress);
         sServerAddress.sin_port = htons(port);
 
         result |= bind(_sd, (const struct sockaddr *)&sServerAddress, sizeof(sServerAddress));
@@ -853,9 +371,9 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
     return false;
 }
 
-static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr) {
+static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd) {
     struct sockaddr_in  sClientAddress;
-    socklen_t  in_addrSize;
+    socklen_t  in_addrSize = sizeof(sClientAddress);
 
     // accepts a connection from a TCP client, if there is any, otherwise returns EAGAIN
     *n_sd = accept(l_sd, (struct sockaddr *)&sClientAddress, (socklen_t *)&in_addrSize);
@@ -865,36 +383,9 @@ static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32
             return E_FTP_RESULT_CONTINUE;
         }
         // error
-        ftp_reset();
         return E_FTP_RESULT_FAILED;
     }
 
-    if (ip_addr) {
-        tcpip_adapter_ip_info_t ip_info;
-
-        bool adapter_found = false;
-#ifdef PYETH_ENABLED
-        if ( tcpip_adapter_is_netif_up(TCPIP_ADAPTER_IF_ETH) ) {
-            tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip_info);
-            adapter_found = true;
-        }
-#endif
-
-        if ( !adapter_found && tcpip_adapter_is_netif_up(TCPIP_ADAPTER_IF_AP) ){
-            tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_AP, &ip_info);
-            adapter_found = true;
-        }
-
-        if ( !adapter_found && tcpip_adapter_is_netif_up(TCPIP_ADAPTER_IF_STA) ){
-            tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &ip_info);
-            adapter_found = true;
-        }
-
-        MSG("fwfc ip=%08x nm=%08x gw=%08x cl=%08x\n", ip_info.ip.addr, ip_info.netmask.addr, ip_info.gw.addr, sClientAddress.sin_addr.s_addr);
-        MSG("fwfc ip=" IPSTR " nm=" IPSTR " gw=" IPSTR "\n", IP2STR(&ip_info.ip), IP2STR(&ip_info.netmask), IP2STR(&ip_info.gw) );
-        *ip_addr = ip_info.ip.addr;
-    }
-
     // add the new socket to the network administration
     modusocket_socket_add(_sd, false);
 
@@ -907,100 +398,365 @@ static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32
     return E_FTP_RESULT_OK;
 }
 
-static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len) {
-    // make it blocking
-    uint32_t option = fcntl(sd, F_GETFL, 0);
-    option &= ~O_NONBLOCK;
-    fcntl(sd, F_SETFL, option);
-    int32_t result = send(sd, data, Len, 0);
-    // make it non-blocking again
-    option |= O_NONBLOCK;
-    fcntl(sd, F_SETFL, option);
+static void ftp_accept_session (void) {
+    ftp_session_t *s = NULL;
+    int32_t sd;
+    ftp_result_t result = ftp_wait_for_connection(ftp_data.lc_sd, &sd);
 
-    if (result > 0) {
-        ftp_data.txRetries = 0;
-        return E_FTP_RESULT_OK;
-    } else if ((FTP_TX_RETRIES_MAX >= ++ftp_data.txRetries) && (errno == EAGAIN)) {
-        return E_FTP_RESULT_CONTINUE;
-    } else {
-        // error
+    if (result == E_FTP_RESULT_FAILED) {
         ftp_reset();
-        return E_FTP_RESULT_FAILED;
+        return;
+    } else if (result != E_FTP_RESULT_OK) {
+        return;
+    }
+
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        if (ftp_data.session[i].c_sd < 0) {
+            s = &ftp_data.session[i];
+            break;
+        }
+    }
+    if (s == NULL || !ftp_open_session(s, sd)) {
+        // no room for another session, tell the client before hanging up
+        send(sd, ftp_reply_busy, sizeof(ftp_reply_busy) - 1, 0);
+        servers_close_socket(&sd);
+    }
+}
+
+static bool ftp_open_session (ftp_session_t *s, int32_t sd) {
+    struct sockaddr_in sLocalAddress;
+    socklen_t in_addrSize = sizeof(sLocalAddress);
+
+    // one allocation for the data buffer, the paths, the scratch and the command buffers
+    s->dBuffer = malloc(FTP_BUFFER_SIZE + (3 * FTP_MAX_PARAM_SIZE) + FTP_CMD_BUFFER_SIZE);
+    if (s->dBuffer == NULL) {
+        return false;
+    }
+    s->path = (char *)s->dBuffer + FTP_BUFFER_SIZE;
+    s->prev = s->path + FTP_MAX_PARAM_SIZE;
+    s->scratch = s->prev + FTP_MAX_PARAM_SIZE;
+    s->cmd = s->scratch + FTP_MAX_PARAM_SIZE;
+
+    // the passive mode replies carry the address the client connected to
+    s->ip_addr = 0;
+    if (!getsockname(sd, (struct sockaddr *)&sLocalAddress, &in_addrSize)) {
+        s->ip_addr = sLocalAddress.sin_addr.s_addr;
+    }
+
+    s->c_sd = sd;
+    s->fh = NULL;
+    s->e_open = E_FTP_NOTHING_OPEN;
+    s->state = E_FTP_STE_READY;
+    s->substate = E_FTP_STE_SUB_DISCONNECTED;
+    s->closesockets = E_FTP_CLOSE_NONE;
+    s->rlen = 0;
+    s->rsent = 0;
+    s->cactive = mp_hal_ticks_ms();
+    s->special_file = false;
+    s->loggin.uservalid = false;
+    s->loggin.passvalid = false;
+    strcpy (s->path, "/");
+    ftp_send_reply (s, 220, "Micropython FTP Server");
+    return true;
+}
+
+static void ftp_close_session (ftp_session_t *s) {
+    servers_close_socket(&s->c_sd);
+    servers_close_socket(&s->d_sd);
+    servers_close_socket(&s->ld_sd);
+    ftp_close_filesystem_on_error(s);
+    free(s->dBuffer);
+    s->dBuffer = NULL;
+    s->rlen = 0;
+    s->rsent = 0;
+    s->state = E_FTP_STE_READY;
+    s->substate = E_FTP_STE_SUB_DISCONNECTED;
+}
+
+static void ftp_run_session (ftp_session_t *s) {
+    switch (s->state) {
+        case E_FTP_STE_READY:
+            // take a new command only once the previous replies are out
+            if (s->rlen == 0 && s->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+                ftp_process_cmd(s);
+            }
+            break;
+        case E_FTP_STE_END_TRANSFER:
+            break;
+        case E_FTP_STE_CONTINUE_LISTING:
+        case E_FTP_STE_CONTINUE_FILE_TX:
+            ftp_transfer_tx(s);
+            break;
+        case E_FTP_STE_CONTINUE_FILE_RX:
+            ftp_transfer_rx(s);
+            break;
+        default:
+            break;
+    }
+
+    switch (s->substate) {
+    case E_FTP_STE_SUB_DISCONNECTED:
+        break;
+    case E_FTP_STE_SUB_LISTEN_FOR_DATA:
+        if (E_FTP_RESULT_OK == ftp_wait_for_connection(s->ld_sd, &s->d_sd)) {
+            s->dactive = mp_hal_ticks_ms();
+            s->substate = E_FTP_STE_SUB_DATA_CONNECTED;
+        } else if (servers_timed_out(s->dactive, FTP_DATA_TIMEOUT_MS)) {
+            // close the listening socket
+            servers_close_socket(&s->ld_sd);
+            s->substate = E_FTP_STE_SUB_DISCONNECTED;
+        }
+        break;
+    case E_FTP_STE_SUB_DATA_CONNECTED:
+        if (s->state == E_FTP_STE_READY && servers_timed_out(s->dactive, FTP_DATA_TIMEOUT_MS)) {
+            // close the listening and the data socket
+            servers_close_socket(&s->ld_sd);
+            servers_close_socket(&s->d_sd);
+            ftp_close_filesystem_on_error (s);
+            s->substate = E_FTP_STE_SUB_DISCONNECTED;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // send the replies pending in the queue
+    ftp_send_pending_reply(s);
+
+    if (s->c_sd < 0) {
+        // the client is gone or has been told to go
+        ftp_close_session(s);
+    } else if (s->d_sd < 0 && (s->state > E_FTP_STE_READY)) {
+        // check the state of the data sockets
+        s->substate = E_FTP_STE_SUB_DISCONNECTED;
+        s->state = E_FTP_STE_READY;
     }
 }
 
-static void ftp_send_reply (uint32_t status, char *message) {
-    SocketFifoElement_t fifoelement;
+static void ftp_prepare_session_wait (ftp_session_t *s, servers_wait_t *w) {
+    if (s->rlen > 0) {
+        // nothing else moves until the replies are out
+        servers_wait_write(w, s->c_sd);
+        servers_wait_until(w, s->cactive, servers_get_timeout());
+        return;
+    }
+
+    switch (s->state) {
+        case E_FTP_STE_READY:
+            if (s->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+                servers_wait_read(w, s->c_sd);
+                servers_wait_until(w, s->cactive, servers_get_timeout());
+            }
+            break;
+        case E_FTP_STE_CONTINUE_LISTING:
+        case E_FTP_STE_CONTINUE_FILE_TX:
+            servers_wait_write(w, s->d_sd);
+            servers_wait_until(w, s->dactive, FTP_DATA_TIMEOUT_MS);
+            break;
+        case E_FTP_STE_CONTINUE_FILE_RX:
+            servers_wait_read(w, s->d_sd);
+            servers_wait_until(w, s->dactive, FTP_DATA_TIMEOUT_MS);
+            break;
+        default:
+            // the transfer is being wound up, finish it right away
+            servers_wait_timeout(w, 0);
+            break;
+    }
+
+    switch (s->substate) {
+        case E_FTP_STE_SUB_LISTEN_FOR_DATA:
+            servers_wait_read(w, s->ld_sd);
+            servers_wait_until(w, s->dactive, FTP_DATA_TIMEOUT_MS);
+            break;
+        case E_FTP_STE_SUB_DATA_CONNECTED:
+            if (s->state == E_FTP_STE_READY) {
+                servers_wait_until(w, s->dactive, FTP_DATA_TIMEOUT_MS);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void ftp_send_reply (ftp_session_t *s, uint32_t status, char *message) {
+    uint32_t room = FTP_REPLY_BUFFER_SIZE - s->rlen;
+    int len;
+
     if (!message) {
         message = "";
     }
-    snprintf((char *)ftp_cmd_buffer, 4, "%u", status);
-    strcat ((char *)ftp_cmd_buffer, " ");
-    strcat ((char *)ftp_cmd_buffer, message);
-    strcat ((char *)ftp_cmd_buffer, "\r\n");
-    fifoelement.sd = &ftp_data.c_sd;
-    fifoelement.datasize = strlen((char *)ftp_cmd_buffer);
-    fifoelement.data = malloc(fifoelement.datasize);
+    len = snprintf(&s->reply[s->rlen], room, "%u %s\r\n", status, message);
+    if (len < 0 || len >= room) {
+        // the queue is full, the reply is dropped
+        return;
+    }
+    s->rlen += len;
+
+    // the sockets are closed once the reply has been sent
     if (status == 221) {
-        fifoelement.closesockets = E_FTP_CLOSE_CMD_AND_DATA;
-    } else if (status == 426 || status == 451 || status == 550) {
-        fifoelement.closesockets = E_FTP_CLOSE_DATA;
-    } else {
-        fifoelement.closesockets = E_FTP_CLOSE_NONE;
+        s->closesockets = E_FTP_CLOSE_CMD_AND_DATA;
+    } else if ((status == 426 || status == 451 || status == 550) && s->closesockets == E_FTP_CLOSE_NONE) {
+        s->closesockets = E_FTP_CLOSE_DATA;
     }
-    fifoelement.freedata = true;
-    if (fifoelement.data) {
-        memcpy (fifoelement.data, ftp_cmd_buffer, fifoelement.datasize);
-        if (!SOCKETFIFO_Push (&fifoelement)) {
-            free(fifoelement.data);
+}
+
+static void ftp_send_pending_reply (ftp_session_t *s) {
+    if (s->rlen > 0) {
+        int32_t result = send(s->c_sd, &s->reply[s->rsent], s->rlen - s->rsent, 0);
+        if (result > 0) {
+            s->rsent += result;
+        } else if (errno != EAGAIN || servers_timed_out(s->cactive, servers_get_timeout())) {
+            // error, or the client stopped reading
+            servers_close_socket(&s->c_sd);
+            return;
+        }
+        if (s->rsent < s->rlen) {
+            return;
+        }
+        s->rlen = 0;
+        s->rsent = 0;
+
+        if (s->closesockets != E_FTP_CLOSE_NONE) {
+            servers_close_socket(&s->d_sd);
+            if (s->closesockets == E_FTP_CLOSE_CMD_AND_DATA) {
+                servers_close_socket(&s->ld_sd);
+                servers_close_socket(&s->c_sd);
+                s->substate = E_FTP_STE_SUB_DISCONNECTED;
+            }
+            ftp_close_filesystem_on_error(s);
+            s->closesockets = E_FTP_CLOSE_NONE;
+        }
+    } else if (s->state == E_FTP_STE_END_TRANSFER && (s->d_sd > 0)) {
+        // close the listening and the data sockets
+        servers_close_socket(&s->ld_sd);
+        servers_close_socket(&s->d_sd);
+        if (s->special_file) {
+            s->special_file = false;
         }
     }
 }
 
-static void ftp_send_data (uint32_t datasize) {
-    SocketFifoElement_t fifoelement;
+static void ftp_end_transfer (ftp_session_t *s, uint32_t status) {
+    ftp_close_files(s);
+    if (status == 226) {
+        // the data must be complete before the client is told so
+        servers_close_socket(&s->ld_sd);
+        servers_close_socket(&s->d_sd);
+    }
+    ftp_send_reply(s, status, NULL);
+    s->state = E_FTP_STE_END_TRANSFER;
+}
+
+static void ftp_transfer_tx (ftp_session_t *s) {
+    const uint32_t half = FTP_BUFFER_SIZE / 2;
+    uint32_t moved = 0;
+
+    while (moved < FTP_BURST_SIZE) {
+        if (s->dhead == s->dtail) {
+            if (s->deof) {
+                ftp_end_transfer(s, 226);
+                return;
+            }
+            s->dhead = 0;
+            s->dtail = 0;
+        }
+
+        // read ahead into the free half while the socket drains the other one
+        if (!s->deof && (s->dhead % half) == 0 && (s->dhead - s->dtail) <= half) {
+            uint32_t readsize;
+            char *dest = (char *)&s->dBuffer[s->dhead % FTP_BUFFER_SIZE];
+            ftp_result_t result;
+
+            if (s->state == E_FTP_STE_CONTINUE_LISTING) {
+                result = ftp_list_dir(s, dest, half, &readsize);
+            } else {
+                result = ftp_read_file(s, dest, half, &readsize);
+            }
+            if (result == E_FTP_RESULT_FAILED) {
+                ftp_end_transfer(s, 451);
+                return;
+            }
+            s->dhead += readsize;
+            s->deof = (result == E_FTP_RESULT_OK);
+        }
 
-    fifoelement.data = ftp_data.dBuffer;
-    fifoelement.datasize = datasize;
-    fifoelement.sd = &ftp_data.d_sd;
-    fifoelement.closesockets = E_FTP_CLOSE_NONE;
-    fifoelement.freedata = false;
-    SOCKETFIFO_Push (&fifoelement);
+        uint32_t len = MIN(s->dhead - s->dtail, FTP_BUFFER_SIZE - (s->dtail % FTP_BUFFER_SIZE));
+        if (len == 0) {
+            continue;
+        }
+        int32_t sent = send(s->d_sd, &s->dBuffer[s->dtail % FTP_BUFFER_SIZE], len, 0);
+        if (sent > 0) {
+            s->dtail += sent;
+            moved += sent;
+            s->dactive = mp_hal_ticks_ms();
+            s->cactive = s->dactive;
+        } else if (errno == EAGAIN) {
+            // the socket is full, carry on once it drains
+            if (moved == 0 && servers_timed_out(s->dactive, FTP_DATA_TIMEOUT_MS)) {
+                ftp_end_transfer(s, 426);
+            }
+            return;
+        } else {
+            ftp_end_transfer(s, 426);
+            return;
+        }
+    }
 }
 
-static void ftp_send_from_fifo (void) {
-    SocketFifoElement_t fifoelement;
-    if (SOCKETFIFO_Peek (&fifoelement)) {
-        int32_t _sd = *fifoelement.sd;
-        if (_sd > 0) {
-            if (E_FTP_RESULT_OK == ftp_send_non_blocking (_sd, fifoelement.data, fifoelement.datasize)) {
-                SOCKETFIFO_Pop (&fifoelement);
-                if (fifoelement.closesockets != E_FTP_CLOSE_NONE) {
-                    servers_close_socket(&ftp_data.d_sd);
-                    if (fifoelement.closesockets == E_FTP_CLOSE_CMD_AND_DATA) {
-                        servers_close_socket(&ftp_data.ld_sd);
-                        // this one is the command socket
-                        servers_close_socket(fifoelement.sd);
-                        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-                    }
-                    ftp_close_filesystem_on_error();
-                }
-                if (fifoelement.freedata) {
-                    free(fifoelement.data);
-                }
+static void ftp_transfer_rx (ftp_session_t *s) {
+    const uint32_t half = FTP_BUFFER_SIZE / 2;
+    uint32_t moved = 0;
+
+    while (moved < FTP_BURST_SIZE) {
+        // receive into the free space while the full halves go to the file
+        uint32_t len = MIN(FTP_BUFFER_SIZE - (s->dhead - s->dtail), FTP_BUFFER_SIZE - (s->dhead % FTP_BUFFER_SIZE));
+        int32_t rxlen;
+        ftp_result_t result = ftp_recv_non_blocking(s->d_sd, &s->dBuffer[s->dhead % FTP_BUFFER_SIZE], len, &rxlen);
+
+        if (result == E_FTP_RESULT_OK) {
+            s->dhead += rxlen;
+            moved += rxlen;
+            s->dactive = mp_hal_ticks_ms();
+            s->cactive = s->dactive;
+        }
+
+        // store whole halves, and what is left once the client is done
+        while ((s->dhead - s->dtail) >= half || (result == E_FTP_RESULT_FAILED && s->dhead != s->dtail)) {
+            uint32_t size = MIN(s->dhead - s->dtail, half);
+            uint8_t *src = &s->dBuffer[s->dtail % FTP_BUFFER_SIZE];
+            bool written;
+
+            // its a software update
+            if (s->special_file) {
+                written = updater_write(src, size);
+            }
+            // user file being received
+            else {
+                written = ftp_write_file(s, src, size);
             }
-        } else { // socket closed, remove it from the queue
-            SOCKETFIFO_Pop (&fifoelement);
-            if (fifoelement.freedata) {
-                free(fifoelement.data);
+            if (!written) {
+                ftp_end_transfer(s, 451);
+                return;
             }
+            s->dtail += size;
         }
-    } else if (ftp_data.state == E_FTP_STE_END_TRANSFER && (ftp_data.d_sd > 0)) {
-        // close the listening and the data sockets
-        servers_close_socket(&ftp_data.ld_sd);
-        servers_close_socket(&ftp_data.d_sd);
-        if (ftp_data.special_file) {
-            ftp_data.special_file = false;
+        if (s->dhead == s->dtail) {
+            s->dhead = 0;
+            s->dtail = 0;
+        }
+
+        if (result == E_FTP_RESULT_FAILED) {
+            if (s->special_file) {
+                s->special_file = false;
+                updater_finish();
+            }
+            ftp_end_transfer(s, 226);
+            return;
+        } else if (result == E_FTP_RESULT_CONTINUE) {
+            if (moved == 0 && servers_timed_out(s->dactive, FTP_DATA_TIMEOUT_MS)) {
+                ftp_end_transfer(s, 426);
+            }
+            return;
         }
     }
 }
@@ -1010,282 +766,271 @@ static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxle
 
     if (*rxLen > 0) {
         return E_FTP_RESULT_OK;
-    } else if (errno != EAGAIN) {
-        // error
+    } else if (*rxLen == 0 || errno != EAGAIN) {
+        // closed by the peer, or error
         return E_FTP_RESULT_FAILED;
     }
     return E_FTP_RESULT_CONTINUE;
 }
 
-static void ftp_get_param_and_open_child (char **bufptr) {
-    ftp_pop_param (bufptr, ftp_scratch_buffer, false);
-    ftp_open_child (ftp_path, ftp_scratch_buffer);
-    ftp_data.closechild = true;
+static void ftp_get_param_and_open_child (ftp_session_t *s, char **bufptr) {
+    ftp_pop_param (bufptr, s->scratch, FTP_MAX_PARAM_SIZE, false);
+    // keep the working directory, the parameter may be an absolute path
+    strcpy (s->prev, s->path);
+    ftp_open_child (s->path, s->scratch);
+    s->closechild = true;
 }
 
-static void ftp_process_cmd (void) {
+static void ftp_process_cmd (ftp_session_t *s) {
     int32_t len;
-    char *bufptr = (char *)ftp_cmd_buffer;
+    char *bufptr = s->cmd;
+    char *dBuffer = (char *)s->dBuffer;
     ftp_result_t result;
-    FRESULT fres;
-    ftp_fileinfo_t fno;
+    ftpfs_info_t *fno = &s->listinfo;
 
-    ftp_data.closechild = false;
-    // also use the reply buffer to receive new commands
-    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len))) {
+    s->closechild = false;
+    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(s->c_sd, s->cmd, FTP_CMD_BUFFER_SIZE - 1, &len))) {
+        s->cmd[len] = '\0';
+        s->cactive = mp_hal_ticks_ms();
         // bufptr is moved as commands are being popped
         ftp_cmd_index_t cmd = ftp_pop_command(&bufptr);
-        if (!ftp_data.loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
-            ftp_send_reply(332, NULL);
+        if (!s->loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
+            ftp_send_reply(s, 332, NULL);
             return;
         }
         switch (cmd) {
         case E_FTP_CMD_FEAT:
-            ftp_send_reply(211, "no-features");
+            ftp_send_reply(s, 211, "no-features");
             break;
         case E_FTP_CMD_SYST:
-            ftp_send_reply(215, "UNIX Type: L8");
+            ftp_send_reply(s, 215, "UNIX Type: L8");
             break;
         case E_FTP_CMD_CDUP:
-            ftp_close_child(ftp_path);
-            ftp_send_reply(250, NULL);
+            ftp_close_child(s->path);
+            ftp_send_reply(s, 250, NULL);
             break;
         case E_FTP_CMD_CWD:
             {
-                fres = FR_NO_PATH;
-                ftp_pop_param (&bufptr, ftp_scratch_buffer, false);
-                ftp_open_child (ftp_path, ftp_scratch_buffer);
-                if ((ftp_path[0] == '/' && ftp_path[1] == '\0') || ((fres = f_opendir_helper (&ftp_data.u.dp, ftp_path)) == FR_OK)) {
-                    if (fres == FR_OK) {
-                        f_closedir_helper(&ftp_data.u.dp);
+                ftpfs_handle_t *dh = NULL;
+                ftp_get_param_and_open_child (s, &bufptr);
+                if ((s->path[0] == '/' && s->path[1] == '\0') || ((dh = ftpfs_opendir (s->path)) != NULL)) {
+                    if (dh) {
+                        ftpfs_closedir(dh);
                     }
-                    ftp_send_reply(250, NULL);
+                    s->closechild = false;
+                    ftp_send_reply(s, 250, NULL);
                 } else {
-                    ftp_close_child (ftp_path);
-                    ftp_send_reply(550, NULL);
+                    ftp_send_reply(s, 550, NULL);
                 }
             }
             break;
         case E_FTP_CMD_PWD:
         case E_FTP_CMD_XPWD:
-            ftp_send_reply(257, ftp_path);
+            ftp_send_reply(s, 257, s->path);
             break;
         case E_FTP_CMD_SIZE:
-            {
-                ftp_get_param_and_open_child (&bufptr);
-                if (FR_OK == f_stat_helper (ftp_path, &fno)) {
-                    // send the size
-                    if(isLittleFs(ftp_path))
-                    {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_lfs.info.size);
-                    }
-                    else
-                    {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_fat.fsize);
-                    }
-
-                    ftp_send_reply(213, (char *)ftp_data.dBuffer);
-                } else {
-                    ftp_send_reply(550, NULL);
-                }
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftpfs_stat (s->path, fno)) {
+                // send the size
+                snprintf(dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno->size);
+                ftp_send_reply(s, 213, dBuffer);
+            } else {
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_MDTM:
-            ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftpfs_stat (s->path, fno)) {
                 // send the last modified time
-                if(isLittleFs(ftp_path))
-                {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
-                            1980 + ((fno.u.fpinfo_lfs.timestamp.fdate >> 9) & 0x7f), (fno.u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f,
-                            fno.u.fpinfo_lfs.timestamp.fdate & 0x1f, (fno.u.fpinfo_lfs.timestamp.ftime >> 11) & 0x1f,
-                            (fno.u.fpinfo_lfs.timestamp.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_lfs.timestamp.ftime & 0x1f));
-                }
-                else
-                {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
-                                             1980 + ((fno.u.fpinfo_fat.fdate >> 9) & 0x7f), (fno.u.fpinfo_fat.fdate >> 5) & 0x0f,
-                                             fno.u.fpinfo_fat.fdate & 0x1f, (fno.u.fpinfo_fat.ftime >> 11) & 0x1f,
-                                             (fno.u.fpinfo_fat.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_fat.ftime & 0x1f));
-                }
-
-                ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                snprintf(dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
+                         1980 + ((fno->fdate >> 9) & 0x7f), (fno->fdate >> 5) & 0x0f,
+                         fno->fdate & 0x1f, (fno->ftime >> 11) & 0x1f,
+                         (fno->ftime >> 5) & 0x3f, 2 * (fno->ftime & 0x1f));
+                ftp_send_reply(s, 213, dBuffer);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_TYPE:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(s, 200, NULL);
             break;
         case E_FTP_CMD_USER:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
-            if (!memcmp(ftp_scratch_buffer, servers_user, MAX(strlen(ftp_scratch_buffer), strlen(servers_user)))) {
-                ftp_data.loggin.uservalid = true && (strlen(servers_user) == strlen(ftp_scratch_buffer));
+            ftp_pop_param (&bufptr, s->scratch, FTP_MAX_PARAM_SIZE, true);
+            if (!memcmp(s->scratch, servers_user, MAX(strlen(s->scratch), strlen(servers_user)))) {
+                s->loggin.uservalid = true && (strlen(servers_user) == strlen(s->scratch));
             }
-            ftp_send_reply(331, NULL);
+            ftp_send_reply(s, 331, NULL);
             break;
         case E_FTP_CMD_PASS:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
-            if (!memcmp(ftp_scratch_buffer, servers_pass, MAX(strlen(ftp_scratch_buffer), strlen(servers_pass))) &&
-                    ftp_data.loggin.uservalid) {
-                ftp_data.loggin.passvalid = true && (strlen(servers_pass) == strlen(ftp_scratch_buffer));
-                if (ftp_data.loggin.passvalid) {
-                    ftp_send_reply(230, NULL);
+            ftp_pop_param (&bufptr, s->scratch, FTP_MAX_PARAM_SIZE, true);
+            if (!memcmp(s->scratch, servers_pass, MAX(strlen(s->scratch), strlen(servers_pass))) &&
+                    s->loggin.uservalid) {
+                s->loggin.passvalid = true && (strlen(servers_pass) == strlen(s->scratch));
+                if (s->loggin.passvalid) {
+                    ftp_send_reply(s, 230, NULL);
                     break;
                 }
             }
-            ftp_send_reply(530, NULL);
+            ftp_send_reply(s, 530, NULL);
             break;
         case E_FTP_CMD_PASV:
             {
                 // some servers (e.g. google chrome) send PASV several times very quickly
-                servers_close_socket(&ftp_data.d_sd);
-                ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                servers_close_socket(&s->d_sd);
+                s->substate = E_FTP_STE_SUB_DISCONNECTED;
                 bool socketcreated = true;
-                if (ftp_data.ld_sd < 0) {
-                    socketcreated = ftp_create_listening_socket(&ftp_data.ld_sd, FTP_PASIVE_DATA_PORT, FTP_DATA_CLIENTS_MAX - 1);
+                if (s->ld_sd < 0) {
+                    socketcreated = ftp_create_listening_socket(&s->ld_sd, s->dport, FTP_DATA_CLIENTS_MAX - 1);
                 }
                 if (socketcreated) {
-                    uint8_t *pip = (uint8_t *)&ftp_data.ip_addr;
-                    ftp_data.dtimeout = 0;
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
-                             pip[0], pip[1], pip[2], pip[3], (FTP_PASIVE_DATA_PORT >> 8), (FTP_PASIVE_DATA_PORT & 0xFF));
-                    ftp_data.substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
-                    ftp_send_reply(227, (char *)ftp_data.dBuffer);
+                    uint8_t *pip = (uint8_t *)&s->ip_addr;
+                    s->dactive = mp_hal_ticks_ms();
+                    snprintf(dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
+                             pip[0], pip[1], pip[2], pip[3], (s->dport >> 8), (s->dport & 0xFF));
+                    s->substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
+                    ftp_send_reply(s, 227, dBuffer);
                 } else {
-                    ftp_send_reply(425, NULL);
+                    ftp_send_reply(s, 425, NULL);
                 }
             }
             break;
         case E_FTP_CMD_LIST:
-            if (ftp_open_dir_for_listing(ftp_path) == E_FTP_RESULT_CONTINUE) {
-                ftp_data.state = E_FTP_STE_CONTINUE_LISTING;
-                ftp_send_reply(150, NULL);
+            if (ftp_open_dir_for_listing(s, s->path) == E_FTP_RESULT_CONTINUE) {
+                ftp_start_transfer(s, E_FTP_STE_CONTINUE_LISTING);
+                ftp_send_reply(s, 150, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_RETR:
-            ftp_get_param_and_open_child (&bufptr);
-            if (ftp_open_file (ftp_path, FA_READ)) {
-                ftp_data.state = E_FTP_STE_CONTINUE_FILE_TX;
-                ftp_send_reply(150, NULL);
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftp_open_file (s, s->path, false)) {
+                ftp_start_transfer(s, E_FTP_STE_CONTINUE_FILE_TX);
+                ftp_send_reply(s, 150, NULL);
             } else {
-                ftp_data.state = E_FTP_STE_END_TRANSFER;
-                ftp_send_reply(550, NULL);
+                s->state = E_FTP_STE_END_TRANSFER;
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_STOR:
-            ftp_get_param_and_open_child (&bufptr);
+            ftp_get_param_and_open_child (s, &bufptr);
             // first check if a software update is being requested
-            if (updater_check_path (ftp_path)) {
-                if (updater_start()) {
-                    ftp_data.special_file = true;
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-                    ftp_send_reply(150, NULL);
+            if (updater_check_path (s->path)) {
+                if (ftp_updater_in_use()) {
+                    // another session is updating already
+                    s->state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_reply(s, 550, NULL);
+                } else if (updater_start()) {
+                    s->special_file = true;
+                    ftp_start_transfer(s, E_FTP_STE_CONTINUE_FILE_RX);
+                    ftp_send_reply(s, 150, NULL);
                 } else {
                     // to unlock the updater
                     updater_finish();
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                    ftp_send_reply(550, NULL);
+                    s->state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_reply(s, 550, NULL);
                 }
             } else {
-                if (ftp_open_file (ftp_path, FA_WRITE | FA_CREATE_ALWAYS)) {
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-                    ftp_send_reply(150, NULL);
+                if (ftp_open_file (s, s->path, true)) {
+                    ftp_start_transfer(s, E_FTP_STE_CONTINUE_FILE_RX);
+                    ftp_send_reply(s, 150, NULL);
                 } else {
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                    ftp_send_reply(550, NULL);
+                    s->state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_reply(s, 550, NULL);
                 }
             }
             break;
         case E_FTP_CMD_DELE:
         case E_FTP_CMD_RMD:
-            ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_unlink_helper(ftp_path)) {
-                ftp_send_reply(250, NULL);
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftpfs_unlink(s->path)) {
+                ftp_send_reply(s, 250, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_MKD:
-            ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_mkdir_helper(ftp_path)) {
-                ftp_send_reply(250, NULL);
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftpfs_mkdir(s->path)) {
+                ftp_send_reply(s, 250, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_RNFR:
-            ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
-                ftp_send_reply(350, NULL);
+            ftp_get_param_and_open_child (s, &bufptr);
+            if (ftpfs_stat (s->path, fno)) {
+                ftp_send_reply(s, 350, NULL);
                 // save the current path
-                strcpy ((char *)ftp_data.dBuffer, ftp_path);
+                strcpy (dBuffer, s->path);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_RNTO:
-            ftp_get_param_and_open_child (&bufptr);
+            ftp_get_param_and_open_child (s, &bufptr);
             // old path was saved in the data buffer
-            if (FR_OK == (fres = f_rename_helper ((char *)ftp_data.dBuffer, ftp_path))) {
-                ftp_send_reply(250, NULL);
+            if (ftpfs_rename (dBuffer, s->path)) {
+                ftp_send_reply(s, 250, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_NOOP:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(s, 200, NULL);
             break;
         case E_FTP_CMD_QUIT:
-            ftp_send_reply(221, NULL);
+            ftp_send_reply(s, 221, NULL);
             break;
         default:
             // command not implemented
             MSG("process_cmd not implemented\n");
-            ftp_send_reply(502, NULL);
+            ftp_send_reply(s, 502, NULL);
             break;
         }
 
-        if (ftp_data.closechild) {
-            ftp_return_to_previous_path(ftp_path, ftp_scratch_buffer);
+        if (s->closechild) {
+            strcpy (s->path, s->prev);
         }
     } else if (result == E_FTP_RESULT_CONTINUE) {
-        if (ftp_data.ctimeout++ > (servers_get_timeout() / FTP_CYCLE_TIME_MS)) {
-            ftp_send_reply(221, NULL);
+        if (servers_timed_out(s->cactive, servers_get_timeout())) {
+            ftp_send_reply(s, 221, NULL);
         }
     } else {
-        ftp_close_cmd_data();
+        servers_close_socket(&s->c_sd);
     }
 }
 
-static void ftp_close_files (void) {
-    if (ftp_data.e_open == E_FTP_FILE_OPEN) {
-        f_closefile_helper(&ftp_data.u.fp);
-    } else if (ftp_data.e_open == E_FTP_DIR_OPEN) {
-        f_closedir_helper(&ftp_data.u.dp);
+static void ftp_close_files (ftp_session_t *s) {
+    if (s->e_open == E_FTP_FILE_OPEN) {
+        ftpfs_close(s->fh);
+    } else if (s->e_open == E_FTP_DIR_OPEN) {
+        ftpfs_closedir(s->fh);
     }
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
+    s->fh = NULL;
+    s->e_open = E_FTP_NOTHING_OPEN;
 }
 
-static void ftp_close_filesystem_on_error (void) {
-    ftp_close_files();
-    if (ftp_data.special_file) {
+static void ftp_close_filesystem_on_error (ftp_session_t *s) {
+    ftp_close_files(s);
+    if (s->special_file) {
         updater_finish ();
-        ftp_data.special_file = false;
+        s->special_file = false;
     }
 }
 
-static void ftp_close_cmd_data (void) {
-    servers_close_socket(&ftp_data.c_sd);
-    servers_close_socket(&ftp_data.d_sd);
-    ftp_close_filesystem_on_error ();
+static bool ftp_updater_in_use (void) {
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        if (ftp_data.session[i].special_file) {
+            return true;
+        }
+    }
+    return false;
 }
 
 static ftp_cmd_index_t ftp_pop_command (char **str) {
     char _cmd[FTP_CMD_SIZE_MAX];
-    ftp_pop_param (str, _cmd, true);
+    ftp_pop_param (str, _cmd, FTP_CMD_SIZE_MAX, true);
     stoupper (_cmd);
     //MSG("pop_command: \"%s\"\n", _cmd);
     for (ftp_cmd_index_t i = 0; i < E_FTP_NUM_FTP_CMDS; i++) {
@@ -1299,74 +1044,45 @@ static ftp_cmd_index_t ftp_pop_command (char **str) {
     return E_FTP_CMD_NOT_SUPPORTED;
 }
 
-static void ftp_pop_param (char **str, char *param, bool stop_on_space) {
+static void ftp_pop_param (char **str, char *param, uint32_t size, bool stop_on_space) {
     while (**str != '\r' && **str != '\n' && **str != '\0') {
         if (stop_on_space && (**str == ' ')) {
             break;
         }
-        *param++ = **str;
+        // whatever does not fit is dropped
+        if (size > 1) {
+            *param++ = **str;
+            size--;
+        }
         (*str)++;
     }
     *param = '\0';
 }
 
-static int ftp_print_eplf_item (char *dest, uint32_t destsize, ftp_fileinfo_t *fno) {
-
-    char *type;
-    uint64_t tseconds = 0;
+static int ftp_print_eplf_item (char *dest, uint32_t destsize, const ftpfs_info_t *fno) {
+    char *type = fno->isdir ? "d" : "-";
+    uint64_t tseconds;
+    uint64_t fseconds;
     uint32_t _len;
-    uint mindex = 0;
-    uint day = 1;
-    uint64_t fseconds = 0;
-
-    if(isLittleFs(ftp_path))
-    {
-        type = (fno->u.fpinfo_lfs.info.type == LFS_TYPE_DIR) ? "d" : "-";
-
-        mindex = (((fno->u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f) > 0) ? (((fno->u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f) - 1) : 0;
-        day = ((fno->u.fpinfo_lfs.timestamp.fdate & 0x1f) > 0) ? (fno->u.fpinfo_lfs.timestamp.fdate & 0x1f) : 1;
-        fseconds = timeutils_seconds_since_epoch(1980 + ((fno->u.fpinfo_lfs.timestamp.fdate >> 9) & 0x7f),
-                                                         (fno->u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f,
-                                                         fno->u.fpinfo_lfs.timestamp.fdate & 0x1f,
-                                                         (fno->u.fpinfo_lfs.timestamp.ftime >> 11) & 0x1f,
-                                                         (fno->u.fpinfo_lfs.timestamp.ftime >> 5) & 0x3f,
-                                                         2 * (fno->u.fpinfo_lfs.timestamp.ftime & 0x1f));
-
-        tseconds = mach_rtc_get_us_since_epoch() / 1000000ll;
-        if (FTP_UNIX_SECONDS_180_DAYS < (int64_t)(tseconds - fseconds)) {
-            _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %5u %s\r\n",
-                            type, (uint32_t)fno->u.fpinfo_lfs.info.size, ftp_month[mindex].month, day,
-                            1980 + ((fno->u.fpinfo_lfs.timestamp.fdate >> 9) & 0x7f), fno->u.fpinfo_lfs.info.name);
-        } else {
-            _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %02u:%02u %s\r\n",
-                            type, (uint32_t)fno->u.fpinfo_lfs.info.size, ftp_month[mindex].month, day,
-                            (fno->u.fpinfo_lfs.timestamp.ftime >> 11) & 0x1f, (fno->u.fpinfo_lfs.timestamp.ftime >> 5) & 0x3f, fno->u.fpinfo_lfs.info.name);
-        }
+    uint mindex = (((fno->fdate >> 5) & 0x0f) > 0) ? (((fno->fdate >> 5) & 0x0f) - 1) : 0;
+    uint day = ((fno->fdate & 0x1f) > 0) ? (fno->fdate & 0x1f) : 1;
 
-    }
-    else
-    {
-        type = (fno->u.fpinfo_fat.fattrib & AM_DIR) ? "d" : "-";
-
-        mindex = (((fno->u.fpinfo_fat.fdate >> 5) & 0x0f) > 0) ? (((fno->u.fpinfo_fat.fdate >> 5) & 0x0f) - 1) : 0;
-        day = ((fno->u.fpinfo_fat.fdate & 0x1f) > 0) ? (fno->u.fpinfo_fat.fdate & 0x1f) : 1;
-        fseconds = timeutils_seconds_since_epoch(1980 + ((fno->u.fpinfo_fat.fdate >> 9) & 0x7f),
-                                                         (fno->u.fpinfo_fat.fdate >> 5) & 0x0f,
-                                                         fno->u.fpinfo_fat.fdate & 0x1f,
-                                                         (fno->u.fpinfo_fat.ftime >> 11) & 0x1f,
-                                                         (fno->u.fpinfo_fat.ftime >> 5) & 0x3f,
-                                                         2 * (fno->u.fpinfo_fat.ftime & 0x1f));
-
-        tseconds = mach_rtc_get_us_since_epoch() / 1000000ll;
-        if (FTP_UNIX_SECONDS_180_DAYS < (int64_t)(tseconds - fseconds)) {
-            _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %5u %s\r\n",
-                            type, (uint32_t)fno->u.fpinfo_fat.fsize, ftp_month[mindex].month, day,
-                            1980 + ((fno->u.fpinfo_fat.fdate >> 9) & 0x7f), fno->u.fpinfo_fat.fname);
-        } else {
-            _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %02u:%02u %s\r\n",
-                            type, (uint32_t)fno->u.fpinfo_fat.fsize, ftp_month[mindex].month, day,
-                            (fno->u.fpinfo_fat.ftime >> 11) & 0x1f, (fno->u.fpinfo_fat.ftime >> 5) & 0x3f, fno->u.fpinfo_fat.fname);
-        }
+    fseconds = timeutils_seconds_since_epoch(1980 + ((fno->fdate >> 9) & 0x7f),
+                                             (fno->fdate >> 5) & 0x0f,
+                                             fno->fdate & 0x1f,
+                                             (fno->ftime >> 11) & 0x1f,
+                                             (fno->ftime >> 5) & 0x3f,
+                                             2 * (fno->ftime & 0x1f));
+
+    tseconds = mach_rtc_get_us_since_epoch() / 1000000ll;
+    if (FTP_UNIX_SECONDS_180_DAYS < (int64_t)(tseconds - fseconds)) {
+        _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %5u %s\r\n",
+                        type, (uint32_t)fno->size, ftp_month[mindex].month, day,
+                        1980 + ((fno->fdate >> 9) & 0x7f), fno->name);
+    } else {
+        _len = snprintf(dest, destsize, "%srw-rw-r--   1 root  root %9u %s %2u %02u:%02u %s\r\n",
+                        type, (uint32_t)fno->size, ftp_month[mindex].month, day,
+                        (fno->ftime >> 11) & 0x1f, (fno->ftime >> 5) & 0x3f, fno->name);
     }
 
     if (_len > 0 && _len < destsize) {
@@ -1398,141 +1114,92 @@ static int ftp_print_eplf_drive (char *dest, uint32_t destsize, const char *name
     return 0;
 }
 
-static bool ftp_open_file (const char *path, int mode) {
-    FRESULT res = f_open_helper(&ftp_data.u.fp, path, mode);
-    if (res != FR_OK) {
+static void ftp_start_transfer (ftp_session_t *s, ftp_state_t state) {
+    s->dhead = 0;
+    s->dtail = 0;
+    s->deof = false;
+    s->listpending = false;
+    s->state = state;
+}
+
+static bool ftp_open_file (ftp_session_t *s, const char *path, bool write) {
+    s->fh = ftpfs_open(path, write);
+    if (s->fh == NULL) {
         return false;
     }
-    ftp_data.e_open = E_FTP_FILE_OPEN;
+    s->e_open = E_FTP_FILE_OPEN;
     return true;
 }
 
-static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t *actualsize) {
-    ftp_result_t result = E_FTP_RESULT_CONTINUE;
-
-
-    FRESULT res = f_read_helper(&ftp_data.u.fp, filebuf, desiredsize, (UINT *)actualsize);
-    if (res != FR_OK) {
-        ftp_close_files();
-        result = E_FTP_RESULT_FAILED;
+static ftp_result_t ftp_read_file (ftp_session_t *s, char *filebuf, uint32_t desiredsize, uint32_t *actualsize) {
+    if (!ftpfs_read(s->fh, filebuf, desiredsize, actualsize)) {
         *actualsize = 0;
+        return E_FTP_RESULT_FAILED;
     } else if (*actualsize < desiredsize) {
-        ftp_close_files();
-        result = E_FTP_RESULT_OK;
+        return E_FTP_RESULT_OK;
     }
-    return result;
+    return E_FTP_RESULT_CONTINUE;
 }
 
-static ftp_result_t ftp_write_file (char *filebuf, uint32_t size) {
-    ftp_result_t result = E_FTP_RESULT_FAILED;
-    uint32_t actualsize;
-    FRESULT res = f_write_helper(&ftp_data.u.fp, filebuf, size, (UINT *)&actualsize);
-    if ((actualsize == size) && (FR_OK == res)) {
-        result = E_FTP_RESULT_OK;
-    } else {
-        ftp_close_files();
+static bool ftp_write_file (ftp_session_t *s, uint8_t *filebuf, uint32_t size) {
+    if (ftpfs_write(s->fh, filebuf, size)) {
+        return true;
     }
-    return result;
+    ftp_close_files(s);
+    return false;
 }
 
-static ftp_result_t ftp_open_dir_for_listing (const char *path) {
-
+static ftp_result_t ftp_open_dir_for_listing (ftp_session_t *s, const char *path) {
     // "hack" to detect the root directory
     if (path[0] == '/' && path[1] == '\0') {
-        ftp_data.listroot = true;
+        s->listroot = true;
+        s->volcount = 0;
     } else {
-        FRESULT res;
-        res = f_opendir_helper(&ftp_data.u.dp, path);                       /* Open the directory */
-        if (res != FR_OK) {
+        s->fh = ftpfs_opendir(path);
+        if (s->fh == NULL) {
             return E_FTP_RESULT_FAILED;
         }
-        ftp_data.e_open = E_FTP_DIR_OPEN;
-        ftp_data.listroot = false;
+        s->e_open = E_FTP_DIR_OPEN;
+        s->listroot = false;
     }
     return E_FTP_RESULT_CONTINUE;
 }
 
-static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *listsize) {
-    uint next = 0;
+static ftp_result_t ftp_list_dir (ftp_session_t *s, char *list, uint32_t maxlistsize, uint32_t *listsize) {
+    uint32_t next = 0;
     uint32_t _len;
-    FRESULT res;
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
-    ftp_fileinfo_t fno;
-
-    // if we are resuming an incomplete list operation, go back to the item we left behind
-    if (!ftp_data.listroot) {
-        for (int i = 0; i < ftp_last_dir_idx; i++) {
-            f_readdir_helper(&ftp_data.u.dp, &fno);
-        }
-    }
 
     // read until we get all items or there's no more space in the buffer
     while (true) {
-        if (ftp_data.listroot) {
+        if (s->listroot) {
             // root directory "hack"
-            mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table);
-            int i = ftp_data.volcount;
-            while (vfs != NULL && i != 0) {
-                vfs = vfs->next;
-                i -= 1;
+            const char *name = ftpfs_volume(s->volcount);
+            if (name == NULL) {
+                result = E_FTP_RESULT_OK;
+                break;
             }
-            if (vfs == NULL) {
-                if (!next) {
-                    // no volume found this time, we are done
-                    ftp_data.volcount = 0;
-                }
+            _len = ftp_print_eplf_drive((list + next), (maxlistsize - next), name);
+            if (!_len) {
                 break;
-            } else {
-                next += ftp_print_eplf_drive((list + next), (maxlistsize - next), vfs->str + 1);
             }
-            ftp_data.volcount++;
+            next += _len;
+            s->volcount++;
         } else {
-            // a "normal" directory
-            res = f_readdir_helper(&ftp_data.u.dp, &fno);                                                       /* Read a directory item */
-            if(isLittleFs(ftp_path))
-            {
-                if (res != FR_OK || fno.u.fpinfo_lfs.info.name[0] == 0) {
-                    result = E_FTP_RESULT_OK;
-                    break;                                                                                 /* Break on error or end of dp */
-                }
-                if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == 0)
-                {
-                    ftp_last_dir_idx++;
-                    continue;            /* Ignore . entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
-                }
-                if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == '.' && fno.u.fpinfo_lfs.info.name[2] == 0)
-                {
-                    ftp_last_dir_idx++;
-                    continue;            /* Ignore .. entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
-                }
-            }
-            else
-            {
-                if (res != FR_OK || fno.u.fpinfo_fat.fname[0] == 0) {
-                    result = E_FTP_RESULT_OK;
-                    break;                                                                                 /* Break on error or end of dp */
-                }
-                if (fno.u.fpinfo_fat.fname[0] == '.' && fno.u.fpinfo_fat.fname[1] == 0) continue;                                    /* Ignore . entry */
-                if (fno.u.fpinfo_fat.fname[0] == '.' && fno.u.fpinfo_fat.fname[1] == '.' && fno.u.fpinfo_fat.fname[2] == 0) continue;             /* Ignore .. entry */
+            // a "normal" directory, the entry that did not fit last time goes first
+            if (!s->listpending && !ftpfs_readdir(s->fh, &s->listinfo)) {
+                result = E_FTP_RESULT_OK;
+                break;
             }
-
-            // add the entry to the list if space is available
-            _len = ftp_print_eplf_item((list + next), (maxlistsize - next - 1), &fno);
-            if (!_len) {
-                // close and open again, we will resume in the next iteration
-                ftp_close_files();
-                ftp_open_dir_for_listing(ftp_path);
+            _len = ftp_print_eplf_item((list + next), (maxlistsize - next), &s->listinfo);
+            s->listpending = (!_len && next > 0);
+            if (s->listpending) {
                 break;
             }
             next += _len;
-            ftp_last_dir_idx++;
         }
     }
 
-    if (result == E_FTP_RESULT_OK) {
-        ftp_close_files();
-        ftp_last_dir_idx = 0;
-    }
     *listsize = next;
     return result;
 }
@@ -1564,16 +1231,3 @@ static void ftp_close_child (char *pwd) {
         pwd[len] = '\0';
     }
 }
-
-static void ftp_return_to_previous_path (char *pwd, char *dir) {
-    uint newlen = strlen(pwd) - strlen(dir);
-    if ((newlen > 2) && (pwd[newlen - 1] == '/')) {
-        pwd[newlen - 1] = '\0';
-    } else {
-        if (newlen == 0) {
-            strcpy (pwd, "/");
-        } else {
-            pwd[newlen] = '\0';
-        }
-    }
-}
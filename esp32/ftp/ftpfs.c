@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/obj.h"
+
+#include "ftpfs.h"
+#include "lib/oofatfs/ff.h"
+#include "extmod/vfs.h"
+#include "extmod/vfs_fat.h"
+#include "vfs_littlefs.h"
+#include "lfs.h"
+#include "mptask.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// These wrapper functions are used so that the FTP server can access the
+// mounted FatFs and LittleFs devices directly without going through the
+// costly mp_vfs_XXX functions. The latter may raise exceptions and we would
+// then need to wrap all calls in an nlr handler. Each handle remembers the
+// volume it was opened on, so several FTP sessions can work on different
+// paths at the same time.
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+struct ftpfs_handle_s {
+    bool                    islfs;
+    union {
+        FATFS               *fat;
+        vfs_lfs_struct_t    *lfs;
+    } fs;
+    union {
+        FIL                 fp_fat;
+        pycom_lfs_file_t    fp_lfs;
+        FF_DIR              dp_fat;
+        lfs_dir_t           dp_lfs;
+    } u;
+    // relative path of an open LittleFs directory, to fetch the timestamps
+    char                    path[];
+};
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static ftpfs_handle_t *ftpfs_new_handle (const char *path, const char **path_relative, bool keep_path) {
+    ftpfs_handle_t *fh;
+    bool islfs = isLittleFs(path);
+    void *fs;
+
+    if (islfs) {
+        fs = lookup_path_littlefs(path, path_relative);
+    } else {
+        fs = lookup_path_fatfs(path, path_relative);
+    }
+    if (fs == NULL) {
+        return NULL;
+    }
+
+    fh = malloc(sizeof(ftpfs_handle_t) + (keep_path ? strlen(*path_relative) + 1 : 0));
+    if (fh) {
+        fh->islfs = islfs;
+        if (islfs) {
+            fh->fs.lfs = fs;
+        } else {
+            fh->fs.fat = fs;
+        }
+        if (keep_path) {
+            strcpy(fh->path, *path_relative);
+        }
+    }
+    return fh;
+}
+
+static void ftpfs_info_from_fat (ftpfs_info_t *info, const FILINFO *fno) {
+    strncpy(info->name, fno->fname, FTPFS_NAME_MAX);
+    info->name[FTPFS_NAME_MAX] = '\0';
+    info->size = fno->fsize;
+    info->fdate = fno->fdate;
+    info->ftime = fno->ftime;
+    info->isdir = (fno->fattrib & AM_DIR) ? true : false;
+}
+
+static void ftpfs_info_from_lfs (ftpfs_info_t *info, const struct lfs_info *fno, const lfs_timestamp_attribute_t *ts) {
+    strncpy(info->name, fno->name, FTPFS_NAME_MAX);
+    info->name[FTPFS_NAME_MAX] = '\0';
+    info->size = fno->size;
+    info->fdate = ts->fdate;
+    info->ftime = ts->ftime;
+    info->isdir = (fno->type == LFS_TYPE_DIR);
+}
+
+static bool ftpfs_is_dot_entry (const char *name) {
+    return (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')));
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+ftpfs_handle_t *ftpfs_open (const char *path, bool write) {
+    const char *path_relative;
+    BYTE mode = write ? (FA_WRITE | FA_CREATE_ALWAYS) : FA_READ;
+    ftpfs_handle_t *fh = ftpfs_new_handle(path, &path_relative, false);
+    int res;
+
+    if (fh == NULL) {
+        return NULL;
+    }
+
+    if (fh->islfs) {
+        littlefs_lock(&fh->fs.lfs->lock);
+            res = littlefs_open_common_helper(&fh->fs.lfs->lfs, path_relative, &fh->u.fp_lfs.fp, fatFsModetoLittleFsMode(mode),
+                                              &fh->u.fp_lfs.cfg, &fh->u.fp_lfs.timestamp_update);
+        littlefs_unlock(&fh->fs.lfs->lock);
+        res = (res == LFS_ERR_OK) ? FR_OK : FR_NO_FILE;
+    } else {
+        res = f_open(fh->fs.fat, &fh->u.fp_fat, path_relative, mode);
+    }
+
+    if (res != FR_OK) {
+        free(fh);
+        return NULL;
+    }
+    return fh;
+}
+
+bool ftpfs_read (ftpfs_handle_t *fh, void *buf, uint32_t size, uint32_t *actual) {
+    if (fh->islfs) {
+        lfs_ssize_t n = littlefs_file_read(&fh->fs.lfs->lfs, &fh->fs.lfs->lock, &fh->u.fp_lfs.fp, buf, size);
+
+        if (n < 0) {
+            *actual = 0;
+            return false;
+        }
+        *actual = n;
+        return true;
+    }
+
+    UINT n = 0;
+    FRESULT res = f_read(&fh->u.fp_fat, buf, size, &n);
+    *actual = n;
+    return (res == FR_OK);
+}
+
+bool ftpfs_write (ftpfs_handle_t *fh, const void *buf, uint32_t size) {
+    if (fh->islfs) {
+        littlefs_lock(&fh->fs.lfs->lock);
+            lfs_ssize_t n = lfs_file_write(&fh->fs.lfs->lfs, &fh->u.fp_lfs.fp, buf, size);
+            // Request timestamp update if file has been written successfully
+            if (n >= 0) {
+                fh->u.fp_lfs.timestamp_update = true;
+            }
+        littlefs_unlock(&fh->fs.lfs->lock);
+
+        return (n == (lfs_ssize_t)size);
+    }
+
+    UINT n = 0;
+    FRESULT res = f_write(&fh->u.fp_fat, buf, size, &n);
+    return (res == FR_OK && n == size);
+}
+
+bool ftpfs_close (ftpfs_handle_t *fh) {
+    bool ok;
+
+    if (fh->islfs) {
+        littlefs_lock(&fh->fs.lfs->lock);
+            int lfs_ret = littlefs_close_common_helper(&fh->fs.lfs->lfs, &fh->u.fp_lfs.fp, &fh->u.fp_lfs.cfg, &fh->u.fp_lfs.timestamp_update);
+        littlefs_unlock(&fh->fs.lfs->lock);
+        ok = (lfs_ret == LFS_ERR_OK);
+    } else {
+        ok = (f_close(&fh->u.fp_fat) == FR_OK);
+    }
+    free(fh);
+    return ok;
+}
+
+ftpfs_handle_t *ftpfs_opendir (const char *path) {
+    const char *path_relative;
+    ftpfs_handle_t *dh = ftpfs_new_handle(path, &path_relative, isLittleFs(path));
+    int res;
+
+    if (dh == NULL) {
+        return NULL;
+    }
+
+    if (dh->islfs) {
+        littlefs_lock(&dh->fs.lfs->lock);
+            res = lfs_dir_open(&dh->fs.lfs->lfs, &dh->u.dp_lfs, path_relative);
+        littlefs_unlock(&dh->fs.lfs->lock);
+        res = (res == LFS_ERR_OK) ? FR_OK : FR_NO_PATH;
+    } else {
+        res = f_opendir(dh->fs.fat, &dh->u.dp_fat, path_relative);
+    }
+
+    if (res != FR_OK) {
+        free(dh);
+        return NULL;
+    }
+    return dh;
+}
+
+bool ftpfs_readdir (ftpfs_handle_t *dh, ftpfs_info_t *info) {
+    if (dh->islfs) {
+        lfs_t *lfs = &dh->fs.lfs->lfs;
+        struct lfs_info fno;
+        lfs_timestamp_attribute_t ts = { 0 };
+        int lfs_ret;
+
+        littlefs_lock(&dh->fs.lfs->lock);
+            // LittleFs does not filter out the "." and ".." entries opposed to FatFs
+            do {
+                lfs_ret = lfs_dir_read(lfs, &dh->u.dp_lfs, &fno);
+            } while (lfs_ret > 0 && ftpfs_is_dot_entry(fno.name));
+
+            if (lfs_ret > 0) {
+                // Length of the relative path, plus "/" if the directory is not the root
+                size_t length_of_relative_path = strlen(dh->path);
+                bool add_slash = (length_of_relative_path > 1);
+                char *file_relative_path = malloc(length_of_relative_path + add_slash + strlen(fno.name) + 1);
+
+                if (file_relative_path) {
+                    memcpy(file_relative_path, dh->path, length_of_relative_path);
+                    if (add_slash) {
+                        file_relative_path[length_of_relative_path++] = '/';
+                    }
+                    strcpy(&file_relative_path[length_of_relative_path], fno.name);
+
+                    // If no timestamp is saved for this entry, leave it 0
+                    if (lfs_getattr(lfs, file_relative_path, LFS_ATTRIBUTE_TIMESTAMP, &ts, sizeof(ts)) < LFS_ERR_OK) {
+                        ts.fdate = 0;
+                        ts.ftime = 0;
+                    }
+                    free(file_relative_path);
+                }
+            }
+        littlefs_unlock(&dh->fs.lfs->lock);
+
+        if (lfs_ret <= 0) {
+            return false;
+        }
+        ftpfs_info_from_lfs(info, &fno, &ts);
+        return true;
+    }
+
+    FILINFO fno;
+    do {
+        if (f_readdir(&dh->u.dp_fat, &fno) != FR_OK || fno.fname[0] == '\0') {
+            return false;
+        }
+    } while (ftpfs_is_dot_entry(fno.fname));
+    ftpfs_info_from_fat(info, &fno);
+    return true;
+}
+
+void ftpfs_closedir (ftpfs_handle_t *dh) {
+    if (dh->islfs) {
+        littlefs_lock(&dh->fs.lfs->lock);
+            lfs_dir_close(&dh->fs.lfs->lfs, &dh->u.dp_lfs);
+        littlefs_unlock(&dh->fs.lfs->lock);
+    } else {
+        f_closedir(&dh->u.dp_fat);
+    }
+    free(dh);
+}
+
+bool ftpfs_stat (const char *path, ftpfs_info_t *info) {
+    const char *path_relative;
+
+    if (isLittleFs(path)) {
+        vfs_lfs_struct_t *littlefs = lookup_path_littlefs(path, &path_relative);
+        struct lfs_info fno;
+        lfs_timestamp_attribute_t ts;
+
+        if (littlefs == NULL) {
+            return false;
+        }
+
+        littlefs_lock(&littlefs->lock);
+            int lfs_ret = littlefs_stat_common_helper(&littlefs->lfs, path_relative, &fno, &ts);
+        littlefs_unlock(&littlefs->lock);
+
+        if (lfs_ret < LFS_ERR_OK) {
+            return false;
+        }
+        ftpfs_info_from_lfs(info, &fno, &ts);
+        return true;
+    }
+
+    FATFS *fs = lookup_path_fatfs(path, &path_relative);
+    FILINFO fno;
+    if (fs == NULL || f_stat(fs, path_relative, &fno) != FR_OK) {
+        return false;
+    }
+    ftpfs_info_from_fat(info, &fno);
+    return true;
+}
+
+bool ftpfs_mkdir (const char *path) {
+    const char *path_relative;
+
+    if (isLittleFs(path)) {
+        vfs_lfs_struct_t *littlefs = lookup_path_littlefs(path, &path_relative);
+        if (littlefs == NULL) {
+            return false;
+        }
+
+        littlefs_lock(&littlefs->lock);
+            int lfs_ret = lfs_mkdir(&littlefs->lfs, path_relative);
+            if (lfs_ret == LFS_ERR_OK) {
+                littlefs_update_timestamp(&littlefs->lfs, path_relative);
+            }
+        littlefs_unlock(&littlefs->lock);
+
+        return (lfs_ret == LFS_ERR_OK);
+    }
+
+    FATFS *fs = lookup_path_fatfs(path, &path_relative);
+    return (fs != NULL && f_mkdir(fs, path_relative) == FR_OK);
+}
+
+bool ftpfs_unlink (const char *path) {
+    const char *path_relative;
+
+    if (isLittleFs(path)) {
+        vfs_lfs_struct_t *littlefs = lookup_path_littlefs(path, &path_relative);
+        if (littlefs == NULL) {
+            return false;
+        }
+
+        littlefs_lock(&littlefs->lock);
+            int lfs_ret = lfs_remove(&littlefs->lfs, path_relative);
+        littlefs_unlock(&littlefs->lock);
+
+        return (lfs_ret == LFS_ERR_OK);
+    }
+
+    FATFS *fs = lookup_path_fatfs(path, &path_relative);
+    return (fs != NULL && f_unlink(fs, path_relative) == FR_OK);
+}
+
+bool ftpfs_rename (const char *path_old, const char *path_new) {
+    const char *path_relative_old;
+    const char *path_relative_new;
+
+    if (isLittleFs(path_old)) {
+        vfs_lfs_struct_t *littlefs_old = lookup_path_littlefs(path_old, &path_relative_old);
+        vfs_lfs_struct_t *littlefs_new = lookup_path_littlefs(path_new, &path_relative_new);
+
+        if (littlefs_old == NULL || littlefs_old != littlefs_new) {
+            return false;
+        }
+
+        littlefs_lock(&littlefs_new->lock);
+            int lfs_ret = lfs_rename(&littlefs_new->lfs, path_relative_old, path_relative_new);
+        littlefs_unlock(&littlefs_new->lock);
+
+        return (lfs_ret == LFS_ERR_OK);
+    }
+
+    FATFS *fs_old = lookup_path_fatfs(path_old, &path_relative_old);
+    FATFS *fs_new = lookup_path_fatfs(path_new, &path_relative_new);
+
+    if (fs_old == NULL || fs_old != fs_new) {
+        return false;
+    }
+    return (f_rename(fs_new, path_relative_old, path_relative_new) == FR_OK);
+}
+
+const char *ftpfs_volume (uint32_t index) {
+    mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table);
+    while (vfs != NULL && index != 0) {
+        vfs = vfs->next;
+        index--;
+    }
+    return (vfs != NULL) ? (vfs->str + 1) : NULL;
+}
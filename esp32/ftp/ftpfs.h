@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef FTPFS_H_
+#define FTPFS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define FTPFS_NAME_MAX                      255
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// an open file or directory, owned by the file system port
+typedef struct ftpfs_handle_s ftpfs_handle_t;
+
+typedef struct {
+    char            name[FTPFS_NAME_MAX + 1];
+    uint32_t        size;
+    uint16_t        fdate;      // FAT encoded date
+    uint16_t        ftime;      // FAT encoded time
+    bool            isdir;
+} ftpfs_info_t;
+
+/******************************************************************************
+ DECLARE EXPORTED FUNCTIONS
+ ******************************************************************************/
+// The file system as seen by the FTP server. Paths are absolute and start
+// with the mount point of the volume. The esp32 port goes straight to the
+// mounted FatFs and LittleFs volumes, the host build to a local directory.
+// Every function reports success with true and never raises.
+extern ftpfs_handle_t *ftpfs_open (const char *path, bool write);
+extern bool ftpfs_read (ftpfs_handle_t *fh, void *buf, uint32_t size, uint32_t *actual);
+extern bool ftpfs_write (ftpfs_handle_t *fh, const void *buf, uint32_t size);
+extern bool ftpfs_close (ftpfs_handle_t *fh);
+
+// ftpfs_readdir skips the "." and ".." entries and returns false at the end
+extern ftpfs_handle_t *ftpfs_opendir (const char *path);
+extern bool ftpfs_readdir (ftpfs_handle_t *dh, ftpfs_info_t *info);
+extern void ftpfs_closedir (ftpfs_handle_t *dh);
+
+extern bool ftpfs_stat (const char *path, ftpfs_info_t *info);
+extern bool ftpfs_mkdir (const char *path);
+extern bool ftpfs_unlink (const char *path);
+extern bool ftpfs_rename (const char *path_old, const char *path_new);
+
+// name of the n-th mounted volume (without the leading '/'), NULL past the end
+extern const char *ftpfs_volume (uint32_t index);
+
+#endif /* FTPFS_H_ */
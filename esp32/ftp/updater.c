@@ -7,9 +7,11 @@
  * available at https://www.pycom.io/opensource/licensing
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "py/mpconfig.h"
 #include "py/obj.h"
@@ -22,10 +24,10 @@
 #include "esp_log.h"
 #include "rom/crc.h"
 #include "esp32chipinfo.h"
+#include "mbedtls/sha256.h"
 
 #ifdef DIFF_UPDATE_ENABLED
-#include "bzlib.h"
-#include "bsdiff_api.h"
+#include "bspatch_stream.h"
 #endif
 
 /******************************************************************************
@@ -42,12 +44,24 @@ static const char *TAG = "updater";
  ******************************************************************************/
 typedef struct {
     uint32_t size;
-    uint32_t offset;
+    uint32_t offset;                        // where the buffered data goes in the flash
     uint32_t offset_start_upd;
-    uint32_t chunk_size;
-    uint32_t current_chunk;
+    uint32_t chunk_size;                    // of the manifest, 0 without one
+    uint32_t current_chunk;                 // bytes in the sector buffer
+    uint8_t *buffer;                        // write combining buffer, one flash sector
+    uint8_t *manifest;
+    uint32_t image_size;
+    mbedtls_sha256_context sha;             // of the chunk being written
 } updater_data_t;
 
+#ifdef DIFF_UPDATE_ENABLED
+typedef struct {
+    uint8_t *data;                          // the patch file, copied to RAM
+    uint32_t old_offset;                    // the current image in the flash
+    uint32_t percent;                       // the progress reported last
+} updater_patch_t;
+#endif
+
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
@@ -56,7 +70,9 @@ static updater_data_t updater_data = {
     .offset = 0,
     .offset_start_upd = 0,
     .chunk_size = 0,
-    .current_chunk = 0 };
+    .current_chunk = 0,
+    .buffer = NULL,
+    .manifest = NULL };
 
 //static OsiLockObj_t updater_LockObj;
 static boot_info_t boot_info;
@@ -68,6 +84,17 @@ static uint32_t boot_info_offset;
 static esp_err_t updater_spi_flash_read(size_t src, void *dest, size_t size, bool allow_decrypt);
 static esp_err_t updater_spi_flash_write(size_t dest_addr, void *src, size_t size, bool write_encrypted);
 static bool updater_is_delta_file(void);
+static bool updater_open (void);
+static void updater_release (void);
+static bool updater_flush (void);
+static bool updater_check_chunk (void);
+static bool updater_progress_valid (void);
+#ifdef DIFF_UPDATE_ENABLED
+static bool updater_patch_read_patch (void *ctx, uint32_t offset, void *buf, uint32_t size);
+static bool updater_patch_read_old (void *ctx, uint32_t offset, void *buf, uint32_t size);
+static bool updater_patch_write_new (void *ctx, const void *buf, uint32_t size);
+static void updater_patch_progress (void *ctx, uint32_t done, uint32_t total);
+#endif
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
@@ -104,48 +131,101 @@ bool updater_check_path (void *path) {
 }
 
 bool updater_start (void) {
+    if (!updater_open()) {
+        return false;
+    }
+    // whatever a resumable update left in the slot is overwritten now
+    if (updater_progress_valid()) {
+        boot_info.progress.magic = 0;
+        return updater_write_boot_info(&boot_info, boot_info_offset);
+    }
+    return true;
+}
 
-    updater_data.size = (esp32_get_chip_rev() > 0 ? IMG_SIZE_8MB : IMG_SIZE_4MB);
-    // check which one should be the next active image
-    updater_data.offset = updater_ota_next_slot_address();
-
-    ESP_LOGD(TAG, "Updating image at offset = 0x%6X\n", updater_data.offset);
-    updater_data.offset_start_upd = updater_data.offset;
+bool updater_start_resumable (const uint8_t *manifest, uint32_t len, uint32_t *offset) {
+    uint8_t id[UPDATER_MANIFEST_DIGEST];
+    uint32_t image_size, chunk_size, chunks;
 
-    // erase the first 2 sectors
-    if (ESP_OK != spi_flash_erase_sector(updater_data.offset / SPI_FLASH_SEC_SIZE)) {
-        ESP_LOGE(TAG, "Erasing first sector failed!\n");
+    if (len < UPDATER_MANIFEST_HEADER || memcmp(manifest, UPDATER_MANIFEST_MAGIC, 4) != 0) {
+        ESP_LOGE(TAG, "Invalid manifest\n");
         return false;
     }
-    if (ESP_OK != spi_flash_erase_sector((updater_data.offset + SPI_FLASH_SEC_SIZE) / SPI_FLASH_SEC_SIZE)) {
-        ESP_LOGE(TAG, "Erasing second sector failed!\n");
+    memcpy(&image_size, manifest + 4, sizeof(image_size));
+    memcpy(&chunk_size, manifest + 8, sizeof(chunk_size));
+    // chunks made of whole sectors are never touched again once verified
+    if (chunk_size == 0 || (chunk_size % SPI_FLASH_SEC_SIZE) != 0 || image_size == 0 ||
+        image_size > (esp32_get_chip_rev() > 0 ? IMG_SIZE_8MB : IMG_SIZE_4MB)) {
+        ESP_LOGE(TAG, "Invalid manifest, size: %d, chunk size: %d\n", image_size, chunk_size);
+        return false;
+    }
+    chunks = (image_size + chunk_size - 1) / chunk_size;
+    if (len != UPDATER_MANIFEST_HEADER + chunks * UPDATER_MANIFEST_DIGEST) {
+        ESP_LOGE(TAG, "Invalid manifest length: %d\n", len);
         return false;
     }
 
-    boot_info.size = 0;
-    updater_data.current_chunk = 0;
-
+    if (!updater_open()) {
+        return false;
+    }
+    if ((updater_data.manifest = malloc(len)) == NULL) {
+        ESP_LOGE(TAG, "Can't allocate %d\n", len);
+        return false;
+    }
+    memcpy(updater_data.manifest, manifest, len);
+    updater_data.chunk_size = chunk_size;
+    updater_data.image_size = image_size;
+    mbedtls_sha256_init(&updater_data.sha);
+    mbedtls_sha256_starts_ret(&updater_data.sha, 0);
+
+    // the image is known by the hash of its manifest
+    mbedtls_sha256_ret(manifest, len, id, 0);
+    if (updater_progress_valid() && memcmp(boot_info.progress.manifest, id, sizeof(boot_info.progress.manifest)) == 0 &&
+        boot_info.progress.offset <= image_size && (boot_info.progress.offset % chunk_size) == 0) {
+        // the chunks before are in the flash already, and checked
+        boot_info.size = boot_info.progress.offset;
+        updater_data.offset += boot_info.size;
+        ESP_LOGI(TAG, "Resuming update at %d of %d\n", boot_info.size, image_size);
+    } else {
+        boot_info.progress.magic = OTA_PROGRESS_MAGIC;
+        boot_info.progress.offset = 0;
+        memcpy(boot_info.progress.manifest, id, sizeof(boot_info.progress.manifest));
+        if (!updater_write_boot_info(&boot_info, boot_info_offset)) {
+            return false;
+        }
+    }
+    *offset = boot_info.size;
     return true;
 }
 
 bool updater_write (uint8_t *buf, uint32_t len) {
 
-    // the actual writing into flash, not-encrypted,
-    // because it already came encrypted from OTA server
-    if (ESP_OK != updater_spi_flash_write(updater_data.offset, (void *)buf, len, false)) {
-        ESP_LOGE(TAG, "SPI flash write failed\n");
-        return false;
-    }
+    while (len > 0) {
+        // up to the end of the sector, and of the chunk being checked
+        uint32_t end = updater_data.size;
+        if (updater_data.manifest != NULL) {
+            end = (boot_info.size / updater_data.chunk_size + 1) * updater_data.chunk_size;
+            end = MIN(end, updater_data.image_size);
+        }
+        uint32_t n = MIN(len, SPI_FLASH_SEC_SIZE - updater_data.current_chunk);
+        n = MIN(n, end - boot_info.size);
+        if (n == 0) {
+            ESP_LOGE(TAG, "Image bigger than %d bytes\n", end);
+            return false;
+        }
 
-    updater_data.offset += len;
-    updater_data.current_chunk += len;
-    boot_info.size += len;
+        memcpy(updater_data.buffer + updater_data.current_chunk, buf, n);
+        if (updater_data.manifest != NULL) {
+            mbedtls_sha256_update_ret(&updater_data.sha, buf, n);
+        }
+        updater_data.current_chunk += n;
+        boot_info.size += n;
+        buf += n;
+        len -= n;
 
-    if (updater_data.current_chunk >= SPI_FLASH_SEC_SIZE) {
-        updater_data.current_chunk -= SPI_FLASH_SEC_SIZE;
-        // erase the next sector
-        if (ESP_OK != spi_flash_erase_sector((updater_data.offset + SPI_FLASH_SEC_SIZE) / SPI_FLASH_SEC_SIZE)) {
-            ESP_LOGE(TAG, "Erasing next sector failed!\n");
+        if (updater_data.current_chunk == SPI_FLASH_SEC_SIZE && !updater_flush()) {
+            return false;
+        }
+        if (updater_data.manifest != NULL && boot_info.size == end && !updater_check_chunk()) {
             return false;
         }
     }
@@ -156,20 +236,15 @@ bool updater_write (uint8_t *buf, uint32_t len) {
 #ifdef DIFF_UPDATE_ENABLED
 bool updater_patch(void) {
 
-    const int HEADER_LEN            = 32;
-    const int MAGIC_BYTES_LEN       = 8;
-    const int CTRLEN_OFFSET         = 8;
-    const int DATALEN_OFFSET        = 16;
-    const int NEWFILE_SIZE_OFFSET   = 24;
-
     bool status = false;                    // Status to be returned (true for success, false otherwise)
-    unsigned char header[HEADER_LEN], buf[8];
+    uint8_t header[BSPATCH_HEADER_SIZE];
+    updater_patch_t patch = { .data = NULL, .percent = 0 };
+    bspatch_result_t res;
 
     uint32_t patch_offset;                  // Offset of the patch file in the flash
     uint32_t patch_size;                    // Size of the patch file
-    uint32_t old_bin_offset;                // Offset of the old/current binary image in the flash
-    uint32_t newsize;
-    uint32_t bzctrllen, bzdatalen, xtralen; // Lengths of various blocks in the patch file
+    uint32_t img_size = (esp32_get_chip_rev() > 0 ? IMG_SIZE_8MB : IMG_SIZE_4MB);
+    int32_t newsize;
 
     printf("Patching the binary...\n");
     // Since we haven't switched the active partition, the next partition
@@ -181,271 +256,78 @@ bool updater_patch(void) {
 
     // Getting the offset of the current image in the flash
     if (boot_info.ActiveImg == IMG_ACT_FACTORY) {
-        old_bin_offset = IMG_FACTORY_OFFSET;
+        patch.old_offset = IMG_FACTORY_OFFSET;
     } else {
-        old_bin_offset = (esp32_get_chip_rev() > 0 ? IMG_UPDATE1_OFFSET_8MB : IMG_UPDATE1_OFFSET_4MB);
+        patch.old_offset = (esp32_get_chip_rev() > 0 ? IMG_UPDATE1_OFFSET_8MB : IMG_UPDATE1_OFFSET_4MB);
     }
 
     ESP_LOGI(TAG, "Old_Offset: %d, Offset: %d, Size: %d, ChunkSize: %d, Chunk: %d\n",
-             old_bin_offset, updater_data.offset, updater_data.size, updater_data.chunk_size, updater_data.current_chunk);
+             patch.old_offset, updater_data.offset, updater_data.size, updater_data.chunk_size, updater_data.current_chunk);
     ESP_LOGI(TAG, "BootInfoSize: %d, BootInfoActiveImg: %d\n",
              boot_info.size, boot_info.ActiveImg);
 
-    // File format:
-    //     0   8   "BSDIFF40"
-    //     8   8   X
-    //     16  8   Y
-    //     24  8   sizeof(newfile)
-    //     32  X   bzip2(control block)
-    //     32+X    Y   bzip2(diff block)
-    //     32+X+Y  ??? bzip2(extra block)
-    // with control block a set of triples (x,y,z) meaning "add x bytes
-    // from oldfile to x bytes from the diff block; copy y bytes from the
-    // extra block; seek forwards in oldfile by z bytes".
-
-    // Reading header of the patch file
-
-    if (ESP_OK != updater_spi_flash_read(patch_offset, header, HEADER_LEN, false)) {
+    if (ESP_OK != updater_spi_flash_read(patch_offset, header, sizeof(header), false)) {
         printf("Error while reading patch file header\n");
         goto return_status;
     }
-
-    // Check for the appropriate magic
-    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0) {
+    newsize = bspatch_new_size(header);
+    if (patch_size < sizeof(header) || !bspatch_is_patch(header) || newsize < 0 || newsize > img_size) {
         printf("Invalid header\n");
         goto return_status;
     }
-
-    ESP_LOGI(TAG,"Header Verified\n");
-
-    // Reading lengths from header
-    bzctrllen = offtin(header + CTRLEN_OFFSET);
-    bzdatalen = offtin(header + DATALEN_OFFSET);
-    newsize = offtin(header + NEWFILE_SIZE_OFFSET);
-
-    xtralen = patch_size - (HEADER_LEN + bzctrllen + bzdatalen);
-
-    ESP_LOGD(TAG, "CtrlLen: %d, DataLen: %d, NewSize: %d, ExtraLen: %d\n", bzctrllen, bzdatalen, newsize, xtralen);
-
-    if ((bzctrllen < 0) || (bzdatalen < 0) || (newsize < 0) || (xtralen < 0)) {
-        printf("Invalid Block Sizes CtrlLen: %d, DataLen: %d, NewSize: %d, ExtraLen: %d\n", bzctrllen, bzdatalen, newsize, xtralen);
+    ESP_LOGI(TAG, "Header Verified, %.8s, NewSize: %d\n", header, newsize);
+
+    // The new image is written over the partition holding the patch, so the
+    // patch has to be copied out first. The rest is streamed: the old image
+    // and the new one go through the flash BSPATCH_IO_SIZE bytes at a time.
+    patch.data = heap_caps_malloc(patch_size, MALLOC_CAP_SPIRAM);
+    if (patch.data == NULL) {
+        printf("Failed to allocate %d bytes for the Patch File\n", patch_size);
+        goto return_status;
+    }
+    if (ESP_OK != updater_spi_flash_read(patch_offset, patch.data, patch_size, false)) {
+        printf("Error while reading the patch file\n");
         goto return_status;
     }
 
-    // Header is valid, reading the contents of the patch file
-    {
-        const int FLASH_READ_WRITE_SIZE = 512;              // Number of bytes read/written to flash at a time
-
-        uint16_t i = 0;
-        unsigned char *out_buf = NULL;
-        unsigned char *diff_ptr = NULL;
-        unsigned char *xtra_ptr = NULL;
-        unsigned char old_bin_buf[FLASH_READ_WRITE_SIZE];   // Buffer to read parts of old binary
-
-        unsigned char *patch_buf;
-
-        void *ctrl_strm = NULL;
-        void *diff_strm = NULL;
-        void *xtra_strm = NULL;
-
-        int ctrl[3];                                        // Buffer to read control block values from the patch file (NOTE: Its value can be negative)
-                                                            // Used to read (x,y,z) tuples from the Control Block
-        int oldpos = 0;                                     // Read pointer for old binary
-        int newpos = 0;                                     // Read pointer for the patched binary
-
-        unsigned int ctrl_len, diff_len, xtra_len;
-        int ret = 0;
-
-        // Reading the complete patch file
-        patch_buf = heap_caps_malloc(patch_size, MALLOC_CAP_SPIRAM);
-        if (patch_buf == NULL) {
-            printf("Failed to allocate %d bytes for the Patch File\n", patch_size);
-            goto free_mem_and_ret;
-        }
-
-        updater_spi_flash_read(patch_offset, patch_buf, patch_size, false);
-
-        // Creating BZLIB streams for decompression
-        ret = BZ2_bzDecompressStreamInit(&ctrl_strm, (char *)patch_buf + 32, bzctrllen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for CTRL block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
-        }
-        ret = BZ2_bzDecompressStreamInit(&diff_strm, (char *)patch_buf + 32 + bzctrllen, bzdatalen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for DIFF block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
-        }
-        ret = BZ2_bzDecompressStreamInit(&xtra_strm, (char *)patch_buf + 32 + bzctrllen + bzdatalen, xtralen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for EXTRA block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
-        }
-
-        // Memory for the buffer to store the decompressed blocks
-        const int AVAIL_MEM = 100 * 1024;
-
-        ESP_LOGD(TAG, "Going to allocate memory for decompressed blocks buffer: %d\n", AVAIL_MEM);
-        out_buf = heap_caps_malloc(AVAIL_MEM, MALLOC_CAP_SPIRAM);
-
-        if (out_buf == NULL) {
-            printf("Failed to allocate the buffer memory of size %d\n", AVAIL_MEM);
-            goto free_mem_and_ret;
-        }
-
-        // Starting the patching
-
-        // Initializing the parameters of the updater so that the next write is
-        // done from the start of the partition
-        if (!updater_start()) {
-            printf("Failed to START UPDATER\n");
-            goto free_mem_and_ret;
-        }
-
-        while (newpos < newsize) {
-            // Reading the control data
-            for (i = 0; i <= 2; i++) {
-                ctrl_len = 8;
-                ret = BZ2_bzDecompressRead(ctrl_strm, (char *)buf, &ctrl_len);
-                if (ret != BZ_OK || ctrl_len != 8) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl_len: %d, i: %d\n", ret, ctrl_len, i);
-                    goto free_mem_and_ret;
-                }
-
-                ctrl[i] = offtin(buf);
-            }
-
-            // Sanity-check
-            if (newpos + ctrl[0] > newsize) {
-                printf("PATCHING: Corrupt Patch. Violated newsize: %d, ctrl[0]: %d\n", newsize, ctrl[0]);
-                goto free_mem_and_ret;
-            }
-
-            // Decompressing ctrl[0] bytes of diff block
-            while (ctrl[0] > 0) {
-                unsigned int byte_count = 0;
-
-                if (ctrl[0] > AVAIL_MEM) {
-                    ctrl[0] -= AVAIL_MEM;
-                    diff_len = AVAIL_MEM;
-                }
-                else {
-                    diff_len = ctrl[0];
-                    ctrl[0] = 0;
-                }
-
-                ret = BZ2_bzDecompressRead(diff_strm, (char *)out_buf, &diff_len);
-
-                if (ret != BZ_OK) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl[0]: %d, diff_len: %d\n", ret, ctrl[0], diff_len);
-                    goto free_mem_and_ret;
-                }
-                diff_ptr = out_buf;
-
-                // Reading old binary file in chunks combining it with the Diff
-                // bytes
-                do {
-                    int bytes_to_read = 0;
-
-                    if ((diff_len - byte_count) > FLASH_READ_WRITE_SIZE) {
-                        bytes_to_read = FLASH_READ_WRITE_SIZE;
-                    } else {
-                        bytes_to_read = diff_len - byte_count;
-                    }
-
-                    if (ESP_OK != updater_spi_flash_read(old_bin_offset + oldpos, old_bin_buf, bytes_to_read, false)) {
-                        printf("Error while reading old bin block. old_bin_offset: %u, oldpos: %u, bytes_to_read: %d\n", old_bin_offset, oldpos, bytes_to_read);
-                        goto free_mem_and_ret;
-                    }
-
-                    for (i = 0; i < bytes_to_read; i++) {
-                        *(diff_ptr + i) += old_bin_buf[i];
-                    }
-
-                    if (!updater_write(diff_ptr, bytes_to_read)) {
-                        printf("Failed to write %d bytes to the Flash\n", bytes_to_read);
-                        goto free_mem_and_ret;
-                    }
-
-                    diff_ptr += bytes_to_read;
-                    oldpos += bytes_to_read;
-                    newpos += bytes_to_read;
-                    byte_count += bytes_to_read;
-
-                } while (byte_count < diff_len);
-            }
-
-            // Sanity-check
-            if (newpos + ctrl[1] > newsize) {
-                printf("PATCHING: Corrupt patch, ctrl[1]: %d violated newsize: %d\n", (int)ctrl[1], (int)newsize);
-                goto free_mem_and_ret;
-            }
-
-            // Decompressing Extra Bytes of size ctrl[1]
-            while (ctrl[1] > 0) {
-                if (ctrl[1] > AVAIL_MEM) {
-                    ctrl[1] -= AVAIL_MEM;
-                    xtra_len = AVAIL_MEM;
-                } else {
-                    xtra_len = ctrl[1];
-                    ctrl[1] = 0;
-                }
-
-                ret = BZ2_bzDecompressRead(xtra_strm, (char *)out_buf, &xtra_len);
-
-                if (ret != BZ_OK) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl[1]: %d, xtra_len: %d\n", ret, ctrl[1], xtra_len);
-                    goto free_mem_and_ret;
-                }
-                xtra_ptr = out_buf;
-
-                // Writing the bytes from the Extra Block
-                int write_size = xtra_len;
-                while (write_size > FLASH_READ_WRITE_SIZE) {
-                    if (!updater_write(xtra_ptr + xtra_len - write_size, FLASH_READ_WRITE_SIZE)) {
-                        printf("Failed to write %d bytes from Extra Block to the Flash\n", FLASH_READ_WRITE_SIZE);
-                        goto free_mem_and_ret;
-                    }
-                    write_size -= FLASH_READ_WRITE_SIZE;
-                }
-
-                if (write_size) {
-                    if (!updater_write(xtra_ptr + xtra_len - write_size, write_size)) {
-                        printf("Failed to write %d bytes from Extra Block to the Flash\n", write_size);
-                        goto free_mem_and_ret;
-                    }
-                }
-                newpos += xtra_len;
-            }
-
-            // Adjust the pointers
-            oldpos += ctrl[2];
-        }
+    // Initializing the parameters of the updater so that the next write is
+    // done from the start of the partition
+    if (!updater_start()) {
+        printf("Failed to START UPDATER\n");
+        goto return_status;
+    }
 
-        ESP_LOGI(TAG, "UPDATER_PATCH: PATCHED: %10d sized file\n", (int)newpos);
+    bspatch_io_t io = {
+        .read_patch = updater_patch_read_patch,
+        .read_old = updater_patch_read_old,
+        .write_new = updater_patch_write_new,
+        .progress = updater_patch_progress,
+        .ctx = &patch,
+        .patch_size = patch_size,
+        // past the end of the old image there's whatever the partition holds
+        .old_size = img_size,
+    };
+    res = bspatch_apply(&io);
+    if (res == BSPATCH_OK && !updater_flush()) {
+        res = BSPATCH_ERR_WRITE;
+    }
+    if (res != BSPATCH_OK) {
+        printf("PATCHING: failed with error %d at %d bytes\n", res, boot_info.size);
+        goto return_status;
+    }
 
-        ESP_LOGD(TAG, "UPDATER_PATCH: Old_Offset: %d, Offset: %d, Size: %d, ChunkSize: %d, Chunk: %d\n",
-                 old_bin_offset, updater_data.offset, updater_data.size,
-                 updater_data.chunk_size, updater_data.current_chunk);
+    ESP_LOGI(TAG, "UPDATER_PATCH: PATCHED: %10d sized file\n", boot_info.size);
 
-        status = true;
-        printf("Patching SUCCESSFUL.\n");
+    ESP_LOGD(TAG, "UPDATER_PATCH: Old_Offset: %d, Offset: %d, Size: %d, ChunkSize: %d, Chunk: %d\n",
+             patch.old_offset, updater_data.offset, updater_data.size,
+             updater_data.chunk_size, updater_data.current_chunk);
 
-    free_mem_and_ret:
-        heap_caps_free(patch_buf);
-        heap_caps_free(out_buf);
-        if (ctrl_strm) {
-            BZ2_bzDecompressStreamEnd(ctrl_strm);
-        }
-        if (diff_strm) {
-            BZ2_bzDecompressStreamEnd(diff_strm);
-        }
-        if (xtra_strm) {
-            BZ2_bzDecompressStreamEnd(xtra_strm);
-        }
-    }
+    status = true;
+    printf("Patching SUCCESSFUL.\n");
 
 return_status:
+    heap_caps_free(patch.data);
+    updater_release();
     if (status) {
         // Updating BOOT INFO
         boot_info.PrevImg = boot_info.ActiveImg;
@@ -472,6 +354,20 @@ return_status:
 
 bool updater_finish (void) {
     if (updater_data.offset > 0) {
+        bool complete = (updater_data.manifest == NULL || boot_info.size == updater_data.image_size);
+        if (!complete) {
+            // the progress stays, for updater_start_resumable() to continue
+            printf("Update incomplete, %d of %d bytes written.\n", boot_info.size, updater_data.image_size);
+        }
+        bool flushed = complete && updater_flush();
+        updater_release();
+        if (!flushed) {
+            updater_data.offset = 0;
+            return false;
+        }
+        bool progress = updater_progress_valid();
+        boot_info.progress.magic = 0;
+
         ESP_LOGI(TAG, "Updater finished, boot status: %d\n", boot_info.Status);
 //        sl_LockObjLock (&wlan_LockObj, SL_OS_WAIT_FOREVER);
         // if we still have an image pending for verification, leave the boot info as it is
@@ -503,6 +399,8 @@ bool updater_finish (void) {
                 // save the actual boot_info structure to otadata partition
                 updater_write_boot_info(&boot_info, boot_info_offset);
             }
+        } else if (progress) {
+            updater_write_boot_info(&boot_info, boot_info_offset);
         }
 //        sl_LockObjUnlock (&wlan_LockObj);
         updater_data.offset = 0;
@@ -535,7 +433,8 @@ bool updater_verify (void) {
 
 bool updater_write_boot_info(boot_info_t *boot_info, uint32_t boot_info_offset) {
 
-    boot_info->crc = crc32_le(UINT32_MAX, (uint8_t *)boot_info, sizeof(boot_info_t) - sizeof(boot_info->crc));
+    boot_info->crc = crc32_le(UINT32_MAX, (uint8_t *)boot_info, offsetof(boot_info_t, crc));
+    boot_info->progress.crc = crc32_le(UINT32_MAX, (uint8_t *)&boot_info->progress, offsetof(ota_progress_t, crc));
     ESP_LOGI(TAG, "Wr crc=0x%x\n", boot_info->crc);
 
     if (ESP_OK != spi_flash_erase_sector(boot_info_offset / SPI_FLASH_SEC_SIZE)) {
@@ -546,8 +445,8 @@ bool updater_write_boot_info(boot_info_t *boot_info, uint32_t boot_info_offset)
     // saving boot info, encrypted
     esp_err_t ret; // return code of the flash_write operation
     if (esp_flash_encryption_enabled()) {
-        // sizeof(boot_info_t) is 40 bytes, and we have to write multiple of 16
-        // so read next 48-40 bytes from flash, and write back 48 B
+        // sizeof(boot_info_t) is 64 bytes, and we have to write multiple of 16,
+        // if it wasn't, read the next bytes from flash, and write them back
 
         uint32_t len_aligned_16 = ((sizeof(boot_info_t) + 15) / 16) * 16;
         uint8_t *buff; // buffer used for filling boot_info data
@@ -686,11 +585,120 @@ static bool updater_is_delta_file(void)
         return false;
     }
 
-    // Check for appropriate magic
-    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0)
+    // Check for appropriate magic, of the bzip2 or of the LZ patches
+    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0 && memcmp(header, "BSDIFFLZ", MAGIC_BYTES_LEN) != 0)
     {
         return false;
     }
 
     return true;
 }
+
+// common to both kinds of update, reads the boot info
+static bool updater_open (void) {
+
+    updater_data.size = (esp32_get_chip_rev() > 0 ? IMG_SIZE_8MB : IMG_SIZE_4MB);
+    // check which one should be the next active image
+    updater_data.offset = updater_ota_next_slot_address();
+
+    ESP_LOGD(TAG, "Updating image at offset = 0x%6X\n", updater_data.offset);
+    updater_data.offset_start_upd = updater_data.offset;
+
+    updater_release();
+    if (updater_data.buffer == NULL && (updater_data.buffer = malloc(SPI_FLASH_SEC_SIZE)) == NULL) {
+        ESP_LOGE(TAG, "Can't allocate %d\n", SPI_FLASH_SEC_SIZE);
+        return false;
+    }
+
+    boot_info.size = 0;
+    updater_data.current_chunk = 0;
+
+    return true;
+}
+
+static void updater_release (void) {
+    if (updater_data.manifest != NULL) {
+        mbedtls_sha256_free(&updater_data.sha);
+        free(updater_data.manifest);
+        updater_data.manifest = NULL;
+    }
+    updater_data.chunk_size = 0;
+    free(updater_data.buffer);
+    updater_data.buffer = NULL;
+}
+
+static bool updater_flush (void) {
+    if (updater_data.current_chunk > 0) {
+        // a sector is erased once, right before it's written as a whole
+        if (ESP_OK != spi_flash_erase_sector(updater_data.offset / SPI_FLASH_SEC_SIZE)) {
+            ESP_LOGE(TAG, "Erasing sector failed!\n");
+            return false;
+        }
+        // the actual writing into flash, not-encrypted,
+        // because it already came encrypted from OTA server
+        if (ESP_OK != updater_spi_flash_write(updater_data.offset, updater_data.buffer, updater_data.current_chunk, false)) {
+            ESP_LOGE(TAG, "SPI flash write failed\n");
+            return false;
+        }
+        updater_data.offset += updater_data.current_chunk;
+        updater_data.current_chunk = 0;
+    }
+    return true;
+}
+
+// called at the end of each chunk of a resumable update
+static bool updater_check_chunk (void) {
+    uint32_t chunk = (boot_info.size - 1) / updater_data.chunk_size;
+    uint8_t digest[UPDATER_MANIFEST_DIGEST];
+
+    mbedtls_sha256_finish_ret(&updater_data.sha, digest);
+    mbedtls_sha256_starts_ret(&updater_data.sha, 0);
+    if (memcmp(digest, updater_data.manifest + UPDATER_MANIFEST_HEADER + chunk * UPDATER_MANIFEST_DIGEST, sizeof(digest)) != 0) {
+        // dropped, it has to be sent again from its start
+        ESP_LOGE(TAG, "Chunk %d doesn't match the manifest\n", chunk);
+        boot_info.size = chunk * updater_data.chunk_size;
+        updater_data.offset = updater_data.offset_start_upd + boot_info.size;
+        updater_data.current_chunk = 0;
+        return false;
+    }
+    // the last chunk may end inside a sector
+    if (!updater_flush()) {
+        return false;
+    }
+    boot_info.progress.offset = boot_info.size;
+    return updater_write_boot_info(&boot_info, boot_info_offset);
+}
+
+static bool updater_progress_valid (void) {
+    return boot_info.progress.magic == OTA_PROGRESS_MAGIC &&
+           boot_info.progress.crc == crc32_le(UINT32_MAX, (uint8_t *)&boot_info.progress, offsetof(ota_progress_t, crc));
+}
+
+#ifdef DIFF_UPDATE_ENABLED
+static bool updater_patch_read_patch (void *ctx, uint32_t offset, void *buf, uint32_t size) {
+    updater_patch_t *patch = ctx;
+
+    memcpy(buf, patch->data + offset, size);
+    return true;
+}
+
+static bool updater_patch_read_old (void *ctx, uint32_t offset, void *buf, uint32_t size) {
+    updater_patch_t *patch = ctx;
+
+    return ESP_OK == updater_spi_flash_read(patch->old_offset + offset, buf, size, false);
+}
+
+static bool updater_patch_write_new (void *ctx, const void *buf, uint32_t size) {
+    return updater_write((uint8_t *)buf, size);
+}
+
+static void updater_patch_progress (void *ctx, uint32_t done, uint32_t total) {
+    updater_patch_t *patch = ctx;
+    uint32_t percent = ((uint64_t)done * 100) / total;
+
+    if (percent / 10 != patch->percent / 10) {
+        printf("Patching: %d%%\n", percent);
+        patch->percent = percent;
+    }
+}
+#endif
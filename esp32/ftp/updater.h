@@ -13,6 +13,17 @@
 
 #include "bootloader.h"
 
+/* Manifest of a resumable update, little endian:
+ *
+ *   0   4   "OTAM"
+ *   4   4   image size
+ *   8   4   chunk size, a multiple of the 4 KB flash sector
+ *   12  32  SHA-256 of each chunk of the image, the last one may be shorter
+ */
+#define UPDATER_MANIFEST_MAGIC                  "OTAM"
+#define UPDATER_MANIFEST_HEADER                 12
+#define UPDATER_MANIFEST_DIGEST                 32
+
 /**
  * @brief  Checks the default path.
  *
@@ -31,11 +42,28 @@ extern bool updater_check_path(void *path);
 extern bool updater_start(void);
 
 
+/**
+ * @brief  Initializes an OTA update which survives a reset or a lost connection.
+ *
+ * @note Each chunk of the image is checked against the manifest once it's complete,
+ *        and the progress saved to the boot info. With the same manifest, a later
+ *        call continues from the last chunk verified. If updater_write() fails on a
+ *        bad chunk, calling this again gives the offset to send the chunk again from.
+ *
+ * @param  manifest  the manifest of the image, see UPDATER_MANIFEST_MAGIC
+ * @param  len       length of the manifest
+ * @param  offset    [out] where the image has to be sent from, 0 for a new download
+ *
+ * @return true if the manifest is valid and initialization succeeded; false otherwise.
+ */
+extern bool updater_start_resumable(const uint8_t *manifest, uint32_t len, uint32_t *offset);
+
 /**
  * @brief  OTA Write next chunk to Flash.
  *
  * @note The OTA process has to be previously initialized with updater_start().
- *        The buf is written as it is (not-encrypted) into Flash.
+ *        The data is gathered into whole flash sectors, each one is erased and
+ *        written once. The buf is written as it is (not-encrypted) into Flash.
  *        If Flash Encryption is enabled, the buf must be already encrypted (by the OTA server).
  *
  * @param  buf  buffer with the data-chunk which needs to be written into Flash
@@ -48,6 +76,8 @@ extern bool updater_write(uint8_t *buf, uint32_t len);
 /**
  * @brief  Closing the OTA process. This provokes updating the boot info from the otadata partition.
  *
+ * @note A resumable update fails here until the whole image is written, its progress is kept.
+ *
  * @return true if boot info was saved successful; false otherwise.
  */
 extern bool updater_finish(void);
@@ -0,0 +1,889 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the streaming patcher, esp32/bsdiff/bspatch_stream.c,
+ * applying patches from and to a file backed flash image laid out like the
+ * updater sees it: the old image, the new image and the patch.
+ *
+ *   test_bspatch                   run the unit tests, on generated images and
+ *                                  patches of both codecs
+ *   test_bspatch -b N              patch a 1.5 MB image N times with bzip2 and
+ *                                  LZ blocks, and the way the updater did before
+ *                                  (whole patch in RAM, 512 byte flash reads and
+ *                                  writes), and report the time and flash use
+ *   test_bspatch -w dir            write old.bin, new.bin and a BSDIFF40 patch.bin
+ *                                  to dir, for esp32/tools/bsdiff_lz.py
+ *   test_bspatch -a old patch new  apply the patch to old and compare with new
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "bspatch_stream.h"
+#include "bzlib.h"
+
+// where the images live in the flash file
+#define FLASH_PART              0x200000
+#define FLASH_OLD               0
+#define FLASH_NEW               FLASH_PART
+#define FLASH_PATCH             (2 * FLASH_PART)
+#define FLASH_SECTOR            4096
+
+// the updater before the streaming patcher
+#define LEGACY_IO_SIZE          512
+#define LEGACY_OUT_SIZE         (100 * 1024)
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t rand_state = 1;
+
+static uint32_t rnd(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static uint32_t rnd_range(uint32_t lo, uint32_t hi) {
+    return lo + rnd() % (hi - lo + 1);
+}
+
+/******************************************************************************
+ HOST STAND-INS: the flash is a file, every access is counted
+ ******************************************************************************/
+
+typedef struct {
+    int fd;
+    uint32_t written;
+    uint32_t patch_reads;
+    uint32_t old_reads;
+    uint32_t old_unaligned;
+    uint64_t old_bytes;
+    uint32_t writes;
+    uint32_t writes_short;      // writes smaller than BSPATCH_IO_SIZE
+    uint32_t erases;
+    uint32_t progress_calls;
+    uint32_t progress_done;
+    uint32_t progress_total;
+    bool progress_backwards;
+    int fail_read;              // fail the read with this count, -1 for none
+    int fail_write;
+} flash_t;
+
+static void flash_open(flash_t *f) {
+    char path[] = "/tmp/test_bspatch.XXXXXX";
+
+    memset(f, 0, sizeof(*f));
+    f->fd = mkstemp(path);
+    unlink(path);
+    f->fail_read = -1;
+    f->fail_write = -1;
+}
+
+static void flash_reset(flash_t *f) {
+    int fd = f->fd;
+
+    memset(f, 0, sizeof(*f));
+    f->fd = fd;
+    f->fail_read = -1;
+    f->fail_write = -1;
+}
+
+static void flash_put(flash_t *f, uint32_t at, const void *buf, uint32_t size) {
+    if (pwrite(f->fd, buf, size, at) != size) {
+        abort();
+    }
+}
+
+static uint8_t *flash_get(flash_t *f, uint32_t at, uint32_t size) {
+    uint8_t *buf = malloc(size + 1);
+
+    if (pread(f->fd, buf, size, at) != size) {
+        abort();
+    }
+    return buf;
+}
+
+static bool flash_read_patch(void *ctx, uint32_t offset, void *buf, uint32_t size) {
+    flash_t *f = ctx;
+
+    if (f->fail_read >= 0 && f->fail_read-- == 0) {
+        return false;
+    }
+    f->patch_reads++;
+    return pread(f->fd, buf, size, FLASH_PATCH + offset) == size;
+}
+
+static bool flash_read_old(void *ctx, uint32_t offset, void *buf, uint32_t size) {
+    flash_t *f = ctx;
+
+    if (f->fail_read >= 0 && f->fail_read-- == 0) {
+        return false;
+    }
+    f->old_reads++;
+    f->old_unaligned += (offset % BSPATCH_IO_SIZE) != 0;
+    f->old_bytes += size;
+    return pread(f->fd, buf, size, FLASH_OLD + offset) == size;
+}
+
+// like updater_write(), erasing each sector before the first write into it
+static bool flash_write(flash_t *f, const void *buf, uint32_t size) {
+    if (f->fail_write >= 0 && f->fail_write-- == 0) {
+        return false;
+    }
+    f->erases += (f->written + size + FLASH_SECTOR - 1) / FLASH_SECTOR - (f->written + FLASH_SECTOR - 1) / FLASH_SECTOR;
+    f->writes++;
+    if (pwrite(f->fd, buf, size, FLASH_NEW + f->written) != size) {
+        return false;
+    }
+    f->written += size;
+    return true;
+}
+
+static bool flash_write_new(void *ctx, const void *buf, uint32_t size) {
+    flash_t *f = ctx;
+
+    // only the tail of the image may come in a smaller piece
+    f->writes_short += (size != BSPATCH_IO_SIZE);
+    return flash_write(f, buf, size);
+}
+
+static void flash_progress(void *ctx, uint32_t done, uint32_t total) {
+    flash_t *f = ctx;
+
+    f->progress_backwards |= (done < f->progress_done);
+    f->progress_calls++;
+    f->progress_done = done;
+    f->progress_total = total;
+}
+
+static bspatch_result_t flash_apply(flash_t *f, uint32_t patch_size, uint32_t old_size) {
+    bspatch_io_t io = {
+        .read_patch = flash_read_patch,
+        .read_old = flash_read_old,
+        .write_new = flash_write_new,
+        .progress = flash_progress,
+        .ctx = f,
+        .patch_size = patch_size,
+        .old_size = old_size,
+    };
+    return bspatch_apply(&io);
+}
+
+/******************************************************************************
+ Patch generation: an edit script of the old image gives the new image and the
+ raw control, diff and extra blocks, which are then coded like bsdiff does
+ ******************************************************************************/
+
+typedef struct {
+    uint8_t *data;
+    uint32_t len;
+    uint32_t cap;
+} buf_t;
+
+static void buf_put(buf_t *b, const void *data, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (b->len + len > b->cap) {
+        b->cap = (b->len + len) * 2;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void offtout(int64_t x, uint8_t *buf) {
+    uint64_t y = (x < 0) ? -x : x;
+
+    for (int i = 0; i < 8; i++) {
+        buf[i] = y >> (8 * i);
+    }
+    if (x < 0) {
+        buf[7] |= 0x80;
+    }
+}
+
+typedef struct {
+    buf_t ctrl;
+    buf_t diff;
+    buf_t xtra;
+    buf_t new;
+} edit_t;
+
+static void edit_ctrl(edit_t *e, int64_t add, int64_t copy, int64_t seek) {
+    uint8_t buf[24];
+
+    offtout(add, buf);
+    offtout(copy, buf + 8);
+    offtout(seek, buf + 16);
+    buf_put(&e->ctrl, buf, sizeof(buf));
+}
+
+// add bytes from the old image, with a few of them changed
+static void edit_add(edit_t *e, const uint8_t *old, uint32_t old_size, int64_t oldpos, uint32_t len, uint32_t changes) {
+    for (uint32_t i = 0; i < len; i++) {
+        int64_t pos = oldpos + i;
+        uint8_t o = (pos >= 0 && pos < old_size) ? old[pos] : 0;
+        // like relocated addresses, small steps every now and then
+        uint8_t d = (changes && rnd() % changes == 0) ? rnd_range(1, 16) : 0;
+        uint8_t n = o + d;
+        buf_put(&e->diff, &d, 1);
+        buf_put(&e->new, &n, 1);
+    }
+}
+
+static void edit_extra(edit_t *e, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        uint8_t x = (rnd() % 3) ? rnd() % 64 : rnd();
+        buf_put(&e->xtra, &x, 1);
+        buf_put(&e->new, &x, 1);
+    }
+}
+
+// something that compresses about like firmware: a small vocabulary of words
+static uint8_t *make_image(uint32_t size) {
+    uint32_t words[256];
+    uint8_t *img = malloc(size + 4);
+
+    for (int i = 0; i < 256; i++) {
+        words[i] = rnd();
+    }
+    for (uint32_t i = 0; i < size; i += 4) {
+        uint32_t w = (rnd() % 4) ? words[rnd() % 256] : rnd();
+        memcpy(img + i, &w, 4);
+    }
+    return img;
+}
+
+// random edits over the whole old image, with moves back and forth
+static void make_edits(edit_t *e, const uint8_t *old, uint32_t old_size, uint32_t new_size) {
+    int64_t oldpos = 0;
+
+    memset(e, 0, sizeof(*e));
+    while (e->new.len < new_size) {
+        uint32_t left = new_size - e->new.len;
+        uint32_t add = rnd_range(1, 64 * 1024);
+        add = (add > left) ? left : add;
+        uint32_t copy = (rnd() % 4) ? rnd_range(0, 2048) : 0;
+        copy = (copy > left - add) ? left - add : copy;
+        int64_t seek = rnd_range(0, 1024);
+        if (rnd() % 8 == 0) {
+            seek = -(int64_t)rnd_range(0, 96 * 1024);
+        }
+        if (oldpos + add + seek < 0) {
+            seek = -(oldpos + add);
+        }
+        edit_ctrl(e, add, copy, seek);
+        edit_add(e, old, old_size, oldpos, add, 256);
+        edit_extra(e, copy);
+        oldpos += add + seek;
+    }
+}
+
+static void edit_free(edit_t *e) {
+    free(e->ctrl.data);
+    free(e->diff.data);
+    free(e->xtra.data);
+    free(e->new.data);
+}
+
+static void code_bz2(buf_t *out, const buf_t *raw) {
+    unsigned int len = raw->len + raw->len / 100 + 1024;
+    char *dst = malloc(len);
+    char empty;
+
+    // bzip2 takes no NULL source, even for an empty block
+    char *src = raw->len ? (char *)raw->data : &empty;
+    if (BZ2_bzBuffToBuffCompress(dst, &len, src, raw->len, 9, 0, 30) != BZ_OK) {
+        abort();
+    }
+    buf_put(out, dst, len);
+    free(dst);
+}
+
+static uint32_t lz_length(uint8_t *out, uint32_t n) {
+    uint32_t i = 0;
+
+    for (; n >= 255; n -= 255) {
+        out[i++] = 255;
+    }
+    out[i++] = n;
+    return i;
+}
+
+// greedy LZ4 block compression, the same as esp32/tools/bsdiff_lz.py
+static uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst) {
+    int32_t table[4096];
+    uint32_t anchor = 0, i = 0, o = 0;
+
+    memset(table, -1, sizeof(table));
+    while (i + 12 < len) {
+        uint32_t key;
+        memcpy(&key, src + i, 4);
+        uint32_t h = (key * 2654435761U) >> 20;
+        int32_t ref = table[h];
+        table[h] = i;
+        if (ref < 0 || memcmp(src + ref, src + i, 4) != 0) {
+            i++;
+            continue;
+        }
+        uint32_t n = 4;
+        while (i + n < len - 5 && src[ref + n] == src[i + n]) {
+            n++;
+        }
+        uint32_t lit = i - anchor;
+        uint32_t ml = n - 4;
+        dst[o++] = ((lit < 15 ? lit : 15) << 4) | (ml < 15 ? ml : 15);
+        if (lit >= 15) {
+            o += lz_length(dst + o, lit - 15);
+        }
+        memcpy(dst + o, src + anchor, lit);
+        o += lit;
+        dst[o++] = (i - ref);
+        dst[o++] = (i - ref) >> 8;
+        if (ml >= 15) {
+            o += lz_length(dst + o, ml - 15);
+        }
+        i += n;
+        anchor = i;
+    }
+    uint32_t lit = len - anchor;
+    dst[o++] = (lit < 15 ? lit : 15) << 4;
+    if (lit >= 15) {
+        o += lz_length(dst + o, lit - 15);
+    }
+    memcpy(dst + o, src + anchor, lit);
+    return o + lit;
+}
+
+static void code_lz(buf_t *out, const buf_t *raw) {
+    uint8_t frame[BSPATCH_LZ_FRAME_SIZE * 2];
+
+    for (uint32_t i = 0; i < raw->len; i += BSPATCH_LZ_FRAME_SIZE) {
+        uint32_t n = raw->len - i;
+        n = (n > BSPATCH_LZ_FRAME_SIZE) ? BSPATCH_LZ_FRAME_SIZE : n;
+        uint32_t lz = lz_compress(raw->data + i, n, frame);
+        uint8_t header[4] = { n, n >> 8, lz, lz >> 8 };
+        if (lz >= n) {
+            header[2] = header[3] = 0;
+            buf_put(out, header, 4);
+            buf_put(out, raw->data + i, n);
+        } else {
+            buf_put(out, header, 4);
+            buf_put(out, frame, lz);
+        }
+    }
+}
+
+static void make_patch(buf_t *patch, const edit_t *e, bool lz) {
+    buf_t ctrl = { 0 }, diff = { 0 }, xtra = { 0 };
+    uint8_t header[BSPATCH_HEADER_SIZE];
+
+    if (lz) {
+        code_lz(&ctrl, &e->ctrl);
+        code_lz(&diff, &e->diff);
+        code_lz(&xtra, &e->xtra);
+    } else {
+        code_bz2(&ctrl, &e->ctrl);
+        code_bz2(&diff, &e->diff);
+        code_bz2(&xtra, &e->xtra);
+    }
+    memcpy(header, lz ? BSPATCH_MAGIC_LZ : BSPATCH_MAGIC_BZ2, 8);
+    offtout(ctrl.len, header + 8);
+    offtout(diff.len, header + 16);
+    offtout(e->new.len, header + 24);
+    memset(patch, 0, sizeof(*patch));
+    buf_put(patch, header, sizeof(header));
+    buf_put(patch, ctrl.data, ctrl.len);
+    buf_put(patch, diff.data, diff.len);
+    buf_put(patch, xtra.data, xtra.len);
+    free(ctrl.data);
+    free(diff.data);
+    free(xtra.data);
+}
+
+// applies the patch and compares with the expected image, if there is one
+static bspatch_result_t check_patch(flash_t *f, const buf_t *patch, const uint8_t *old, uint32_t old_size,
+                                    const uint8_t *new, uint32_t new_size) {
+    flash_reset(f);
+    flash_put(f, FLASH_OLD, old, old_size);
+    flash_put(f, FLASH_PATCH, patch->data, patch->len);
+    bspatch_result_t res = flash_apply(f, patch->len, old_size);
+    if (res == BSPATCH_OK && new != NULL) {
+        uint8_t *out = flash_get(f, FLASH_NEW, new_size);
+        CHECK(f->written == new_size);
+        CHECK(memcmp(out, new, new_size) == 0);
+        free(out);
+    }
+    return res;
+}
+
+/******************************************************************************
+ Tests
+ ******************************************************************************/
+
+static void test_roundtrip(flash_t *f) {
+    // sizes around the write unit, and images shorter and longer than the old
+    static const uint32_t sizes[][2] = {
+        { 1, 1 }, { 100, 5000 }, { 4096, 4096 }, { 20000, 4095 }, { 20000, 4097 },
+        { 65536, 100000 }, { 300000, 260000 }, { 200000, 400001 },
+    };
+
+    for (int lz = 0; lz <= 1; lz++) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            uint32_t old_size = sizes[i][0], new_size = sizes[i][1];
+            uint8_t *old = make_image(old_size);
+            edit_t e;
+            buf_t patch;
+            make_edits(&e, old, old_size, new_size);
+            make_patch(&patch, &e, lz);
+
+            CHECK(bspatch_is_patch(patch.data));
+            CHECK(bspatch_new_size(patch.data) == new_size);
+            CHECK(check_patch(f, &patch, old, old_size, e.new.data, new_size) == BSPATCH_OK);
+            CHECK(f->writes_short <= 1);
+            CHECK(f->writes == (new_size + BSPATCH_IO_SIZE - 1) / BSPATCH_IO_SIZE);
+            CHECK(f->old_unaligned == 0);
+            CHECK(f->progress_calls == f->writes);
+            CHECK(!f->progress_backwards);
+            CHECK(f->progress_done == new_size && f->progress_total == new_size);
+            free(patch.data);
+            edit_free(&e);
+            free(old);
+        }
+    }
+}
+
+static void test_empty(flash_t *f) {
+    uint8_t old[16] = { 0 };
+    edit_t e;
+    buf_t patch;
+
+    for (int lz = 0; lz <= 1; lz++) {
+        make_edits(&e, old, sizeof(old), 0);
+        make_patch(&patch, &e, lz);
+        CHECK(check_patch(f, &patch, old, sizeof(old), NULL, 0) == BSPATCH_OK);
+        CHECK(f->writes == 0 && f->written == 0);
+        free(patch.data);
+        edit_free(&e);
+    }
+}
+
+// adds before the start and past the end of the old image add nothing
+static void test_old_bounds(flash_t *f) {
+    uint32_t old_size = 10000;
+    uint8_t *old = make_image(old_size);
+    edit_t e;
+    buf_t patch;
+
+    for (int lz = 0; lz <= 1; lz++) {
+        memset(&e, 0, sizeof(e));
+        edit_ctrl(&e, 5000, 10, -7000);
+        edit_add(&e, old, old_size, 0, 5000, 16);
+        edit_extra(&e, 10);
+        edit_ctrl(&e, 9000, 0, 20000);
+        edit_add(&e, old, old_size, -2000, 9000, 16);
+        edit_ctrl(&e, 3000, 0, 0);
+        edit_add(&e, old, old_size, 27000, 3000, 16);
+        make_patch(&patch, &e, lz);
+        CHECK(check_patch(f, &patch, old, old_size, e.new.data, e.new.len) == BSPATCH_OK);
+        free(patch.data);
+        edit_free(&e);
+    }
+    free(old);
+}
+
+static void test_lz_frames(flash_t *f) {
+    static const uint32_t lens[] = { 1, 4, 12, 13, 17, 300, 4095, 4096, 4097, 12345 };
+    uint8_t old[64] = { 0 };
+
+    // runs (overlapping matches), text like data and noise, of many lengths
+    for (int kind = 0; kind < 3; kind++) {
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            edit_t e;
+            buf_t patch;
+            memset(&e, 0, sizeof(e));
+            edit_ctrl(&e, 0, lens[i], 0);
+            for (uint32_t j = 0; j < lens[i]; j++) {
+                uint8_t x = (kind == 0) ? 0xAA : (kind == 1) ? "pycom bsdiff "[rnd() % 13] : rnd();
+                buf_put(&e.xtra, &x, 1);
+                buf_put(&e.new, &x, 1);
+            }
+            make_patch(&patch, &e, true);
+            CHECK(check_patch(f, &patch, old, sizeof(old), e.new.data, e.new.len) == BSPATCH_OK);
+            free(patch.data);
+            edit_free(&e);
+        }
+    }
+}
+
+static void test_errors(flash_t *f) {
+    uint32_t old_size = 50000;
+    uint8_t *old = make_image(old_size);
+    edit_t e;
+    buf_t patch;
+
+    make_edits(&e, old, old_size, 60000);
+    for (int lz = 0; lz <= 1; lz++) {
+        make_patch(&patch, &e, lz);
+
+        // header
+        buf_t bad = { 0 };
+        buf_put(&bad, patch.data, patch.len);
+        bad.data[7] = '1';
+        CHECK(!bspatch_is_patch(bad.data));
+        CHECK(check_patch(f, &bad, old, old_size, NULL, 0) == BSPATCH_ERR_HEADER);
+        memcpy(bad.data, patch.data, 8);
+        bad.data[15] = 0x80;
+        CHECK(check_patch(f, &bad, old, old_size, NULL, 0) == BSPATCH_ERR_HEADER);
+        offtout(patch.len, bad.data + 8);
+        CHECK(check_patch(f, &bad, old, old_size, NULL, 0) == BSPATCH_ERR_HEADER);
+        bad.len = 20;
+        CHECK(check_patch(f, &bad, old, old_size, NULL, 0) == BSPATCH_ERR_HEADER);
+
+        // truncated
+        memcpy(bad.data, patch.data, patch.len);
+        bad.len = patch.len - 100;
+        CHECK(check_patch(f, &bad, old, old_size, e.new.data, e.new.len) != BSPATCH_OK);
+
+        // damaged anywhere in the blocks: an error, never a crash
+        for (int i = 0; i < 200; i++) {
+            memcpy(bad.data, patch.data, patch.len);
+            bad.len = patch.len;
+            bad.data[rnd_range(BSPATCH_HEADER_SIZE, patch.len - 1)] ^= 1 << (rnd() % 8);
+            bspatch_result_t res = check_patch(f, &bad, old, old_size, NULL, 0);
+            CHECK(res == BSPATCH_OK || res == BSPATCH_ERR_CORRUPT);
+        }
+
+        // the flash failing
+        for (int i = 0; i < 10; i++) {
+            flash_reset(f);
+            flash_put(f, FLASH_PATCH, patch.data, patch.len);
+            f->fail_read = rnd_range(0, 4);
+            CHECK(flash_apply(f, patch.len, old_size) == BSPATCH_ERR_READ);
+            flash_reset(f);
+            f->fail_write = rnd_range(0, 10);
+            CHECK(flash_apply(f, patch.len, old_size) == BSPATCH_ERR_WRITE);
+        }
+        free(bad.data);
+        free(patch.data);
+    }
+    edit_free(&e);
+
+    // a control triple going past the new image
+    for (int lz = 0; lz <= 1; lz++) {
+        memset(&e, 0, sizeof(e));
+        edit_ctrl(&e, 100, 100, 0);
+        edit_add(&e, old, old_size, 0, 100, 0);
+        edit_extra(&e, 100);
+        make_patch(&patch, &e, lz);
+        offtout(150, patch.data + 24);
+        CHECK(check_patch(f, &patch, old, old_size, NULL, 0) == BSPATCH_ERR_CORRUPT);
+        free(patch.data);
+        edit_free(&e);
+    }
+    free(old);
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+
+static void *legacy_bz_alloc(void *opaque, int items, int size) {
+    return malloc(items * size);
+}
+
+static void legacy_bz_free(void *opaque, void *addr) {
+    free(addr);
+}
+
+static bool legacy_bz_read(bz_stream *s, uint8_t *dst, uint32_t len) {
+    s->next_out = (char *)dst;
+    s->avail_out = len;
+    int ret = BZ2_bzDecompress(s);
+    return (ret == BZ_OK || ret == BZ_STREAM_END) && s->avail_out == 0;
+}
+
+static int64_t legacy_offtin(const uint8_t *buf) {
+    int64_t y = buf[7] & 0x7F;
+
+    for (int i = 6; i >= 0; i--) {
+        y = y * 256 + buf[i];
+    }
+    return (buf[7] & 0x80) ? -y : y;
+}
+
+// the former updater_patch(): the patch read into RAM, bzip2 read into a
+// 100 KB buffer, the old image read and the new one written 512 bytes a time
+static bool legacy_apply(flash_t *f, uint32_t patch_size, uint32_t old_size) {
+    uint8_t *patch = malloc(patch_size);
+    uint8_t *out = malloc(LEGACY_OUT_SIZE);
+    uint8_t old[LEGACY_IO_SIZE];
+    bz_stream s[3];
+    bool ok = false;
+
+    memset(s, 0, sizeof(s));
+    f->patch_reads++;
+    if (pread(f->fd, patch, patch_size, FLASH_PATCH) != patch_size) {
+        goto exit;
+    }
+    int64_t ctrllen = legacy_offtin(patch + 8);
+    int64_t datalen = legacy_offtin(patch + 16);
+    int64_t newsize = legacy_offtin(patch + 24);
+    uint32_t start[3] = { 32, 32 + ctrllen, 32 + ctrllen + datalen };
+    uint32_t len[3] = { ctrllen, datalen, patch_size - start[2] };
+    for (int i = 0; i < 3; i++) {
+        s[i].bzalloc = legacy_bz_alloc;
+        s[i].bzfree = legacy_bz_free;
+        BZ2_bzDecompressInit(&s[i], 0, 1);
+        s[i].next_in = (char *)patch + start[i];
+        s[i].avail_in = len[i];
+    }
+
+    int64_t oldpos = 0, newpos = 0;
+    while (newpos < newsize) {
+        uint8_t buf[24];
+        if (!legacy_bz_read(&s[0], buf, 24)) {
+            goto exit;
+        }
+        int64_t add = legacy_offtin(buf), copy = legacy_offtin(buf + 8);
+        while (add > 0) {
+            uint32_t n = (add > LEGACY_OUT_SIZE) ? LEGACY_OUT_SIZE : add;
+            if (!legacy_bz_read(&s[1], out, n)) {
+                goto exit;
+            }
+            for (uint32_t done = 0; done < n; done += LEGACY_IO_SIZE) {
+                uint32_t m = (n - done > LEGACY_IO_SIZE) ? LEGACY_IO_SIZE : n - done;
+                f->old_reads++;
+                f->old_bytes += m;
+                if (pread(f->fd, old, m, FLASH_OLD + oldpos) < 0) {
+                    goto exit;
+                }
+                for (uint32_t i = 0; i < m; i++) {
+                    out[done + i] += (oldpos + i < old_size) ? old[i] : 0;
+                }
+                if (!flash_write(f, out + done, m)) {
+                    goto exit;
+                }
+                oldpos += m;
+            }
+            newpos += n;
+            add -= n;
+        }
+        while (copy > 0) {
+            uint32_t n = (copy > LEGACY_OUT_SIZE) ? LEGACY_OUT_SIZE : copy;
+            if (!legacy_bz_read(&s[2], out, n)) {
+                goto exit;
+            }
+            for (uint32_t done = 0; done < n; done += LEGACY_IO_SIZE) {
+                uint32_t m = (n - done > LEGACY_IO_SIZE) ? LEGACY_IO_SIZE : n - done;
+                if (!flash_write(f, out + done, m)) {
+                    goto exit;
+                }
+            }
+            newpos += n;
+            copy -= n;
+        }
+        oldpos += legacy_offtin(buf + 16);
+    }
+    ok = true;
+
+exit:
+    for (int i = 0; i < 3; i++) {
+        BZ2_bzDecompressEnd(&s[i]);
+    }
+    free(patch);
+    free(out);
+    return ok;
+}
+
+// ESP32 SPI flash at 40 MHz QIO, roughly: a fixed cost per operation, plus
+// the bytes, plus programming 256 byte pages and erasing 4 KB sectors
+static double flash_model_ms(const flash_t *f, uint32_t patch_size) {
+    double reads = f->patch_reads + f->old_reads;
+    double read_bytes = f->old_bytes + patch_size;
+    double pages = f->written / 256.0;
+    return (reads * 20 + read_bytes * 0.05 + f->writes * 20 + pages * 700 + f->erases * 45000) / 1000.0;
+}
+
+static void bench(int runs) {
+    const uint32_t old_size = 1536 * 1024, new_size = 1560 * 1024;
+    uint8_t *old = make_image(old_size);
+    edit_t e;
+    flash_t f;
+
+    flash_open(&f);
+    make_edits(&e, old, old_size, new_size);
+    printf("old image %u bytes, new image %u bytes, %u bytes of extra\n", old_size, new_size, e.xtra.len);
+    printf("%-26s %10s %10s %10s %10s %10s %12s\n", "", "patch", "ms", "reads", "writes", "erases", "flash ms");
+    for (int mode = 0; mode < 3; mode++) {
+        const char *name[] = { "512 B, patch in RAM", "streaming, bzip2", "streaming, LZ" };
+        buf_t patch;
+        make_patch(&patch, &e, mode == 2);
+        uint64_t total = 0;
+        for (int r = 0; r < runs; r++) {
+            flash_reset(&f);
+            flash_put(&f, FLASH_OLD, old, old_size);
+            flash_put(&f, FLASH_PATCH, patch.data, patch.len);
+            uint64_t t0 = now_ns();
+            bool ok = (mode == 0) ? legacy_apply(&f, patch.len, old_size)
+                                  : flash_apply(&f, patch.len, old_size) == BSPATCH_OK;
+            total += now_ns() - t0;
+            CHECK(ok && f.written == new_size);
+        }
+        uint8_t *out = flash_get(&f, FLASH_NEW, new_size);
+        CHECK(memcmp(out, e.new.data, new_size) == 0);
+        free(out);
+        printf("%-26s %10u %10.1f %10u %10u %10u %12.0f\n", name[mode], patch.len, total / 1e6 / runs,
+               f.patch_reads + f.old_reads, f.writes, f.erases, flash_model_ms(&f, patch.len));
+        free(patch.data);
+    }
+    close(f.fd);
+    edit_free(&e);
+    free(old);
+}
+
+/******************************************************************************
+ Files for esp32/tools/bsdiff_lz.py
+ ******************************************************************************/
+
+static void write_file(const char *dir, const char *name, const void *data, uint32_t len) {
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(data, 1, len, fp) != len) {
+        perror(path);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+static uint8_t *read_file(const char *path, uint32_t *len) {
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = malloc(*len + 1);
+    if (fread(data, 1, *len, fp) != *len) {
+        perror(path);
+        exit(1);
+    }
+    fclose(fp);
+    return data;
+}
+
+static void write_files(const char *dir) {
+    const uint32_t old_size = 192 * 1024, new_size = 200 * 1024;
+    uint8_t *old = make_image(old_size);
+    edit_t e;
+    buf_t patch;
+
+    make_edits(&e, old, old_size, new_size);
+    make_patch(&patch, &e, false);
+    write_file(dir, "old.bin", old, old_size);
+    write_file(dir, "new.bin", e.new.data, e.new.len);
+    write_file(dir, "patch.bin", patch.data, patch.len);
+    free(patch.data);
+    edit_free(&e);
+    free(old);
+}
+
+static int apply_files(const char *old_path, const char *patch_path, const char *new_path) {
+    buf_t patch;
+    uint32_t old_size, new_size;
+    uint8_t *old = read_file(old_path, &old_size);
+    uint8_t *new = read_file(new_path, &new_size);
+    flash_t f;
+
+    patch.data = read_file(patch_path, &patch.len);
+    flash_open(&f);
+    bspatch_result_t res = check_patch(&f, &patch, old, old_size, new, new_size);
+    CHECK(res == BSPATCH_OK);
+    printf("%s: %u bytes, %.8s, %s\n", patch_path, patch.len, patch.data, (res == BSPATCH_OK && !failures) ? "applied" : "FAILED");
+    close(f.fd);
+    free(patch.data);
+    free(old);
+    free(new);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int runs = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:w:a")) != -1) {
+        switch (opt) {
+        case 'b':
+            runs = atoi(optarg);
+            break;
+        case 'w':
+            write_files(optarg);
+            return 0;
+        case 'a':
+            if (argc - optind != 3) {
+                fprintf(stderr, "usage: %s -a old patch new\n", argv[0]);
+                return 2;
+            }
+            return apply_files(argv[optind], argv[optind + 1], argv[optind + 2]);
+        default:
+            fprintf(stderr, "usage: %s [-b runs] [-w dir] [-a old patch new]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (runs > 0) {
+        bench(runs);
+        return failures ? 1 : 0;
+    }
+
+    flash_t f;
+    flash_open(&f);
+    test_roundtrip(&f);
+    test_empty(&f);
+    test_old_bounds(&f);
+    test_lz_frames(&f);
+    test_errors(&f);
+    close(f.fd);
+
+    if (failures) {
+        printf("test_bspatch: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_bspatch: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the block cache of the mounts, see
+ * extmod/vfs_blockcache.h, alone and under FatFS. The block device is an
+ * image file in /tmp, read and written with pread() and pwrite(). It counts
+ * the requests and the blocks, and models their time on an SD card on the
+ * SPI bus, with multi-block commands.
+ *
+ *   test_blockcache                run the unit tests
+ *   test_blockcache -b N [-s seed] create N files, list them, stat them,
+ *                                  read them back in small pieces, then read
+ *                                  a 512 KB file by sectors and at random.
+ *                                  Without the cache, with it and no
+ *                                  read-ahead, and with read-ahead
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/oofatfs/ff.h"
+#include "lib/oofatfs/diskio.h"
+#include "extmod/vfs_blockcache.h"
+
+#define SECTOR_SIZE             512
+#define SECTOR_COUNT            (8 * 1024 * 1024 / SECTOR_SIZE)
+
+// SD card on SPI at 20 MHz, typical, in us
+#define T_REQUEST_US            150     // command, response, data token
+#define T_BLOCK_US              210     // 512 bytes and the CRC
+#define T_WRITE_BUSY_US         600     // programming, per write request
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+static int image = -1;
+static uint32_t fail_from = UINT32_MAX;     // reads from this block fail
+
+static struct {
+    uint32_t reads;
+    uint64_t read_blocks;
+    uint32_t writes;
+    uint64_t written_blocks;
+} stats;
+
+static int dev_read(void *ctx, uint8_t *buf, uint32_t block, uint32_t count) {
+    if (block + count > SECTOR_COUNT || block + count > fail_from) {
+        return EIO;
+    }
+    if (pread(image, buf, count * SECTOR_SIZE, (off_t)block * SECTOR_SIZE) != count * SECTOR_SIZE) {
+        return EIO;
+    }
+    stats.reads++;
+    stats.read_blocks += count;
+    return 0;
+}
+
+static int dev_write(void *ctx, const uint8_t *buf, uint32_t block, uint32_t count) {
+    if (block + count > SECTOR_COUNT) {
+        return EIO;
+    }
+    if (pwrite(image, buf, count * SECTOR_SIZE, (off_t)block * SECTOR_SIZE) != count * SECTOR_SIZE) {
+        return EIO;
+    }
+    stats.writes++;
+    stats.written_blocks += count;
+    return 0;
+}
+
+static const vfs_blockcache_io_t dev_io = {
+    .read = dev_read,
+    .write = dev_write,
+};
+
+// the mount, as in extmod/vfs_fat_diskio.c
+typedef struct {
+    FATFS fatfs;
+    vfs_blockcache_t *cache;
+} mount_t;
+
+DRESULT disk_read(void *drv, BYTE *buff, DWORD sector, UINT count) {
+    mount_t *m = drv;
+    int err = m->cache ? vfs_blockcache_read(m->cache, buff, sector, count) : dev_read(NULL, buff, sector, count);
+    return err ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_write(void *drv, const BYTE *buff, DWORD sector, UINT count) {
+    mount_t *m = drv;
+    int err = m->cache ? vfs_blockcache_write(m->cache, buff, sector, count) : dev_write(NULL, buff, sector, count);
+    return err ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_ioctl(void *drv, BYTE cmd, void *buff) {
+    mount_t *m = drv;
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            return (m->cache && vfs_blockcache_sync(m->cache)) ? RES_ERROR : RES_OK;
+        case GET_SECTOR_COUNT:
+            *(DWORD*)buff = SECTOR_COUNT;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD*)buff = SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD*)buff = 1;
+            return RES_OK;
+        case IOCTL_INIT:
+        case IOCTL_STATUS:
+            *(DSTATUS*)buff = 0;
+            return RES_OK;
+    }
+    return RES_PARERR;
+}
+
+DWORD get_fattime(void) {
+    return ((2020 - 1980) << 25) | (1 << 21) | (1 << 16);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+static void image_open(void) {
+    char path[] = "/tmp/test_blockcache.XXXXXX";
+
+    image = mkstemp(path);
+    unlink(path);
+    if (image < 0 || ftruncate(image, (off_t)SECTOR_COUNT * SECTOR_SIZE) != 0) {
+        perror("image");
+        exit(2);
+    }
+}
+
+static void stats_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+static uint64_t stats_device_us(void) {
+    return (uint64_t)(stats.reads + stats.writes) * T_REQUEST_US +
+           (stats.read_blocks + stats.written_blocks) * T_BLOCK_US + (uint64_t)stats.writes * T_WRITE_BUSY_US;
+}
+
+static vfs_blockcache_t *cache_new(uint32_t entries, uint32_t readahead) {
+    vfs_blockcache_t *cache = malloc(sizeof(vfs_blockcache_t));
+
+    vfs_blockcache_init(cache, malloc(vfs_blockcache_mem_size(entries, SECTOR_SIZE, readahead)), entries,
+                        SECTOR_SIZE, SECTOR_COUNT, readahead, &dev_io, NULL);
+    return cache;
+}
+
+static void cache_free(vfs_blockcache_t *cache) {
+    if (cache != NULL) {
+        free(cache->entries);
+        free(cache);
+    }
+}
+
+static void fill(uint8_t *buf, uint32_t block, uint32_t count, uint8_t salt) {
+    for (uint32_t i = 0; i < count * SECTOR_SIZE; i++) {
+        buf[i] = (uint8_t)((block + i / SECTOR_SIZE) * 7 + i + salt);
+    }
+}
+
+static bool same(const uint8_t *buf, uint32_t block, uint32_t count, uint8_t salt) {
+    static uint8_t expected[64 * SECTOR_SIZE];
+
+    fill(expected, block, count, salt);
+    return memcmp(buf, expected, count * SECTOR_SIZE) == 0;
+}
+
+// the content of file i, of some size between 100 bytes and 6 KB
+static UINT file_data(int i, uint8_t *buf) {
+    UINT len = 100 + (i * 1237) % 6000;
+
+    for (UINT k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i * 31 + k * 7);
+    }
+    return len;
+}
+
+static FRESULT write_file(FATFS *fs, const char *path, const uint8_t *data, UINT len, UINT chunk) {
+    FIL fp;
+    UINT n;
+    FRESULT res = f_open(fs, &fp, path, FA_WRITE | FA_CREATE_ALWAYS);
+
+    for (UINT done = 0; res == FR_OK && done < len; done += n) {
+        res = f_write(&fp, data + done, (len - done < chunk) ? len - done : chunk, &n);
+    }
+    if (res == FR_OK) {
+        res = f_close(&fp);
+    }
+    return res;
+}
+
+static UINT read_file(FATFS *fs, const char *path, uint8_t *buf, UINT max, UINT chunk) {
+    FIL fp;
+    UINT len = 0, n;
+
+    if (f_open(fs, &fp, path, FA_READ) != FR_OK) {
+        return 0;
+    }
+    while (len < max && f_read(&fp, buf + len, (max - len < chunk) ? max - len : chunk, &n) == FR_OK && n > 0) {
+        len += n;
+    }
+    f_close(&fp);
+    return len;
+}
+
+static void mount(mount_t *m, vfs_blockcache_t *cache) {
+    memset(m, 0, sizeof(*m));
+    m->fatfs.drv = m;
+    m->cache = cache;
+    CHECK(f_mount(&m->fatfs) == FR_OK);
+}
+
+static void mkfs(vfs_blockcache_t *cache) {
+    static uint8_t work[FF_MAX_SS];
+    mount_t m;
+
+    memset(&m, 0, sizeof(m));
+    m.fatfs.drv = &m;
+    m.cache = cache;
+    CHECK(f_mkfs(&m.fatfs, FM_FAT | FM_SFD, 0, work, sizeof(work)) == FR_OK);
+    if (cache != NULL) {
+        CHECK(vfs_blockcache_sync(cache) == 0);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_hits_lru(void) {
+    static uint8_t buf[8 * SECTOR_SIZE];
+    vfs_blockcache_t *cache = cache_new(4, 0);
+
+    fill(buf, 100, 8, 1);
+    CHECK(dev_write(NULL, buf, 100, 8) == 0);
+    stats_reset();
+    for (uint32_t b = 100; b < 104; b++) {
+        CHECK(vfs_blockcache_read(cache, buf, b, 1) == 0 && same(buf, b, 1, 1));
+    }
+    CHECK(stats.reads == 4 && cache->misses == 4 && cache->hits == 0);
+    for (uint32_t b = 100; b < 104; b++) {
+        CHECK(vfs_blockcache_read(cache, buf, b, 1) == 0 && same(buf, b, 1, 1));
+    }
+    CHECK(stats.reads == 4 && cache->hits == 4);
+
+    // 100 was used least recently, then 101
+    CHECK(vfs_blockcache_read(cache, buf, 101, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 106, 1) == 0 && same(buf, 106, 1, 1));
+    CHECK(vfs_blockcache_read(cache, buf, 101, 3) == 0 && same(buf, 101, 3, 1));
+    CHECK(stats.reads == 5);
+    CHECK(vfs_blockcache_read(cache, buf, 100, 1) == 0 && same(buf, 100, 1, 1));
+    CHECK(stats.reads == 6);
+
+    // across hits and misses
+    CHECK(vfs_blockcache_read(cache, buf, 100, 7) == 0 && same(buf, 100, 7, 1));
+    CHECK(vfs_blockcache_read(cache, buf, 102, 6) == 0 && same(buf, 102, 6, 1));
+    cache_free(cache);
+}
+
+static void test_readahead(void) {
+    static uint8_t buf[16 * SECTOR_SIZE];
+    vfs_blockcache_t *cache = cache_new(16, 7);
+
+    CHECK(cache->window == 8);
+    fill(buf, 200, 16, 2);
+    CHECK(dev_write(NULL, buf, 200, 16) == 0);
+    stats_reset();
+
+    // reads that go on read ahead 1, 2, 4 then 7 blocks as they miss
+    for (uint32_t b = 200; b < 216; b++) {
+        CHECK(vfs_blockcache_read(cache, buf, b, 1) == 0 && same(buf, b, 1, 2));
+    }
+    CHECK(stats.reads == 5 && stats.read_blocks == 1 + 2 + 3 + 5 + 8);
+    CHECK(cache->read_ahead == 1 + 2 + 4 + 7 && cache->hits == 16 - 5);
+
+    // not at random
+    CHECK(vfs_blockcache_read(cache, buf, 300, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 250, 1) == 0);
+    CHECK(stats.reads == 7 && stats.read_blocks == 19 + 2);
+
+    // nor past the end of the device
+    CHECK(vfs_blockcache_read(cache, buf, SECTOR_COUNT - 4, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, SECTOR_COUNT - 3, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, SECTOR_COUNT - 2, 1) == 0);
+    CHECK(stats.reads == 9 && stats.read_blocks == 21 + 1 + 2);
+    CHECK(vfs_blockcache_read(cache, buf, SECTOR_COUNT - 1, 1) == 0);
+    CHECK(stats.reads == 10 && stats.read_blocks == 24 + 1);
+
+    // large reads don't go through the cache
+    uint32_t hits = cache->hits;
+    CHECK(vfs_blockcache_read(cache, buf, 400, 8) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 400, 8) == 0);
+    CHECK(stats.reads == 12 && cache->hits == hits);
+    cache_free(cache);
+
+    // a device that can't read ahead as far as it's asked to
+    cache = cache_new(16, 7);
+    cache->block_count = 0;
+    fail_from = 505;
+    stats_reset();
+    CHECK(vfs_blockcache_read(cache, buf, 500, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 501, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 502, 1) == 0);
+    CHECK(vfs_blockcache_read(cache, buf, 503, 1) == 0);
+    CHECK(stats.reads == 3 && stats.read_blocks == 4 && cache->read_ahead == 1);
+    CHECK(vfs_blockcache_read(cache, buf, 504, 2) == EIO);
+    fail_from = UINT32_MAX;
+    cache_free(cache);
+}
+
+static void test_write_back(void) {
+    static uint8_t buf[16 * SECTOR_SIZE], back[16 * SECTOR_SIZE];
+    vfs_blockcache_t *cache = cache_new(8, 3);
+
+    stats_reset();
+    fill(buf, 5, 1, 3);
+    CHECK(vfs_blockcache_write(cache, buf, 5, 1) == 0);
+    CHECK(stats.writes == 0);
+    CHECK(vfs_blockcache_read(cache, back, 5, 1) == 0 && same(back, 5, 1, 3));
+    CHECK(stats.reads == 0);
+    CHECK(vfs_blockcache_sync(cache) == 0);
+    CHECK(stats.writes == 1);
+    CHECK(vfs_blockcache_sync(cache) == 0);
+    CHECK(stats.writes == 1);
+
+    // written out in order, and in runs
+    stats_reset();
+    const uint32_t order[] = { 9, 7, 8, 6, 20, 12 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        fill(buf, order[i], 1, 4);
+        CHECK(vfs_blockcache_write(cache, buf, order[i], 1) == 0);
+    }
+    CHECK(vfs_blockcache_sync(cache) == 0);
+    CHECK(stats.writes == 3 && stats.written_blocks == 6 && cache->written_back == 1 + 6);
+    CHECK(dev_read(NULL, back, 6, 4) == 0 && same(back, 6, 4, 4));
+
+    // full of changes, one more writes them out first
+    stats_reset();
+    for (uint32_t b = 30; b < 38; b++) {
+        fill(buf, b, 1, 5);
+        CHECK(vfs_blockcache_write(cache, buf, b, 1) == 0);
+    }
+    CHECK(stats.writes == 0);
+    fill(buf, 50, 1, 5);
+    CHECK(vfs_blockcache_write(cache, buf, 50, 1) == 0);
+    CHECK(stats.writes == 2 && stats.written_blocks == 8);
+    CHECK(dev_read(NULL, back, 30, 8) == 0 && same(back, 30, 8, 5));
+
+    // a read that needs the entries of changed blocks
+    CHECK(vfs_blockcache_sync(cache) == 0);
+    fill(buf, 70, 4, 6);
+    CHECK(dev_write(NULL, buf, 70, 4) == 0);
+    stats_reset();
+    for (uint32_t b = 60; b < 68; b++) {
+        fill(buf, b, 1, 6);
+        CHECK(vfs_blockcache_write(cache, buf, b, 1) == 0);
+    }
+    CHECK(stats.writes == 0);
+    CHECK(vfs_blockcache_read(cache, back, 69, 1) == 0);
+    CHECK(stats.writes == 2);
+    CHECK(vfs_blockcache_read(cache, back, 70, 1) == 0 && same(back, 70, 1, 6));
+    CHECK(vfs_blockcache_read(cache, back, 71, 3) == 0 && same(back, 71, 3, 6));
+    CHECK(dev_read(NULL, back, 60, 8) == 0 && same(back, 60, 8, 6));
+
+    // large writes go straight to the device, and blocks in the cache are kept up to date
+    stats_reset();
+    fill(buf, 71, 10, 7);
+    CHECK(vfs_blockcache_write(cache, buf, 71, 10) == 0);
+    CHECK(vfs_blockcache_read(cache, back, 71, 10) == 0 && same(back, 71, 10, 7));
+    CHECK(vfs_blockcache_sync(cache) == 0);
+    CHECK(dev_read(NULL, back, 71, 10) == 0 && same(back, 71, 10, 7));
+
+    // written around the cache
+    fill(buf, 71, 1, 8);
+    CHECK(dev_write(NULL, buf, 71, 1) == 0);
+    vfs_blockcache_invalidate(cache, 71, 1);
+    CHECK(vfs_blockcache_read(cache, back, 71, 1) == 0 && same(back, 71, 1, 8));
+    cache_free(cache);
+}
+
+// FatFS over the cache: what's on the device after a sync is the same as without it
+static void test_fat(void) {
+    static uint8_t data[8192], back[8192];
+    char path[32];
+    mount_t m;
+
+    for (int pass = 0; pass < 2; pass++) {
+        vfs_blockcache_t *cache = cache_new(pass ? 4 : 32, pass ? 1 : 8);
+
+        mkfs(cache);
+        mount(&m, cache);
+        CHECK(f_mkdir(&m.fatfs, "/dir") == FR_OK);
+        for (int i = 0; i < 40; i++) {
+            snprintf(path, sizeof(path), "/dir/file number %02d.txt", i);
+            CHECK(write_file(&m.fatfs, path, data, file_data(i, data), 300 + i) == FR_OK);
+        }
+        for (int i = 0; i < 40; i += 3) {
+            snprintf(path, sizeof(path), "/dir/file number %02d.txt", i);
+            CHECK(f_unlink(&m.fatfs, path) == FR_OK);
+        }
+        CHECK(write_file(&m.fatfs, "/big", data, sizeof(data), sizeof(data)) == FR_OK);
+
+        // seen through the cache
+        for (int i = 1; i < 40; i++) {
+            UINT len = file_data(i, data);
+            snprintf(path, sizeof(path), "/dir/file number %02d.txt", i);
+            CHECK(read_file(&m.fatfs, path, back, sizeof(back), 77) == ((i % 3) ? len : 0));
+            CHECK((i % 3) == 0 || memcmp(back, data, len) == 0);
+        }
+
+        // and without it
+        mount(&m, NULL);
+        for (int i = 1; i < 40; i++) {
+            UINT len = file_data(i, data);
+            snprintf(path, sizeof(path), "/dir/file number %02d.txt", i);
+            CHECK(read_file(&m.fatfs, path, back, sizeof(back), 512) == ((i % 3) ? len : 0));
+            CHECK((i % 3) == 0 || memcmp(back, data, len) == 0);
+        }
+        CHECK(read_file(&m.fatfs, "/big", back, sizeof(back), 1000) == sizeof(back));
+        CHECK(cache->hits > 0);
+        cache_free(cache);
+    }
+}
+
+static void run_tests(void) {
+    test_hits_lru();
+    test_readahead();
+    test_write_back();
+    test_fat();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench_report(const char *phase, vfs_blockcache_t *cache, uint64_t t0) {
+    uint32_t lookups = cache ? cache->hits + cache->misses : 0;
+
+    printf("  %-16s %6u reads %7.1f KB  %5u writes %7.1f KB  hits %5.1f%%  device %8.1f ms  host %6.2f ms\n",
+           phase, stats.reads, stats.read_blocks * SECTOR_SIZE / 1024.0, stats.writes,
+           stats.written_blocks * SECTOR_SIZE / 1024.0, lookups ? 100.0 * cache->hits / lookups : 0.0,
+           stats_device_us() / 1000.0, (now_ns() - t0) / 1e6);
+}
+
+static void bench_phase_start(vfs_blockcache_t *cache, uint64_t *t0) {
+    stats_reset();
+    if (cache != NULL) {
+        cache->hits = cache->misses = 0;
+    }
+    *t0 = now_ns();
+}
+
+static void bench(int n) {
+    static uint8_t data[8192], back[8192], big[512 * 1024];
+    struct {
+        const char *name;
+        uint32_t entries;
+        uint32_t readahead;
+    } configs[] = {
+        { "no cache", 0, 0 },
+        { "16 blocks", 16, 0 },
+        { "16 blocks, read-ahead 8", 16, 8 },
+        { "32 blocks, read-ahead 16", 32, 16 },
+    };
+    char path[32];
+    uint64_t t0;
+    mount_t m;
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        vfs_blockcache_t *cache = configs[c].entries ? cache_new(configs[c].entries, configs[c].readahead) : NULL;
+
+        printf("%s\n", configs[c].name);
+        mkfs(cache);
+        mount(&m, cache);
+        f_mkdir(&m.fatfs, "/data");
+
+        bench_phase_start(cache, &t0);
+        for (int i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/data/sample_%04d.csv", i);
+            CHECK(write_file(&m.fatfs, path, data, file_data(i, data), 256) == FR_OK);
+        }
+        bench_report("create", cache, t0);
+
+        bench_phase_start(cache, &t0);
+        for (int k = 0; k < 5; k++) {
+            FF_DIR dir;
+            FILINFO fno;
+            int count = 0;
+            CHECK(f_opendir(&m.fatfs, &dir, "/data") == FR_OK);
+            while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0) {
+                count++;
+            }
+            f_closedir(&dir);
+            CHECK(count == n);
+        }
+        bench_report("list x5", cache, t0);
+
+        bench_phase_start(cache, &t0);
+        for (int i = 0; i < n; i++) {
+            FILINFO fno;
+            snprintf(path, sizeof(path), "/data/sample_%04d.csv", i);
+            CHECK(f_stat(&m.fatfs, path, &fno) == FR_OK && fno.fsize == file_data(i, data));
+        }
+        bench_report("stat", cache, t0);
+
+        bench_phase_start(cache, &t0);
+        for (int i = 0; i < n; i++) {
+            UINT len = file_data(i, data);
+            snprintf(path, sizeof(path), "/data/sample_%04d.csv", i);
+            CHECK(read_file(&m.fatfs, path, back, sizeof(back), 100) == len && memcmp(back, data, len) == 0);
+        }
+        bench_report("read, 100 B", cache, t0);
+
+        for (size_t k = 0; k < sizeof(big); k++) {
+            big[k] = (uint8_t)(k * 13 + k / 512);
+        }
+        CHECK(write_file(&m.fatfs, "/big.bin", big, sizeof(big), sizeof(big)) == FR_OK);
+        bench_phase_start(cache, &t0);
+        CHECK(read_file(&m.fatfs, "/big.bin", big, sizeof(big), 512) == sizeof(big));
+        bench_report("read big, 512 B", cache, t0);
+
+        bench_phase_start(cache, &t0);
+        {
+            FIL fp;
+            UINT got;
+            f_open(&m.fatfs, &fp, "/big.bin", FA_READ);
+            for (int k = 0; k < 200; k++) {
+                f_lseek(&fp, (rand() % (sizeof(big) / 64)) * 64);
+                f_read(&fp, back, 64, &got);
+            }
+            f_close(&fp);
+        }
+        bench_report("random 64 B x200", cache, t0);
+        cache_free(cache);
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b files] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+    image_open();
+
+    if (count > 0) {
+        bench(count);
+    } else {
+        run_tests();
+    }
+    close(image);
+    if (failures) {
+        printf("test_blockcache: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_blockcache: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the SD card transfers, see
+ * esp32/fatfs/src/drivers/sd_xfer.h. The card is a model of one on the
+ * SDMMC host in 1-bit mode at 20 MHz: it keeps the sectors in memory, takes
+ * single and multiple block commands and counts them and their time. Under
+ * it sits what sdmmc_read_sectors() and sdmmc_write_sectors() do with a
+ * buffer the DMA can't reach, one sector at a time through their own.
+ *
+ *   test_sdxfer                    run the unit tests
+ *   test_sdxfer -b N [-s seed]     write a recording of N KB in 4 KB pieces,
+ *                                  then read it back, from a buffer in the
+ *                                  internal RAM and from one in the PSRAM,
+ *                                  with bounce buffers of a few sizes
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sd_xfer.h"
+
+#define SECTOR_SIZE             512
+#define SECTOR_COUNT            (8 * 1024 * 1024 / SECTOR_SIZE)
+
+// SDMMC, 1-bit at 20 MHz, typical, in us
+#define T_CMD_US                60      // command, response and the driver around them
+#define T_ACCESS_US             250     // until the first block read comes
+#define T_BLOCK_US              206     // 512 bytes and the CRC
+#define T_PROG_US               250     // programming, per block written
+#define T_BUSY_US               1000    // and at the end of each write command
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+// the internal RAM, what's outside is taken to be the PSRAM
+static uint8_t dram[64 * 1024] __attribute__((aligned(4)));
+static uint32_t dram_used;
+
+static uint8_t *card;
+static uint32_t fail_from = UINT32_MAX;     // commands from this sector fail
+
+static struct {
+    uint32_t cmd17, cmd18, cmd24, cmd25;
+    uint64_t blocks;
+    uint64_t time_us;
+    uint32_t dma_faults;
+} stats;
+
+static void stats_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void *dram_alloc(uint32_t size) {
+    void *p = &dram[dram_used];
+    dram_used += (size + 3) & ~3;
+    if (dram_used > sizeof(dram)) {
+        fprintf(stderr, "out of internal RAM\n");
+        exit(2);
+    }
+    return p;
+}
+
+static bool dma_capable(const void *buf) {
+    const uint8_t *p = buf;
+    return p >= dram && p < dram + sizeof(dram) && ((uintptr_t)p & 3) == 0;
+}
+
+// a command and its data, as the card sees it
+static int card_read(uint8_t *buf, uint32_t sector, uint32_t count) {
+    if (!dma_capable(buf)) {
+        stats.dma_faults++;
+        return EIO;
+    }
+    if (count == 0 || sector + count > SECTOR_COUNT || sector + count > fail_from) {
+        return EIO;
+    }
+    memcpy(buf, card + (size_t)sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+    if (count == 1) {
+        stats.cmd17++;
+        stats.time_us += T_CMD_US + T_ACCESS_US + T_BLOCK_US;
+    } else {
+        // and CMD12 to stop
+        stats.cmd18++;
+        stats.time_us += T_CMD_US + T_ACCESS_US + count * T_BLOCK_US + T_CMD_US;
+    }
+    stats.blocks += count;
+    return 0;
+}
+
+static int card_write(const uint8_t *buf, uint32_t sector, uint32_t count) {
+    if (!dma_capable(buf)) {
+        stats.dma_faults++;
+        return EIO;
+    }
+    if (count == 0 || sector + count > SECTOR_COUNT || sector + count > fail_from) {
+        return EIO;
+    }
+    memcpy(card + (size_t)sector * SECTOR_SIZE, buf, (size_t)count * SECTOR_SIZE);
+    // and CMD13 until it's done
+    if (count == 1) {
+        stats.cmd24++;
+        stats.time_us += T_CMD_US + T_BLOCK_US + T_PROG_US + T_BUSY_US + T_CMD_US;
+    } else {
+        stats.cmd25++;
+        stats.time_us += T_CMD_US + count * (T_BLOCK_US + T_PROG_US) + T_CMD_US + T_BUSY_US + T_CMD_US;
+    }
+    stats.blocks += count;
+    return 0;
+}
+
+// sdmmc_read_sectors() and sdmmc_write_sectors()
+static int driver_read(void *ctx, void *buf, uint32_t sector, uint32_t count) {
+    static uint8_t *tmp;
+
+    if (dma_capable(buf)) {
+        return card_read(buf, sector, count);
+    }
+    if (tmp == NULL) {
+        tmp = dram_alloc(SECTOR_SIZE);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        int err = card_read(tmp, sector + i, 1);
+        if (err != 0) {
+            return err;
+        }
+        memcpy((uint8_t *)buf + i * SECTOR_SIZE, tmp, SECTOR_SIZE);
+    }
+    return 0;
+}
+
+static int driver_write(void *ctx, const void *buf, uint32_t sector, uint32_t count) {
+    static uint8_t *tmp;
+
+    if (dma_capable(buf)) {
+        return card_write(buf, sector, count);
+    }
+    if (tmp == NULL) {
+        tmp = dram_alloc(SECTOR_SIZE);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(tmp, (const uint8_t *)buf + i * SECTOR_SIZE, SECTOR_SIZE);
+        int err = card_write(tmp, sector + i, 1);
+        if (err != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+static uint8_t *bounce_buffers[64];
+
+static sd_xfer_t xfer_new(uint32_t bounce_sectors) {
+    sd_xfer_t xfer = {
+        .read = driver_read,
+        .write = driver_write,
+        .dma_capable = dma_capable,
+        .ctx = NULL,
+        .bounce = NULL,
+        .bounce_sectors = bounce_sectors,
+        .sector_size = SECTOR_SIZE,
+    };
+    if (bounce_sectors > 0) {
+        // the same ones each time, the internal RAM here doesn't give back
+        if (bounce_buffers[bounce_sectors] == NULL) {
+            bounce_buffers[bounce_sectors] = dram_alloc(bounce_sectors * SECTOR_SIZE);
+        }
+        xfer.bounce = bounce_buffers[bounce_sectors];
+    }
+    return xfer;
+}
+
+static void fill(uint8_t *buf, uint32_t sector, uint32_t count, uint8_t salt) {
+    for (uint32_t i = 0; i < count * SECTOR_SIZE; i++) {
+        buf[i] = (uint8_t)((sector + i / SECTOR_SIZE) * 11 + i + salt);
+    }
+}
+
+static bool same(const uint8_t *buf, uint32_t sector, uint32_t count, uint8_t salt) {
+    for (uint32_t i = 0; i < count * SECTOR_SIZE; i++) {
+        if (buf[i] != (uint8_t)((sector + i / SECTOR_SIZE) * 11 + i + salt)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_direct(void) {
+    sd_xfer_t xfer = xfer_new(SD_XFER_BOUNCE_SECTORS);
+    uint8_t *buf = dram_alloc(16 * SECTOR_SIZE);
+
+    // a buffer the DMA reaches goes in one command, however long
+    fill(buf, 100, 16, 1);
+    stats_reset();
+    CHECK(sd_xfer_write(&xfer, buf, 100, 16) == 0);
+    CHECK(stats.cmd25 == 1 && stats.cmd24 == 0 && stats.blocks == 16);
+    memset(buf, 0, 16 * SECTOR_SIZE);
+    CHECK(sd_xfer_read(&xfer, buf, 100, 16) == 0 && same(buf, 100, 16, 1));
+    CHECK(stats.cmd18 == 1 && stats.cmd17 == 0 && stats.blocks == 32);
+
+    CHECK(sd_xfer_read(&xfer, buf, 105, 1) == 0 && same(buf, 105, 1, 1));
+    CHECK(stats.cmd17 == 1);
+    CHECK(stats.dma_faults == 0);
+}
+
+static void test_bounce(void) {
+    sd_xfer_t xfer = xfer_new(8);
+    uint8_t *psram = malloc(20 * SECTOR_SIZE);
+
+    // 8, 8 and 4
+    fill(psram, 200, 20, 2);
+    stats_reset();
+    CHECK(sd_xfer_write(&xfer, psram, 200, 20) == 0);
+    CHECK(stats.cmd25 == 3 && stats.cmd24 == 0 && stats.blocks == 20);
+    memset(psram, 0, 20 * SECTOR_SIZE);
+    CHECK(sd_xfer_read(&xfer, psram, 200, 20) == 0 && same(psram, 200, 20, 2));
+    CHECK(stats.cmd18 == 3 && stats.cmd17 == 0 && stats.blocks == 40);
+
+    // the last one a single block
+    stats_reset();
+    CHECK(sd_xfer_read(&xfer, psram, 200, 9) == 0 && same(psram, 200, 9, 2));
+    CHECK(stats.cmd18 == 1 && stats.cmd17 == 1);
+
+    // in the internal RAM, but not aligned for the DMA
+    uint8_t *odd = (uint8_t *)dram_alloc(8 * SECTOR_SIZE + 4) + 1;
+    stats_reset();
+    CHECK(sd_xfer_read(&xfer, odd, 200, 8) == 0 && same(odd, 200, 8, 2));
+    CHECK(stats.cmd18 == 1);
+    CHECK(stats.dma_faults == 0);
+
+    // left to the driver, a sector at a time
+    xfer = xfer_new(0);
+    stats_reset();
+    CHECK(sd_xfer_read(&xfer, psram, 200, 20) == 0 && same(psram, 200, 20, 2));
+    CHECK(stats.cmd17 == 20 && stats.cmd18 == 0);
+    free(psram);
+}
+
+static void test_errors(void) {
+    sd_xfer_t xfer = xfer_new(8);
+    uint8_t *psram = malloc(20 * SECTOR_SIZE);
+
+    // stops at the command that fails
+    fill(psram, 300, 20, 3);
+    fail_from = 310;
+    stats_reset();
+    CHECK(sd_xfer_write(&xfer, psram, 300, 20) == EIO);
+    CHECK(stats.cmd25 == 1 && stats.blocks == 8);
+    CHECK(sd_xfer_read(&xfer, psram, 300, 20) == EIO);
+    CHECK(stats.cmd18 == 1 && stats.blocks == 16);
+    fail_from = UINT32_MAX;
+
+    CHECK(sd_xfer_read(&xfer, psram, SECTOR_COUNT - 4, 8) == EIO);
+    CHECK(sd_xfer_read(&xfer, psram, SECTOR_COUNT - 4, 4) == 0);
+    free(psram);
+}
+
+static void run_tests(void) {
+    test_direct();
+    test_bounce();
+    test_errors();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+#define BENCH_CHUNK             (4 * 1024)
+
+static void bench_report(const char *phase, uint32_t kb, uint64_t t0) {
+    printf("  %-6s %4u CMD17 %5u CMD18 %4u CMD24 %5u CMD25  device %8.1f ms %6.0f KB/s  host %6.2f ms\n",
+           phase, stats.cmd17, stats.cmd18, stats.cmd24, stats.cmd25, stats.time_us / 1000.0,
+           kb * 1000000.0 / (stats.time_us ? stats.time_us : 1), (now_ns() - t0) / 1e6);
+}
+
+static void bench(uint32_t kb) {
+    struct {
+        const char *name;
+        bool internal;
+        uint32_t bounce_sectors;
+    } configs[] = {
+        { "internal RAM", true, 0 },
+        { "PSRAM, no bounce buffer", false, 0 },
+        { "PSRAM, bounce 4 sectors", false, 4 },
+        { "PSRAM, bounce 8 sectors", false, 8 },
+        { "PSRAM, bounce 16 sectors", false, 16 },
+    };
+    uint32_t sectors = BENCH_CHUNK / SECTOR_SIZE;
+    uint32_t chunks = (kb * 1024) / BENCH_CHUNK;
+    uint8_t *psram = malloc(BENCH_CHUNK);
+    uint8_t *internal = dram_alloc(BENCH_CHUNK);
+    uint32_t start = rand() % 1024;
+    uint64_t t0;
+
+    if (chunks * sectors + start > SECTOR_COUNT) {
+        chunks = (SECTOR_COUNT - start) / sectors;
+        kb = chunks * BENCH_CHUNK / 1024;
+    }
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        sd_xfer_t xfer = xfer_new(configs[c].bounce_sectors);
+        uint8_t *buf = configs[c].internal ? internal : psram;
+
+        printf("%s\n", configs[c].name);
+        stats_reset();
+        t0 = now_ns();
+        for (uint32_t i = 0; i < chunks; i++) {
+            fill(buf, start + i * sectors, sectors, 4);
+            CHECK(sd_xfer_write(&xfer, buf, start + i * sectors, sectors) == 0);
+        }
+        bench_report("write", kb, t0);
+
+        stats_reset();
+        t0 = now_ns();
+        for (uint32_t i = 0; i < chunks; i++) {
+            CHECK(sd_xfer_read(&xfer, buf, start + i * sectors, sectors) == 0);
+            CHECK(same(buf, start + i * sectors, sectors, 4));
+        }
+        bench_report("read", kb, t0);
+        CHECK(stats.dma_faults == 0);
+    }
+    free(psram);
+}
+
+int main(int argc, char **argv) {
+    int kb = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                kb = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b KB] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+    card = calloc(SECTOR_COUNT, SECTOR_SIZE);
+
+    if (kb > 0) {
+        bench(kb);
+    } else {
+        run_tests();
+    }
+    free(card);
+    if (failures) {
+        printf("test_sdxfer: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_sdxfer: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Host implementation of the FTP server file system port (ftpfs.h). The
+ * volumes "/flash" and "/sd" are sub directories of a local directory,
+ * set with host_ftpfs_set_root().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "ftpfs.h"
+#include "host_ftpfs.h"
+
+struct ftpfs_handle_s {
+    int             fd;
+    DIR             *dir;
+    char            path[PATH_MAX];
+};
+
+static char host_root[PATH_MAX] = ".";
+static const char *host_volumes[] = { "flash", "sd" };
+
+void host_ftpfs_set_root (const char *root) {
+    snprintf(host_root, sizeof(host_root), "%s", root);
+}
+
+static bool host_path (char *dest, const char *path) {
+    int len = snprintf(dest, PATH_MAX, "%s%s", host_root, path);
+    return (len > 0 && len < PATH_MAX);
+}
+
+static void host_info_from_stat (ftpfs_info_t *info, const char *name, const struct stat *st) {
+    struct tm tm;
+
+    localtime_r(&st->st_mtime, &tm);
+    snprintf(info->name, sizeof(info->name), "%s", name);
+    info->size = st->st_size;
+    info->fdate = ((tm.tm_year + 1900 - 1980) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+    info->ftime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+    info->isdir = S_ISDIR(st->st_mode);
+}
+
+ftpfs_handle_t *ftpfs_open (const char *path, bool write) {
+    ftpfs_handle_t *fh = malloc(sizeof(ftpfs_handle_t));
+    struct stat st;
+
+    if (fh == NULL || !host_path(fh->path, path)) {
+        free(fh);
+        return NULL;
+    }
+    fh->dir = NULL;
+    fh->fd = open(fh->path, write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (fh->fd < 0 || fstat(fh->fd, &st) || S_ISDIR(st.st_mode)) {
+        if (fh->fd >= 0) {
+            close(fh->fd);
+        }
+        free(fh);
+        return NULL;
+    }
+    return fh;
+}
+
+bool ftpfs_read (ftpfs_handle_t *fh, void *buf, uint32_t size, uint32_t *actual) {
+    *actual = 0;
+    while (*actual < size) {
+        ssize_t n = read(fh->fd, (uint8_t *)buf + *actual, size - *actual);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        } else if (n == 0) {
+            break;
+        }
+        *actual += n;
+    }
+    return true;
+}
+
+bool ftpfs_write (ftpfs_handle_t *fh, const void *buf, uint32_t size) {
+    uint32_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fh->fd, (const uint8_t *)buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+bool ftpfs_close (ftpfs_handle_t *fh) {
+    bool ok = (close(fh->fd) == 0);
+    free(fh);
+    return ok;
+}
+
+ftpfs_handle_t *ftpfs_opendir (const char *path) {
+    ftpfs_handle_t *dh = malloc(sizeof(ftpfs_handle_t));
+
+    if (dh == NULL || !host_path(dh->path, path) || (dh->dir = opendir(dh->path)) == NULL) {
+        free(dh);
+        return NULL;
+    }
+    dh->fd = -1;
+    return dh;
+}
+
+bool ftpfs_readdir (ftpfs_handle_t *dh, ftpfs_info_t *info) {
+    struct dirent *de;
+    char entry[PATH_MAX];
+    struct stat st;
+
+    while ((de = readdir(dh->dir)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        if (snprintf(entry, sizeof(entry), "%s/%s", dh->path, de->d_name) >= (int)sizeof(entry) || stat(entry, &st)) {
+            continue;
+        }
+        host_info_from_stat(info, de->d_name, &st);
+        return true;
+    }
+    return false;
+}
+
+void ftpfs_closedir (ftpfs_handle_t *dh) {
+    closedir(dh->dir);
+    free(dh);
+}
+
+bool ftpfs_stat (const char *path, ftpfs_info_t *info) {
+    char hpath[PATH_MAX];
+    struct stat st;
+    const char *name = strrchr(path, '/');
+
+    if (!host_path(hpath, path) || stat(hpath, &st)) {
+        return false;
+    }
+    host_info_from_stat(info, name ? name + 1 : path, &st);
+    return true;
+}
+
+bool ftpfs_mkdir (const char *path) {
+    char hpath[PATH_MAX];
+    return (host_path(hpath, path) && mkdir(hpath, 0755) == 0);
+}
+
+bool ftpfs_unlink (const char *path) {
+    char hpath[PATH_MAX];
+    return (host_path(hpath, path) && remove(hpath) == 0);
+}
+
+bool ftpfs_rename (const char *path_old, const char *path_new) {
+    char hpath_old[PATH_MAX];
+    char hpath_new[PATH_MAX];
+    return (host_path(hpath_old, path_old) && host_path(hpath_new, path_new) && rename(hpath_old, hpath_new) == 0);
+}
+
+const char *ftpfs_volume (uint32_t index) {
+    if (index < sizeof(host_volumes) / sizeof(host_volumes[0])) {
+        return host_volumes[index];
+    }
+    return NULL;
+}
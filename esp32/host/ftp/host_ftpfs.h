@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef HOST_FTPFS_H_
+#define HOST_FTPFS_H_
+
+// the local directory holding the "flash" and "sd" volumes
+extern void host_ftpfs_set_root (const char *root);
+
+#endif /* HOST_FTPFS_H_ */
@@ -0,0 +1,866 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the FTP server. The server runs in a thread
+ * that sleeps in select() and steps it like the servers task does, on top of
+ * the Linux sockets and a scratch directory holding the "/flash" and "/sd"
+ * volumes. The tests drive it over loopback with a small FTP client.
+ *
+ *   test_ftp                       run the unit tests
+ *   test_ftp -b N [-s seed]        upload and download N MB, from one session
+ *                                  and from all sessions at once, and report
+ *                                  the throughput. The server this replaced
+ *                                  moved one 512 byte block per cycle, at most
+ *                                  128 KB/s. Then the command round trip and
+ *                                  the idle wake ups and CPU time, for the
+ *                                  select loop and for the former loop that
+ *                                  stepped the server every FTP cycle
+ *   test_ftp -d dir [-p]           serve dir on port FTP_CMD_PORT until killed,
+ *                                  to try other FTP clients against it, -p
+ *                                  steps the server every cycle instead
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "py/obj.h"
+#include "ftp.h"
+#include "updater.h"
+#include "serverstask.h"
+#include "serverscore.h"
+#include "host_ftpfs.h"
+
+#ifndef FTP_CMD_CLIENTS_MAX
+#define FTP_CMD_CLIENTS_MAX     2
+#endif
+#ifndef FTP_BUFFER_SIZE
+#define FTP_BUFFER_SIZE         4096
+#endif
+#define FTP_CYCLE_US            (SERVERS_CYCLE_TIME_MS * 2 * 1000)
+#define UPDATER_IMG_PATH        "/flash/sys/appimg.bin"
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+char servers_user[SERVERS_USER_PASS_LEN_MAX + 1] = SERVERS_DEF_USER;
+char servers_pass[SERVERS_USER_PASS_LEN_MAX + 1] = SERVERS_DEF_PASS;
+
+void servers_close_socket(int32_t *sd) {
+    if (*sd > 0) {
+        close(*sd);
+        *sd = -1;
+    }
+}
+
+uint32_t servers_get_timeout(void) {
+    return SERVERS_DEF_TIMEOUT_MS;
+}
+
+void stoupper(char *str) {
+    while (str && *str != '\0') {
+        *str = (char)toupper((int)(*str));
+        str++;
+    }
+}
+
+uint64_t mach_rtc_get_us_since_epoch(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+uint32_t mp_hal_ticks_ms(void) {
+    return now_ns() / 1000000ULL;
+}
+
+/* the OTA image is collected in memory */
+static uint8_t *upd_data;
+static size_t upd_len;
+static int upd_started;
+static int upd_finished;
+
+bool updater_check_path(void *path) {
+    return !strcmp(UPDATER_IMG_PATH, path);
+}
+
+bool updater_start(void) {
+    upd_len = 0;
+    upd_started++;
+    return true;
+}
+
+bool updater_write(uint8_t *buf, uint32_t len) {
+    uint8_t *data = realloc(upd_data, upd_len + len);
+
+    if (data == NULL) {
+        return false;
+    }
+    memcpy(data + upd_len, buf, len);
+    upd_data = data;
+    upd_len += len;
+    return true;
+}
+
+bool updater_finish(void) {
+    upd_finished++;
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- SERVER AND CLIENT ---------------------------------------------------- */
+
+static volatile bool server_stop;
+static volatile bool server_polling;
+static volatile uint32_t server_wakeups;
+static pthread_t server_tid;
+static char root[64];
+
+static void *server_thread(void *arg) {
+    servers_wait_t wait;
+
+    (void)arg;
+    ftp_init();
+    ftp_enable();
+    while (!server_stop) {
+        if (server_polling) {
+            ftp_run();
+            usleep(FTP_CYCLE_US);
+        } else {
+            servers_wait_init(&wait, SERVERS_IDLE_TIME_MS);
+            ftp_prepare_wait(&wait);
+            servers_wait(&wait);
+            ftp_run();
+        }
+        server_wakeups++;
+    }
+    ftp_disable();
+    return NULL;
+}
+
+static void server_start(void) {
+    server_stop = false;
+    pthread_create(&server_tid, NULL, server_thread, NULL);
+    // listening takes a couple of cycles
+    usleep(20 * FTP_CYCLE_US);
+}
+
+static void server_halt(void) {
+    server_stop = true;
+    pthread_join(server_tid, NULL);
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void root_create(void) {
+    char path[128];
+
+    strcpy(root, "/tmp/test_ftp.XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    host_ftpfs_set_root(root);
+    snprintf(path, sizeof(path), "%s/flash", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/flash/sys", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sd", root);
+    mkdir(path, 0755);
+}
+
+static void root_remove(void) {
+    nftw(root, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+typedef struct {
+    int         sd;
+    int         rlen;
+    char        rbuf[1024];
+    char        line[512];      // the last reply
+} client_t;
+
+static int tcp_connect(uint16_t port) {
+    struct sockaddr_in addr;
+    struct timeval tv = { 5, 0 };
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sd < 0) {
+        return -1;
+    }
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+static bool send_all(int sd, const void *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data = (const uint8_t *)data + n;
+        len -= n;
+    }
+    return true;
+}
+
+/* returns the code of the next reply line, or -1 */
+static int client_reply(client_t *c) {
+    while (true) {
+        char *eol = memchr(c->rbuf, '\n', c->rlen);
+        if (eol) {
+            int n = eol - c->rbuf + 1;
+            int len = MIN(n, (int)sizeof(c->line) - 1);
+            memcpy(c->line, c->rbuf, len);
+            while (len > 0 && (c->line[len - 1] == '\n' || c->line[len - 1] == '\r')) {
+                len--;
+            }
+            c->line[len] = '\0';
+            memmove(c->rbuf, c->rbuf + n, c->rlen - n);
+            c->rlen -= n;
+            return atoi(c->line);
+        }
+        if (c->rlen == (int)sizeof(c->rbuf)) {
+            return -1;
+        }
+        ssize_t n = recv(c->sd, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        c->rlen += n;
+    }
+}
+
+static int client_cmd(client_t *c, const char *fmt, ...) {
+    char buf[600];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf) - 2, fmt, ap);
+    va_end(ap);
+    strcpy(buf + len, "\r\n");
+    if (!send_all(c->sd, buf, len + 2)) {
+        return -1;
+    }
+    return client_reply(c);
+}
+
+static int client_open(client_t *c) {
+    c->rlen = 0;
+    c->sd = tcp_connect(FTP_CMD_PORT);
+    if (c->sd < 0) {
+        return -1;
+    }
+    return client_reply(c);
+}
+
+static bool client_login(client_t *c) {
+    return client_open(c) == 220 &&
+           client_cmd(c, "USER %s", SERVERS_DEF_USER) == 331 &&
+           client_cmd(c, "PASS %s", SERVERS_DEF_PASS) == 230;
+}
+
+static void client_close(client_t *c) {
+    if (c->sd >= 0) {
+        close(c->sd);
+        c->sd = -1;
+    }
+}
+
+/* enters passive mode and returns the connected data socket */
+static int client_pasv(client_t *c) {
+    unsigned h[6];
+    char *p;
+
+    if (client_cmd(c, "PASV") != 227 || (p = strchr(c->line, '(')) == NULL ||
+        sscanf(p, "(%u,%u,%u,%u,%u,%u)", &h[0], &h[1], &h[2], &h[3], &h[4], &h[5]) != 6) {
+        return -1;
+    }
+    // the address the client connected to
+    if (h[0] != 127 || h[1] != 0 || h[2] != 0 || h[3] != 1) {
+        return -1;
+    }
+    return tcp_connect((h[4] << 8) | h[5]);
+}
+
+/* RETR or LIST, the data is returned in a malloc'ed buffer */
+static bool client_retr(client_t *c, const char *cmd, uint8_t **data, size_t *len) {
+    size_t cap = 65536;
+    int dsd = client_pasv(c);
+
+    *data = NULL;
+    *len = 0;
+    if (dsd < 0) {
+        return false;
+    }
+    if (client_cmd(c, "%s", cmd) != 150) {
+        close(dsd);
+        return false;
+    }
+    *data = malloc(cap);
+    while (true) {
+        if (*len == cap) {
+            cap *= 2;
+            *data = realloc(*data, cap);
+        }
+        ssize_t n = recv(dsd, *data + *len, cap - *len, 0);
+        if (n <= 0) {
+            break;
+        }
+        *len += n;
+    }
+    close(dsd);
+    return client_reply(c) == 226;
+}
+
+static bool client_stor(client_t *c, const char *path, const uint8_t *data, size_t len) {
+    int dsd = client_pasv(c);
+    bool ok;
+
+    if (dsd < 0) {
+        return false;
+    }
+    if (client_cmd(c, "STOR %s", path) != 150) {
+        close(dsd);
+        return false;
+    }
+    ok = send_all(dsd, data, len);
+    close(dsd);
+    return client_reply(c) == 226 && ok;
+}
+
+static uint8_t *random_data(size_t len) {
+    uint8_t *data = malloc(len + 1);
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = rand();
+    }
+    return data;
+}
+
+static bool file_equals(const char *path, const uint8_t *data, size_t len) {
+    char hpath[256];
+    FILE *f;
+    bool same = true;
+    size_t i = 0;
+    int ch;
+
+    snprintf(hpath, sizeof(hpath), "%s%s", root, path);
+    if ((f = fopen(hpath, "rb")) == NULL) {
+        return false;
+    }
+    while ((ch = fgetc(f)) != EOF) {
+        if (i >= len || ch != data[i]) {
+            same = false;
+            break;
+        }
+        i++;
+    }
+    fclose(f);
+    return same && i == len;
+}
+
+static void file_create(const char *path, const uint8_t *data, size_t len) {
+    char hpath[256];
+    FILE *f;
+
+    snprintf(hpath, sizeof(hpath), "%s%s", root, path);
+    f = fopen(hpath, "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- UNIT TESTS ----------------------------------------------------------- */
+
+static void test_login(void) {
+    client_t c;
+
+    CHECK(client_open(&c) == 220);
+    CHECK(client_cmd(&c, "PWD") == 332);
+    CHECK(client_cmd(&c, "USER %s", SERVERS_DEF_USER) == 331);
+    CHECK(client_cmd(&c, "PASS wrong") == 530);
+    CHECK(client_cmd(&c, "LIST") == 332);
+    CHECK(client_cmd(&c, "USER %s", SERVERS_DEF_USER) == 331);
+    CHECK(client_cmd(&c, "PASS %s", SERVERS_DEF_PASS) == 230);
+    CHECK(client_cmd(&c, "SYST") == 215);
+    CHECK(client_cmd(&c, "NOOP") == 200);
+    // commands longer than any known one are refused, not overflowed
+    CHECK(client_cmd(&c, "XXXXXXXXXXXXXXXXXXXXXXXX") == 502);
+    CHECK(client_cmd(&c, "QUIT") == 221);
+    CHECK(client_reply(&c) == -1);
+    client_close(&c);
+}
+
+static void test_navigation(void) {
+    client_t c;
+    uint8_t *list;
+    size_t len;
+
+    CHECK(client_login(&c));
+    CHECK(client_cmd(&c, "PWD") == 257 && !strcmp(c.line, "257 /"));
+
+    // the root lists the volumes
+    CHECK(client_retr(&c, "LIST", &list, &len));
+    CHECK(list && len > 0);
+    if (list) {
+        list[len - 1] = '\0';
+        CHECK(strstr((char *)list, " flash\r\n") && strstr((char *)list, " sd\r") && list[0] == 'd');
+    }
+    free(list);
+
+    CHECK(client_cmd(&c, "CWD /flash") == 250);
+    CHECK(client_cmd(&c, "CWD nothere") == 550);
+    CHECK(client_cmd(&c, "PWD") == 257 && !strcmp(c.line, "257 /flash"));
+    CHECK(client_cmd(&c, "MKD sub") == 250);
+    CHECK(client_cmd(&c, "MKD sub") == 550);
+    CHECK(client_cmd(&c, "CWD sub") == 250);
+    CHECK(client_cmd(&c, "PWD") == 257 && !strcmp(c.line, "257 /flash/sub"));
+    CHECK(client_cmd(&c, "CDUP") == 250);
+    CHECK(client_cmd(&c, "PWD") == 257 && !strcmp(c.line, "257 /flash"));
+    CHECK(client_cmd(&c, "RMD sub") == 250);
+    CHECK(client_cmd(&c, "CWD /") == 250);
+    CHECK(client_cmd(&c, "QUIT") == 221);
+    client_close(&c);
+}
+
+static void test_transfers(void) {
+    const size_t sizes[] = { 0, 1, 1000, FTP_BUFFER_SIZE / 2 - 1, FTP_BUFFER_SIZE / 2, FTP_BUFFER_SIZE / 2 + 1,
+                             FTP_BUFFER_SIZE, 3 * FTP_BUFFER_SIZE + 17, 300000 };
+    client_t c;
+    char name[64];
+
+    CHECK(client_login(&c));
+    CHECK(client_cmd(&c, "TYPE I") == 200);
+    CHECK(client_cmd(&c, "CWD /sd") == 250);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint8_t *data = random_data(sizes[i]);
+        uint8_t *back;
+        size_t len;
+
+        snprintf(name, sizeof(name), "file%u.bin", (unsigned)i);
+        CHECK(client_stor(&c, name, data, sizes[i]));
+        snprintf(name, sizeof(name), "/sd/file%u.bin", (unsigned)i);
+        CHECK(file_equals(name, data, sizes[i]));
+
+        CHECK(client_cmd(&c, "SIZE %s", name) == 213 && strtoul(c.line + 4, NULL, 10) == sizes[i]);
+        CHECK(client_cmd(&c, "MDTM %s", name) == 213 && strlen(c.line) == 4 + 14);
+
+        // a relative path this time
+        char cmd[80];
+        snprintf(cmd, sizeof(cmd), "RETR file%u.bin", (unsigned)i);
+        CHECK(client_retr(&c, cmd, &back, &len));
+        CHECK(len == sizes[i] && (len == 0 || !memcmp(back, data, len)));
+        free(back);
+        free(data);
+    }
+
+    // a file that does not exist, and a directory
+    uint8_t *back;
+    size_t len;
+    CHECK(!client_retr(&c, "RETR nothere.bin", &back, &len));
+    free(back);
+    CHECK(client_cmd(&c, "SIZE nothere.bin") == 550);
+    CHECK(client_cmd(&c, "MKD dir") == 250);
+    CHECK(!client_retr(&c, "RETR dir", &back, &len));
+    free(back);
+
+    // rename and delete
+    CHECK(client_cmd(&c, "RNFR nothere.bin") == 550);
+    CHECK(client_cmd(&c, "RNFR file2.bin") == 350);
+    CHECK(client_cmd(&c, "RNTO renamed.bin") == 250);
+    CHECK(client_cmd(&c, "SIZE renamed.bin") == 213 && !strcmp(c.line, "213 1000"));
+    CHECK(client_cmd(&c, "SIZE file2.bin") == 550);
+    CHECK(client_cmd(&c, "DELE renamed.bin") == 250);
+    CHECK(client_cmd(&c, "DELE renamed.bin") == 550);
+    CHECK(client_cmd(&c, "RMD dir") == 250);
+
+    // the session is still in a sane state after all of the above
+    CHECK(client_cmd(&c, "PWD") == 257 && !strcmp(c.line, "257 /sd"));
+    CHECK(client_cmd(&c, "QUIT") == 221);
+    client_close(&c);
+}
+
+static void test_long_listing(void) {
+    const int count = 300;
+    char path[256];
+    char name[160];
+    uint8_t *list;
+    size_t len;
+    client_t c;
+    int lines = 0;
+
+    // many long entries, so the listing spans many blocks
+    snprintf(path, sizeof(path), "%s/flash/many", root);
+    mkdir(path, 0755);
+    uint8_t *content = random_data(count);
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "/flash/many/%03d_%0100d.txt", i, i);
+        file_create(name, content, i);
+    }
+    free(content);
+
+    CHECK(client_login(&c));
+    CHECK(client_cmd(&c, "CWD /flash/many") == 250);
+    CHECK(client_retr(&c, "LIST", &list, &len));
+    if (list) {
+        list = realloc(list, len + 1);
+        list[len] = '\0';
+        for (size_t i = 0; i < len; i++) {
+            lines += (list[i] == '\n');
+        }
+        CHECK(lines == count);
+        for (int i = 0; i < count; i++) {
+            snprintf(name, sizeof(name), " %03d_%0100d.txt\r\n", i, i);
+            CHECK(strstr((char *)list, name) != NULL);
+        }
+        CHECK(list[0] == '-');
+    }
+    free(list);
+    CHECK(client_cmd(&c, "QUIT") == 221);
+    client_close(&c);
+}
+
+typedef struct {
+    int         index;
+    size_t      size;
+    bool        ok;
+    uint64_t    up_ns;
+    uint64_t    down_ns;
+} session_job_t;
+
+static void *session_thread(void *arg) {
+    session_job_t *job = arg;
+    uint8_t *data = random_data(job->size);
+    uint8_t *back = NULL;
+    size_t len = 0;
+    char name[64];
+    char cmd[80];
+    client_t c;
+    uint64_t t0;
+
+    snprintf(name, sizeof(name), "session%d.bin", job->index);
+    snprintf(cmd, sizeof(cmd), "RETR %s", name);
+    job->ok = client_login(&c) && client_cmd(&c, "CWD /flash") == 250;
+    t0 = now_ns();
+    job->ok = job->ok && client_stor(&c, name, data, job->size);
+    job->up_ns = now_ns() - t0;
+    t0 = now_ns();
+    job->ok = job->ok && client_retr(&c, cmd, &back, &len);
+    job->down_ns = now_ns() - t0;
+    job->ok = job->ok && len == job->size && !memcmp(back, data, len);
+    snprintf(name, sizeof(name), "/flash/session%d.bin", job->index);
+    job->ok = job->ok && file_equals(name, data, job->size);
+    job->ok = job->ok && client_cmd(&c, "QUIT") == 221;
+    client_close(&c);
+    free(back);
+    free(data);
+    return NULL;
+}
+
+static void run_sessions(session_job_t *jobs, int count) {
+    pthread_t tid[FTP_CMD_CLIENTS_MAX];
+
+    for (int i = 0; i < count; i++) {
+        jobs[i].index = i;
+        pthread_create(&tid[i], NULL, session_thread, &jobs[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(tid[i], NULL);
+    }
+}
+
+static void test_sessions(void) {
+    session_job_t jobs[FTP_CMD_CLIENTS_MAX];
+    client_t c[FTP_CMD_CLIENTS_MAX + 1];
+
+    // all the sessions transfer at the same time
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        jobs[i].size = 200000 + i * 7777;
+    }
+    run_sessions(jobs, FTP_CMD_CLIENTS_MAX);
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        CHECK(jobs[i].ok);
+    }
+
+    // one more client than sessions is turned away
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        CHECK(client_login(&c[i]));
+    }
+    CHECK(client_open(&c[FTP_CMD_CLIENTS_MAX]) == 421);
+    CHECK(client_reply(&c[FTP_CMD_CLIENTS_MAX]) == -1);
+    client_close(&c[FTP_CMD_CLIENTS_MAX]);
+
+    // and gets in once a session is free
+    CHECK(client_cmd(&c[0], "QUIT") == 221);
+    client_close(&c[0]);
+    usleep(5 * FTP_CYCLE_US);
+    CHECK(client_login(&c[0]));
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        CHECK(client_cmd(&c[i], "PWD") == 257);
+        client_close(&c[i]);
+    }
+    usleep(5 * FTP_CYCLE_US);
+}
+
+static void test_updater(void) {
+    const size_t size = 100000;
+    uint8_t *data = random_data(size);
+    client_t a;
+    client_t b;
+    int dsd;
+
+    upd_started = 0;
+    upd_finished = 0;
+    CHECK(client_login(&a));
+    CHECK(client_login(&b));
+
+    // session a is halfway through the image when b asks for an update too
+    dsd = client_pasv(&a);
+    CHECK(dsd >= 0);
+    CHECK(client_cmd(&a, "STOR %s", UPDATER_IMG_PATH) == 150);
+    CHECK(send_all(dsd, data, size / 2));
+
+    int bsd = client_pasv(&b);
+    CHECK(bsd >= 0);
+    CHECK(client_cmd(&b, "STOR %s", UPDATER_IMG_PATH) == 550);
+    close(bsd);
+
+    CHECK(send_all(dsd, data + size / 2, size - size / 2));
+    close(dsd);
+    CHECK(client_reply(&a) == 226);
+    CHECK(upd_started == 1 && upd_finished == 1);
+    CHECK(upd_len == size && !memcmp(upd_data, data, size));
+
+    // the image never reaches the file system
+    CHECK(client_cmd(&a, "SIZE %s", UPDATER_IMG_PATH) == 550);
+    CHECK(client_cmd(&a, "QUIT") == 221);
+    CHECK(client_cmd(&b, "QUIT") == 221);
+    client_close(&a);
+    client_close(&b);
+    free(data);
+}
+
+static void test_idle(void) {
+    client_t c;
+    uint32_t wakeups;
+
+    // a logged in client that says nothing costs one wake up per idle period
+    CHECK(client_login(&c));
+    usleep(10000);
+    wakeups = server_wakeups;
+    usleep(5 * SERVERS_IDLE_TIME_MS * 1000);
+    wakeups = server_wakeups - wakeups;
+    CHECK(wakeups >= 4 && wakeups <= 7);
+
+    // and gets its replies straight away
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < 10; i++) {
+        CHECK(client_cmd(&c, "NOOP") == 200);
+    }
+    CHECK(now_ns() - t0 < 10 * FTP_CYCLE_US * 1000ULL);
+    CHECK(client_cmd(&c, "QUIT") == 221);
+    client_close(&c);
+}
+
+static void run_tests(void) {
+    root_create();
+    server_start();
+    test_login();
+    test_navigation();
+    test_transfers();
+    test_long_listing();
+    test_sessions();
+    test_updater();
+    test_idle();
+    server_halt();
+    root_remove();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench_latency(bool polling) {
+    const int rounds = 500;
+    uint64_t worst = 0;
+    uint64_t total;
+    uint64_t cpu0, cpu1;
+    uint32_t wakeups;
+    clockid_t cid;
+    struct timespec ts;
+    client_t c;
+
+    server_polling = polling;
+    server_start();
+    pthread_getcpuclockid(server_tid, &cid);
+    if (!client_login(&c)) {
+        printf("%-8s login failed\n", polling ? "polling" : "select");
+        server_halt();
+        return;
+    }
+
+    total = now_ns();
+    for (int i = 0; i < rounds; i++) {
+        uint64_t t0 = now_ns();
+        client_cmd(&c, "NOOP");
+        worst = MAX(worst, now_ns() - t0);
+    }
+    total = now_ns() - total;
+
+    // one second with the client logged in and silent
+    wakeups = server_wakeups;
+    clock_gettime(cid, &ts);
+    cpu0 = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    sleep(1);
+    clock_gettime(cid, &ts);
+    cpu1 = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    wakeups = server_wakeups - wakeups;
+
+    printf("%-8s %14.3f %14.3f %14u %14.3f\n", polling ? "polling" : "select",
+           total / 1e6 / rounds, worst / 1e6, wakeups, (cpu1 - cpu0) / 1e6);
+    client_cmd(&c, "QUIT");
+    client_close(&c);
+    server_halt();
+}
+
+static void bench(int mbytes) {
+    session_job_t jobs[FTP_CMD_CLIENTS_MAX];
+    size_t size = (size_t)mbytes << 20;
+
+    root_create();
+    server_start();
+
+    printf("FTP_BUFFER_SIZE %d, %d sessions, select loop (the former loop stepped every %d ms)\n",
+           FTP_BUFFER_SIZE, FTP_CMD_CLIENTS_MAX, FTP_CYCLE_US / 1000);
+    printf("%-10s %10s %14s %14s\n", "sessions", "MB each", "upload MB/s", "download MB/s");
+    for (int count = 1; count <= FTP_CMD_CLIENTS_MAX; count = (count == 1) ? FTP_CMD_CLIENTS_MAX : count + 1) {
+        uint64_t up = 0;
+        uint64_t down = 0;
+        bool ok = true;
+
+        for (int i = 0; i < count; i++) {
+            jobs[i].size = size;
+        }
+        run_sessions(jobs, count);
+        for (int i = 0; i < count; i++) {
+            up = MAX(up, jobs[i].up_ns);
+            down = MAX(down, jobs[i].down_ns);
+            ok = ok && jobs[i].ok;
+        }
+        printf("%-10d %10d %14.2f %14.2f%s\n", count, mbytes,
+               (double)size * count / 1048576.0 / (up / 1e9),
+               (double)size * count / 1048576.0 / (down / 1e9), ok ? "" : "  (transfer failed)");
+    }
+
+    server_halt();
+
+    printf("\n%-8s %14s %14s %14s %14s\n", "loop", "NOOP avg ms", "NOOP max ms", "idle wakeups/s", "idle CPU ms/s");
+    bench_latency(false);
+    bench_latency(true);
+    root_remove();
+}
+
+static void serve(const char *dir) {
+    host_ftpfs_set_root(dir);
+    printf("serving %s on port %d, user %s password %s\n", dir, FTP_CMD_PORT, SERVERS_DEF_USER, SERVERS_DEF_PASS);
+    server_thread(NULL);
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    const char *dir = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:d:p")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'p':
+                server_polling = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b MB] [-s seed] [-d dir [-p]]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    if (dir) {
+        serve(dir);
+        return 0;
+    }
+    if (count > 0) {
+        bench(count);
+        return 0;
+    }
+
+    run_tests();
+    if (failures > 0) {
+        printf("test_ftp: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_ftp: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,733 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the OTA updater. updater.c runs on a 4 MB
+ * flash kept in a scratch file: erasing sets a sector to 0xFF, programming
+ * can only clear bits, like on the NOR flash. The flash counts the erases of
+ * each sector and the writes, and the writes that needed an erase first.
+ *
+ *   test_updater                   run the unit tests
+ *   test_updater -b N [-s seed]    write an image of N KB in 1460 byte pieces,
+ *                                  as the FTP server and pycom.ota_write()
+ *                                  feed it, plain and resumable, and report the
+ *                                  flash operations and their time on the
+ *                                  ESP32 flash (typical datasheet figures).
+ *                                  Then the same for the former updater that
+ *                                  wrote each piece as it came and erased one
+ *                                  sector ahead
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "py/obj.h"
+#include "updater.h"
+#include "esp_spi_flash.h"
+#include "esp_image_format.h"
+#include "rom/crc.h"
+#include "mbedtls/sha256.h"
+
+#define FLASH_SIZE              (4 * 1024 * 1024)
+#define FLASH_SECTORS           (FLASH_SIZE / SPI_FLASH_SEC_SIZE)
+#define FLASH_PAGE_SIZE         256
+#define OTADATA_OFFSET          0x1BE000
+#define UPDATE1_OFFSET          IMG_UPDATE1_OFFSET_4MB
+#define OLD_BOOT_INFO_CRC_LEN   36      // what the bootloaders before the progress record check
+
+// ESP32 flash timings, typical, in us
+#define T_ERASE_SECTOR_US       45000
+#define T_PROGRAM_PAGE_US       700
+#define T_WRITE_CALL_US         20      // the cache is disabled and enabled again
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+static uint8_t *flash;
+static uint32_t erases[FLASH_SECTORS];
+static uint32_t write_calls;
+static uint32_t write_pages;
+static uint32_t dirty_writes;   // bits to set that only an erase sets
+
+esp_err_t spi_flash_erase_sector(size_t sector) {
+    if (sector >= FLASH_SECTORS) {
+        return ESP_FAIL;
+    }
+    memset(flash + sector * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+    erases[sector]++;
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_write(size_t dest_addr, const void *src, size_t size) {
+    const uint8_t *s = src;
+
+    if (dest_addr + size > FLASH_SIZE) {
+        return ESP_FAIL;
+    }
+    bool dirty = false;
+    for (size_t i = 0; i < size; i++) {
+        dirty |= (flash[dest_addr + i] & s[i]) != s[i];
+        flash[dest_addr + i] &= s[i];
+    }
+    dirty_writes += dirty;
+    write_calls++;
+    if (size > 0) {
+        write_pages += (dest_addr + size - 1) / FLASH_PAGE_SIZE - dest_addr / FLASH_PAGE_SIZE + 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_write_encrypted(size_t dest_addr, const void *src, size_t size) {
+    return spi_flash_write(dest_addr, src, size);
+}
+
+esp_err_t spi_flash_read(size_t src_addr, void *dest, size_t size) {
+    if (src_addr + size > FLASH_SIZE) {
+        return ESP_FAIL;
+    }
+    memcpy(dest, flash + src_addr, size);
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_read_encrypted(size_t src, void *dest, size_t size) {
+    return spi_flash_read(src, dest, size);
+}
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data) {
+    return ESP_OK;
+}
+
+uint8_t esp32_get_chip_rev(void) {
+    return 0;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/* FIPS 180-4 SHA-256, for the chunk checks */
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(mbedtls_sha256_context *ctx, const uint8_t *p) {
+    uint32_t w[64], s[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+                      ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+                      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] += s[i];
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224) {
+    static const uint32_t h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->state, h0, sizeof(h0));
+    ctx->total[0] = ctx->total[1] = 0;
+    ctx->is224 = is224;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) {
+    while (ilen > 0) {
+        uint32_t used = ctx->total[0] % 64;
+        uint32_t n = MIN(64 - used, ilen);
+
+        memcpy(ctx->buffer + used, input, n);
+        ctx->total[0] += n;
+        ctx->total[1] += ctx->total[0] < n;
+        input += n;
+        ilen -= n;
+        if (used + n == 64) {
+            sha256_block(ctx, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32]) {
+    uint64_t bits = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) * 8;
+    uint8_t pad[72] = { 0x80 };
+    uint32_t used = ctx->total[0] % 64;
+    uint32_t n = (used < 56 ? 56 : 120) - used;
+
+    for (int i = 0; i < 8; i++) {
+        pad[n + i] = bits >> (56 - 8 * i);
+    }
+    mbedtls_sha256_update_ret(ctx, pad, n + 8);
+    for (int i = 0; i < 8; i++) {
+        output[4 * i] = ctx->state[i] >> 24;
+        output[4 * i + 1] = ctx->state[i] >> 16;
+        output[4 * i + 2] = ctx->state[i] >> 8;
+        output[4 * i + 3] = ctx->state[i];
+    }
+    return 0;
+}
+
+int mbedtls_sha256_ret(const unsigned char *input, size_t ilen, unsigned char output[32], int is224) {
+    mbedtls_sha256_context ctx;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, is224);
+    mbedtls_sha256_update_ret(&ctx, input, ilen);
+    mbedtls_sha256_finish_ret(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+static void flash_open(void) {
+    char path[] = "/tmp/test_updater_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0 || ftruncate(fd, FLASH_SIZE) != 0) {
+        perror("flash file");
+        exit(1);
+    }
+    unlink(path);
+    flash = mmap(NULL, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (flash == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+}
+
+static void flash_counters_reset(void) {
+    memset(erases, 0, sizeof(erases));
+    write_calls = 0;
+    write_pages = 0;
+    dirty_writes = 0;
+}
+
+// blank flash, with the partition table and the boot info of a device
+// running the factory image
+static void flash_format(void) {
+    esp_partition_info_t table[PARTITIONS_COUNT_4MB];
+    boot_info_t boot_info;
+
+    memset(flash, 0xFF, FLASH_SIZE);
+    memset(table, 0xFF, sizeof(table));
+    table[OTA_DATA_INDEX].magic = 0x50AA;
+    table[OTA_DATA_INDEX].type = PART_TYPE_DATA;
+    table[OTA_DATA_INDEX].subtype = PART_SUBTYPE_DATA_OTA;
+    table[OTA_DATA_INDEX].pos.offset = OTADATA_OFFSET;
+    table[OTA_DATA_INDEX].pos.size = OTAA_DATA_SIZE;
+    memcpy(flash + CONFIG_PARTITION_TABLE_OFFSET, table, sizeof(table));
+
+    // as the bootloaders before the progress record left it
+    memset(&boot_info, 0xFF, sizeof(boot_info));
+    boot_info.ActiveImg = IMG_ACT_FACTORY;
+    boot_info.Status = IMG_STATUS_READY;
+    boot_info.PrevImg = IMG_ACT_FACTORY;
+    boot_info.size = 0;
+    boot_info.safeboot = 0;
+    boot_info.crc = crc32_le(UINT32_MAX, (uint8_t *)&boot_info, OLD_BOOT_INFO_CRC_LEN);
+    memcpy(flash + OTADATA_OFFSET, &boot_info, sizeof(boot_info));
+    flash_counters_reset();
+}
+
+static boot_info_t flash_boot_info(void) {
+    boot_info_t boot_info;
+
+    memcpy(&boot_info, flash + OTADATA_OFFSET, sizeof(boot_info));
+    return boot_info;
+}
+
+static uint8_t *make_image(uint32_t len) {
+    uint8_t *image = malloc(len);
+
+    for (uint32_t i = 0; i < len; i++) {
+        image[i] = rand();
+    }
+    return image;
+}
+
+static uint8_t *make_manifest(const uint8_t *image, uint32_t len, uint32_t chunk_size, uint32_t *manifest_len) {
+    uint32_t chunks = (len + chunk_size - 1) / chunk_size;
+    uint8_t *manifest = malloc(UPDATER_MANIFEST_HEADER + chunks * UPDATER_MANIFEST_DIGEST);
+
+    memcpy(manifest, UPDATER_MANIFEST_MAGIC, 4);
+    memcpy(manifest + 4, &len, 4);
+    memcpy(manifest + 8, &chunk_size, 4);
+    for (uint32_t i = 0; i < chunks; i++) {
+        mbedtls_sha256_ret(image + i * chunk_size, MIN(chunk_size, len - i * chunk_size),
+                           manifest + UPDATER_MANIFEST_HEADER + i * UPDATER_MANIFEST_DIGEST, 0);
+    }
+    *manifest_len = UPDATER_MANIFEST_HEADER + chunks * UPDATER_MANIFEST_DIGEST;
+    return manifest;
+}
+
+// feeds image[from, to) in pieces of random sizes up to max_piece
+static bool write_pieces(uint8_t *image, uint32_t from, uint32_t to, uint32_t max_piece) {
+    while (from < to) {
+        uint32_t n = 1 + rand() % max_piece;
+
+        n = MIN(n, to - from);
+
+        if (!updater_write(image + from, n)) {
+            return false;
+        }
+        from += n;
+    }
+    return true;
+}
+
+static uint32_t erased_sectors(uint32_t offset, uint32_t len, uint32_t times) {
+    uint32_t count = 0;
+
+    for (uint32_t s = offset / SPI_FLASH_SEC_SIZE; s < (offset + len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE; s++) {
+        count += erases[s] == times;
+    }
+    return count;
+}
+
+static uint32_t sectors_of(uint32_t len) {
+    return (len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_plain(void) {
+    const uint32_t len = 300 * 1024 + 123;
+    uint8_t *image = make_image(len);
+
+    flash_format();
+    CHECK(updater_start());
+    CHECK(write_pieces(image, 0, len, 5000));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+    // each sector erased once, right before it's written
+    CHECK(erased_sectors(UPDATE1_OFFSET, len, 1) == sectors_of(len));
+    CHECK(erases[sectors_of(UPDATE1_OFFSET + len)] == 0);
+    CHECK(dirty_writes == 0);
+    // whole sectors, except for the tail and the boot info
+    CHECK(write_calls == sectors_of(len) + 1);
+
+    boot_info_t boot_info = flash_boot_info();
+    CHECK(boot_info.ActiveImg == IMG_ACT_UPDATE1);
+    CHECK(boot_info.PrevImg == IMG_ACT_FACTORY);
+    CHECK(boot_info.Status == IMG_STATUS_CHECK);
+    CHECK(boot_info.size == len);
+    CHECK(boot_info.progress.magic != OTA_PROGRESS_MAGIC);
+    // what the bootloaders check, older ones included
+    CHECK(boot_info.crc == crc32_le(UINT32_MAX, (uint8_t *)&boot_info, OLD_BOOT_INFO_CRC_LEN));
+    free(image);
+}
+
+static void test_plain_too_big(void) {
+    const uint32_t len = IMG_SIZE_4MB;
+    uint8_t *image = make_image(len + 1);
+
+    flash_format();
+    CHECK(updater_start());
+    CHECK(write_pieces(image, 0, len, 4096));
+    CHECK(!updater_write(image + len, 1));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+    free(image);
+}
+
+static void test_resume(void) {
+    const uint32_t chunk = 16 * 1024, len = 100000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset = 1;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 0);
+    CHECK(flash_boot_info().progress.magic == OTA_PROGRESS_MAGIC);
+    CHECK(write_pieces(image, 0, 58000, 3000));
+
+    // the connection drops, or the device resets: what wasn't checked is lost
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 3 * chunk);
+    CHECK(flash_boot_info().progress.offset == 3 * chunk);
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, offset) == 0);
+    CHECK(write_pieces(image, offset, len, 3000));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+    // the sectors of the chunk being written at the time, two of them out of
+    // the buffer already, were erased twice
+    CHECK(erased_sectors(UPDATE1_OFFSET, 3 * chunk, 1) == sectors_of(3 * chunk));
+    CHECK(erased_sectors(UPDATE1_OFFSET + 3 * chunk, chunk, 2) == 2);
+    CHECK(erased_sectors(UPDATE1_OFFSET + 3 * chunk, chunk, 1) == 2);
+    CHECK(erased_sectors(UPDATE1_OFFSET + 4 * chunk, len - 4 * chunk, 1) == sectors_of(len - 4 * chunk));
+    CHECK(dirty_writes == 0);
+
+    boot_info_t boot_info = flash_boot_info();
+    CHECK(boot_info.ActiveImg == IMG_ACT_UPDATE1);
+    CHECK(boot_info.Status == IMG_STATUS_CHECK);
+    CHECK(boot_info.size == len);
+    CHECK(boot_info.progress.magic != OTA_PROGRESS_MAGIC);
+    CHECK(boot_info.crc == crc32_le(UINT32_MAX, (uint8_t *)&boot_info, OLD_BOOT_INFO_CRC_LEN));
+    free(manifest);
+    free(image);
+}
+
+static void test_resume_bad_chunk(void) {
+    const uint32_t chunk = 8 * 1024, len = 5 * chunk + 1000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 0);
+    CHECK(write_pieces(image, 0, chunk, 1500));
+    // damaged in transit, noticed at the end of its chunk
+    image[chunk + 100] ^= 0x01;
+    CHECK(write_pieces(image, chunk, 2 * chunk - 1, 1500));
+    CHECK(!updater_write(image + 2 * chunk - 1, 1));
+    image[chunk + 100] ^= 0x01;
+
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == chunk);
+    CHECK(write_pieces(image, offset, len, 1500));
+    // more than the image is refused
+    CHECK(!updater_write(image, 1));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+    free(manifest);
+    free(image);
+}
+
+static void test_resume_other_manifest(void) {
+    const uint32_t chunk = 4 * 1024, len = 40000;
+    uint8_t *image_a = make_image(len), *image_b = make_image(len);
+    uint32_t len_a, len_b, offset;
+    uint8_t *manifest_a = make_manifest(image_a, len, chunk, &len_a);
+    uint8_t *manifest_b = make_manifest(image_b, len, chunk, &len_b);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest_a, len_a, &offset));
+    CHECK(write_pieces(image_a, 0, 5 * chunk, 1024));
+    CHECK(updater_start_resumable(manifest_a, len_a, &offset));
+    CHECK(offset == 5 * chunk);
+
+    // another image starts over
+    CHECK(updater_start_resumable(manifest_b, len_b, &offset));
+    CHECK(offset == 0);
+    CHECK(write_pieces(image_b, 0, len, 1024));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image_b, len) == 0);
+    free(manifest_a);
+    free(manifest_b);
+    free(image_a);
+    free(image_b);
+}
+
+static void test_finish_early(void) {
+    const uint32_t chunk = 4 * 1024, len = 30000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(write_pieces(image, 0, 10000, 1024));
+    CHECK(!updater_finish());
+    // nothing switched, the progress kept
+    boot_info_t boot_info = flash_boot_info();
+    CHECK(boot_info.ActiveImg == IMG_ACT_FACTORY);
+    CHECK(boot_info.Status == IMG_STATUS_READY);
+    CHECK(boot_info.progress.magic == OTA_PROGRESS_MAGIC);
+    CHECK(boot_info.progress.offset == 2 * chunk);
+
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 2 * chunk);
+    CHECK(write_pieces(image, offset, len, 1024));
+    CHECK(updater_finish());
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+    free(manifest);
+    free(image);
+}
+
+static void test_plain_start_clears_progress(void) {
+    const uint32_t chunk = 4 * 1024, len = 30000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(write_pieces(image, 0, 3 * chunk, 1024));
+    CHECK(flash_boot_info().progress.offset == 3 * chunk);
+
+    // the slot is overwritten by a plain update
+    CHECK(updater_start());
+    CHECK(flash_boot_info().progress.magic != OTA_PROGRESS_MAGIC);
+    CHECK(updater_write(image, 100));
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 0);
+    CHECK(updater_finish() == false);
+    free(manifest);
+    free(image);
+}
+
+static void test_invalid_manifest(void) {
+    const uint32_t chunk = 4 * 1024, len = 10000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset, value;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(!updater_start_resumable(manifest, 8, &offset));
+    CHECK(!updater_start_resumable(manifest, manifest_len - 1, &offset));
+    CHECK(!updater_start_resumable(manifest, manifest_len + UPDATER_MANIFEST_DIGEST, &offset));
+
+    manifest[0] = 'X';
+    CHECK(!updater_start_resumable(manifest, manifest_len, &offset));
+    manifest[0] = 'O';
+
+    // chunks of whole sectors only
+    value = 1000;
+    memcpy(manifest + 8, &value, 4);
+    CHECK(!updater_start_resumable(manifest, manifest_len, &offset));
+    value = 0;
+    memcpy(manifest + 8, &value, 4);
+    CHECK(!updater_start_resumable(manifest, manifest_len, &offset));
+    memcpy(manifest + 8, &chunk, 4);
+
+    value = 0;
+    memcpy(manifest + 4, &value, 4);
+    CHECK(!updater_start_resumable(manifest, manifest_len, &offset));
+    value = IMG_SIZE_4MB + 1;
+    memcpy(manifest + 4, &value, 4);
+    CHECK(!updater_start_resumable(manifest, manifest_len, &offset));
+    memcpy(manifest + 4, &len, 4);
+
+    // nothing was touched
+    CHECK(flash_boot_info().progress.magic != OTA_PROGRESS_MAGIC);
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 0);
+    free(manifest);
+    free(image);
+}
+
+static void test_progress_crc(void) {
+    const uint32_t chunk = 4 * 1024, len = 20000;
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset;
+    uint8_t *manifest = make_manifest(image, len, chunk, &manifest_len);
+
+    flash_format();
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(write_pieces(image, 0, 2 * chunk, 1024));
+    boot_info_t boot_info = flash_boot_info();
+    CHECK(boot_info.crc == crc32_le(UINT32_MAX, (uint8_t *)&boot_info, OLD_BOOT_INFO_CRC_LEN));
+
+    // a progress record that doesn't check out is ignored
+    flash[OTADATA_OFFSET + offsetof(boot_info_t, progress) + offsetof(ota_progress_t, offset) + 1] ^= 0x01;
+    CHECK(updater_start_resumable(manifest, manifest_len, &offset));
+    CHECK(offset == 0);
+    free(manifest);
+    free(image);
+}
+
+static void run_tests(void) {
+    test_plain();
+    test_plain_too_big();
+    test_resume();
+    test_resume_bad_chunk();
+    test_resume_other_manifest();
+    test_finish_early();
+    test_plain_start_clears_progress();
+    test_invalid_manifest();
+    test_progress_crc();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+// the updater this replaced: each piece written as it came, the next sector
+// erased whenever one got full
+static uint32_t legacy_offset, legacy_in_sector;
+
+static void legacy_start(void) {
+    legacy_offset = UPDATE1_OFFSET;
+    legacy_in_sector = 0;
+    spi_flash_erase_sector(legacy_offset / SPI_FLASH_SEC_SIZE);
+}
+
+static bool legacy_write(uint8_t *buf, uint32_t len) {
+    if (ESP_OK != spi_flash_write(legacy_offset, buf, len)) {
+        return false;
+    }
+    legacy_offset += len;
+    legacy_in_sector += len;
+    if (legacy_in_sector >= SPI_FLASH_SEC_SIZE) {
+        legacy_in_sector -= SPI_FLASH_SEC_SIZE;
+        return ESP_OK == spi_flash_erase_sector((legacy_offset + SPI_FLASH_SEC_SIZE) / SPI_FLASH_SEC_SIZE);
+    }
+    return true;
+}
+
+static void bench_report(const char *name, uint64_t t0) {
+    uint64_t host_ns = now_ns() - t0;
+    uint32_t erase_count = 0;
+
+    for (int s = 0; s < FLASH_SECTORS; s++) {
+        erase_count += erases[s];
+    }
+    uint64_t flash_us = (uint64_t)erase_count * T_ERASE_SECTOR_US + (uint64_t)write_pages * T_PROGRAM_PAGE_US +
+                        (uint64_t)write_calls * T_WRITE_CALL_US;
+    printf("%-24s %6u erases %7u writes %7u pages %4u dirty  flash %7.1f ms  host %6.1f ms\n",
+           name, erase_count, write_calls, write_pages, dirty_writes, flash_us / 1000.0, host_ns / 1e6);
+}
+
+static void bench(uint32_t kb) {
+    const uint32_t piece = 1460;      // a TCP segment
+    uint32_t len = MIN(kb * 1024, IMG_SIZE_4MB);
+    uint8_t *image = make_image(len);
+    uint32_t manifest_len, offset;
+    uint8_t *manifest = make_manifest(image, len, 64 * 1024, &manifest_len);
+    uint64_t t0;
+
+    printf("image of %u bytes in %u byte pieces\n", len, piece);
+
+    flash_format();
+    t0 = now_ns();
+    legacy_start();
+    for (uint32_t i = 0; i < len; i += piece) {
+        legacy_write(image + i, MIN(piece, len - i));
+    }
+    bench_report("former, erase ahead", t0);
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+
+    flash_format();
+    t0 = now_ns();
+    updater_start();
+    for (uint32_t i = 0; i < len; i += piece) {
+        updater_write(image + i, MIN(piece, len - i));
+    }
+    updater_finish();
+    bench_report("write combining", t0);
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+
+    flash_format();
+    t0 = now_ns();
+    updater_start_resumable(manifest, manifest_len, &offset);
+    for (uint32_t i = 0; i < len; i += piece) {
+        updater_write(image + i, MIN(piece, len - i));
+    }
+    updater_finish();
+    bench_report("resumable, 64 KB chunks", t0);
+    CHECK(memcmp(flash + UPDATE1_OFFSET, image, len) == 0);
+
+    free(manifest);
+    free(image);
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b KB] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+    flash_open();
+    // the updater reports to the console as it goes
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (count > 0) {
+        bench(count);
+    } else {
+        run_tests();
+    }
+    munmap(flash, FLASH_SIZE);
+    if (failures) {
+        printf("test_updater: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_updater: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host stand-in for esp32/lora/board.h, only what the host builds of lib/lora use */
+
+#ifndef LORA_BOARD_H_
+#define LORA_BOARD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define IRAM_ATTR
+
+// An interrupt a test sets pending runs when the next atomic section ends
+__attribute__((weak)) void (*host_pending_irq)(void) = NULL;
+
+static inline void host_end_atomic_section(uint32_t state) {
+    void (*irq)(void) = host_pending_irq;
+
+    (void)state;
+    if (irq != NULL) {
+        host_pending_irq = NULL;
+        irq();
+    }
+}
+
+#define MICROPY_BEGIN_ATOMIC_SECTION()      (0)
+#define MICROPY_END_ATOMIC_SECTION(state)   host_end_atomic_section(state)
+
+#include "lora/system/timer.h"
+#include "radio.h"
+
+#define RADIO_WAKEUP_TIME                   1 // [ms]
+
+#endif // LORA_BOARD_H_
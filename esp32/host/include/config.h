@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the HAL library configuration header */
+
+#ifndef _LORAGW_CONFIGURATION_H
+#define _LORAGW_CONFIGURATION_H
+
+#define LIBLORAGW_VERSION   "host"
+
+#define DEBUG_AUX           0
+#define DEBUG_COM           0
+#define DEBUG_MCU           0
+#define DEBUG_REG           0
+#define DEBUG_GPS           0
+
+#endif
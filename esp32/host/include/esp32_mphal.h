@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the port HAL, only what the host builds use */
+
+#ifndef ESP32_MPHAL_H_
+#define ESP32_MPHAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+uint32_t mp_hal_ticks_ms(void);
+uint32_t mp_hal_ticks_us(void);
+void mp_hal_set_interrupt_char(int c);
+void mp_hal_reset_safe_and_boot(bool reset);
+
+#endif // ESP32_MPHAL_H_
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: no IRAM/DRAM placement on Linux */
+
+#ifndef __ESP_ATTR_H__
+#define __ESP_ATTR_H__
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#define DRAM_ATTR
+
+#endif /* __ESP_ATTR_H__ */
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the partition table types bootloader.h needs */
+
+#ifndef ESP_FLASH_DATA_TYPES_H_
+#define ESP_FLASH_DATA_TYPES_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t  type;
+    uint8_t  subtype;
+    esp_partition_pos_t pos;
+    uint8_t  label[16];
+    uint32_t flags;
+} esp_partition_info_t;
+
+#endif // ESP_FLASH_DATA_TYPES_H_
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the flash of the updater tests is never encrypted */
+
+#ifndef ESP_FLASH_ENCRYPT_H_
+#define ESP_FLASH_ENCRYPT_H_
+
+#include <stdbool.h>
+
+static inline bool esp_flash_encryption_enabled(void) {
+    return false;
+}
+
+#endif // ESP_FLASH_ENCRYPT_H_
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Host stand in for the ESP-IDF esp_heap_caps.h
+ */
+
+#ifndef ESP_HEAP_CAPS_H_
+#define ESP_HEAP_CAPS_H_
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+
+#define heap_caps_malloc(size, caps)    malloc(size)
+#define heap_caps_free(ptr)             free(ptr)
+
+#endif // ESP_HEAP_CAPS_H_
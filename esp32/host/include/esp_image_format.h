@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: only what updater_verify() names */
+
+#ifndef ESP_IMAGE_FORMAT_H_
+#define ESP_IMAGE_FORMAT_H_
+
+#include "esp_spi_flash.h"
+#include "esp_flash_data_types.h"
+
+typedef enum {
+    ESP_IMAGE_VERIFY,
+    ESP_IMAGE_VERIFY_SILENT,
+    ESP_IMAGE_LOAD,
+} esp_image_load_mode_t;
+
+typedef struct {
+    uint32_t start_addr;
+    uint32_t image_len;
+} esp_image_metadata_t;
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data);
+
+#endif // ESP_IMAGE_FORMAT_H_
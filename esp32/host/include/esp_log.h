@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: logging compiled out, the arguments still checked */
+
+#ifndef ESP_LOG_H_
+#define ESP_LOG_H_
+
+#include <stdio.h>
+
+#define ESP_LOG_NONE(tag, ...)  do { if (0) { (void)(tag); printf(__VA_ARGS__); } } while (0)
+
+#define ESP_LOGE                ESP_LOG_NONE
+#define ESP_LOGW                ESP_LOG_NONE
+#define ESP_LOGI                ESP_LOG_NONE
+#define ESP_LOGD                ESP_LOG_NONE
+#define ESP_LOGV                ESP_LOG_NONE
+
+#endif // ESP_LOG_H_
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: thread stack size and priority are left to libc */
+
+#ifndef __ESP_PTHREAD_H__
+#define __ESP_PTHREAD_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    size_t stack_size;
+    size_t prio;
+    bool inherit_cfg;
+} esp_pthread_cfg_t;
+
+static inline int esp_pthread_set_cfg(const esp_pthread_cfg_t *cfg) {
+    (void)cfg;
+    return 0;
+}
+
+#endif /* __ESP_PTHREAD_H__ */
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the flash of the updater tests is a file, see test_updater.c */
+
+#ifndef ESP_SPI_FLASH_H_
+#define ESP_SPI_FLASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+
+#define SPI_FLASH_SEC_SIZE              4096
+
+// from sdkconfig.h
+#define CONFIG_PARTITION_TABLE_OFFSET   0x8000
+
+esp_err_t spi_flash_erase_sector(size_t sector);
+esp_err_t spi_flash_write(size_t dest_addr, const void *src, size_t size);
+esp_err_t spi_flash_write_encrypted(size_t dest_addr, const void *src, size_t size);
+esp_err_t spi_flash_read(size_t src_addr, void *dest, size_t size);
+esp_err_t spi_flash_read_encrypted(size_t src, void *dest, size_t size);
+
+#endif // ESP_SPI_FLASH_H_
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the FreeRTOS types, tasks are pthreads */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+
+#define portTICK_PERIOD_MS      1
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+uint32_t xPortGetFreeHeapSize(void);
+
+/* esp_system.h, pulled in through the IDF FreeRTOS headers on target */
+void esp_restart(void);
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,13 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the generated version header */
+
+#define MICROPY_GIT_TAG             "host"
+#define MICROPY_BUILD_DATE          __DATE__
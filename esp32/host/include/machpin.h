@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: concentrator reset pins are no-ops */
+
+#ifndef MACHPIN_H_
+#define MACHPIN_H_
+
+#define GPIO_MODE_OUTPUT                  2
+#define MACHPIN_PULL_NONE                 0x00
+
+typedef struct {
+    unsigned int        pin_number;
+    unsigned int        value;
+} pin_obj_t;
+
+extern void pin_config (pin_obj_t *self, int af_in, int af_out, unsigned int mode, unsigned int pull, int value);
+extern void pin_set_value (const pin_obj_t* self);
+
+#endif // MACHPIN_H_
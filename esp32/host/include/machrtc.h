@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the RTC is the system clock */
+
+#ifndef MACHRTC_H_
+#define MACHRTC_H_
+
+#include <stdint.h>
+
+extern uint64_t mach_rtc_get_us_since_epoch(void);
+
+#endif // MACHRTC_H_
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host stand-in for esp32/mods/modlora.h, the tests provide the callback queue */
+
+#ifndef MODLORA_H_
+#define MODLORA_H_
+
+typedef void ( *modlora_timerCallback )( void );
+
+void modlora_set_timer_callback(modlora_timerCallback cb);
+
+#endif // MODLORA_H_
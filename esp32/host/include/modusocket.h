@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the sockets of the servers are not tracked on the host */
+
+#ifndef MODUSOCKET_H_
+#define MODUSOCKET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline void modusocket_socket_add (int32_t sd, bool user) {
+    (void)sd;
+    (void)user;
+}
+
+#endif // MODUSOCKET_H_
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the generated board pin table */
+
+#ifndef PINS_H_
+#define PINS_H_
+
+#include "machpin.h"
+
+extern pin_obj_t PIN_MODULE_P8;
+
+#endif
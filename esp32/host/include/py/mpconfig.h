@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the few settings of esp32/mpconfigport.h the host
+ * builds use */
+
+#ifndef MICROPY_INCLUDED_PY_MPCONFIG_H
+#define MICROPY_INCLUDED_PY_MPCONFIG_H
+
+#define STATIC static
+
+#define MICROPY_HW_BOARD_NAME                       "Host"
+#define MICROPY_HW_MCU_NAME                         "Linux"
+
+#define MICROPY_ALLOC_PATH_MAX                      (128)
+
+// the FatFS options, without the locking
+#define MICROPY_FATFS_ENABLE_LFN                    (2)
+#define MICROPY_FATFS_MAX_LFN                       (MICROPY_ALLOC_PATH_MAX)
+#define MICROPY_FATFS_LFN_CODE_PAGE                 437
+#define MICROPY_FATFS_RPATH                         (2)
+
+#define MICROPY_VFS_LOG                             (1)
+#define MICROPY_VFS_BLOCKCACHE                      (1)
+
+#endif // MICROPY_INCLUDED_PY_MPCONFIG_H
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for py/mpprint.h: mp_printf goes to stdout */
+
+#ifndef MICROPY_INCLUDED_PY_MPPRINT_H
+#define MICROPY_INCLUDED_PY_MPPRINT_H
+
+typedef struct _mp_print_t {
+    void *data;
+} mp_print_t;
+
+extern const mp_print_t mp_plat_print;
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // MICROPY_INCLUDED_PY_MPPRINT_H
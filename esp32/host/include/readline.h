@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in: the control characters the telnet server uses */
+
+#ifndef MICROPY_INCLUDED_LIB_MP_READLINE_READLINE_H
+#define MICROPY_INCLUDED_LIB_MP_READLINE_READLINE_H
+
+#define CHAR_CTRL_D (4)
+#define CHAR_CTRL_F (6)
+
+#endif // MICROPY_INCLUDED_LIB_MP_READLINE_READLINE_H
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the ROM CRC, see test_updater.c */
+
+#ifndef ROM_CRC_H_
+#define ROM_CRC_H_
+
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif // ROM_CRC_H_
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/* Host build stand-in for the Pygate concentrator wiring */
+
+#ifndef SX1308_CONFIG_H_
+#define SX1308_CONFIG_H_
+
+#include "pins.h"
+
+extern pin_obj_t PIN_MODULE_P12;
+
+#define SX1308_RST_PIN              (&PIN_MODULE_P12)
+
+#endif
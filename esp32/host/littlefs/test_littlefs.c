@@ -0,0 +1,600 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for littlefs with the sizes /flash can be given,
+ * see littlefs_init_config(). The block device is RAM that behaves like the
+ * NOR flash: erasing sets a block to 0xFF, programming can only clear bits.
+ * It counts the operations and the bytes, and models their time on the
+ * ESP32 flash (typical datasheet figures).
+ *
+ *   test_littlefs                  run the unit tests
+ *   test_littlefs -b N [-s seed]   create N small files, append to a log N
+ *                                  times, read the files back, then mount
+ *                                  and write, with and without the map of
+ *                                  the blocks in use. With the sizes of the
+ *                                  former driver (4 KB reads, programs and
+ *                                  caches), the default ones (256 byte reads)
+ *                                  and with smaller program units. Then
+ *                                  list 10 * N files with their timestamps,
+ *                                  looked up by path and from the directory
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfs.h"
+#include "lfs_util.h"
+#include "lfs_freemap.h"
+
+#define BLOCK_SIZE              4096
+#define BLOCK_COUNT             127     // /flash of the 4 MB parts
+#define PAGE_SIZE               256
+
+// ESP32 flash timings, typical, in us
+#define T_READ_OP_US            5
+#define T_READ_BYTES_PER_US     20
+#define T_PROG_PAGE_US          30
+#define T_PROG_BYTE_NS          2700
+#define T_ERASE_BLOCK_US        45000
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+static uint8_t flash[BLOCK_COUNT * BLOCK_SIZE];
+
+static struct {
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t progs;
+    uint64_t prog_bytes;
+    uint32_t prog_pages;
+    uint32_t erases;
+    uint32_t dirty;         // programs that needed an erase first
+} stats;
+
+static int bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    memcpy(buffer, flash + block * c->block_size + off, size);
+    stats.reads++;
+    stats.read_bytes += size;
+    return LFS_ERR_OK;
+}
+
+static int bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+    const uint8_t *data = buffer;
+    uint8_t *p = flash + block * c->block_size + off;
+    bool dirty = false;
+
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    for (lfs_size_t i = 0; i < size; i++) {
+        dirty |= (p[i] & data[i]) != data[i];
+        p[i] &= data[i];
+    }
+    stats.dirty += dirty;
+    stats.progs++;
+    stats.prog_bytes += size;
+    stats.prog_pages += (off + size - 1) / PAGE_SIZE - off / PAGE_SIZE + 1;
+    return LFS_ERR_OK;
+}
+
+static int bd_erase(const struct lfs_config *c, lfs_block_t block) {
+    if (block >= c->block_count) {
+        return LFS_ERR_IO;
+    }
+    memset(flash + block * c->block_size, 0xFF, c->block_size);
+    stats.erases++;
+    return LFS_ERR_OK;
+}
+
+static int bd_sync(const struct lfs_config *c) {
+    return LFS_ERR_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+typedef struct {
+    const char *name;
+    lfs_size_t read_size;
+    lfs_size_t prog_size;
+    lfs_size_t cache_size;
+    lfs_size_t lookahead_size;
+} tuning_t;
+
+static const tuning_t tunings[] = {
+    { "former, 4 KB units",     4096, 4096, 4096, 32 },
+    { "default, 256 B reads",   256,  4096, 4096, 16 },
+    { "256 B programs",         256,  256,  1024, 16 },
+    { "16 B programs",          16,   16,   512,  16 },
+};
+#define TUNINGS         (sizeof(tunings) / sizeof(tunings[0]))
+
+static struct lfs_config make_config(const tuning_t *t) {
+    struct lfs_config cfg = {
+        .read = bd_read,
+        .prog = bd_prog,
+        .erase = bd_erase,
+        .sync = bd_sync,
+        .read_size = t->read_size,
+        .prog_size = t->prog_size,
+        .block_size = BLOCK_SIZE,
+        .block_count = BLOCK_COUNT,
+        .block_cycles = 0,
+        .cache_size = t->cache_size,
+        .lookahead_size = t->lookahead_size,
+    };
+    return cfg;
+}
+
+static void stats_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+static uint64_t stats_flash_us(void) {
+    return (uint64_t)stats.reads * T_READ_OP_US + stats.read_bytes / T_READ_BYTES_PER_US +
+           (uint64_t)stats.prog_pages * T_PROG_PAGE_US + stats.prog_bytes * T_PROG_BYTE_NS / 1000 +
+           (uint64_t)stats.erases * T_ERASE_BLOCK_US;
+}
+
+// the content of file i, of some size between 64 and 512 bytes
+static lfs_size_t file_data(int i, uint8_t *buf) {
+    lfs_size_t len = 64 + (i * 97) % 449;
+
+    for (lfs_size_t k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i * 31 + k * 7);
+    }
+    return len;
+}
+
+static int write_file(lfs_t *lfs, const char *path, const void *data, lfs_size_t len, int flags) {
+    lfs_file_t file;
+    int err = lfs_file_open(lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | flags);
+
+    if (err) {
+        return err;
+    }
+    lfs_ssize_t n = lfs_file_write(lfs, &file, data, len);
+    err = lfs_file_close(lfs, &file);
+    return n < 0 ? n : (n != len ? LFS_ERR_IO : err);
+}
+
+// reads the file in chunks of chunk bytes, returns its length
+static lfs_ssize_t read_file(lfs_t *lfs, const char *path, uint8_t *buf, lfs_size_t max, lfs_size_t chunk) {
+    lfs_file_t file;
+    lfs_size_t len = 0;
+    int err = lfs_file_open(lfs, &file, path, LFS_O_RDONLY);
+
+    if (err) {
+        return err;
+    }
+    while (len < max) {
+        lfs_ssize_t n = lfs_file_read(lfs, &file, buf + len, lfs_min(chunk, max - len));
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    lfs_file_close(lfs, &file);
+    return len;
+}
+
+static void create_files(lfs_t *lfs, int from, int to) {
+    uint8_t buf[512];
+    char path[16];
+
+    for (int i = from; i < to; i++) {
+        snprintf(path, sizeof(path), "/f%03d", i);
+        CHECK(write_file(lfs, path, buf, file_data(i, buf), LFS_O_TRUNC) == LFS_ERR_OK);
+    }
+}
+
+static bool check_files(lfs_t *lfs, int from, int to) {
+    uint8_t buf[512], expected[512];
+    char path[16];
+    bool ok = true;
+
+    for (int i = from; i < to; i++) {
+        lfs_size_t len = file_data(i, expected);
+        snprintf(path, sizeof(path), "/f%03d", i);
+        ok &= read_file(lfs, path, buf, sizeof(buf), 64) == len && memcmp(buf, expected, len) == 0;
+    }
+    return ok;
+}
+
+// the timestamp /flash keeps with each file, LFS_ATTRIBUTE_TIMESTAMP
+#define ATTR_TIMESTAMP          1
+
+static void create_stamped(lfs_t *lfs, const char *dir, int n) {
+    char path[48];
+
+    for (int i = 0; i < n; i++) {
+        uint32_t stamp = 0x50000000 + i;
+        snprintf(path, sizeof(path), "%s/log-%05d.txt", dir, i);
+        CHECK(write_file(lfs, path, path, i % 64, LFS_O_TRUNC) == LFS_ERR_OK);
+        CHECK(lfs_setattr(lfs, path, ATTR_TIMESTAMP, &stamp, sizeof(stamp)) == LFS_ERR_OK);
+    }
+}
+
+// lists dir with the timestamps, from the directory or by path as os.stat()
+// does, returns the number of entries and the sum of their sizes and stamps
+static int list_stamped(lfs_t *lfs, const char *dir, bool by_path, uint64_t *sum) {
+    struct lfs_info info;
+    lfs_dir_t d;
+    char path[16 + LFS_NAME_MAX + 1];
+    int n = 0;
+
+    *sum = 0;
+    if (lfs_dir_open(lfs, &d, dir) != LFS_ERR_OK) {
+        return -1;
+    }
+    while (lfs_dir_read(lfs, &d, &info) > 0) {
+        uint32_t stamp = 0;
+        lfs_ssize_t res;
+        if (by_path) {
+            snprintf(path, sizeof(path), "%s/%s", dir, info.name);
+            res = lfs_getattr(lfs, path, ATTR_TIMESTAMP, &stamp, sizeof(stamp));
+        } else {
+            res = lfs_dir_getattr(lfs, &d, ATTR_TIMESTAMP, &stamp, sizeof(stamp));
+        }
+        if (info.name[0] == '.') {
+            continue;
+        }
+        if (res != sizeof(stamp)) {
+            n = -1;
+            break;
+        }
+        *sum += info.size + stamp;
+        n++;
+    }
+    lfs_dir_close(lfs, &d);
+    return n;
+}
+
+static int count_bits(const uint32_t *map, lfs_size_t blocks) {
+    int n = 0;
+
+    for (lfs_size_t b = 0; b < blocks; b++) {
+        n += (map[b / 32] >> (b % 32)) & 1;
+    }
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_tunings(void) {
+    for (size_t t = 0; t < TUNINGS; t++) {
+        struct lfs_config cfg = make_config(&tunings[t]);
+        lfs_t lfs;
+
+        CHECK(lfs_format(&lfs, &cfg) == LFS_ERR_OK);
+        CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+        create_files(&lfs, 0, 40);
+        CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+        CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+        CHECK(check_files(&lfs, 0, 40));
+        CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+        CHECK(stats.dirty == 0);
+    }
+}
+
+// the sizes aren't part of the format, /flash mounts whatever it was made with
+static void test_mount_other_sizes(void) {
+    for (size_t a = 0; a < TUNINGS; a++) {
+        for (size_t b = 0; b < TUNINGS; b++) {
+            struct lfs_config cfg_a = make_config(&tunings[a]);
+            struct lfs_config cfg_b = make_config(&tunings[b]);
+            uint8_t buf[200], log[200 * 2];
+            lfs_t lfs;
+
+            memset(buf, 'a' + a, sizeof(buf));
+            CHECK(lfs_format(&lfs, &cfg_a) == LFS_ERR_OK);
+            CHECK(lfs_mount(&lfs, &cfg_a) == LFS_ERR_OK);
+            create_files(&lfs, 0, 20);
+            CHECK(write_file(&lfs, "/log", buf, sizeof(buf), LFS_O_APPEND) == LFS_ERR_OK);
+            CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+
+            CHECK(lfs_mount(&lfs, &cfg_b) == LFS_ERR_OK);
+            CHECK(check_files(&lfs, 0, 20));
+            create_files(&lfs, 20, 30);
+            memset(buf, 'a' + b, sizeof(buf));
+            CHECK(write_file(&lfs, "/log", buf, sizeof(buf), LFS_O_APPEND) == LFS_ERR_OK);
+            CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+
+            CHECK(lfs_mount(&lfs, &cfg_a) == LFS_ERR_OK);
+            CHECK(check_files(&lfs, 0, 30));
+            CHECK(read_file(&lfs, "/log", log, sizeof(log), 64) == sizeof(log));
+            CHECK(log[0] == 'a' + a && log[sizeof(log) - 1] == 'a' + b);
+            CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+        }
+    }
+}
+
+static void test_freemap(void) {
+    struct lfs_config cfg = make_config(&tunings[1]);
+    lfs_size_t size = lfs_freemap_size(&cfg);
+    lfs_freemap_t *fm = malloc(size);
+    uint8_t big[20000];
+    lfs_t lfs;
+
+    CHECK(size == sizeof(lfs_freemap_t) + 4 * sizeof(uint32_t));
+    CHECK(lfs_format(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    create_files(&lfs, 0, 60);
+    memset(big, 0x5A, sizeof(big));
+    CHECK(write_file(&lfs, "/big", big, sizeof(big), 0) == LFS_ERR_OK);
+    CHECK(lfs_freemap_take(&lfs, fm, 1234) == LFS_ERR_OK);
+    CHECK(count_bits(fm->map, BLOCK_COUNT) == lfs_fs_size(&lfs));
+    CHECK(fm->map[0] & 3);      // the superblock
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+
+    // the first write after the mount walks the whole file system, or not
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    stats_reset();
+    CHECK(write_file(&lfs, "/big2", big, 5000, 0) == LFS_ERR_OK);
+    uint32_t reads_walk = stats.reads;
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_freemap_take(&lfs, fm, 1234) == LFS_ERR_OK);
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+    // the allocations start where the seed of the mount has them start
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    lfs_block_t off = lfs.free.off % cfg.block_count;
+    CHECK(off != 0);
+    CHECK(lfs_freemap_seed(&lfs, fm, size, 1234));
+    CHECK(lfs.free.off == off);
+    stats_reset();
+    CHECK(write_file(&lfs, "/big2", big, 5000, LFS_O_TRUNC) == LFS_ERR_OK);
+    CHECK(stats.reads < reads_walk);
+
+    // allocating from the map doesn't overwrite anything
+    for (int i = 0; i < 5; i++) {
+        big[0] = i;
+        CHECK(write_file(&lfs, "/big2", big, sizeof(big), LFS_O_TRUNC) == LFS_ERR_OK);
+    }
+    CHECK(lfs_remove(&lfs, "/big2") == LFS_ERR_OK);
+    create_files(&lfs, 60, 90);
+    CHECK(check_files(&lfs, 0, 90));
+    uint8_t back[sizeof(big)];
+    big[0] = 0x5A;
+    CHECK(read_file(&lfs, "/big", back, sizeof(back), 4096) == sizeof(back) && memcmp(back, big, sizeof(big)) == 0);
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+    free(fm);
+}
+
+static void test_freemap_rejected(void) {
+    struct lfs_config cfg = make_config(&tunings[1]);
+    lfs_size_t size = lfs_freemap_size(&cfg);
+    lfs_freemap_t *fm = malloc(size);
+    lfs_t lfs;
+
+    CHECK(lfs_format(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    create_files(&lfs, 0, 10);
+    CHECK(lfs_freemap_take(&lfs, fm, 7) == LFS_ERR_OK);
+    CHECK(lfs_freemap_seed(&lfs, fm, size, 7));
+
+    // by another firmware, damaged, or of another file system
+    CHECK(!lfs_freemap_seed(&lfs, fm, size, 8));
+    CHECK(!lfs_freemap_seed(&lfs, fm, size - 4, 7));
+    fm->map[1] ^= 0x10;
+    CHECK(!lfs_freemap_seed(&lfs, fm, size, 7));
+    fm->map[1] ^= 0x10;
+    fm->block_count++;
+    CHECK(!lfs_freemap_seed(&lfs, fm, size, 7));
+    fm->block_count--;
+    fm->magic = 0;
+    CHECK(!lfs_freemap_seed(&lfs, fm, size, 7));
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+    free(fm);
+}
+
+// enough entries for the directory to span several metadata pairs
+static void test_dir_getattr(void) {
+    struct lfs_config cfg = make_config(&tunings[1]);
+    struct lfs_info info;
+    uint32_t stamp;
+    uint64_t sum, expected = 0;
+    lfs_dir_t d;
+    lfs_t lfs;
+    int n = 300;
+
+    for (int i = 0; i < n; i++) {
+        expected += i % 64 + 0x50000000 + i;
+    }
+    CHECK(lfs_format(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_mkdir(&lfs, "/logs") == LFS_ERR_OK);
+    create_stamped(&lfs, "/logs", n);
+    CHECK(list_stamped(&lfs, "/logs", true, &sum) == n && sum == expected);
+    CHECK(list_stamped(&lfs, "/logs", false, &sum) == n && sum == expected);
+
+    // none for '.' and '..', nor for a file written without one
+    CHECK(write_file(&lfs, "/logs/plain", "x", 1, 0) == LFS_ERR_OK);
+    CHECK(lfs_dir_open(&lfs, &d, "/logs") == LFS_ERR_OK);
+    CHECK(lfs_dir_read(&lfs, &d, &info) > 0 && strcmp(info.name, ".") == 0);
+    CHECK(lfs_dir_getattr(&lfs, &d, ATTR_TIMESTAMP, &stamp, sizeof(stamp)) == LFS_ERR_NOATTR);
+    CHECK(lfs_dir_read(&lfs, &d, &info) > 0 && strcmp(info.name, "..") == 0);
+    CHECK(lfs_dir_getattr(&lfs, &d, ATTR_TIMESTAMP, &stamp, sizeof(stamp)) == LFS_ERR_NOATTR);
+    int plain = 0;
+    while (lfs_dir_read(&lfs, &d, &info) > 0) {
+        if (strcmp(info.name, "plain") == 0) {
+            CHECK(lfs_dir_getattr(&lfs, &d, ATTR_TIMESTAMP, &stamp, sizeof(stamp)) == LFS_ERR_NOATTR);
+            plain++;
+        }
+    }
+    CHECK(plain == 1);
+    CHECK(lfs_dir_close(&lfs, &d) == LFS_ERR_OK);
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+}
+
+static void run_tests(void) {
+    test_tunings();
+    test_mount_other_sizes();
+    test_freemap();
+    test_freemap_rejected();
+    test_dir_getattr();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench_report(const char *phase, uint64_t t0) {
+    printf("  %-18s %6u reads %7.1f KB  %5u progs %7.1f KB  %4u erases  flash %8.1f ms  host %6.2f ms\n",
+           phase, stats.reads, stats.read_bytes / 1024.0, stats.progs, stats.prog_bytes / 1024.0,
+           stats.erases, stats_flash_us() / 1000.0, (now_ns() - t0) / 1e6);
+}
+
+static void bench(int n) {
+    uint8_t buf[512], entry[48], image[2048];
+    char path[16];
+    uint64_t t0;
+
+    for (size_t t = 0; t < TUNINGS; t++) {
+        struct lfs_config cfg = make_config(&tunings[t]);
+        lfs_size_t size = lfs_freemap_size(&cfg);
+        lfs_freemap_t *fm = malloc(size);
+        lfs_t lfs;
+
+        printf("%s: read %u, prog %u, cache %u, lookahead %u\n", tunings[t].name,
+               cfg.read_size, cfg.prog_size, cfg.cache_size, cfg.lookahead_size);
+        lfs_format(&lfs, &cfg);
+        lfs_mount(&lfs, &cfg);
+
+        stats_reset();
+        t0 = now_ns();
+        create_files(&lfs, 0, n);
+        bench_report("create", t0);
+
+        stats_reset();
+        t0 = now_ns();
+        for (int i = 0; i < n; i++) {
+            memset(entry, 'A' + i % 26, sizeof(entry));
+            CHECK(write_file(&lfs, "/log", entry, sizeof(entry), LFS_O_APPEND) == LFS_ERR_OK);
+        }
+        bench_report("append", t0);
+
+        stats_reset();
+        t0 = now_ns();
+        for (int i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/f%03d", i);
+            CHECK(read_file(&lfs, path, buf, sizeof(buf), 64) == file_data(i, buf));
+        }
+        bench_report("read", t0);
+        CHECK(check_files(&lfs, 0, n));
+
+        // a boot, and the first write that needs a block
+        memset(image, 0x3C, sizeof(image));
+        lfs_freemap_take(&lfs, fm, 0);
+        lfs_unmount(&lfs);
+        stats_reset();
+        t0 = now_ns();
+        lfs_mount(&lfs, &cfg);
+        CHECK(write_file(&lfs, "/boot", image, sizeof(image), LFS_O_TRUNC) == LFS_ERR_OK);
+        bench_report("mount, write", t0);
+        lfs_unmount(&lfs);
+
+        lfs_mount(&lfs, &cfg);
+        lfs_freemap_take(&lfs, fm, 0);
+        lfs_unmount(&lfs);
+        stats_reset();
+        t0 = now_ns();
+        lfs_mount(&lfs, &cfg);
+        CHECK(lfs_freemap_seed(&lfs, fm, size, 0));
+        CHECK(write_file(&lfs, "/boot", image, sizeof(image), LFS_O_TRUNC) == LFS_ERR_OK);
+        bench_report("same, with map", t0);
+        lfs_unmount(&lfs);
+        free(fm);
+    }
+
+    // a directory of 10 * n small log files, listed with their timestamps
+    struct lfs_config cfg = make_config(&tunings[1]);
+    uint64_t sum_path, sum_dir;
+    lfs_t lfs;
+
+    n *= 10;
+    printf("%s: listing %d files with timestamps\n", tunings[1].name, n);
+    lfs_format(&lfs, &cfg);
+    lfs_mount(&lfs, &cfg);
+    lfs_mkdir(&lfs, "/logs");
+    create_stamped(&lfs, "/logs", n);
+
+    stats_reset();
+    t0 = now_ns();
+    CHECK(list_stamped(&lfs, "/logs", true, &sum_path) == n);
+    bench_report("by path", t0);
+
+    stats_reset();
+    t0 = now_ns();
+    CHECK(list_stamped(&lfs, "/logs", false, &sum_dir) == n);
+    bench_report("from directory", t0);
+    CHECK(sum_path == sum_dir);
+    lfs_unmount(&lfs);
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b files] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    if (count > 0) {
+        bench(count);
+    } else {
+        run_tests();
+    }
+    if (failures) {
+        printf("test_littlefs: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_littlefs: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests, stress test and benchmark of the littlefs lock, see
+ * littlefs_lock.h. Tasks are pthreads, littlefs runs on RAM that behaves like
+ * the NOR flash. For the benchmark the flash takes the time the ESP32 one
+ * would (typical datasheet figures), one operation at a time.
+ *
+ *   test_lock                      run the unit tests and the stress test
+ *   test_lock -b N [-s seed]       a logger appends to a file N times, while
+ *                                  the application reads its configuration
+ *                                  and another task reads a large file; with
+ *                                  the lock held alone for everything, as
+ *                                  before, and with the reads sharing it
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lfs.h"
+#include "lfs_util.h"
+#include "littlefs_lock.h"
+
+#define BLOCK_SIZE              4096
+#define BLOCK_COUNT             127     // /flash of the 4 MB parts
+#define PAGE_SIZE               256
+
+// ESP32 flash timings, typical, in us
+#define T_READ_OP_US            5
+#define T_READ_BYTES_PER_US     20
+#define T_PROG_PAGE_US          30
+#define T_PROG_BYTE_NS          2700
+#define T_ERASE_BLOCK_US        45000
+
+#define CONFIG_SIZE             6000    // in blocks of its own, not inlined
+#define BULK_SIZE               32768
+#define RECORD_SIZE             64
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);             \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+typedef struct {
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    int count;
+} host_sem_t;
+
+static SemaphoreHandle_t host_sem_new(int count) {
+    host_sem_t *sem = calloc(1, sizeof(*sem));
+
+    pthread_mutex_init(&sem->m, NULL);
+    pthread_cond_init(&sem->c, NULL);
+    sem->count = count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return host_sem_new(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return host_sem_new(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    host_sem_t *sem = handle;
+
+    pthread_mutex_lock(&sem->m);
+    while (sem->count == 0) {
+        pthread_cond_wait(&sem->c, &sem->m);
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->m);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    host_sem_t *sem = handle;
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&sem->m);
+    if (sem->count == 0) {
+        sem->count = 1;
+        given = pdTRUE;
+        pthread_cond_signal(&sem->c);
+    }
+    pthread_mutex_unlock(&sem->m);
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle) {
+    host_sem_t *sem = handle;
+
+    pthread_mutex_destroy(&sem->m);
+    pthread_cond_destroy(&sem->c);
+    free(sem);
+}
+
+static void lock_delete(littlefs_lock_t *lock) {
+    vSemaphoreDelete(lock->mutex);
+    vSemaphoreDelete(lock->idle);
+    vSemaphoreDelete(lock->count);
+}
+
+// the flash, one operation at a time; it takes the time of the ESP32 one when timed
+static uint8_t flash[BLOCK_COUNT * BLOCK_SIZE];
+static pthread_mutex_t flash_bus = PTHREAD_MUTEX_INITIALIZER;
+static bool flash_timed;
+static uint64_t flash_read_us;          // on top, for the stress test to have reads overlap
+static int flash_reading, flash_reading_max;
+
+static void flash_busy(uint64_t us) {
+    if (flash_timed) {
+        sleep_us(us);
+    }
+}
+
+static int bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    int reading = __atomic_add_fetch(&flash_reading, 1, __ATOMIC_RELAXED);
+    if (reading > __atomic_load_n(&flash_reading_max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&flash_reading_max, reading, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&flash_bus);
+    memcpy(buffer, flash + block * c->block_size + off, size);
+    flash_busy(T_READ_OP_US + size / T_READ_BYTES_PER_US);
+    pthread_mutex_unlock(&flash_bus);
+    if (flash_read_us) {
+        sleep_us(flash_read_us);
+    }
+    __atomic_sub_fetch(&flash_reading, 1, __ATOMIC_RELAXED);
+    return LFS_ERR_OK;
+}
+
+static int bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+    const uint8_t *data = buffer;
+    uint8_t *p = flash + block * c->block_size + off;
+
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    pthread_mutex_lock(&flash_bus);
+    for (lfs_size_t i = 0; i < size; i++) {
+        p[i] &= data[i];
+    }
+    flash_busy(((off + size - 1) / PAGE_SIZE - off / PAGE_SIZE + 1) * T_PROG_PAGE_US +
+               (uint64_t)size * T_PROG_BYTE_NS / 1000);
+    pthread_mutex_unlock(&flash_bus);
+    return LFS_ERR_OK;
+}
+
+static int bd_erase(const struct lfs_config *c, lfs_block_t block) {
+    if (block >= c->block_count) {
+        return LFS_ERR_IO;
+    }
+    pthread_mutex_lock(&flash_bus);
+    memset(flash + block * c->block_size, 0xFF, c->block_size);
+    flash_busy(T_ERASE_BLOCK_US);
+    pthread_mutex_unlock(&flash_bus);
+    return LFS_ERR_OK;
+}
+
+static int bd_sync(const struct lfs_config *c) {
+    return LFS_ERR_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+// the sizes /flash has by default, see littlefs_init_config()
+static const struct lfs_config cfg = {
+    .read = bd_read,
+    .prog = bd_prog,
+    .erase = bd_erase,
+    .sync = bd_sync,
+    .read_size = 256,
+    .prog_size = BLOCK_SIZE,
+    .block_size = BLOCK_SIZE,
+    .block_count = BLOCK_COUNT,
+    .cache_size = BLOCK_SIZE,
+    .lookahead_size = 16,
+};
+
+static lfs_t lfs;
+static littlefs_lock_t lock;
+static bool stop;
+
+static uint8_t pattern(int file, lfs_size_t pos) {
+    return (uint8_t)(file * 53 + pos * 11 + (pos >> 8));
+}
+
+static void make_file(const char *path, int file, lfs_size_t len) {
+    uint8_t buf[256];
+    lfs_file_t fp;
+
+    CHECK(lfs_file_open(&lfs, &fp, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) == LFS_ERR_OK);
+    for (lfs_size_t pos = 0; pos < len; pos += sizeof(buf)) {
+        lfs_size_t n = lfs_min(sizeof(buf), len - pos);
+        for (lfs_size_t k = 0; k < n; k++) {
+            buf[k] = pattern(file, pos + k);
+        }
+        CHECK(lfs_file_write(&lfs, &fp, buf, n) == (lfs_ssize_t)n);
+    }
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+}
+
+static void setup_fs(void) {
+    CHECK(lfs_format(&lfs, &cfg) == LFS_ERR_OK);
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    make_file("/config", 1, CONFIG_SIZE);
+    make_file("/small", 2, 100);    // inlined in the directory
+    make_file("/bulk", 3, BULK_SIZE);
+    littlefs_lock_init(&lock);
+}
+
+static void teardown_fs(void) {
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+    lock_delete(&lock);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TASKS ---------------------------------------------------------------- */
+
+typedef struct {
+    pthread_t thread;
+    const char *path;
+    int file;
+    lfs_size_t len;
+    lfs_size_t chunk;           // 0 for random sizes
+    bool shared;                // littlefs_file_read(), or the lock held alone
+    unsigned seed;
+    uint64_t reads;
+    uint64_t bytes;
+    uint64_t *latency_ns;       // of each read, if not NULL
+    size_t latency_max;
+} reader_t;
+
+static lfs_ssize_t read_locked(reader_t *r, lfs_file_t *fp, void *buf, lfs_size_t size) {
+    if (r->shared) {
+        return littlefs_file_read(&lfs, &lock, fp, buf, size);
+    }
+    littlefs_lock(&lock);
+    lfs_ssize_t n = lfs_file_read(&lfs, fp, buf, size);
+    littlefs_unlock(&lock);
+    return n;
+}
+
+// reads the file over and over, checking what it reads
+static void *reader_task(void *arg) {
+    reader_t *r = arg;
+    uint8_t buf[4096];
+    lfs_file_t fp;
+    lfs_size_t pos = 0;
+
+    littlefs_lock(&lock);
+    CHECK(lfs_file_open(&lfs, &fp, r->path, LFS_O_RDONLY) == LFS_ERR_OK);
+    littlefs_unlock(&lock);
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        lfs_size_t want = r->chunk ? r->chunk : 1 + rand_r(&r->seed) % sizeof(buf);
+        uint64_t t0 = now_ns();
+        lfs_ssize_t n = read_locked(r, &fp, buf, want);
+        if (r->latency_ns != NULL && r->reads < r->latency_max) {
+            r->latency_ns[r->reads] = now_ns() - t0;
+        }
+        r->reads++;
+
+        if (n < 0) {
+            CHECK(n >= 0);
+            break;
+        }
+        for (lfs_ssize_t k = 0; k < n; k++) {
+            if (buf[k] != pattern(r->file, pos + k)) {
+                CHECK(buf[k] == pattern(r->file, pos + k));
+                __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        r->bytes += n;
+        pos += n;
+        if (n == 0 || pos == r->len) {
+            littlefs_lock(&lock);
+            CHECK(lfs_file_seek(&lfs, &fp, 0, LFS_SEEK_SET) == 0);
+            littlefs_unlock(&lock);
+            pos = 0;
+        }
+    }
+
+    littlefs_lock(&lock);
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+    littlefs_unlock(&lock);
+    return NULL;
+}
+
+typedef struct {
+    pthread_t thread;
+    int records;
+    uint64_t period_us;
+    bool churn;                 // and creates and removes files
+    uint64_t elapsed_ns;
+} logger_t;
+
+static void *logger_task(void *arg) {
+    logger_t *l = arg;
+    uint8_t record[RECORD_SIZE];
+    char path[16];
+    lfs_file_t fp;
+    uint64_t t0 = now_ns();
+
+    for (int i = 0; i < l->records && !__atomic_load_n(&stop, __ATOMIC_RELAXED); i++) {
+        memset(record, 'A' + i % 26, sizeof(record));
+        littlefs_lock(&lock);
+        CHECK(lfs_file_open(&lfs, &fp, "/log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) == LFS_ERR_OK);
+        CHECK(lfs_file_write(&lfs, &fp, record, sizeof(record)) == sizeof(record));
+        CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+        littlefs_unlock(&lock);
+
+        if (l->churn) {
+            snprintf(path, sizeof(path), "/tmp%d", i % 4);
+            littlefs_lock(&lock);
+            if (i % 8 < 4) {
+                make_file(path, 10 + i % 4, 1000 + 700 * (i % 4));
+            } else {
+                CHECK(lfs_remove(&lfs, path) == LFS_ERR_OK);
+            }
+            littlefs_unlock(&lock);
+        }
+        if (l->period_us) {
+            sleep_us(l->period_us);
+        }
+    }
+    l->elapsed_ns = now_ns() - t0;
+    return NULL;
+}
+
+static void check_log(int records) {
+    uint8_t record[RECORD_SIZE];
+    lfs_file_t fp;
+    int i = 0;
+
+    CHECK(lfs_file_open(&lfs, &fp, "/log", LFS_O_RDONLY) == LFS_ERR_OK);
+    while (lfs_file_read(&lfs, &fp, record, sizeof(record)) == sizeof(record)) {
+        CHECK(record[0] == 'A' + i % 26 && record[RECORD_SIZE - 1] == 'A' + i % 26);
+        i++;
+    }
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+    CHECK(i == records);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static littlefs_lock_t plain;
+static int inside_readers, inside_writers, readers_max, violations;
+
+static void *plain_reader(void *arg) {
+    for (int i = 0; i < 300 && !__atomic_load_n(&stop, __ATOMIC_RELAXED); i++) {
+        littlefs_lock_shared(&plain);
+        int n = __atomic_add_fetch(&inside_readers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&inside_writers, __ATOMIC_SEQ_CST) != 0) {
+            __atomic_add_fetch(&violations, 1, __ATOMIC_SEQ_CST);
+        }
+        if (n > __atomic_load_n(&readers_max, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&readers_max, n, __ATOMIC_SEQ_CST);
+        }
+        sleep_us(100);
+        __atomic_sub_fetch(&inside_readers, 1, __ATOMIC_SEQ_CST);
+        littlefs_unlock_shared(&plain);
+    }
+    return NULL;
+}
+
+static void *plain_writer(void *arg) {
+    int *done = arg;
+
+    for (int i = 0; i < 100; i++) {
+        littlefs_lock(&plain);
+        if (__atomic_add_fetch(&inside_writers, 1, __ATOMIC_SEQ_CST) != 1 ||
+            __atomic_load_n(&inside_readers, __ATOMIC_SEQ_CST) != 0) {
+            __atomic_add_fetch(&violations, 1, __ATOMIC_SEQ_CST);
+        }
+        sleep_us(50);
+        __atomic_sub_fetch(&inside_writers, 1, __ATOMIC_SEQ_CST);
+        littlefs_unlock(&plain);
+        sleep_us(200);
+    }
+    __atomic_store_n(done, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+// readers run together, never with a writer, and a writer gets in though they
+// keep coming back
+static void test_lock_exclusion(void) {
+    pthread_t readers[4], writers[2];
+    int done[2] = { 0, 0 };
+
+    littlefs_lock_init(&plain);
+    __atomic_store_n(&stop, false, __ATOMIC_RELAXED);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&readers[i], NULL, plain_reader, NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&writers[i], NULL, plain_writer, &done[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    CHECK(done[0] && done[1]);
+    CHECK(violations == 0);
+    CHECK(readers_max > 1);
+    CHECK(plain.readers == 0);
+
+    // and it's free again
+    littlefs_lock(&plain);
+    littlefs_unlock(&plain);
+    lock_delete(&plain);
+}
+
+typedef struct {
+    lfs_file_t *fp;
+    uint8_t buf[64];
+    lfs_ssize_t n;
+    int done;
+} pending_read_t;
+
+static void *pending_read(void *arg) {
+    pending_read_t *p = arg;
+
+    p->n = littlefs_file_read(&lfs, &lock, p->fp, p->buf, sizeof(p->buf));
+    __atomic_store_n(&p->done, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+// true if reading fp, at pos, waits for a reader to leave, that is if it holds the lock alone
+static bool read_waits_for_reader(lfs_file_t *fp, int file, lfs_size_t pos) {
+    pending_read_t p = { .fp = fp };
+    pthread_t thread;
+
+    littlefs_lock_shared(&lock);
+    pthread_create(&thread, NULL, pending_read, &p);
+    sleep_us(20000);
+    bool waited = !__atomic_load_n(&p.done, __ATOMIC_SEQ_CST);
+    littlefs_unlock_shared(&lock);
+    pthread_join(thread, NULL);
+    CHECK(p.n == sizeof(p.buf) && p.buf[10] == pattern(file, pos + 10));
+    return waited;
+}
+
+// which reads share the lock
+static void test_file_read_shares(void) {
+    uint8_t buf[64];
+    lfs_file_t fp;
+
+    setup_fs();
+
+    // the inlined file is read through the caches of lfs_t
+    CHECK(lfs_file_open(&lfs, &fp, "/small", LFS_O_RDONLY) == LFS_ERR_OK);
+    CHECK(read_waits_for_reader(&fp, 2, 0));
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+
+    // one in blocks of its own only through its own
+    CHECK(lfs_file_open(&lfs, &fp, "/config", LFS_O_RDONLY) == LFS_ERR_OK);
+    CHECK(!read_waits_for_reader(&fp, 1, 0));
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+
+    // data not written yet is flushed first
+    CHECK(lfs_file_open(&lfs, &fp, "/config", LFS_O_RDWR) == LFS_ERR_OK);
+    for (int k = 0; k < sizeof(buf); k++) {
+        buf[k] = pattern(1, k);
+    }
+    CHECK(lfs_file_write(&lfs, &fp, buf, sizeof(buf)) == sizeof(buf));
+    CHECK(fp.flags & LFS_F_WRITING);
+    CHECK(read_waits_for_reader(&fp, 1, sizeof(buf)));
+    CHECK(!(fp.flags & LFS_F_WRITING));
+    CHECK(lfs_file_close(&lfs, &fp) == LFS_ERR_OK);
+    CHECK(lock.readers == 0);
+
+    teardown_fs();
+}
+
+// readers of files of their own and an inlined one, while a logger appends and
+// files come and go; everything read and written is checked
+static void test_stress(void) {
+    reader_t readers[4] = {
+        { .path = "/config", .file = 1, .len = CONFIG_SIZE },
+        { .path = "/config", .file = 1, .len = CONFIG_SIZE },
+        { .path = "/bulk", .file = 3, .len = BULK_SIZE },
+        { .path = "/small", .file = 2, .len = 100 },
+    };
+    logger_t logger = { .records = 300, .churn = true };
+
+    setup_fs();
+    __atomic_store_n(&stop, false, __ATOMIC_RELAXED);
+    flash_reading_max = 0;
+    flash_read_us = 20;
+    for (int i = 0; i < 4; i++) {
+        readers[i].shared = true;
+        readers[i].seed = i + 1;
+        pthread_create(&readers[i].thread, NULL, reader_task, &readers[i]);
+    }
+    pthread_create(&logger.thread, NULL, logger_task, &logger);
+    pthread_join(logger.thread, NULL);
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(readers[i].thread, NULL);
+        CHECK(readers[i].reads > 0);
+    }
+    flash_read_us = 0;
+    CHECK(flash_reading_max > 1);
+    CHECK(lock.readers == 0);
+    check_log(logger.records);
+    teardown_fs();
+}
+
+static void run_tests(void) {
+    test_lock_exclusion();
+    test_file_read_shares();
+    test_stress();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench(int records) {
+    static const struct {
+        const char *name;
+        bool shared;
+    } modes[] = {
+        { "lock held alone", false },
+        { "shared reads", true },
+    };
+    size_t latency_max = 1 << 20;
+
+    flash_timed = true;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        reader_t app = { .path = "/config", .file = 1, .len = CONFIG_SIZE, .chunk = 128 };
+        reader_t bulk = { .path = "/bulk", .file = 3, .len = BULK_SIZE, .chunk = 4096 };
+        logger_t logger = { .records = records, .period_us = 20000 };
+
+        flash_timed = false;
+        setup_fs();
+        flash_timed = true;
+        __atomic_store_n(&stop, false, __ATOMIC_RELAXED);
+        app.shared = bulk.shared = modes[m].shared;
+        app.latency_ns = malloc(latency_max * sizeof(uint64_t));
+        app.latency_max = latency_max;
+
+        pthread_create(&app.thread, NULL, reader_task, &app);
+        pthread_create(&bulk.thread, NULL, reader_task, &bulk);
+        pthread_create(&logger.thread, NULL, logger_task, &logger);
+        pthread_join(logger.thread, NULL);
+        __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+        pthread_join(app.thread, NULL);
+        pthread_join(bulk.thread, NULL);
+
+        size_t n = app.reads < latency_max ? app.reads : latency_max;
+        qsort(app.latency_ns, n, sizeof(uint64_t), cmp_u64);
+        double secs = logger.elapsed_ns / 1e9;
+        printf("%-16s %d appends in %.2f s, config reads %8.0f/s: p50 %6.1f us  p99 %7.1f us  max %7.1f ms,"
+               " bulk %6.0f KB/s\n",
+               modes[m].name, records, secs, app.reads / secs, app.latency_ns[n / 2] / 1e3,
+               app.latency_ns[n * 99 / 100] / 1e3, app.latency_ns[n - 1] / 1e6, bulk.bytes / 1024.0 / secs);
+        free(app.latency_ns);
+
+        flash_timed = false;
+        check_log(records);
+        teardown_fs();
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b appends] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    if (count > 0) {
+        bench(count);
+    } else {
+        run_tests();
+    }
+    if (failures) {
+        printf("test_lock: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_lock: all tests passed\n");
+    return 0;
+}
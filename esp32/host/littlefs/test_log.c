@@ -0,0 +1,701 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the log files, see extmod/vfs_log.h, written
+ * to littlefs on the same RAM block device as test_littlefs, which counts
+ * the operations and models their time on the ESP32 flash.
+ *
+ *   test_log                   run the unit tests
+ *   test_log -b N [-s seed]    append N sensor records of 24 to 40 bytes:
+ *                              opening and closing the file for each one,
+ *                              keeping it open and flushing each one, and
+ *                              as a log with a 512 byte and a 4 KB buffer.
+ *                              With the default sizes and 256 B programs
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfs.h"
+#include "lfs_util.h"
+#include "extmod/vfs_log.h"
+
+#define BLOCK_SIZE              4096
+#define BLOCK_COUNT             127     // /flash of the 4 MB parts
+#define PAGE_SIZE               256
+
+// ESP32 flash timings, typical, in us
+#define T_READ_OP_US            5
+#define T_READ_BYTES_PER_US     20
+#define T_PROG_PAGE_US          30
+#define T_PROG_BYTE_NS          2700
+#define T_ERASE_BLOCK_US        45000
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+static uint8_t flash[BLOCK_COUNT * BLOCK_SIZE];
+static uint8_t snapshot[BLOCK_COUNT * BLOCK_SIZE];
+static uint32_t snapshot_at;    // the flash as it was before this program
+
+static struct {
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t progs;
+    uint64_t prog_bytes;
+    uint32_t prog_pages;
+    uint32_t erases;
+} stats;
+
+static int bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    memcpy(buffer, flash + block * c->block_size + off, size);
+    stats.reads++;
+    stats.read_bytes += size;
+    return LFS_ERR_OK;
+}
+
+static int bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+    const uint8_t *data = buffer;
+    uint8_t *p = flash + block * c->block_size + off;
+
+    if (block >= c->block_count || off + size > c->block_size) {
+        return LFS_ERR_IO;
+    }
+    stats.progs++;
+    if (stats.progs == snapshot_at) {
+        memcpy(snapshot, flash, sizeof(flash));
+    }
+    for (lfs_size_t i = 0; i < size; i++) {
+        p[i] &= data[i];
+    }
+    stats.prog_bytes += size;
+    stats.prog_pages += (off + size - 1) / PAGE_SIZE - off / PAGE_SIZE + 1;
+    return LFS_ERR_OK;
+}
+
+static int bd_erase(const struct lfs_config *c, lfs_block_t block) {
+    if (block >= c->block_count) {
+        return LFS_ERR_IO;
+    }
+    memset(flash + block * c->block_size, 0xFF, c->block_size);
+    stats.erases++;
+    return LFS_ERR_OK;
+}
+
+static int bd_sync(const struct lfs_config *c) {
+    return LFS_ERR_OK;
+}
+
+// the file object of vfs_littlefs_file.c, without the lock
+typedef struct {
+    lfs_t *lfs;
+    lfs_file_t fp;
+} log_file_t;
+
+static int lfs_log_write(void *ctx, const void *buf, size_t len, size_t *written) {
+    log_file_t *f = ctx;
+    lfs_ssize_t n = lfs_file_write(f->lfs, &f->fp, buf, len);
+
+    if (n < 0) {
+        *written = 0;
+        return EIO;
+    }
+    *written = n;
+    return (n == len) ? 0 : ENOSPC;
+}
+
+static int lfs_log_sync(void *ctx) {
+    log_file_t *f = ctx;
+
+    return lfs_file_sync(f->lfs, &f->fp) < 0 ? EIO : 0;
+}
+
+static const vfs_log_io_t lfs_log_io = {
+    .write = lfs_log_write,
+    .sync = lfs_log_sync,
+};
+
+// a file in RAM, that can be made to fail
+static struct {
+    uint8_t data[65536 * 3];
+    size_t len;
+    uint32_t writes;
+    uint32_t syncs;
+    size_t limit;       // full after that many bytes, if not 0
+    int error;
+    int sync_error;
+} ram;
+
+static int ram_write(void *ctx, const void *buf, size_t len, size_t *written) {
+    *written = 0;
+    if (ram.error) {
+        return ram.error;
+    }
+    if (ram.limit != 0 && ram.len + len > ram.limit) {
+        len = ram.limit - ram.len;
+    }
+    memcpy(ram.data + ram.len, buf, len);
+    ram.len += len;
+    ram.writes++;
+    *written = len;
+    return (ram.limit != 0 && ram.len == ram.limit) ? ENOSPC : 0;
+}
+
+static int ram_sync(void *ctx) {
+    ram.syncs++;
+    return ram.sync_error;
+}
+
+static const vfs_log_io_t ram_io = {
+    .write = ram_write,
+    .sync = ram_sync,
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- HELPERS -------------------------------------------------------------- */
+
+static struct lfs_config make_config(lfs_size_t read_size, lfs_size_t prog_size, lfs_size_t cache_size) {
+    struct lfs_config cfg = {
+        .read = bd_read,
+        .prog = bd_prog,
+        .erase = bd_erase,
+        .sync = bd_sync,
+        .read_size = read_size,
+        .prog_size = prog_size,
+        .block_size = BLOCK_SIZE,
+        .block_count = BLOCK_COUNT,
+        .block_cycles = 0,
+        .cache_size = cache_size,
+        .lookahead_size = 16,
+    };
+    return cfg;
+}
+
+static void stats_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+static uint64_t stats_flash_us(void) {
+    return (uint64_t)stats.reads * T_READ_OP_US + stats.read_bytes / T_READ_BYTES_PER_US +
+           (uint64_t)stats.prog_pages * T_PROG_PAGE_US + stats.prog_bytes * T_PROG_BYTE_NS / 1000 +
+           (uint64_t)stats.erases * T_ERASE_BLOCK_US;
+}
+
+// record i, a sensor sample of 24 to 40 bytes
+static size_t record_data(int i, uint8_t *buf) {
+    size_t len = 24 + (i * 7) % 17;
+
+    for (size_t k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i * 13 + k);
+    }
+    return len;
+}
+
+// the records in p, the way uos.logrecords() finds them: calls found() with
+// the number and the data of each, returns how many there were
+static int scan(const uint8_t *p, size_t len, bool (*found)(int n, const uint8_t *data, size_t len)) {
+    size_t start = 0;
+    int n = 0;
+
+    while (start < len) {
+        int32_t r = vfs_log_parse(p + start, len - start);
+        if (r > 0) {
+            if (found != NULL && !found(n, p + start + VFS_LOG_HEADER_SIZE, r - VFS_LOG_HEADER_SIZE)) {
+                return -1;
+            }
+            n++;
+            start += r;
+        } else {
+            // not a record, or cut short at the end
+            start++;
+        }
+    }
+    return n;
+}
+
+static bool found_in_order(int n, const uint8_t *data, size_t len) {
+    uint8_t expected[64];
+
+    return record_data(n, expected) == len && memcmp(data, expected, len) == 0;
+}
+
+static void ram_reset(void) {
+    memset(&ram, 0, sizeof(ram));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_framing(void) {
+    static uint8_t rec[VFS_LOG_HEADER_SIZE + VFS_LOG_RECORD_MAX];
+    const size_t lens[] = { 0, 1, 37, 4096, VFS_LOG_RECORD_MAX };
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        size_t len = lens[i];
+        for (size_t k = 0; k < len; k++) {
+            rec[VFS_LOG_HEADER_SIZE + k] = (uint8_t)(k * 3 + i);
+        }
+        vfs_log_header(rec, rec + VFS_LOG_HEADER_SIZE, len);
+        CHECK(rec[0] == VFS_LOG_SYNC);
+        CHECK(vfs_log_parse(rec, VFS_LOG_HEADER_SIZE + len) == VFS_LOG_HEADER_SIZE + len);
+        CHECK(vfs_log_parse(rec, VFS_LOG_HEADER_SIZE + len + 10) == VFS_LOG_HEADER_SIZE + len);
+
+        // more is needed to tell
+        CHECK(vfs_log_parse(rec, 0) == 0);
+        CHECK(vfs_log_parse(rec, 3) == 0);
+        CHECK(vfs_log_parse(rec, VFS_LOG_HEADER_SIZE + len - 1) == 0);
+
+        // a bit flipped, anywhere
+        size_t bits = (VFS_LOG_HEADER_SIZE + len) * 8;
+        for (size_t bit = 0; bit < bits; bit += (bit < 64) ? 1 : bits / 256 + 7) {
+            rec[bit / 8] ^= 1 << (bit % 8);
+            CHECK(vfs_log_parse(rec, sizeof(rec)) == -1);
+            rec[bit / 8] ^= 1 << (bit % 8);
+        }
+    }
+}
+
+// garbage between records, and a record cut short, are skipped
+static void test_resync(void) {
+    uint8_t stream[1024], data[64];
+    size_t len = 0;
+
+    for (int i = 0; i < 6; i++) {
+        size_t n = record_data(i, data);
+        vfs_log_header(stream + len, data, n);
+        memcpy(stream + len + VFS_LOG_HEADER_SIZE, data, n);
+        if (i == 2) {
+            // torn by a reset: only the header and a part made it
+            memcpy(stream + len + VFS_LOG_HEADER_SIZE + n / 2, "\xA5\x10\x00\xA5\xff", 5);
+            len += VFS_LOG_HEADER_SIZE + n / 2 + 5;
+            continue;
+        }
+        len += VFS_LOG_HEADER_SIZE + n;
+        if (i == 3) {
+            memset(stream + len, VFS_LOG_SYNC, 9);
+            len += 9;
+        }
+    }
+
+    uint8_t seen[6] = { 0 };
+    int n = 0;
+    size_t start = 0;
+    while (start < len) {
+        int32_t r = vfs_log_parse(stream + start, len - start);
+        if (r > 0) {
+            size_t dlen = r - VFS_LOG_HEADER_SIZE;
+            for (int i = 0; i < 6; i++) {
+                size_t elen = record_data(i, data);
+                if (elen == dlen && memcmp(stream + start + VFS_LOG_HEADER_SIZE, data, elen) == 0) {
+                    seen[i]++;
+                }
+            }
+            n++;
+            start += r;
+        } else {
+            start++;
+        }
+    }
+    CHECK(n == 5);
+    CHECK(seen[0] && seen[1] && !seen[2] && seen[3] && seen[4] && seen[5]);
+
+    // cut short at the end
+    CHECK(scan(stream, len - 1, NULL) == 4);
+}
+
+static void test_group_commit(void) {
+    uint8_t buf[128], data[64];
+    vfs_log_t log;
+
+    // on size: 8 records of 11 bytes fill the buffer
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    memset(data, 'x', sizeof(data));
+    for (int i = 0; i < 7; i++) {
+        CHECK(vfs_log_append(&log, data, 11, 0) == 0);
+    }
+    CHECK(ram.writes == 0 && log.len == 7 * 16);
+    CHECK(vfs_log_append(&log, data, 11, 0) == 0);
+    CHECK(ram.writes == 1 && ram.syncs == 1 && ram.len == 8 * 16 && log.len == 0);
+
+    // one that doesn't fit writes the others out first
+    ram_reset();
+    CHECK(vfs_log_append(&log, data, 60, 0) == 0);
+    CHECK(vfs_log_append(&log, data, 60, 0) == 0);
+    CHECK(ram.writes == 1 && log.len == 65);
+
+    // on time, at the next write
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    CHECK(vfs_log_append(&log, data, 10, 5000) == 0);
+    CHECK(vfs_log_append(&log, data, 10, 5999) == 0);
+    CHECK(ram.writes == 0);
+    CHECK(vfs_log_append(&log, data, 10, 6000) == 0);
+    CHECK(ram.writes == 1 && ram.len == 3 * 15);
+    CHECK(vfs_log_append(&log, data, 10, 6001) == 0);
+    CHECK(ram.writes == 1 && log.oldest_ms == 6001);
+
+    // ticks wrapping around
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(vfs_log_append(&log, data, 10, 0xffffff00) == 0);
+    CHECK(vfs_log_append(&log, data, 10, 0x100) == 0);
+    CHECK(ram.writes == 2 && ram.syncs == 2);
+    CHECK(vfs_log_append(&log, data, 10, 0x3e8) == 0);
+    CHECK(ram.writes == 3);
+
+    // flush with nothing buffered
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(ram.writes == 3 && ram.syncs == 3);
+
+    CHECK(scan(ram.data, ram.len, NULL) == 3 + 1 + 3);
+}
+
+static void test_oversize(void) {
+    static uint8_t data[VFS_LOG_RECORD_MAX];
+    uint8_t buf[128];
+    vfs_log_t log;
+
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    memset(data, 0x42, sizeof(data));
+    CHECK(vfs_log_append(&log, data, 10, 0) == 0);
+    CHECK(vfs_log_append(&log, data, 200, 0) == 0);
+    // the one buffered, then the header and the data
+    CHECK(ram.writes == 3 && ram.syncs == 2 && log.len == 0);
+    CHECK(vfs_log_append(&log, data, sizeof(data), 0) == 0);
+    CHECK(ram.len == 15 + 205 + VFS_LOG_HEADER_SIZE + sizeof(data));
+    CHECK(scan(ram.data, ram.len, NULL) == 3);
+
+    // torn: the error is returned, the readers skip what went to the file
+    ram_reset();
+    CHECK(vfs_log_append(&log, data, 10, 0) == 0);
+    ram.limit = 15 + VFS_LOG_HEADER_SIZE + 100;
+    CHECK(vfs_log_append(&log, data, 200, 0) == ENOSPC);
+    CHECK(ram.len == ram.limit && log.len == 0);
+    ram.limit = 0;
+    CHECK(vfs_log_append(&log, data, 200, 0) == 0);
+    CHECK(scan(ram.data, ram.len, NULL) == 2);
+
+    // whole, but the commit failed: returned too, and done again on flush
+    ram_reset();
+    ram.sync_error = EIO;
+    CHECK(vfs_log_append(&log, data, 200, 0) == EIO);
+    CHECK(ram.len == 205 && log.unsynced);
+    ram.sync_error = 0;
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(!log.unsynced && ram.syncs == 2);
+}
+
+// a record that can't be written out isn't taken, the ones before it are kept
+static void test_write_fails(void) {
+    uint8_t buf[128], data[64];
+    vfs_log_t log;
+    int i;
+
+    // failing when it's time to write out
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    CHECK(vfs_log_append(&log, data, record_data(0, data), 0) == 0);
+    ram.error = EIO;
+    CHECK(vfs_log_append(&log, data, record_data(1, data), 1000) == EIO);
+    CHECK(log.len == VFS_LOG_HEADER_SIZE + record_data(0, data));
+
+    // failing to make room
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    for (i = 0; i < 3; i++) {
+        CHECK(vfs_log_append(&log, data, record_data(i, data), 0) == 0);
+    }
+    size_t before = log.len;
+    ram.error = ENOSPC;
+    CHECK(vfs_log_append(&log, data, record_data(i, data), 1000) == ENOSPC);
+    CHECK(log.len == before && ram.writes == 0);
+    CHECK(vfs_log_flush(&log) == ENOSPC);
+    CHECK(log.len == before);
+
+    // written again, in order
+    ram.error = 0;
+    CHECK(vfs_log_append(&log, data, record_data(i, data), 1000) == 0);
+    CHECK(ram.writes == 1 && log.len == VFS_LOG_HEADER_SIZE + record_data(i, data));
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(scan(ram.data, ram.len, found_in_order) == 4);
+}
+
+// written in part, the rest goes on from there and nothing is logged twice
+static void test_write_partial(void) {
+    uint8_t buf[128], data[64];
+    vfs_log_t log;
+    int i;
+
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    for (i = 0; i < 3; i++) {
+        CHECK(vfs_log_append(&log, data, record_data(i, data), 0) == 0);
+    }
+    size_t before = log.len;
+    ram.limit = 20;
+    CHECK(vfs_log_append(&log, data, record_data(i, data), 1000) == ENOSPC);
+    CHECK(ram.len == 20 && log.written == 20 && log.len == before);
+    CHECK(vfs_log_flush(&log) == ENOSPC);
+    CHECK(ram.len == 20 && log.written == 20);
+
+    ram.limit = 0;
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(log.len == 0 && log.written == 0 && ram.len == before);
+    CHECK(vfs_log_append(&log, data, record_data(i, data), 1000) == 0);
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(scan(ram.data, ram.len, found_in_order) == 4);
+
+    // the record itself torn: taken, as part of it is in the file
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    CHECK(vfs_log_append(&log, data, record_data(0, data), 0) == 0);
+    ram.limit = log.len + 2;
+    CHECK(vfs_log_append(&log, data, record_data(1, data), 1000) == 0);
+    ram.limit = 0;
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(scan(ram.data, ram.len, found_in_order) == 2);
+}
+
+// written, but the commit failed: not written again, the commit is
+static void test_sync_fails(void) {
+    uint8_t buf[128], data[64];
+    vfs_log_t log;
+
+    ram_reset();
+    vfs_log_init(&log, buf, sizeof(buf), 1000, &ram_io, NULL);
+    CHECK(vfs_log_append(&log, data, record_data(0, data), 0) == 0);
+    ram.sync_error = EIO;
+    CHECK(vfs_log_append(&log, data, record_data(1, data), 1000) == 0);
+    CHECK(ram.writes == 1 && ram.syncs == 1 && log.len == 0 && log.unsynced);
+    CHECK(vfs_log_flush(&log) == EIO);
+    CHECK(ram.writes == 1 && ram.syncs == 2);
+
+    ram.sync_error = 0;
+    CHECK(vfs_log_append(&log, data, record_data(2, data), 1000) == 0);
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(!log.unsynced && ram.writes == 2 && ram.syncs == 3);
+    CHECK(vfs_log_flush(&log) == 0);
+    CHECK(ram.syncs == 3);
+    CHECK(scan(ram.data, ram.len, found_in_order) == 3);
+}
+
+// cut the power at every program of a log being written: the file found
+// after has the records of the last commit, in order, and none torn
+static void test_power_cut(void) {
+    struct lfs_config cfg = make_config(256, 256, 1024);
+    uint8_t buf[512], data[64];
+    static uint8_t content[32768];
+    lfs_t lfs;
+    uint32_t progs;
+    int records = 100;
+
+    static uint8_t before[sizeof(flash)];
+
+    lfs_format(&lfs, &cfg);
+    CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+    memcpy(before, flash, sizeof(flash));
+    stats_reset();
+    {
+        log_file_t f = { .lfs = &lfs };
+        vfs_log_t log;
+        CHECK(lfs_file_open(&lfs, &f.fp, "/log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) == LFS_ERR_OK);
+        vfs_log_init(&log, buf, sizeof(buf), 1000, &lfs_log_io, &f);
+        for (int i = 0; i < records; i++) {
+            CHECK(vfs_log_append(&log, data, record_data(i, data), i * 50) == 0);
+        }
+        CHECK(vfs_log_flush(&log) == 0);
+        CHECK(lfs_file_close(&lfs, &f.fp) == LFS_ERR_OK);
+    }
+    progs = stats.progs;
+    CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+
+    int last = -1;
+    for (uint32_t cut = 1; cut <= progs; cut++) {
+        memcpy(flash, before, sizeof(flash));
+        CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+        stats_reset();
+        snapshot_at = cut;
+        log_file_t f = { .lfs = &lfs };
+        vfs_log_t log;
+        lfs_file_open(&lfs, &f.fp, "/log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+        vfs_log_init(&log, buf, sizeof(buf), 1000, &lfs_log_io, &f);
+        for (int i = 0; i < records; i++) {
+            vfs_log_append(&log, data, record_data(i, data), i * 50);
+        }
+        vfs_log_flush(&log);
+        lfs_file_close(&lfs, &f.fp);
+        lfs_unmount(&lfs);
+        snapshot_at = 0;
+
+        memcpy(flash, snapshot, sizeof(flash));
+        CHECK(lfs_mount(&lfs, &cfg) == LFS_ERR_OK);
+        lfs_file_t fp;
+        lfs_ssize_t len = 0;
+        if (lfs_file_open(&lfs, &fp, "/log", LFS_O_RDONLY) == LFS_ERR_OK) {
+            len = lfs_file_read(&lfs, &fp, content, sizeof(content));
+            lfs_file_close(&lfs, &fp);
+        }
+        CHECK(len >= 0);
+        int n = scan(content, len, found_in_order);
+        CHECK(n >= last);
+        last = n;
+        CHECK(lfs_unmount(&lfs) == LFS_ERR_OK);
+    }
+    CHECK(last > 0 && last <= records);
+}
+
+static void run_tests(void) {
+    test_framing();
+    test_resync();
+    test_group_commit();
+    test_oversize();
+    test_write_fails();
+    test_write_partial();
+    test_sync_fails();
+    test_power_cut();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+typedef enum {
+    EACH_OPEN,          // open, append, close
+    EACH_FLUSH,         // kept open, write and flush
+    LOG,                // a log file
+} bench_mode_t;
+
+static void bench_run(struct lfs_config *cfg, const char *name, bench_mode_t mode, size_t buffering, int n) {
+    static uint8_t buf[4096];
+    uint8_t data[64];
+    uint64_t payload = 0;
+    lfs_t lfs;
+    log_file_t f = { .lfs = &lfs };
+    vfs_log_t log;
+
+    lfs_format(&lfs, cfg);
+    lfs_mount(&lfs, cfg);
+    stats_reset();
+    uint64_t t0 = now_ns();
+    if (mode != EACH_OPEN) {
+        lfs_file_open(&lfs, &f.fp, "/log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+    }
+    vfs_log_init(&log, buf, buffering, 1000, &lfs_log_io, &f);
+    for (int i = 0; i < n; i++) {
+        size_t len = record_data(i, data);
+        payload += len;
+        switch (mode) {
+            case EACH_OPEN:
+                CHECK(lfs_file_open(&lfs, &f.fp, "/log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) == LFS_ERR_OK);
+                CHECK(lfs_file_write(&lfs, &f.fp, data, len) == len);
+                CHECK(lfs_file_close(&lfs, &f.fp) == LFS_ERR_OK);
+                break;
+            case EACH_FLUSH:
+                CHECK(lfs_file_write(&lfs, &f.fp, data, len) == len);
+                CHECK(lfs_file_sync(&lfs, &f.fp) == LFS_ERR_OK);
+                break;
+            case LOG:
+                // a sample every 10 ms
+                CHECK(vfs_log_append(&log, data, len, i * 10) == 0);
+                break;
+        }
+    }
+    if (mode == LOG) {
+        CHECK(vfs_log_flush(&log) == 0);
+    }
+    if (mode != EACH_OPEN) {
+        CHECK(lfs_file_close(&lfs, &f.fp) == LFS_ERR_OK);
+    }
+    uint64_t host_ns = now_ns() - t0;
+    printf("  %-22s %8.1f KB programmed  %4u erases  amplification %6.1f  flash %7.0f us/record  host %5.1f us/record\n",
+           name, stats.prog_bytes / 1024.0, stats.erases, (double)stats.prog_bytes / payload,
+           (double)stats_flash_us() / n, host_ns / 1e3 / n);
+    lfs_unmount(&lfs);
+}
+
+static void bench(int n) {
+    struct {
+        const char *name;
+        lfs_size_t read_size, prog_size, cache_size;
+    } sizes[] = {
+        { "default sizes", 256, 4096, 4096 },
+        { "256 B programs", 256, 256, 1024 },
+    };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        struct lfs_config cfg = make_config(sizes[s].read_size, sizes[s].prog_size, sizes[s].cache_size);
+
+        printf("%s: %d records, read %u, prog %u, cache %u\n", sizes[s].name, n,
+               cfg.read_size, cfg.prog_size, cfg.cache_size);
+        bench_run(&cfg, "open, append, close", EACH_OPEN, 0, n);
+        bench_run(&cfg, "write, flush", EACH_FLUSH, 0, n);
+        bench_run(&cfg, "log, 512 B buffer", LOG, 512, n);
+        bench_run(&cfg, "log, 4 KB buffer", LOG, 4096, n);
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b records] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    if (count > 0) {
+        bench(count);
+    } else {
+        run_tests();
+    }
+    if (failures) {
+        printf("test_log: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_log: all tests passed\n");
+    return 0;
+}
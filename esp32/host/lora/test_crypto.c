@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Test vectors and benchmark for the LoRaWAN 1.0.x crypto, lib/lora/mac/LoRaMacCrypto.c
+ * on top of lib/lora/system/crypto/aes.c.
+ *
+ *   test_crypto                    check AES (FIPS-197), CMAC (RFC 4493) and the
+ *                                  LoRaWAN frame, join and session key vectors,
+ *                                  then random frames against the byte round
+ *                                  AES and cmac.c the code replaced
+ *   test_crypto -b N [-s seed]     encrypt and sign N frames of several sizes
+ *                                  both ways and report the cost per frame
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lora/system/crypto/aes.h"
+#include "lora/system/crypto/cmac.h"
+#include "lora/mac/LoRaMacCrypto.h"
+#include "board.h"
+#include "utilities.h"
+
+// The byte round AES, built from the same source with AES_BYTE_ROUNDS, see the Makefile
+return_type ref_aes_set_key_lora(const uint8_t key[], length_type keylen, aes_context ctx[1]);
+return_type ref_aes_encrypt_lora(const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1]);
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t mic_le(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/******************************************************************************
+ esp32/lora/utilities.c, which needs the board
+ ******************************************************************************/
+
+void memcpy1(uint8_t *dst, const uint8_t *src, uint16_t size) {
+    memcpy(dst, src, size);
+}
+
+void memset1(uint8_t *dst, uint8_t value, uint16_t size) {
+    memset(dst, value, size);
+}
+
+/******************************************************************************
+ Reference, the LoRaMacCrypto.c implementation before the key schedule cache
+ ******************************************************************************/
+
+static void ref_block(uint8_t *block, uint8_t first, uint8_t dir, uint32_t address, uint32_t seq, uint8_t last) {
+    memset(block, 0, 16);
+    block[0] = first;
+    block[5] = dir;
+    for (int i = 0; i < 4; i++) {
+        block[6 + i] = address >> (8 * i);
+        block[10 + i] = seq >> (8 * i);
+    }
+    block[15] = last;
+}
+
+static uint32_t ref_compute_mic(const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t seq) {
+    AES_CMAC_CTX ctx;
+    uint8_t b0[16];
+    uint8_t digest[16];
+
+    ref_block(b0, 0x49, dir, address, seq, size & 0xFF);
+    AES_CMAC_Init(&ctx);
+    AES_CMAC_SetKey(&ctx, key);
+    AES_CMAC_Update(&ctx, b0, 16);
+    AES_CMAC_Update(&ctx, buffer, size & 0xFF);
+    AES_CMAC_Final(digest, &ctx);
+    return mic_le(digest);
+}
+
+static void ref_encrypt(const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t seq, uint8_t *out) {
+    aes_context aes;
+    uint8_t a[16];
+    uint8_t s[16];
+
+    memset(aes.ksch, 0, sizeof(aes.ksch));
+    ref_aes_set_key_lora(key, 16, &aes);
+    ref_block(a, 0x01, dir, address, seq, 0);
+    for (uint16_t i = 0; i < size; i += 16) {
+        a[15] = i / 16 + 1;
+        ref_aes_encrypt_lora(a, s, &aes);
+        for (uint16_t j = i; j < size && j < i + 16; j++) {
+            out[j] = buffer[j] ^ s[j - i];
+        }
+    }
+}
+
+/******************************************************************************
+ Test vectors
+ ******************************************************************************/
+
+static const uint8_t rfc4493_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const uint8_t rfc4493_msg[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+// NwkSKey is the RFC 4493 key, AppSKey the FIPS-197 one
+static const uint8_t fips197_key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+#define DEV_ADDR        0x26011BDA
+
+typedef struct {
+    uint8_t dir;
+    uint32_t seq;
+    uint8_t hdr_len;
+    uint8_t payload_len;
+    uint8_t frame[64];
+    uint8_t mic[4];
+} frame_vector_t;
+
+static const frame_vector_t frame_vectors[] = {
+    // uplink, FPort 1, "hello"
+    { 0, 1, 9, 5, {
+        0x40, 0xda, 0x1b, 0x01, 0x26, 0x00, 0x01, 0x00, 0x01, 0xba, 0x96, 0xc8, 0xf0, 0xfc },
+      { 0xed, 0x38, 0x28, 0x04 } },
+    // uplink, FPort 2, 51 bytes 0x00..0x32
+    { 0, 0x1234, 9, 51, {
+        0x40, 0xda, 0x1b, 0x01, 0x26, 0x00, 0x34, 0x12, 0x02, 0x15, 0xe6, 0x30, 0xbf, 0x31, 0x1f, 0x60,
+        0xbb, 0x4b, 0x4f, 0x1e, 0x52, 0x43, 0x7c, 0xd1, 0x50, 0xc4, 0x0c, 0xd9, 0xc7, 0x5e, 0x61, 0xe7,
+        0xa8, 0x2e, 0xce, 0x3c, 0x1d, 0xb4, 0xbd, 0x89, 0x7a, 0x26, 0xba, 0x54, 0x2f, 0x3f, 0xe5, 0x37,
+        0x31, 0x00, 0x59, 0x76, 0xc8, 0xac, 0xbd, 0xd1, 0xff, 0xf2, 0x13, 0xa9 },
+      { 0xec, 0xf3, 0xdd, 0xc2 } },
+    // downlink, FPort 3, 40 bytes 0x64..0x8b
+    { 1, 7, 9, 40, {
+        0x60, 0xda, 0x1b, 0x01, 0x26, 0x00, 0x07, 0x00, 0x03, 0xbc, 0xa4, 0x5b, 0x6b, 0x2c, 0x94, 0x84,
+        0x50, 0x8d, 0xb8, 0xf7, 0x1e, 0x34, 0x28, 0x25, 0xf6, 0x5f, 0x5a, 0xa8, 0xfd, 0xc3, 0x1f, 0x8d,
+        0xf5, 0x9d, 0xb8, 0xc8, 0xd7, 0xbd, 0xd7, 0xf1, 0x85, 0x41, 0xd7, 0xb1, 0x59, 0x0e, 0xf1, 0x89,
+        0x7c },
+      { 0x27, 0x9f, 0x81, 0x85 } },
+};
+
+static const uint8_t app_key[16] = {
+    0xb6, 0xb5, 0x3f, 0x4a, 0x16, 0x8a, 0x7a, 0x88, 0xbd, 0xf7, 0xea, 0x13, 0x5c, 0xe9, 0xcf, 0xca
+};
+
+static void vector_payload(const frame_vector_t *v, uint8_t *payload) {
+    for (int i = 0; i < v->payload_len; i++) {
+        payload[i] = (v->dir == 0 ? (v->payload_len == 5 ? "hello"[i] : i) : 0x64 + i);
+    }
+}
+
+/******************************************************************************
+ Tests
+ ******************************************************************************/
+
+static void test_aes(void) {
+    static const uint8_t pt[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    static const uint8_t ct[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    aes_context aes;
+    uint8_t out[16];
+
+    memset(aes.ksch, 0, sizeof(aes.ksch));
+    aes_set_key_lora(fips197_key, 16, &aes);
+    aes_encrypt_lora(pt, out, &aes);
+    CHECK(memcmp(out, ct, 16) == 0);
+
+    // in place
+    memcpy(out, pt, 16);
+    aes_encrypt_lora(out, out, &aes);
+    CHECK(memcmp(out, ct, 16) == 0);
+
+    memset(aes.ksch, 0, sizeof(aes.ksch));
+    ref_aes_set_key_lora(fips197_key, 16, &aes);
+    ref_aes_encrypt_lora(pt, out, &aes);
+    CHECK(memcmp(out, ct, 16) == 0);
+}
+
+static void test_cmac(void) {
+    uint32_t mic;
+
+    // LoRaMacJoinComputeMic is a plain CMAC, truncated to 4 bytes
+    LoRaMacJoinComputeMic(rfc4493_msg, 0, rfc4493_key, &mic);
+    CHECK(mic == 0x29691dbb);
+    LoRaMacJoinComputeMic(rfc4493_msg, 16, rfc4493_key, &mic);
+    CHECK(mic == 0xb4160a07);
+    LoRaMacJoinComputeMic(rfc4493_msg, 40, rfc4493_key, &mic);
+    CHECK(mic == 0x4767a6df);
+    LoRaMacJoinComputeMic(rfc4493_msg, 64, rfc4493_key, &mic);
+    CHECK(mic == 0xbfbef051);
+}
+
+static void test_frames(void) {
+    uint8_t payload[64];
+    uint8_t frame[64];
+    uint32_t mic;
+
+    for (size_t n = 0; n < sizeof(frame_vectors) / sizeof(frame_vectors[0]); n++) {
+        const frame_vector_t *v = &frame_vectors[n];
+        uint16_t len = v->hdr_len + v->payload_len;
+
+        vector_payload(v, payload);
+
+        // encrypt, then sign, as the MAC did it
+        memset(frame, 0, sizeof(frame));
+        memcpy(frame, v->frame, v->hdr_len);
+        LoRaMacPayloadEncrypt(payload, v->payload_len, fips197_key, DEV_ADDR, v->dir, v->seq, frame + v->hdr_len);
+        CHECK(memcmp(frame, v->frame, len) == 0);
+        LoRaMacComputeMic(frame, len, rfc4493_key, DEV_ADDR, v->dir, v->seq, &mic);
+        CHECK(mic == mic_le(v->mic));
+
+        // in one pass
+        memset(frame, 0, sizeof(frame));
+        memcpy(frame, v->frame, v->hdr_len);
+        mic = 0;
+        LoRaMacPayloadEncryptComputeMic(frame, v->hdr_len, payload, v->payload_len, fips197_key, rfc4493_key,
+                                        DEV_ADDR, v->dir, v->seq, &mic);
+        CHECK(memcmp(frame, v->frame, len) == 0);
+        CHECK(mic == mic_le(v->mic));
+
+        // and back
+        LoRaMacPayloadDecrypt(v->frame + v->hdr_len, v->payload_len, fips197_key, DEV_ADDR, v->dir, v->seq, frame);
+        CHECK(memcmp(frame, payload, v->payload_len) == 0);
+    }
+}
+
+static void test_join(void) {
+    static const uint8_t join_request[19] = {
+        0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+        0x0f, 0xa5, 0x5a
+    };
+    static const uint8_t accept_cipher[32] = {
+        0xa6, 0x25, 0x69, 0x24, 0x04, 0x51, 0x55, 0xf6, 0x50, 0xb6, 0x27, 0xee, 0x0c, 0x59, 0x27, 0xfd,
+        0xa8, 0x71, 0x17, 0x79, 0x4c, 0xc1, 0x3d, 0x92, 0x07, 0x57, 0x13, 0x90, 0x5b, 0x7e, 0x76, 0xdb
+    };
+    static const uint8_t accept_cipher_short[16] = {
+        0x2e, 0x72, 0x76, 0x11, 0x72, 0xf1, 0x12, 0x04, 0xf0, 0xc8, 0xa2, 0x63, 0x0e, 0xb0, 0x0d, 0x9f
+    };
+    static const uint8_t app_nonce[6] = { 0xa1, 0xa2, 0xa3, 0xb1, 0xb2, 0xb3 };
+    static const uint8_t nwk_skey[16] = {
+        0xa3, 0xba, 0x7b, 0xd2, 0x53, 0x21, 0x55, 0xec, 0x39, 0x1a, 0xdd, 0xd1, 0xcc, 0xc2, 0xd6, 0x59
+    };
+    static const uint8_t app_skey[16] = {
+        0x6c, 0x7d, 0xe1, 0x92, 0xbd, 0x54, 0x6c, 0x71, 0x3b, 0x1c, 0x90, 0x09, 0x4d, 0xaf, 0xbe, 0x67
+    };
+    uint8_t out[32];
+    uint8_t key2[16];
+    uint32_t mic;
+
+    LoRaMacJoinComputeMic(join_request, sizeof(join_request), app_key, &mic);
+    CHECK(mic == 0xee21ce64);
+
+    LoRaMacJoinDecrypt(accept_cipher, 32, app_key, out);
+    for (int i = 0; i < 32; i++) {
+        CHECK(out[i] == 0x20 + i);
+    }
+    memset(out, 0, sizeof(out));
+    LoRaMacJoinDecrypt(accept_cipher_short, 15, app_key, out);
+    CHECK(out[0] == 0x20);
+    for (int i = 1; i < 16; i++) {
+        CHECK(out[i] == i);
+    }
+    for (int i = 16; i < 32; i++) {
+        CHECK(out[i] == 0);
+    }
+
+    LoRaMacJoinComputeSKeys(app_key, app_nonce, 0x5aa5, out, key2);
+    CHECK(memcmp(out, nwk_skey, 16) == 0);
+    CHECK(memcmp(key2, app_skey, 16) == 0);
+}
+
+// More keys than the schedule cache holds, used in turns
+static void test_key_cache(void) {
+    uint8_t keys[9][16];
+    uint32_t mic;
+
+    for (int k = 0; k < 9; k++) {
+        for (int i = 0; i < 16; i++) {
+            keys[k][i] = k * 31 + i * 7;
+        }
+    }
+    for (int round = 0; round < 4; round++) {
+        for (int k = 0; k < 9; k++) {
+            int key = (round & 1) ? 8 - k : (k * 4) % 9;
+            LoRaMacComputeMic(rfc4493_msg, 64, keys[key], DEV_ADDR, 0, round, &mic);
+            CHECK(mic == ref_compute_mic(rfc4493_msg, 64, keys[key], DEV_ADDR, 0, round));
+        }
+    }
+}
+
+// The radio interrupt, using more keys than the cache holds in the middle of
+// a frame. It comes after irq_after atomic sections have ended.
+static uint8_t irq_keys[4][16];
+static int irq_after;
+
+static void irq_frames(void) {
+    uint32_t mic;
+
+    for (int k = 0; k < 4; k++) {
+        LoRaMacComputeMic(rfc4493_msg, 40, irq_keys[k], DEV_ADDR, 1, k, &mic);
+        CHECK(mic == ref_compute_mic(rfc4493_msg, 40, irq_keys[k], DEV_ADDR, 1, k));
+    }
+}
+
+static void irq_countdown(void) {
+    if (irq_after-- > 0) {
+        host_pending_irq = irq_countdown;
+    } else {
+        irq_frames();
+    }
+}
+
+static void test_key_cache_irq(void) {
+    uint8_t enc_key[16];
+    uint8_t mic_key[16];
+    uint8_t payload[64];
+    uint8_t frame[13 + 64];
+    uint8_t ref[13 + 64];
+    uint32_t mic;
+
+    for (int i = 0; i < 16; i++) {
+        enc_key[i] = 0x10 + i;
+        mic_key[i] = 0x20 + i;
+        for (int k = 0; k < 4; k++) {
+            irq_keys[k][i] = 0x30 + 0x10 * k + i;
+        }
+    }
+    memcpy(payload, rfc4493_msg, sizeof(payload));
+    memset(ref, 0xa5, 13);
+    ref_encrypt(payload, sizeof(payload), enc_key, DEV_ADDR, 0, 7, ref + 13);
+
+    // at each point the cache lets the interrupt in, the frame keys cached
+    // or not, until the frame is done first
+    for (int at = 0; ; at++) {
+        irq_frames();
+        irq_after = at;
+        host_pending_irq = irq_countdown;
+        memset(frame, 0xa5, 13);
+        LoRaMacPayloadEncryptComputeMic(frame, 13, payload, sizeof(payload), enc_key, mic_key, DEV_ADDR, 0, 7, &mic);
+        CHECK(memcmp(frame, ref, sizeof(frame)) == 0);
+        CHECK(mic == ref_compute_mic(ref, sizeof(frame), mic_key, DEV_ADDR, 0, 7));
+        if (host_pending_irq != NULL) {
+            host_pending_irq = NULL;
+            CHECK(at > 0);
+            break;
+        }
+    }
+}
+
+static void random_frame(uint8_t *key1, uint8_t *key2, uint8_t *hdr, uint16_t hdr_len, uint8_t *payload, uint16_t payload_len) {
+    for (int i = 0; i < 16; i++) {
+        key1[i] = rand();
+        key2[i] = rand();
+    }
+    for (int i = 0; i < hdr_len; i++) {
+        hdr[i] = rand();
+    }
+    for (int i = 0; i < payload_len; i++) {
+        payload[i] = rand();
+    }
+}
+
+static void test_random(int count) {
+    uint8_t enc_key[16];
+    uint8_t mic_key[16];
+    uint8_t payload[256];
+    uint8_t frame[256];
+    uint8_t ref[256];
+
+    for (int n = 0; n < count; n++) {
+        uint16_t hdr_len = 1 + rand() % 23;
+        uint16_t payload_len = rand() % (256 - 4 - hdr_len);
+        uint32_t address = rand();
+        uint32_t seq = rand();
+        uint8_t dir = rand() & 1;
+        uint32_t mic;
+
+        random_frame(enc_key, mic_key, frame, hdr_len, payload, payload_len);
+        memcpy(ref, frame, hdr_len);
+        ref_encrypt(payload, payload_len, enc_key, address, dir, seq, ref + hdr_len);
+
+        LoRaMacPayloadEncryptComputeMic(frame, hdr_len, payload, payload_len, enc_key, mic_key, address, dir, seq, &mic);
+        CHECK(memcmp(frame, ref, hdr_len + payload_len) == 0);
+        CHECK(mic == ref_compute_mic(ref, hdr_len + payload_len, mic_key, address, dir, seq));
+        if (failures > 0) {
+            printf("random frame %d: header %u, payload %u\n", n, hdr_len, payload_len);
+            return;
+        }
+    }
+}
+
+static void run_tests(void) {
+    test_aes();
+    test_cmac();
+    test_frames();
+    test_join();
+    test_key_cache();
+    test_key_cache_irq();
+    test_random(20000);
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+
+static void bench(int count) {
+    static const uint16_t sizes[] = { 11, 51, 115, 222 };
+    uint8_t nwk_skey[16];
+    uint8_t app_skey[16];
+    uint8_t payload[256];
+    uint8_t frame[256];
+    uint32_t mic;
+    uint32_t sink = 0;
+    uint64_t t0, t_ref, t_new;
+
+    printf("%8s %14s %14s %8s\n", "payload", "ref ns/frame", "new ns/frame", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint16_t len = sizes[s];
+
+        random_frame(nwk_skey, app_skey, frame, 9, payload, len);
+
+        t0 = now_ns();
+        for (int n = 0; n < count; n++) {
+            ref_encrypt(payload, len, app_skey, DEV_ADDR, 0, n, frame + 9);
+            sink += ref_compute_mic(frame, 9 + len, nwk_skey, DEV_ADDR, 0, n);
+        }
+        t_ref = now_ns() - t0;
+
+        t0 = now_ns();
+        for (int n = 0; n < count; n++) {
+            LoRaMacPayloadEncryptComputeMic(frame, 9, payload, len, app_skey, nwk_skey, DEV_ADDR, 0, n, &mic);
+            sink += mic;
+        }
+        t_new = now_ns() - t0;
+
+        printf("%8u %14.1f %14.1f %7.1fx\n", len, (double)t_ref / count, (double)t_new / count, (double)t_ref / t_new);
+    }
+    // keep the loops
+    if (sink == 0x5a5a5a5a) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b count] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    if (count > 0) {
+        bench(count);
+        return 0;
+    }
+
+    run_tests();
+    if (failures > 0) {
+        printf("test_crypto: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_crypto: all tests passed\n");
+    return 0;
+}
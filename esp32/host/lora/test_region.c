@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the channel selection of the LoRaMac regions,
+ * lib/lora/mac/region, for the regions built into the esp32 port.
+ *
+ *   test_region                    check the channels mask selector and the
+ *                                  enabled channels search against the per
+ *                                  channel scan they replaced, then draw
+ *                                  channels with RegionNextChannel in each
+ *                                  region and check them
+ *   test_region -b N [-s seed]     call RegionNextChannel N times in each
+ *                                  region, and time the enabled channels
+ *                                  search against the per channel scan
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "utilities.h"
+#include "lora/mac/LoRaMac.h"
+#include "lora/mac/region/Region.h"
+#include "lora/mac/region/RegionCommon.h"
+
+#define MASK_SIZE_MAX       6
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/******************************************************************************
+ Host versions of esp32/lora/utilities.c, the timer and the radio
+ ******************************************************************************/
+
+static uint32_t next = 1;
+
+int32_t rand1(void) {
+    return ((next = next * 1103515245L + 12345L) % 2147483647L);
+}
+
+void srand1(uint32_t seed) {
+    next = seed;
+}
+
+int32_t randr(int32_t min, int32_t max) {
+    return (int32_t)rand1() % (max - min + 1) + min;
+}
+
+void memcpy1(uint8_t *dst, const uint8_t *src, uint16_t size) {
+    memcpy(dst, src, size);
+}
+
+void memset1(uint8_t *dst, uint8_t value, uint16_t size) {
+    memset(dst, value, size);
+}
+
+static TimerTime_t sim_now = 1000000;
+
+TimerTime_t TimerGetCurrentTime(void) {
+    return sim_now;
+}
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t savedTime) {
+    return sim_now - savedTime;
+}
+
+static bool radio_check_rf_frequency(uint32_t frequency) {
+    return true;
+}
+
+static bool radio_is_channel_free(RadioModems_t modem, uint32_t freq, int16_t rssiThresh, uint32_t maxCarrierSenseTime) {
+    return true;
+}
+
+const struct Radio_s Radio = {
+    .CheckRfFrequency = radio_check_rf_frequency,
+    .IsChannelFree = radio_is_channel_free,
+};
+
+/******************************************************************************
+ Reference, the per channel scan of the regions before the channels mask search
+ ******************************************************************************/
+
+static uint8_t ref_count(RegionCommonCountNbOfEnabledChannelsParams_t *p, uint8_t *enabledChannels, uint8_t *delayTx) {
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTransmission = 0;
+
+    for (uint8_t i = 0, k = 0; i < p->MaxNbChannels; i += 16, k++) {
+        for (uint8_t j = 0; j < 16; j++) {
+            if ((p->ChannelsMask[k] & (1 << j)) != 0) {
+                if (p->Channels[i + j].Frequency == 0) {
+                    continue;
+                }
+                if (p->Joined == false && (p->JoinChannels & (1 << j)) == 0) {
+                    continue;
+                }
+                if (RegionCommonValueInRange(p->Datarate, p->Channels[i + j].DrRange.Fields.Min,
+                                             p->Channels[i + j].DrRange.Fields.Max) == false) {
+                    continue;
+                }
+                if (p->Bands[p->Channels[i + j].Band].TimeOff > 0) {
+                    delayTransmission++;
+                    continue;
+                }
+                enabledChannels[nbEnabledChannels++] = i + j;
+            }
+        }
+    }
+
+    *delayTx = delayTransmission;
+    return nbEnabledChannels;
+}
+
+/******************************************************************************
+ Tests
+ ******************************************************************************/
+
+static uint16_t random_mask(void) {
+    switch (rand() % 4) {
+        case 0:
+            return 0;
+        case 1:
+            return 0xFFFF;
+        default:
+            return rand() & rand();
+    }
+}
+
+static void test_select(int count) {
+    uint16_t mask[MASK_SIZE_MAX];
+
+    for (int n = 0; n < count; n++) {
+        uint8_t len = 1 + rand() % MASK_SIZE_MAX;
+        uint8_t nth = 0;
+
+        for (int k = 0; k < len; k++) {
+            mask[k] = random_mask();
+        }
+        for (int id = 0; id < len * 16; id++) {
+            if (mask[id / 16] & (1 << (id % 16))) {
+                CHECK(RegionCommonChanMaskSelect(mask, len, nth) == id);
+                nth++;
+            }
+        }
+        CHECK(RegionCommonCountChannels(mask, 0, len) == nth);
+    }
+}
+
+static void test_count(int count) {
+    static const uint8_t nb_channels[] = { 16, 72, 96 };
+    ChannelParams_t channels[MASK_SIZE_MAX * 16];
+    Band_t bands[6];
+    uint16_t mask[MASK_SIZE_MAX];
+    uint16_t enabled[MASK_SIZE_MAX];
+    uint8_t ref[MASK_SIZE_MAX * 16];
+    RegionCommonCountNbOfEnabledChannelsParams_t p;
+
+    for (int n = 0; n < count; n++) {
+        uint8_t nb, ref_nb, delay, ref_delay;
+
+        memset(channels, 0, sizeof(channels));
+        memset(bands, 0, sizeof(bands));
+        p.MaxNbChannels = nb_channels[rand() % 3];
+        for (int i = 0; i < p.MaxNbChannels; i++) {
+            channels[i].Frequency = (rand() % 8) ? 868100000 + i * 200000 : 0;
+            channels[i].DrRange.Fields.Min = rand() % 3;
+            channels[i].DrRange.Fields.Max = 3 + rand() % 3;
+            channels[i].Band = rand() % 6;
+        }
+        for (int b = 0; b < 6; b++) {
+            bands[b].TimeOff = (rand() % 3) ? 0 : 1 + rand() % 1000;
+        }
+        for (int k = 0; k < MASK_SIZE_MAX; k++) {
+            mask[k] = (k * 16 < p.MaxNbChannels) ? random_mask() : 0;
+        }
+        if (p.MaxNbChannels == 72) {
+            // as US915 and AU915, the last word only has 8 channels
+            mask[4] &= 0x00FF;
+        }
+        p.Joined = rand() & 1;
+        p.Datarate = rand() % 7;
+        p.ChannelsMask = mask;
+        p.Channels = channels;
+        p.Bands = bands;
+        p.JoinChannels = (rand() & 1) ? 0xFFFF : LC(1) | LC(2) | LC(3);
+
+        ref_nb = ref_count(&p, ref, &ref_delay);
+        nb = RegionCommonCountNbOfEnabledChannels(&p, enabled, &delay);
+        CHECK(nb == ref_nb);
+        CHECK(delay == ref_delay);
+        for (int i = 0; i < nb && i < ref_nb; i++) {
+            CHECK(RegionCommonChanMaskSelect(enabled, MASK_SIZE_MAX, i) == ref[i]);
+        }
+        if (failures > 0) {
+            printf("random search %d: %u channels\n", n, p.MaxNbChannels);
+            return;
+        }
+    }
+}
+
+typedef struct {
+    const char *name;
+    LoRaMacRegion_t region;
+    int8_t datarate;
+} region_t;
+
+static const region_t regions[] = {
+    { "AS923", LORAMAC_REGION_AS923, DR_2 },
+    { "AU915", LORAMAC_REGION_AU915, DR_2 },
+    { "CN470", LORAMAC_REGION_CN470, DR_2 },
+    { "EU433", LORAMAC_REGION_EU433, DR_2 },
+    { "EU868", LORAMAC_REGION_EU868, DR_2 },
+    { "IN865", LORAMAC_REGION_IN865, DR_2 },
+    { "US915", LORAMAC_REGION_US915, DR_2 },
+};
+
+#define NB_REGIONS          (sizeof(regions) / sizeof(regions[0]))
+
+// Adds channels up to 8, as a network would with a CFList
+static void region_setup(const region_t *r) {
+    ChannelParams_t channel = { 0 };
+    ChannelAddParams_t add = { .NewChannel = &channel };
+
+    RegionInitDefaults(r->region, INIT_TYPE_INIT);
+    if (r->region == LORAMAC_REGION_EU868 || r->region == LORAMAC_REGION_AS923 ||
+        r->region == LORAMAC_REGION_IN865 || r->region == LORAMAC_REGION_EU433) {
+        ChannelParams_t *channels;
+        uint32_t size;
+
+        channel.DrRange.Value = (DR_5 << 4) | DR_0;
+        for (uint8_t id = 3; id < 8; id++) {
+            channel.Frequency = (r->region == LORAMAC_REGION_EU433) ? 433775000 + id * 200000 :
+                                (r->region == LORAMAC_REGION_AS923) ? 922000000 + id * 200000 :
+                                (r->region == LORAMAC_REGION_IN865) ? 865000000 + id * 200000 :
+                                                                      867100000 + (id - 3) * 200000;
+            add.ChannelId = id;
+            RegionChannelAdd(r->region, &add);
+        }
+        if (RegionGetChannels(r->region, &channels, &size)) {
+            CHECK(channels[7].Frequency != 0);
+        }
+    }
+}
+
+static void test_next_channel(int count) {
+    NextChanParams_t next = { 0 };
+
+    for (size_t n = 0; n < NB_REGIONS; n++) {
+        const region_t *r = &regions[n];
+        ChannelParams_t *channels = NULL;
+        uint16_t *mask = NULL;
+        uint32_t size;
+        uint32_t used[MASK_SIZE_MAX * 16] = { 0 };
+
+        region_setup(r);
+        RegionGetChannels(r->region, &channels, &size);
+        RegionGetChannelMask(r->region, &mask, &size);
+
+        for (int joined = 0; joined < 2; joined++) {
+            next.Joined = joined;
+            next.Datarate = r->datarate;
+            for (int i = 0; i < count; i++) {
+                uint8_t channel = 0xFF;
+                TimerTime_t time = 1;
+                TimerTime_t aggregated = 1;
+
+                CHECK(RegionNextChannel(r->region, &next, &channel, &time, &aggregated) == true);
+                CHECK(time == 0);
+                CHECK(channel < MASK_SIZE_MAX * 16);
+                if (channel >= MASK_SIZE_MAX * 16) {
+                    continue;
+                }
+                used[channel]++;
+                if (mask != NULL) {
+                    CHECK(mask[channel / 16] & (1 << (channel % 16)));
+                }
+                if (channels != NULL) {
+                    CHECK(channels[channel].Frequency != 0);
+                    CHECK(RegionCommonValueInRange(r->datarate, channels[channel].DrRange.Fields.Min,
+                                                   channels[channel].DrRange.Fields.Max));
+                }
+                if (joined == 0 && mask != NULL && r->region != LORAMAC_REGION_US915 && r->region != LORAMAC_REGION_AU915) {
+                    // the join channels, the first 2 or 3
+                    CHECK(channel < 3);
+                }
+            }
+        }
+
+        // the draw covers the enabled channels
+        if (mask != NULL) {
+            for (int id = 0; id < MASK_SIZE_MAX * 16; id++) {
+                if (used[id] == 0 && id < size * 16 && (mask[id / 16] & (1 << (id % 16))) &&
+                    channels != NULL && channels[id].Frequency != 0 &&
+                    RegionCommonValueInRange(r->datarate, channels[id].DrRange.Fields.Min, channels[id].DrRange.Fields.Max)) {
+                    printf("%s: channel %d never drawn\n", r->name, id);
+                    failures++;
+                }
+            }
+        }
+    }
+}
+
+static void run_tests(void) {
+    test_select(20000);
+    test_count(20000);
+    test_next_channel(2000);
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+
+static void bench(int count) {
+    NextChanParams_t next = { .Joined = true };
+    uint32_t sink = 0;
+
+    printf("%-6s %8s %14s %14s %14s\n", "region", "channels", "next ns/call", "scan ns/call", "mask ns/call");
+    for (size_t n = 0; n < NB_REGIONS; n++) {
+        const region_t *r = &regions[n];
+        uint64_t t0, t_next, t_scan = 0, t_mask = 0;
+        uint8_t channel;
+        TimerTime_t time, aggregated;
+        ChannelParams_t *channels;
+        uint16_t *mask;
+        uint32_t size;
+        uint8_t nb = 0;
+
+        region_setup(r);
+        next.Datarate = r->datarate;
+
+        t0 = now_ns();
+        for (int i = 0; i < count; i++) {
+            RegionNextChannel(r->region, &next, &channel, &time, &aggregated);
+            sink += channel;
+        }
+        t_next = now_ns() - t0;
+
+        // the search alone, on the channels of the region
+        if (RegionGetChannels(r->region, &channels, &size) && RegionGetChannelMask(r->region, &mask, &size)) {
+            RegionCommonCountNbOfEnabledChannelsParams_t p = {
+                .Joined = true, .Datarate = r->datarate, .ChannelsMask = mask, .Channels = channels,
+                .MaxNbChannels = 16, .JoinChannels = 0xFFFF,
+            };
+            Band_t bands[6] = { { 0 } };
+            uint8_t ref[MASK_SIZE_MAX * 16];
+            uint16_t enabled[MASK_SIZE_MAX];
+            uint8_t delay;
+
+            p.Bands = bands;
+            if (r->region == LORAMAC_REGION_US915 || r->region == LORAMAC_REGION_AU915) {
+                p.MaxNbChannels = 72;
+            }
+            t0 = now_ns();
+            for (int i = 0; i < count; i++) {
+                nb = ref_count(&p, ref, &delay);
+                sink += ref[randr(0, nb - 1)];
+            }
+            t_scan = now_ns() - t0;
+            t0 = now_ns();
+            for (int i = 0; i < count; i++) {
+                nb = RegionCommonCountNbOfEnabledChannels(&p, enabled, &delay);
+                sink += RegionCommonChanMaskSelect(enabled, MASK_SIZE_MAX, randr(0, nb - 1));
+            }
+            t_mask = now_ns() - t0;
+        }
+
+        if (t_scan > 0) {
+            printf("%-6s %8u %14.1f %14.1f %14.1f\n", r->name, nb, (double)t_next / count,
+                   (double)t_scan / count, (double)t_mask / count);
+        } else {
+            printf("%-6s %8s %14.1f %14s %14s\n", r->name, "-", (double)t_next / count, "-", "-");
+        }
+    }
+    // keep the loops
+    if (sink == 0x5a5a5a5a) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b count] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+    srand1(seed);
+
+    if (count > 0) {
+        bench(count);
+        return 0;
+    }
+
+    run_tests();
+    if (failures > 0) {
+        printf("test_region: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_region: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the LoRaMac timer engine, lib/lora/system/timer.c,
+ * running on a simulated copy of the esp32/lora/timer-board.c 1 ms tick.
+ *
+ *   test_timer                     run the unit tests, then random start, stop
+ *                                  and expiry sequences checked against a model
+ *   test_timer -b N [-s seed]      restart a random timer N times with 1 to
+ *                                  TIMER_HEAP_SIZE timers running, on the timer
+ *                                  heap and on a sorted list, the scheme the
+ *                                  heap replaced, and report the cost per call
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "timer-board.h"
+#include "modlora.h"
+
+#define NB_TIMERS           TIMER_HEAP_SIZE
+
+#if NB_TIMERS < 16
+#error "the tests need 16 timers at least"
+#endif
+
+#define FIRED_MAX           64
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/******************************************************************************
+ Simulated esp32/lora/timer-board.c, the tests drive the tick
+ ******************************************************************************/
+
+#define HW_TIMER_TIME_BASE  1 // ms
+
+static TimerTime_t TimerTickCounter = 1;
+static TimerTime_t TimerTickCounterContext = 0;
+static TimerTime_t TimeoutCntValue = 0;
+
+static void sim_tick(void) {
+    TimerTickCounter++;
+    if (TimeoutCntValue > 0 && TimerTickCounter == TimeoutCntValue) {
+        TimerIrqHandler();
+    }
+}
+
+static void sim_run(uint32_t ms) {
+    while (ms-- > 0) {
+        sim_tick();
+    }
+}
+
+void TimerHwStart(uint32_t val) {
+    TimerTickCounterContext = TimerHwGetTimerValue();
+    if (val <= HW_TIMER_TIME_BASE) {
+        TimeoutCntValue = TimerTickCounterContext + (HW_TIMER_TIME_BASE * 2);
+    } else {
+        TimeoutCntValue = TimerTickCounterContext + val;
+    }
+}
+
+TimerTime_t TimerHwGetTimerValue(void) {
+    return TimerTickCounter;
+}
+
+TimerTime_t TimerHwGetTime(void) {
+    return TimerHwGetTimerValue() * HW_TIMER_TIME_BASE;
+}
+
+TimerTime_t TimerHwGetElapsedTime(void) {
+    return (((TimerHwGetTimerValue() - TimerTickCounterContext) + 1) * HW_TIMER_TIME_BASE);
+}
+
+TimerTime_t TimerHwComputeTimeDifference(TimerTime_t eventInTime) {
+    return TimerHwGetTime() - eventInTime;
+}
+
+void TimerHwEnterLowPowerStopMode(void) {
+}
+
+/******************************************************************************
+ One callback per timer, to tell which one fired
+ ******************************************************************************/
+
+struct fired_s {
+    int id;
+    uint32_t tick;
+};
+
+static TimerEvent_t timers[NB_TIMERS];
+static struct fired_s fired[FIRED_MAX];
+static int nb_fired;
+static uint32_t nb_anonymous;
+
+static void on_fired(int id) {
+    if (nb_fired < FIRED_MAX) {
+        fired[nb_fired].id = id;
+        fired[nb_fired].tick = TimerTickCounter;
+    }
+    nb_fired++;
+}
+
+#define CB(n)   static void cb##n(void) { on_fired(n); }
+CB(0) CB(1) CB(2) CB(3) CB(4) CB(5) CB(6) CB(7)
+CB(8) CB(9) CB(10) CB(11) CB(12) CB(13) CB(14) CB(15)
+
+static void (* const callbacks[16])(void) = {
+    cb0, cb1, cb2, cb3, cb4, cb5, cb6, cb7, cb8, cb9, cb10, cb11, cb12, cb13, cb14, cb15
+};
+
+// what TASK_LoRa_Timer does with the queued callbacks, straight away
+void modlora_set_timer_callback(modlora_timerCallback cb) {
+    if (cb != NULL) {
+        cb();
+    }
+}
+
+static void anonymous_cb(void) {
+    nb_anonymous++;
+}
+
+static void reset_all(void) {
+    int i;
+
+    for (i = 0; i < NB_TIMERS; i++) {
+        TimerInit(&timers[i], (i < 16) ? callbacks[i] : anonymous_cb);
+    }
+    nb_fired = 0;
+}
+
+static void start(int id, uint32_t value) {
+    TimerSetValue(&timers[id], value);
+    TimerStart(&timers[id]);
+}
+
+/******************************************************************************
+ Unit tests
+ ******************************************************************************/
+
+static void test_single(void) {
+    uint32_t t0;
+
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 10);
+    CHECK(timers[0].IsRunning);
+    sim_run(9);
+    CHECK(nb_fired == 0);
+    sim_run(1);
+    CHECK(nb_fired == 1 && fired[0].id == 0 && fired[0].tick == t0 + 10);
+    CHECK(!timers[0].IsRunning);
+    sim_run(100);
+    CHECK(nb_fired == 1);
+}
+
+// expiry in deadline order, timers expiring together in start order
+static void test_order(void) {
+    static const uint32_t values[] = { 50, 10, 30, 10, 20, 30 };
+    static const int expected[] = { 1, 3, 4, 2, 5, 0 };
+    uint32_t t0;
+    int i;
+
+    reset_all();
+    t0 = TimerTickCounter;
+    for (i = 0; i < 6; i++) {
+        start(i, values[i]);
+    }
+    sim_run(60);
+    CHECK(nb_fired == 6);
+    for (i = 0; i < 6 && i < nb_fired; i++) {
+        CHECK(fired[i].id == expected[i]);
+        CHECK(fired[i].tick == t0 + values[expected[i]]);
+    }
+}
+
+static void test_stop(void) {
+    uint32_t t0;
+
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 10);
+    start(1, 20);
+    start(2, 30);
+    start(3, 40);
+    sim_run(5);
+    TimerStop(&timers[0]);          // the head
+    TimerStop(&timers[2]);          // within the heap
+    TimerStop(&timers[2]);          // again
+    TimerStop(&timers[5]);          // never started
+    TimerStop(NULL);
+    CHECK(!timers[0].IsRunning && !timers[2].IsRunning);
+    CHECK(timers[1].IsRunning && timers[3].IsRunning);
+    sim_run(50);
+    CHECK(nb_fired == 2);
+    CHECK(fired[0].id == 1 && fired[0].tick == t0 + 20);
+    CHECK(fired[1].id == 3 && fired[1].tick == t0 + 40);
+
+    // stop the last one running, then start it again
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 10);
+    TimerStop(&timers[0]);
+    sim_run(20);
+    CHECK(nb_fired == 0);
+    TimerStart(&timers[0]);
+    sim_run(10);
+    CHECK(nb_fired == 1 && fired[0].tick == t0 + 30);
+}
+
+static void test_restart(void) {
+    uint32_t t0;
+
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 10);
+    sim_run(5);
+    TimerStart(&timers[0]);         // already running, no effect
+    sim_run(5);
+    CHECK(nb_fired == 1 && fired[0].tick == t0 + 10);
+
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 10);
+    start(1, 12);
+    sim_run(5);
+    TimerReset(&timers[0]);         // pushed back behind timer 1
+    sim_run(10);
+    CHECK(nb_fired == 2);
+    CHECK(fired[0].id == 1 && fired[0].tick == t0 + 12);
+    CHECK(fired[1].id == 0 && fired[1].tick == t0 + 15);
+}
+
+// the hardware timer needs 2 ticks at least
+static void test_short(void) {
+    uint32_t t0;
+
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 0);
+    start(1, 1);
+    sim_run(2);
+    CHECK(nb_fired == 2 && fired[0].id == 0 && fired[1].id == 1);
+    CHECK(fired[0].tick == t0 + 2 && fired[1].tick == t0 + 2);
+}
+
+static void test_capacity(void) {
+    TimerEvent_t extra;
+    int i;
+
+    reset_all();
+    for (i = 0; i < NB_TIMERS; i++) {
+        start(i, 100 + i);
+    }
+    TimerInit(&extra, anonymous_cb);
+    TimerSetValue(&extra, 10);
+    TimerStart(&extra);
+    CHECK(!extra.IsRunning);
+    nb_anonymous = 0;
+    sim_run(100 + NB_TIMERS);
+    CHECK(nb_fired + nb_anonymous == NB_TIMERS);
+    for (i = 0; i < nb_fired && i < FIRED_MAX; i++) {
+        CHECK(fired[i].id == i);
+    }
+}
+
+// expiry times past the 32-bit tick counter wrap around
+static void test_wrap(void) {
+    uint32_t t0;
+
+    TimerTickCounter = 0xFFFFFFF0;
+    reset_all();
+    t0 = TimerTickCounter;
+    start(0, 100);
+    start(1, 5);
+    start(2, 40);
+    sim_run(100);
+    CHECK(nb_fired == 3);
+    CHECK(fired[0].id == 1 && fired[0].tick == t0 + 5);
+    CHECK(fired[1].id == 2 && fired[1].tick == t0 + 40);
+    CHECK(fired[2].id == 0 && fired[2].tick == t0 + 100);
+    TimerTickCounter = 1;
+}
+
+/*
+ * Random starts, stops and restarts, checked against a model. A timer fires
+ * at its expiry time, or up to 2 ticks later if the hardware timer is set when
+ * it is that close. Timers firing in the same tick do so in expiry time order,
+ * then start order.
+ */
+static void test_random(uint32_t steps) {
+    struct {
+        bool running;
+        uint32_t deadline;
+        uint32_t seq;
+    } model[16];
+    uint32_t seq = 0;
+    uint32_t s;
+    int i;
+
+    reset_all();
+    memset(model, 0, sizeof(model));
+    for (s = 0; s < steps; s++) {
+        int id = lrand48() % 16;
+        uint32_t value = lrand48() % 200;
+
+        switch (lrand48() % 4) {
+        case 0:
+            if (!model[id].running) {
+                model[id].running = true;
+                model[id].deadline = TimerTickCounter + value;
+                model[id].seq = seq++;
+            }
+            timers[id].ReloadValue = value;
+            TimerStart(&timers[id]);
+            break;
+        case 1:
+            model[id].running = false;
+            TimerStop(&timers[id]);
+            break;
+        case 2:
+            model[id].running = true;
+            model[id].deadline = TimerTickCounter + value;
+            model[id].seq = seq++;
+            start(id, value);
+            break;
+        default:
+            value = lrand48() % 20;
+            while (value-- > 0) {
+                nb_fired = 0;
+                sim_tick();
+                for (i = 0; i < nb_fired && i < FIRED_MAX; i++) {
+                    int f = fired[i].id;
+                    CHECK(model[f].running);
+                    CHECK((int32_t)(TimerTickCounter - model[f].deadline) >= 0);
+                    CHECK(TimerTickCounter - model[f].deadline <= 2);
+                    if (i > 0) {
+                        int p = fired[i - 1].id;
+                        CHECK((int32_t)(model[p].deadline - model[f].deadline) < 0 ||
+                              (model[p].deadline == model[f].deadline && model[p].seq < model[f].seq));
+                    }
+                    model[f].running = false;
+                }
+                for (i = 0; i < 16; i++) {
+                    CHECK(!model[i].running || TimerTickCounter - model[i].deadline <= 2 ||
+                          (int32_t)(TimerTickCounter - model[i].deadline) < 0);
+                }
+            }
+            break;
+        }
+        for (i = 0; i < 16; i++) {
+            CHECK(timers[i].IsRunning == model[i].running);
+        }
+        if (failures > 0) {
+            printf("random sequence failed at step %u\n", s);
+            return;
+        }
+    }
+}
+
+static int run_tests(void) {
+    test_single();
+    test_order();
+    test_stop();
+    test_restart();
+    test_short();
+    test_capacity();
+    test_wrap();
+    srand48(1);
+    test_random(1000000);
+    if (failures == 0) {
+        printf("test_timer: all tests passed\n");
+    }
+    return failures ? 1 : 0;
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+
+// Sorted list of absolute expiry times, with the O(n) walks of the old engine:
+// the check that the timer is not in the list yet, the insert and the remove
+struct list_timer_s {
+    uint32_t deadline;
+    struct list_timer_s *next;
+};
+
+static struct list_timer_s *list_head;
+
+static void list_start(struct list_timer_s *t, uint32_t value) {
+    struct list_timer_s **p;
+
+    for (p = &list_head; *p != NULL; p = &(*p)->next) {
+        if (*p == t) {
+            return;
+        }
+    }
+    t->deadline = TimerTickCounter + value;
+    for (p = &list_head; *p != NULL && (int32_t)((*p)->deadline - t->deadline) <= 0; p = &(*p)->next) {
+    }
+    t->next = *p;
+    *p = t;
+    if (list_head == t) {
+        TimerHwStart(value);
+    }
+}
+
+static void list_stop(struct list_timer_s *t) {
+    struct list_timer_s **p = &list_head;
+
+    while (*p != NULL && *p != t) {
+        p = &(*p)->next;
+    }
+    if (*p != NULL) {
+        *p = t->next;
+        if (p == &list_head && list_head != NULL) {
+            TimerHwStart(list_head->deadline - TimerTickCounter);
+        }
+    }
+}
+
+static void bench(uint32_t n) {
+    static struct list_timer_s list_timers[NB_TIMERS];
+    uint32_t *values = malloc(n * sizeof(uint32_t));
+    uint32_t *ids = malloc(n * sizeof(uint32_t));
+    uint32_t running, i;
+    uint64_t t0, t_heap, t_list;
+
+    for (i = 0; i < n; i++) {
+        values[i] = 1000 + lrand48() % 100000;
+    }
+    printf("timers     heap ns/restart   list ns/restart\n");
+    for (running = 1; running <= NB_TIMERS; running *= 2) {
+        for (i = 0; i < n; i++) {
+            ids[i] = lrand48() % running;
+        }
+
+        reset_all();
+        for (i = 0; i < running; i++) {
+            start(i, values[i]);
+        }
+        t0 = now_ns();
+        for (i = 0; i < n; i++) {
+            TimerSetValue(&timers[ids[i]], values[i]);
+            TimerStart(&timers[ids[i]]);
+        }
+        t_heap = now_ns() - t0;
+
+        list_head = NULL;
+        for (i = 0; i < running; i++) {
+            list_start(&list_timers[i], values[i]);
+        }
+        t0 = now_ns();
+        for (i = 0; i < n; i++) {
+            list_stop(&list_timers[ids[i]]);
+            list_start(&list_timers[ids[i]], values[i]);
+        }
+        t_list = now_ns() - t0;
+
+        printf("%6u     %15.1f   %15.1f\n", running, (double)t_heap / n, (double)t_list / n);
+        if (running < NB_TIMERS && running * 2 > NB_TIMERS) {
+            running = NB_TIMERS / 2;
+        }
+    }
+    reset_all();
+    free(values);
+    free(ids);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b N] [-s seed]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    long seed = 1;
+    int n = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b': n = atoi(optarg); break;
+            case 's': seed = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n <= 0) {
+        return run_tests();
+    }
+    srand48(seed);
+    bench(n);
+    return 0;
+}
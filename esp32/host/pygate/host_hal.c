@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Host stand-ins for the port functions used by the packet forwarder
+ * sources, so that they can be built and exercised on Linux.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp32_mphal.h"
+#include "py/mpprint.h"
+
+const mp_print_t mp_plat_print = {NULL};
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+
+    (void)print;
+    va_start(ap, fmt);
+    ret = vprintf(fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+uint32_t mp_hal_ticks_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+uint32_t mp_hal_ticks_ms(void) {
+    return mp_hal_ticks_us() / 1000;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Forwarder and HAL symbols needed by jitqueue.c for the unit tests, which
+ * do not link lora_pkt_fwd.c and loragw_hal.c.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "loragw_hal.h"
+
+int debug_level = 0;
+
+/* Same computation as loragw_hal.c, LoRa only */
+uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
+    uint16_t BW;
+    uint8_t SF, H, DE;
+    double Tsym, Tpreamble, Tpayload;
+    uint32_t payloadSymbNb;
+
+    if ((packet == NULL) || (packet->modulation != MOD_LORA)) {
+        return 0;
+    }
+
+    switch (packet->bandwidth) {
+        case BW_500KHZ: BW = 500; break;
+        case BW_250KHZ: BW = 250; break;
+        case BW_125KHZ: BW = 125; break;
+        default: return 0;
+    }
+    for (SF = 7; SF <= 12; SF++) {
+        if (packet->datarate == (DR_LORA_SF7 << (SF - 7))) {
+            break;
+        }
+    }
+    if (SF > 12) {
+        return 0;
+    }
+
+    Tsym = pow(2, SF) / BW;
+    Tpreamble = (8 + 4.25) * Tsym;
+    H = (packet->no_header == false) ? 0 : 1;
+    DE = (SF >= 11) ? 1 : 0;
+    payloadSymbNb = 8 + (ceil((double)(8 * packet->size - 4 * SF + 28 + 16 - 20 * H) / (double)(4 * (SF - 2 * DE))) * (packet->coderate + 4));
+    Tpayload = payloadSymbNb * Tsym;
+
+    return Tpreamble + Tpayload;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Host stand-ins for the FreeRTOS, IDF and machine module functions used by
+ * lora_pkt_fwd.c: tasks are pthreads, and the forwarder leaving its task
+ * (vTaskDelete or esp_restart) ends that thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp32_mphal.h"
+#include "modmachine.h"
+#include "machpin.h"
+#include "sim.h"
+
+struct host_task_s {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *params;
+};
+
+static _sig_func_cb_ptr pygate_sig_handler = NULL;
+static volatile machine_pygate_states_t pygate_status = PYGATE_STOPPED;
+
+pin_obj_t PIN_MODULE_P8;
+pin_obj_t PIN_MODULE_P12;
+
+static void *task_entry(void *arg) {
+    struct host_task_s *task = arg;
+
+    task->fn(task->params);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *params, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+    struct host_task_s *task;
+
+    (void)name;
+    (void)stack_depth;
+    (void)prio;
+    (void)core;
+
+    task = calloc(1, sizeof *task);
+    if (task == NULL) {
+        return 0;
+    }
+    task->fn = fn;
+    task->params = params;
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        free(task);
+        return 0;
+    }
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    /* only self deletion is used by the forwarder */
+    (void)task;
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts;
+
+    ts.tv_sec = (ticks * portTICK_PERIOD_MS) / 1000;
+    ts.tv_nsec = ((ticks * portTICK_PERIOD_MS) % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return mp_hal_ticks_ms() / portTICK_PERIOD_MS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    (void)task;
+    return 0;
+}
+
+uint32_t xPortGetFreeHeapSize(void) {
+    return 0;
+}
+
+void esp_restart(void) {
+    /* the forwarder restarts the board after a clean stop */
+    pthread_exit(NULL);
+}
+
+void mp_hal_set_interrupt_char(int c) {
+    (void)c;
+}
+
+void mp_hal_set_signal_exit_cb(_sig_func_cb_ptr fun) {
+    (void)fun;
+}
+
+bool mach_is_rtc_synced(void) {
+    return true;
+}
+
+void machine_register_pygate_sig_handler(_sig_func_cb_ptr sig_handler) {
+    pygate_sig_handler = sig_handler;
+}
+
+void machine_pygate_set_status(machine_pygate_states_t status) {
+    pygate_status = status;
+}
+
+void pin_config(pin_obj_t *self, int af_in, int af_out, unsigned int mode, unsigned int pull, int value) {
+    (void)af_in;
+    (void)af_out;
+    (void)mode;
+    (void)pull;
+    self->value = value;
+}
+
+void pin_set_value(const pin_obj_t *self) {
+    (void)self;
+}
+
+void host_task_join(TaskHandle_t task) {
+    pthread_join(((struct host_task_s *)task)->thread, NULL);
+}
+
+/* what machine.pygate_deinit() does on target */
+void host_pygate_signal(int sig) {
+    if (pygate_sig_handler != NULL) {
+        pygate_sig_handler(sig);
+    }
+}
+
+int host_pygate_status(void) {
+    return pygate_status;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Host simulation of the Pygate forwarder: a concentrator stand-in fed by
+ * RF traces (sim_concentrator.c), a network server stand-in on local UDP
+ * sockets (sim_server.c) and the FreeRTOS/port glue (host_rtos.c).
+ */
+
+#ifndef PYGATE_HOST_SIM_H_
+#define PYGATE_HOST_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+/* --- CLOCK ---------------------------------------------------------------- */
+
+static inline uint64_t sim_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* min / max / sum of a series of microsecond samples */
+struct sim_series_s {
+    uint32_t n;
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+};
+
+void sim_series_add(struct sim_series_s *s, int64_t v);
+void sim_series_print(const char *name, const struct sim_series_s *s);
+
+/* --- CONCENTRATOR --------------------------------------------------------- */
+
+/* One uplink as heard by the concentrator, time_us from RX start */
+struct sim_rf_event_s {
+    uint32_t time_us;
+    uint32_t freq_hz;
+    uint8_t sf;
+    uint16_t bw_khz;
+    uint8_t status;
+    float rssi;
+    float snr;
+    uint16_t size;
+};
+
+struct sim_concentrator_stats_s {
+    uint32_t rx_events;         /* uplinks in the trace that became due */
+    uint32_t rx_fetched;        /* handed to the forwarder by lgw_receive */
+    uint32_t rx_nochan;         /* no IF chain configured for the channel */
+    uint32_t rx_overflow;       /* RX FIFO full when the packet arrived */
+    uint32_t rx_tx_lost;        /* arrived while transmitting, or flushed by the post-TX reset */
+    uint32_t tx_sent;
+    uint32_t tx_late;           /* TX timestamp already passed at hand-off */
+    uint32_t tx_unmatched;      /* not found in the server downlink ledger */
+    struct sim_series_s tx_margin;      /* scheduled TX time - hand-off time */
+    struct sim_series_s tx_handoff;     /* hand-off time - PULL_RESP sent by the server */
+};
+
+int sim_concentrator_load(const struct sim_rf_event_s *events, uint32_t nb_events);
+uint32_t sim_concentrator_counter(void);
+bool sim_concentrator_started(void);
+bool sim_concentrator_idle(void);
+void sim_concentrator_get_stats(struct sim_concentrator_stats_s *stats);
+
+/* --- NETWORK SERVER ------------------------------------------------------- */
+
+struct sim_server_conf_s {
+    uint16_t port_up;
+    uint16_t port_down;
+    uint32_t downlink_every;    /* answer one uplink out of N with a class A downlink, 0 = never */
+    uint32_t rx1_delay_us;
+};
+
+struct sim_server_stats_s {
+    uint32_t push_data;
+    uint32_t rxpk;
+    uint32_t stat;
+    uint32_t pull_data;
+    uint32_t pull_resp;
+    uint32_t tx_ack;
+    uint32_t tx_ack_error;
+    struct sim_series_s uplink_latency;     /* PUSH_DATA received - packet count_us */
+};
+
+int sim_server_start(const struct sim_server_conf_s *conf);
+void sim_server_stop(void);
+uint32_t sim_server_pending(void);
+void sim_server_get_stats(struct sim_server_stats_s *stats, uint64_t *cpu_ns);
+
+/* Downlink ledger: the server records when it sent the PULL_RESP for a TX
+   timestamp, the concentrator looks it up when the packet is handed over */
+void sim_ledger_add(uint32_t count_us, uint64_t sent_us);
+bool sim_ledger_take(uint32_t count_us, uint64_t *sent_us);
+
+/* --- PORT GLUE ------------------------------------------------------------ */
+
+void host_task_join(TaskHandle_t task);
+void host_pygate_signal(int sig);
+int host_pygate_status(void);
+
+#endif // PYGATE_HOST_SIM_H_
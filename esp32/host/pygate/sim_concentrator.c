@@ -0,0 +1,724 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Simulated SX1308 concentrator, standing in for concentrator/cmd_manager.c
+ * behind hal/loragw_com_esp.c so that the HAL above it runs unmodified.
+ *
+ * Register accesses go to a register file initialised from the HAL register
+ * map, with just enough of the arbiter/AGC MCU behaviour emulated for
+ * lgw_start() to succeed (firmware readback, version words, calibration
+ * status and the AGC init handshake). lgw_receive() is served from an RF
+ * trace played against the concentrator counter, lgw_send() blocks until
+ * the end of the emission like the real command does, during which the
+ * radio is deaf.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "sim.h"
+
+extern const struct lgw_reg_s loregs[LGW_TOTALREGS];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CMD_HEADER_SIZE         4 /* id + len_msb + len_lsb + status */
+#define CMD_DATA_TX_SIZE        (1024 + 16 * 44) /* MAX_FIFO + 16 * METADATA_SIZE_ALIGNED */
+#define CMD_OK                  1
+#define CMD_K0                  0
+#define ACK_OK                  1
+#define ACK_K0                  0
+#define FWVERSION               0x010a0006
+
+#define REG_PAGES               4
+#define REG_ADDRS               128
+#define PROM_SIZE               8192
+#define MCU_RAM_SIZE            256
+
+#define FW_VERSION_ADDR         0x20
+#define FW_VERSION_CAL          2
+#define FW_VERSION_AGC          4
+#define FW_VERSION_ARB          1
+#define AGC_CMD_WAIT            16
+#define AGC_CMD_ABORT           17
+#define AGC_LUT_SIZE            16
+#define CAL_STATUS_ALL_OK       0xFF
+#define SX1257_VERSION          0x21
+
+#define RX_FIFO_BYTES           1024
+#define TX_TIMEOUT_US           10000000
+#define CHAN_TOLERANCE_HZ       1000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+enum agc_mode_e {
+    AGC_OFF,
+    AGC_CAL,        /* calibration firmware */
+    AGC_INIT,       /* AGC firmware, waiting for the init handshake */
+    AGC_RUN         /* AGC firmware, init done: concentrator started */
+};
+
+struct rx_slot_s {
+    uint32_t index;
+    uint32_t count_us;
+    uint8_t if_chain;
+    uint8_t rf_chain;
+    uint32_t freq_hz;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t mx_sim = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t buf_to_host[CMD_HEADER_SIZE + CMD_DATA_TX_SIZE];
+
+/* register file, page independent addresses live in page 0 */
+static uint8_t regs[REG_PAGES][REG_ADDRS];
+static uint8_t regs_dflt[REG_PAGES][REG_ADDRS];
+static bool reg_common[REG_ADDRS];
+static bool regs_ready = false;
+
+/* MCU emulation */
+static uint8_t prom[PROM_SIZE];
+static uint16_t prom_wptr;
+static uint16_t prom_rptr;
+static uint8_t arb_ram[MCU_RAM_SIZE];
+static uint8_t radio_regs[LGW_RF_CHAIN_NB][0x80];
+static uint8_t agc_ram[MCU_RAM_SIZE];
+static uint8_t mcu_rst = 0x03;
+static enum agc_mode_e agc_mode = AGC_OFF;
+static uint8_t agc_status;
+static bool agc_wait;
+static int agc_phase;
+static int agc_lut_idx;
+
+/* radio configuration, as sent by lgw_rxrf_setconf / lgw_rxif_setconf */
+static bool rf_enable[LGW_RF_CHAIN_NB];
+static uint32_t rf_freq[LGW_RF_CHAIN_NB];
+static bool if_enable[LGW_IF_CHAIN_NB];
+static uint8_t if_rf_chain[LGW_IF_CHAIN_NB];
+static int32_t if_freq[LGW_IF_CHAIN_NB];
+static uint8_t if_bandwidth[LGW_IF_CHAIN_NB];
+static uint32_t if_datarate[LGW_IF_CHAIN_NB];
+
+/* time base */
+static uint64_t t0_us;
+static uint32_t rx_origin;
+static bool started = false;
+
+/* RF trace and RX FIFO */
+static const struct sim_rf_event_s *rf_events;
+static uint32_t rf_nb_events;
+static uint32_t rf_cursor;
+static struct rx_slot_s fifo[LGW_PKT_FIFO_SIZE];
+static int fifo_head;
+static int fifo_count;
+static int fifo_bytes;
+
+/* TX in progress, the radio does not receive */
+static bool tx_busy = false;
+static uint32_t tx_start;
+static uint32_t tx_end;
+
+static struct sim_concentrator_stats_s stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t counter(void) {
+    return (uint32_t)(sim_now_us() - t0_us);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_float(uint8_t *p, float f) {
+    uint32_t v;
+
+    memcpy(&v, &f, sizeof v);
+    put_le32(p, v);
+}
+
+static void regs_init(void) {
+    int i, j, page, nb;
+    struct lgw_reg_s r;
+
+    memset(regs_dflt, 0, sizeof regs_dflt);
+    for (i = 0; i < LGW_TOTALREGS; i++) {
+        r = loregs[i];
+        page = (r.page < 0) ? 0 : r.page;
+        if (r.page < 0) {
+            reg_common[r.addr] = true;
+        }
+        if ((r.offs + r.leng) <= 8) {
+            regs_dflt[page][r.addr] |= ((r.dflt & ((1 << r.leng) - 1)) << r.offs);
+        } else {
+            nb = (r.leng + 7) / 8;
+            for (j = 0; (j < nb) && (r.addr + j < REG_ADDRS); j++) {
+                regs_dflt[page][r.addr + j] = (uint8_t)(r.dflt >> (8 * j));
+            }
+        }
+    }
+    regs_ready = true;
+}
+
+static void soft_reset(void) {
+    if (!regs_ready) {
+        regs_init();
+    }
+    memcpy(regs, regs_dflt, sizeof regs);
+    mcu_rst = 0x03;
+    agc_mode = AGC_OFF;
+    agc_status = 0;
+}
+
+static uint8_t *reg_at(uint8_t addr) {
+    addr &= (REG_ADDRS - 1);
+    if (reg_common[addr]) {
+        return &regs[0][addr];
+    }
+    return &regs[regs[0][0] & 0x03][addr];
+}
+
+/* true if addr on the current page is the byte holding register id */
+static bool reg_is(uint16_t id, uint8_t addr) {
+    const struct lgw_reg_s *r = &loregs[id];
+
+    if (r->addr != (addr & (REG_ADDRS - 1))) {
+        return false;
+    }
+    return (r->page < 0) || (r->page == (regs[0][0] & 0x03));
+}
+
+static uint8_t reg_value(uint16_t id) {
+    const struct lgw_reg_s *r = &loregs[id];
+
+    return regs[(r->page < 0) ? 0 : r->page][r->addr];
+}
+
+static void agc_command(uint8_t val) {
+    switch (agc_phase) {
+        case 0: /* TX gain LUT entries, or abort */
+            if (val == AGC_CMD_ABORT) {
+                agc_status = 0x30;
+                agc_phase = 1;
+            } else {
+                agc_status = 0x30 + agc_lut_idx;
+                if (++agc_lut_idx == AGC_LUT_SIZE) {
+                    agc_phase = 1;
+                }
+            }
+            break;
+        case 1: /* TX frequency MSBs */
+            agc_status = 0x30 + val;
+            agc_phase = 2;
+            break;
+        case 2: /* chan_select option */
+            agc_status = 0x30;
+            agc_phase = 3;
+            break;
+        default: /* final RADIO_SELECT value, init done */
+            agc_status = 0x40;
+            agc_mode = AGC_RUN;
+            rx_origin = counter();
+            started = true;
+            break;
+    }
+}
+
+static void mcu_reset_write(uint8_t val) {
+    uint8_t released = mcu_rst & ~val;
+
+    if (released & 0x01) {
+        arb_ram[FW_VERSION_ADDR] = FW_VERSION_ARB;
+    }
+    if (released & 0x02) {
+        /* the firmware reads its configuration word at boot: the
+           calibration command always has bit 4 set, AGC init needs 0 */
+        memset(agc_ram, 0, sizeof agc_ram);
+        if (reg_value(LGW_RADIO_SELECT) & 0x10) {
+            agc_mode = AGC_CAL;
+            agc_ram[FW_VERSION_ADDR] = FW_VERSION_CAL;
+            agc_status = CAL_STATUS_ALL_OK;
+        } else {
+            agc_mode = AGC_INIT;
+            agc_ram[FW_VERSION_ADDR] = FW_VERSION_AGC;
+            agc_status = 0x10;
+            agc_wait = false;
+            agc_phase = 0;
+            agc_lut_idx = 0;
+        }
+    } else if (val & ~mcu_rst & 0x02) {
+        agc_mode = AGC_OFF;
+        agc_status = 0;
+    }
+    mcu_rst = val & 0x03;
+}
+
+/* SX125x radios behind the SPI master registers: the transfer happens on
+   the rising edge of CS, the PLL always locks */
+static void radio_spi(int rf_chain) {
+    static const uint16_t spi_regs[LGW_RF_CHAIN_NB][3] = {
+        { LGW_SPI_RADIO_A__ADDR, LGW_SPI_RADIO_A__DATA, LGW_SPI_RADIO_A__DATA_READBACK },
+        { LGW_SPI_RADIO_B__ADDR, LGW_SPI_RADIO_B__DATA, LGW_SPI_RADIO_B__DATA_READBACK }
+    };
+    const struct lgw_reg_s *rb = &loregs[spi_regs[rf_chain][2]];
+    uint8_t addr = reg_value(spi_regs[rf_chain][0]);
+    uint8_t val;
+
+    if (addr & 0x80) {
+        radio_regs[rf_chain][addr & 0x7F] = reg_value(spi_regs[rf_chain][1]);
+        return;
+    }
+    switch (addr) {
+        case 0x07: val = SX1257_VERSION; break;
+        case 0x11: val = (radio_regs[rf_chain][0x00] & 0x02) ? 0x02 : 0x00; break;
+        default: val = radio_regs[rf_chain][addr & 0x7F]; break;
+    }
+    regs[(rb->page < 0) ? 0 : rb->page][rb->addr] = val;
+}
+
+static void reg_write(uint8_t addr, uint8_t val) {
+    addr &= (REG_ADDRS - 1);
+
+    if (addr == loregs[LGW_PAGE_REG].addr) {
+        if (val & 0x80) {
+            soft_reset();
+        }
+        regs[0][0] = val & 0x03;
+        return;
+    }
+    if (reg_is(LGW_MCU_PROM_DATA, addr)) {
+        prom[prom_wptr++ % PROM_SIZE] = val;
+        return;
+    }
+
+    *reg_at(addr) = val;
+
+    if (reg_is(LGW_MCU_PROM_ADDR, addr)) {
+        prom_wptr = prom_rptr = val;
+    } else if (reg_is(LGW_MCU_RST_0, addr)) {
+        mcu_reset_write(val);
+    } else if (reg_is(LGW_SPI_RADIO_A__CS, addr) && (val & 0x01)) {
+        radio_spi(0);
+    } else if (reg_is(LGW_SPI_RADIO_B__CS, addr) && (val & 0x01)) {
+        radio_spi(1);
+    } else if (reg_is(LGW_RADIO_SELECT, addr) && (agc_mode == AGC_INIT)) {
+        if (!agc_wait) {
+            agc_wait = (val == AGC_CMD_WAIT);
+        } else {
+            agc_wait = false;
+            agc_command(val);
+        }
+    }
+}
+
+static uint8_t reg_read(uint8_t addr, bool burst) {
+    addr &= (REG_ADDRS - 1);
+
+    if (reg_is(LGW_MCU_PROM_DATA, addr)) {
+        /* a single read only primes the read pointer, see load_firmware() */
+        return burst ? prom[prom_rptr++ % PROM_SIZE] : prom[prom_rptr % PROM_SIZE];
+    }
+    if (reg_is(LGW_MCU_AGC_STATUS, addr)) {
+        return agc_status;
+    }
+    if (reg_is(LGW_DBG_AGC_MCU_RAM_DATA, addr)) {
+        return agc_ram[reg_value(LGW_DBG_AGC_MCU_RAM_ADDR)];
+    }
+    if (reg_is(LGW_DBG_ARB_MCU_RAM_DATA, addr)) {
+        return arb_ram[reg_value(LGW_DBG_ARB_MCU_RAM_ADDR)];
+    }
+    return *reg_at(addr);
+}
+
+static uint8_t sf_to_dr(uint8_t sf) {
+    return (sf >= 7 && sf <= 12) ? (DR_LORA_SF7 << (sf - 7)) : DR_UNDEFINED;
+}
+
+static uint8_t khz_to_bw(uint16_t bw_khz) {
+    switch (bw_khz) {
+        case 500: return BW_500KHZ;
+        case 250: return BW_250KHZ;
+        case 125: return BW_125KHZ;
+        default: return BW_UNDEFINED;
+    }
+}
+
+/* find the IF chain demodulating this uplink, -1 if none is configured */
+static int rx_channel(const struct sim_rf_event_s *ev, uint32_t *center) {
+    int i;
+    int64_t c;
+
+    for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+        if (!if_enable[i] || !rf_enable[if_rf_chain[i]]) {
+            continue;
+        }
+        c = (int64_t)rf_freq[if_rf_chain[i]] + if_freq[i];
+        if (llabs((int64_t)ev->freq_hz - c) > CHAN_TOLERANCE_HZ) {
+            continue;
+        }
+        if (i < LGW_MULTI_NB) {
+            if (ev->bw_khz != 125) {
+                continue;
+            }
+        } else if (i == 8) {
+            if ((khz_to_bw(ev->bw_khz) != if_bandwidth[i]) || !(if_datarate[i] & sf_to_dr(ev->sf))) {
+                continue;
+            }
+        } else {
+            continue; /* FSK */
+        }
+        *center = (uint32_t)c;
+        return i;
+    }
+    return -1;
+}
+
+/* move the uplinks that are due at `now` from the trace to the RX FIFO */
+static void rx_advance(uint32_t now) {
+    const struct sim_rf_event_s *ev;
+    struct rx_slot_s *slot;
+    uint32_t t, center = 0;
+    int chan;
+
+    if (!started) {
+        return;
+    }
+    while (rf_cursor < rf_nb_events) {
+        ev = &rf_events[rf_cursor];
+        t = rx_origin + ev->time_us;
+        if ((int32_t)(now - t) < 0) {
+            break;
+        }
+        stats.rx_events++;
+        chan = rx_channel(ev, &center);
+        if (tx_busy && ((int32_t)(t - tx_start) >= 0) && ((int32_t)(tx_end - t) >= 0)) {
+            stats.rx_tx_lost++;
+        } else if (chan < 0) {
+            stats.rx_nochan++;
+        } else if ((fifo_count == LGW_PKT_FIFO_SIZE) || (fifo_bytes + ev->size > RX_FIFO_BYTES)) {
+            stats.rx_overflow++;
+        } else {
+            slot = &fifo[(fifo_head + fifo_count) % LGW_PKT_FIFO_SIZE];
+            slot->index = rf_cursor;
+            slot->count_us = t;
+            slot->if_chain = chan;
+            slot->rf_chain = if_rf_chain[chan];
+            slot->freq_hz = center;
+            fifo_count++;
+            fifo_bytes += ev->size;
+        }
+        rf_cursor++;
+    }
+}
+
+/* serialise one packet in the aligned layout expected by lgw_mcu_receive() */
+static int rx_serialise(const struct rx_slot_s *slot, uint8_t *out) {
+    const struct sim_rf_event_s *ev = &rf_events[slot->index];
+    uint32_t seed = slot->index * 2654435761u + 1;
+    int i;
+
+    memset(out, 0, LGW_PKT_RX_METADATA_SIZE_ALIGNED);
+    put_le32(&out[0], slot->freq_hz);
+    out[4] = slot->if_chain;
+    out[5] = ev->status;
+    put_le32(&out[8], slot->count_us);
+    out[12] = slot->rf_chain;
+    out[13] = MOD_LORA;
+    out[14] = khz_to_bw(ev->bw_khz);
+    put_le32(&out[16], sf_to_dr(ev->sf));
+    out[20] = CR_LORA_4_5;
+    put_float(&out[24], ev->rssi);
+    put_float(&out[28], ev->snr);
+    put_float(&out[32], ev->snr - 1.0f);
+    put_float(&out[36], ev->snr + 1.0f);
+    out[42] = (uint8_t)ev->size;
+    out[43] = (uint8_t)(ev->size >> 8);
+
+    /* LoRaWAN looking payload: unconfirmed data up, DevAddr and FCnt
+       derived from the trace line so the forwarder logs are readable */
+    out += LGW_PKT_RX_METADATA_SIZE_ALIGNED;
+    for (i = 0; i < ev->size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        out[i] = seed >> 16;
+    }
+    if (ev->size >= 8) {
+        out[0] = 0x40;
+        put_le32(&out[1], 0x26000000 | (slot->index & 0xFF));
+        out[5] = 0;
+        out[6] = (uint8_t)slot->index;
+        out[7] = (uint8_t)(slot->index >> 8);
+    }
+    return LGW_PKT_RX_METADATA_SIZE_ALIGNED + ev->size;
+}
+
+static int cmd_receive(uint8_t max_pkt) {
+    int nb = 0, len = 1;
+    struct rx_slot_s *slot;
+
+    pthread_mutex_lock(&mx_sim);
+    rx_advance(counter());
+    while ((nb < max_pkt) && (fifo_count > 0)) {
+        slot = &fifo[fifo_head];
+        len += rx_serialise(slot, &buf_to_host[CMD_HEADER_SIZE + len]);
+        fifo_head = (fifo_head + 1) % LGW_PKT_FIFO_SIZE;
+        fifo_count--;
+        fifo_bytes -= rf_events[slot->index].size;
+        nb++;
+    }
+    stats.rx_fetched += nb;
+    pthread_mutex_unlock(&mx_sim);
+
+    buf_to_host[CMD_HEADER_SIZE] = nb;
+    return len;
+}
+
+static int cmd_send(const uint8_t *data) {
+    struct lgw_pkt_tx_s pkt;
+    uint64_t sent_us;
+    uint32_t now, toa_us;
+    int32_t margin;
+
+    memset(&pkt, 0, sizeof pkt);
+    pkt.freq_hz = get_le32(&data[0]);
+    pkt.tx_mode = data[4];
+    pkt.count_us = get_le32(&data[8]);
+    pkt.rf_chain = data[12];
+    pkt.rf_power = (int8_t)data[13];
+    pkt.modulation = data[14];
+    pkt.bandwidth = data[15];
+    pkt.datarate = get_le32(&data[16]);
+    pkt.coderate = data[20];
+    pkt.invert_pol = data[21];
+    pkt.f_dev = data[22];
+    pkt.preamble = data[24] | (data[25] << 8);
+    pkt.no_crc = data[26];
+    pkt.no_header = data[27];
+    pkt.size = data[28] | (data[29] << 8);
+    toa_us = lgw_time_on_air(&pkt) * 1000;
+
+    pthread_mutex_lock(&mx_sim);
+    now = counter();
+    rx_advance(now);
+    if (pkt.tx_mode == TIMESTAMPED) {
+        margin = (int32_t)(pkt.count_us - now);
+        sim_series_add(&stats.tx_margin, margin);
+        if (margin < 0) {
+            stats.tx_late++;
+        }
+        if (sim_ledger_take(pkt.count_us, &sent_us)) {
+            sim_series_add(&stats.tx_handoff, (int64_t)(sim_now_us() - sent_us));
+        } else {
+            stats.tx_unmatched++;
+        }
+        tx_start = (margin > 0) ? pkt.count_us : now;
+    } else {
+        tx_start = now;
+    }
+    tx_end = tx_start + toa_us;
+    tx_busy = true;
+    pthread_mutex_unlock(&mx_sim);
+
+    /* like the real command, answer once the packet has been emitted */
+    while (((int32_t)(tx_end - counter()) > 0) && ((int32_t)(counter() - now) < TX_TIMEOUT_US)) {
+        usleep(200);
+    }
+
+    pthread_mutex_lock(&mx_sim);
+    rx_advance(counter());
+    /* the SX1308 is reset after each TX, losing what was in the FIFO */
+    stats.rx_tx_lost += fifo_count;
+    fifo_count = 0;
+    fifo_bytes = 0;
+    tx_busy = false;
+    stats.tx_sent++;
+    pthread_mutex_unlock(&mx_sim);
+    return 0;
+}
+
+static void answer(char id, uint16_t len, uint8_t status) {
+    buf_to_host[0] = id;
+    buf_to_host[1] = (uint8_t)(len >> 8);
+    buf_to_host[2] = (uint8_t)len;
+    buf_to_host[3] = status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int cmd_manager_DecodeCmd(uint8_t *BufFromHost) {
+    uint16_t len = (BufFromHost[1] << 8) | BufFromHost[2];
+    uint8_t addr = BufFromHost[3];
+    uint8_t *data = &BufFromHost[4];
+    uint32_t v;
+    int i, size;
+
+    if (!regs_ready) {
+        soft_reset();
+        t0_us = sim_now_us();
+    }
+
+    switch (BufFromHost[0]) {
+        case 'r':
+            buf_to_host[CMD_HEADER_SIZE] = reg_read(addr, false);
+            answer('r', 1, ACK_OK);
+            return CMD_OK;
+        case 's':
+        case 't':
+        case 'u':
+        case 'p':
+            size = (data[0] << 8) | data[1];
+            if (size > CMD_DATA_TX_SIZE) {
+                answer(BufFromHost[0], 0, ACK_K0);
+                return CMD_OK;
+            }
+            for (i = 0; i < size; i++) {
+                buf_to_host[CMD_HEADER_SIZE + i] = reg_read(addr + (reg_is(LGW_MCU_PROM_DATA, addr) ? 0 : i), true);
+            }
+            answer(BufFromHost[0], size, ACK_OK);
+            return CMD_OK;
+        case 'w':
+            reg_write(addr, data[0]);
+            answer('w', 0, ACK_OK);
+            return CMD_OK;
+        case 'x':
+        case 'y':
+        case 'z':
+        case 'a':
+            for (i = 0; i < len; i++) {
+                reg_write(addr + (reg_is(LGW_MCU_PROM_DATA, addr) ? 0 : i), data[i]);
+            }
+            answer(BufFromHost[0], 0, ACK_OK);
+            return CMD_OK;
+        case 'b':
+            size = cmd_receive(data[0]);
+            answer('b', size, ACK_OK);
+            return CMD_OK;
+        case 'c':
+            if (addr >= LGW_RF_CHAIN_NB) {
+                answer('c', 0, ACK_K0);
+                return CMD_OK;
+            }
+            rf_enable[addr] = data[0];
+            rf_freq[addr] = get_le32(&data[4]);
+            answer('c', 0, ACK_OK);
+            return CMD_OK;
+        case 'd':
+            if (addr >= LGW_IF_CHAIN_NB) {
+                answer('d', 0, ACK_K0);
+                return CMD_OK;
+            }
+            if_enable[addr] = data[0];
+            if_rf_chain[addr] = data[1] % LGW_RF_CHAIN_NB;
+            if_freq[addr] = (int32_t)get_le32(&data[4]);
+            if_bandwidth[addr] = data[8];
+            if_datarate[addr] = get_le32(&data[12]);
+            answer('d', 0, ACK_OK);
+            return CMD_OK;
+        case 'f':
+            answer('f', 0, (cmd_send(data) == 0) ? ACK_OK : ACK_K0);
+            return CMD_OK;
+        case 'q':
+            v = counter();
+            buf_to_host[4] = (uint8_t)(v >> 24);
+            buf_to_host[5] = (uint8_t)(v >> 16);
+            buf_to_host[6] = (uint8_t)(v >> 8);
+            buf_to_host[7] = (uint8_t)v;
+            answer('q', 4, ACK_OK);
+            return CMD_OK;
+        case 'h':
+        case 'i':
+        case 'j':
+            answer(BufFromHost[0], 0, ACK_OK);
+            return CMD_OK;
+        case 'l':
+            v = ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+            memcpy(&buf_to_host[CMD_HEADER_SIZE], "SIMULATE", 8);
+            answer('l', 8, (v == FWVERSION) ? ACK_OK : ACK_K0);
+            return CMD_OK;
+        case 'm':
+            soft_reset();
+            answer('m', 0, ACK_OK);
+            return CMD_OK;
+        default:
+            answer('k', 0, ACK_K0);
+            return CMD_K0;
+    }
+}
+
+size_t cmd_manager_GetCmdToHost_byte(uint32_t index, uint8_t *bufToHost, size_t len) {
+    size_t n;
+
+    if (index >= sizeof buf_to_host) {
+        return -1;
+    }
+    /* the reader may ask for one USB padding byte past the answer */
+    n = sizeof buf_to_host - index;
+    if (len <= n) {
+        memcpy(bufToHost, &buf_to_host[index], len);
+    } else {
+        memcpy(bufToHost, &buf_to_host[index], n);
+        memset(bufToHost + n, 0, len - n);
+    }
+    return len;
+}
+
+int sim_concentrator_load(const struct sim_rf_event_s *events, uint32_t nb_events) {
+    pthread_mutex_lock(&mx_sim);
+    rf_events = events;
+    rf_nb_events = nb_events;
+    rf_cursor = 0;
+    fifo_head = fifo_count = fifo_bytes = 0;
+    memset(&stats, 0, sizeof stats);
+    pthread_mutex_unlock(&mx_sim);
+    return 0;
+}
+
+uint32_t sim_concentrator_counter(void) {
+    return counter();
+}
+
+bool sim_concentrator_started(void) {
+    return started;
+}
+
+/* true once every uplink of the trace has been delivered or dropped */
+bool sim_concentrator_idle(void) {
+    bool idle;
+
+    pthread_mutex_lock(&mx_sim);
+    rx_advance(counter());
+    idle = started && !tx_busy && (rf_cursor == rf_nb_events) && (fifo_count == 0);
+    pthread_mutex_unlock(&mx_sim);
+    return idle;
+}
+
+void sim_concentrator_get_stats(struct sim_concentrator_stats_s *out) {
+    pthread_mutex_lock(&mx_sim);
+    *out = stats;
+    pthread_mutex_unlock(&mx_sim);
+}
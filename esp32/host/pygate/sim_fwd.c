@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Runs the Pygate packet forwarder on Linux against the simulated
+ * concentrator and network server, and reports end-to-end figures.
+ *
+ *   sim_fwd [options] trace        replay an RF trace
+ *   sim_fwd [options] -g N         N random uplinks at -R packets/s
+ *
+ *   -c conf    base configuration (default
+ *              ../pygate/lora_pkt_fwd/global_conf.json), the gateway_conf
+ *              server settings are overridden
+ *   -p port    first of the two UDP ports used by the server (default 17800)
+ *   -d N       answer one uplink out of N with a class A downlink, 0 = never
+ *   -a ms      aggregate uplinks in PUSH_DATA for up to ms (default: conf)
+ *   -s seed    seed for -g
+ *   -v         forwarder logs at debug level
+ *
+ * A trace has one uplink per line, '#' starts a comment:
+ *   <time_us> <freq_hz> <sf> <bw_khz> <OK|BAD|NOCRC> <rssi> <snr> <size>
+ * time_us counts from the moment the concentrator is started.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "parson.h"
+#include "loragw_hal.h"
+#include "sim.h"
+
+#define TRACE_MAX_EVENTS    100000
+#define START_TIMEOUT_US    30000000
+#define DRAIN_GRACE_US      500000
+#define RX1_DELAY_US        1000000
+
+void lora_gw_init(const char *global_conf);
+extern TaskHandle_t xLoraGwTaskHndl;
+
+static struct sim_rf_event_s events[TRACE_MAX_EVENTS];
+
+/* -------------------------------------------------------------------------- */
+/* --- SERIES --------------------------------------------------------------- */
+
+void sim_series_add(struct sim_series_s *s, int64_t v) {
+    if ((s->n == 0) || (v < s->min)) {
+        s->min = v;
+    }
+    if ((s->n == 0) || (v > s->max)) {
+        s->max = v;
+    }
+    s->sum += v;
+    s->n++;
+}
+
+void sim_series_print(const char *name, const struct sim_series_s *s) {
+    if (s->n == 0) {
+        printf("  %-28s -\n", name);
+        return;
+    }
+    printf("  %-28s avg %8.1f ms  min %8.1f ms  max %8.1f ms  (%u)\n", name,
+           s->sum / 1000.0 / s->n, s->min / 1000.0, s->max / 1000.0, s->n);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TRACES --------------------------------------------------------------- */
+
+static int load_trace(const char *path) {
+    char line[256], crc[8];
+    unsigned time_us, freq_hz, sf, bw_khz, size;
+    float rssi, snr;
+    struct sim_rf_event_s *ev;
+    FILE *f;
+    int n = 0;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while ((n < TRACE_MAX_EVENTS) && (fgets(line, sizeof line, f) != NULL)) {
+        if ((line[0] == '#') || (line[0] == '\n')) {
+            continue;
+        }
+        if (sscanf(line, "%u %u %u %u %7s %f %f %u", &time_us, &freq_hz, &sf, &bw_khz, crc, &rssi, &snr, &size) != 8) {
+            fprintf(stderr, "%s: bad line: %s", path, line);
+            fclose(f);
+            return -1;
+        }
+        ev = &events[n++];
+        ev->time_us = time_us;
+        ev->freq_hz = freq_hz;
+        ev->sf = sf;
+        ev->bw_khz = bw_khz;
+        ev->status = !strcasecmp(crc, "OK") ? STAT_CRC_OK : !strcasecmp(crc, "BAD") ? STAT_CRC_BAD : STAT_NO_CRC;
+        ev->rssi = rssi;
+        ev->snr = snr;
+        ev->size = (size > 255) ? 255 : size;
+    }
+    fclose(f);
+    return n;
+}
+
+/* Poisson arrivals on the eight multi-SF channels of the EU868 sample conf */
+static int gen_trace(int nb, double rate) {
+    static const uint32_t chans[8] = { 868100000, 868300000, 868500000, 867100000,
+                                       867300000, 867500000, 867700000, 867900000 };
+    double t = 0;
+    int i;
+
+    if (nb > TRACE_MAX_EVENTS) {
+        nb = TRACE_MAX_EVENTS;
+    }
+    for (i = 0; i < nb; i++) {
+        t += -log(1.0 - drand48()) * 1e6 / rate;
+        events[i].time_us = (uint32_t)t;
+        events[i].freq_hz = chans[lrand48() % 8];
+        events[i].sf = 7 + lrand48() % 6;
+        events[i].bw_khz = 125;
+        events[i].status = (lrand48() % 20) ? STAT_CRC_OK : STAT_CRC_BAD;
+        events[i].rssi = -120 + lrand48() % 80;
+        events[i].snr = -15 + lrand48() % 25;
+        events[i].size = 10 + lrand48() % 50;
+    }
+    return nb;
+}
+
+/* The forwarder takes the configuration as a string, like machine.pygate_init() */
+static char *make_conf(const char *base, uint16_t port, int aggr_ms) {
+    JSON_Value *root;
+    JSON_Object *obj;
+    char *text, *conf;
+    long len;
+    FILE *f;
+
+    f = fopen(base, "r");
+    if (f == NULL) {
+        perror(base);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    text = calloc(1, len + 1);
+    if ((text == NULL) || (fread(text, 1, len, f) != (size_t)len)) {
+        fclose(f);
+        free(text);
+        return NULL;
+    }
+    fclose(f);
+    root = json_parse_string_with_comments(text);
+    free(text);
+    if (root == NULL) {
+        fprintf(stderr, "%s: invalid configuration\n", base);
+        return NULL;
+    }
+
+    obj = json_value_get_object(root);
+    json_object_dotset_string(obj, "gateway_conf.server_address", "127.0.0.1");
+    json_object_dotset_number(obj, "gateway_conf.serv_port_up", port);
+    json_object_dotset_number(obj, "gateway_conf.serv_port_down", port + 1);
+    json_object_dotset_number(obj, "gateway_conf.keepalive_interval", 5);
+    json_object_dotset_number(obj, "gateway_conf.stat_interval", 1);
+    json_object_dotset_number(obj, "gateway_conf.push_timeout_ms", 100);
+    json_object_dotset_boolean(obj, "gateway_conf.forward_crc_valid", 1);
+    json_object_dotset_boolean(obj, "gateway_conf.forward_crc_error", 0);
+    json_object_dotset_boolean(obj, "gateway_conf.forward_crc_disabled", 0);
+    if (aggr_ms >= 0) {
+        json_object_dotset_number(obj, "gateway_conf.aggregate_max_latency_ms", aggr_ms);
+    }
+    conf = json_serialize_to_string(root);
+    json_value_free(root);
+    return conf;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN ----------------------------------------------------------------- */
+
+static uint64_t process_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(void) {
+    printf("usage: sim_fwd [-c conf] [-p port] [-d N] [-a ms] [-v] trace\n"
+           "       sim_fwd [-c conf] [-p port] [-d N] [-a ms] [-v] -g N [-R pps] [-s seed]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *base_conf = "../pygate/lora_pkt_fwd/global_conf.json";
+    char *conf;
+    struct sim_server_conf_s server_conf = { 17800, 17801, 10, RX1_DELAY_US };
+    struct sim_concentrator_stats_s cs;
+    struct sim_server_stats_s ss;
+    uint64_t t_start, t_end, cpu_start, cpu_end, server_cpu, fwd_cpu;
+    double rate = 10.0, secs;
+    long seed = 1;
+    int nb_gen = 0, aggr_ms = -1, nb, i;
+
+    debug_level = LORAPF_WARN_;
+    while ((i = getopt(argc, argv, "c:p:d:a:g:R:s:vh")) != -1) {
+        switch (i) {
+            case 'c': base_conf = optarg; break;
+            case 'p': server_conf.port_up = atoi(optarg); server_conf.port_down = server_conf.port_up + 1; break;
+            case 'd': server_conf.downlink_every = atoi(optarg); break;
+            case 'a': aggr_ms = atoi(optarg); break;
+            case 'g': nb_gen = atoi(optarg); break;
+            case 'R': rate = atof(optarg); break;
+            case 's': seed = atol(optarg); break;
+            case 'v': debug_level = LORAPF_DEBUG; break;
+            default: usage(); return (i == 'h') ? 0 : 2;
+        }
+    }
+
+    if (nb_gen > 0) {
+        srand48(seed);
+        nb = gen_trace(nb_gen, rate);
+    } else if (optind < argc) {
+        nb = load_trace(argv[optind]);
+    } else {
+        usage();
+        return 2;
+    }
+    if (nb <= 0) {
+        return 1;
+    }
+    sim_concentrator_load(events, nb);
+
+    conf = make_conf(base_conf, server_conf.port_up, aggr_ms);
+    if ((conf == NULL) || (sim_server_start(&server_conf) != 0)) {
+        return 1;
+    }
+
+    /* same entry point as machine.pygate_init() */
+    lora_gw_init(conf);
+
+    t_start = sim_now_us();
+    while (!sim_concentrator_started()) {
+        if ((host_pygate_status() == 2) || (sim_now_us() - t_start > START_TIMEOUT_US)) {
+            fprintf(stderr, "sim_fwd: concentrator failed to start\n");
+            return 1;
+        }
+        usleep(1000);
+    }
+    t_start = sim_now_us();
+    cpu_start = process_cpu_ns();
+
+    /* wait for the trace to play out and the last downlinks to be sent */
+    while (!sim_concentrator_idle() || (sim_server_pending() > 0)) {
+        usleep(10000);
+    }
+    usleep(DRAIN_GRACE_US);
+    t_end = sim_now_us();
+    cpu_end = process_cpu_ns();
+
+    /* same as machine.pygate_deinit() */
+    host_pygate_signal(SIGQUIT);
+    host_task_join(xLoraGwTaskHndl);
+    sim_server_stop();
+    json_free_serialized_string(conf);
+
+    sim_concentrator_get_stats(&cs);
+    sim_server_get_stats(&ss, &server_cpu);
+    secs = (t_end - t_start) / 1e6;
+    fwd_cpu = cpu_end - cpu_start - server_cpu;
+
+    printf("duration %.2f s, %u uplinks in the trace\n", secs, nb);
+    printf("uplink\n");
+    printf("  concentrator: %u due, %u fetched, %u no channel, %u FIFO overflow, %u lost to TX\n",
+           cs.rx_events, cs.rx_fetched, cs.rx_nochan, cs.rx_overflow, cs.rx_tx_lost);
+    printf("  server: %u rxpk in %u PUSH_DATA, %.1f rxpk/s\n", ss.rxpk, ss.push_data, ss.rxpk / secs);
+    sim_series_print("latency (RX to server)", &ss.uplink_latency);
+    printf("downlink\n");
+    printf("  server: %u PULL_RESP, %u TX_ACK, %u with error\n", ss.pull_resp, ss.tx_ack, ss.tx_ack_error);
+    printf("  concentrator: %u sent, %u late, %u unmatched\n", cs.tx_sent, cs.tx_late, cs.tx_unmatched);
+    sim_series_print("scheduling (server to HAL)", &cs.tx_handoff);
+    sim_series_print("margin (HAL to TX time)", &cs.tx_margin);
+    printf("cpu\n");
+    printf("  forwarder + HAL: %.1f ms, %.1f us per uplink forwarded, %.1f%% of one core\n",
+           fwd_cpu / 1e6, ss.rxpk ? fwd_cpu / 1e3 / ss.rxpk : 0.0, 100.0 * fwd_cpu / 1e3 / (t_end - t_start));
+    printf("  server stand-in: %.1f ms\n", server_cpu / 1e6);
+
+    return (host_pygate_status() == 0) ? 0 : 1;
+}
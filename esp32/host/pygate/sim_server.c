@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Network server stand-in for the host simulation: acknowledges PUSH_DATA
+ * and PULL_DATA on local UDP sockets, measures the uplink latency from the
+ * packet timestamp, and answers a share of the uplinks with a class A
+ * downlink in RX1 so that the JiT path gets exercised.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "parson.h"
+#include "base64.h"
+#include "sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PROTOCOL_VERSION    2
+
+#define PKT_PUSH_DATA       0
+#define PKT_PUSH_ACK        1
+#define PKT_PULL_DATA       2
+#define PKT_PULL_RESP       3
+#define PKT_PULL_ACK        4
+#define PKT_TX_ACK          5
+
+#define POLL_TIMEOUT_MS     50
+#define LEDGER_SIZE         256
+#define LEDGER_EXPIRE_US    500000
+#define DOWNLINK_SIZE       12
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct sim_server_conf_s conf;
+static int sock_up = -1;
+static int sock_down = -1;
+static pthread_t thrid;
+static volatile bool stop_sig;
+
+static struct sockaddr_in pull_addr;
+static bool pull_addr_known = false;
+static uint16_t resp_token;
+static uint32_t uplinks_seen;
+
+static pthread_mutex_t mx_server = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_server_stats_s stats;
+static uint64_t thread_cpu_ns;
+
+static struct {
+    uint32_t count_us;
+    uint64_t sent_us;
+    bool used;
+} ledger[LEDGER_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int open_socket(uint16_t port) {
+    struct sockaddr_in addr;
+    int s;
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(s, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static void send_downlink(JSON_Object *rxpk) {
+    char json[320];
+    char data64[32];
+    uint8_t buff[4 + sizeof json];
+    uint8_t payload[DOWNLINK_SIZE];
+    uint32_t tmst;
+    int i, len;
+
+    tmst = (uint32_t)json_object_get_number(rxpk, "tmst") + conf.rx1_delay_us;
+    for (i = 0; i < DOWNLINK_SIZE; i++) {
+        payload[i] = (uint8_t)(tmst >> (8 * (i & 3))) ^ i;
+    }
+    payload[0] = 0x60; /* unconfirmed data down */
+    bin_to_b64(payload, DOWNLINK_SIZE, data64, sizeof data64);
+
+    len = snprintf(json, sizeof json,
+                   "{\"txpk\":{\"imme\":false,\"tmst\":%u,\"freq\":%.6f,\"rfch\":0,\"powe\":14,"
+                   "\"modu\":\"LORA\",\"datr\":\"%s\",\"codr\":\"4/5\",\"ipol\":true,"
+                   "\"size\":%d,\"data\":\"%s\"}}",
+                   tmst, json_object_get_number(rxpk, "freq"), json_object_get_string(rxpk, "datr"),
+                   DOWNLINK_SIZE, data64);
+
+    resp_token++;
+    buff[0] = PROTOCOL_VERSION;
+    buff[1] = (uint8_t)(resp_token >> 8);
+    buff[2] = (uint8_t)resp_token;
+    buff[3] = PKT_PULL_RESP;
+    memcpy(&buff[4], json, len);
+
+    sim_ledger_add(tmst, sim_now_us());
+    sendto(sock_down, buff, 4 + len, 0, (struct sockaddr *)&pull_addr, sizeof pull_addr);
+
+    pthread_mutex_lock(&mx_server);
+    stats.pull_resp++;
+    pthread_mutex_unlock(&mx_server);
+}
+
+static void handle_push_data(const uint8_t *buff, int len, struct sockaddr_in *from) {
+    uint8_t ack[4];
+    JSON_Value *root;
+    JSON_Object *obj, *rxpk;
+    JSON_Array *rxpk_arr;
+    uint32_t now = sim_concentrator_counter();
+    size_t i, nb = 0;
+
+    ack[0] = PROTOCOL_VERSION;
+    ack[1] = buff[1];
+    ack[2] = buff[2];
+    ack[3] = PKT_PUSH_ACK;
+    sendto(sock_up, ack, sizeof ack, 0, (struct sockaddr *)from, sizeof *from);
+
+    root = json_parse_string((const char *)(buff + 12));
+    if (root == NULL) {
+        return;
+    }
+    obj = json_value_get_object(root);
+    rxpk_arr = json_object_get_array(obj, "rxpk");
+    if (rxpk_arr != NULL) {
+        nb = json_array_get_count(rxpk_arr);
+    }
+
+    pthread_mutex_lock(&mx_server);
+    stats.push_data++;
+    stats.rxpk += nb;
+    if (json_object_get_object(obj, "stat") != NULL) {
+        stats.stat++;
+    }
+    for (i = 0; i < nb; i++) {
+        rxpk = json_array_get_object(rxpk_arr, i);
+        sim_series_add(&stats.uplink_latency, (int32_t)(now - (uint32_t)json_object_get_number(rxpk, "tmst")));
+    }
+    pthread_mutex_unlock(&mx_server);
+
+    for (i = 0; i < nb; i++) {
+        uplinks_seen++;
+        if ((conf.downlink_every > 0) && pull_addr_known && ((uplinks_seen % conf.downlink_every) == 0)) {
+            send_downlink(json_array_get_object(rxpk_arr, i));
+        }
+    }
+    json_value_free(root);
+}
+
+static void handle_down(const uint8_t *buff, int len, struct sockaddr_in *from) {
+    uint8_t ack[4];
+
+    if (buff[3] == PKT_PULL_DATA) {
+        ack[0] = PROTOCOL_VERSION;
+        ack[1] = buff[1];
+        ack[2] = buff[2];
+        ack[3] = PKT_PULL_ACK;
+        pull_addr = *from;
+        pull_addr_known = true;
+        sendto(sock_down, ack, sizeof ack, 0, (struct sockaddr *)from, sizeof *from);
+        pthread_mutex_lock(&mx_server);
+        stats.pull_data++;
+        pthread_mutex_unlock(&mx_server);
+    } else if (buff[3] == PKT_TX_ACK) {
+        pthread_mutex_lock(&mx_server);
+        stats.tx_ack++;
+        /* the forwarder only attaches a JSON report on error */
+        if (len > 12) {
+            stats.tx_ack_error++;
+        }
+        pthread_mutex_unlock(&mx_server);
+    }
+}
+
+static void *server_thread(void *arg) {
+    struct pollfd fds[2];
+    struct sockaddr_in from;
+    socklen_t from_len;
+    uint8_t buff[4096];
+    struct timespec cpu;
+    int i, len;
+
+    (void)arg;
+    fds[0].fd = sock_up;
+    fds[1].fd = sock_down;
+    fds[0].events = fds[1].events = POLLIN;
+
+    while (!stop_sig) {
+        if (poll(fds, 2, POLL_TIMEOUT_MS) <= 0) {
+            continue;
+        }
+        for (i = 0; i < 2; i++) {
+            if (!(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            from_len = sizeof from;
+            len = recvfrom(fds[i].fd, buff, sizeof buff - 1, 0, (struct sockaddr *)&from, &from_len);
+            if ((len < 4) || (buff[0] != PROTOCOL_VERSION)) {
+                continue;
+            }
+            buff[len] = 0;
+            if ((i == 0) && (buff[3] == PKT_PUSH_DATA) && (len >= 12)) {
+                handle_push_data(buff, len, &from);
+            } else if (i == 1) {
+                handle_down(buff, len, &from);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    thread_cpu_ns = (uint64_t)cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int sim_server_start(const struct sim_server_conf_s *c) {
+    conf = *c;
+    sock_up = open_socket(conf.port_up);
+    sock_down = open_socket(conf.port_down);
+    if ((sock_up < 0) || (sock_down < 0)) {
+        perror("sim_server: bind");
+        return -1;
+    }
+    stop_sig = false;
+    return pthread_create(&thrid, NULL, server_thread, NULL);
+}
+
+void sim_server_stop(void) {
+    stop_sig = true;
+    pthread_join(thrid, NULL);
+    close(sock_up);
+    close(sock_down);
+}
+
+/* downlinks sent whose TX time has not passed yet */
+uint32_t sim_server_pending(void) {
+    uint32_t now = sim_concentrator_counter();
+    uint32_t i, n = 0;
+
+    pthread_mutex_lock(&mx_server);
+    for (i = 0; i < LEDGER_SIZE; i++) {
+        if (ledger[i].used && ((int32_t)(ledger[i].count_us + LEDGER_EXPIRE_US - now) > 0)) {
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&mx_server);
+    return n;
+}
+
+void sim_server_get_stats(struct sim_server_stats_s *out, uint64_t *cpu_ns) {
+    pthread_mutex_lock(&mx_server);
+    *out = stats;
+    pthread_mutex_unlock(&mx_server);
+    *cpu_ns = thread_cpu_ns;
+}
+
+void sim_ledger_add(uint32_t count_us, uint64_t sent_us) {
+    uint32_t now = sim_concentrator_counter();
+    int i, slot = -1;
+
+    pthread_mutex_lock(&mx_server);
+    for (i = 0; i < LEDGER_SIZE; i++) {
+        /* reuse free entries and the ones well past their TX time */
+        if (!ledger[i].used || ((int32_t)(ledger[i].count_us + LEDGER_EXPIRE_US - now) < 0)) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot >= 0) {
+        ledger[slot].count_us = count_us;
+        ledger[slot].sent_us = sent_us;
+        ledger[slot].used = true;
+    }
+    pthread_mutex_unlock(&mx_server);
+}
+
+bool sim_ledger_take(uint32_t count_us, uint64_t *sent_us) {
+    bool found = false;
+    int i;
+
+    pthread_mutex_lock(&mx_server);
+    for (i = 0; i < LEDGER_SIZE; i++) {
+        if (ledger[i].used && (ledger[i].count_us == count_us)) {
+            *sent_us = ledger[i].sent_us;
+            ledger[i].used = false;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mx_server);
+    return found;
+}
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and trace replay benchmark for the JiT downlink queue.
+ *
+ *   test_jitqueue                  run the unit tests
+ *   test_jitqueue [-v] [-r N] trace...
+ *                                  replay downlink traces N times and report
+ *                                  the scheduling results and cost per call
+ *   test_jitqueue -g N [-s seed]   same, on N random class A/B/C downlinks
+ *
+ * A trace has one downlink request per line, '#' starts a comment:
+ *   <arrival_us> <A|B|C|BEACON> <count_us> <sf> <size>
+ * arrival_us is the concentrator time the request reaches the forwarder,
+ * count_us the requested TX timestamp (ignored for class C).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "jitqueue.h"
+
+#define TRACE_MAX_EVENTS    100000
+
+struct trace_event_s {
+    uint32_t arrival_us;
+    uint32_t count_us;
+    enum jit_pkt_type_e type;
+    uint8_t sf;
+    uint16_t size;
+};
+
+static struct jit_queue_s queue;
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static struct timeval tv_of(uint32_t us) {
+    struct timeval tv;
+
+    tv.tv_sec = us / 1000000UL;
+    tv.tv_usec = us % 1000000UL;
+    return tv;
+}
+
+static void make_pkt(struct lgw_pkt_tx_s *pkt, uint32_t count_us, uint8_t sf, uint16_t size) {
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->tx_mode = TIMESTAMPED;
+    pkt->count_us = count_us;
+    pkt->modulation = MOD_LORA;
+    pkt->bandwidth = BW_125KHZ;
+    pkt->datarate = DR_LORA_SF7 << (sf - 7);
+    pkt->coderate = CR_LORA_4_5;
+    pkt->size = size;
+}
+
+static enum jit_error_e enqueue(uint32_t now, enum jit_pkt_type_e type, uint32_t count_us, uint8_t sf, uint16_t size) {
+    struct lgw_pkt_tx_s pkt;
+    struct timeval tv = tv_of(now);
+
+    make_pkt(&pkt, count_us, sf, size);
+    return jit_enqueue(&queue, &tv, &pkt, type);
+}
+
+/* Peek and dequeue like thread_jit does, return the timestamp sent or 0 */
+static uint32_t send_due(uint32_t now) {
+    struct lgw_pkt_tx_s pkt;
+    struct timeval tv = tv_of(now);
+    enum jit_pkt_type_e type;
+    int idx;
+
+    if (jit_peek(&queue, &tv, &idx) != JIT_ERROR_OK || idx < 0) {
+        return 0;
+    }
+    if (jit_dequeue(&queue, idx, &pkt, &type) != JIT_ERROR_OK) {
+        return 0;
+    }
+    return pkt.count_us;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- UNIT TESTS ----------------------------------------------------------- */
+
+static void test_order(void) {
+    static const uint32_t ts[] = {7000000, 3000000, 9000000, 5000000, 4000000};
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e type;
+    struct timeval tv = tv_of(1000000);
+    unsigned i;
+
+    jit_queue_init(&queue);
+    for (i = 0; i < sizeof(ts) / sizeof(ts[0]); i++) {
+        CHECK(enqueue(1000000, JIT_PKT_TYPE_DOWNLINK_CLASS_B, ts[i], 7, 20) == JIT_ERROR_OK);
+    }
+    CHECK(queue.num_pkt == 5);
+    /* dequeue from the middle, then the rest must come out in time order */
+    CHECK(jit_dequeue(&queue, 2, &pkt, &type) == JIT_ERROR_OK);
+    CHECK(pkt.count_us == 5000000);
+    CHECK(jit_dequeue(&queue, 4, &pkt, &type) == JIT_ERROR_INVALID);
+    CHECK(send_due(2999999 - 10000) == 3000000);
+    CHECK(send_due(3999999 - 10000) == 4000000);
+    CHECK(send_due(6999999 - 10000) == 7000000);
+    CHECK(send_due(8000000) == 0);
+    CHECK(send_due(8999999 - 10000) == 9000000);
+    CHECK(jit_peek(&queue, &tv, (int *)&i) == JIT_ERROR_EMPTY);
+}
+
+static void test_collision(void) {
+    jit_queue_init(&queue);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 1000000, 10, 50) == JIT_ERROR_OK);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 3000000, 7, 50) == JIT_ERROR_OK);
+    /* inside the time on air of the SF10 packet */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 1500000, 7, 10) == JIT_ERROR_COLLISION_PACKET);
+    /* pre delay reaching into the next packet */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 2990000, 7, 10) == JIT_ERROR_COLLISION_PACKET);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 3000000, 7, 10) == JIT_ERROR_COLLISION_PACKET);
+    /* gap between the two */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 2700000, 7, 10) == JIT_ERROR_OK);
+    CHECK(queue.num_pkt == 3);
+}
+
+static void test_beacon_guard(void) {
+    jit_queue_init(&queue);
+    CHECK(enqueue(0, JIT_PKT_TYPE_BEACON, 10000000, 9, 17) == JIT_ERROR_OK);
+    CHECK(queue.num_beacon == 1);
+    /* short downlinks queued in front of the beacon, inside its guard */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 8000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 9000000, 7, 10) == JIT_ERROR_OK);
+    /* class B must respect the guard, even with other packets in between */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_B, 7500000, 7, 10) == JIT_ERROR_COLLISION_BEACON);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_B, 6500000, 7, 10) == JIT_ERROR_OK);
+    /* nobody can overlap the beacon itself */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 11000000, 7, 10) == JIT_ERROR_COLLISION_BEACON);
+    /* reported against the first packet in its guard, as before */
+    CHECK(enqueue(0, JIT_PKT_TYPE_BEACON, 11000000, 9, 17) == JIT_ERROR_COLLISION_PACKET);
+    CHECK(enqueue(0, JIT_PKT_TYPE_BEACON, 12500000, 9, 17) == JIT_ERROR_COLLISION_BEACON);
+    CHECK(queue.num_pkt == 4);
+}
+
+static void test_class_c(void) {
+    struct lgw_pkt_tx_s pkt;
+    struct timeval tv = tv_of(0);
+    uint32_t busy_end;
+
+    jit_queue_init(&queue);
+    /* nothing around now + 1s: goes there */
+    make_pkt(&pkt, 0, 7, 10);
+    CHECK(jit_enqueue(&queue, &tv, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_C) == JIT_ERROR_OK);
+    CHECK(pkt.count_us == 1000000);
+    CHECK(pkt.tx_mode == TIMESTAMPED);
+
+    /* no room left between the two packets: goes right after the second one */
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 1100000, 12, 20) == JIT_ERROR_OK);
+    make_pkt(&pkt, 0, 12, 20);
+    busy_end = 1100000 + lgw_time_on_air(&pkt) * 1000;
+    make_pkt(&pkt, 0, 7, 10);
+    CHECK(jit_enqueue(&queue, &tv, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_C) == JIT_ERROR_OK);
+    CHECK(pkt.count_us > busy_end);
+    CHECK(pkt.count_us < busy_end + 200000);
+    CHECK(queue.num_pkt == 3);
+}
+
+static void test_full(void) {
+    int i;
+
+    jit_queue_init(&queue);
+    for (i = 0; i < JIT_QUEUE_MAX; i++) {
+        CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_B, 1000000 + i * 200000, 7, 10) == JIT_ERROR_OK);
+    }
+    CHECK(jit_queue_is_full(&queue));
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_B, 900000000, 7, 10) == JIT_ERROR_FULL);
+    /* slots are recycled */
+    CHECK(send_due(1000000 - 10000) == 1000000);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_B, 100000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(jit_queue_is_full(&queue));
+}
+
+static void test_drop_outdated(void) {
+    struct timeval tv;
+    int idx;
+
+    jit_queue_init(&queue);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 1000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 2000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(enqueue(0, JIT_PKT_TYPE_DOWNLINK_CLASS_A, 60000000, 7, 10) == JIT_ERROR_OK);
+    /* both first packets were missed */
+    tv = tv_of(3000000);
+    CHECK(jit_peek(&queue, &tv, &idx) == JIT_ERROR_OK);
+    CHECK(idx == -1);
+    CHECK(queue.num_pkt == 1);
+    CHECK(send_due(60000000 - 10000) == 60000000);
+}
+
+static void test_rollover(void) {
+    uint32_t now = 0xFFFFFFFFUL - 2000000;
+
+    jit_queue_init(&queue);
+    CHECK(enqueue(now, JIT_PKT_TYPE_DOWNLINK_CLASS_B, now + 4000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(enqueue(now, JIT_PKT_TYPE_DOWNLINK_CLASS_B, now + 1000000, 7, 10) == JIT_ERROR_OK);
+    CHECK(enqueue(now, JIT_PKT_TYPE_DOWNLINK_CLASS_B, now + 4000000 + 1000, 7, 10) == JIT_ERROR_COLLISION_PACKET);
+    CHECK(send_due(now + 1000000 - 10000) == now + 1000000);
+    CHECK(send_due(now + 4000000 - 10000) == now + 4000000);
+}
+
+static int run_tests(void) {
+    test_order();
+    test_collision();
+    test_beacon_guard();
+    test_class_c();
+    test_full();
+    test_drop_outdated();
+    test_rollover();
+    if (failures == 0) {
+        printf("jitqueue: all tests passed\n");
+    }
+    return failures ? 1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TRACE REPLAY --------------------------------------------------------- */
+
+static int parse_type(const char *s, enum jit_pkt_type_e *type) {
+    if (strcasecmp(s, "A") == 0) {
+        *type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
+    } else if (strcasecmp(s, "B") == 0) {
+        *type = JIT_PKT_TYPE_DOWNLINK_CLASS_B;
+    } else if (strcasecmp(s, "C") == 0) {
+        *type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
+    } else if (strcasecmp(s, "BEACON") == 0) {
+        *type = JIT_PKT_TYPE_BEACON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int load_trace(const char *path, struct trace_event_s *ev, int n) {
+    char line[256];
+    char type[16];
+    unsigned long arrival, count;
+    unsigned sf, size;
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%lu %15s %lu %u %u", &arrival, type, &count, &sf, &size) != 5 ||
+                parse_type(type, &ev[n].type) < 0 || sf < 7 || sf > 12 || size > 255) {
+            fprintf(stderr, "%s:%d: invalid trace line\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        if (n == TRACE_MAX_EVENTS) {
+            fprintf(stderr, "%s: too many events\n", path);
+            break;
+        }
+        ev[n].arrival_us = arrival;
+        ev[n].count_us = count;
+        ev[n].sf = sf;
+        ev[n].size = size;
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+/* Class A replies 1s after an uplink, class B in one of the ping slots of the
+ * next ~15s, class C immediately: all arriving in bursts */
+static int gen_trace(struct trace_event_s *ev, int n, unsigned seed) {
+    uint32_t t = 1000000;
+    int i;
+
+    srand(seed);
+    for (i = 0; i < n; i++) {
+        t += (rand() % 8 == 0) ? 200000 + rand() % 2000000 : rand() % 20000;
+        ev[i].arrival_us = t;
+        ev[i].sf = 7 + rand() % 6;
+        ev[i].size = 10 + rand() % 50;
+        switch (rand() % 3) {
+            case 0:
+                ev[i].type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
+                ev[i].count_us = t + 1000000 - rand() % 100000;
+                break;
+            case 1:
+                ev[i].type = JIT_PKT_TYPE_DOWNLINK_CLASS_B;
+                ev[i].count_us = t + 1000000 + (rand() % 512) * 30000;
+                break;
+            default:
+                ev[i].type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
+                ev[i].count_us = 0;
+                break;
+        }
+    }
+    return n;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct replay_stats_s {
+    unsigned results[JIT_ERROR_INVALID + 1];
+    unsigned sent;
+    unsigned late;
+    unsigned enq_calls, peek_calls;
+    uint64_t enq_ns, peek_ns;
+};
+
+/* Advance the concentrator clock to 'until', sending packets as thread_jit
+ * would with its 5ms polling period */
+static void replay_until(uint32_t *clock, uint32_t until, struct replay_stats_s *st) {
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e type;
+    struct timeval tv;
+    uint64_t t0;
+    int idx;
+
+    while ((int32_t)(until - *clock) > 0) {
+        tv = tv_of(*clock);
+        t0 = now_ns();
+        if (jit_peek(&queue, &tv, &idx) == JIT_ERROR_OK && idx >= 0) {
+            jit_dequeue(&queue, idx, &pkt, &type);
+            st->sent++;
+            if ((int32_t)(pkt.count_us - *clock) < 1500) {
+                st->late++;
+            }
+        }
+        st->peek_ns += now_ns() - t0;
+        st->peek_calls++;
+        *clock += 5000;
+    }
+}
+
+static void replay(struct trace_event_s *ev, int n, struct replay_stats_s *st) {
+    struct lgw_pkt_tx_s pkt;
+    struct timeval tv;
+    uint64_t t0;
+    uint32_t clock = ev[0].arrival_us;
+    enum jit_error_e err;
+    int i;
+
+    jit_queue_init(&queue);
+    for (i = 0; i < n; i++) {
+        replay_until(&clock, ev[i].arrival_us, st);
+        make_pkt(&pkt, ev[i].count_us, ev[i].sf, ev[i].size);
+        tv = tv_of(ev[i].arrival_us);
+        t0 = now_ns();
+        err = jit_enqueue(&queue, &tv, &pkt, ev[i].type);
+        st->enq_ns += now_ns() - t0;
+        st->enq_calls++;
+        st->results[err]++;
+    }
+    replay_until(&clock, clock + (JIT_NUM_BEACON_IN_QUEUE + 1) * 128000000UL, st);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-v] [-r repeat] trace...\n"
+                    "       %s [-v] [-r repeat] -g count [-s seed]\n", prog, prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static struct trace_event_s ev[TRACE_MAX_EVENTS];
+    static const char *names[] = {
+        "ok", "too late", "too early", "full", "empty", "collision packet",
+        "collision beacon", "tx freq", "tx power", "gps unlocked", "invalid",
+    };
+    struct replay_stats_s st;
+    int gen = 0, repeat = 1;
+    unsigned seed = 1;
+    int n = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "vr:g:s:")) != -1) {
+        switch (opt) {
+            case 'v': debug_level = LORAPF_DEBUG; break;
+            case 'r': repeat = atoi(optarg); break;
+            case 'g': gen = atoi(optarg); break;
+            case 's': seed = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (gen == 0 && optind == argc) {
+        return run_tests();
+    }
+
+    if (gen > 0) {
+        n = gen_trace(ev, gen > TRACE_MAX_EVENTS ? TRACE_MAX_EVENTS : gen, seed);
+    }
+    for (i = optind; i < argc; i++) {
+        n = load_trace(argv[i], ev, n);
+        if (n < 0) {
+            return 1;
+        }
+    }
+    if (n == 0 || repeat < 1) {
+        usage(argv[0]);
+    }
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < repeat; i++) {
+        replay(ev, n, &st);
+    }
+
+    printf("JIT_QUEUE_MAX=%d, %d downlinks x %d\n", JIT_QUEUE_MAX, n, repeat);
+    for (i = 0; i <= JIT_ERROR_INVALID; i++) {
+        if (st.results[i]) {
+            printf("  %-17s %u\n", names[i], st.results[i] / repeat);
+        }
+    }
+    printf("  sent              %u (%u late)\n", st.sent / repeat, st.late / repeat);
+    printf("  enqueue           %.1f ns/call\n", (double)st.enq_ns / st.enq_calls);
+    printf("  peek+dequeue      %.1f ns/call\n", (double)st.peek_ns / st.peek_calls);
+    return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the rxpk writer and txpk reader.
+ *
+ *   test_pktjson                   run the unit tests
+ *   test_pktjson -b N [-s seed]    format and parse N random packets with
+ *                                  pktjson and with the snprintf / parson code
+ *                                  it replaces, and report packets per second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parson.h"
+#include "base64.h"
+#include "pktjson.h"
+
+#define BENCH_SET           256
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- REFERENCES ----------------------------------------------------------- */
+
+/* rxpk as lora_pkt_fwd.c used to format it */
+static int ref_rxpk(char *out, int max_len, const struct lgw_pkt_rx_s *p) {
+    static const char *sf[] = { "SF7", "SF8", "SF9", "SF10", "SF11", "SF12" };
+    const char *bw, *cr;
+    int n, i;
+
+    n = snprintf(out, max_len, "{\"tmst\":%u", p->count_us);
+    n += snprintf(out + n, max_len - n, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6));
+    n += snprintf(out + n, max_len - n, ",\"stat\":%d", (p->status == STAT_CRC_OK) ? 1 : (p->status == STAT_CRC_BAD) ? -1 : 0);
+    if (p->modulation == MOD_LORA) {
+        for (i = 0; (DR_LORA_SF7 << i) != p->datarate; i++);
+        bw = (p->bandwidth == BW_125KHZ) ? "BW125" : (p->bandwidth == BW_250KHZ) ? "BW250" : "BW500";
+        switch (p->coderate) {
+            case CR_LORA_4_5: cr = "4/5"; break;
+            case CR_LORA_4_6: cr = "4/6"; break;
+            case CR_LORA_4_7: cr = "4/7"; break;
+            case CR_LORA_4_8: cr = "4/8"; break;
+            default: cr = "OFF"; break;
+        }
+        n += snprintf(out + n, max_len - n, ",\"modu\":\"LORA\",\"datr\":\"%s%s\",\"codr\":\"%s\",\"lsnr\":%.1f", sf[i], bw, cr, p->snr);
+    } else {
+        n += snprintf(out + n, max_len - n, ",\"modu\":\"FSK\",\"datr\":%u", p->datarate);
+    }
+    n += snprintf(out + n, max_len - n, ",\"rssi\":%.0f,\"size\":%u,\"data\":\"", p->rssi, p->size);
+    n += bin_to_b64(p->payload, p->size, out + n, 341);
+    n += snprintf(out + n, max_len - n, "\"}");
+    return n;
+}
+
+/* txpk members as lora_pkt_fwd.c used to read them with parson */
+static int ref_txpk(const char *json, struct pktjson_txpk_s *t, uint8_t *payload) {
+    JSON_Value *root, *val;
+    JSON_Object *obj;
+    const char *str;
+    short x0, x1;
+
+    memset(t, 0, sizeof *t);
+    root = json_parse_string_with_comments(json);
+    if (root == NULL) {
+        return PKTJSON_ERR_SYNTAX;
+    }
+    obj = json_object_get_object(json_value_get_object(root), "txpk");
+    if (obj == NULL) {
+        json_value_free(root);
+        return PKTJSON_ERR_NO_TXPK;
+    }
+    if (json_object_get_boolean(obj, "imme") == 1) {
+        t->imme = true;
+    }
+    if ((val = json_object_get_value(obj, "tmst")) != NULL) {
+        t->tmst = (uint32_t)json_value_get_number(val);
+    }
+    if ((val = json_object_get_value(obj, "freq")) != NULL) {
+        t->freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+    }
+    t->rfch = (uint8_t)json_object_get_number(obj, "rfch");
+    t->powe = (int8_t)json_object_get_number(obj, "powe");
+    t->ipol = json_object_get_boolean(obj, "ipol") == 1;
+    t->size = (uint16_t)json_object_get_number(obj, "size");
+    if ((str = json_object_get_string(obj, "datr")) != NULL && sscanf(str, "SF%2hdBW%3hd", &x0, &x1) == 2) {
+        t->datr_sf = x0;
+        t->datr_bw = x1;
+    }
+    str = json_object_get_string(obj, "data");
+    if (str != NULL) {
+        b64_to_bin(str, strlen(str), payload, 256);
+    }
+    json_value_free(root);
+    return PKTJSON_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PACKETS -------------------------------------------------------------- */
+
+static void random_rx(struct lgw_pkt_rx_s *p) {
+    static const uint8_t cr[] = { CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8, 0 };
+    static const uint8_t bw[] = { BW_125KHZ, BW_250KHZ, BW_500KHZ };
+    static const uint8_t st[] = { STAT_CRC_OK, STAT_CRC_BAD, STAT_NO_CRC };
+    int i;
+
+    memset(p, 0, sizeof *p);
+    p->count_us = lrand48() ^ (lrand48() << 16);
+    p->if_chain = lrand48() % 10;
+    p->rf_chain = lrand48() % 2;
+    p->freq_hz = 863000000 + (lrand48() % 7000000);
+    p->status = st[lrand48() % 3];
+    if (lrand48() % 10) {
+        p->modulation = MOD_LORA;
+        p->datarate = DR_LORA_SF7 << (lrand48() % 6);
+        p->bandwidth = bw[lrand48() % 3];
+        p->coderate = cr[lrand48() % 5];
+        /* the HAL reports SNR in quarter dB and RSSI in whole dB */
+        p->snr = ((int)(lrand48() % 160) - 100) / 4.0f;
+    } else {
+        p->modulation = MOD_FSK;
+        p->datarate = 1200 + lrand48() % 300000;
+    }
+    p->rssi = -(float)(lrand48() % 140);
+    p->size = lrand48() % 256;
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = lrand48();
+    }
+}
+
+static int random_txpk(char *out, int max_len) {
+    static const char *codr[] = { "4/5", "4/6", "4/7", "4/8" };
+    uint8_t payload[64];
+    char data[96];
+    int i, size = 1 + lrand48() % 64;
+
+    for (i = 0; i < size; i++) {
+        payload[i] = lrand48();
+    }
+    bin_to_b64(payload, size, data, sizeof data);
+    return snprintf(out, max_len,
+                    "{\"txpk\":{\"imme\":false,\"tmst\":%u,\"freq\":%.6f,\"rfch\":0,\"powe\":14,"
+                    "\"modu\":\"LORA\",\"datr\":\"SF%dBW125\",\"codr\":\"%s\",\"ipol\":true,"
+                    "\"size\":%d,\"data\":\"%s\"}}",
+                    (unsigned)(lrand48() ^ (lrand48() << 16)), (863000000 + (lrand48() % 70000) * 100) / 1e6,
+                    7 + (int)(lrand48() % 6), codr[lrand48() % 4], size, data);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_rxpk_matches_reference(void) {
+    struct lgw_pkt_rx_s p;
+    char out[PKTJSON_RXPK_MAX_LEN], ref[1024];
+    int i, n, n_ref, mismatches = 0;
+    JSON_Value *root;
+
+    srand48(1);
+    for (i = 0; i < 20000; i++) {
+        random_rx(&p);
+        n = pktjson_rxpk(out, sizeof out, &p);
+        n_ref = ref_rxpk(ref, sizeof ref, &p);
+        if ((n != n_ref) || (memcmp(out, ref, n) != 0)) {
+            if (mismatches++ == 0) {
+                printf("  got %.*s\n  ref %s\n", n, out, ref);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+
+    /* the result stands on its own as a JSON object */
+    out[n] = 0;
+    root = json_parse_string(out);
+    CHECK(root != NULL);
+    CHECK(json_object_get_number(json_value_get_object(root), "size") == p.size);
+    json_value_free(root);
+}
+
+static void test_rxpk_edges(void) {
+    struct lgw_pkt_rx_s p;
+    char out[PKTJSON_RXPK_MAX_LEN];
+    int n;
+
+    memset(&p, 0, sizeof p);
+    p.count_us = 4294967295U;
+    p.if_chain = 9;
+    p.rf_chain = 1;
+    p.freq_hz = 868100000;
+    p.status = STAT_CRC_BAD;
+    p.modulation = MOD_LORA;
+    p.datarate = DR_LORA_SF12;
+    p.bandwidth = BW_500KHZ;
+    p.coderate = CR_LORA_4_8;
+    p.snr = -0.25f;
+    p.rssi = -0.4f;
+    p.size = 255;
+
+    /* the longest LoRa object fits */
+    n = pktjson_rxpk(out, sizeof out, &p);
+    CHECK(n > 0);
+    CHECK(strstr(out, ",\"lsnr\":-0.2,\"rssi\":-0,") != NULL);
+    CHECK(pktjson_rxpk(out, n, &p) == n);
+    CHECK(pktjson_rxpk(out, n - 1, &p) == PKTJSON_ERROR);
+    CHECK(pktjson_rxpk(out, 20, &p) == PKTJSON_ERROR);
+
+    p.size = 0;
+    n = pktjson_rxpk(out, sizeof out, &p);
+    CHECK((n > 10) && (memcmp(out + n - 10, "\"data\":\"\"}", 10) == 0));
+
+    /* unknown enum values are refused rather than written as '?' */
+    p.status = 0x55;
+    CHECK(pktjson_rxpk(out, sizeof out, &p) == PKTJSON_ERROR);
+    p.status = STAT_CRC_OK;
+    p.datarate = DR_UNDEFINED;
+    CHECK(pktjson_rxpk(out, sizeof out, &p) == PKTJSON_ERROR);
+    p.datarate = DR_LORA_SF7;
+    p.bandwidth = BW_UNDEFINED;
+    CHECK(pktjson_rxpk(out, sizeof out, &p) == PKTJSON_ERROR);
+    p.bandwidth = BW_125KHZ;
+    p.modulation = MOD_UNDEFINED;
+    CHECK(pktjson_rxpk(out, sizeof out, &p) == PKTJSON_ERROR);
+}
+
+static int parse(const char *json, struct pktjson_txpk_s *t) {
+    return pktjson_txpk(json, strlen(json), t);
+}
+
+static void test_txpk_members(void) {
+    struct pktjson_txpk_s t;
+    uint8_t payload[256];
+
+    CHECK(parse("{\"txpk\":{\"imme\":false,\"tmst\":4294967295,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+                "\"modu\":\"LORA\",\"datr\":\"SF12BW125\",\"codr\":\"4/5\",\"ipol\":true,"
+                "\"size\":4,\"data\":\"3q2+7w==\",\"ncrc\":true}}", &t) == PKTJSON_OK);
+    CHECK(t.present == (PKTJSON_TXPK_IMME | PKTJSON_TXPK_TMST | PKTJSON_TXPK_FREQ | PKTJSON_TXPK_RFCH |
+                        PKTJSON_TXPK_POWE | PKTJSON_TXPK_MODU | PKTJSON_TXPK_DATR_STR | PKTJSON_TXPK_CODR |
+                        PKTJSON_TXPK_IPOL | PKTJSON_TXPK_SIZE | PKTJSON_TXPK_DATA | PKTJSON_TXPK_NCRC));
+    CHECK(!t.imme && t.ipol && t.ncrc);
+    CHECK(t.tmst == 4294967295U);
+    CHECK(t.freq_hz == 868100000);
+    CHECK((t.rfch == 0) && (t.powe == 14) && (t.size == 4));
+    CHECK(pktjson_streq(&t.modu, "LORA") && !pktjson_streq(&t.modu, "LOR"));
+    CHECK((t.datr_sf == 12) && (t.datr_bw == 125));
+    CHECK(pktjson_streq(&t.codr, "4/5"));
+    CHECK(pktjson_b64_to_bin(&t.data, payload, sizeof payload) == 4);
+    CHECK(memcmp(payload, "\xde\xad\xbe\xef", 4) == 0);
+
+    /* FSK, numbers in other notations */
+    CHECK(parse("{\"txpk\":{\"imme\":true,\"freq\":8.6955e2,\"rfch\":1,\"powe\":-3,\"modu\":\"FSK\","
+                "\"datr\":50000,\"fdev\":25000.0,\"prea\":5,\"size\":0,\"data\":\"\"}}", &t) == PKTJSON_OK);
+    CHECK(t.imme);
+    CHECK(t.freq_hz == 869550000);
+    CHECK((t.rfch == 1) && (t.powe == -3));
+    CHECK((t.present & PKTJSON_TXPK_DATR_NUM) && !(t.present & PKTJSON_TXPK_DATR_STR));
+    CHECK((t.datr_num == 50000) && (t.fdev == 25000) && (t.prea == 5));
+    CHECK(pktjson_b64_to_bin(&t.data, payload, sizeof payload) == 0);
+
+    /* exact frequency where the double conversion used to lose one Hz */
+    CHECK(parse("{\"txpk\":{\"freq\":867.100001}}", &t) == PKTJSON_OK);
+    CHECK(t.freq_hz == 867100001);
+
+    /* malformed datr, members of the wrong type are absent */
+    CHECK(parse("{\"txpk\":{\"datr\":\"SF7\",\"tmst\":\"12\",\"modu\":1,\"ipol\":null}}", &t) == PKTJSON_OK);
+    CHECK(t.present == PKTJSON_TXPK_DATR_STR);
+    CHECK(t.datr_sf == 0);
+    CHECK(parse("{\"txpk\":{\"time\":\"2020-01-01T00:00:00Z\"}}", &t) == PKTJSON_OK);
+    CHECK(t.present == PKTJSON_TXPK_TIME);
+}
+
+static void test_txpk_syntax(void) {
+    struct pktjson_txpk_s t;
+    uint8_t payload[256];
+
+    /* white space, comments and members the forwarder does not use */
+    CHECK(parse(" /* resp */ {\n\t\"brd\" : [0, {\"a\":[]}, \"x\\\"}\"],\r\n"
+                " \"txpk\" : { \"rfch\" : 1 , // chain\n \"ant\":{\"b\":-1.5e-3,\"c\":null} , \"size\":2 } ,"
+                " \"z\": true }", &t) == PKTJSON_OK);
+    CHECK((t.rfch == 1) && (t.size == 2));
+    CHECK(t.present == (PKTJSON_TXPK_RFCH | PKTJSON_TXPK_SIZE));
+
+    /* escaped base64 '/' */
+    CHECK(parse("{\"txpk\":{\"data\":\"\\/\\/8=\"}}", &t) == PKTJSON_OK);
+    CHECK(t.data.escaped);
+    CHECK(pktjson_b64_to_bin(&t.data, payload, sizeof payload) == 2);
+    CHECK((payload[0] == 0xff) && (payload[1] == 0xff));
+    CHECK(parse("{\"txpk\":{\"data\":\"\\n8=\"}}", &t) == PKTJSON_OK);
+    CHECK(pktjson_b64_to_bin(&t.data, payload, sizeof payload) == -1);
+    CHECK(parse("{\"txpk\":{\"data\":\"AB$D\"}}", &t) == PKTJSON_OK);
+    CHECK(pktjson_b64_to_bin(&t.data, payload, sizeof payload) == -1);
+
+    CHECK(parse("{}", &t) == PKTJSON_ERR_NO_TXPK);
+    CHECK(parse("{\"txpk\":[1]}", &t) == PKTJSON_ERR_NO_TXPK);
+    CHECK(parse("{\"rxpk\":{\"txpk\":{}}}", &t) == PKTJSON_ERR_NO_TXPK);
+    CHECK(parse("", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("[]", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"size\":}}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"size\":1,}}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"size\":1}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"modu\":\"LORA}}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"ipol\":tru}}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"txpk\":{\"freq\":1e}}", &t) == PKTJSON_ERR_SYNTAX);
+    CHECK(parse("{\"a\":[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]],\"txpk\":{}}", &t) == PKTJSON_ERR_SYNTAX);
+
+    /* the length bounds the parse, not a null char */
+    CHECK(pktjson_txpk("{\"txpk\":{}}garbage", 11, &t) == PKTJSON_OK);
+    CHECK(pktjson_txpk("{\"txpk\":{}}", 10, &t) == PKTJSON_ERR_SYNTAX);
+}
+
+static void test_txpk_matches_reference(void) {
+    struct pktjson_txpk_s t, ref;
+    uint8_t payload[256], ref_payload[256];
+    char json[512];
+    int i, mismatches = 0;
+
+    srand48(2);
+    for (i = 0; i < 5000; i++) {
+        random_txpk(json, sizeof json);
+        CHECK(parse(json, &t) == PKTJSON_OK);
+        CHECK(ref_txpk(json, &ref, ref_payload) == PKTJSON_OK);
+        pktjson_b64_to_bin(&t.data, payload, sizeof payload);
+        if ((t.tmst != ref.tmst) || (t.freq_hz != ref.freq_hz) || (t.imme != ref.imme) || (t.ipol != ref.ipol) ||
+            (t.powe != ref.powe) || (t.size != ref.size) || (t.datr_sf != ref.datr_sf) ||
+            (t.datr_bw != ref.datr_bw) || (memcmp(payload, ref_payload, t.size) != 0)) {
+            /* the only accepted difference: parson's double rounding down one Hz */
+            if ((t.freq_hz != ref.freq_hz + 1) || (mismatches++ == 0)) {
+                printf("  %s\n", json);
+                failures++;
+            }
+        }
+    }
+}
+
+static int run_tests(void) {
+    test_rxpk_matches_reference();
+    test_rxpk_edges();
+    test_txpk_members();
+    test_txpk_syntax();
+    test_txpk_matches_reference();
+
+    if (failures) {
+        printf("pktjson: %d failure(s)\n", failures);
+        return 1;
+    }
+    printf("pktjson: all tests passed\n");
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench(int n) {
+    static struct lgw_pkt_rx_s rx[BENCH_SET];
+    static char tx[BENCH_SET][512];
+    static int tx_len[BENCH_SET];
+    struct pktjson_txpk_s t;
+    uint8_t payload[256];
+    char out[1024];
+    uint64_t t0, bytes = 0;
+    double ns_new, ns_ref;
+    int i;
+
+    for (i = 0; i < BENCH_SET; i++) {
+        random_rx(&rx[i]);
+        tx_len[i] = random_txpk(tx[i], sizeof tx[i]);
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        bytes += pktjson_rxpk(out, sizeof out, &rx[i % BENCH_SET]);
+    }
+    ns_new = (double)(now_ns() - t0) / n;
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        bytes += ref_rxpk(out, sizeof out, &rx[i % BENCH_SET]);
+    }
+    ns_ref = (double)(now_ns() - t0) / n;
+    printf("rxpk format   pktjson %8.0f pkt/s (%6.0f ns)   snprintf %8.0f pkt/s (%6.0f ns)   x%.1f\n",
+           1e9 / ns_new, ns_new, 1e9 / ns_ref, ns_ref, ns_ref / ns_new);
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        pktjson_txpk(tx[i % BENCH_SET], tx_len[i % BENCH_SET], &t);
+        bytes += pktjson_b64_to_bin(&t.data, payload, sizeof payload);
+    }
+    ns_new = (double)(now_ns() - t0) / n;
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        bytes += ref_txpk(tx[i % BENCH_SET], &t, payload);
+    }
+    ns_ref = (double)(now_ns() - t0) / n;
+    printf("txpk parse    pktjson %8.0f pkt/s (%6.0f ns)   parson   %8.0f pkt/s (%6.0f ns)   x%.1f\n",
+           1e9 / ns_new, ns_new, 1e9 / ns_ref, ns_ref, ns_ref / ns_new);
+
+    if (bytes == 0) {
+        printf("(nothing done)\n");
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b N] [-s seed]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    long seed = 1;
+    int n = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b': n = atoi(optarg); break;
+            case 's': seed = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n <= 0) {
+        return run_tests();
+    }
+    srand48(seed);
+    bench(n);
+    return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the telnet server. The server runs in a
+ * thread that sleeps in select() and steps it like the servers task does, on
+ * top of the Linux sockets, and the tests play both the telnet client and the
+ * REPL reading and printing through telnet_rx_char() and telnet_tx_strn().
+ *
+ *   test_telnet                    run the unit tests
+ *   test_telnet -b N               echo N keystrokes through a logged in
+ *                                  session and report the round trip, then
+ *                                  the idle wake ups and CPU time, for the
+ *                                  select loop and for the former loop that
+ *                                  stepped the server every telnet cycle
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "py/obj.h"
+#include "telnet.h"
+#include "serverstask.h"
+#include "serverscore.h"
+#include "utils/interrupt_char.h"
+
+#define TELNET_CYCLE_US         (SERVERS_CYCLE_TIME_MS * 2 * 1000)
+#define IAC                     255
+#define AYT                     246
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST STAND-INS ------------------------------------------------------- */
+
+char servers_user[SERVERS_USER_PASS_LEN_MAX + 1] = SERVERS_DEF_USER;
+char servers_pass[SERVERS_USER_PASS_LEN_MAX + 1] = SERVERS_DEF_PASS;
+static volatile uint32_t servers_timeout = SERVERS_DEF_TIMEOUT_MS;
+
+void servers_close_socket(int32_t *sd) {
+    if (*sd > 0) {
+        close(*sd);
+        *sd = -1;
+    }
+}
+
+uint32_t servers_get_timeout(void) {
+    return servers_timeout;
+}
+
+uint32_t mp_hal_ticks_ms(void) {
+    return now_ns() / 1000000ULL;
+}
+
+int mp_interrupt_char = 3;
+static int interrupts;
+
+void mp_keyboard_interrupt(void) {
+    interrupts++;
+}
+
+void mp_hal_reset_safe_and_boot(bool reset) {
+    (void)reset;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- SERVER AND CLIENT ---------------------------------------------------- */
+
+static volatile bool server_stop;
+static volatile bool server_polling;
+static volatile uint32_t server_wakeups;
+static pthread_t server_tid;
+
+static void *server_thread(void *arg) {
+    servers_wait_t wait;
+
+    (void)arg;
+    telnet_init();
+    telnet_enable();
+    while (!server_stop) {
+        if (server_polling) {
+            telnet_run();
+            usleep(TELNET_CYCLE_US);
+        } else {
+            servers_wait_init(&wait, SERVERS_IDLE_TIME_MS);
+            telnet_prepare_wait(&wait);
+            servers_wait(&wait);
+            telnet_run();
+        }
+        server_wakeups++;
+    }
+    telnet_disable();
+    return NULL;
+}
+
+static void server_start(void) {
+    server_stop = false;
+    pthread_create(&server_tid, NULL, server_thread, NULL);
+    // listening takes a couple of cycles
+    usleep(20 * TELNET_CYCLE_US);
+}
+
+static void server_halt(void) {
+    server_stop = true;
+    pthread_join(server_tid, NULL);
+}
+
+/* what the client received and did not look at yet, one client at a time */
+static char client_buf[2048];
+static size_t client_have;
+
+static int tcp_connect(uint16_t port) {
+    struct sockaddr_in addr;
+    struct timeval tv = { 2, 0 };
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sd < 0) {
+        return -1;
+    }
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sd);
+        return -1;
+    }
+    client_have = 0;
+    return sd;
+}
+
+static bool client_send(int sd, const char *str) {
+    size_t len = strlen(str);
+    return send(sd, str, len, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+/* reads until text has been received, what came up to it is consumed */
+static bool client_expect(int sd, const void *text, size_t len) {
+    while (true) {
+        char *found = memmem(client_buf, client_have, text, len);
+        if (found) {
+            size_t used = found + len - client_buf;
+            memmove(client_buf, client_buf + used, client_have - used);
+            client_have -= used;
+            return true;
+        }
+        if (client_have == sizeof(client_buf)) {
+            // keep the tail, the text may straddle
+            memmove(client_buf, client_buf + client_have - len, len);
+            client_have = len;
+        }
+        ssize_t n = recv(sd, client_buf + client_have, sizeof(client_buf) - client_have, 0);
+        if (n <= 0) {
+            return false;
+        }
+        client_have += n;
+    }
+}
+
+/* true once the server has hung up */
+static bool client_closed(int sd) {
+    char buf[256];
+
+    while (true) {
+        ssize_t n = recv(sd, buf, sizeof(buf), 0);
+        if (n == 0) {
+            return true;
+        } else if (n < 0) {
+            return false;
+        }
+    }
+}
+
+/* the server drops what comes before the echo is switched off, like a human
+   the client answers only once the prompt and the options are in */
+static bool client_credentials(int sd, const char *user, const char *pass) {
+    static const char options_pass[] = { 255, 251, 1, 255, 252, 3, 255, 251, 34 };
+
+    return client_expect(sd, "Login as: ", 10) && client_send(sd, user) &&
+           client_expect(sd, "Password: ", 10) && client_expect(sd, options_pass, sizeof(options_pass)) &&
+           client_send(sd, pass);
+}
+
+static int client_login(void) {
+    int sd = tcp_connect(TELNET_PORT);
+
+    if (sd < 0) {
+        return -1;
+    }
+    if (client_credentials(sd, SERVERS_DEF_USER "\r\n", SERVERS_DEF_PASS "\r\n") &&
+        client_expect(sd, "Login succeeded!", 16)) {
+        return sd;
+    }
+    close(sd);
+    return -1;
+}
+
+/* what the REPL has been given since the last call */
+static int repl_read(char *buf, int size, int timeout_ms) {
+    uint64_t end = now_ns() + timeout_ms * 1000000ULL;
+    int len = 0;
+
+    while (len < size && now_ns() < end) {
+        if (telnet_rx_any()) {
+            buf[len++] = telnet_rx_char();
+        } else {
+            usleep(100);
+        }
+    }
+    return len;
+}
+
+static void repl_drain(void) {
+    char buf[256];
+    while (repl_read(buf, sizeof(buf), 20) > 0) {
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TESTS ---------------------------------------------------------------- */
+
+static void test_login(void) {
+    int sd;
+
+    // three wrong logins and the server hangs up
+    sd = tcp_connect(TELNET_PORT);
+    CHECK(sd >= 0);
+    for (int i = 0; i < 3; i++) {
+        CHECK(client_credentials(sd, "root\r\n", "secret\r\n"));
+        CHECK(client_expect(sd, "Invalid credentials", 19));
+    }
+    CHECK(client_closed(sd));
+    close(sd);
+
+    // the server listens again within an idle period
+    usleep((SERVERS_IDLE_TIME_MS + 50) * 1000);
+    sd = client_login();
+    CHECK(sd >= 0);
+    close(sd);
+    usleep((SERVERS_IDLE_TIME_MS + 50) * 1000);
+}
+
+static void test_repl(void) {
+    static char big[65536];
+    char buf[64];
+    int sd = client_login();
+
+    CHECK(sd >= 0);
+    repl_drain();
+
+    // keystrokes reach the REPL
+    CHECK(client_send(sd, "print(1)\r"));
+    CHECK(repl_read(buf, 9, 1000) == 9 && !memcmp(buf, "print(1)\r", 9));
+
+    // the interrupt char never reaches it
+    interrupts = 0;
+    CHECK(client_send(sd, "\x03"));
+    CHECK(repl_read(buf, 1, 100) == 0);
+    CHECK(interrupts == 1);
+
+    // are you there is answered by the server itself
+    const char ayt[] = { (char)IAC, (char)AYT, 0 };
+    CHECK(client_send(sd, ayt));
+    CHECK(client_expect(sd, ayt, 2));
+
+    // output larger than the socket buffers arrives whole
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + (i % 26);
+    }
+    memcpy(big + sizeof(big) - 4, "END\n", 4);
+    telnet_tx_strn(big, sizeof(big));
+    CHECK(client_expect(sd, "END\n", 4));
+
+    close(sd);
+    usleep((SERVERS_IDLE_TIME_MS + 50) * 1000);
+}
+
+static void test_timeout(void) {
+    uint32_t wakeups;
+    int sd;
+
+    // a logged in client that says nothing costs one wake up per idle period
+    sd = client_login();
+    CHECK(sd >= 0);
+    usleep(10000);
+    wakeups = server_wakeups;
+    usleep(5 * SERVERS_IDLE_TIME_MS * 1000);
+    wakeups = server_wakeups - wakeups;
+    CHECK(wakeups >= 4 && wakeups <= 7);
+
+    // and is dropped on time once the inactivity timeout is up
+    servers_timeout = 300;
+    CHECK(client_send(sd, "x"));
+    uint64_t t0 = now_ns();
+    CHECK(client_closed(sd));
+    uint64_t ms = (now_ns() - t0) / 1000000ULL;
+    CHECK(ms >= 250 && ms < 400);
+    close(sd);
+    servers_timeout = SERVERS_DEF_TIMEOUT_MS;
+    usleep((SERVERS_IDLE_TIME_MS + 50) * 1000);
+}
+
+static void run_tests(void) {
+    server_start();
+    test_login();
+    test_repl();
+    test_timeout();
+    server_halt();
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+static void bench_echo(bool polling, int rounds) {
+    uint64_t worst = 0;
+    uint64_t total;
+    uint64_t cpu0, cpu1;
+    uint32_t wakeups;
+    clockid_t cid;
+    struct timespec ts;
+    char c;
+    int sd;
+
+    server_polling = polling;
+    server_start();
+    pthread_getcpuclockid(server_tid, &cid);
+    if ((sd = client_login()) < 0) {
+        printf("%-8s login failed\n", polling ? "polling" : "select");
+        server_halt();
+        return;
+    }
+    repl_drain();
+
+    // the REPL echoes each keystroke back
+    total = now_ns();
+    for (int i = 0; i < rounds; i++) {
+        uint64_t t0 = now_ns();
+        char key[2] = { 'a' + (i % 26), 0 };
+        client_send(sd, key);
+        if (repl_read(&c, 1, 1000) == 1) {
+            telnet_tx_strn(&c, 1);
+        }
+        client_expect(sd, key, 1);
+        worst = MAX(worst, now_ns() - t0);
+    }
+    total = now_ns() - total;
+
+    // one second with the client logged in and silent
+    wakeups = server_wakeups;
+    clock_gettime(cid, &ts);
+    cpu0 = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    sleep(1);
+    clock_gettime(cid, &ts);
+    cpu1 = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    wakeups = server_wakeups - wakeups;
+
+    printf("%-8s %14.3f %14.3f %14u %14.3f\n", polling ? "polling" : "select",
+           total / 1e6 / rounds, worst / 1e6, wakeups, (cpu1 - cpu0) / 1e6);
+    close(sd);
+    server_halt();
+}
+
+static void bench(int rounds) {
+    printf("select loop, the former loop stepped the telnet server every %d ms\n", TELNET_CYCLE_US / 1000);
+    printf("%-8s %14s %14s %14s %14s\n", "loop", "echo avg ms", "echo max ms", "idle wakeups/s", "idle CPU ms/s");
+    bench_echo(false, rounds);
+    bench_echo(true, rounds);
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+            case 'b':
+                count = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b keystrokes]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (count > 0) {
+        bench(count);
+        return 0;
+    }
+
+    run_tests();
+    if (failures > 0) {
+        printf("test_telnet: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_telnet: all tests passed\n");
+    return 0;
+}
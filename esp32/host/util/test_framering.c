@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Unit tests and benchmark for the frame ring used between the LoRa radio
+ * IRQ and the LoRa socket.
+ *
+ *   test_framering                 run the unit tests, then feed the ring
+ *                                  from a simulated IRQ thread while the main
+ *                                  thread reads it
+ *   test_framering -b N [-s seed]  pass N frames through the ring and through
+ *                                  a locked queue of fixed size copies, the
+ *                                  scheme the ring replaced, and report the
+ *                                  frames per second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framering.h"
+
+#define PAYLOAD_MAX         255
+#define RING_SIZE           2048        /* LORA_RX_RING_SIZE */
+#define QUEUE_LEN           7           /* the old LORA_DATA_QUEUE_SIZE_MAX */
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Frame n: a 4-byte sequence number followed by a pattern derived from it */
+static uint16_t frame_fill(uint8_t *buf, uint32_t n, uint16_t len) {
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (i < 4) ? (uint8_t)(n >> (8 * i)) : (uint8_t)(n * 31 + i);
+    }
+    return len;
+}
+
+static bool frame_check(const uint8_t *buf, uint16_t len, uint32_t *n) {
+    uint16_t i;
+
+    if (len < 4) {
+        return false;
+    }
+    *n = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    for (i = 4; i < len; i++) {
+        if (buf[i] != (uint8_t)(*n * 31 + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- UNIT TESTS ----------------------------------------------------------- */
+
+static void test_ringbuf_bytes(void) {
+    uint8_t mem[8], out[8];
+    ringbuf_t r = { mem, sizeof(mem) };
+
+    CHECK(ringbuf_avail(&r) == 0);
+    CHECK(ringbuf_free(&r) == 7);
+    CHECK(ringbuf_put_bytes(&r, (const uint8_t *)"abcde", 5) == 0);
+    CHECK(ringbuf_put_bytes(&r, (const uint8_t *)"xyz", 3) == -1);
+    CHECK(ringbuf_get_bytes(&r, out, 6) == -1);
+    CHECK((ringbuf_get_bytes(&r, out, 4) == 0) && (memcmp(out, "abcd", 4) == 0));
+    /* wraps around the end of the buffer */
+    CHECK(ringbuf_put_bytes(&r, (const uint8_t *)"fghijk", 6) == 0);
+    CHECK(ringbuf_avail(&r) == 7);
+    CHECK(ringbuf_free(&r) == 0);
+    CHECK(ringbuf_get(&r) == 'e');
+    CHECK((ringbuf_get_bytes(&r, out, 6) == 0) && (memcmp(out, "fghijk", 6) == 0));
+    CHECK(ringbuf_get(&r) == -1);
+}
+
+static void test_frames(void) {
+    uint8_t mem[64], buf[64];
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+    uint8_t tag = 0;
+
+    CHECK(!framering_any(&f));
+    CHECK(framering_read(&f, buf, sizeof(buf), &tag) == -1);
+
+    CHECK(framering_put(&f, 2, (const uint8_t *)"hello", 5));
+    CHECK(framering_put(&f, 0, NULL, 0));
+    CHECK(framering_put(&f, 3, (const uint8_t *)"world!", 6));
+    CHECK(framering_any(&f));
+
+    /* frames do not merge, a short read leaves the rest for the next one */
+    CHECK((framering_read(&f, buf, 3, &tag) == 3) && (memcmp(buf, "hel", 3) == 0) && (tag == 2));
+    CHECK((framering_read(&f, buf, sizeof(buf), &tag) == 2) && (memcmp(buf, "lo", 2) == 0) && (tag == 2));
+    CHECK((framering_read(&f, buf, sizeof(buf), &tag) == 0) && (tag == 0));
+    CHECK((framering_read(&f, buf, sizeof(buf), &tag) == 6) && (memcmp(buf, "world!", 6) == 0) && (tag == 3));
+    CHECK(framering_read(&f, buf, sizeof(buf), &tag) == -1);
+    CHECK(!framering_any(&f));
+
+    /* a frame that does not fit is dropped whole */
+    memset(buf, 'x', sizeof(buf));
+    CHECK(framering_put(&f, 1, buf, 40));
+    CHECK(!framering_put(&f, 1, buf, 30));
+    CHECK(f.dropped == 1);
+    CHECK(framering_put(&f, 1, buf, 20 - FRAMERING_HEADER_SIZE));
+    CHECK(framering_read(&f, buf, sizeof(buf), NULL) == 40);
+    CHECK(framering_read(&f, buf, sizeof(buf), NULL) == 20 - FRAMERING_HEADER_SIZE);
+
+    /* consumer side flush, including the rest of a frame being read */
+    CHECK(framering_put(&f, 1, (const uint8_t *)"abc", 3));
+    CHECK(framering_put(&f, 1, (const uint8_t *)"def", 3));
+    CHECK(framering_read(&f, buf, 1, NULL) == 1);
+    framering_flush(&f);
+    CHECK(!framering_any(&f));
+}
+
+static void test_wrap(void) {
+    uint8_t mem[101], buf[PAYLOAD_MAX], tag;
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+    uint32_t put = 0, got = 0, n;
+    int i, len;
+
+    /* odd sizes in a small ring, headers and data wrap at every position */
+    srand48(3);
+    for (i = 0; i < 20000; i++) {
+        if (lrand48() % 2) {
+            len = 4 + lrand48() % 40;
+            frame_fill(buf, put, len);
+            if (framering_put(&f, put & 0xFF, buf, len)) {
+                put++;
+            }
+        } else {
+            len = framering_read(&f, buf, sizeof(buf), &tag);
+            if (len >= 0) {
+                CHECK(frame_check(buf, len, &n) && (n == got) && (tag == (got & 0xFF)));
+                got++;
+            }
+        }
+    }
+    while (framering_read(&f, buf, sizeof(buf), &tag) >= 0) {
+        got++;
+    }
+    CHECK(got == put);
+}
+
+static void test_producer_flush(void) {
+    uint8_t mem[64], buf[64];
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+
+    /* frames put before the request are dropped, the ones after are kept */
+    CHECK(framering_put(&f, 1, (const uint8_t *)"old1", 4));
+    CHECK(framering_read(&f, buf, 2, NULL) == 2);
+    CHECK(framering_put(&f, 1, (const uint8_t *)"old2", 4));
+    framering_flush_from_producer(&f);
+    CHECK(framering_put(&f, 2, (const uint8_t *)"new", 3));
+    CHECK((framering_read(&f, buf, sizeof(buf), NULL) == 3) && (memcmp(buf, "new", 3) == 0));
+    CHECK(!framering_any(&f));
+
+    /* a request the consumer sees late does not roll back frames it read */
+    CHECK(framering_put(&f, 1, (const uint8_t *)"old", 3));
+    framering_flush_from_producer(&f);
+    f.flush_seen = f.flush_seq; /* the consumer is past its check */
+    CHECK(framering_put(&f, 2, (const uint8_t *)"new1", 4));
+    CHECK((framering_read(&f, buf, sizeof(buf), NULL) == 3) && (memcmp(buf, "old", 3) == 0));
+    CHECK(framering_read(&f, buf, 2, NULL) == 2);
+    f.flush_seen--;
+    CHECK(framering_put(&f, 2, (const uint8_t *)"new2", 4));
+    CHECK((framering_read(&f, buf, sizeof(buf), NULL) == 2) && (memcmp(buf, "w1", 2) == 0));
+    CHECK((framering_read(&f, buf, sizeof(buf), NULL) == 4) && (memcmp(buf, "new2", 4) == 0));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- SIMULATED IRQ -------------------------------------------------------- */
+
+struct irq_sim_s {
+    framering_t *ring;
+    uint32_t nb_frames;
+    bool bursts;            /* back to back frames, the ring will overflow */
+    volatile bool done;
+    uint32_t put;
+};
+
+static void *irq_thread(void *arg) {
+    struct irq_sim_s *sim = arg;
+    uint8_t buf[PAYLOAD_MAX];
+    uint32_t n;
+    uint16_t len;
+
+    for (n = 0; n < sim->nb_frames; n++) {
+        len = frame_fill(buf, n, 4 + lrand48() % (PAYLOAD_MAX - 3));
+        if (framering_put(sim->ring, n & 0xFF, buf, len)) {
+            sim->put++;
+        }
+        if (!sim->bursts && ((n % 8) == 0)) {
+            usleep(lrand48() % 200);
+        }
+    }
+    __atomic_store_n(&sim->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* The main thread reads in random sized parts, as a socket would */
+static void test_irq_thread(bool bursts) {
+    static uint8_t mem[RING_SIZE];
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+    struct irq_sim_s sim = { &f, 200000, bursts, false, 0 };
+    uint8_t frame[PAYLOAD_MAX], tag = 0, first_tag = 0;
+    uint32_t got = 0, n, last = 0;
+    int len, part, bad = 0;
+    pthread_t th;
+
+    srand48(4);
+    pthread_create(&th, NULL, irq_thread, &sim);
+    len = 0;
+    for (;;) {
+        part = framering_read(&f, frame + len, 1 + lrand48() % 64, &tag);
+        if (part < 0) {
+            if (__atomic_load_n(&sim.done, __ATOMIC_ACQUIRE) && !framering_any(&f)) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        if (len == 0) {
+            first_tag = tag;
+        }
+        len += part;
+        if ((len < 4) || (f.left > 0)) {
+            continue;
+        }
+        /* a whole frame, in order, with its tag */
+        if (!frame_check(frame, len, &n) || (tag != first_tag) || (tag != (n & 0xFF)) || ((got > 0) && (n <= last))) {
+            bad++;
+        }
+        last = n;
+        got++;
+        len = 0;
+    }
+    pthread_join(th, NULL);
+
+    CHECK(bad == 0);
+    CHECK(got == sim.put);
+    CHECK(got + f.dropped == sim.nb_frames);
+    if (bursts) {
+        CHECK(f.dropped > 0);
+    }
+}
+
+/* Several threads reading and polling the same socket, under a lock as in
+   modlora.c: each frame is read once, whole */
+#define READERS_FRAMES      100000
+
+struct readers_s {
+    framering_t *ring;
+    struct irq_sim_s *sim;
+    pthread_mutex_t lock;
+    uint8_t seen[READERS_FRAMES];
+    uint32_t bad;
+};
+
+static void *reader_thread(void *arg) {
+    struct readers_s *r = arg;
+    uint8_t frame[PAYLOAD_MAX];
+    uint8_t tag;
+    uint32_t n;
+    bool any;
+    int len;
+
+    for (;;) {
+        pthread_mutex_lock(&r->lock);
+        len = framering_read(r->ring, frame, sizeof(frame), &tag);
+        any = framering_any(r->ring);
+        pthread_mutex_unlock(&r->lock);
+        if (len < 0) {
+            if (__atomic_load_n(&r->sim->done, __ATOMIC_ACQUIRE) && !any) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        if (!frame_check(frame, len, &n) || (n >= READERS_FRAMES) || (tag != (n & 0xFF))) {
+            __atomic_add_fetch(&r->bad, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_add_fetch(&r->seen[n], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static void *poller_thread(void *arg) {
+    struct readers_s *r = arg;
+
+    while (!__atomic_load_n(&r->sim->done, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&r->lock);
+        framering_any(r->ring);
+        pthread_mutex_unlock(&r->lock);
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void test_readers(void) {
+    static uint8_t mem[RING_SIZE];
+    static struct readers_s r;
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+    struct irq_sim_s sim = { &f, READERS_FRAMES, false, false, 0 };
+    pthread_t th, readers[3], poller;
+    uint32_t got = 0, twice = 0;
+
+    memset(&r, 0, sizeof(r));
+    r.ring = &f;
+    r.sim = &sim;
+    pthread_mutex_init(&r.lock, NULL);
+    srand48(5);
+    pthread_create(&th, NULL, irq_thread, &sim);
+    for (int i = 0; i < 3; i++) {
+        pthread_create(&readers[i], NULL, reader_thread, &r);
+    }
+    pthread_create(&poller, NULL, poller_thread, &r);
+    pthread_join(th, NULL);
+    for (int i = 0; i < 3; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    pthread_join(poller, NULL);
+    pthread_mutex_destroy(&r.lock);
+
+    for (uint32_t n = 0; n < READERS_FRAMES; n++) {
+        got += r.seen[n];
+        twice += r.seen[n] > 1;
+    }
+    CHECK(r.bad == 0);
+    CHECK(twice == 0);
+    CHECK(got == sim.put);
+}
+
+static int run_tests(void) {
+    test_ringbuf_bytes();
+    test_frames();
+    test_wrap();
+    test_producer_flush();
+    test_irq_thread(false);
+    test_irq_thread(true);
+    test_readers();
+
+    if (failures) {
+        printf("framering: %d failure(s)\n", failures);
+        return 1;
+    }
+    printf("framering: all tests passed\n");
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+/* What the ring replaced: the IRQ copies the frame into a static slot, the
+   queue copies it in and out under a lock, and the reader copies the part
+   that fits in the user buffer */
+struct slot_s {
+    uint8_t data[PAYLOAD_MAX + 1];
+    uint8_t len;
+    uint8_t port;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct slot_s slots[QUEUE_LEN];
+    unsigned first, count;
+} queue = { PTHREAD_MUTEX_INITIALIZER };
+
+static bool queue_send(const struct slot_s *s) {
+    bool ok = false;
+
+    pthread_mutex_lock(&queue.lock);
+    if (queue.count < QUEUE_LEN) {
+        queue.slots[(queue.first + queue.count) % QUEUE_LEN] = *s;
+        queue.count++;
+        ok = true;
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return ok;
+}
+
+static bool queue_receive(struct slot_s *s) {
+    bool ok = false;
+
+    pthread_mutex_lock(&queue.lock);
+    if (queue.count > 0) {
+        *s = queue.slots[queue.first];
+        queue.first = (queue.first + 1) % QUEUE_LEN;
+        queue.count--;
+        ok = true;
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return ok;
+}
+
+struct bench_s {
+    uint32_t nb_frames;
+    bool use_ring;
+    framering_t *ring;
+    volatile bool done;
+};
+
+static void *bench_irq(void *arg) {
+    struct bench_s *b = arg;
+    static uint8_t payload[PAYLOAD_MAX];
+    struct slot_s isr_slot;
+    uint32_t n;
+    uint16_t len;
+
+    for (n = 0; n < b->nb_frames; n++) {
+        len = 10 + (n * 37) % 60;
+        if (b->use_ring) {
+            while (!framering_put(b->ring, 1, payload, len)) {
+                b->ring->dropped = 0;
+                sched_yield();
+            }
+        } else {
+            memcpy(isr_slot.data, payload, len);
+            isr_slot.len = len;
+            isr_slot.port = 1;
+            while (!queue_send(&isr_slot)) {
+                sched_yield();
+            }
+        }
+    }
+    __atomic_store_n(&b->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static double bench_run(uint32_t nb, bool use_ring) {
+    static uint8_t mem[RING_SIZE];
+    framering_t f = { .rb = { mem, sizeof(mem) } };
+    struct bench_s b = { nb, use_ring, &f, false };
+    struct slot_s slot;
+    uint8_t user[64];
+    uint32_t got = 0;
+    uint64_t t0;
+    pthread_t th;
+
+    t0 = now_ns();
+    pthread_create(&th, NULL, bench_irq, &b);
+    while (got < nb) {
+        if (use_ring) {
+            if (framering_read(&f, user, sizeof(user), NULL) < 0) {
+                sched_yield();
+                continue;
+            }
+            if (f.left == 0) {
+                got++;
+            }
+        } else {
+            if (!queue_receive(&slot)) {
+                sched_yield();
+                continue;
+            }
+            memcpy(user, slot.data, (slot.len < sizeof(user)) ? slot.len : sizeof(user));
+            got++;
+        }
+    }
+    pthread_join(th, NULL);
+    return nb / ((now_ns() - t0) / 1e9);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b N] [-s seed]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    long seed = 1;
+    int n = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b': n = atoi(optarg); break;
+            case 's': seed = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n <= 0) {
+        return run_tests();
+    }
+    srand48(seed);
+    printf("frame ring     %9.0f frames/s\n", bench_run(n, true));
+    printf("locked queue   %9.0f frames/s\n", bench_run(n, false));
+    return 0;
+}
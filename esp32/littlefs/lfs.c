@@ -1996,6 +1996,27 @@ int lfs_dir_read(lfs_t *lfs, lfs_dir_t *dir, struct lfs_info *info) {
     return true;
 }
 
+lfs_ssize_t lfs_dir_getattr(lfs_t *lfs, lfs_dir_t *dir,
+        uint8_t type, void *buffer, lfs_size_t size) {
+    // past '.' and '..', the entry read last is the one before dir->id
+    if (dir->pos <= 2 || dir->id == 0) {
+        return LFS_ERR_NOATTR;
+    }
+
+    lfs_stag_t tag = lfs_dir_get(lfs, &dir->m, LFS_MKTAG(0x7ff, 0x3ff, 0),
+            LFS_MKTAG(LFS_TYPE_USERATTR + type,
+                dir->id - 1, lfs_min(size, lfs->attr_max)),
+            buffer);
+    if (tag < 0) {
+        if (tag == LFS_ERR_NOENT) {
+            return LFS_ERR_NOATTR;
+        }
+        return tag;
+    }
+
+    return lfs_tag_size(tag);
+}
+
 int lfs_dir_seek(lfs_t *lfs, lfs_dir_t *dir, lfs_off_t off) {
     // simply walk from head dir
     int err = lfs_dir_rewind(lfs, dir);
@@ -3816,6 +3837,25 @@ lfs_ssize_t lfs_fs_size(lfs_t *lfs) {
   return size;
 }
 
+int lfs_fs_setlookahead(lfs_t *lfs, const uint32_t *map) {
+    // the first window starts where lfs_mount put it from the seed, so that
+    // the allocations still spread over the blocks
+    lfs->free.off %= lfs->cfg->block_count;
+    lfs->free.size = lfs_min(8*lfs->cfg->lookahead_size,
+            lfs->cfg->block_count);
+    lfs->free.i = 0;
+    lfs_alloc_ack(lfs);
+
+    memset(lfs->free.buffer, 0, lfs->cfg->lookahead_size);
+    for (lfs_block_t i = 0; i < lfs->free.size; i++) {
+        lfs_block_t block = (lfs->free.off + i) % lfs->cfg->block_count;
+        if (map[block / 32] & (1U << (block % 32))) {
+            lfs->free.buffer[i / 32] |= 1U << (i % 32);
+        }
+    }
+    return 0;
+}
+
 #ifdef LFS_MIGRATE
 ////// Migration from littelfs v1 below this //////
 
@@ -583,6 +583,15 @@ int lfs_dir_close(lfs_t *lfs, lfs_dir_t *dir);
 // or a negative error code on failure.
 int lfs_dir_read(lfs_t *lfs, lfs_dir_t *dir, struct lfs_info *info);
 
+// Get a custom attribute of the entry lfs_dir_read returned last
+//
+// Same as lfs_getattr, from the metadata pair the directory is at instead
+// of looking the path up again. '.' and '..' have none.
+//
+// Returns the size of the attribute, or a negative error code on failure.
+lfs_ssize_t lfs_dir_getattr(lfs_t *lfs, lfs_dir_t *dir,
+        uint8_t type, void *buffer, lfs_size_t size);
+
 // Change the position of the directory
 //
 // The new off must be a value previous returned from tell and specifies
@@ -624,6 +633,16 @@ lfs_ssize_t lfs_fs_size(lfs_t *lfs);
 // Returns a negative error code on failure.
 int lfs_fs_traverse(lfs_t *lfs, int (*cb)(void*, lfs_block_t), void *data);
 
+// Starts the block allocator from a map of the blocks in use
+//
+// The map has a bit for each block, set when it's in use, and must be exact:
+// a block in use marked free gets overwritten. It spares the traversal of
+// the file system on the first allocations after lfs_mount, a map taken with
+// lfs_fs_traverse while the file system hasn't changed since will do.
+//
+// Returns a negative error code on failure.
+int lfs_fs_setlookahead(lfs_t *lfs, const uint32_t *map);
+
 #ifdef LFS_MIGRATE
 // Attempts to migrate a previous version of littlefs
 //
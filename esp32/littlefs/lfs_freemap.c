@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+#include <stddef.h>
+
+#include "lfs.h"
+#include "lfs_util.h"
+#include "lfs_freemap.h"
+
+static int lfs_freemap_mark(void *p, lfs_block_t block)
+{
+    lfs_freemap_t *fm = p;
+
+    if (block < fm->block_count) {
+        fm->map[block / 32] |= 1U << (block % 32);
+    }
+    return 0;
+}
+
+static uint32_t lfs_freemap_crc(const lfs_freemap_t *fm)
+{
+    uint32_t crc = lfs_crc(0xffffffff, fm, offsetof(lfs_freemap_t, crc));
+    return lfs_crc(crc, fm->map, ((fm->block_count + 31) / 32) * sizeof(uint32_t));
+}
+
+lfs_size_t lfs_freemap_size(const struct lfs_config *cfg)
+{
+    return sizeof(lfs_freemap_t) + ((cfg->block_count + 31) / 32) * sizeof(uint32_t);
+}
+
+int lfs_freemap_take(lfs_t *lfs, lfs_freemap_t *fm, uint32_t tag)
+{
+    fm->magic = 0;
+    fm->block_count = lfs->cfg->block_count;
+    fm->tag = tag;
+    memset(fm->map, 0, lfs_freemap_size(lfs->cfg) - sizeof(lfs_freemap_t));
+
+    int err = lfs_fs_traverse(lfs, lfs_freemap_mark, fm);
+    if (err) {
+        return err;
+    }
+    fm->magic = LFS_FREEMAP_MAGIC;
+    fm->crc = lfs_freemap_crc(fm);
+    return LFS_ERR_OK;
+}
+
+bool lfs_freemap_seed(lfs_t *lfs, const lfs_freemap_t *fm, lfs_size_t size, uint32_t tag)
+{
+    if (size != lfs_freemap_size(lfs->cfg) || fm->magic != LFS_FREEMAP_MAGIC ||
+        fm->block_count != lfs->cfg->block_count || fm->tag != tag || fm->crc != lfs_freemap_crc(fm)) {
+        return false;
+    }
+    return lfs_fs_setlookahead(lfs, fm->map) == LFS_ERR_OK;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LFS_FREEMAP_H
+#define LFS_FREEMAP_H
+
+#include <stdbool.h>
+#include "lfs.h"
+
+/* Map of the blocks in use, taken while the file system is idle. Given to the
+ * allocator after the next mount it spares the traversal of the whole file
+ * system on the first allocation. It's only valid as long as nothing is
+ * programmed or erased, whoever keeps it has to drop it before that. */
+
+#define LFS_FREEMAP_MAGIC           0x50414D46  // "FMAP"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t block_count;
+    uint32_t tag;           // of the firmware that took it, see lfs_freemap_seed()
+    uint32_t crc;           // of the fields above and the map
+    uint32_t map[];         // a bit set for each block in use
+} lfs_freemap_t;
+
+// bytes of a map of the file system cfg describes
+extern lfs_size_t lfs_freemap_size(const struct lfs_config *cfg);
+// fills fm, of lfs_freemap_size() bytes
+extern int lfs_freemap_take(lfs_t *lfs, lfs_freemap_t *fm, uint32_t tag);
+// true if fm is intact, for this file system and taken with the same tag,
+// and was given to the allocator
+extern bool lfs_freemap_seed(lfs_t *lfs, const lfs_freemap_t *fm, lfs_size_t size, uint32_t tag);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "littlefs_lock.h"
+
+void littlefs_lock_init(littlefs_lock_t *lock)
+{
+    lock->mutex = xSemaphoreCreateMutex();
+    lock->idle = xSemaphoreCreateBinary();
+    lock->count = xSemaphoreCreateMutex();
+    lock->readers = 0;
+}
+
+void littlefs_lock(littlefs_lock_t *lock)
+{
+    xSemaphoreTake(lock->mutex, portMAX_DELAY);
+
+    // no one joins the readers now, wait for them to leave
+    for (;;) {
+        xSemaphoreTake(lock->count, portMAX_DELAY);
+        uint32_t readers = lock->readers;
+        xSemaphoreGive(lock->count);
+
+        if (readers == 0) {
+            break;
+        }
+        // may have been given by readers who left before, then it's taken again
+        xSemaphoreTake(lock->idle, portMAX_DELAY);
+    }
+}
+
+void littlefs_unlock(littlefs_lock_t *lock)
+{
+    xSemaphoreGive(lock->mutex);
+}
+
+void littlefs_lock_shared(littlefs_lock_t *lock)
+{
+    xSemaphoreTake(lock->mutex, portMAX_DELAY);
+    xSemaphoreTake(lock->count, portMAX_DELAY);
+    lock->readers++;
+    xSemaphoreGive(lock->count);
+    xSemaphoreGive(lock->mutex);
+}
+
+void littlefs_unlock_shared(littlefs_lock_t *lock)
+{
+    xSemaphoreTake(lock->count, portMAX_DELAY);
+    bool last = (--lock->readers == 0);
+    xSemaphoreGive(lock->count);
+
+    if (last) {
+        xSemaphoreGive(lock->idle);
+    }
+}
+
+// A file with data yet to be written flushes it first, and one inlined in its
+// directory entry is read through the caches of lfs_t. Otherwise lfs_file_read()
+// walks the blocks of the file with its own cache.
+static bool littlefs_file_read_shares(const lfs_file_t *fp)
+{
+    return (fp->flags & (LFS_F_WRITING | LFS_F_INLINE)) == 0;
+}
+
+lfs_ssize_t littlefs_file_read(lfs_t *lfs, littlefs_lock_t *lock, lfs_file_t *fp, void *buf, lfs_size_t size)
+{
+    lfs_ssize_t n;
+
+    littlefs_lock_shared(lock);
+    if (littlefs_file_read_shares(fp)) {
+        n = lfs_file_read(lfs, fp, buf, size);
+        littlefs_unlock_shared(lock);
+        return n;
+    }
+    littlefs_unlock_shared(lock);
+
+    littlefs_lock(lock);
+    n = lfs_file_read(lfs, fp, buf, size);
+    littlefs_unlock(lock);
+    return n;
+}
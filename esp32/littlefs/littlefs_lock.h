@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LITTLEFS_LOCK_H
+#define LITTLEFS_LOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lfs.h"
+
+typedef void* SemaphoreHandle_t;
+
+/* littlefs isn't reentrant: whatever changes the file system, or only reads
+ * its metadata through the caches of lfs_t, holds the lock alone. Reading a
+ * file kept in blocks of its own touches nothing but the file and the flash,
+ * so any number of those go on at once, see littlefs_file_read(). A task
+ * waiting to hold the lock alone keeps new readers out. */
+
+typedef struct littlefs_lock_s {
+    SemaphoreHandle_t mutex;        // held alone, or for a moment to join the readers
+    SemaphoreHandle_t idle;         // given when the last reader leaves
+    SemaphoreHandle_t count;        // guards readers
+    uint32_t readers;
+} littlefs_lock_t;
+
+extern void littlefs_lock_init(littlefs_lock_t *lock);
+extern void littlefs_lock(littlefs_lock_t *lock);
+extern void littlefs_unlock(littlefs_lock_t *lock);
+extern void littlefs_lock_shared(littlefs_lock_t *lock);
+extern void littlefs_unlock_shared(littlefs_lock_t *lock);
+
+// lfs_file_read() with the lock shared when the file allows, held alone otherwise
+extern lfs_ssize_t littlefs_file_read(lfs_t *lfs, littlefs_lock_t *lock, lfs_file_t *fp, void *buf, lfs_size_t size);
+
+#endif
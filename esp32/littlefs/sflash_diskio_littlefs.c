@@ -1,31 +1,79 @@
+#include <string.h>
+
 #include "ff.h" /* Needed by diskio.h */
 #include "diskio.h"
 #include "sflash_diskio.h"
 #include "sflash_diskio_littlefs.h"
+#include "lfs_util.h"
+#include "lfs_freemap.h"
+#include "nvs.h"
+#include "pycom_version.h"
 
 //TODO: figure out a proper value here
 #define PYCOM_CONTEXT ((void*)"pycom.io")
 
+#define LITTLEFS_NVS_NAMESPACE          "LFS_NVM"
+#define LITTLEFS_NVS_TUNING             "tuning"
+#define LITTLEFS_NVS_FREEMAP            "freemap"
+
+// one bit for each block of the biggest file system
+#define LITTLEFS_LOOKAHEAD_MAX          (SFLASH_BLOCK_COUNT_8MB / 8)
+// reads are cheap at any offset, the caches stay a whole block
+#define LITTLEFS_READ_SIZE_DEFAULT      256
+
 
 char prog_buffer[SFLASH_BLOCK_SIZE] = {0};
 char read_buffer[SFLASH_BLOCK_SIZE] = {0};
 // Must be on 64 bit aligned address, create it as array of 64 bit entries to achieve it
-uint64_t lookahead_buffer[SFLASH_BLOCK_COUNT_8MB/(8*8)] = {0};
+uint64_t lookahead_buffer[LITTLEFS_LOOKAHEAD_MAX/8] = {0};
+
+static uint64_t freemap_buffer[(sizeof(lfs_freemap_t) + LITTLEFS_LOOKAHEAD_MAX + 7) / 8];
+// until it's known to be gone the map in the NVS could be there, and stale
+// after the next program or erase
+static bool freemap_stored = true;
+static nvs_handle littlefs_nvs_handle;
+static bool littlefs_nvs_ready = false;
+
+static bool littlefs_nvs_open(void)
+{
+    if (!littlefs_nvs_ready) {
+        littlefs_nvs_ready = (ESP_OK == nvs_open(LITTLEFS_NVS_NAMESPACE, NVS_READWRITE, &littlefs_nvs_handle));
+    }
+    return littlefs_nvs_ready;
+}
+
+// a map taken by another firmware isn't trusted, it may not have dropped it when writing
+static uint32_t littlefs_firmware_tag(void)
+{
+    static const char build[] = SW_VERSION_NUMBER " " __DATE__ " " __TIME__;
+    return lfs_crc(0xffffffff, build, sizeof(build) - 1);
+}
+
+static bool littlefs_power_of_two(uint32_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
 
 int littlefs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
 {
-    return sflash_disk_read_littlefs(c, buffer, block, size);
+    return sflash_disk_read_littlefs(c, buffer, block, off, size);
 }
 
 
 int littlefs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
 {
-    return sflash_disk_write_littlefs(c, buffer, block, size);
+    if (!littlefs_freemap_drop()) {
+        return LFS_ERR_IO;
+    }
+    return sflash_disk_write_littlefs(c, buffer, block, off, size);
 }
 
 
 int littlefs_erase(const struct lfs_config *c, lfs_block_t block)
 {
+    if (!littlefs_freemap_drop()) {
+        return LFS_ERR_IO;
+    }
     return sflash_disk_erase_littlefs(c, block);
 }
 
@@ -41,15 +89,14 @@ struct lfs_config lfscfg =
     .prog = &littlefs_prog,
     .erase = &littlefs_erase,
     .sync = &littlefs_sync,
-    .read_size = SFLASH_BLOCK_SIZE,
+    .read_size = LITTLEFS_READ_SIZE_DEFAULT,
     .prog_size = SFLASH_BLOCK_SIZE,
     .block_size = SFLASH_BLOCK_SIZE,
     .block_count = 0, // To be initialized according to the flash size of the chip
     .block_cycles = 0, // No block-level wear-leveling
-    /* Current implementation of littlefs_read/prog/erase/sync() functions only operates with
-     * full blocks, always the starting address of the block is passed to the driver.
+    /* By default the file system is programmed a whole block at a time, a commit takes a block.
      * This helps on the Power-loss resilient behavior of LittleFS, with this approach the File System will not be corrupted by corruption of a single file/block
-     * E.g.: it is not possible to only read/write a middle of a block, inline files will not work, set cache_size equal to read/prog size.*/
+     * The cache_size has to be a multiple of the prog_size, see littlefs_set_tuning() for smaller ones. */
     .cache_size = SFLASH_BLOCK_SIZE,
     .lookahead_size = 0, // To be initialized according to the flash size of the chip
     .prog_buffer = prog_buffer,
@@ -59,3 +106,99 @@ struct lfs_config lfscfg =
     .file_max = 0, // 0 means it is equal to LFS_FILE_MAX
     .attr_max = 0 // 0 means it is equal to LFS_ATTR_MAX
 };
+
+void littlefs_init_config(lfs_size_t block_count)
+{
+    littlefs_tuning_t tuning = {
+        .read_size = LITTLEFS_READ_SIZE_DEFAULT,
+        .prog_size = SFLASH_BLOCK_SIZE,
+        .cache_size = SFLASH_BLOCK_SIZE,
+        // the whole file system at once
+        .lookahead_size = ((block_count + 63) / 64) * 8,
+    };
+    littlefs_tuning_t stored;
+    size_t size = sizeof(stored);
+
+    lfscfg.block_count = block_count;
+    // the sizes given to os.fsformat(), they don't change the format on the flash
+    if (littlefs_nvs_open() && ESP_OK == nvs_get_blob(littlefs_nvs_handle, LITTLEFS_NVS_TUNING, &stored, &size) &&
+        size == sizeof(stored) && littlefs_tuning_valid(&stored)) {
+        tuning = stored;
+    }
+    littlefs_tuning_apply(&tuning);
+}
+
+// files of up to block_size / 8 bytes are kept in their directory, and can only be opened
+// with a cache that holds them whole, so a smaller one wouldn't read all the files back
+bool littlefs_tuning_valid(const littlefs_tuning_t *tuning)
+{
+    return littlefs_power_of_two(tuning->read_size) && littlefs_power_of_two(tuning->prog_size) &&
+           littlefs_power_of_two(tuning->cache_size) && tuning->read_size >= 16 && tuning->prog_size >= 16 &&
+           tuning->cache_size >= tuning->read_size && tuning->cache_size >= tuning->prog_size &&
+           tuning->cache_size >= SFLASH_BLOCK_SIZE / 8 && tuning->cache_size <= SFLASH_BLOCK_SIZE &&
+           tuning->lookahead_size >= 8 && tuning->lookahead_size <= LITTLEFS_LOOKAHEAD_MAX && (tuning->lookahead_size % 8) == 0;
+}
+
+// the file system must not be mounted
+void littlefs_tuning_apply(const littlefs_tuning_t *tuning)
+{
+    lfscfg.read_size = tuning->read_size;
+    lfscfg.prog_size = tuning->prog_size;
+    lfscfg.cache_size = tuning->cache_size;
+    lfscfg.lookahead_size = tuning->lookahead_size;
+}
+
+void littlefs_tuning_get(littlefs_tuning_t *tuning)
+{
+    tuning->read_size = lfscfg.read_size;
+    tuning->prog_size = lfscfg.prog_size;
+    tuning->cache_size = lfscfg.cache_size;
+    tuning->lookahead_size = lfscfg.lookahead_size;
+}
+
+bool littlefs_tuning_save(const littlefs_tuning_t *tuning)
+{
+    return littlefs_nvs_open() && ESP_OK == nvs_set_blob(littlefs_nvs_handle, LITTLEFS_NVS_TUNING, tuning, sizeof(*tuning)) &&
+           ESP_OK == nvs_commit(littlefs_nvs_handle);
+}
+
+void littlefs_freemap_save(lfs_t *lfs)
+{
+    lfs_freemap_t *fm = (lfs_freemap_t *)freemap_buffer;
+    lfs_size_t size = lfs_freemap_size(lfs->cfg);
+
+    if (size <= sizeof(freemap_buffer) && LFS_ERR_OK == lfs_freemap_take(lfs, fm, littlefs_firmware_tag()) &&
+        littlefs_nvs_open() && ESP_OK == nvs_set_blob(littlefs_nvs_handle, LITTLEFS_NVS_FREEMAP, fm, size) &&
+        ESP_OK == nvs_commit(littlefs_nvs_handle)) {
+        freemap_stored = true;
+    }
+}
+
+void littlefs_freemap_load(lfs_t *lfs)
+{
+    size_t size = sizeof(freemap_buffer);
+
+    if (littlefs_nvs_open() && ESP_OK == nvs_get_blob(littlefs_nvs_handle, LITTLEFS_NVS_FREEMAP, freemap_buffer, &size)) {
+        if (!lfs_freemap_seed(lfs, (lfs_freemap_t *)freemap_buffer, size, littlefs_firmware_tag())) {
+            littlefs_freemap_drop();
+        }
+    }
+}
+
+bool littlefs_freemap_drop(void)
+{
+    if (freemap_stored) {
+        if (!littlefs_nvs_open()) {
+            return false;
+        }
+        esp_err_t err = nvs_erase_key(littlefs_nvs_handle, LITTLEFS_NVS_FREEMAP);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            freemap_stored = false;
+        } else if (err == ESP_OK && ESP_OK == nvs_commit(littlefs_nvs_handle)) {
+            freemap_stored = false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,13 +1,35 @@
-
 #ifndef SFLASH_DISKIO_LITTLEFS_H
 #define SFLASH_DISKIO_LITTLEFS_H
 
+#include <stdbool.h>
 #include "lfs.h"
 
+// the sizes of littlefs that can be chosen with os.fsformat(), see struct lfs_config
+typedef struct {
+    uint32_t read_size;
+    uint32_t prog_size;
+    uint32_t cache_size;
+    uint32_t lookahead_size;
+} littlefs_tuning_t;
+
 extern int littlefs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
 extern int littlefs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
 extern int littlefs_erase(const struct lfs_config *c, lfs_block_t block);
 extern int littlefs_sync(const struct lfs_config *c);
 extern struct lfs_config lfscfg;
 
+// sets up lfscfg for block_count blocks, with the sizes saved last if any
+extern void littlefs_init_config(lfs_size_t block_count);
+extern bool littlefs_tuning_valid(const littlefs_tuning_t *tuning);
+extern void littlefs_tuning_apply(const littlefs_tuning_t *tuning);
+extern void littlefs_tuning_get(littlefs_tuning_t *tuning);
+extern bool littlefs_tuning_save(const littlefs_tuning_t *tuning);
+
+// The map of the blocks in use, kept in the NVS so that the first allocation
+// after the next mount doesn't traverse the whole file system. Saved by
+// os.sync(), dropped before anything is programmed or erased.
+extern void littlefs_freemap_save(lfs_t *lfs);
+extern void littlefs_freemap_load(lfs_t *lfs);
+extern bool littlefs_freemap_drop(void);
+
 #endif
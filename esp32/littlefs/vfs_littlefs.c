@@ -6,9 +6,12 @@
 #include "py/mperrno.h"
 #include "lib/oofatfs/ff.h"
 #include "extmod/vfs.h"
+#include "extmod/vfs_mmap.h"
 #include "vfs_littlefs.h"
 #include "lib/timeutils/timeutils.h"
 #include "sflash_diskio_littlefs.h"
+#include "sflash_diskio.h"
+#include "esp_flash_encrypt.h"
 
 
 int lfs_statvfs_count(void *p, lfs_block_t b)
@@ -21,24 +24,28 @@ int lfs_statvfs_count(void *p, lfs_block_t b)
 const char* concat_with_cwd(vfs_lfs_struct_t* littlefs, const char* path)
 {
     char* path_out = NULL;
+    size_t len = strlen(path);
 
     if (path[0] == '/') /* Absolute path */
     {
-        path_out = (char*)malloc(strlen(path) + 1); // Count the \0 too
+        path_out = (char*)malloc(len + 1); // Count the \0 too
         if(path_out != NULL)
         {
-            strcpy(path_out, path);
+            memcpy(path_out, path, len + 1);
         }
     }
     else
     {
-        path_out = (char*)malloc(strlen(littlefs->cwd) + 1 + strlen(path) + 1);
+        // the length of the cwd is kept with it, see change_cwd()
+        size_t cwd_len = littlefs->cwd_len;
+
+        path_out = (char*)malloc(cwd_len + 1 + len + 1);
         if(path_out != NULL)
         {
-            strcpy(path_out, littlefs->cwd);
-            if (strlen(path_out) > 1) strcat(path_out, "/"); //if not root append / to the end
-            strcat(path_out, path);
-            uint len = strlen(path_out);
+            memcpy(path_out, littlefs->cwd, cwd_len);
+            if (cwd_len > 1) path_out[cwd_len++] = '/'; //if not root append / to the end
+            memcpy(path_out + cwd_len, path, len + 1);
+            len += cwd_len;
             if ((len > 1) && (path_out[len - 1] == '/')) //Remove trailing "/" from the end if any
             {
                 path_out[len - 1] = '\0';
@@ -90,79 +97,68 @@ static mp_import_stat_t lfs_vfs_import_stat(void *self, const char *path)
     }
 }
 
+// Goes to path_in, absolute or relative to the cwd. "." and ".." are resolved
+// while the new path is put together, so that only the directory it ends in
+// is looked up, instead of each one on the way from the root, and the cwd is
+// left as it was if it doesn't exist.
 static int change_cwd(vfs_lfs_struct_t* littlefs, const char* path_in)
 {
-    int res;
+    size_t len = strlen(path_in);
+    size_t cwd_len = 0;
+    char* cwd = (char*)malloc(littlefs->cwd_len + 1 + len + 1);
 
-    if(path_in[0] == '.' && path_in[1] == '.' && path_in[2] == '\0') // go back 1 level
+    if(cwd == NULL)
     {
-        if(strlen(littlefs->cwd) > 1) // if cwd = "/" do nothing, else go back to one level
-        {
-            uint len = strlen(littlefs->cwd);
-            for(;; len--)
-            {
-                if(len == 0)
-                {
-                    littlefs->cwd[1] = '\0';
-                    break;
-                }
-                else if(littlefs->cwd[len] == '/')
-                {
-                    littlefs->cwd[len] = '\0';
-                    break;
-                }
-            }
-        }
-        res = LFS_ERR_OK;
+        return LFS_ERR_NOMEM;
     }
-    else if(path_in[0] == '.' && path_in[1] == '\0') // "." means the current directory, do nothing
+
+    // without the trailing "/", the root is the empty string until the end
+    if(path_in[0] != '/' && littlefs->cwd_len > 1)
     {
-        res = LFS_ERR_OK;
+        cwd_len = littlefs->cwd_len;
+        memcpy(cwd, littlefs->cwd, cwd_len);
     }
-    else // append the new relative path to the end
-    {
-        const char* new_path = concat_with_cwd(littlefs, path_in);
 
-        if(new_path == NULL)
+    const char* name = path_in;
+    while(*name != '\0')
+    {
+        const char* end = strchr(name, '/');
+        if(end == NULL)
         {
-            res = LFS_ERR_NOMEM;
+            end = name + strlen(name);
         }
-        else if(is_valid_directory(littlefs, new_path))
-        {
-            free(littlefs->cwd);
-            littlefs->cwd = (char*)new_path;
+        size_t name_len = end - name;
 
-            res = LFS_ERR_OK;
+        if(name_len == 2 && name[0] == '.' && name[1] == '.') // go back 1 level
+        {
+            while(cwd_len > 0 && cwd[--cwd_len] != '/');
         }
-        else
+        else if(name_len > 0 && !(name_len == 1 && name[0] == '.')) // "." means the current directory
         {
-            res = LFS_ERR_NOENT;
+            cwd[cwd_len++] = '/';
+            memcpy(&cwd[cwd_len], name, name_len);
+            cwd_len += name_len;
         }
-    }
 
-    return res;
-}
+        name = (*end == '/') ? end + 1 : end;
+    }
 
-static int parse_and_append_to_cwd(vfs_lfs_struct_t* littlefs, const char* path_in)
-{
-    char tmp[LFS_NAME_MAX+1];
-    int start = 0;
-    int end = 1; // Skip the first / = absolute path is given
-    while(end < strlen(path_in)+1) // Read until the end of the path
+    if(cwd_len == 0)
     {
-        while(path_in[end] != '/' && path_in[end] != '\0') end++; //find the first / or end of the path
-        memset(tmp,0,end-start); // Clear the buffer
-        memcpy(tmp, &path_in[start], end-start); // Copy the element of the path
-        tmp[end-start] = '\0'; //
-
-        int retVal = change_cwd(littlefs, tmp);
-
-        if(retVal != LFS_ERR_OK) return retVal;
+        cwd[cwd_len++] = '/';
+    }
+    cwd[cwd_len] = '\0';
 
-        end++; //skip the found / in path_in
-        start = end;
+    if(cwd_len > 1 && !is_valid_directory(littlefs, cwd))
+    {
+        free(cwd);
+        return LFS_ERR_NOENT;
     }
 
+    free(littlefs->cwd);
+    littlefs->cwd = cwd;
+    littlefs->cwd_len = cwd_len;
+
     return LFS_ERR_OK;
 }
 
@@ -396,9 +392,21 @@ void littlefs_update_timestamp_cfg(struct lfs_file_config *cfg)
 }
 
 
+STATIC mp_uint_t littlefs_timestamp_seconds(const lfs_timestamp_attribute_t *ts) {
+    return timeutils_seconds_since_2000(
+        1980 + ((ts->fdate >> 9) & 0x7f),
+        (ts->fdate >> 5) & 0x0f,
+        ts->fdate & 0x1f,
+        (ts->ftime >> 11) & 0x1f,
+        (ts->ftime >> 5) & 0x3f,
+        2 * (ts->ftime & 0x1f)
+    );
+}
+
 typedef struct _mp_vfs_littlefs_ilistdir_it_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
+    bool with_stat;
     bool is_str;
     lfs_dir_t dir;
     vfs_lfs_struct_t* littlefs;
@@ -410,10 +418,18 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
     //cycle is needed to filter out "." and ".."
     for (;;) {
         struct lfs_info fno;
+        lfs_timestamp_attribute_t ts = { 0, 0 };
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(&self->littlefs->lock);
             int res = lfs_dir_read(&self->littlefs->lfs, &self->dir, &fno);
-        xSemaphoreGive(self->littlefs->mutex);
+            if (res > LFS_ERR_OK && self->with_stat) {
+                // from where the entry is, stat() would look the path up again
+                if (lfs_dir_getattr(&self->littlefs->lfs, &self->dir, LFS_ATTRIBUTE_TIMESTAMP, &ts, sizeof(ts)) < LFS_ERR_OK) {
+                    ts.fdate = 0;
+                    ts.ftime = 0;
+                }
+            }
+        littlefs_unlock(&self->littlefs->lock);
 
         char *fn = fno.name;
         if (res < LFS_ERR_OK || fn[0] == 0) {
@@ -425,30 +441,23 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
         if(fn[0] == '.' && fn[1] == '\0') continue;
         if(fn[0] == '.' && fn[1] == '.' && fn[2] == '\0') continue;
 
-        // make 4-tuple with info about this entry
-        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(4, NULL));
+        mp_obj_t name;
         if (self->is_str) {
-            t->items[0] = mp_obj_new_str(fn, strlen(fn));
-        } else {
-            t->items[0] = mp_obj_new_bytes((const byte*)fn, strlen(fn));
-        }
-        if (fno.type == LFS_TYPE_DIR) {
-            // dir
-            t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR);
+            name = mp_obj_new_str(fn, strlen(fn));
         } else {
-            // file
-            t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFREG);
+            name = mp_obj_new_bytes((const byte*)fn, strlen(fn));
         }
-        t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
-        t->items[3] = mp_obj_new_int_from_uint(fno.size);
-
-        return MP_OBJ_FROM_PTR(t);
+        // Size only interpreted on files, not directories
+        return mp_vfs_ilistdir_entry(self->with_stat, name,
+            (fno.type == LFS_TYPE_DIR) ? MP_S_IFDIR : MP_S_IFREG,
+            (fno.type == LFS_TYPE_REG) ? fno.size : 0,
+            littlefs_timestamp_seconds(&ts));
     }
 
     // ignore error because we may be closing a second time
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    littlefs_lock(&self->littlefs->lock);
         lfs_dir_close(&self->littlefs->lfs, &self->dir);
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(&self->littlefs->lock);
 
     return MP_OBJ_STOP_ITERATION;
 }
@@ -460,7 +469,7 @@ STATIC mp_obj_t littlefs_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args)
     const char *path_in;
     int res = LFS_ERR_OK;
 
-    if (n_args == 2) {
+    if (n_args >= 2) {
         if (mp_obj_get_type(args[1]) == &mp_type_bytes) {
             is_str_type = false;
         }
@@ -474,16 +483,17 @@ STATIC mp_obj_t littlefs_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args)
     iter->littlefs = &self->fs.littlefs;
     iter->base.type = &mp_type_polymorph_iter;
     iter->iternext = mp_vfs_littlefs_ilistdir_it_iternext;
+    iter->with_stat = mp_vfs_ilistdir_with_stat(n_args, args, 2);
     iter->is_str = is_str_type;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_dir_open(&self->fs.littlefs.lfs, &iter->dir, path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     free((void*)path);
 
@@ -493,7 +503,7 @@ STATIC mp_obj_t littlefs_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args)
 
     return MP_OBJ_FROM_PTR(iter);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_ilistdir_obj, 1, 2, littlefs_vfs_ilistdir_func);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_ilistdir_obj, 1, 3, littlefs_vfs_ilistdir_func);
 
 STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
 
@@ -501,7 +511,7 @@ STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
@@ -511,7 +521,7 @@ STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
                 littlefs_update_timestamp(&self->fs.littlefs.lfs, path);
             }
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     free((void*)path);
 
@@ -530,14 +540,14 @@ STATIC mp_obj_t littlefs_vfs_remove(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_remove(&self->fs.littlefs.lfs, path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     free((void*)path);
 
@@ -557,7 +567,7 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
     const char *path_in = mp_obj_str_get_str(path_param_in);
     const char *path_out = mp_obj_str_get_str(path_param_out);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         const char *old_path = concat_with_cwd(&self->fs.littlefs, path_in);
         const char *new_path = concat_with_cwd(&self->fs.littlefs, path_out);
 
@@ -566,7 +576,7 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
         } else {
             res = lfs_rename(&self->fs.littlefs.lfs, old_path, new_path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     free((void*)old_path);
     free((void*)new_path);
@@ -586,9 +596,9 @@ STATIC mp_obj_t littlefs_vfs_chdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
-        res = parse_and_append_to_cwd(&self->fs.littlefs, path_in);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_lock(&self->fs.littlefs.lock);
+        res = change_cwd(&self->fs.littlefs, path_in);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     if (res != LFS_ERR_OK) {
         mp_raise_OSError(littleFsErrorToErrno(res));
@@ -602,9 +612,9 @@ STATIC mp_obj_t littlefs_vfs_getcwd(mp_obj_t vfs_in) {
 
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
-        mp_obj_t ret = mp_obj_new_str(self->fs.littlefs.cwd, strlen(self->fs.littlefs.cwd));
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_lock(&self->fs.littlefs.lock);
+        mp_obj_t ret = mp_obj_new_str(self->fs.littlefs.cwd, self->fs.littlefs.cwd_len);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     return ret;
 }
@@ -619,7 +629,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
     lfs_timestamp_attribute_t ts;
 
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
@@ -631,7 +641,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
             res = littlefs_stat_common_helper(&self->fs.littlefs.lfs, path, &fno, &ts);
         }
 
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     free((void*)path);
 
@@ -647,14 +657,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
         mode |= MP_S_IFREG;
     }
 
-    mp_int_t seconds = timeutils_seconds_since_2000(
-        1980 + ((ts.fdate >> 9) & 0x7f),
-        (ts.fdate >> 5) & 0x0f,
-        ts.fdate & 0x1f,
-        (ts.ftime >> 11) & 0x1f,
-        (ts.ftime >> 5) & 0x3f,
-        2 * (ts.ftime & 0x1f)
-    );
+    mp_int_t seconds = littlefs_timestamp_seconds(&ts);
 
     t->items[0] = MP_OBJ_NEW_SMALL_INT(mode); // st_mode
     t->items[1] = MP_OBJ_NEW_SMALL_INT(0); // st_ino
@@ -687,9 +690,9 @@ STATIC mp_obj_t littlefs_vfs_statvfs(mp_obj_t vfs_in, mp_obj_t path_in) {
 
     mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(10, NULL));
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -717,9 +720,9 @@ STATIC mp_obj_t littlefs_vfs_getfree(mp_obj_t vfs_in) {
 
     lfs_t* lfs = &self->fs.littlefs.lfs;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs.lock);
         lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs.lock);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -731,6 +734,60 @@ STATIC mp_obj_t littlefs_vfs_getfree(mp_obj_t vfs_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(littlefs_vfs_getfree_obj, littlefs_vfs_getfree);
 
+#if MICROPY_VFS_MMAP
+STATIC void littlefs_vfs_munmap(const uint8_t *data, size_t len, uintptr_t handle) {
+    sflash_disk_munmap(handle);
+}
+
+// Only a file that fits in one block is in one piece, the data of the bigger
+// ones is interleaved with the pointers of their skip-list. The ones that are
+// kept in their directory aren't either, and littlefs reads around the flash
+// encryption.
+STATIC mp_obj_t littlefs_vfs_mmap(mp_obj_t vfs_in, mp_obj_t path_in) {
+
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
+    lfs_t *lfs = &self->fs.littlefs.lfs;
+    lfs_file_t fp;
+    int res;
+
+    if (esp_flash_encryption_enabled()) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+
+    littlefs_lock(&self->fs.littlefs.lock);
+        const char *path = concat_with_cwd(&self->fs.littlefs, mp_obj_str_get_str(path_in));
+        if (path == NULL) {
+            res = LFS_ERR_NOMEM;
+        } else {
+            res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+            if (res == LFS_ERR_OK) {
+                res = lfs_file_close(lfs, &fp);
+            }
+        }
+    littlefs_unlock(&self->fs.littlefs.lock);
+
+    free((void*)path);
+
+    if (res < LFS_ERR_OK) {
+        mp_raise_OSError(littleFsErrorToErrno(res));
+    }
+    if (fp.ctz.size == 0) {
+        return mp_vfs_mmap_new("", 0, NULL, 0);
+    }
+    if ((fp.flags & LFS_F_INLINE) || fp.ctz.size > lfs->cfg->block_size) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+
+    const void *data;
+    uint32_t handle;
+    if (!sflash_disk_mmap(fp.ctz.head * lfs->cfg->block_size, fp.ctz.size, &data, &handle)) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    return mp_vfs_mmap_new(data, fp.ctz.size, littlefs_vfs_munmap, handle);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(littlefs_vfs_mmap_obj, littlefs_vfs_mmap);
+#endif
+
 STATIC mp_obj_t littlefs_vfs_umount(mp_obj_t self_in) {
     (void)self_in;
     // keep the LittleFs filesystem mounted internally so the VFS methods can still be used
@@ -738,15 +795,65 @@ STATIC mp_obj_t littlefs_vfs_umount(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(littlefs_vfs_umount_obj, littlefs_vfs_umount);
 
-STATIC mp_obj_t littlefs_vfs_fsformat(mp_obj_t vfs_in)
+// os.fsformat('/flash', *, read_size, prog_size, cache_size, lookahead_size)
+// The sizes left out are kept, the ones given are used from now on and at every boot
+STATIC mp_obj_t littlefs_vfs_fsformat(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
-    fs_user_mount_t * vfs = MP_OBJ_TO_PTR(vfs_in);
+    enum { ARG_read_size, ARG_prog_size, ARG_cache_size, ARG_lookahead_size };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_read_size,        MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_prog_size,        MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_cache_size,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_lookahead_size,   MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    fs_user_mount_t * vfs = MP_OBJ_TO_PTR(pos_args[0]);
+    lfs_t *lfs = &vfs->fs.littlefs.lfs;
+    littlefs_tuning_t tuning;
+    bool tuned = false;
+
+    littlefs_tuning_get(&tuning);
+    if (args[ARG_read_size].u_int > 0) {
+        tuning.read_size = args[ARG_read_size].u_int;
+        tuned = true;
+    }
+    if (args[ARG_prog_size].u_int > 0) {
+        tuning.prog_size = args[ARG_prog_size].u_int;
+        tuned = true;
+    }
+    if (args[ARG_cache_size].u_int > 0) {
+        tuning.cache_size = args[ARG_cache_size].u_int;
+        tuned = true;
+    }
+    if (args[ARG_lookahead_size].u_int > 0) {
+        tuning.lookahead_size = args[ARG_lookahead_size].u_int;
+        tuned = true;
+    }
+    if (!littlefs_tuning_valid(&tuning)) {
+        mp_raise_ValueError("invalid sizes");
+    }
+
+    littlefs_lock(&vfs->fs.littlefs.lock);
+        lfs_unmount(lfs);
+        littlefs_tuning_apply(&tuning);
+        int res = lfs_format(lfs, &lfscfg);
+        if (res == LFS_ERR_OK) {
+            res = lfs_mount(lfs, &lfscfg);
+        }
+    littlefs_unlock(&vfs->fs.littlefs.lock);
 
-    lfs_format(&vfs->fs.littlefs.lfs, &lfscfg);
+    if (res != LFS_ERR_OK) {
+        mp_raise_OSError(littleFsErrorToErrno(res));
+    }
+    if (tuned && !littlefs_tuning_save(&tuning)) {
+        mp_raise_OSError(MP_EIO);
+    }
 
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(littlefs_vfs_fsformat_obj, littlefs_vfs_fsformat);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(littlefs_vfs_fsformat_obj, 1, littlefs_vfs_fsformat);
 
 STATIC const mp_rom_map_elem_t littlefs_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_open),        MP_ROM_PTR(&littlefs_vfs_open_obj) },
@@ -760,6 +867,9 @@ STATIC const mp_rom_map_elem_t littlefs_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_stat),        MP_ROM_PTR(&littlefs_vfs_stat_obj) },
     { MP_ROM_QSTR(MP_QSTR_statvfs),     MP_ROM_PTR(&littlefs_vfs_statvfs_obj) },
     { MP_ROM_QSTR(MP_QSTR_getfree),     MP_ROM_PTR(&littlefs_vfs_getfree_obj) },
+    #if MICROPY_VFS_MMAP
+    { MP_ROM_QSTR(MP_QSTR_mmap),        MP_ROM_PTR(&littlefs_vfs_mmap_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_umount),      MP_ROM_PTR(&littlefs_vfs_umount_obj) },
     { MP_ROM_QSTR(MP_QSTR_fsformat),    MP_ROM_PTR(&littlefs_vfs_fsformat_obj) }
 
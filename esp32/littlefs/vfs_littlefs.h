@@ -4,11 +4,10 @@
 #include "py/obj.h"
 #include "lib/oofatfs/ff.h" //Needed for FatFs types
 #include "lfs.h"
+#include "littlefs_lock.h"
 
 #define LFS_ATTRIBUTE_TIMESTAMP     ((uint8_t)1)
 
-typedef void* SemaphoreHandle_t;
-
 typedef struct pycom_lfs_file_s {
     lfs_file_t fp;
     struct lfs_file_config cfg;  // Attributes of the file, e.g.: timestamp
@@ -19,7 +18,8 @@ typedef struct vfs_lfs_struct_s
 {
     lfs_t lfs;
     char* cwd; // Needs to be initialized to point to: "/\0"
-    SemaphoreHandle_t mutex; // Needs to be created
+    size_t cwd_len; // strlen(cwd), needs to be initialized to 1
+    littlefs_lock_t lock; // Needs to be initialized, see littlefs_lock_init()
 }vfs_lfs_struct_t;
 
 typedef struct lfs_timestamp_attribute_s
@@ -50,7 +50,7 @@ extern lfs_timestamp_attribute_t littlefs_get_timestamp_fp(lfs_file_t* fp);
 
 
 extern const mp_obj_type_t mp_littlefs_vfs_type;
-MP_DECLARE_CONST_FUN_OBJ_3(littlefs_vfs_open_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_open_obj);
 
 
 #endif // MICROPY_INCLUDED_VFS_LITTLEFS_H
@@ -6,8 +6,10 @@
 #include "py/runtime.h"
 #include "py/stream.h"
 #include "py/mperrno.h"
+#include "py/mphal.h"
 #include "lfs.h"
 #include "extmod/vfs.h"
+#include "extmod/vfs_log.h"
 #include "vfs_littlefs.h"
 
 extern const mp_obj_type_t mp_type_vfs_lfs_fileio;
@@ -20,6 +22,9 @@ typedef struct _pyb_file_obj_t {
     vfs_lfs_struct_t* littlefs;
     struct lfs_file_config cfg;  // Attributes of the file, e.g.: timestamp
     bool timestamp_update;  // For requesting timestamp update when closing the file
+    #if MICROPY_VFS_LOG
+    vfs_log_t log;
+    #endif
 } pyb_file_obj_t;
 
 STATIC void file_obj_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
@@ -31,9 +36,10 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
-        lfs_ssize_t sz_out = lfs_file_read(&self->littlefs->lfs ,&self->fp, buf, size);
-    xSemaphoreGive(self->littlefs->mutex);
+    // other threads run meanwhile, and read other files too
+    MP_THREAD_GIL_EXIT();
+        lfs_ssize_t sz_out = littlefs_file_read(&self->littlefs->lfs, &self->littlefs->lock, &self->fp, buf, size);
+    MP_THREAD_GIL_ENTER();
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -42,17 +48,76 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
     return sz_out;
 }
 
+#if MICROPY_VFS_LOG
+// the log writes out through these, with the GIL released by the caller
+STATIC int file_log_write(void *ctx, const void *buf, size_t len, size_t *written) {
+    pyb_file_obj_t *self = ctx;
+
+    littlefs_lock(&self->littlefs->lock);
+        lfs_ssize_t sz_out = lfs_file_write(&self->littlefs->lfs, &self->fp, buf, len);
+        if(sz_out > 0) {
+            self->timestamp_update = true;
+        }
+    littlefs_unlock(&self->littlefs->lock);
+
+    if (sz_out < 0) {
+        *written = 0;
+        return littleFsErrorToErrno(sz_out);
+    }
+    *written = sz_out;
+    return (sz_out == len) ? 0 : MP_ENOSPC;
+}
+
+STATIC int file_log_sync(void *ctx) {
+    pyb_file_obj_t *self = ctx;
+
+    littlefs_lock(&self->littlefs->lock);
+        int res = lfs_file_sync(&self->littlefs->lfs, &self->fp);
+    littlefs_unlock(&self->littlefs->lock);
+
+    return (res < 0) ? littleFsErrorToErrno(res) : 0;
+}
+
+STATIC const vfs_log_io_t file_log_io = {
+    .write = file_log_write,
+    .sync = file_log_sync,
+};
+#endif
+
 STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    #if MICROPY_VFS_LOG
+    if (self->log.buf != NULL) {
+        // one write() is one record
+        if (size > VFS_LOG_RECORD_MAX) {
+            *errcode = MP_EINVAL;
+            return MP_STREAM_ERROR;
+        }
+        if (size == 0) {
+            return 0;
+        }
+        MP_THREAD_GIL_EXIT();
+            int res = vfs_log_append(&self->log, buf, size, mp_hal_ticks_ms());
+        MP_THREAD_GIL_ENTER();
+        if (res != 0) {
+            *errcode = res;
+            return MP_STREAM_ERROR;
+        }
+        return size;
+    }
+    #endif
+
+    MP_THREAD_GIL_EXIT();
+    littlefs_lock(&self->littlefs->lock);
         lfs_ssize_t sz_out = lfs_file_write(&self->littlefs->lfs, &self->fp, buf, size);
         // Request timestamp update if file has been written successfully
         if(sz_out > 0) {
             self->timestamp_update = true;
         }
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(&self->littlefs->lock);
+    MP_THREAD_GIL_ENTER();
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -80,18 +145,44 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
         struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        #if MICROPY_VFS_LOG
+        // write them out first, so tell() counts them
+        if (self->log.buf != NULL) {
+            int res = vfs_log_flush(&self->log);
+            if (res != 0) {
+                *errcode = res;
+                return MP_STREAM_ERROR;
+            }
+        }
+        #endif
+
+        littlefs_lock(&self->littlefs->lock);
             lfs_file_seek(&self->littlefs->lfs, &self->fp, s->offset, s->whence);
             s->offset = lfs_file_tell(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(&self->littlefs->lock);
 
         return 0;
 
     } else if (request == MP_STREAM_FLUSH) {
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        #if MICROPY_VFS_LOG
+        if (self->log.buf != NULL) {
+            MP_THREAD_GIL_EXIT();
+                int res = vfs_log_flush(&self->log);
+            MP_THREAD_GIL_ENTER();
+            if (res != 0) {
+                *errcode = res;
+                return MP_STREAM_ERROR;
+            }
+            return 0;
+        }
+        #endif
+
+        MP_THREAD_GIL_EXIT();
+        littlefs_lock(&self->littlefs->lock);
             int res = lfs_file_sync(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(&self->littlefs->lock);
+        MP_THREAD_GIL_ENTER();
 
         if (res < 0) {
             *errcode = littleFsErrorToErrno(res);
@@ -101,13 +192,29 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
     } else if (request == MP_STREAM_CLOSE) {
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        // keeps the GIL, the finaliser closes files while the GC is locked
+        #if MICROPY_VFS_LOG
+        int log_res = 0;
+        if (self->log.buf != NULL) {
+            log_res = vfs_log_flush(&self->log);
+            m_del(byte, self->log.buf, self->log.size);
+            self->log.buf = NULL;
+        }
+        #endif
+
+        littlefs_lock(&self->littlefs->lock);
             int res = littlefs_close_common_helper(&self->littlefs->lfs, &self->fp, &self->cfg, &self->timestamp_update);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(&self->littlefs->lock);
         if (res < 0) {
             *errcode = littleFsErrorToErrno(res);
             return MP_STREAM_ERROR;
         }
+        #if MICROPY_VFS_LOG
+        if (log_res != 0) {
+            *errcode = log_res;
+            return MP_STREAM_ERROR;
+        }
+        #endif
         // Free up the object so GC does not need to do that
         m_del_obj(pyb_file_obj_t, self);
 
@@ -127,8 +234,9 @@ STATIC const mp_arg_t file_open_args[] = {
 };
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
 
-STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args) {
+STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args, mp_int_t buffering) {
     int mode = 0;
+    bool binary = false;
     const char *mode_s = mp_obj_str_get_str(args[1].u_obj);
 
     assert(vfs != NULL);
@@ -154,6 +262,7 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
             #if MICROPY_PY_IO_FILEIO
             case 'b':
                 type = &mp_type_vfs_lfs_fileio;
+                binary = true;
                 break;
             #endif
             case 't':
@@ -165,11 +274,17 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
     pyb_file_obj_t *o = m_new_obj_with_finaliser(pyb_file_obj_t);
     o->base.type = type;
     o->timestamp_update = false;
-
-    xSemaphoreTake(vfs->fs.littlefs.mutex, portMAX_DELAY);
+    #if MICROPY_VFS_LOG
+    o->log.buf = NULL;
+    #else
+    (void)binary;
+    (void)buffering;
+    #endif
+
+    littlefs_lock(&vfs->fs.littlefs.lock);
         const char *fname = concat_with_cwd(&vfs->fs.littlefs, mp_obj_str_get_str(args[0].u_obj));
         int res = littlefs_open_common_helper(&vfs->fs.littlefs.lfs, fname, &o->fp, mode, &o->cfg, &o->timestamp_update);
-    xSemaphoreGive(vfs->fs.littlefs.mutex);
+    littlefs_unlock(&vfs->fs.littlefs.lock);
 
     free((void*)fname);
     if (res < LFS_ERR_OK) {
@@ -179,13 +294,20 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
 
     o->littlefs = &vfs->fs.littlefs;
 
+    #if MICROPY_VFS_LOG
+    // open(path, 'ab', buffering=N) makes a log file, see extmod/vfs_log.h
+    if (binary && (mode & (LFS_O_APPEND | LFS_O_RDWR)) == (LFS_O_APPEND | LFS_O_WRONLY) && buffering >= VFS_LOG_BUFFER_MIN) {
+        vfs_log_init(&o->log, m_new(byte, buffering), buffering, MICROPY_VFS_LOG_INTERVAL_MS, &file_log_io, o);
+    }
+    #endif
+
     return MP_OBJ_FROM_PTR(o);
 }
 
 STATIC mp_obj_t file_obj_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
     mp_arg_parse_all_kw_array(n_args, n_kw, args, FILE_OPEN_NUM_ARGS, file_open_args, arg_vals);
-    return file_open(NULL, type, arg_vals);
+    return file_open(NULL, type, arg_vals, -1);
 }
 
 // TODO gc hook to close the file if not already closed
@@ -245,15 +367,15 @@ const mp_obj_type_t mp_type_vfs_lfs_textio = {
 };
 
 // Factory function for I/O stream classes
-STATIC mp_obj_t littlefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-    // TODO: analyze buffering args and instantiate appropriate type
-    fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+STATIC mp_obj_t littlefs_builtin_open_self(size_t n_args, const mp_obj_t *args) {
+    // buffering only matters to log files
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
-    arg_vals[0].u_obj = path;
-    arg_vals[1].u_obj = mode;
+    arg_vals[0].u_obj = args[1];
+    arg_vals[1].u_obj = args[2];
     arg_vals[2].u_obj = mp_const_none;
-    return file_open(self, &mp_type_vfs_lfs_textio, arg_vals);
+    return file_open(self, &mp_type_vfs_lfs_textio, arg_vals, (n_args > 3) ? mp_obj_get_int(args[3]) : -1);
 }
-MP_DEFINE_CONST_FUN_OBJ_3(littlefs_vfs_open_obj, littlefs_builtin_open_self);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_open_obj, 3, 4, littlefs_builtin_open_self);
 
 //#endif // MICROPY_VFS && MICROPY_VFS_FAT
@@ -110,7 +110,10 @@ static const uint32_t mach_uart_pin_af[MACH_NUM_UARTS][4] = { { U0TXD_OUT_IDX, U
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
 void uart_init0 (void) {
-
+    // the root pointers outlive a soft reset, the polls they pointed to don't
+    for (int i = 0; i < MACH_NUM_UARTS; i++) {
+        MP_STATE_PORT(uart_poll_notify)[i] = NULL;
+    }
 }
 
 void uart_deinit_all (void) {
@@ -121,6 +124,10 @@ void uart_deinit_all (void) {
     for (int i = 0; i < num_uarts; i++) {
         mach_uart_deinit(&mach_uart_obj[i]);
     }
+    // the one kept running too, its poll goes with the heap
+    for (int i = num_uarts; i < MACH_NUM_UARTS; i++) {
+        MP_STATE_PORT(uart_poll_notify)[i] = NULL;
+    }
 }
 
 uint32_t uart_rx_any(mach_uart_obj_t *self) {
@@ -316,6 +323,8 @@ STATIC IRAM_ATTR void UARTRxCallback(int uart_id, int rx_byte) {
         // raise an exception when interrupts are finished
         mp_hal_trig_term_sig();
     }
+    // Wake up a uselect.poll waiting on this UART
+    mp_stream_poll_signal(MP_STATE_PORT(uart_poll_notify)[uart_id], MP_STREAM_POLL_RD);
 }
 
 STATIC mp_obj_t mach_uart_init_helper(mach_uart_obj_t *self, const mp_arg_val_t *args) {
@@ -505,6 +514,9 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_uart_init_obj, 1, mach_uart_init);
 STATIC mp_obj_t mach_uart_deinit(mp_obj_t self_in) {
     mach_uart_obj_t *self = self_in;
 
+    // a poll still waiting on it won't be woken up any more
+    MP_STATE_PORT(uart_poll_notify)[self->uart_id] = NULL;
+
     if (self->config.baud_rate > 0) {
         // invalidate the baudrate
         self->config.baud_rate = 0;
@@ -658,6 +670,21 @@ STATIC mp_uint_t mach_uart_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint_t
         if ((flags & MP_STREAM_POLL_WR) && uart_tx_fifo_space(self)) {
             ret |= MP_STREAM_POLL_WR;
         }
+    } else if (request == MP_STREAM_POLL_NOTIFY) {
+        mp_stream_poll_notify_t *notify = (mp_stream_poll_notify_t *)arg;
+        if (notify != NULL && MP_STATE_PORT(uart_poll_notify)[self->uart_id] != NULL) {
+            *errcode = EBUSY;
+            ret = MP_STREAM_ERROR;
+        } else {
+            // only RX is signalled (from the Rx callback), a poll for TX
+            // space keeps checking the FIFO
+            if (notify != NULL) {
+                notify->mask = MP_STREAM_POLL_RD;
+            }
+            // held in a root pointer as the UART objects are static
+            MP_STATE_PORT(uart_poll_notify)[self->uart_id] = notify;
+            ret = 0;
+        }
     } else {
         *errcode = EINVAL;
         ret = MP_STREAM_ERROR;
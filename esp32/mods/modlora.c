@@ -28,6 +28,7 @@
 #include "modusocket.h"
 #include "pycom_config.h"
 #include "mpirq.h"
+#include "framering.h"
 #include "modlora.h"
 
 #include "esp_heap_caps.h"
@@ -42,6 +43,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "lora/mac/LoRaMacTest.h"
@@ -178,6 +180,7 @@ typedef struct {
     uint32_t          tx_time_on_air;
     uint32_t          tx_counter;
     uint32_t          tx_frequency;
+    uint32_t          tx_airtime;       // ms, of all the raw LoRa frames sent
     int16_t           rssi;
     int8_t            snr;
     uint8_t           sfrx;
@@ -229,20 +232,24 @@ typedef struct {
     uint8_t           events;
     uint8_t           trigger;
     uint8_t           tx_trials;
+    uint8_t           tx_queue_len;     // 0: send() waits for each frame, else the queue depth
+    uint8_t           tx_queue_max;     // highest number of frames seen waiting
 } lora_obj_t;
 
-typedef struct {
-    uint32_t    index;
-    uint32_t    size;
-    uint8_t     data[LORA_PAYLOAD_SIZE_MAX];
-    uint8_t     port;
-} lora_partial_rx_packet_t;
+// a sender waiting in lora_send(), on its own stack
+typedef struct lora_tx_waiter_s {
+    TaskHandle_t task;
+    struct lora_tx_waiter_s *next;
+} lora_tx_waiter_t;
 
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static QueueHandle_t xCmdQueue;
-static QueueHandle_t xRxQueue;
+static QueueHandle_t xTxQueue;
+static SemaphoreHandle_t xRxSem;
+static SemaphoreHandle_t xRxMutex;
+static SemaphoreHandle_t xTxMutex;
 static QueueHandle_t xCbQueue;
 static EventGroupHandle_t LoRaEvents;
 
@@ -252,8 +259,21 @@ static LoRaMacPrimitives_t LoRaMacPrimitives;
 static LoRaMacCallback_t LoRaMacCallbacks;
 
 static lora_obj_t lora_obj;
-static lora_partial_rx_packet_t lora_partial_rx_packet;
-static lora_rx_data_t rx_data_isr;
+// raw LoRa frames queued and sent so far, send() waits on these to tell when its frame is out
+static uint32_t lora_tx_queued;
+static uint32_t lora_tx_done;
+// the frame on the air, its completion isn't counted once lora_reset() dropped it
+static bool lora_tx_on_air;
+static uint32_t lora_tx_on_air_seq;
+// the senders waiting for a free slot or for their frame, woken all at once
+// by lora_tx_signal(). The list, the counters above and the queueing itself
+// are under xTxMutex.
+static lora_tx_waiter_t *lora_tx_waiters;
+// received frames, filled straight from the radio and MAC callbacks, the
+// port number is the frame tag. Read with xRxMutex held, the socket can be
+// read and polled from several threads.
+static uint8_t lora_rx_ring_buf[LORA_RX_RING_SIZE];
+static framering_t lora_rx_ring = { .rb = { lora_rx_ring_buf, sizeof(lora_rx_ring_buf) } };
 
 static TimerEvent_t TxNextActReqTimer;
 
@@ -288,7 +308,11 @@ static void lora_validate_coding_rate (uint8_t coding_rate);
 static void lora_set_config (lora_cmd_data_t *cmd_data);
 static void lora_get_config (lora_cmd_data_t *cmd_data);
 static void lora_send_cmd (lora_cmd_data_t *cmd_data);
-static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms);
+static int32_t lora_send (const byte *buf, uint32_t len, int32_t timeout_ms);
+static bool lora_tx_next (void);
+static void lora_tx_complete (void);
+static void lora_tx_signal (void);
+static void lora_tx_wait (TickType_t timeout);
 static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port);
 static bool lora_rx_any (void);
 static bool lora_tx_space (void);
@@ -321,7 +345,10 @@ SemaphoreHandle_t xLoRaSigfoxSem;
  ******************************************************************************/
 void modlora_init0(void) {
     xCmdQueue = xQueueCreate(LORA_CMD_QUEUE_SIZE_MAX, sizeof(lora_cmd_data_t));
-    xRxQueue = xQueueCreate(LORA_DATA_QUEUE_SIZE_MAX, sizeof(lora_rx_data_t));
+    xTxQueue = xQueueCreate(LORA_TX_QUEUE_SIZE_MAX, sizeof(lora_tx_cmd_data_t));
+    xRxSem = xSemaphoreCreateBinary();
+    xRxMutex = xSemaphoreCreateMutex();
+    xTxMutex = xSemaphoreCreateMutex();
     xCbQueue = xQueueCreate(LORA_CB_QUEUE_SIZE_MAX, sizeof(modlora_timerCallback));
     LoRaEvents = xEventGroupCreate();
 #if defined(FIPY) || defined(LOPY4)
@@ -622,10 +649,8 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
     if (mcpsIndication->RxData && mcpsIndication->BufferSize > 0) {
         if (mcpsIndication->Port > 0 && mcpsIndication->Port < 224) {
             if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                rx_data_isr.len = mcpsIndication->BufferSize;
-                rx_data_isr.port = mcpsIndication->Port;
-                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+                framering_put(&lora_rx_ring, mcpsIndication->Port, mcpsIndication->Buffer, mcpsIndication->BufferSize);
+                xSemaphoreGive(xRxSem);
                 lora_obj.events |= MODLORA_RX_EVENT;
                 if (lora_obj.trigger & MODLORA_RX_EVENT) {
                     mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
@@ -652,7 +677,7 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         lora_obj.ComplianceTest.State = 1;
 
                         // flush the rx queue
-                        xQueueReset(xRxQueue);
+                        framering_flush_from_producer(&lora_rx_ring);
 
                         // enable ADR during test mode
                         MibRequestConfirm_t mibReq;
@@ -699,9 +724,8 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         // return the payload
                         if (bDoEcho) {
                             if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                                rx_data_isr.len = mcpsIndication->BufferSize;
-                                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+                                framering_put(&lora_rx_ring, mcpsIndication->Port, mcpsIndication->Buffer, mcpsIndication->BufferSize);
+                                xSemaphoreGive(xRxSem);
                             }
                         } else {
                             // set the state back to 1
@@ -976,24 +1000,6 @@ static void TASK_LoRa (void *pvParameters) {
                     }
                     lora_obj.state = E_LORA_STATE_JOIN;
                     break;
-                case E_LORA_CMD_TX:
-                    // implement Listen-before-Talk LBT, only for LoRa RAW (not LoRaWAN)
-                    if (lora_lbt_is_free()) {
-                        // no activity detected on Lora, so send the pack now
-
-                        // taking sigfox semaphore blocks ?!?!?
-                        // maybe, in the end of TX sempahore has to be released sooner
-//                        #if defined(FIPY) || defined(LOPY4)
-//                            xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
-//                        #endif
-                        Radio.Send(task_cmd_data.info.tx.data, task_cmd_data.info.tx.len);
-                        lora_obj.state = E_LORA_STATE_TX;
-                    } else {
-                        // activity detected on Lora, so put the TX command back on queue on Front
-                        // to be executed on next Lora task
-                        xQueueSendToFront(xCmdQueue, (void *)&task_cmd_data, (TickType_t)portMAX_DELAY);
-                    }
-                    break;
                 case E_LORA_CMD_CONFIG_CHANNEL:
                     if (task_cmd_data.info.channel.add) {
                         ChannelParams_t channel =
@@ -1091,6 +1097,9 @@ static void TASK_LoRa (void *pvParameters) {
 //            } else if (lora_obj.state == E_LORA_STATE_IDLE && lora_obj.stack_mode == E_LORA_STACK_MODE_LORA) {
 //                Radio.Rx(LORA_RX_TIMEOUT);
 //                lora_obj.state = E_LORA_STATE_RX;
+            } else if (lora_obj.state != E_LORA_STATE_NOINIT && lora_obj.state != E_LORA_STATE_RESET) {
+                // commands first, then the next raw LoRa frame, if any
+                lora_tx_next();
             }
             break;
         case E_LORA_STATE_JOIN:
@@ -1162,7 +1171,7 @@ static void TASK_LoRa (void *pvParameters) {
         case E_LORA_STATE_TX_DONE:
             // we need to perform a mode transition in order to clear the TxRx FIFO
             Radio.Sleep();
-            xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
+            lora_tx_complete();
             //lora_obj.state = E_LORA_STATE_IDLE;
             lora_obj.state = E_LORA_STATE_RX;
             Radio.Rx(LORA_RX_TIMEOUT);
@@ -1173,7 +1182,7 @@ static void TASK_LoRa (void *pvParameters) {
         case E_LORA_STATE_TX_TIMEOUT:
             // we need to perform a mode transition in order to clear the TxRx FIFO
             Radio.Sleep();
-            xEventGroupSetBits(LoRaEvents, LORA_STATUS_ERROR);
+            lora_tx_complete();
             //lora_obj.state = E_LORA_STATE_IDLE;
             lora_obj.state = E_LORA_STATE_RX;
             Radio.Rx(LORA_RX_TIMEOUT);
@@ -1238,6 +1247,91 @@ static bool lora_lbt_is_free(void)
     return is_free;
 }
 
+/*! lora_tx_next sends the frame at the head of the TX queue, if the channel is
+ * free. The radio is back in RX by the time the previous frame is done, so LBT
+ * gets a real RSSI reading between back-to-back frames.
+ * returns true if a frame is on the air
+ */
+static bool lora_tx_next(void)
+{
+    static lora_tx_cmd_data_t tx_frame;
+
+    if (lora_obj.stack_mode != E_LORA_STACK_MODE_LORA || !xQueuePeek(xTxQueue, &tx_frame, 0)) {
+        return false;
+    }
+    // implement Listen-before-Talk LBT, only for LoRa RAW (not LoRaWAN),
+    // if the channel is busy the frame stays at the head of the queue
+    if (!lora_lbt_is_free()) {
+        return false;
+    }
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    // the head of the queue is the oldest frame numbered by lora_send(), it's
+    // gone if lora_reset() ran meanwhile
+    lora_tx_on_air_seq = lora_tx_queued - uxQueueMessagesWaiting(xTxQueue) + 1;
+    lora_tx_on_air = xQueueReceive(xTxQueue, &tx_frame, 0);
+    xSemaphoreGive(xTxMutex);
+    if (!lora_tx_on_air) {
+        return false;
+    }
+    lora_tx_signal();
+
+    Radio.Send(tx_frame.data, tx_frame.len);
+    lora_obj.state = E_LORA_STATE_TX;
+
+    // calculate the time on air
+    lora_obj.tx_time_on_air = Radio.TimeOnAir(MODEM_LORA, tx_frame.len);
+    lora_obj.tx_airtime += lora_obj.tx_time_on_air;
+    lora_obj.tx_counter += 1;
+    lora_obj.tx_frequency = lora_obj.frequency;
+    lora_obj.sftx = lora_obj.sf;
+    return true;
+}
+
+static void lora_tx_complete(void)
+{
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    if (lora_tx_on_air) {
+        lora_tx_done = lora_tx_on_air_seq;
+        lora_tx_on_air = false;
+    }
+    xSemaphoreGive(xTxMutex);
+    lora_tx_signal();
+}
+
+/*! lora_tx_signal wakes up all the senders waiting, after a slot was freed or
+ * a frame is out, they check again what they wait for
+ */
+static void lora_tx_signal(void)
+{
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    for (lora_tx_waiter_t *w = lora_tx_waiters; w != NULL; w = w->next) {
+        xTaskNotifyGive(w->task);
+    }
+    lora_tx_waiters = NULL;
+    xSemaphoreGive(xTxMutex);
+}
+
+/*! lora_tx_wait is called with xTxMutex held, released while waiting for the
+ * next lora_tx_signal() or the timeout. A wake up left over from an earlier
+ * wait only makes the caller check once more.
+ */
+static void lora_tx_wait(TickType_t timeout)
+{
+    lora_tx_waiter_t waiter = { xTaskGetCurrentTaskHandle(), lora_tx_waiters };
+
+    lora_tx_waiters = &waiter;
+    xSemaphoreGive(xTxMutex);
+    ulTaskNotifyTake(pdTRUE, timeout);
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    // still listed if it timed out
+    for (lora_tx_waiter_t **w = &lora_tx_waiters; *w != NULL; w = &(*w)->next) {
+        if (*w == &waiter) {
+            *w = waiter.next;
+            break;
+        }
+    }
+}
+
 static void lora_callback_handler(void *arg) {
     lora_obj_t *self = arg;
 
@@ -1260,9 +1354,8 @@ static IRAM_ATTR void OnRxDone (uint8_t *payload, uint32_t timestamp, uint16_t s
     lora_obj.snr = snr;
     lora_obj.sfrx = sf;
     if (size <= LORA_PAYLOAD_SIZE_MAX) {
-        memcpy((void *)rx_data_isr.data, payload, size);
-        rx_data_isr.len = size;
-        xQueueSendFromISR(xRxQueue, (void *)&rx_data_isr, NULL);
+        framering_put(&lora_rx_ring, 0, payload, size);
+        xSemaphoreGiveFromISR(xRxSem, NULL);
     }
 
     lora_obj.events |= MODLORA_RX_EVENT;
@@ -1274,6 +1367,10 @@ static IRAM_ATTR void OnRxDone (uint8_t *payload, uint32_t timestamp, uint16_t s
 }
 
 static IRAM_ATTR void OnTxTimeout (void) {
+    lora_obj.events |= MODLORA_TX_FAILED_EVENT;
+    if (lora_obj.trigger & MODLORA_TX_FAILED_EVENT) {
+        mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
+    }
     lora_obj.state = E_LORA_STATE_TX_TIMEOUT;
 }
 
@@ -1558,129 +1655,103 @@ static void lora_send_cmd (lora_cmd_data_t *cmd_data) {
     }
 }
 
-static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms) {
-    lora_cmd_data_t cmd_data;
+static int32_t lora_send (const byte *buf, uint32_t len, int32_t timeout_ms) {
+    TickType_t timeout = (timeout_ms < 0) ? portMAX_DELAY : (timeout_ms / portTICK_PERIOD_MS);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed;
+    UBaseType_t depth = lora_obj.tx_queue_len ? lora_obj.tx_queue_len : LORA_TX_QUEUE_SIZE_MAX;
+    UBaseType_t waiting;
+    lora_tx_cmd_data_t tx_frame;
+    uint32_t seq;
 
-/*
-#if defined(FIPY) || defined(LOPY4)
-    xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
-    lora_get_config (&cmd_data);
-    cmd_data.cmd = E_LORA_CMD_INIT;
-    lora_send_cmd (&cmd_data);
-    xSemaphoreGive(xLoRaSigfoxSem);
-#endif
-*/
-    cmd_data.cmd = E_LORA_CMD_TX;
-    memcpy (cmd_data.info.tx.data, buf, len);
-    cmd_data.info.tx.len = len;
+    memcpy (tx_frame.data, buf, len);
+    tx_frame.len = len;
 
-    if (timeout_ms < 0) {
-        // blocking mode
-        timeout_ms = portMAX_DELAY;
-    }
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
 
-    xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE);
+    // wait for a free slot, the LoRa task frees one each time it starts sending a frame
+    while (uxQueueMessagesWaiting(xTxQueue) >= depth) {
+        elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            xSemaphoreGive(xTxMutex);
+            return 0;
+        }
+        lora_tx_wait((timeout == portMAX_DELAY) ? portMAX_DELAY : (timeout - elapsed));
+    }
 
-    // just pass to the LoRa queue
-    if (!xQueueSend(xCmdQueue, (void *)&cmd_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
-        //printf("Q full\n");
+    // numbered before it's queued, so that the LoRa task can't be done with
+    // it first, and in the order of the queue
+    seq = ++lora_tx_queued;
+    if (!xQueueSend(xTxQueue, (void *)&tx_frame, 0)) {
+        lora_tx_queued--;
+        xSemaphoreGive(xTxMutex);
         return 0;
     }
-
-    lora_obj.sftx = lora_obj.sf;
-
-    if (timeout_ms != 0) {
-        //printf("timeout_ms %d\n", timeout_ms);
-
-        xEventGroupWaitBits(LoRaEvents,
-                            LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE,
-                            pdTRUE,   // clear on exit
-                            pdFALSE,  // do not wait for all bits
-                            (TickType_t)portMAX_DELAY);
+    waiting = uxQueueMessagesWaiting(xTxQueue);
+    if (waiting > lora_obj.tx_queue_max) {
+        lora_obj.tx_queue_max = waiting;
     }
 
-    // calculate the time on air
-    lora_obj.tx_time_on_air = Radio.TimeOnAir(MODEM_LORA, len);
-    lora_obj.tx_counter += 1;
-    lora_obj.tx_frequency = lora_obj.frequency;
+    // without a TX queue configured, only non-blocking sockets return before the frame is out
+    if (lora_obj.tx_queue_len == 0 && timeout_ms != 0) {
+        while ((int32_t)(lora_tx_done - seq) < 0) {
+            lora_tx_wait(portMAX_DELAY);
+        }
+    }
+    xSemaphoreGive(xTxMutex);
 
     // return the number of bytes sent
     return len;
 }
 
-static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port) {
-    lora_rx_data_t rx_data;
-
-    if (timeout_ms < 0) {
-        // blocking mode
-        timeout_ms = portMAX_DELAY;
+static int32_t lora_rx_read (byte *buf, uint32_t len, uint8_t *port) {
+    xSemaphoreTake(xRxMutex, portMAX_DELAY);
+    int32_t r_len = framering_read(&lora_rx_ring, buf, len, port);
+    bool more = framering_any(&lora_rx_ring);
+    xSemaphoreGive(xRxMutex);
+    if (r_len >= 0 && more) {
+        // pass the wake up on to the next reader
+        xSemaphoreGive(xRxSem);
     }
+    return r_len;
+}
 
-    // if there's a partial packet pending
-    if (lora_partial_rx_packet.size > 0) {
-        // adjust the len
-        uint32_t available_len = lora_partial_rx_packet.size - lora_partial_rx_packet.index;
-        if (available_len < len) {
-            len = available_len;
-        }
-
-        // get the available data
-        memcpy(buf, (void *)&lora_partial_rx_packet.data[lora_partial_rx_packet.index], len);
-        if (port != NULL) {
-            *port = rx_data.port;
-        }
-
-        // update the index and size values
-        lora_partial_rx_packet.index += len;
-        if (lora_partial_rx_packet.index == lora_partial_rx_packet.size) {
-            // there's no more data left
-            lora_partial_rx_packet.size = 0;
-        }
-        // return the number of bytes received
-        return len;
-    } else if (xQueueReceive(xRxQueue, &rx_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
-        // adjust the len
-        if (rx_data.len < len) {
-            len = rx_data.len;
-        }
-
-        // get the available data
-        memcpy(buf, rx_data.data, len);
-        if (port != NULL) {
-            *port = rx_data.port;
-        }
-
-        // copy the remainder to the partial data buffer
-        int32_t r_len = rx_data.len - len;
-        if (r_len > 0) {
-            memcpy((void *)lora_partial_rx_packet.data, &rx_data.data[len], r_len);
-            lora_partial_rx_packet.size = r_len;
-            lora_partial_rx_packet.index = 0;
-            lora_partial_rx_packet.port = rx_data.port;
+static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port) {
+    TickType_t timeout = (timeout_ms < 0) ? portMAX_DELAY : (timeout_ms / portTICK_PERIOD_MS);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed;
+    uint8_t rx_port;
+    int32_t r_len;
+
+    // copy straight from the ring, what does not fit in buf stays there for the next call
+    while ((r_len = lora_rx_read(buf, len, &rx_port)) < 0) {
+        elapsed = xTaskGetTickCount() - start;
+        if ((elapsed >= timeout) || !xSemaphoreTake(xRxSem, (timeout == portMAX_DELAY) ? portMAX_DELAY : (timeout - elapsed))) {
+            // non-blocking sockects do not thrown timeout errors
+            if (timeout_ms == 0) {
+                return 0;
+            }
+            // there's no data available
+            return -1;
         }
-        // return the number of bytes received
-        return len;
     }
-    // non-blocking sockects do not thrown timeout errors
-    if (timeout_ms == 0) {
-        return 0;
+    if (port != NULL) {
+        *port = rx_port;
     }
-    // there's no data available
-    return -1;
+    // return the number of bytes received
+    return r_len;
 }
 
 static bool lora_rx_any (void) {
-    lora_rx_data_t rx_data;
-    if (lora_partial_rx_packet.size > 0) {
-        return true;
-    } else if (xQueuePeek(xRxQueue, &rx_data, (TickType_t)0)) {
-        return true;
-    }
-    return false;
+    xSemaphoreTake(xRxMutex, portMAX_DELAY);
+    bool any = framering_any(&lora_rx_ring);
+    xSemaphoreGive(xRxMutex);
+    return any;
 }
 
 static bool lora_tx_space (void) {
-    if (uxQueueSpacesAvailable(xCmdQueue) > 0) {
+    UBaseType_t depth = lora_obj.tx_queue_len ? lora_obj.tx_queue_len : LORA_TX_QUEUE_SIZE_MAX;
+    if (uxQueueMessagesWaiting(xTxQueue) < depth) {
         return true;
     }
     return false;
@@ -2209,7 +2280,7 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
     static const qstr lora_stats_info_fields[] = {
         MP_QSTR_rx_timestamp, MP_QSTR_rssi, MP_QSTR_snr, MP_QSTR_sfrx, MP_QSTR_sftx,
         MP_QSTR_tx_trials, MP_QSTR_tx_power, MP_QSTR_tx_time_on_air, MP_QSTR_tx_counter,
-        MP_QSTR_tx_frequency
+        MP_QSTR_tx_frequency, MP_QSTR_tx_airtime, MP_QSTR_tx_queue, MP_QSTR_tx_queue_max
     };
 
     if (self->snr & 0x80)  { // the SNR sign bit is 1
@@ -2221,7 +2292,7 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
         snr = (self->snr & 0xFF) / 4;
     }
 
-    mp_obj_t stats_tuple[10];
+    mp_obj_t stats_tuple[13];
     stats_tuple[0] = mp_obj_new_int_from_uint(self->rx_timestamp);
     stats_tuple[1] = mp_obj_new_int(self->rssi);
     stats_tuple[2] = mp_obj_new_float(snr);
@@ -2232,6 +2303,9 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
     stats_tuple[7] = mp_obj_new_int(self->tx_time_on_air);
     stats_tuple[8] = mp_obj_new_int(self->tx_counter);
     stats_tuple[9] = mp_obj_new_int(self->tx_frequency);
+    stats_tuple[10] = mp_obj_new_int_from_uint(self->tx_airtime);
+    stats_tuple[11] = mp_obj_new_int(uxQueueMessagesWaiting(xTxQueue));
+    stats_tuple[12] = mp_obj_new_int(self->tx_queue_max);
 
     return mp_obj_new_attrtuple(lora_stats_info_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
 }
@@ -2437,6 +2511,13 @@ STATIC mp_obj_t lora_reset (mp_obj_t self_in) {
         // Try again
         vTaskDelay (100 / portTICK_PERIOD_MS);
     }
+    // drop the queued frames and the one on the air, and let their senders go
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    xQueueReset(xTxQueue);
+    lora_tx_on_air = false;
+    lora_tx_done = lora_tx_queued;
+    xSemaphoreGive(xTxMutex);
+    lora_tx_signal();
 
     self->reset = true;
 
@@ -2704,6 +2785,14 @@ static int lora_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level,
             return -1;
         }
         LORAWAN_SOCKET_SET_DR(s->sock_base.u.sd, *(uint8_t *)optval);
+    } else if (opt == SO_LORA_TX_QUEUE) {
+        // 0 restores the default: blocking sends return once the frame is out
+        uint32_t depth = *(uint32_t *)optval;
+        if (depth > LORA_TX_QUEUE_SIZE_MAX) {
+            *_errno = MP_EINVAL;
+            return -1;
+        }
+        lora_obj.tx_queue_len = depth;
     } else {
         *_errno = MP_EOPNOTSUPP;
         return -1;
@@ -18,7 +18,8 @@
  ******************************************************************************/
 #define LORA_PAYLOAD_SIZE_MAX                                   (255)
 #define LORA_CMD_QUEUE_SIZE_MAX                                 (7)
-#define LORA_DATA_QUEUE_SIZE_MAX                                (7)
+#define LORA_TX_QUEUE_SIZE_MAX                                  (8)     // raw LoRa frames waiting to be sent
+#define LORA_RX_RING_SIZE                                       (2048)  // bytes, at least 7 frames of the largest size
 #define LORA_CB_QUEUE_SIZE_MAX                                  (7)
 #define LORA_STACK_SIZE                                         (4096)
 #define LORA_TIMER_STACK_SIZE                                   (3072)
@@ -36,7 +37,6 @@
 typedef enum {
     E_LORA_CMD_INIT = 0,
     E_LORA_CMD_JOIN,
-    E_LORA_CMD_TX,
     E_LORA_CMD_CONFIG_CHANNEL,
     E_LORA_CMD_LORAWAN_TX,
     E_LORA_CMD_SLEEP,
@@ -134,12 +134,6 @@ typedef struct {
 
 ///////////////////////////////////////////
 
-typedef struct {
-    uint8_t data[LORA_PAYLOAD_SIZE_MAX + 1];
-    uint8_t len;
-    uint8_t port;
-} lora_rx_data_t;
-
 typedef void ( *modlora_timerCallback )( void );
 /******************************************************************************
  EXPORTED DATA
@@ -176,13 +176,23 @@ STATIC mp_obj_t mod_pycom_rgb_led (mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_rgb_led_obj, 0,1,mod_pycom_rgb_led);
 
-STATIC mp_obj_t mod_pycom_ota_start (void) {
+STATIC mp_obj_t mod_pycom_ota_start (mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args > 0 && args[0] != mp_const_none) {
+        // resumable, returns the offset the image has to be sent from
+        mp_buffer_info_t bufinfo;
+        uint32_t offset;
+        mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+        if (!updater_start_resumable(bufinfo.buf, bufinfo.len, &offset)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+        }
+        return mp_obj_new_int_from_uint(offset);
+    }
     if (!updater_start()) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_ota_start_obj, mod_pycom_ota_start);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_ota_start_obj, 0, 1, mod_pycom_ota_start);
 
 STATIC mp_obj_t mod_pycom_ota_write (mp_obj_t data) {
     mp_buffer_info_t bufinfo;
@@ -53,6 +53,7 @@
 #include "extmod/vfs.h"
 #include "extmod/vfs_fat.h"
 #include "vfs_littlefs.h"
+#include "sflash_diskio_littlefs.h"
 #include "random.h"
 #include "mpexception.h"
 #include "pybsd.h"
@@ -153,7 +154,15 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_0(os_uname_obj, os_uname);
 STATIC mp_obj_t os_sync(void) {
     for (mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table); vfs != NULL; vfs = vfs->next) {
         // this assumes that vfs->obj is fs_user_mount_t with block device functions
-        disk_ioctl(MP_OBJ_TO_PTR(vfs->obj), CTRL_SYNC, NULL);
+        fs_user_mount_t *fs = MP_OBJ_TO_PTR(vfs->obj);
+        if (fs->base.type == &mp_littlefs_vfs_type) {
+            // littlefs writes through, but the next boot can start from the blocks in use now
+            littlefs_lock(&fs->fs.littlefs.lock);
+            littlefs_freemap_save(&fs->fs.littlefs.lfs);
+            littlefs_unlock(&fs->fs.littlefs.lock);
+        } else {
+            disk_ioctl(fs, CTRL_SYNC, NULL);
+        }
     }
     return mp_const_none;
 }
@@ -212,6 +221,15 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_getfree),         MP_ROM_PTR(&mp_vfs_getfree_obj) },
     { MP_ROM_QSTR(MP_QSTR_fsformat),        MP_ROM_PTR(&mp_vfs_fsformat_obj) },
     { MP_ROM_QSTR(MP_QSTR_unlink),          MP_ROM_PTR(&mp_vfs_remove_obj) },
+    #if MICROPY_VFS_LOG
+    { MP_ROM_QSTR(MP_QSTR_logrecords),      MP_ROM_PTR(&mp_vfs_logrecords_obj) },
+    #endif
+    #if MICROPY_VFS_BLOCKCACHE
+    { MP_ROM_QSTR(MP_QSTR_cachestats),      MP_ROM_PTR(&mp_vfs_cachestats_obj) },
+    #endif
+    #if MICROPY_VFS_MMAP
+    { MP_ROM_QSTR(MP_QSTR_mmap),            MP_ROM_PTR(&mp_vfs_mmap_obj) },
+    #endif
 
     { MP_ROM_QSTR(MP_QSTR_sync),            MP_ROM_PTR(&mod_os_sync_obj) },
     { MP_ROM_QSTR(MP_QSTR_urandom),         MP_ROM_PTR(&os_urandom_obj) },
@@ -53,6 +53,7 @@
 #define SO_SIGFOX_TX_REPEAT                 (0xF0005)
 #define SO_SIGFOX_OOB                       (0xF0006)
 #define SO_SIGFOX_BIT                       (0xF0007)
+#define SO_LORA_TX_QUEUE                    (0xF0008)
 
 /* chars for storing an IPv6 address 39 chars + zero end string
 * ex: ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD 4*8+7=39 chars */
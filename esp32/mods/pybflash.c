@@ -28,10 +28,12 @@
 //#include <string.h>
 
 #include "py/runtime.h"
+#include "py/mperrno.h"
 #include "lib/oofatfs/ff.h"
 #include "lib/oofatfs/diskio.h"
 #include "extmod/vfs.h"
 #include "extmod/vfs_fat.h"
+#include "extmod/vfs_mmap.h"
 #include "vfs_littlefs.h"
 
 #include "fatfs/src/drivers/sflash_diskio.h"
@@ -82,10 +84,43 @@ STATIC mp_obj_t pyb_flash_ioctl(mp_obj_t self, mp_obj_t cmd_in, mp_obj_t arg_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(pyb_flash_ioctl_obj, pyb_flash_ioctl);
 
+#if MICROPY_VFS_MMAP
+STATIC void pyb_flash_munmap(const uint8_t *data, size_t len, uintptr_t handle) {
+    sflash_disk_munmap(handle);
+}
+
+// len bytes from block on, read-only and in place, see extmod/vfs_mmap.h
+STATIC mp_obj_t pyb_flash_mmap(mp_obj_t self, mp_obj_t block_num, mp_obj_t len_in) {
+    mp_int_t block = mp_obj_get_int(block_num);
+    mp_int_t len = mp_obj_get_int(len_in);
+    const void *data;
+    uint32_t handle;
+
+    if (block < 0 || len < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    if (len == 0) {
+        return mp_vfs_mmap_new("", 0, NULL, 0);
+    }
+    // the block last written may still be in the RAM
+    if (sflash_disk_flush() != RES_OK) {
+        mp_raise_OSError(MP_EIO);
+    }
+    if (!sflash_disk_mmap(block * SFLASH_FS_SECTOR_SIZE, len, &data, &handle)) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    return mp_vfs_mmap_new(data, len, pyb_flash_munmap, handle);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(pyb_flash_mmap_obj, pyb_flash_mmap);
+#endif
+
 STATIC const mp_rom_map_elem_t pyb_flash_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_readblocks), MP_ROM_PTR(&pyb_flash_readblocks_obj) },
     { MP_ROM_QSTR(MP_QSTR_writeblocks), MP_ROM_PTR(&pyb_flash_writeblocks_obj) },
     { MP_ROM_QSTR(MP_QSTR_ioctl), MP_ROM_PTR(&pyb_flash_ioctl_obj) },
+    #if MICROPY_VFS_MMAP
+    { MP_ROM_QSTR(MP_QSTR_mmap), MP_ROM_PTR(&pyb_flash_mmap_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(pyb_flash_locals_dict, pyb_flash_locals_dict_table);
@@ -129,9 +129,19 @@ STATIC mp_obj_t pyb_sd_deinit (mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(pyb_sd_deinit_obj, pyb_sd_deinit);
 
+// any number of whole blocks, read or written with one command
+STATIC void pyb_sd_check_blocks (mp_obj_t block_num, const mp_buffer_info_t *bufinfo) {
+    mp_int_t block = mp_obj_get_int(block_num);
+    if (bufinfo->len == 0 || (bufinfo->len % SD_SECTOR_SIZE) != 0 || block < 0 ||
+        (uint64_t)block + bufinfo->len / SD_SECTOR_SIZE > (uint64_t)sdmmc_card_info.csd.capacity) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+}
+
 STATIC mp_obj_t pyb_sd_readblocks(mp_obj_t self, mp_obj_t block_num, mp_obj_t buf) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(buf, &bufinfo, MP_BUFFER_WRITE);
+    pyb_sd_check_blocks(block_num, &bufinfo);
     DRESULT res = sd_disk_read(bufinfo.buf, mp_obj_get_int(block_num), bufinfo.len / SD_SECTOR_SIZE);
     return MP_OBJ_NEW_SMALL_INT(res != RES_OK); // return of 0 means success
 }
@@ -140,6 +150,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_3(pyb_sd_readblocks_obj, pyb_sd_readblocks);
 STATIC mp_obj_t pyb_sd_writeblocks(mp_obj_t self, mp_obj_t block_num, mp_obj_t buf) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(buf, &bufinfo, MP_BUFFER_READ);
+    pyb_sd_check_blocks(block_num, &bufinfo);
     DRESULT res = sd_disk_write(bufinfo.buf, mp_obj_get_int(block_num), bufinfo.len / SD_SECTOR_SIZE);
     return MP_OBJ_NEW_SMALL_INT(res != RES_OK); // return of 0 means success
 }
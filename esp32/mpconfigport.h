@@ -80,6 +80,7 @@
 #define MICROPY_PY_CMATH                            (1)
 #define MICROPY_PY_IO                               (1)
 #define MICROPY_PY_IO_FILEIO                        (1)
+#define MICROPY_PY_IO_BUFFEREDREADER                (1)
 #define MICROPY_PY_STRUCT                           (1)
 #define MICROPY_PY_SYS                              (1)
 #define MICROPY_PY_THREAD                           (1)
@@ -121,6 +122,8 @@
 #define MICROPY_PY_UZLIB                            (1)
 
 #define MICROPY_STREAMS_NON_BLOCK                   (1)
+#define MICROPY_STREAMS_POLL_NOTIFY                 (1)
+#define MICROPY_STREAMS_POLL_SIGNAL_ATTR            IRAM_ATTR   // called from the UART ISR
 #define MICROPY_PY_BUILTINS_TIMEOUTERROR            (1)
 #define MICROPY_PY_ALL_SPECIAL_METHODS              (1)
 
@@ -144,6 +147,9 @@
 
 #define MICROPY_VFS                                 (1)
 #define MICROPY_VFS_FAT                             (1)
+#define MICROPY_VFS_LOG                             (1)
+#define MICROPY_VFS_BLOCKCACHE                      (1)
+#define MICROPY_VFS_MMAP                            (1)
 
 #define MICROPY_READER_VFS                          (1)
 #define MICROPY_PY_BUILTINS_INPUT                   (1)
@@ -242,6 +248,7 @@ extern const struct _mp_obj_module_t mp_module_uqueue;
     const char *readline_hist[8];                               \
     mp_obj_t machine_config_main;                               \
     mp_obj_t uart_buf[3];                                       \
+    void *uart_poll_notify[3];                                  \
     mp_obj_list_t mp_irq_obj_list;                              \
     mp_obj_list_t mod_network_nic_list;                         \
     mp_obj_t mp_os_stream_o;                                    \
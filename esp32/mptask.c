@@ -511,13 +511,11 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
 
     if(spi_flash_get_chip_size() > (4* 1024 * 1024))
     {
-        lfscfg.block_count = SFLASH_BLOCK_COUNT_8MB;
-        lfscfg.lookahead_size = (SFLASH_BLOCK_COUNT_8MB/8);
+        littlefs_init_config(SFLASH_BLOCK_COUNT_8MB);
     }
     else
     {
-        lfscfg.block_count = SFLASH_BLOCK_COUNT_4MB;
-        lfscfg.lookahead_size = 32;
+        littlefs_init_config(SFLASH_BLOCK_COUNT_4MB);
     }
 
     // Mount the file system if exists
@@ -536,6 +534,8 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
             __fatal_error("failed to create /flash");
         }
     }
+    // spares the first allocation a walk through the whole file system
+    littlefs_freemap_load(littlefsptr);
 
     // mount the flash device (there should be no other devices mounted at this point)
     // we allocate this structure on the heap because vfs->next is a root pointer
@@ -557,10 +557,11 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
     vfs_littlefs->fs.littlefs.cwd = (char*)malloc(2);
     vfs_littlefs->fs.littlefs.cwd[0] = '/';
     vfs_littlefs->fs.littlefs.cwd[1] = '\0';
+    vfs_littlefs->fs.littlefs.cwd_len = 1;
 
-    vfs_littlefs->fs.littlefs.mutex = xSemaphoreCreateMutex();
+    littlefs_lock_init(&vfs_littlefs->fs.littlefs.lock);
 
-    xSemaphoreTake(vfs_littlefs->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&vfs_littlefs->fs.littlefs.lock);
 
     // create empty main.py if does not exist
     lfs_file_t fp;
@@ -609,7 +610,7 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
         littlefs_update_timestamp(littlefsptr, "/cert");
     }
 
-    xSemaphoreGive(vfs_littlefs->fs.littlefs.mutex);
+    littlefs_unlock(&vfs_littlefs->fs.littlefs.lock);
 }
 
 
@@ -649,7 +650,7 @@ STATIC void mptask_update_lpwan_mac_address (void) {
         lfs_file_t fp;
         lfs_t* fsptr = &sflash_vfs_flash.fs.littlefs.lfs;
 
-        xSemaphoreTake(sflash_vfs_flash.fs.littlefs.mutex, portMAX_DELAY);
+        littlefs_lock(&sflash_vfs_flash.fs.littlefs.lock);
 
         if(LFS_ERR_OK == lfs_file_open(fsptr, &fp, LPWAN_MAC_ADDR_PATH, LFS_O_RDONLY)){
             uint8_t mac[8];
@@ -668,7 +669,7 @@ STATIC void mptask_update_lpwan_mac_address (void) {
            }
        }
 
-        xSemaphoreGive(sflash_vfs_flash.fs.littlefs.mutex);
+        littlefs_unlock(&sflash_vfs_flash.fs.littlefs.lock);
 
     }
 }
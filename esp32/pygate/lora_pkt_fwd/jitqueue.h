@@ -37,7 +37,12 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
-#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
+#ifndef JIT_QUEUE_MAX
+#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue (max 255) */
+#endif
+#if JIT_QUEUE_MAX > 255
+#error "JIT_QUEUE_MAX must fit in the uint8_t slot index"
+#endif
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
 
 /* -------------------------------------------------------------------------- */
@@ -74,10 +79,17 @@ struct jit_node_s {
     uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
 };
 
+/*
+Nodes never move once stored: the queue order is kept in a separate array of
+slot indexes, sorted by ascending packet timestamp. The first num_pkt entries
+of order[] are the queued packets, the remaining ones are the free slots.
+Inserting or removing a packet is a binary search plus a byte-sized memmove.
+*/
 struct jit_queue_s {
     uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, beacons...) */
     uint8_t num_beacon;             /* Number of beacons in the queue */
-    struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+    uint8_t order[JIT_QUEUE_MAX];   /* Slot indexes, queued ones sorted by timestamp, then free ones */
+    struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets storage, indexed by order[] */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -127,7 +139,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 @brief Dequeue a packet from a Just-in-Time queue
 
 @param queue[in/out] Just in Time queue from which the packet should be removed
-@param index[in] in the queue where to get the packet to be removed
+@param index[in] position in the queue (0 is the earliest packet) of the packet to be removed
 @param packet[out] that was at index
 @param pkt_type[out] Type of packet dequeued: Downlink, Beacon
 @return success if the function was able to dequeue the packet
@@ -146,8 +158,8 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 @return success if the function was able to parse the queue. pkt_idx is set to -1 if no packet found.
 
 This function is typically used to check in JiT queue if there is a packet soon to be sent.
-It search the packet with the highest priority in queue, and check if its timestamp is near
-enough the current concentrator time.
+Outdated packets are dropped from both ends of the queue, then the earliest remaining one
+is checked against the current concentrator time, so pkt_idx is either 0 or -1.
 */
 enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx);
 
@@ -57,6 +57,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "timersync.h"
 #include "parson.h"
 #include "base64.h"
+#include "pktjson.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
@@ -114,8 +115,13 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define MIN_FSK_PREAMB  3 /* minimum FSK preamble length for this application */
 #define STD_FSK_PREAMB  5
 
-#define STATUS_SIZE     200
-#define TX_BUFF_SIZE    ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
+#define AGGR_PKT_MAX    8 /* max number of packets aggregated in one PUSH_DATA */
+#define DEFAULT_AGGR_BYTES      1400    /* default PUSH_DATA size limit, fits in one Ethernet frame */
+#define DEFAULT_AGGR_LATENCY_MS 0       /* default aggregation window, 0 = one PUSH_DATA per fetch cycle */
+#define PUSH_HEADER_SIZE        21      /* 12-byte header + {"rxpk":[ */
+
+#define STATUS_SIZE     256
+#define TX_BUFF_SIZE    (((PKTJSON_RXPK_MAX_LEN + 1) * AGGR_PKT_MAX) + 30 + STATUS_SIZE)
 
 #define NI_NUMERICHOST	1	/* return the host address, not the name */
 
@@ -143,6 +149,20 @@ struct coord_s {
     short   alt;    /*!> altitude in meters (WGS 84 geoid ref.) */
 };
 
+/**
+@struct push_data_s
+@brief PUSH_DATA datagram being composed by the upstream thread
+*/
+struct push_data_s {
+    uint8_t buff[TX_BUFF_SIZE]; /*!> datagram, header included */
+    int     index;              /*!> bytes written so far */
+    uint8_t token_h;            /*!> token for acknowledgement matching */
+    uint8_t token_l;
+    unsigned nb_pkt;            /*!> rxpk objects in the datagram */
+    uint32_t first_ms;          /*!> time the first rxpk was written */
+    uint32_t sum_ms;            /*!> sum of the times the rxpk were written */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -165,6 +185,11 @@ static int keepalive_time = DEFAULT_KEEPALIVE; /* send a PULL_DATA request every
 /* statistics collection configuration variables */
 static unsigned stat_interval = DEFAULT_STAT; /* time interval (in sec) at which statistics are collected and displayed */
 
+/* uplink aggregation, rxpk of several fetch cycles can share a PUSH_DATA */
+static unsigned aggr_max_pkts = AGGR_PKT_MAX; /* send when that many rxpk are pending */
+static unsigned aggr_max_bytes = DEFAULT_AGGR_BYTES; /* PUSH_DATA size limit, status report excluded */
+static unsigned aggr_max_latency_ms = DEFAULT_AGGR_LATENCY_MS; /* send when the oldest rxpk has waited that long */
+
 /* gateway <-> MAC protocol variables */
 static uint32_t net_mac_h; /* Most Significant Nibble, network order */
 static uint32_t net_mac_l; /* Least Significant Nibble, network order */
@@ -197,6 +222,10 @@ static uint32_t meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream
 static uint32_t meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t meas_up_dgram_sent = 0; /* number of datagrams sent for upstream traffic */
 static uint32_t meas_up_ack_rcv = 0; /* number of datagrams acknowledged for upstream traffic */
+static uint32_t meas_up_batch_nb = 0; /* number of datagrams carrying rxpk */
+static uint32_t meas_up_batch_max = 0; /* most rxpk carried by one datagram */
+static uint32_t meas_up_delay_sum = 0; /* sum of the time (in ms) rxpk waited for their datagram to be sent */
+static uint32_t meas_up_delay_max = 0; /* longest time (in ms) a rxpk waited for its datagram to be sent */
 
 static pthread_mutex_t mx_meas_dw = PTHREAD_MUTEX_INITIALIZER; /* control access to the downstream measurements */
 static uint32_t meas_dw_pull_sent = 0; /* number of PULL requests sent for downstream traffic */
@@ -249,6 +278,12 @@ static void obtain_time(void);
 
 static void loragw_exit(int status);
 
+static uint32_t uptime_ms(void);
+
+static void push_data_begin(struct push_data_s *dgram);
+
+static void push_data_send(struct push_data_s *dgram, bool send_report);
+
 /* threads */
 void thread_up(void);
 void thread_down(void);
@@ -704,6 +739,34 @@ static int parse_gateway_configuration(const char * conf_file) {
         MSG_INFO("[main] upstream PUSH_DATA time-out is configured to %u ms\n", (unsigned)(push_timeout_half.tv_usec / 500));
     }
 
+    /* uplink aggregation window (optional) */
+    val = json_object_get_value(conf_obj, "aggregate_max_pkts");
+    if (val != NULL) {
+        aggr_max_pkts = (unsigned)json_value_get_number(val);
+        if (aggr_max_pkts < 1) {
+            aggr_max_pkts = 1;
+        } else if (aggr_max_pkts > AGGR_PKT_MAX) {
+            aggr_max_pkts = AGGR_PKT_MAX;
+        }
+    }
+    val = json_object_get_value(conf_obj, "aggregate_max_bytes");
+    if (val != NULL) {
+        aggr_max_bytes = (unsigned)json_value_get_number(val);
+        /* one packet of the largest size must always fit */
+        if (aggr_max_bytes < PUSH_HEADER_SIZE + PKTJSON_RXPK_MAX_LEN + 2) {
+            aggr_max_bytes = PUSH_HEADER_SIZE + PKTJSON_RXPK_MAX_LEN + 2;
+        } else if (aggr_max_bytes > TX_BUFF_SIZE - STATUS_SIZE) {
+            aggr_max_bytes = TX_BUFF_SIZE - STATUS_SIZE;
+        }
+    }
+    val = json_object_get_value(conf_obj, "aggregate_max_latency_ms");
+    if (val != NULL) {
+        aggr_max_latency_ms = (unsigned)json_value_get_number(val);
+    }
+    if (aggr_max_latency_ms > 0) {
+        MSG_INFO("[main] uplinks are aggregated up to %u packets, %u bytes or %u ms\n", aggr_max_pkts, aggr_max_bytes, aggr_max_latency_ms);
+    }
+
     /* packet filtering parameters */
     val = json_object_get_value(conf_obj, "forward_crc_valid");
     if (json_value_get_type(val) == JSONBoolean) {
@@ -889,6 +952,121 @@ static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error)
     return send(sock_down, (void *)buff_ack, buff_index, 0);
 }
 
+static uint32_t uptime_ms(void) {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/* Start a PUSH_DATA datagram, up to the opening of the rxpk array */
+static void push_data_begin(struct push_data_s *dgram) {
+    static uint16_t token = 0;
+
+    dgram->token_h = (uint8_t)(token >> 8);
+    dgram->token_l = (uint8_t)(token & 0x00FF);
+    token++;
+
+    dgram->buff[0] = PROTOCOL_VERSION;
+    dgram->buff[1] = dgram->token_h;
+    dgram->buff[2] = dgram->token_l;
+    dgram->buff[3] = PKT_PUSH_DATA;
+    *(uint32_t *)(dgram->buff + 4) = net_mac_h;
+    *(uint32_t *)(dgram->buff + 8) = net_mac_l;
+    memcpy((void *)(dgram->buff + 12), (void *)"{\"rxpk\":[", 9);
+    dgram->index = PUSH_HEADER_SIZE;
+    dgram->nb_pkt = 0;
+}
+
+/* Close the datagram, send it and wait for the server acknowledge */
+static void push_data_send(struct push_data_s *dgram, bool send_report) {
+    uint8_t *buff_up = dgram->buff;
+    int buff_index = dgram->index;
+    uint8_t buff_ack[32]; /* buffer to receive acknowledges */
+    struct timeval send_time;
+    struct timeval recv_time;
+    uint32_t now, delay_sum, delay_max;
+    int i, j;
+
+    if (dgram->nb_pkt == 0) {
+        /* only a status report, clean up the beginning of the payload */
+        buff_index -= 8; /* removes "rxpk":[ */
+    } else {
+        /* end of packet array */
+        buff_up[buff_index] = ']';
+        ++buff_index;
+        /* add separator if needed */
+        if (send_report == true) {
+            buff_up[buff_index] = ',';
+            ++buff_index;
+        }
+    }
+
+    /* add status report if a new one is available */
+    if (send_report == true) {
+        pthread_mutex_lock(&mx_stat_rep);
+        report_ready = false;
+        j = strlen(status_report);
+        memcpy((void *)(buff_up + buff_index), (void *)status_report, j);
+        pthread_mutex_unlock(&mx_stat_rep);
+        buff_index += j;
+    }
+
+    /* end of JSON datagram payload */
+    buff_up[buff_index] = '}';
+    ++buff_index;
+    buff_up[buff_index] = 0; /* add string terminator, for safety */
+
+    MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u]: %s\n", dgram->token_h, dgram->token_l, (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
+
+    /* send datagram to server */
+    send(sock_up, (void *)buff_up, buff_index, 0);
+
+    /* time the rxpk spent waiting for the datagram to fill up */
+    now = uptime_ms();
+    delay_sum = (dgram->nb_pkt * now) - dgram->sum_ms;
+    delay_max = (dgram->nb_pkt > 0) ? (now - dgram->first_ms) : 0;
+
+    gettimeofday(&send_time, NULL);
+    pthread_mutex_lock(&mx_meas_up);
+    meas_up_dgram_sent += 1;
+    meas_up_network_byte += buff_index;
+    if (dgram->nb_pkt > 0) {
+        meas_up_batch_nb += 1;
+        if (dgram->nb_pkt > meas_up_batch_max) {
+            meas_up_batch_max = dgram->nb_pkt;
+        }
+        meas_up_delay_sum += delay_sum;
+        if (delay_max > meas_up_delay_max) {
+            meas_up_delay_max = delay_max;
+        }
+    }
+
+    /* wait for acknowledge (in 2 times, to catch extra packets) */
+    for (i = 0; i < 2; ++i) {
+        j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
+        gettimeofday(&recv_time, NULL);
+        if (j == -1) {
+            if (errno == EAGAIN) { /* timeout */
+                MSG_WARN("[up  ] PUSH_ACK recieve timeout %d\n", i);
+                continue;
+            } else { /* server connection error */
+                break;
+            }
+        } else if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK)) {
+            MSG_WARN("[up  ] ignored invalid non-ACL packet\n");
+            continue;
+        } else if ((buff_ack[1] != dgram->token_h) || (buff_ack[2] != dgram->token_l)) {
+            MSG_WARN("[up  ] ignored out-of sync PUSH_ACK packet buff_ack[%u:%u] != token[%u:%u]\n", buff_ack[1], buff_ack[2], dgram->token_h, dgram->token_l);
+            continue;
+        } else {
+            MSG_DEBUG("[up  ] received PUSH_ACK [%u:%u] in %i ms\n", buff_ack[1], buff_ack[2], (int)(1000 * time_diff(send_time, recv_time)));
+            meas_up_ack_rcv += 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mx_meas_up);
+
+    dgram->nb_pkt = 0;
+}
+
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
@@ -998,6 +1176,10 @@ void TASK_lora_gw(void *pvParameters) {
     uint32_t cp_up_payload_byte;
     uint32_t cp_up_dgram_sent;
     uint32_t cp_up_ack_rcv;
+    uint32_t cp_up_batch_nb;
+    uint32_t cp_up_batch_max;
+    uint32_t cp_up_delay_sum;
+    uint32_t cp_up_delay_max;
     uint32_t cp_dw_pull_sent;
     uint32_t cp_dw_ack_rcv;
     uint32_t cp_dw_dgram_rcv;
@@ -1022,6 +1204,8 @@ void TASK_lora_gw(void *pvParameters) {
     float rx_nocrc_ratio;
     float up_ack_ratio;
     float dw_ack_ratio;
+    float up_batch_avg;
+    uint32_t up_delay_avg;
 
     /* Parse command line options */
     /*while((i = getopt(argc, argv, "hd:")) != -1) {
@@ -1294,6 +1478,10 @@ void TASK_lora_gw(void *pvParameters) {
         cp_up_payload_byte = meas_up_payload_byte;
         cp_up_dgram_sent   = meas_up_dgram_sent;
         cp_up_ack_rcv      = meas_up_ack_rcv;
+        cp_up_batch_nb     = meas_up_batch_nb;
+        cp_up_batch_max    = meas_up_batch_max;
+        cp_up_delay_sum    = meas_up_delay_sum;
+        cp_up_delay_max    = meas_up_delay_max;
         meas_nb_rx_rcv = 0;
         meas_nb_rx_ok = 0;
         meas_nb_rx_bad = 0;
@@ -1303,6 +1491,10 @@ void TASK_lora_gw(void *pvParameters) {
         meas_up_payload_byte = 0;
         meas_up_dgram_sent = 0;
         meas_up_ack_rcv = 0;
+        meas_up_batch_nb = 0;
+        meas_up_batch_max = 0;
+        meas_up_delay_sum = 0;
+        meas_up_delay_max = 0;
         pthread_mutex_unlock(&mx_meas_up);
         if (cp_nb_rx_rcv > 0) {
             rx_ok_ratio = (float)cp_nb_rx_ok / (float)cp_nb_rx_rcv;
@@ -1318,6 +1510,16 @@ void TASK_lora_gw(void *pvParameters) {
         } else {
             up_ack_ratio = 0.0;
         }
+        if (cp_up_batch_nb > 0) {
+            up_batch_avg = (float)cp_up_pkt_fwd / (float)cp_up_batch_nb;
+        } else {
+            up_batch_avg = 0.0;
+        }
+        if (cp_up_pkt_fwd > 0) {
+            up_delay_avg = cp_up_delay_sum / cp_up_pkt_fwd;
+        } else {
+            up_delay_avg = 0;
+        }
 
         /* access downstream statistics, copy and reset them */
         pthread_mutex_lock(&mx_meas_dw);
@@ -1367,6 +1569,8 @@ void TASK_lora_gw(void *pvParameters) {
         mp_printf(&mp_plat_print, "# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
         mp_printf(&mp_plat_print, "# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         mp_printf(&mp_plat_print, "# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
+        mp_printf(&mp_plat_print, "# RF packets per PUSH_DATA: %.1f avg, %u max\n", up_batch_avg, cp_up_batch_max);
+        mp_printf(&mp_plat_print, "# Aggregation latency: %u ms avg, %u ms max\n", up_delay_avg, cp_up_delay_max);
         mp_printf(&mp_plat_print, "### [DOWNSTREAM] ###\n");
         mp_printf(&mp_plat_print, "# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
         mp_printf(&mp_plat_print, "# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
@@ -1392,7 +1596,7 @@ void TASK_lora_gw(void *pvParameters) {
 
         /* generate a JSON report (will be sent to server by upstream thread) */
         pthread_mutex_lock(&mx_stat_rep);
-        snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok);
+        snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"upbt\":%.1f,\"upbm\":%u,\"upld\":%u,\"uplm\":%u}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, up_batch_avg, cp_up_batch_max, up_delay_avg, cp_up_delay_max);
         report_ready = true;
         pthread_mutex_unlock(&mx_stat_rep);
     }
@@ -1428,25 +1632,15 @@ void TASK_lora_gw(void *pvParameters) {
 void thread_up(void) {
     MSG_INFO("[up  ] start\n");
     int i, j; /* loop variables */
-    unsigned pkt_in_dgram; /* nb on Lora packet in the current datagram */
 
     /* allocate memory for packet fetching and processing */
     struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
     int nb_pkt;
 
-    /* data buffers */
-    uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
-    int buff_index;
-    uint8_t buff_ack[32]; /* buffer to receive acknowledges */
-
-    /* protocol variables */
-    uint8_t token_h = 0; /* random token for acknowledgement matching */
-    uint8_t token_l = 0; /* random token for acknowledgement matching */
-    static uint16_t token = 0;
-    /* ping measurement variables */
-    struct timeval send_time;
-    struct timeval recv_time;
+    /* datagram being composed, can span several fetch cycles: too large for the stack */
+    static struct push_data_s dgram;
+    uint32_t now, waited;
 
     /* report management variable */
     bool send_report = false;
@@ -1463,11 +1657,7 @@ void thread_up(void) {
         machine_pygate_set_status(PYGATE_ERROR);
     }
 
-    /* pre-fill the data buffer with fixed fields */
-    buff_up[0] = PROTOCOL_VERSION;
-    buff_up[3] = PKT_PUSH_DATA;
-    *(uint32_t *)(buff_up + 4) = net_mac_h;
-    *(uint32_t *)(buff_up + 8) = net_mac_l;
+    dgram.nb_pkt = 0;
 
     while (!exit_sig && !quit_sig) {
         /* fetch packets */
@@ -1477,33 +1667,20 @@ void thread_up(void) {
         if (nb_pkt == LGW_HAL_ERROR) {
             MSG_ERROR("[up  ] failed packet fetch, exiting\n");
             //exit(EXIT_FAILURE);
+            nb_pkt = 0;
         }
 
         /* check if there are status report to send */
         send_report = report_ready; /* copy the variable so it doesn't change mid-function */
         /* no mutex, we're only reading */
 
-        /* wait a short time if no packets, nor status report */
-        if ((nb_pkt == 0) && (send_report == false)) {
+        /* wait a short time if no packets, nor status report, nor pending datagram */
+        if ((nb_pkt == 0) && (send_report == false) && (dgram.nb_pkt == 0)) {
             wait_ms ((FETCH_SLEEP_MS));
             continue;
         }
 
-        /* start composing datagram with the header */
-        token_h = (uint8_t)(token >> 8); // (uint8_t)rand(); /* random token */
-        token_l =  (uint8_t)(token & 0x00FF); //(uint8_t)rand(); /* random token */
-
-        buff_up[1] = token_h;
-        buff_up[2] = token_l;
-        token++;
-        buff_index = 12; /* 12-byte header */
-
-        /* start of JSON structure */
-        memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-        buff_index += 9;
-
         /* serialize Lora packets metadata and payload */
-        pkt_in_dgram = 0;
         for (i = 0; i < nb_pkt; ++i) {
             p = &rxpkt[i];
 
@@ -1554,280 +1731,65 @@ void thread_up(void) {
             meas_up_payload_byte += p->size;
             pthread_mutex_unlock(&mx_meas_up);
 
-            /* Start of packet, add inter-packet separator if necessary */
-            if (pkt_in_dgram == 0) {
-                buff_up[buff_index] = '{';
-                ++buff_index;
-            } else {
-                buff_up[buff_index] = ',';
-                buff_up[buff_index + 1] = '{';
-                buff_index += 2;
-            }
-
-            /* RAW timestamp, 8-17 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "\"tmst\":%u", p->count_us);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
+            /* send the pending datagram first if it holds as many packets as allowed */
+            if (dgram.nb_pkt >= aggr_max_pkts) {
+                push_data_send(&dgram, false);
             }
 
-            /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6));
-            if (j > 0) {
-                buff_index += j;
+            /* Packet metadata and base64-encoded payload, written in place, room is left for "]}" */
+            now = uptime_ms();
+            if (dgram.nb_pkt == 0) {
+                push_data_begin(&dgram);
+                j = pktjson_rxpk((char *)(dgram.buff + dgram.index), (int)aggr_max_bytes - 2 - dgram.index, p);
             } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet status, 9-10 useful chars */
-            switch (p->status) {
-                case STAT_CRC_OK:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":1", 9);
-                    buff_index += 9;
-                    break;
-                case STAT_CRC_BAD:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":-1", 10);
-                    buff_index += 10;
-                    break;
-                case STAT_NO_CRC:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":0", 9);
-                    buff_index += 9;
-                    break;
-                default:
-                    MSG_ERROR("[up  ] received packet with unknown status\n");
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":?", 9);
-                    buff_index += 9;
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet modulation, 13-14 useful chars */
-            if (p->modulation == MOD_LORA) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-                buff_index += 14;
-
-                /* Lora datarate & bandwidth, 16-19 useful chars */
-                switch (p->datarate) {
-                    case DR_LORA_SF7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF7", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF8", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF9:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF9", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF10:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF10", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF11:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF11", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF12:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF12", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown datarate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF?", 12);
-                        buff_index += 12;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-                switch (p->bandwidth) {
-                    case BW_125KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW125\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_250KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW250\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_500KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW500\"", 6);
-                        buff_index += 6;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown bandwidth\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW?\"", 4);
-                        buff_index += 4;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Packet ECC coding rate, 11-13 useful chars */
-                switch (p->coderate) {
-                    case CR_LORA_4_5:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_6:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/6\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/7\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/8\"", 13);
-                        buff_index += 13;
-                        break;
-                    case 0: /* treat the CR0 case (mostly false sync) */
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"OFF\"", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown coderate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"?\"", 11);
-                        buff_index += 11;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Lora SNR, 11-13 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"lsnr\":%.1f", p->snr);
-                if (j > 0) {
-                    buff_index += j;
+                /* after an inter-packet separator, if the packet fits in the size limit */
+                j = pktjson_rxpk((char *)(dgram.buff + dgram.index + 1), (int)aggr_max_bytes - 2 - dgram.index - 1, p);
+                if (j >= 0) {
+                    dgram.buff[dgram.index] = ',';
+                    ++dgram.index;
                 } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
+                    /* does not fit, send the pending packets and start over in a new datagram */
+                    push_data_send(&dgram, false);
+                    push_data_begin(&dgram);
+                    j = pktjson_rxpk((char *)(dgram.buff + dgram.index), (int)aggr_max_bytes - 2 - dgram.index, p);
                 }
-            } else if (p->modulation == MOD_FSK) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"FSK\"", 13);
-                buff_index += 13;
-
-                /* FSK datarate, 11-14 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"datr\":%u", p->datarate);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-                }
-            } else {
-                MSG_ERROR("[up  ] received packet with unknown modulation\n");
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
             }
-
-            /* Packet RSSI, payload size, 18-23 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"rssi\":%.0f,\"size\":%u", p->rssi, p->size);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
+            if (j < 0) {
+                MSG_ERROR("[up  ] cannot serialize packet (status %u, modulation %u, BW %u, DR %u, CR %u)\n", p->status, p->modulation, p->bandwidth, p->datarate, p->coderate);
                 quit_sig = true;
                 machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet base64-encoded payload, 14-350 useful chars */
-            memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-            buff_index += 9;
-            j = bin_to_b64(p->payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-            if (j >= 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] bin_to_b64 failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-            buff_up[buff_index] = '"';
-            ++buff_index;
-
-            /* End of packet serialization */
-            buff_up[buff_index] = '}';
-            ++buff_index;
-            ++pkt_in_dgram;
-        }
-
-        /* restart fetch sequence without sending empty JSON if all packets have been filtered out */
-        if (pkt_in_dgram == 0) {
-            if (send_report == true) {
-                /* need to clean up the beginning of the payload */
-                buff_index -= 8; /* removes "rxpk":[ */
-            } else {
-                /* all packet have been filtered out and no report, restart loop */
                 continue;
             }
-        } else {
-            /* end of packet array */
-            buff_up[buff_index] = ']';
-            ++buff_index;
-            /* add separator if needed */
-            if (send_report == true) {
-                buff_up[buff_index] = ',';
-                ++buff_index;
+            dgram.index += j;
+            if (dgram.nb_pkt == 0) {
+                dgram.first_ms = now;
+                dgram.sum_ms = 0;
             }
+            dgram.sum_ms += now;
+            ++dgram.nb_pkt;
         }
 
-        /* add status report if a new one is available */
-        if (send_report == true) {
-            pthread_mutex_lock(&mx_stat_rep);
-            report_ready = false;
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "%s", status_report);
-            pthread_mutex_unlock(&mx_stat_rep);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
+        /* nothing to send if all packets have been filtered out and there is no report */
+        if ((dgram.nb_pkt == 0) && (send_report == false)) {
+            continue;
         }
 
-        /* end of JSON datagram payload */
-        buff_up[buff_index] = '}';
-        ++buff_index;
-        buff_up[buff_index] = 0; /* add string terminator, for safety */
-
-        MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u]: %s\n", token_h, token_l, (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
-
-        /* send datagram to server */
-        send(sock_up, (void *)buff_up, buff_index, 0);
-        
-        gettimeofday(&send_time, NULL);
-        //clock_gettime(CLOCK_MONOTONIC, &send_time);
-        pthread_mutex_lock(&mx_meas_up);
-        meas_up_dgram_sent += 1;
-        meas_up_network_byte += buff_index;
-
-        /* wait for acknowledge (in 2 times, to catch extra packets) */
-        for (i = 0; i < 2; ++i) {
-            j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
-            gettimeofday(&recv_time, NULL);
-            //clock_gettime(CLOCK_MONOTONIC, &recv_time);
-            if (j == -1) {
-                if (errno == EAGAIN) { /* timeout */
-                    MSG_WARN("[up  ] PUSH_ACK recieve timeout %d\n", i);
-                    continue;
-                } else { /* server connection error */
-                    break;
+        /* keep aggregating while the window is open, a status report closes it */
+        if ((dgram.nb_pkt > 0) && (dgram.nb_pkt < aggr_max_pkts) && (send_report == false)) {
+            waited = uptime_ms() - dgram.first_ms;
+            if (waited < aggr_max_latency_ms) {
+                if (nb_pkt == 0) {
+                    waited = aggr_max_latency_ms - waited;
+                    wait_ms ((waited < FETCH_SLEEP_MS) ? waited : FETCH_SLEEP_MS);
                 }
-            } else if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK)) {
-                MSG_WARN("[up  ] ignored invalid non-ACL packet\n");
-                continue;
-            } else if ((buff_ack[1] != token_h) || (buff_ack[2] != token_l)) {
-                MSG_WARN("[up  ] ignored out-of sync PUSH_ACK packet buff_ack[%u:%u] != token[%u:%u]\n", buff_ack[1], buff_ack[2], token_h, token_l);
                 continue;
-            } else {
-                MSG_DEBUG("[up  ] received PUSH_ACK [%u:%u] in %i ms\n", buff_ack[1], buff_ack[2], (int)(1000 * time_diff(send_time, recv_time)));
-                meas_up_ack_rcv += 1;
-                break;
             }
         }
-        pthread_mutex_unlock(&mx_meas_up);
+
+        if (dgram.nb_pkt == 0) {
+            push_data_begin(&dgram);
+        }
+        push_data_send(&dgram, send_report);
         wait_ms (5);
     }
     MSG_INFO("[up  ] End of upstream thread\n\n");
@@ -1859,11 +1821,7 @@ void thread_down(void) {
     bool req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
 
     /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *txpk_obj = NULL;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
-    short x0, x1;
+    struct pktjson_txpk_s txpk; /* txpk members, strings point into buff_down */
 
     /* auto-quit variable */
     uint32_t autoquit_cnt = 0; /* count the number of PULL_DATA sent since the latest PULL_ACK */
@@ -1963,108 +1921,89 @@ void thread_down(void) {
             MSG_DEBUG("[down] received PULL_RESP [%d:%d] :)\n", buff_down[1], buff_down[2]); /* very verbose */
             MSG_DEBUG("[down] PULL_RESP json: %s\n", (char *)(buff_down + 4)); /* DEBUG: display JSON payload */
 
-            /* initialize TX struct and try to parse JSON */
+            /* initialize TX struct and parse the JSON in place */
             memset(&txpkt, 0, sizeof txpkt);
-            root_val = json_parse_string_with_comments((const char *)(buff_down + 4)); /* JSON offset */
-            if (root_val == NULL) {
+            i = pktjson_txpk((const char *)(buff_down + 4), msg_len - 4, &txpk); /* JSON offset */
+            if (i == PKTJSON_ERR_SYNTAX) {
                 MSG_WARN("[down] invalid JSON, TX aborted\n");
                 continue;
             }
 
             /* look for JSON sub-object 'txpk' */
-            txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
-            if (txpk_obj == NULL) {
+            if (i == PKTJSON_ERR_NO_TXPK) {
                 MSG_WARN("[down] no \"txpk\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse "immediate" tag, or target timestamp */
-            i = json_object_get_boolean(txpk_obj, "imme"); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
-            if (i == 1) {
+            if ((txpk.present & PKTJSON_TXPK_IMME) && txpk.imme) {
                 /* TX procedure: send immediately */
                 sent_immediate = true;
                 downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
                 MSG_INFO("[down] a packet will be sent in \"immediate\" mode\n");
             } else {
                 sent_immediate = false;
-                val = json_object_get_value(txpk_obj, "tmst");
-                if (val != NULL) {
+                if (txpk.present & PKTJSON_TXPK_TMST) {
                     /* TX procedure: send on timestamp value */
-                    txpkt.count_us = (uint32_t)json_value_get_number(val);
+                    txpkt.count_us = txpk.tmst;
 
                     /* Concentrator timestamp is given, we consider it is a Class A downlink */
                     downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
                 } else {
                     /* TX procedure: send on UTC time (converted to timestamp value) */
-                    str = json_object_get_string(txpk_obj, "time");
-                    if (str == NULL) {
+                    if (!(txpk.present & PKTJSON_TXPK_TIME)) {
                         MSG_WARN("[down] no mandatory \"txpk.tmst\" or \"txpk.time\" objects in JSON, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                     }
                     MSG_WARN("[down] GPS disabled, impossible to send packet on specific UTC time, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
             }
 
             /* Parse "No CRC" flag (optional field) */
-            val = json_object_get_value(txpk_obj, "ncrc");
-            if (val != NULL) {
-                txpkt.no_crc = (bool)json_value_get_boolean(val);
+            if (txpk.present & PKTJSON_TXPK_NCRC) {
+                txpkt.no_crc = txpk.ncrc;
             }
 
             /* parse target frequency (mandatory) */
-            val = json_object_get_value(txpk_obj, "freq");
-            if (val == NULL) {
+            if (!(txpk.present & PKTJSON_TXPK_FREQ)) {
                 MSG_WARN("[down] no mandatory \"txpk.freq\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+            txpkt.freq_hz = txpk.freq_hz;
 
             /* parse RF chain used for TX (mandatory) */
-            val = json_object_get_value(txpk_obj, "rfch");
-            if (val == NULL) {
+            if (!(txpk.present & PKTJSON_TXPK_RFCH)) {
                 MSG_WARN("[down] no mandatory \"txpk.rfch\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.rf_chain = (uint8_t)json_value_get_number(val);
+            txpkt.rf_chain = txpk.rfch;
 
             /* parse TX power (optional field) */
-            val = json_object_get_value(txpk_obj, "powe");
-            if (val != NULL) {
-                txpkt.rf_power = (int8_t)json_value_get_number(val) - antenna_gain;
+            if (txpk.present & PKTJSON_TXPK_POWE) {
+                txpkt.rf_power = txpk.powe - antenna_gain;
             }
 
             /* Parse modulation (mandatory) */
-            str = json_object_get_string(txpk_obj, "modu");
-            if (str == NULL) {
+            if (!(txpk.present & PKTJSON_TXPK_MODU)) {
                 MSG_WARN("[down] no mandatory \"txpk.modu\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
-            if (strcmp(str, "LORA") == 0) {
+            if (pktjson_streq(&txpk.modu, "LORA")) {
                 /* Lora modulation */
                 txpkt.modulation = MOD_LORA;
 
                 /* Parse Lora spreading-factor and modulation bandwidth (mandatory) */
-                str = json_object_get_string(txpk_obj, "datr");
-                if (str == NULL) {
+                if (!(txpk.present & PKTJSON_TXPK_DATR_STR)) {
                     MSG_WARN("[down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                i = sscanf(str, "SF%2hdBW%3hd", &x0, &x1);
-                if (i != 2) {
+                if (txpk.datr_sf == 0) {
                     MSG_WARN("[down] format error in \"txpk.datr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                switch (x0) {
+                switch (txpk.datr_sf) {
                     case  7:
                         txpkt.datarate = DR_LORA_SF7;
                         break;
@@ -2085,10 +2024,9 @@ void thread_down(void) {
                         break;
                     default:
                         MSG_WARN("[down] format error in \"txpk.datr\", invalid SF, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
-                switch (x1) {
+                switch (txpk.datr_bw) {
                     case 125:
                         txpkt.bandwidth = BW_125KHZ;
                         break;
@@ -2100,47 +2038,40 @@ void thread_down(void) {
                         break;
                     default:
                         MSG_WARN("[down] format error in \"txpk.datr\", invalid BW, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
-              
+
                 /* Parse ECC coding rate (optional field) */
-                str = json_object_get_string(txpk_obj, "codr");
-                if (str == NULL) {
+                if (!(txpk.present & PKTJSON_TXPK_CODR)) {
                     MSG_WARN("[down] no mandatory \"txpk.codr\" object in json, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                if      (strcmp(str, "4/5") == 0) {
+                if      (pktjson_streq(&txpk.codr, "4/5")) {
                     txpkt.coderate = CR_LORA_4_5;
-                } else if (strcmp(str, "4/6") == 0) {
+                } else if (pktjson_streq(&txpk.codr, "4/6")) {
                     txpkt.coderate = CR_LORA_4_6;
-                } else if (strcmp(str, "2/3") == 0) {
+                } else if (pktjson_streq(&txpk.codr, "2/3")) {
                     txpkt.coderate = CR_LORA_4_6;
-                } else if (strcmp(str, "4/7") == 0) {
+                } else if (pktjson_streq(&txpk.codr, "4/7")) {
                     txpkt.coderate = CR_LORA_4_7;
-                } else if (strcmp(str, "4/8") == 0) {
+                } else if (pktjson_streq(&txpk.codr, "4/8")) {
                     txpkt.coderate = CR_LORA_4_8;
-                } else if (strcmp(str, "1/2") == 0) {
+                } else if (pktjson_streq(&txpk.codr, "1/2")) {
                     txpkt.coderate = CR_LORA_4_8;
                 } else {
                     MSG_WARN("[down] format error in \"txpk.codr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
 
                 /* Parse signal polarity switch (optional field) */
-                val = json_object_get_value(txpk_obj, "ipol");
-                if (val != NULL) {
-                    txpkt.invert_pol = (bool)json_value_get_boolean(val);
+                if (txpk.present & PKTJSON_TXPK_IPOL) {
+                    txpkt.invert_pol = txpk.ipol;
                 }
 
                 /* parse Lora preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj, "prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
-                    if (i >= MIN_LORA_PREAMB) {
-                        txpkt.preamble = (uint16_t)i;
+                if (txpk.present & PKTJSON_TXPK_PREA) {
+                    if (txpk.prea >= MIN_LORA_PREAMB) {
+                        txpkt.preamble = txpk.prea;
                     } else {
                         txpkt.preamble = (uint16_t)MIN_LORA_PREAMB;
                     }
@@ -2148,35 +2079,29 @@ void thread_down(void) {
                     txpkt.preamble = (uint16_t)STD_LORA_PREAMB;
                 }
 
-            } else if (strcmp(str, "FSK") == 0) {
+            } else if (pktjson_streq(&txpk.modu, "FSK")) {
 
                 /* FSK modulation */
                 txpkt.modulation = MOD_FSK;
 
                 /* parse FSK bitrate (mandatory) */
-                val = json_object_get_value(txpk_obj, "datr");
-                if (val == NULL) {
+                if (!(txpk.present & PKTJSON_TXPK_DATR_NUM)) {
                     MSG_WARN("[down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.datarate = (uint32_t)(json_value_get_number(val));
+                txpkt.datarate = txpk.datr_num;
 
                 /* parse frequency deviation (mandatory) */
-                val = json_object_get_value(txpk_obj, "fdev");
-                if (val == NULL) {
+                if (!(txpk.present & PKTJSON_TXPK_FDEV)) {
                     MSG_WARN("[down] no mandatory \"txpk.fdev\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.f_dev = (uint8_t)(json_value_get_number(val) / 1000.0); /* JSON value in Hz, txpkt.f_dev in kHz */
+                txpkt.f_dev = (uint8_t)(txpk.fdev / 1000); /* JSON value in Hz, txpkt.f_dev in kHz */
 
                 /* parse FSK preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj, "prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
-                    if (i >= MIN_FSK_PREAMB) {
-                        txpkt.preamble = (uint16_t)i;
+                if (txpk.present & PKTJSON_TXPK_PREA) {
+                    if (txpk.prea >= MIN_FSK_PREAMB) {
+                        txpkt.preamble = txpk.prea;
                     } else {
                         txpkt.preamble = (uint16_t)MIN_FSK_PREAMB;
                     }
@@ -2186,34 +2111,26 @@ void thread_down(void) {
 
             } else {
                 MSG_WARN("[down] invalid modulation in \"txpk.modu\", TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse payload length (mandatory) */
-            val = json_object_get_value(txpk_obj, "size");
-            if (val == NULL) {
+            if (!(txpk.present & PKTJSON_TXPK_SIZE)) {
                 MSG_WARN("[down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.size = (uint16_t)json_value_get_number(val);
+            txpkt.size = txpk.size;
 
-            /* Parse payload data (mandatory) */
-            str = json_object_get_string(txpk_obj, "data");
-            if (str == NULL) {
+            /* Parse payload data (mandatory), decoded straight from the datagram */
+            if (!(txpk.present & PKTJSON_TXPK_DATA)) {
                 MSG_WARN("[down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
+            i = pktjson_b64_to_bin(&txpk.data, txpkt.payload, sizeof txpkt.payload);
             if (i != txpkt.size) {
                 MSG_WARN("[down] mismatch between .size and .data size once converter to binary\n");
             }
 
-            /* free the JSON parse tree from memory */
-            json_value_free(root_val);
-
             /* select TX mode */
             if (sent_immediate) {
                 txpkt.tx_mode = IMMEDIATE;
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * Streaming rxpk writer and single pass txpk reader, see pktjson.h.
+ *
+ * The writer produces the same text as the snprintf based code it replaces:
+ * decimals are rounded half to even on the scaled value, which matches
+ * printf for the SNR quarter steps and integer RSSI the HAL reports.
+ * The reader works on integers only (no double arithmetic, which is done in
+ * software on the ESP32): numbers are kept in millionths, so that "freq"
+ * converts exactly to Hz.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <string.h>     /* memcpy */
+#include <math.h>       /* rint, signbit */
+
+#include "base64.h"
+#include "pktjson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define W_LIT(w, s)         w_raw(w, s, sizeof(s) - 1)
+#define KEY4(a, b, c, d)    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NUM_SCALE           1000000LL   /* numbers are parsed in millionths */
+#define NUM_MAX             (1LL << 62)
+#define SKIP_MAX_DEPTH      32
+#define B64_MAX_LEN         344         /* 256 bytes in base64 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct writer_s {
+    char *p;
+    char *end;
+    bool ok;
+};
+
+struct reader_s {
+    const char *p;
+    const char *end;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION: WRITER --------------------------------- */
+
+static inline void w_raw(struct writer_s *w, const char *s, int n) {
+    if (w->end - w->p < n) {
+        w->ok = false;
+        return;
+    }
+    memcpy(w->p, s, n);
+    w->p += n;
+}
+
+static void w_uint(struct writer_s *w, uint32_t v) {
+    char tmp[10];
+    int n = sizeof tmp;
+
+    do {
+        tmp[--n] = '0' + (v % 10);
+        v /= 10;
+    } while (v != 0);
+    w_raw(w, &tmp[n], sizeof tmp - n);
+}
+
+/* v with 6 decimals, v in millionths */
+static void w_micro(struct writer_s *w, uint32_t v) {
+    char frac[7];
+    uint32_t f = v % 1000000;
+    int i;
+
+    w_uint(w, v / 1000000);
+    frac[0] = '.';
+    for (i = 6; i > 0; i--) {
+        frac[i] = '0' + (f % 10);
+        f /= 10;
+    }
+    w_raw(w, frac, sizeof frac);
+}
+
+/* same as printf "%.0f" (decimals 0) or "%.1f" (decimals 1) */
+static void w_fixed(struct writer_s *w, double v, int decimals) {
+    uint32_t u;
+    char c;
+
+    if (signbit(v)) {
+        W_LIT(w, "-");
+        v = -v;
+    }
+    if (v > 1e6) {
+        v = 1e6;
+    }
+    u = (uint32_t)rint((decimals > 0) ? (v * 10) : v);
+    if (decimals > 0) {
+        w_uint(w, u / 10);
+        W_LIT(w, ".");
+        c = '0' + (u % 10);
+        w_raw(w, &c, 1);
+    } else {
+        w_uint(w, u);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION: READER --------------------------------- */
+
+/* skip white space and comments, as json_parse_string_with_comments() does */
+static void r_ws(struct reader_s *r) {
+    while (r->p < r->end) {
+        switch (*r->p) {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                r->p++;
+                break;
+            case '/':
+                if ((r->end - r->p >= 2) && (r->p[1] == '*')) {
+                    for (r->p += 2; (r->end - r->p >= 2) && !((r->p[0] == '*') && (r->p[1] == '/')); r->p++);
+                    r->p = (r->end - r->p >= 2) ? r->p + 2 : r->end;
+                } else if ((r->end - r->p >= 2) && (r->p[1] == '/')) {
+                    for (r->p += 2; (r->p < r->end) && (*r->p != '\n'); r->p++);
+                } else {
+                    return;
+                }
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+static inline bool r_char(struct reader_s *r, char c) {
+    r_ws(r);
+    if ((r->p < r->end) && (*r->p == c)) {
+        r->p++;
+        return true;
+    }
+    return false;
+}
+
+static inline char r_peek(struct reader_s *r) {
+    r_ws(r);
+    return (r->p < r->end) ? *r->p : 0;
+}
+
+static bool r_string(struct reader_s *r, struct pktjson_str_s *s) {
+    const char *start;
+
+    if (!r_char(r, '"')) {
+        return false;
+    }
+    s->escaped = false;
+    for (start = r->p; r->p < r->end; r->p++) {
+        if (*r->p == '\\') {
+            s->escaped = true;
+            r->p++;
+        } else if (*r->p == '"') {
+            s->ptr = start;
+            s->len = (r->p - start > UINT16_MAX) ? UINT16_MAX : (uint16_t)(r->p - start);
+            r->p++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool r_literal(struct reader_s *r, const char *lit, int len) {
+    if ((r->end - r->p < len) || (memcmp(r->p, lit, len) != 0)) {
+        return false;
+    }
+    r->p += len;
+    return true;
+}
+
+/* JSON number in millionths, saturated to +/-NUM_MAX */
+static bool r_number(struct reader_s *r, int64_t *v) {
+    int64_t mant = 0;
+    int scale = 0; /* mant * 10^scale is the value */
+    int exp = 0;
+    bool neg = false;
+    bool exp_neg = false;
+    bool digits = false;
+
+    r_ws(r);
+    if ((r->p < r->end) && (*r->p == '-')) {
+        neg = true;
+        r->p++;
+    }
+    for (; (r->p < r->end) && (*r->p >= '0') && (*r->p <= '9'); r->p++) {
+        digits = true;
+        if (mant < NUM_MAX / 10) {
+            mant = mant * 10 + (*r->p - '0');
+        } else {
+            scale++;
+        }
+    }
+    if ((r->p < r->end) && (*r->p == '.')) {
+        for (r->p++; (r->p < r->end) && (*r->p >= '0') && (*r->p <= '9'); r->p++) {
+            digits = true;
+            if (mant < NUM_MAX / 10) {
+                mant = mant * 10 + (*r->p - '0');
+                scale--;
+            }
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+    if ((r->p < r->end) && ((*r->p == 'e') || (*r->p == 'E'))) {
+        r->p++;
+        if ((r->p < r->end) && ((*r->p == '+') || (*r->p == '-'))) {
+            exp_neg = (*r->p == '-');
+            r->p++;
+        }
+        if ((r->p >= r->end) || (*r->p < '0') || (*r->p > '9')) {
+            return false;
+        }
+        for (; (r->p < r->end) && (*r->p >= '0') && (*r->p <= '9'); r->p++) {
+            if (exp < 1000) {
+                exp = exp * 10 + (*r->p - '0');
+            }
+        }
+        scale += exp_neg ? -exp : exp;
+    }
+
+    /* to millionths */
+    for (scale += 6; (scale > 0) && (mant != 0); scale--) {
+        if (mant >= NUM_MAX / 10) {
+            mant = NUM_MAX;
+            break;
+        }
+        mant *= 10;
+    }
+    for (; (scale < 0) && (mant != 0); scale++) {
+        mant /= 10;
+    }
+    *v = neg ? -mant : mant;
+    return true;
+}
+
+static bool r_skip_value(struct reader_s *r, int depth) {
+    struct pktjson_str_s s;
+    int64_t n;
+
+    if (depth > SKIP_MAX_DEPTH) {
+        return false;
+    }
+    switch (r_peek(r)) {
+        case '"':
+            return r_string(r, &s);
+        case 't':
+            return r_literal(r, "true", 4);
+        case 'f':
+            return r_literal(r, "false", 5);
+        case 'n':
+            return r_literal(r, "null", 4);
+        case '{':
+            r->p++;
+            if (r_char(r, '}')) {
+                return true;
+            }
+            do {
+                if (!r_string(r, &s) || !r_char(r, ':') || !r_skip_value(r, depth + 1)) {
+                    return false;
+                }
+            } while (r_char(r, ','));
+            return r_char(r, '}');
+        case '[':
+            r->p++;
+            if (r_char(r, ']')) {
+                return true;
+            }
+            do {
+                if (!r_skip_value(r, depth + 1)) {
+                    return false;
+                }
+            } while (r_char(r, ','));
+            return r_char(r, ']');
+        default:
+            return r_number(r, &n);
+    }
+}
+
+/* "SF7BW125" style LoRa datarate, sf is left to 0 if malformed */
+static void parse_lora_datr(const struct pktjson_str_s *s, struct pktjson_txpk_s *t) {
+    uint32_t sf = 0, bw = 0;
+    int i = 2, d;
+
+    t->datr_sf = 0;
+    if ((s->len < 6) || (s->ptr[0] != 'S') || (s->ptr[1] != 'F')) {
+        return;
+    }
+    for (d = 0; (i < s->len) && (d < 2) && (s->ptr[i] >= '0') && (s->ptr[i] <= '9'); i++, d++) {
+        sf = sf * 10 + (s->ptr[i] - '0');
+    }
+    if ((d == 0) || (s->len - i < 3) || (s->ptr[i] != 'B') || (s->ptr[i + 1] != 'W')) {
+        return;
+    }
+    for (i += 2, d = 0; (i < s->len) && (d < 3) && (s->ptr[i] >= '0') && (s->ptr[i] <= '9'); i++, d++) {
+        bw = bw * 10 + (s->ptr[i] - '0');
+    }
+    if (d == 0) {
+        return;
+    }
+    t->datr_sf = sf;
+    t->datr_bw = bw;
+}
+
+static bool parse_txpk(struct reader_s *r, struct pktjson_txpk_s *t) {
+    struct pktjson_str_s key, s;
+    uint32_t k, flag;
+    int64_t n;
+    char c;
+
+    if (r_char(r, '}')) {
+        return true;
+    }
+    do {
+        if (!r_string(r, &key) || !r_char(r, ':')) {
+            return false;
+        }
+        k = (key.len == 4) ? KEY4(key.ptr[0], key.ptr[1], key.ptr[2], key.ptr[3]) : 0;
+        c = r_peek(r);
+
+        if ((c == 't') || (c == 'f')) {
+            /* booleans */
+            bool b = (c == 't');
+            if (!r_literal(r, b ? "true" : "false", b ? 4 : 5)) {
+                return false;
+            }
+            switch (k) {
+                case KEY4('i','m','m','e'): t->imme = b; t->present |= PKTJSON_TXPK_IMME; break;
+                case KEY4('n','c','r','c'): t->ncrc = b; t->present |= PKTJSON_TXPK_NCRC; break;
+                case KEY4('i','p','o','l'): t->ipol = b; t->present |= PKTJSON_TXPK_IPOL; break;
+                default: break;
+            }
+        } else if (c == '"') {
+            /* strings */
+            if (!r_string(r, &s)) {
+                return false;
+            }
+            switch (k) {
+                case KEY4('t','i','m','e'): t->present |= PKTJSON_TXPK_TIME; break;
+                case KEY4('m','o','d','u'): t->modu = s; t->present |= PKTJSON_TXPK_MODU; break;
+                case KEY4('c','o','d','r'): t->codr = s; t->present |= PKTJSON_TXPK_CODR; break;
+                case KEY4('d','a','t','a'): t->data = s; t->present |= PKTJSON_TXPK_DATA; break;
+                case KEY4('d','a','t','r'):
+                    parse_lora_datr(&s, t);
+                    t->present |= PKTJSON_TXPK_DATR_STR;
+                    break;
+                default: break;
+            }
+        } else if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+            /* numbers */
+            if (!r_number(r, &n)) {
+                return false;
+            }
+            flag = 0;
+            switch (k) {
+                case KEY4('t','m','s','t'): t->tmst = (uint32_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_TMST; break;
+                case KEY4('f','r','e','q'): t->freq_hz = (uint32_t)n; flag = PKTJSON_TXPK_FREQ; break;
+                case KEY4('r','f','c','h'): t->rfch = (uint8_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_RFCH; break;
+                case KEY4('p','o','w','e'): t->powe = (int8_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_POWE; break;
+                case KEY4('d','a','t','r'): t->datr_num = (uint32_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_DATR_NUM; break;
+                case KEY4('f','d','e','v'): t->fdev = (uint32_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_FDEV; break;
+                case KEY4('p','r','e','a'): t->prea = (uint16_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_PREA; break;
+                case KEY4('s','i','z','e'): t->size = (uint16_t)(n / NUM_SCALE); flag = PKTJSON_TXPK_SIZE; break;
+                default: break;
+            }
+            t->present |= flag;
+        } else if (!r_skip_value(r, 1)) {
+            return false;
+        }
+    } while (r_char(r, ','));
+
+    return r_char(r, '}');
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int pktjson_rxpk(char *out, int max_len, const struct lgw_pkt_rx_s *p) {
+    struct writer_s w = { out, out + max_len, true };
+    int j;
+
+    /* RAW timestamp, concentrator channel, RF chain & RX frequency */
+    W_LIT(&w, "{\"tmst\":");
+    w_uint(&w, p->count_us);
+    W_LIT(&w, ",\"chan\":");
+    w_uint(&w, p->if_chain);
+    W_LIT(&w, ",\"rfch\":");
+    w_uint(&w, p->rf_chain);
+    W_LIT(&w, ",\"freq\":");
+    w_micro(&w, p->freq_hz);
+
+    /* Packet status */
+    switch (p->status) {
+        case STAT_CRC_OK:   W_LIT(&w, ",\"stat\":1"); break;
+        case STAT_CRC_BAD:  W_LIT(&w, ",\"stat\":-1"); break;
+        case STAT_NO_CRC:   W_LIT(&w, ",\"stat\":0"); break;
+        default:            return PKTJSON_ERROR;
+    }
+
+    /* Packet modulation, datarate, bandwidth, coding rate and SNR */
+    if (p->modulation == MOD_LORA) {
+        W_LIT(&w, ",\"modu\":\"LORA\"");
+        switch (p->datarate) {
+            case DR_LORA_SF7:   W_LIT(&w, ",\"datr\":\"SF7"); break;
+            case DR_LORA_SF8:   W_LIT(&w, ",\"datr\":\"SF8"); break;
+            case DR_LORA_SF9:   W_LIT(&w, ",\"datr\":\"SF9"); break;
+            case DR_LORA_SF10:  W_LIT(&w, ",\"datr\":\"SF10"); break;
+            case DR_LORA_SF11:  W_LIT(&w, ",\"datr\":\"SF11"); break;
+            case DR_LORA_SF12:  W_LIT(&w, ",\"datr\":\"SF12"); break;
+            default:            return PKTJSON_ERROR;
+        }
+        switch (p->bandwidth) {
+            case BW_125KHZ:     W_LIT(&w, "BW125\""); break;
+            case BW_250KHZ:     W_LIT(&w, "BW250\""); break;
+            case BW_500KHZ:     W_LIT(&w, "BW500\""); break;
+            default:            return PKTJSON_ERROR;
+        }
+        switch (p->coderate) {
+            case CR_LORA_4_5:   W_LIT(&w, ",\"codr\":\"4/5\""); break;
+            case CR_LORA_4_6:   W_LIT(&w, ",\"codr\":\"4/6\""); break;
+            case CR_LORA_4_7:   W_LIT(&w, ",\"codr\":\"4/7\""); break;
+            case CR_LORA_4_8:   W_LIT(&w, ",\"codr\":\"4/8\""); break;
+            case 0:             W_LIT(&w, ",\"codr\":\"OFF\""); break; /* treat the CR0 case (mostly false sync) */
+            default:            return PKTJSON_ERROR;
+        }
+        W_LIT(&w, ",\"lsnr\":");
+        w_fixed(&w, p->snr, 1);
+    } else if (p->modulation == MOD_FSK) {
+        W_LIT(&w, ",\"modu\":\"FSK\",\"datr\":");
+        w_uint(&w, p->datarate);
+    } else {
+        return PKTJSON_ERROR;
+    }
+
+    /* Packet RSSI, payload size and base64-encoded payload */
+    W_LIT(&w, ",\"rssi\":");
+    w_fixed(&w, p->rssi, 0);
+    W_LIT(&w, ",\"size\":");
+    w_uint(&w, p->size);
+    W_LIT(&w, ",\"data\":\"");
+    if (!w.ok) {
+        return PKTJSON_ERROR;
+    }
+    /* bin_to_b64 needs room for its null char, which the closing quote overwrites */
+    j = bin_to_b64(p->payload, p->size, w.p, w.end - w.p);
+    if (j < 0) {
+        return PKTJSON_ERROR;
+    }
+    w.p += j;
+    W_LIT(&w, "\"}");
+
+    return w.ok ? (w.p - out) : PKTJSON_ERROR;
+}
+
+int pktjson_b64_to_bin(const struct pktjson_str_s *s, uint8_t *out, int max_len) {
+    char buff[B64_MAX_LEN];
+    int i, n = 0;
+
+    if (!s->escaped) {
+        return b64_to_bin(s->ptr, s->len, out, max_len);
+    }
+    /* some servers escape the '/' of the base64 alphabet */
+    for (i = 0; i < s->len; i++) {
+        if (s->ptr[i] == '\\') {
+            if ((++i == s->len) || (s->ptr[i] != '/')) {
+                return -1;
+            }
+        }
+        if (n == sizeof buff) {
+            return -1;
+        }
+        buff[n++] = s->ptr[i];
+    }
+    return b64_to_bin(buff, n, out, max_len);
+}
+
+int pktjson_txpk(const char *json, int len, struct pktjson_txpk_s *txpk) {
+    struct reader_s r = { json, json + len };
+    struct pktjson_str_s key;
+    bool found = false;
+
+    memset(txpk, 0, sizeof *txpk);
+    if (!r_char(&r, '{')) {
+        return PKTJSON_ERR_SYNTAX;
+    }
+    if (r_char(&r, '}')) {
+        return PKTJSON_ERR_NO_TXPK;
+    }
+    do {
+        if (!r_string(&r, &key) || !r_char(&r, ':')) {
+            return PKTJSON_ERR_SYNTAX;
+        }
+        if (pktjson_streq(&key, "txpk") && (r_peek(&r) == '{')) {
+            r.p++;
+            memset(txpk, 0, sizeof *txpk);
+            if (!parse_txpk(&r, txpk)) {
+                return PKTJSON_ERR_SYNTAX;
+            }
+            found = true;
+        } else if (!r_skip_value(&r, 1)) {
+            return PKTJSON_ERR_SYNTAX;
+        }
+    } while (r_char(&r, ','));
+
+    if (!r_char(&r, '}')) {
+        return PKTJSON_ERR_SYNTAX;
+    }
+    return found ? PKTJSON_OK : PKTJSON_ERR_NO_TXPK;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+/*
+ * JSON of the Semtech UDP protocol on the packet forwarder hot paths:
+ * rxpk objects are written straight into the datagram buffer, and txpk
+ * objects are read in a single pass over the received datagram, without
+ * building a parse tree or allocating memory.
+ */
+
+#ifndef _LORA_PKTFWD_PKTJSON_H
+#define _LORA_PKTFWD_PKTJSON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <string.h>     /* memcmp */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PKTJSON_OK              0
+#define PKTJSON_ERROR           -1  /* output buffer too small, or packet field out of range */
+#define PKTJSON_ERR_SYNTAX      -2  /* not valid JSON */
+#define PKTJSON_ERR_NO_TXPK     -3  /* no "txpk" object */
+
+/* longest rxpk object written by pktjson_rxpk(), 255 bytes payload */
+#define PKTJSON_RXPK_MAX_LEN    540
+
+/* txpk members found by pktjson_txpk() */
+#define PKTJSON_TXPK_IMME       (1 << 0)
+#define PKTJSON_TXPK_TMST       (1 << 1)
+#define PKTJSON_TXPK_TIME       (1 << 2)
+#define PKTJSON_TXPK_FREQ       (1 << 3)
+#define PKTJSON_TXPK_RFCH       (1 << 4)
+#define PKTJSON_TXPK_POWE       (1 << 5)
+#define PKTJSON_TXPK_MODU       (1 << 6)
+#define PKTJSON_TXPK_DATR_STR   (1 << 7)
+#define PKTJSON_TXPK_DATR_NUM   (1 << 8)
+#define PKTJSON_TXPK_CODR       (1 << 9)
+#define PKTJSON_TXPK_FDEV       (1 << 10)
+#define PKTJSON_TXPK_IPOL       (1 << 11)
+#define PKTJSON_TXPK_PREA       (1 << 12)
+#define PKTJSON_TXPK_SIZE       (1 << 13)
+#define PKTJSON_TXPK_DATA       (1 << 14)
+#define PKTJSON_TXPK_NCRC       (1 << 15)
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* String value, pointing into the parsed datagram (escapes are not decoded) */
+struct pktjson_str_s {
+    const char *ptr;
+    uint16_t len;
+    bool escaped;               /*!> contains backslash escapes */
+};
+
+/**
+@struct pktjson_txpk_s
+@brief Members of a txpk object, only valid when their bit is set in present.
+A member with an unexpected JSON type is reported as absent.
+*/
+struct pktjson_txpk_s {
+    uint32_t present;           /*!> PKTJSON_TXPK_xxx of the members found */
+    bool imme;
+    bool ncrc;
+    bool ipol;
+    uint32_t tmst;
+    uint32_t freq_hz;           /*!> "freq" in MHz, converted exactly to Hz */
+    uint8_t rfch;
+    int8_t powe;
+    struct pktjson_str_s modu;
+    uint8_t datr_sf;            /*!> "SFxxBWyyy" datr, 0 if it is malformed */
+    uint16_t datr_bw;
+    uint32_t datr_num;          /*!> FSK datr, in bits per second */
+    struct pktjson_str_s codr;
+    uint32_t fdev;
+    uint16_t prea;
+    uint16_t size;
+    struct pktjson_str_s data;  /*!> base64 payload */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Write a packet as an rxpk JSON object
+@param out buffer receiving the object, not null terminated
+@param max_len space left in the buffer
+@param p received packet
+@return length of the object, PKTJSON_ERROR if it does not fit or if the packet
+status, modulation, datarate, bandwidth or coderate is unknown
+*/
+int pktjson_rxpk(char *out, int max_len, const struct lgw_pkt_rx_s *p);
+
+/**
+@brief Find the txpk object of a PULL_RESP and read its members
+@param json datagram payload
+@param len length of the payload
+@param txpk receives the members found
+@return PKTJSON_OK, PKTJSON_ERR_SYNTAX or PKTJSON_ERR_NO_TXPK
+*/
+int pktjson_txpk(const char *json, int len, struct pktjson_txpk_s *txpk);
+
+/**
+@brief Decode a base64 string value, such as txpk "data"
+@param s string value, "\/" escapes are accepted
+@param out buffer receiving the binary data
+@param max_len size of the buffer
+@return number of bytes decoded, -1 on error
+*/
+int pktjson_b64_to_bin(const struct pktjson_str_s *s, uint8_t *out, int max_len);
+
+/**
+@brief Compare a string value with a C string
+*/
+static inline bool pktjson_streq(const struct pktjson_str_s *s, const char *cstr) {
+    return (strlen(cstr) == s->len) && (memcmp(s->ptr, cstr, s->len) == 0);
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
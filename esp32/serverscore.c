@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "serverscore.h"
+#include "esp32_mphal.h"
+
+#include "lwip/sockets.h"
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void servers_wait_init (servers_wait_t *w, uint32_t timeout) {
+    FD_ZERO(&w->rfds);
+    FD_ZERO(&w->wfds);
+    w->maxsd = -1;
+    w->timeout = timeout;
+}
+
+void servers_wait_read (servers_wait_t *w, int32_t sd) {
+    if (sd >= 0) {
+        FD_SET(sd, &w->rfds);
+        w->maxsd = (sd > w->maxsd) ? sd : w->maxsd;
+    }
+}
+
+void servers_wait_write (servers_wait_t *w, int32_t sd) {
+    if (sd >= 0) {
+        FD_SET(sd, &w->wfds);
+        w->maxsd = (sd > w->maxsd) ? sd : w->maxsd;
+    }
+}
+
+void servers_wait_timeout (servers_wait_t *w, uint32_t timeout) {
+    if (timeout < w->timeout) {
+        w->timeout = timeout;
+    }
+}
+
+void servers_wait_until (servers_wait_t *w, uint32_t since, uint32_t timeout) {
+    uint32_t elapsed = mp_hal_ticks_ms() - since;
+    servers_wait_timeout(w, (elapsed >= timeout) ? 0 : (timeout - elapsed));
+}
+
+int32_t servers_wait (servers_wait_t *w) {
+    struct timeval tv;
+
+    tv.tv_sec = w->timeout / 1000;
+    tv.tv_usec = (w->timeout % 1000) * 1000;
+    // the sets come back holding only the sockets that are ready
+    return lwip_select(w->maxsd + 1, &w->rfds, &w->wfds, NULL, &tv);
+}
+
+bool servers_timed_out (uint32_t since, uint32_t timeout) {
+    return (uint32_t)(mp_hal_ticks_ms() - since) >= timeout;
+}
+
+bool servers_send_all (int32_t sd, const void *data, int32_t len, uint32_t timeout) {
+    uint32_t start = mp_hal_ticks_ms();
+    const uint8_t *p = data;
+
+    while (len > 0) {
+        int32_t sent = send(sd, p, len, 0);
+        if (sent > 0) {
+            p += sent;
+            len -= sent;
+            continue;
+        } else if (sent < 0 && errno != EAGAIN) {
+            return false;
+        }
+
+        // the socket is full, block until it drains or the time is up
+        servers_wait_t w;
+        servers_wait_init(&w, timeout);
+        servers_wait_until(&w, start, timeout);
+        if (w.timeout == 0) {
+            return false;
+        }
+        servers_wait_write(&w, sd);
+        if (servers_wait(&w) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
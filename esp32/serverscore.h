@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef SERVERSCORE_H_
+#define SERVERSCORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/sockets.h"
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// What the servers task sleeps on: each server adds the sockets it can make
+// progress on and the time its nearest timeout expires, the task then blocks
+// in select() until one of them is ready. Timeouts are in milliseconds.
+typedef struct {
+    fd_set      rfds;
+    fd_set      wfds;
+    int32_t     maxsd;
+    uint32_t    timeout;
+} servers_wait_t;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern void servers_wait_init (servers_wait_t *w, uint32_t timeout);
+extern void servers_wait_read (servers_wait_t *w, int32_t sd);
+extern void servers_wait_write (servers_wait_t *w, int32_t sd);
+extern void servers_wait_timeout (servers_wait_t *w, uint32_t timeout);
+extern void servers_wait_until (servers_wait_t *w, uint32_t since, uint32_t timeout);
+extern int32_t servers_wait (servers_wait_t *w);
+extern bool servers_timed_out (uint32_t since, uint32_t timeout);
+extern bool servers_send_all (int32_t sd, const void *data, int32_t len, uint32_t timeout);
+
+#endif /* SERVERSCORE_H_ */
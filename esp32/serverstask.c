@@ -16,6 +16,7 @@
 #include "py/nlr.h"
 #include "py/mphal.h"
 #include "serverstask.h"
+#include "serverscore.h"
 //#include "debug.h"
 #include "telnet.h"
 #include "ftp.h"
@@ -61,7 +62,7 @@ extern TaskHandle_t svTaskHandle;
  DECLARE PUBLIC FUNCTIONS
  ******************************************************************************/
 void TASK_Servers (void *pvParameters) {
-    bool cycle = false;
+    servers_wait_t wait;
 
     strcpy (servers_user, SERVERS_DEF_USER);
     strcpy (servers_pass, SERVERS_DEF_PASS);
@@ -99,12 +100,19 @@ void TASK_Servers (void *pvParameters) {
             modusocket_close_all_user_sockets();
         }
 
-        if (cycle) {
-            telnet_run();
-        } else {
-            ftp_run();
+        // sleep until a client needs attention or a timeout expires, the
+        // requests from other tasks are picked up at least once per idle period
+        servers_wait_init(&wait, SERVERS_IDLE_TIME_MS);
+        telnet_prepare_wait(&wait);
+        ftp_prepare_wait(&wait);
+        if (servers_wait(&wait) < 0) {
+            // a socket went away under select, don't spin on it
+            vTaskDelay(SERVERS_CYCLE_TIME_MS / portTICK_PERIOD_MS);
         }
 
+        telnet_run();
+        ftp_run();
+
         if (sleep_sockets) {
 //            pybwdt_srv_sleeping(true);  //  FIXME
 //            modusocket_enter_sleep();   //  FIXME
@@ -123,15 +131,15 @@ void TASK_Servers (void *pvParameters) {
         if (servers_data.reset_and_safe_boot) {
             mp_hal_reset_safe_and_boot(true);
         }
-
-        // move to the next cycle
-        cycle = cycle ? false : true;
-        vTaskDelay (SERVERS_CYCLE_TIME_MS / portTICK_PERIOD_MS);
     }
 }
 
 void servers_start (void) {
     servers_data.do_enable = true;
+    // the servers task picks the request up within one idle period
+    for (uint32_t t = 0; servers_data.do_enable && t < (SERVERS_IDLE_TIME_MS * 2); t += SERVERS_CYCLE_TIME_MS) {
+        vTaskDelay(SERVERS_CYCLE_TIME_MS / portTICK_PERIOD_MS);
+    }
     vTaskDelay((SERVERS_CYCLE_TIME_MS * 3) / portTICK_PERIOD_MS);
 }
 
@@ -8,6 +8,7 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "py/mpconfig.h"
@@ -16,14 +17,8 @@
 #include "readline.h"
 #include "telnet.h"
 #include "serverstask.h"
+#include "serverscore.h"
 
-#include "esp_heap_caps.h"
-#include "sdkconfig.h"
-#include "esp_system.h"
-#include "esp_spi_flash.h"
-#include "nvs_flash.h"
-
-#include "modnetwork.h"
 //#include "modwlan.h"
 #include "modusocket.h"
 //#include "debug.h"
@@ -31,23 +26,18 @@
 #include "genhdr/mpversion.h"
 
 #include "lwip/sockets.h"
-#include "lwip/dns.h"
-#include "lwip/netdb.h"
-
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
+#ifndef TELNET_PORT
 #define TELNET_PORT                         23
+#endif
 // rxRindex and rxWindex must be uint8_t and TELNET_RX_BUFFER_SIZE == 256
 #define TELNET_RX_BUFFER_SIZE               256
 #define TELNET_MAX_CLIENTS                  1
-#define TELNET_TX_RETRIES_MAX               50
-#define TELNET_WAIT_TIME_MS                 2
+#define TELNET_TX_TIMEOUT_MS                1500
 #define TELNET_LOGIN_RETRIES_MAX            3
-#define TELNET_CYCLE_TIME_MS                (SERVERS_CYCLE_TIME_MS * 2)
 
 #define SE 240
 #define AYT 246
@@ -100,7 +90,7 @@ typedef union {
 
 typedef struct {
     uint8_t             *rxBuffer;
-    uint32_t            timeout;
+    uint32_t            active;         // ticks of the last client activity
     telnet_state_t      state;
     telnet_substate_t   substate;
     int32_t             sd;
@@ -114,7 +104,6 @@ typedef struct {
     // completed later
     uint8_t             rxIncompleteLen;
 
-    uint8_t             txRetries;
     uint8_t             loginRetries;
     bool                enabled;
     bool                credentialsValid;
@@ -146,7 +135,6 @@ static telnet_result_t telnet_recv_text_non_blocking (void *buff, int32_t Maxlen
 static void telnet_process (void);
 static int telnet_process_credential (char *credential, int32_t rxLen);
 static void telnet_parse_input (uint8_t *str, int32_t *len);
-static bool telnet_send_with_retries (int32_t sd, const void *pBuf, int32_t len);
 static void telnet_reset_buffer (void);
 
 /******************************************************************************
@@ -163,7 +151,10 @@ void telnet_run (void) {
     switch (telnet_data.state) {
         case E_TELNET_STE_DISABLED:
             telnet_wait_for_enabled();
-            break;
+            if (telnet_data.state != E_TELNET_STE_START) {
+                break;
+            }
+            // fall through, to start listening right away
         case E_TELNET_STE_START:
             if (/*wlan_is_connected() && */ telnet_create_socket()) {
                 telnet_data.state = E_TELNET_STE_LISTEN;
@@ -251,15 +242,49 @@ void telnet_run (void) {
     }
 
     if (telnet_data.state >= E_TELNET_STE_CONNECTED) {
-        if (telnet_data.timeout++ > (servers_get_timeout() / TELNET_CYCLE_TIME_MS)) {
+        if (servers_timed_out(telnet_data.active, servers_get_timeout())) {
             telnet_reset();
         }
     }
 }
 
+void telnet_prepare_wait (servers_wait_t *w) {
+    switch (telnet_data.state) {
+        case E_TELNET_STE_DISABLED:
+            if (telnet_data.enabled) {
+                servers_wait_timeout(w, 0);
+            }
+            break;
+        case E_TELNET_STE_LISTEN:
+            servers_wait_read(w, telnet_data.sd);
+            break;
+        case E_TELNET_STE_CONNECTED:
+            if (telnet_data.substate.connected == E_TELNET_STE_SUB_GET_USER ||
+                telnet_data.substate.connected == E_TELNET_STE_SUB_GET_PASSWORD) {
+                servers_wait_read(w, telnet_data.n_sd);
+            } else {
+                servers_wait_write(w, telnet_data.n_sd);
+            }
+            servers_wait_until(w, telnet_data.active, servers_get_timeout());
+            break;
+        case E_TELNET_STE_LOGGED_IN:
+            if ((uint8_t)(telnet_data.rxWindex + 1) != telnet_data.rxRindex) {
+                servers_wait_read(w, telnet_data.n_sd);
+            } else {
+                // the buffer is full, look again once the REPL had time to read it
+                servers_wait_timeout(w, SERVERS_CYCLE_TIME_MS);
+            }
+            servers_wait_until(w, telnet_data.active, servers_get_timeout());
+            break;
+        default:
+            // retry the listening socket after an idle period
+            break;
+    }
+}
+
 void telnet_tx_strn (const char *str, int len) {
     if (telnet_data.n_sd > 0 && telnet_data.state == E_TELNET_STE_LOGGED_IN && len > 0) {
-        telnet_send_with_retries(telnet_data.n_sd, str, len);
+        servers_send_all(telnet_data.n_sd, str, len, TELNET_TX_TIMEOUT_MS);
     }
 }
 
@@ -328,12 +353,12 @@ static bool telnet_create_socket (void) {
         result = setsockopt(telnet_data.sd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
 
         // bind the socket to a port number
+        memset(&sServerAddress, 0, sizeof(sServerAddress));
         sServerAddress.sin_family = AF_INET;
         sServerAddress.sin_addr.s_addr = INADDR_ANY;
-        sServerAddress.sin_len = sizeof(sServerAddress);
         sServerAddress.sin_port = htons(TELNET_PORT);
 
-        result = bind(telnet_data.sd, (const struct sockaddr *)&sServerAddress, sizeof(sServerAddress));
+        result |= bind(telnet_data.sd, (const struct sockaddr *)&sServerAddress, sizeof(sServerAddress));
 
         // start listening
         result |= listen (telnet_data.sd, TELNET_MAX_CLIENTS - 1);
@@ -348,8 +373,8 @@ static bool telnet_create_socket (void) {
 }
 
 static void telnet_wait_for_connection (void) {
-    socklen_t  in_addrSize;
     struct sockaddr_in  sClientAddress;
+    socklen_t  in_addrSize = sizeof(sClientAddress);
 
     // accepts a connection from a TCP client, if there is any, otherwise returns EAGAIN
     telnet_data.n_sd = accept(telnet_data.sd, (struct sockaddr *)&sClientAddress, (socklen_t *)&in_addrSize);
@@ -376,14 +401,13 @@ static void telnet_wait_for_connection (void) {
         // client connected, so go on
         telnet_data.rxWindex = 0;
         telnet_data.rxRindex = 0;
-        telnet_data.txRetries = 0;
         telnet_data.rxIncompleteLen = 0;
 
         telnet_data.state = E_TELNET_STE_CONNECTED;
         telnet_data.substate.connected = E_TELNET_STE_SUB_WELCOME;
         telnet_data.credentialsValid = true;
         telnet_data.loginRetries = 0;
-        telnet_data.timeout = 0;
+        telnet_data.active = mp_hal_ticks_ms();
         telnet_data.binary_mode = false;
     }
 }
@@ -396,9 +420,9 @@ static void telnet_send_and_proceed (void *data, int32_t Len, telnet_connected_s
 
 static telnet_result_t telnet_send_non_blocking (void *data, int32_t Len) {
     if (send(telnet_data.n_sd, data, Len, 0) > 0) {
-        telnet_data.txRetries = 0;
         return E_TELNET_RESULT_OK;
-    } else if ((TELNET_TX_RETRIES_MAX >= ++telnet_data.txRetries) && (errno == EAGAIN)) {
+    } else if (errno == EAGAIN) {
+        // a client that stops reading is dropped by the inactivity timeout
         return E_TELNET_RESULT_AGAIN;
     } else {
         // error
@@ -411,13 +435,13 @@ static telnet_result_t telnet_recv_text_non_blocking (void *buff, int32_t Maxlen
     *rxLen = recv(telnet_data.n_sd, buff, Maxlen, 0);
     // if there's data received, parse it
     if (*rxLen > 0) {
-        telnet_data.timeout = 0;
+        telnet_data.active = mp_hal_ticks_ms();
         telnet_parse_input (buff, rxLen);
         if (*rxLen > 0) {
             return E_TELNET_RESULT_OK;
         }
-    } else if (errno != EAGAIN) {
-        // error
+    } else if (*rxLen == 0 || errno != EAGAIN) {
+        // closed by the peer, or error
         telnet_reset();
         return E_TELNET_RESULT_FAILED;
     }
@@ -551,33 +575,6 @@ static void telnet_parse_input (uint8_t *str, int32_t *len) {
     }
 }
 
-static bool telnet_send_with_retries (int32_t sd, const void *pBuf, int32_t len) {
-    int32_t retries = 0;
-    uint32_t delay = TELNET_WAIT_TIME_MS;
-
-    do {
-        // make it blocking
-        uint32_t option = fcntl(sd, F_GETFL, 0);
-        option &= ~O_NONBLOCK;
-        fcntl(sd, F_SETFL, option);
-        if (send(sd, pBuf, len, 0) > 0) {
-            // make it non-blocking again
-            option |= O_NONBLOCK;
-            fcntl(sd, F_SETFL, option);
-            return true;
-        } else if (EAGAIN != errno) {
-            // make it non-blocking again
-            option |= O_NONBLOCK;
-            fcntl(sd, F_SETFL, option);
-            return false;
-        }
-        // start with the default delay and increment it on each retry
-        mp_hal_delay_ms(delay++);
-    } while (++retries <= TELNET_TX_RETRIES_MAX);
-
-    return false;
-}
-
 static void telnet_reset_buffer (void) {
     // erase any characters present in the current line
     memset (telnet_data.rxBuffer, '\b', TELNET_RX_BUFFER_SIZE / 2);
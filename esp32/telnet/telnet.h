@@ -10,11 +10,14 @@
 #ifndef TELNET_H_
 #define TELNET_H_
 
+#include "serverscore.h"
+
 /******************************************************************************
  DECLARE EXPORTED FUNCTIONS
  ******************************************************************************/
 extern void telnet_init (void);
 extern void telnet_run (void);
+extern void telnet_prepare_wait (servers_wait_t *w);
 extern void telnet_tx_strn (const char *str, int len);
 extern bool telnet_rx_any (void);
 extern int  telnet_rx_char (void);
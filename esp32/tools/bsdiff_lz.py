@@ -0,0 +1,137 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2020, Pycom Limited.
+#
+# This software is licensed under the GNU GPL version 3 or any
+# later version, with permitted additional terms. For more information
+# see the Pycom Licence v1.0 document supplied with this file, or
+# available at https://www.pycom.io/opensource/licensing
+#
+
+"""
+Convert a bsdiff patch (BSDIFF40, bzip2 blocks) to the BSDIFFLZ format the
+esp32 updater also applies, see esp32/bsdiff/bspatch_stream.h. The control,
+diff and extra blocks are kept, each one is re-coded as a sequence of frames:
+
+    u16 decoded length (1 to 4096)
+    u16 coded length, 0 when the frame is stored as it is
+    the LZ4 block
+
+Decoding those costs a fraction of bzip2 on the device, for a somewhat bigger
+patch.
+
+    python bsdiff_lz.py firmware.patch firmware.lzpatch
+"""
+
+import argparse
+import bz2
+import struct
+import sys
+
+FRAME_SIZE = 4096
+MIN_MATCH = 4
+# LZ4 block rules: the last 5 bytes are literals, no match starts in the
+# last 12 bytes
+LAST_LITERALS = 5
+MF_LIMIT = 12
+
+
+def offtin(buf):
+    y = struct.unpack('<Q', buf)[0]
+    if y & (1 << 63):
+        y = -(y & ~(1 << 63))
+    return y
+
+
+def lz_length(n):
+    out = bytearray()
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+    return out
+
+
+def lz_compress(data):
+    """Greedy LZ4 block compression of one frame."""
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    while i + MF_LIMIT < n:
+        key = data[i:i + MIN_MATCH]
+        ref = table.get(key, -1)
+        table[key] = i
+        if ref < 0 or i - ref > 0xFFFF:
+            i += 1
+            continue
+        length = MIN_MATCH
+        limit = n - LAST_LITERALS
+        while i + length < limit and data[ref + length] == data[i + length]:
+            length += 1
+        lit = i - anchor
+        ml = length - MIN_MATCH
+        out.append((min(lit, 15) << 4) | min(ml, 15))
+        if lit >= 15:
+            out += lz_length(lit - 15)
+        out += data[anchor:i]
+        out += struct.pack('<H', i - ref)
+        if ml >= 15:
+            out += lz_length(ml - 15)
+        i += length
+        anchor = i
+    lit = n - anchor
+    out.append(min(lit, 15) << 4)
+    if lit >= 15:
+        out += lz_length(lit - 15)
+    out += data[anchor:]
+    return out
+
+
+def lz_frames(data):
+    out = bytearray()
+    for i in range(0, len(data), FRAME_SIZE):
+        raw = data[i:i + FRAME_SIZE]
+        coded = lz_compress(raw)
+        if len(coded) >= len(raw):
+            out += struct.pack('<HH', len(raw), 0) + raw
+        else:
+            out += struct.pack('<HH', len(raw), len(coded)) + coded
+    return out
+
+
+def convert(patch):
+    if patch[:8] != b'BSDIFF40':
+        raise ValueError('not a BSDIFF40 patch')
+    ctrllen = offtin(patch[8:16])
+    datalen = offtin(patch[16:24])
+    ctrl = bz2.decompress(patch[32:32 + ctrllen])
+    diff = bz2.decompress(patch[32 + ctrllen:32 + ctrllen + datalen])
+    xtra = bz2.decompress(patch[32 + ctrllen + datalen:])
+    ctrl, diff, xtra = lz_frames(ctrl), lz_frames(diff), lz_frames(xtra)
+    header = b'BSDIFFLZ' + struct.pack('<QQ', len(ctrl), len(diff)) + patch[24:32]
+    return header + ctrl + diff + xtra
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a BSDIFF40 patch to BSDIFFLZ')
+    parser.add_argument('patch', help='the BSDIFF40 patch')
+    parser.add_argument('output', help='where to write the BSDIFFLZ patch')
+    args = parser.parse_args()
+
+    with open(args.patch, 'rb') as f:
+        patch = f.read()
+    try:
+        out = convert(patch)
+    except (ValueError, IOError, EOFError) as e:
+        print('%s: %s' % (args.patch, e))
+        return 1
+    with open(args.output, 'wb') as f:
+        f.write(out)
+    print('%s: %d bytes, %s: %d bytes' % (args.patch, len(patch), args.output, len(out)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2020, Pycom Limited.
+#
+# This software is licensed under the GNU GPL version 3 or any
+# later version, with permitted additional terms. For more information
+# see the Pycom Licence v1.0 document supplied with this file, or
+# available at https://www.pycom.io/opensource/licensing
+#
+
+"""
+Make the manifest of a resumable OTA update, see updater_start_resumable() in
+esp32/ftp/updater.h: the image size, the chunk size and the SHA-256 of each
+chunk. The device is given the manifest first:
+
+    offset = pycom.ota_start(manifest)
+    ... pycom.ota_write() the image from offset on ...
+    pycom.ota_finish()
+
+    python ota_manifest.py appimg.bin appimg.manifest [--chunk-size 65536]
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+SECTOR_SIZE = 4096
+
+
+def manifest(image, chunk_size):
+    out = bytearray(b'OTAM')
+    out += struct.pack('<II', len(image), chunk_size)
+    for i in range(0, len(image), chunk_size):
+        out += hashlib.sha256(image[i:i + chunk_size]).digest()
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Make the manifest of a resumable OTA update')
+    parser.add_argument('image', help='the application image')
+    parser.add_argument('output', help='where to write the manifest')
+    parser.add_argument('--chunk-size', type=int, default=64 * 1024,
+                        help='bytes checked at once, a multiple of %d (default 65536)' % SECTOR_SIZE)
+    args = parser.parse_args()
+
+    if args.chunk_size <= 0 or args.chunk_size % SECTOR_SIZE:
+        print('the chunk size must be a multiple of %d' % SECTOR_SIZE)
+        return 1
+    with open(args.image, 'rb') as f:
+        image = f.read()
+    if not image:
+        print('%s: empty' % args.image)
+        return 1
+    out = manifest(image, args.chunk_size)
+    with open(args.output, 'wb') as f:
+        f.write(out)
+    print('%s: %d bytes, %d chunks' % (args.image, len(image), (len(out) - 12) // 32))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef FRAMERING_H_
+#define FRAMERING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "py/ringbuf.h"
+
+/******************************************************************************
+ Variable length frames in a byte ring, written by one producer (a radio IRQ
+ handler) and read by one consumer (a socket), without locks. Several
+ consumers, threads reading or polling the same socket, take turns under a
+ lock of their own: the consumer side, framering_any() included, changes the
+ ring.
+
+ Each frame is stored as a 16-bit length, a tag byte and the data. A frame is
+ published in one go, so the consumer never sees half of it. The consumer may
+ read a frame in several parts, what is left of it stays in the ring.
+ ******************************************************************************/
+
+#define FRAMERING_HEADER_SIZE               (3)
+
+typedef struct {
+    ringbuf_t rb;
+    volatile uint32_t dropped;      // written by the producer: frames lost, ring full
+    uint16_t flush_at;              // written by the producer: iput when a flush was requested
+    volatile uint16_t flush_seq;    // written by the producer: incremented on each flush request
+    uint16_t flush_seen;            // consumer: last flush request handled
+    uint16_t left;                  // consumer: bytes of the current frame not read yet
+    uint8_t tag;                    // consumer: tag of the current frame
+} framering_t;
+
+// Static initialization:
+// uint8_t buf_array[N];
+// framering_t ring = { .rb = { buf_array, sizeof(buf_array) } };
+
+/******************************************************************************
+ Producer side
+ ******************************************************************************/
+
+// Returns false, and counts the frame as dropped, if it does not fit
+static inline bool framering_put(framering_t *f, uint8_t tag, const uint8_t *data, uint16_t len) {
+    uint8_t hdr[FRAMERING_HEADER_SIZE] = { len & 0xFF, len >> 8, tag };
+
+    if (ringbuf_free(&f->rb) < FRAMERING_HEADER_SIZE + (size_t)len) {
+        f->dropped++;
+        return false;
+    }
+    ringbuf_write_at(&f->rb, 0, hdr, FRAMERING_HEADER_SIZE);
+    ringbuf_write_at(&f->rb, FRAMERING_HEADER_SIZE, data, len);
+    ringbuf_put_commit(&f->rb, FRAMERING_HEADER_SIZE + len);
+    return true;
+}
+
+// Discard the frames put so far, the consumer drops them on its next access
+static inline void framering_flush_from_producer(framering_t *f) {
+    __atomic_store_n(&f->flush_at, f->rb.iput, __ATOMIC_RELAXED);
+    __atomic_store_n(&f->flush_seq, f->flush_seq + 1, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ Consumer side
+ ******************************************************************************/
+
+static inline void framering_sync(framering_t *f) {
+    uint16_t seq = __atomic_load_n(&f->flush_seq, __ATOMIC_ACQUIRE);
+    if (seq != f->flush_seen) {
+        uint16_t at = __atomic_load_n(&f->flush_at, __ATOMIC_RELAXED);
+        size_t skip = (f->rb.size + at - f->rb.iget) % f->rb.size;
+        f->flush_seen = seq;
+        // unless the frames put after the request are already being read
+        if (skip <= ringbuf_avail(&f->rb)) {
+            ringbuf_get_commit(&f->rb, skip);
+            f->left = 0;
+        }
+    }
+}
+
+static inline bool framering_any(framering_t *f) {
+    framering_sync(f);
+    return (f->left > 0) || (ringbuf_avail(&f->rb) > 0);
+}
+
+// Read up to len bytes of the current frame, or of the next one if the current
+// one has been read entirely. Returns the number of bytes read (0 for an empty
+// frame) or -1 if there is no frame.
+static inline int framering_read(framering_t *f, uint8_t *buf, size_t len, uint8_t *tag) {
+    framering_sync(f);
+    if (f->left == 0) {
+        uint8_t hdr[FRAMERING_HEADER_SIZE];
+        if (ringbuf_get_bytes(&f->rb, hdr, FRAMERING_HEADER_SIZE) != 0) {
+            return -1;
+        }
+        f->left = hdr[0] | (hdr[1] << 8);
+        f->tag = hdr[2];
+    }
+    if (len > f->left) {
+        len = f->left;
+    }
+    ringbuf_read_at(&f->rb, 0, buf, len);
+    ringbuf_get_commit(&f->rb, len);
+    f->left -= len;
+    if (tag != NULL) {
+        *tag = f->tag;
+    }
+    return len;
+}
+
+// Drop all frames, including what is left of the current one
+static inline void framering_flush(framering_t *f) {
+    framering_sync(f);
+    ringbuf_get_commit(&f->rb, ringbuf_avail(&f->rb));
+    f->left = 0;
+}
+
+#endif /* FRAMERING_H_ */
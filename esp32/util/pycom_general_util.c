@@ -44,7 +44,7 @@ char *pycom_util_read_file (const char *file_path, vstr_t *vstr) {
 
             lfs_file_t fp;
 
-            xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+            littlefs_lock(&littlefs->lock);
 
             int res = lfs_file_open(&littlefs->lfs, &fp, path_relative, LFS_O_RDONLY);
             if(res < LFS_ERR_OK) {
@@ -69,7 +69,7 @@ char *pycom_util_read_file (const char *file_path, vstr_t *vstr) {
                 lfs_file_close(&littlefs->lfs, &fp);
             }
 
-            xSemaphoreGive(littlefs->mutex);
+            littlefs_unlock(&littlefs->lock);
         }
     }
     else
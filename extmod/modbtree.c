@@ -44,6 +44,9 @@ typedef struct _mp_obj_btree_t {
     mp_obj_t end_key;
     #define FLAG_END_KEY_INCL 1
     #define FLAG_DESC 2
+    // Yield memoryviews into the page cache instead of bytes copies. They
+    // are only valid until the next iteration step or database operation.
+    #define FLAG_NOCOPY 4
     #define FLAG_ITER_TYPE_MASK 0xc0
     #define FLAG_ITER_KEYS   0x40
     #define FLAG_ITER_VALUES 0x80
@@ -118,6 +121,40 @@ STATIC mp_obj_t btree_get(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(btree_get_obj, 2, 3, btree_get);
 
+// Bulk load from an iterable of (key, value) pairs, which must be in
+// strictly ascending key order. Sorted input always lands on the rightmost
+// leaf, so each put takes the library's fast path (no descent from the root)
+// and the right-edge splits leave full pages behind, giving a bottom-up
+// build without per-item method call overhead.
+STATIC mp_obj_t btree_load(mp_obj_t self_in, mp_obj_t iterable) {
+    mp_obj_btree_t *self = MP_OBJ_TO_PTR(self_in);
+    BTREE *t = self->db->internal;
+    mp_obj_iter_buf_t iter_buf;
+    mp_obj_t iter = mp_getiter(iterable, &iter_buf);
+    mp_obj_t item;
+    mp_obj_t prev_key = MP_OBJ_NULL;
+    DBT prev = {NULL, 0};
+    mp_int_t n = 0;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        mp_obj_t *kv;
+        mp_obj_get_array_fixed_n(item, 2, &kv);
+        DBT key, val;
+        key.data = (void*)mp_obj_str_get_data(kv[0], &key.size);
+        val.data = (void*)mp_obj_str_get_data(kv[1], &val.size);
+        if (prev_key != MP_OBJ_NULL && t->bt_cmp(&prev, &key) >= 0) {
+            mp_raise_ValueError("keys not sorted");
+        }
+        int res = __bt_put(self->db, &key, &val, 0);
+        CHECK_ERROR(res);
+        // keep the key object (and so its data) alive for the next compare
+        prev_key = kv[0];
+        prev = key;
+        n++;
+    }
+    return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(btree_load_obj, btree_load);
+
 STATIC mp_obj_t btree_seq(size_t n_args, const mp_obj_t *args) {
     mp_obj_btree_t *self = MP_OBJ_TO_PTR(args[0]);
     int flags = MP_OBJ_SMALL_INT_VALUE(args[1]);
@@ -190,6 +227,14 @@ STATIC mp_obj_t btree_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf) {
     return self_in;
 }
 
+STATIC mp_obj_t btree_dbt_bytes(const DBT *dbt) {
+    return mp_obj_new_bytes(dbt->data, dbt->size);
+}
+
+STATIC mp_obj_t btree_dbt_view(const DBT *dbt) {
+    return mp_obj_new_memoryview('B', dbt->size, dbt->data);
+}
+
 STATIC mp_obj_t btree_iternext(mp_obj_t self_in) {
     mp_obj_btree_t *self = MP_OBJ_TO_PTR(self_in);
     DBT key, val;
@@ -231,16 +276,21 @@ STATIC mp_obj_t btree_iternext(mp_obj_t self_in) {
         }
     }
 
+    mp_obj_t (*new_obj)(const DBT *dbt) = btree_dbt_bytes;
+    if (self->flags & FLAG_NOCOPY) {
+        new_obj = btree_dbt_view;
+    }
+
     switch (self->flags & FLAG_ITER_TYPE_MASK) {
         case FLAG_ITER_KEYS:
-            return mp_obj_new_bytes(key.data, key.size);
+            return new_obj(&key);
         case FLAG_ITER_VALUES:
-            return mp_obj_new_bytes(val.data, val.size);
+            return new_obj(&val);
         default: {
             mp_obj_t pair_o = mp_obj_new_tuple(2, NULL);
             mp_obj_tuple_t *pair = MP_OBJ_TO_PTR(pair_o);
-            pair->items[0] = mp_obj_new_bytes(key.data, key.size);
-            pair->items[1] = mp_obj_new_bytes(val.data, val.size);
+            pair->items[0] = new_obj(&key);
+            pair->items[1] = new_obj(&val);
             return pair_o;
         }
     }
@@ -300,6 +350,7 @@ STATIC const mp_rom_map_elem_t btree_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&btree_flush_obj) },
     { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&btree_get_obj) },
     { MP_ROM_QSTR(MP_QSTR_put), MP_ROM_PTR(&btree_put_obj) },
+    { MP_ROM_QSTR(MP_QSTR_load), MP_ROM_PTR(&btree_load_obj) },
     { MP_ROM_QSTR(MP_QSTR_seq), MP_ROM_PTR(&btree_seq_obj) },
     { MP_ROM_QSTR(MP_QSTR_keys), MP_ROM_PTR(&btree_keys_obj) },
     { MP_ROM_QSTR(MP_QSTR_values), MP_ROM_PTR(&btree_values_obj) },
@@ -333,6 +384,7 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         { MP_QSTR_cachesize, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
         { MP_QSTR_pagesize, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
         { MP_QSTR_minkeypage, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_cachepages, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
     };
 
     // Make sure we got a stream object
@@ -343,6 +395,7 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         mp_arg_val_t cachesize;
         mp_arg_val_t pagesize;
         mp_arg_val_t minkeypage;
+        mp_arg_val_t cachepages;
     } args;
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args,
         MP_ARRAY_SIZE(allowed_args), allowed_args, (mp_arg_val_t*)&args);
@@ -351,6 +404,13 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
     openinfo.cachesize = args.cachesize.u_int;
     openinfo.psize = args.pagesize.u_int;
     openinfo.minkeypage = args.minkeypage.u_int;
+    if (args.cachepages.u_int != 0) {
+        // Cache size given in pages, which needs a known page size
+        if (openinfo.psize == 0 || openinfo.cachesize != 0) {
+            mp_raise_ValueError("cachepages needs pagesize and no cachesize");
+        }
+        openinfo.cachesize = args.cachepages.u_int * openinfo.psize;
+    }
 
     DB *db = __bt_open(MP_OBJ_TO_PTR(pos_args[0]), &btree_stream_fvtable, &openinfo, /*dflags*/0);
     if (db == NULL) {
@@ -365,6 +425,7 @@ STATIC const mp_rom_map_elem_t mp_module_btree_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_open), MP_ROM_PTR(&mod_btree_open_obj) },
     { MP_ROM_QSTR(MP_QSTR_INCL), MP_ROM_INT(FLAG_END_KEY_INCL) },
     { MP_ROM_QSTR(MP_QSTR_DESC), MP_ROM_INT(FLAG_DESC) },
+    { MP_ROM_QSTR(MP_QSTR_NOCOPY), MP_ROM_INT(FLAG_NOCOPY) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_btree_globals, mp_module_btree_globals_table);
@@ -39,6 +39,8 @@ typedef struct _mp_obj_framebuf_t {
     void *buf;
     uint16_t width, height, stride;
     uint8_t format;
+    // region modified since the last call to dirty(), empty if dirty_x1 == 0
+    uint16_t dirty_x0, dirty_y0, dirty_x1, dirty_y1;
 } mp_obj_framebuf_t;
 
 typedef void (*setpixel_t)(const mp_obj_framebuf_t*, int, int, uint32_t);
@@ -60,6 +62,24 @@ typedef struct _mp_framebuf_p_t {
 #define FRAMEBUF_MHLSB    (3)
 #define FRAMEBUF_MHMSB    (4)
 
+// Fill the columns of byte b0 selected by m0, bytes b0+1..b1-1 and the columns
+// of byte b1 selected by m1, of h rows advance bytes apart. Used by the packed
+// horizontal formats, the caller works out the masks for its bit order.
+STATIC void fill_rows_packed(uint8_t *row, int advance, int h, int b0, int b1, uint8_t m0, uint8_t m1, uint8_t fill) {
+    if (b0 == b1) {
+        m0 &= m1;
+        for (; h; --h, row += advance) {
+            row[b0] = (row[b0] & ~m0) | (fill & m0);
+        }
+        return;
+    }
+    for (; h; --h, row += advance) {
+        row[b0] = (row[b0] & ~m0) | (fill & m0);
+        memset(row + b0 + 1, fill, b1 - b0 - 1);
+        row[b1] = (row[b1] & ~m1) | (fill & m1);
+    }
+}
+
 // Functions for MHLSB and MHMSB
 
 STATIC void mono_horiz_setpixel(const mp_obj_framebuf_t *fb, int x, int y, uint32_t col) {
@@ -75,17 +95,19 @@ STATIC uint32_t mono_horiz_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void mono_horiz_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    int reverse = fb->format == FRAMEBUF_MHMSB;
     int advance = fb->stride >> 3;
-    while (w--) {
-        uint8_t *b = &((uint8_t*)fb->buf)[(x >> 3) + y * advance];
-        int offset = reverse ?  x & 7 : 7 - (x & 7);
-        for (int hh = h; hh; --hh) {
-            *b = (*b & ~(0x01 << offset)) | ((col != 0) << offset);
-            b += advance;
-        }
-        ++x;
+    int first = x & 7;
+    int last = (x + w - 1) & 7;
+    uint8_t m0, m1;
+    if (fb->format == FRAMEBUF_MHMSB) {
+        m0 = 0xff << first;
+        m1 = 0xff >> (7 - last);
+    } else {
+        m0 = 0xff >> first;
+        m1 = 0xff << (7 - last);
     }
+    fill_rows_packed((uint8_t*)fb->buf + y * advance, advance, h,
+        x >> 3, (x + w - 1) >> 3, m0, m1, col ? 0xff : 0x00);
 }
 
 // Functions for MVLSB format
@@ -101,14 +123,23 @@ STATIC uint32_t mvlsb_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void mvlsb_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    while (h--) {
+    uint8_t fill = col ? 0xff : 0x00;
+    int yend = y + h;
+    // work a band of 8 rows (one byte per column) at a time
+    while (y < yend) {
+        int band = y & ~7;
+        int band_end = MIN(band + 8, yend);
+        uint8_t mask = (0xff << (y - band)) & (0xff >> (band + 8 - band_end));
         uint8_t *b = &((uint8_t*)fb->buf)[(y >> 3) * fb->stride + x];
-        uint8_t offset = y & 0x07;
-        for (int ww = w; ww; --ww) {
-            *b = (*b & ~(0x01 << offset)) | ((col != 0) << offset);
-            ++b;
+        if (mask == 0xff) {
+            memset(b, fill, w);
+        } else {
+            for (int ww = w; ww; --ww) {
+                *b = (*b & ~mask) | (fill & mask);
+                ++b;
+            }
         }
-        ++y;
+        y = band_end;
     }
 }
 
@@ -124,11 +155,22 @@ STATIC uint32_t rgb565_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 
 STATIC void rgb565_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
     uint16_t *b = &((uint16_t*)fb->buf)[x + y * fb->stride];
-    while (h--) {
-        for (int ww = w; ww; --ww) {
-            *b++ = col;
+    if ((col & 0xff) == ((col >> 8) & 0xff)) {
+        // both bytes equal (eg black, white), so memset does it
+        for (; h; --h, b += fb->stride) {
+            memset(b, col, w * 2);
         }
-        b += fb->stride - w;
+        return;
+    }
+    // fill the first row, then copy it to the others
+    uint16_t *first = b;
+    for (int ww = w; ww; --ww) {
+        *b++ = col;
+    }
+    b = first;
+    while (--h > 0) {
+        b += fb->stride;
+        memcpy(b, first, w * 2);
     }
 }
 
@@ -149,11 +191,11 @@ STATIC uint32_t gs2_hmsb_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void gs2_hmsb_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    for (int xx=x; xx < x+w; xx++) {
-        for (int yy=y; yy < y+h; yy++) {
-            gs2_hmsb_setpixel(fb, xx, yy, col);
-        }
-    }
+    int advance = fb->stride >> 2;
+    uint8_t m0 = 0xff << ((x & 3) << 1);
+    uint8_t m1 = 0xff >> ((3 - ((x + w - 1) & 3)) << 1);
+    fill_rows_packed((uint8_t*)fb->buf + y * advance, advance, h,
+        x >> 2, (x + w - 1) >> 2, m0, m1, (col & 0x3) * 0x55);
 }
 
 // Functions for GS4_HMSB format
@@ -244,7 +286,39 @@ static inline uint32_t getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
     return formats[fb->format].getpixel(fb, x, y);
 }
 
-STATIC void fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
+// Bits per pixel of the formats that pack pixels along rows, 0 for MVLSB
+STATIC int horiz_bpp(const mp_obj_framebuf_t *fb) {
+    switch (fb->format) {
+        case FRAMEBUF_RGB565: return 16;
+        case FRAMEBUF_GS8: return 8;
+        case FRAMEBUF_GS4_HMSB: return 4;
+        case FRAMEBUF_GS2_HMSB: return 2;
+        case FRAMEBUF_MHLSB:
+        case FRAMEBUF_MHMSB: return 1;
+        default: return 0;
+    }
+}
+
+// Address of the byte holding pixel (x, y) of a horizontal format
+static inline uint8_t *horiz_addr(const mp_obj_framebuf_t *fb, int bpp, int x, int y) {
+    return (uint8_t*)fb->buf + (((size_t)y * fb->stride + x) * bpp >> 3);
+}
+
+STATIC void mark_dirty(mp_obj_framebuf_t *fb, int x, int y, int xend, int yend) {
+    if (fb->dirty_x1 == 0) {
+        fb->dirty_x0 = x;
+        fb->dirty_y0 = y;
+        fb->dirty_x1 = xend;
+        fb->dirty_y1 = yend;
+    } else {
+        fb->dirty_x0 = MIN(fb->dirty_x0, x);
+        fb->dirty_y0 = MIN(fb->dirty_y0, y);
+        fb->dirty_x1 = MAX(fb->dirty_x1, xend);
+        fb->dirty_y1 = MAX(fb->dirty_y1, yend);
+    }
+}
+
+STATIC void fill_rect(mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
     if (h < 1 || w < 1 || x + w <= 0 || y + h <= 0 || y >= fb->height || x >= fb->width) {
         // No operation needed.
         return;
@@ -257,6 +331,7 @@ STATIC void fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, u
     y = MAX(y, 0);
 
     formats[fb->format].fill_rect(fb, x, y, xend - x, yend - y, col);
+    mark_dirty(fb, x, y, xend, yend);
 }
 
 STATIC mp_obj_t framebuf_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
@@ -273,6 +348,7 @@ STATIC mp_obj_t framebuf_make_new(const mp_obj_type_t *type, size_t n_args, size
     o->width = mp_obj_get_int(args[1]);
     o->height = mp_obj_get_int(args[2]);
     o->format = mp_obj_get_int(args[3]);
+    o->dirty_x1 = 0;
     if (n_args >= 5) {
         o->stride = mp_obj_get_int(args[4]);
     } else {
@@ -315,6 +391,7 @@ STATIC mp_obj_t framebuf_fill(mp_obj_t self_in, mp_obj_t col_in) {
     mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
     mp_int_t col = mp_obj_get_int(col_in);
     formats[self->format].fill_rect(self, 0, 0, self->width, self->height, col);
+    mark_dirty(self, 0, 0, self->width, self->height);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(framebuf_fill_obj, framebuf_fill);
@@ -346,6 +423,7 @@ STATIC mp_obj_t framebuf_pixel(size_t n_args, const mp_obj_t *args) {
         } else {
             // set
             setpixel(self, x, y, mp_obj_get_int(args[3]));
+            mark_dirty(self, x, y, x + 1, y + 1);
         }
     }
     return mp_const_none;
@@ -410,6 +488,7 @@ STATIC mp_obj_t framebuf_line(size_t n_args, const mp_obj_t *args) {
     mp_int_t x2 = mp_obj_get_int(args[3]);
     mp_int_t y2 = mp_obj_get_int(args[4]);
     mp_int_t col = mp_obj_get_int(args[5]);
+    mp_int_t x_start = x1, y_start = y1;
 
     mp_int_t dx = x2 - x1;
     mp_int_t sx;
@@ -463,10 +542,27 @@ STATIC mp_obj_t framebuf_line(size_t n_args, const mp_obj_t *args) {
         setpixel(self, x2, y2, col);
     }
 
+    // the line lies within the box spanned by its ends
+    mp_int_t bx0 = MAX(0, MIN(x_start, x2));
+    mp_int_t by0 = MAX(0, MIN(y_start, y2));
+    mp_int_t bx1 = MIN(self->width, MAX(x_start, x2) + 1);
+    mp_int_t by1 = MIN(self->height, MAX(y_start, y2) + 1);
+    if (bx0 < bx1 && by0 < by1) {
+        mark_dirty(self, bx0, by0, bx1, by1);
+    }
+
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_line_obj, 6, 6, framebuf_line);
 
+// Whether the memory of two framebuffers may overlap (errs on yes)
+STATIC bool framebuf_overlap(const mp_obj_framebuf_t *a, const mp_obj_framebuf_t *b) {
+    const uint8_t *a0 = a->buf, *b0 = b->buf;
+    const uint8_t *a1 = a0 + (size_t)a->stride * a->height * 2;
+    const uint8_t *b1 = b0 + (size_t)b->stride * b->height * 2;
+    return a0 < b1 && b0 < a1;
+}
+
 STATIC mp_obj_t framebuf_blit(size_t n_args, const mp_obj_t *args) {
     mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(args[0]);
     mp_obj_framebuf_t *source = MP_OBJ_TO_PTR(args[1]);
@@ -495,6 +591,34 @@ STATIC mp_obj_t framebuf_blit(size_t n_args, const mp_obj_t *args) {
     int x0end = MIN(self->width, x + source->width);
     int y0end = MIN(self->height, y + source->height);
 
+    mark_dirty(self, x0, y0, x0end, y0end);
+
+    // Without a transparent colour, copy whole bytes where the formats match
+    // and the pixel positions line up with byte boundaries. Overlapping
+    // buffers keep the pixel-by-pixel order of the generic loop.
+    if (key == -1 && source->format == self->format && !framebuf_overlap(self, source)) {
+        int bpp = horiz_bpp(self);
+        int w = x0end - x0;
+        if (bpp != 0 && ((x0 * bpp) & 7) == 0 && ((x1 * bpp) & 7) == 0) {
+            size_t n = (size_t)w * bpp >> 3;
+            if (n != 0) {
+                for (int yy = 0; yy < y0end - y0; ++yy) {
+                    memcpy(horiz_addr(self, bpp, x0, y0 + yy), horiz_addr(source, bpp, x1, y1 + yy), n);
+                }
+                // remaining pixels of a partial last byte
+                int done = (n << 3) / bpp;
+                x0 += done;
+                x1 += done;
+            }
+        } else if (bpp == 0 && (y0 & 7) == 0 && (y1 & 7) == 0) {
+            // MVLSB: each byte is a column of 8 rows
+            for (; y0 + 8 <= y0end; y0 += 8, y1 += 8) {
+                memcpy((uint8_t*)self->buf + (y0 >> 3) * self->stride + x0,
+                    (uint8_t*)source->buf + (y1 >> 3) * source->stride + x1, w);
+            }
+        }
+    }
+
     for (; y0 < y0end; ++y0) {
         int cx1 = x1;
         for (int cx0 = x0; cx0 < x0end; ++cx0) {
@@ -514,6 +638,47 @@ STATIC mp_obj_t framebuf_scroll(mp_obj_t self_in, mp_obj_t xstep_in, mp_obj_t ys
     mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
     mp_int_t xstep = mp_obj_get_int(xstep_in);
     mp_int_t ystep = mp_obj_get_int(ystep_in);
+    if (xstep >= self->width || -xstep >= self->width || ystep >= self->height || -ystep >= self->height) {
+        // Everything scrolled out, nothing left to move
+        return mp_const_none;
+    }
+    mark_dirty(self, 0, 0, self->width, self->height);
+
+    // Move whole rows (or MVLSB bands) with memmove when the shifted
+    // columns start and end on byte boundaries. Rows are visited in the
+    // same order as the generic loop so the source is read before it's
+    // overwritten.
+    int bpp = horiz_bpp(self);
+    int n = self->width - (xstep < 0 ? -xstep : xstep);
+    int dst_x = MAX(xstep, 0);
+    int src_x = MAX(-xstep, 0);
+    if (bpp != 0 && ((dst_x * bpp) & 7) == 0 && ((src_x * bpp) & 7) == 0 && ((n * bpp) & 7) == 0) {
+        if (ystep < 0) {
+            for (int yy = 0; yy < self->height + ystep; ++yy) {
+                memmove(horiz_addr(self, bpp, dst_x, yy), horiz_addr(self, bpp, src_x, yy - ystep), n * bpp >> 3);
+            }
+        } else {
+            for (int yy = self->height - 1; yy >= ystep; --yy) {
+                memmove(horiz_addr(self, bpp, dst_x, yy), horiz_addr(self, bpp, src_x, yy - ystep), n * bpp >> 3);
+            }
+        }
+        return mp_const_none;
+    } else if (bpp == 0 && (ystep & 7) == 0 && (self->height & 7) == 0) {
+        int bands = self->height >> 3;
+        int bstep = ystep / 8;
+        uint8_t *buf = self->buf;
+        if (bstep < 0) {
+            for (int b = 0; b < bands + bstep; ++b) {
+                memmove(buf + b * self->stride + dst_x, buf + (b - bstep) * self->stride + src_x, n);
+            }
+        } else {
+            for (int b = bands - 1; b >= bstep; --b) {
+                memmove(buf + b * self->stride + dst_x, buf + (b - bstep) * self->stride + src_x, n);
+            }
+        }
+        return mp_const_none;
+    }
+
     int sx, y, xend, yend, dx, dy;
     if (xstep < 0) {
         sx = 0;
@@ -553,6 +718,20 @@ STATIC mp_obj_t framebuf_text(size_t n_args, const mp_obj_t *args) {
         col = mp_obj_get_int(args[4]);
     }
 
+    int bx0 = MAX(0, x0);
+    int by0 = MAX(0, y0);
+    int bx1 = MIN(self->width, x0 + 8 * (mp_int_t)strlen(str));
+    int by1 = MIN(self->height, y0 + 8);
+    if (bx0 >= bx1 || by0 >= by1) {
+        return mp_const_none;
+    }
+    mark_dirty(self, bx0, by0, bx1, by1);
+
+    // For MVLSB with the text on a band boundary each font column is
+    // exactly one byte of the buffer
+    bool direct = self->format == FRAMEBUF_MVLSB && (y0 & 7) == 0 && y0 >= 0 && y0 + 8 <= self->height;
+    uint8_t *band = direct ? (uint8_t*)self->buf + (y0 >> 3) * self->stride : NULL;
+
     // loop over chars
     for (; *str; ++str) {
         // get char and make sure its in range of font
@@ -564,7 +743,10 @@ STATIC mp_obj_t framebuf_text(size_t n_args, const mp_obj_t *args) {
         const uint8_t *chr_data = &font_petme128_8x8[(chr - 32) * 8];
         // loop over char data
         for (int j = 0; j < 8; j++, x0++) {
-            if (0 <= x0 && x0 < self->width) { // clip x
+            if (direct && 0 <= x0 && x0 < self->width) {
+                uint8_t *b = band + x0;
+                *b = col ? (*b | chr_data[j]) : (*b & ~chr_data[j]);
+            } else if (0 <= x0 && x0 < self->width) { // clip x
                 uint vline_data = chr_data[j]; // each byte is a column of 8 pixels, LSB at top
                 for (int y = y0; vline_data; vline_data >>= 1, y++) { // scan over vertical column
                     if (vline_data & 1) { // only draw if pixel set
@@ -580,6 +762,24 @@ STATIC mp_obj_t framebuf_text(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_text_obj, 4, 5, framebuf_text);
 
+// Return the (x, y, w, h) region drawn to since the last call, or None,
+// and start tracking afresh. Writes made directly to the buffer are not seen.
+STATIC mp_obj_t framebuf_dirty(mp_obj_t self_in) {
+    mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->dirty_x1 == 0) {
+        return mp_const_none;
+    }
+    mp_obj_t tuple[4] = {
+        MP_OBJ_NEW_SMALL_INT(self->dirty_x0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_y0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_x1 - self->dirty_x0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_y1 - self->dirty_y0),
+    };
+    self->dirty_x1 = 0;
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(framebuf_dirty_obj, framebuf_dirty);
+
 STATIC const mp_rom_map_elem_t framebuf_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_fill), MP_ROM_PTR(&framebuf_fill_obj) },
     { MP_ROM_QSTR(MP_QSTR_fill_rect), MP_ROM_PTR(&framebuf_fill_rect_obj) },
@@ -591,6 +791,7 @@ STATIC const mp_rom_map_elem_t framebuf_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_blit), MP_ROM_PTR(&framebuf_blit_obj) },
     { MP_ROM_QSTR(MP_QSTR_scroll), MP_ROM_PTR(&framebuf_scroll_obj) },
     { MP_ROM_QSTR(MP_QSTR_text), MP_ROM_PTR(&framebuf_text_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dirty), MP_ROM_PTR(&framebuf_dirty_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(framebuf_locals_dict, framebuf_locals_dict_table);
 
@@ -614,6 +815,7 @@ STATIC mp_obj_t legacy_framebuffer1(size_t n_args, const mp_obj_t *args) {
     o->width = mp_obj_get_int(args[1]);
     o->height = mp_obj_get_int(args[2]);
     o->format = FRAMEBUF_MVLSB;
+    o->dirty_x1 = 0;
     if (n_args >= 4) {
         o->stride = mp_obj_get_int(args[3]);
     } else {
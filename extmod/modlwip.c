@@ -294,6 +294,9 @@ typedef struct _lwip_socket_obj_t {
         } connection;
     } incoming;
     mp_obj_t callback;
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    mp_stream_poll_notify_t *notify;
+    #endif
     byte peer[4];
     mp_uint_t peer_port;
     mp_uint_t timeout;
@@ -360,6 +363,16 @@ static inline void exec_user_callback(lwip_socket_obj_t *socket) {
     }
 }
 
+// Tell a uselect.poll object waiting on this socket that its state changed
+static inline void lwip_socket_poll_signal(lwip_socket_obj_t *socket, mp_uint_t events) {
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    mp_stream_poll_signal(socket->notify, events);
+    #else
+    (void)socket;
+    (void)events;
+    #endif
+}
+
 // Callback for incoming UDP packets. We simply stash the packet and the source address,
 // in case we need it for recvfrom.
 #if LWIP_VERSION_MAJOR < 2
@@ -377,6 +390,7 @@ STATIC void _lwip_udp_incoming(void *arg, struct udp_pcb *upcb, struct pbuf *p,
         socket->incoming.pbuf = p;
         socket->peer_port = (mp_uint_t)port;
         memcpy(&socket->peer, addr, sizeof(socket->peer));
+        lwip_socket_poll_signal(socket, MP_STREAM_POLL_RD);
     }
 }
 
@@ -390,6 +404,7 @@ STATIC void _lwip_tcp_error(void *arg, err_t err) {
     socket->state = err;
     // If we got here, the lwIP stack either has deallocated or will deallocate the pcb.
     socket->pcb.tcp = NULL;
+    lwip_socket_poll_signal(socket, MP_STREAM_POLL_RD | MP_STREAM_POLL_WR | MP_STREAM_POLL_HUP | MP_STREAM_POLL_ERR);
 }
 
 // Callback for tcp connection requests. Error code err is unused. (See tcp.h)
@@ -397,9 +412,21 @@ STATIC err_t _lwip_tcp_connected(void *arg, struct tcp_pcb *tpcb, err_t err) {
     lwip_socket_obj_t *socket = (lwip_socket_obj_t*)arg;
 
     socket->state = STATE_CONNECTED;
+    lwip_socket_poll_signal(socket, MP_STREAM_POLL_WR);
     return ERR_OK;
 }
 
+// Callback for acknowledged tcp data, which frees space in the send buffer.
+// Only needed to wake up a poll waiting for the socket to become writable.
+#if MICROPY_STREAMS_POLL_NOTIFY
+STATIC err_t _lwip_tcp_sent(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+    lwip_socket_obj_t *socket = (lwip_socket_obj_t*)arg;
+
+    lwip_socket_poll_signal(socket, MP_STREAM_POLL_WR);
+    return ERR_OK;
+}
+#endif
+
 // Handle errors (eg connection aborted) on TCP PCBs that have been put on the
 // accept queue but are not yet actually accepted.
 STATIC void _lwip_tcp_err_unaccepted(void *arg, err_t err) {
@@ -482,6 +509,7 @@ STATIC err_t _lwip_tcp_accept(void *arg, struct tcp_pcb *newpcb, err_t err) {
             // is idle.
             tcp_poll(newpcb, _lwip_tcp_accept_finished, 1);
         }
+        lwip_socket_poll_signal(socket, MP_STREAM_POLL_RD);
 
         // Set the error callback to handle the case of a dropped connection before we
         // have a chance to take it off the accept queue.
@@ -506,6 +534,7 @@ STATIC err_t _lwip_tcp_recv(void *arg, struct tcp_pcb *tcpb, struct pbuf *p, err
         // Other side has closed connection.
         DEBUG_printf("_lwip_tcp_recv[%p]: other side closed connection\n", socket);
         socket->state = STATE_PEER_CLOSED;
+        lwip_socket_poll_signal(socket, MP_STREAM_POLL_RD | MP_STREAM_POLL_WR);
         exec_user_callback(socket);
         return ERR_OK;
     }
@@ -520,6 +549,7 @@ STATIC err_t _lwip_tcp_recv(void *arg, struct tcp_pcb *tcpb, struct pbuf *p, err
         #endif
     }
 
+    lwip_socket_poll_signal(socket, MP_STREAM_POLL_RD);
     exec_user_callback(socket);
 
     return ERR_OK;
@@ -774,6 +804,9 @@ STATIC mp_obj_t lwip_socket_make_new(const mp_obj_type_t *type, size_t n_args, s
     socket->domain = MOD_NETWORK_AF_INET;
     socket->type = MOD_NETWORK_SOCK_STREAM;
     socket->callback = MP_OBJ_NULL;
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    socket->notify = NULL;
+    #endif
     if (n_args >= 1) {
         socket->domain = mp_obj_get_int(args[0]);
         if (n_args >= 2) {
@@ -805,6 +838,9 @@ STATIC mp_obj_t lwip_socket_make_new(const mp_obj_type_t *type, size_t n_args, s
             tcp_arg(socket->pcb.tcp, (void*)socket);
             // Register our error callback.
             tcp_err(socket->pcb.tcp, _lwip_tcp_error);
+            #if MICROPY_STREAMS_POLL_NOTIFY
+            tcp_sent(socket->pcb.tcp, _lwip_tcp_sent);
+            #endif
             break;
         }
         case MOD_NETWORK_SOCK_DGRAM: {
@@ -960,6 +996,10 @@ STATIC mp_obj_t lwip_socket_accept(mp_obj_t self_in) {
     tcp_arg(socket2->pcb.tcp, (void*)socket2);
     tcp_err(socket2->pcb.tcp, _lwip_tcp_error);
     tcp_recv(socket2->pcb.tcp, _lwip_tcp_recv);
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    socket2->notify = NULL;
+    tcp_sent(socket2->pcb.tcp, _lwip_tcp_sent);
+    #endif
 
     tcp_accepted(listener);
 
@@ -1415,6 +1455,9 @@ STATIC mp_uint_t lwip_socket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_
         tcp_arg(socket->pcb.tcp, NULL);
         tcp_err(socket->pcb.tcp, NULL);
         tcp_recv(socket->pcb.tcp, NULL);
+        #if MICROPY_STREAMS_POLL_NOTIFY
+        tcp_sent(socket->pcb.tcp, NULL);
+        #endif
 
         // Free any incoming buffers or connections that are stored
         lwip_socket_free_incoming(socket);
@@ -1439,8 +1482,25 @@ STATIC mp_uint_t lwip_socket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_
 
         socket->pcb.tcp = NULL;
         socket->state = _ERR_BADF;
+        lwip_socket_poll_signal(socket, 0);
         ret = 0;
 
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    } else if (request == MP_STREAM_POLL_NOTIFY) {
+        mp_stream_poll_notify_t *notify = (mp_stream_poll_notify_t*)arg;
+        if (notify != NULL && socket->notify != NULL) {
+            *errcode = MP_EBUSY;
+            ret = MP_STREAM_ERROR;
+        } else {
+            // all state changes reported by poll are signalled by the callbacks
+            if (notify != NULL) {
+                notify->mask = MP_STREAM_POLL_RD | MP_STREAM_POLL_WR | MP_STREAM_POLL_HUP | MP_STREAM_POLL_ERR;
+            }
+            socket->notify = notify;
+            ret = 0;
+        }
+    #endif
+
     } else {
         *errcode = MP_EINVAL;
         ret = MP_STREAM_ERROR;
@@ -39,16 +39,24 @@
 
 // Flags for poll()
 #define FLAG_ONESHOT (1)
+#define FLAG_EDGE    (2) // report a pushed event once, until signalled again
 
 /// \module select - Provides select function to wait for events on a stream
 ///
 /// This module provides the select function.
 
 typedef struct _poll_obj_t {
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    // Must be first: the stream holds a pointer to it, which keeps this
+    // entry alive for the GC.
+    mp_stream_poll_notify_t notify;
+    bool push; // stream signals its events, it's not polled on every call
+    #endif
     mp_obj_t obj;
     mp_uint_t (*ioctl)(mp_obj_t obj, mp_uint_t request, uintptr_t arg, int *errcode);
     mp_uint_t flags;
     mp_uint_t flags_ret;
+    struct _poll_obj_t *ret_next; // chain of entries reported by the last poll
 } poll_obj_t;
 
 STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_len, mp_uint_t flags, bool or_flags) {
@@ -62,6 +70,9 @@ STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_
             poll_obj->ioctl = stream_p->ioctl;
             poll_obj->flags = flags;
             poll_obj->flags_ret = 0;
+            #if MICROPY_STREAMS_POLL_NOTIFY
+            poll_obj->push = false;
+            #endif
             elem->value = MP_OBJ_FROM_PTR(poll_obj);
         } else {
             // object exists; update its flags
@@ -148,7 +159,7 @@ STATIC mp_obj_t select_select(size_t n_args, const mp_obj_t *args) {
         // poll the objects
         mp_uint_t n_ready = poll_map_poll(&poll_map, rwx_len);
 
-        if (n_ready > 0 || (timeout != -1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
+        if (n_ready > 0 || (timeout != (mp_uint_t)-1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
             // one or more objects are ready, or we had a timeout
             mp_obj_t list_array[3];
             list_array[0] = mp_obj_new_list(rwx_len[0], NULL);
@@ -184,12 +195,165 @@ typedef struct _mp_obj_poll_t {
     mp_obj_base_t base;
     mp_map_t poll_map;
     short iter_cnt;
-    short iter_idx;
     int flags;
+    // entries with events from the last poll, linked through ret_next
+    poll_obj_t *ret_head;
+    poll_obj_t *iter_next;
     // callee-owned tuple
     mp_obj_t ret_tuple;
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    // entries signalled by their stream since the last poll
+    mp_stream_poll_ready_t *ready;
+    // number of entries without push support, which are polled every time
+    mp_uint_t n_scan;
+    #endif
 } mp_obj_poll_t;
 
+#if MICROPY_STREAMS_POLL_NOTIFY
+
+STATIC void poll_notify_attach(mp_obj_poll_t *self, poll_obj_t *poll_obj) {
+    poll_obj->notify.next = NULL;
+    poll_obj->notify.ready = self->ready;
+    poll_obj->notify.events = 0;
+    poll_obj->notify.queued = 0;
+    poll_obj->notify.mask = 0;
+    int errcode;
+    if (poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL_NOTIFY, (uintptr_t)&poll_obj->notify, &errcode) == 0) {
+        poll_obj->push = true;
+        // the stream may already be ready, so check it on the next poll
+        mp_stream_poll_signal(&poll_obj->notify, 0);
+    } else {
+        self->n_scan += 1;
+    }
+}
+
+STATIC void poll_notify_detach(mp_obj_poll_t *self, poll_obj_t *poll_obj) {
+    if (!poll_obj->push) {
+        self->n_scan -= 1;
+        return;
+    }
+    int errcode;
+    poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL_NOTIFY, 0, &errcode);
+    poll_obj->push = false;
+    // unlink from the ready list if it's queued there
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    if (poll_obj->notify.queued) {
+        mp_stream_poll_notify_t **n = &self->ready->head;
+        while (*n != NULL && *n != &poll_obj->notify) {
+            n = &(*n)->next;
+        }
+        if (*n != NULL) {
+            *n = poll_obj->notify.next;
+        }
+        poll_obj->notify.queued = 0;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+// Poll the entries signalled since the last call, and those which can't
+// signal. Cost is proportional to the number of ready objects when all
+// registered streams support MP_STREAM_POLL_NOTIFY.
+STATIC mp_uint_t poll_notify_poll(mp_obj_poll_t *self) {
+    mp_uint_t n_ready = 0;
+    self->ret_head = NULL;
+
+    // take the whole ready list in one go; streams signalling from now on
+    // start a new list
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    mp_stream_poll_notify_t *n = self->ready->head;
+    self->ready->head = NULL;
+    for (mp_stream_poll_notify_t *m = n; m != NULL; m = m->next) {
+        m->queued = 0;
+        m->events = 0;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+
+    while (n != NULL) {
+        poll_obj_t *poll_obj = (poll_obj_t*)n;
+        n = n->next;
+        if (poll_obj->flags == 0) {
+            // disarmed by FLAG_ONESHOT; register()/modify() re-signal it
+            continue;
+        }
+        int errcode;
+        mp_int_t ret = poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL, poll_obj->flags, &errcode);
+        if (ret == -1) {
+            // put back what we took so nothing is missed by the next poll
+            for (;;) {
+                mp_stream_poll_signal(&poll_obj->notify, 0);
+                if (n == NULL) {
+                    break;
+                }
+                poll_obj = (poll_obj_t*)n;
+                n = n->next;
+            }
+            mp_raise_OSError(errcode);
+        }
+        poll_obj->flags_ret = ret;
+        if (ret != 0) {
+            poll_obj->ret_next = self->ret_head;
+            self->ret_head = poll_obj;
+            n_ready += 1;
+            if (!(self->flags & FLAG_EDGE)) {
+                // level-triggered: keep reporting it until it's drained
+                mp_stream_poll_signal(&poll_obj->notify, 0);
+            }
+        } else if (poll_obj->flags & ~poll_obj->notify.mask) {
+            // waiting for an event the stream doesn't signal, keep polling
+            mp_stream_poll_signal(&poll_obj->notify, 0);
+        }
+    }
+
+    if (self->n_scan == 0) {
+        return n_ready;
+    }
+
+    for (mp_uint_t i = 0; i < self->poll_map.alloc; ++i) {
+        if (!mp_map_slot_is_filled(&self->poll_map, i)) {
+            continue;
+        }
+        poll_obj_t *poll_obj = MP_OBJ_TO_PTR(self->poll_map.table[i].value);
+        if (poll_obj->push) {
+            continue;
+        }
+        int errcode;
+        mp_int_t ret = poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL, poll_obj->flags, &errcode);
+        if (ret == -1) {
+            mp_raise_OSError(errcode);
+        }
+        poll_obj->flags_ret = ret;
+        if (ret != 0) {
+            poll_obj->ret_next = self->ret_head;
+            self->ret_head = poll_obj;
+            n_ready += 1;
+        }
+    }
+    return n_ready;
+}
+
+#else
+
+STATIC mp_uint_t poll_notify_poll(mp_obj_poll_t *self) {
+    mp_uint_t n_ready = poll_map_poll(&self->poll_map, NULL);
+    // chain the ready entries so results can be walked without a rescan
+    self->ret_head = NULL;
+    if (n_ready > 0) {
+        for (mp_uint_t i = 0; i < self->poll_map.alloc; ++i) {
+            if (!mp_map_slot_is_filled(&self->poll_map, i)) {
+                continue;
+            }
+            poll_obj_t *poll_obj = MP_OBJ_TO_PTR(self->poll_map.table[i].value);
+            if (poll_obj->flags_ret != 0) {
+                poll_obj->ret_next = self->ret_head;
+                self->ret_head = poll_obj;
+            }
+        }
+    }
+    return n_ready;
+}
+
+#endif
+
 /// \method register(obj[, eventmask])
 STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
     mp_obj_poll_t *self = MP_OBJ_TO_PTR(args[0]);
@@ -199,7 +363,19 @@ STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
     } else {
         flags = MP_STREAM_POLL_RD | MP_STREAM_POLL_WR;
     }
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    mp_map_elem_t *elem = mp_map_lookup(&self->poll_map, mp_obj_id(args[1]), MP_MAP_LOOKUP);
     poll_map_add(&self->poll_map, &args[1], 1, flags, false);
+    poll_obj_t *poll_obj = MP_OBJ_TO_PTR(mp_map_lookup(&self->poll_map, mp_obj_id(args[1]), MP_MAP_LOOKUP)->value);
+    if (elem == NULL) {
+        poll_notify_attach(self, poll_obj);
+    } else if (poll_obj->push) {
+        // new event mask, so re-check it
+        mp_stream_poll_signal(&poll_obj->notify, 0);
+    }
+    #else
+    poll_map_add(&self->poll_map, &args[1], 1, flags, false);
+    #endif
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
@@ -207,7 +383,14 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
 /// \method unregister(obj)
 STATIC mp_obj_t poll_unregister(mp_obj_t self_in, mp_obj_t obj_in) {
     mp_obj_poll_t *self = MP_OBJ_TO_PTR(self_in);
-    mp_map_lookup(&self->poll_map, mp_obj_id(obj_in), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+    mp_map_elem_t *elem = mp_map_lookup(&self->poll_map, mp_obj_id(obj_in), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    if (elem != NULL) {
+        poll_notify_detach(self, MP_OBJ_TO_PTR(elem->value));
+    }
+    #else
+    (void)elem;
+    #endif
     // TODO raise KeyError if obj didn't exist in map
     return mp_const_none;
 }
@@ -220,7 +403,13 @@ STATIC mp_obj_t poll_modify(mp_obj_t self_in, mp_obj_t obj_in, mp_obj_t eventmas
     if (elem == NULL) {
         mp_raise_OSError(MP_ENOENT);
     }
-    ((poll_obj_t*)MP_OBJ_TO_PTR(elem->value))->flags = mp_obj_get_int(eventmask_in);
+    poll_obj_t *poll_obj = MP_OBJ_TO_PTR(elem->value);
+    poll_obj->flags = mp_obj_get_int(eventmask_in);
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    if (poll_obj->push) {
+        mp_stream_poll_signal(&poll_obj->notify, 0);
+    }
+    #endif
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_3(poll_modify_obj, poll_modify);
@@ -249,8 +438,8 @@ STATIC mp_uint_t poll_poll_internal(uint n_args, const mp_obj_t *args) {
     mp_uint_t n_ready;
     for (;;) {
         // poll the objects
-        n_ready = poll_map_poll(&self->poll_map, NULL);
-        if (n_ready > 0 || (timeout != -1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
+        n_ready = poll_notify_poll(self);
+        if (n_ready > 0 || (timeout != (mp_uint_t)-1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
             break;
         }
         MICROPY_EVENT_POLL_HOOK
@@ -266,18 +455,12 @@ STATIC mp_obj_t poll_poll(size_t n_args, const mp_obj_t *args) {
     // one or more objects are ready, or we had a timeout
     mp_obj_list_t *ret_list = MP_OBJ_TO_PTR(mp_obj_new_list(n_ready, NULL));
     n_ready = 0;
-    for (mp_uint_t i = 0; i < self->poll_map.alloc; ++i) {
-        if (!mp_map_slot_is_filled(&self->poll_map, i)) {
-            continue;
-        }
-        poll_obj_t *poll_obj = MP_OBJ_TO_PTR(self->poll_map.table[i].value);
-        if (poll_obj->flags_ret != 0) {
-            mp_obj_t tuple[2] = {poll_obj->obj, MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret)};
-            ret_list->items[n_ready++] = mp_obj_new_tuple(2, tuple);
-            if (self->flags & FLAG_ONESHOT) {
-                // Don't poll next time, until new event flags will be set explicitly
-                poll_obj->flags = 0;
-            }
+    for (poll_obj_t *poll_obj = self->ret_head; poll_obj != NULL; poll_obj = poll_obj->ret_next) {
+        mp_obj_t tuple[2] = {poll_obj->obj, MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret)};
+        ret_list->items[n_ready++] = mp_obj_new_tuple(2, tuple);
+        if (self->flags & FLAG_ONESHOT) {
+            // Don't poll next time, until new event flags will be set explicitly
+            poll_obj->flags = 0;
         }
     }
     return MP_OBJ_FROM_PTR(ret_list);
@@ -293,7 +476,7 @@ STATIC mp_obj_t poll_ipoll(size_t n_args, const mp_obj_t *args) {
 
     int n_ready = poll_poll_internal(n_args, args);
     self->iter_cnt = n_ready;
-    self->iter_idx = 0;
+    self->iter_next = self->ret_head;
 
     return args[0];
 }
@@ -308,27 +491,22 @@ STATIC mp_obj_t poll_iternext(mp_obj_t self_in) {
 
     self->iter_cnt--;
 
-    for (mp_uint_t i = self->iter_idx; i < self->poll_map.alloc; ++i) {
-        self->iter_idx++;
-        if (!mp_map_slot_is_filled(&self->poll_map, i)) {
-            continue;
-        }
-        poll_obj_t *poll_obj = MP_OBJ_TO_PTR(self->poll_map.table[i].value);
-        if (poll_obj->flags_ret != 0) {
-            mp_obj_tuple_t *t = MP_OBJ_TO_PTR(self->ret_tuple);
-            t->items[0] = poll_obj->obj;
-            t->items[1] = MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret);
-            if (self->flags & FLAG_ONESHOT) {
-                // Don't poll next time, until new event flags will be set explicitly
-                poll_obj->flags = 0;
-            }
-            return MP_OBJ_FROM_PTR(t);
-        }
+    poll_obj_t *poll_obj = self->iter_next;
+    if (poll_obj == NULL) {
+        assert(!"inconsistent number of poll active entries");
+        self->iter_cnt = 0;
+        return MP_OBJ_STOP_ITERATION;
     }
-
-    assert(!"inconsistent number of poll active entries");
-    self->iter_cnt = 0;
-    return MP_OBJ_STOP_ITERATION;
+    self->iter_next = poll_obj->ret_next;
+
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(self->ret_tuple);
+    t->items[0] = poll_obj->obj;
+    t->items[1] = MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret);
+    if (self->flags & FLAG_ONESHOT) {
+        // Don't poll next time, until new event flags will be set explicitly
+        poll_obj->flags = 0;
+    }
+    return MP_OBJ_FROM_PTR(t);
 }
 
 STATIC const mp_rom_map_elem_t poll_locals_dict_table[] = {
@@ -351,9 +529,18 @@ STATIC const mp_obj_type_t mp_type_poll = {
 /// \function poll()
 STATIC mp_obj_t select_poll(void) {
     mp_obj_poll_t *poll = m_new_obj(mp_obj_poll_t);
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    // Separate allocation: if the poll object is dropped without
+    // unregistering, streams still signal into a valid (orphaned) list.
+    poll->ready = m_new_obj(mp_stream_poll_ready_t);
+    poll->ready->head = NULL;
+    poll->n_scan = 0;
+    #endif
     poll->base.type = &mp_type_poll;
     mp_map_init(&poll->poll_map, 0);
     poll->iter_cnt = 0;
+    poll->ret_head = NULL;
+    poll->iter_next = NULL;
     poll->ret_tuple = MP_OBJ_NULL;
     return MP_OBJ_FROM_PTR(poll);
 }
@@ -367,6 +554,9 @@ STATIC const mp_rom_map_elem_t mp_module_select_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_POLLOUT), MP_ROM_INT(MP_STREAM_POLL_WR) },
     { MP_ROM_QSTR(MP_QSTR_POLLERR), MP_ROM_INT(MP_STREAM_POLL_ERR) },
     { MP_ROM_QSTR(MP_QSTR_POLLHUP), MP_ROM_INT(MP_STREAM_POLL_HUP) },
+    #if MICROPY_STREAMS_POLL_NOTIFY
+    { MP_ROM_QSTR(MP_QSTR_POLLEDGE), MP_ROM_INT(FLAG_EDGE) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_select_globals, mp_module_select_globals_table);
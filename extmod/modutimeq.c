@@ -175,6 +175,28 @@ STATIC mp_obj_t mod_utimeq_peektime(mp_obj_t heap_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_utimeq_peektime_obj, mod_utimeq_peektime);
 
+// Remove the first entry whose callback is the given object, so a scheduler
+// can cancel a pending timeout without waiting for it to expire.
+STATIC mp_obj_t mod_utimeq_remove(mp_obj_t heap_in, mp_obj_t callback) {
+    mp_obj_utimeq_t *heap = get_heap(heap_in);
+    for (mp_uint_t i = 0; i < heap->len; i++) {
+        if (heap->items[i].callback == callback) {
+            heap->len -= 1;
+            heap->items[i] = heap->items[heap->len];
+            heap->items[heap->len].callback = MP_OBJ_NULL; // so we don't retain a pointer
+            heap->items[heap->len].args = MP_OBJ_NULL;
+            if (i < heap->len) {
+                // the moved entry may need to go either down or up the heap
+                heap_siftup(heap, i);
+                heap_siftdown(heap, 0, i);
+            }
+            return mp_const_true;
+        }
+    }
+    return mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_utimeq_remove_obj, mod_utimeq_remove);
+
 #if DEBUG
 STATIC mp_obj_t mod_utimeq_dump(mp_obj_t heap_in) {
     mp_obj_utimeq_t *heap = get_heap(heap_in);
@@ -200,6 +222,7 @@ STATIC const mp_rom_map_elem_t utimeq_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_push), MP_ROM_PTR(&mod_utimeq_heappush_obj) },
     { MP_ROM_QSTR(MP_QSTR_pop), MP_ROM_PTR(&mod_utimeq_heappop_obj) },
     { MP_ROM_QSTR(MP_QSTR_peektime), MP_ROM_PTR(&mod_utimeq_peektime_obj) },
+    { MP_ROM_QSTR(MP_QSTR_remove), MP_ROM_PTR(&mod_utimeq_remove_obj) },
     #if DEBUG
     { MP_ROM_QSTR(MP_QSTR_dump), MP_ROM_PTR(&mod_utimeq_dump_obj) },
     #endif
@@ -0,0 +1,244 @@
+# uasyncio: asyncio-like event loop with I/O waiting via uselect.poll
+#
+# Tasks blocked on a stream are registered with a single poll object and
+# the loop sleeps in ipoll() until either a stream becomes ready or the
+# nearest wait queue deadline expires, so an idle loop uses no CPU.
+
+import uerrno
+import uselect as select
+import usocket as _socket
+from uasyncio.core import *
+
+
+class PollEventLoop(EventLoop):
+
+    def __init__(self, runq_len=16, waitq_len=16):
+        EventLoop.__init__(self, runq_len, waitq_len)
+        self.poller = select.poll()
+        # id(stream) -> task (or (callback, args)) waiting on it. Only one
+        # task may wait on a given stream at a time.
+        self.objmap = {}
+
+    def add_reader(self, sock, cb, *args):
+        if args:
+            self.poller.register(sock, select.POLLIN)
+            self.objmap[id(sock)] = (cb, args)
+        else:
+            self.poller.register(sock, select.POLLIN)
+            self.objmap[id(sock)] = cb
+
+    def remove_reader(self, sock):
+        self.objmap.pop(id(sock), None)
+        self.poller.unregister(sock)
+
+    def add_writer(self, sock, cb, *args):
+        if args:
+            self.poller.register(sock, select.POLLOUT)
+            self.objmap[id(sock)] = (cb, args)
+        else:
+            self.poller.register(sock, select.POLLOUT)
+            self.objmap[id(sock)] = cb
+
+    def remove_writer(self, sock):
+        self.objmap.pop(id(sock), None)
+        try:
+            self.poller.unregister(sock)
+        except OSError as e:
+            # StreamWriter.awrite() first tries to write to a socket,
+            # and if that succeeds, yield IOWrite may never be called
+            # for that socket, and it will never be added to poller. So,
+            # ignore such error.
+            if e.args[0] != uerrno.ENOENT:
+                raise
+
+    def remove_polled_cb(self, cb):
+        for id_ in self.objmap:
+            if self.objmap[id_] is cb:
+                # The stream object itself isn't kept here, so just forget
+                # the waiter; wait() unregisters the stream if it fires.
+                del self.objmap[id_]
+                break
+
+    def wait(self, delay):
+        # We need one-shot behaviour (second arg of 1 to .ipoll())
+        res = self.poller.ipoll(delay, 1)
+        for sock, ev in res:
+            cb = self.objmap.get(id(sock))
+            if ev & (select.POLLHUP | select.POLLERR):
+                # These events are returned even if not requested, and
+                # are sticky, i.e. will be returned again and again.
+                # If the caller doesn't do proper error handling and
+                # unregister this sock, we'll busy-loop on it, so we
+                # as well can unregister it now "just in case".
+                self.remove_reader(sock)
+            if cb is None:
+                # Waiter was cancelled
+                self.poller.unregister(sock)
+                continue
+            if isinstance(cb, tuple):
+                cb[0](*cb[1])
+            else:
+                cb.pend_throw(None)
+                self.call_soon(cb)
+
+
+class StreamReader:
+
+    def __init__(self, polls, ios=None):
+        if ios is None:
+            ios = polls
+        self.polls = polls
+        self.ios = ios
+
+    def read(self, n=-1):
+        while True:
+            yield IORead(self.polls)
+            res = self.ios.read(n)
+            if res is not None:
+                break
+            # This should not happen for real sockets, but can easily
+            # happen for stream wrappers (ssl, websockets, etc.)
+        if not res:
+            yield IOReadDone(self.polls)
+        return res
+
+    def readinto(self, buf, n=-1):
+        # Fills buf without allocating a new bytes object per call
+        while True:
+            yield IORead(self.polls)
+            if n < 0:
+                res = self.ios.readinto(buf)
+            else:
+                res = self.ios.readinto(buf, n)
+            if res is not None:
+                break
+        if not res:
+            yield IOReadDone(self.polls)
+        return res
+
+    def readexactly(self, n):
+        buf = b""
+        while n:
+            yield IORead(self.polls)
+            res = self.ios.read(n)
+            assert res is not None
+            if not res:
+                yield IOReadDone(self.polls)
+                break
+            buf += res
+            n -= len(res)
+        return buf
+
+    def readline(self):
+        buf = b""
+        while True:
+            yield IORead(self.polls)
+            res = self.ios.readline()
+            assert res is not None
+            if not res:
+                yield IOReadDone(self.polls)
+                break
+            buf += res
+            if buf[-1] == 0x0a:
+                break
+        return buf
+
+    def aclose(self):
+        yield IOReadDone(self.polls)
+        self.ios.close()
+
+    def __repr__(self):
+        return "<StreamReader %r %r>" % (self.polls, self.ios)
+
+
+class StreamWriter:
+
+    def __init__(self, s, extra):
+        self.s = s
+        self.extra = extra
+
+    def awrite(self, buf, off=0, sz=-1):
+        # This method is called awrite (async write) to not proliferate
+        # incompatibility with original asyncio. Unlike original asyncio
+        # whose .write() method is both not a coroutine and guaranteed
+        # to return immediately (which means it has to buffer all the
+        # data), this method is a coroutine.
+        if sz == -1:
+            sz = len(buf) - off
+        waited = False
+        while True:
+            res = self.s.write(buf, off, sz)
+            # If we spooled everything, return immediately
+            if res == sz:
+                if waited:
+                    yield IOWriteDone(self.s)
+                return
+            if res is None:
+                res = 0
+            assert res < sz
+            off += res
+            sz -= res
+            waited = True
+            yield IOWrite(self.s)
+
+    # Write piecewise content from iterable (usually, a generator)
+    def awriteiter(self, iterable):
+        for line in iterable:
+            yield from self.awrite(line)
+
+    def aclose(self):
+        yield IOWriteDone(self.s)
+        self.s.close()
+
+    def get_extra_info(self, name, default=None):
+        return self.extra.get(name, default)
+
+    def __repr__(self):
+        return "<StreamWriter %r>" % self.s
+
+
+def open_connection(host, port, ssl=False):
+    ai = _socket.getaddrinfo(host, port, 0, _socket.SOCK_STREAM)
+    ai = ai[0]
+    s = _socket.socket(ai[0], ai[1], ai[2])
+    s.setblocking(False)
+    try:
+        s.connect(ai[-1])
+    except OSError as e:
+        if e.args[0] != uerrno.EINPROGRESS:
+            raise
+    # Writability signals that the non-blocking connect has completed
+    yield IOWrite(s)
+    yield IOWriteDone(s)
+    if ssl:
+        import ussl
+        s.setblocking(True)
+        s2 = ussl.wrap_socket(s)
+        s.setblocking(False)
+        return StreamReader(s, s2), StreamWriter(s2, {})
+    return StreamReader(s), StreamWriter(s, {})
+
+
+def start_server(client_coro, host, port, backlog=10):
+    ai = _socket.getaddrinfo(host, port, 0, _socket.SOCK_STREAM)
+    ai = ai[0]
+    s = _socket.socket(ai[0], ai[1], ai[2])
+    s.setblocking(False)
+
+    s.setsockopt(_socket.SOL_SOCKET, _socket.SO_REUSEADDR, 1)
+    s.bind(ai[-1])
+    s.listen(backlog)
+    try:
+        while True:
+            yield IORead(s)
+            s2, client_addr = s.accept()
+            s2.setblocking(False)
+            yield client_coro(StreamReader(s2), StreamWriter(s2, {"peername": client_addr}))
+    finally:
+        yield IOReadDone(s)
+        s.close()
+
+
+import uasyncio.core
+
+uasyncio.core._event_loop_class = PollEventLoop
@@ -0,0 +1,299 @@
+# uasyncio core: coroutine scheduler built on utimeq and deque
+#
+# Tasks are plain generators/coroutines. The run queue holds tasks ready to
+# run, the wait queue (a utimeq heap keyed on ticks_ms) holds tasks sleeping
+# until a deadline. Waiting for I/O is implemented by a subclass which
+# overrides wait(), add_reader() and friends (see uasyncio/__init__.py).
+
+import utime as time
+import utimeq
+import ucollections
+
+
+type_gen = type((lambda: (yield))())
+
+
+class CancelledError(Exception):
+    pass
+
+
+class TimeoutError(CancelledError):
+    pass
+
+
+class EventLoop:
+
+    def __init__(self, runq_len=16, waitq_len=16):
+        self.runq = ucollections.deque((), runq_len, True)
+        self.waitq = utimeq.utimeq(waitq_len)
+        # Current task being run. Task is a top-level coroutine scheduled
+        # in the event loop (sub-coroutines executed transparently by
+        # yield from/await, event loop "doesn't see" them).
+        self.cur_task = None
+
+    def time(self):
+        return time.ticks_ms()
+
+    def create_task(self, coro):
+        # CPython 3.4.2
+        self.call_later_ms(0, coro)
+        # CPython asyncio incompatibility: we don't return Task object
+        return coro
+
+    def call_soon(self, callback, *args):
+        self.runq.append(callback)
+        if not isinstance(callback, type_gen):
+            self.runq.append(args)
+
+    def call_later(self, delay, callback, *args):
+        self.call_at_(time.ticks_add(self.time(), int(delay * 1000)), callback, args)
+
+    def call_later_ms(self, delay, callback, *args):
+        if not delay:
+            return self.call_soon(callback, *args)
+        self.call_at_(time.ticks_add(self.time(), delay), callback, args)
+
+    def call_at_(self, time, callback, args=()):
+        self.waitq.push(time, callback, args)
+
+    def wait(self, delay):
+        # Default wait implementation, to be overriden in subclasses
+        # with IO scheduling
+        time.sleep_ms(delay)
+
+    def remove_polled_cb(self, cb):
+        # Overriden in subclasses which can wait on I/O
+        pass
+
+    def run_forever(self):
+        cur_task = [0, 0, 0]
+        while True:
+            # Expire entries in waitq and move them to runq
+            tnow = self.time()
+            while self.waitq:
+                t = self.waitq.peektime()
+                delay = time.ticks_diff(t, tnow)
+                if delay > 0:
+                    break
+                self.waitq.pop(cur_task)
+                self.call_soon(cur_task[1], *cur_task[2])
+
+            # Process runq. Only tasks which were queued before this pass
+            # are run, so a task rescheduling itself can't starve the loop.
+            l = len(self.runq)
+            while l:
+                cb = self.runq.popleft()
+                l -= 1
+                if not isinstance(cb, type_gen):
+                    args = self.runq.popleft()
+                    l -= 1
+                    cb(*args)
+                    continue
+
+                self.cur_task = cb
+                delay = 0
+                try:
+                    ret = next(cb)
+                    if isinstance(ret, SysCall1):
+                        arg = ret.arg
+                        if isinstance(ret, SleepMs):
+                            delay = arg
+                        elif isinstance(ret, IORead):
+                            # Mark the task as blocked on I/O, see cancel()
+                            cb.pend_throw(False)
+                            self.add_reader(arg, cb)
+                            continue
+                        elif isinstance(ret, IOWrite):
+                            cb.pend_throw(False)
+                            self.add_writer(arg, cb)
+                            continue
+                        elif isinstance(ret, IOReadDone):
+                            self.remove_reader(arg)
+                        elif isinstance(ret, IOWriteDone):
+                            self.remove_writer(arg)
+                        elif isinstance(ret, StopLoop):
+                            return arg
+                        else:
+                            assert False, "Unknown syscall yielded: %r (of type %r)" % (ret, type(ret))
+                    elif isinstance(ret, type_gen):
+                        self.call_soon(ret)
+                    elif isinstance(ret, int):
+                        # Native sleep: "yield 100" sleeps for 100ms
+                        delay = ret
+                    elif ret is None:
+                        # Just reschedule
+                        pass
+                    elif ret is False:
+                        # Don't reschedule
+                        continue
+                    else:
+                        assert False, "Unsupported coroutine yield value: %r (of type %r)" % (ret, type(ret))
+                except StopIteration as e:
+                    continue
+                except CancelledError as e:
+                    continue
+                # Currently all syscalls don't return anything, so we don't
+                # need to feed anything to the next invocation of coroutine.
+                # If that changes, need to pass that value below.
+                if delay:
+                    self.call_later_ms(delay, cb)
+                else:
+                    self.call_soon(cb)
+
+            # Wait until next waitq task or I/O availability
+            delay = 0
+            if not self.runq:
+                delay = -1
+                if self.waitq:
+                    tnow = self.time()
+                    t = self.waitq.peektime()
+                    delay = time.ticks_diff(t, tnow)
+                    if delay < 0:
+                        delay = 0
+            self.wait(delay)
+
+    def run_until_complete(self, coro):
+        ret = None
+
+        def _run_and_stop():
+            nonlocal ret
+            ret = yield from coro
+            yield StopLoop(0)
+
+        self.call_soon(_run_and_stop())
+        self.run_forever()
+        return ret
+
+    def stop(self):
+        self.call_soon((lambda: (yield StopLoop(0)))())
+
+    def close(self):
+        pass
+
+
+class SysCall:
+
+    def __init__(self, *args):
+        self.args = args
+
+    def handle(self):
+        raise NotImplementedError
+
+
+# Optimized syscall with 1 arg
+class SysCall1(SysCall):
+
+    def __init__(self, arg):
+        self.arg = arg
+
+
+class StopLoop(SysCall1):
+    pass
+
+
+class IORead(SysCall1):
+    pass
+
+
+class IOWrite(SysCall1):
+    pass
+
+
+class IOReadDone(SysCall1):
+    pass
+
+
+class IOWriteDone(SysCall1):
+    pass
+
+
+_event_loop = None
+_event_loop_class = EventLoop
+
+
+def get_event_loop(runq_len=16, waitq_len=16):
+    global _event_loop
+    if _event_loop is None:
+        _event_loop = _event_loop_class(runq_len, waitq_len)
+    return _event_loop
+
+
+def sleep(secs):
+    yield int(secs * 1000)
+
+
+# Implementation of sleep_ms awaitable with zero heap memory usage: a single
+# instance is reused by every caller, since the scheduler consumes the delay
+# as soon as the task yields it.
+class SleepMs(SysCall1):
+
+    def __init__(self):
+        self.v = None
+        self.arg = None
+
+    def __call__(self, arg):
+        self.v = arg
+        return self
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        if self.v is not None:
+            self.arg = self.v
+            self.v = None
+            return self
+        _stop_iter.__traceback__ = None
+        raise _stop_iter
+
+
+_stop_iter = StopIteration()
+sleep_ms = SleepMs()
+
+
+def _throw_pending(coro, exc):
+    # Arrange for exc to be raised in coro when it next runs. A task sleeping
+    # in the wait queue is woken straight away; one blocked on I/O (marked by
+    # pend_throw(False)) is detached from the poller and rescheduled.
+    prev = coro.pend_throw(exc)
+    if prev is False:
+        _event_loop.remove_polled_cb(coro)
+        _event_loop.call_soon(coro)
+    elif _event_loop.waitq.remove(coro):
+        _event_loop.call_soon(coro)
+
+
+def cancel(coro):
+    _throw_pending(coro, CancelledError())
+
+
+class TimeoutObj:
+
+    def __init__(self, coro):
+        self.coro = coro
+
+
+def wait_for_ms(coro, timeout):
+
+    def timeout_func(timeout_obj):
+        if timeout_obj.coro:
+            _throw_pending(timeout_obj.coro, TimeoutError())
+
+    def waiter(coro, timeout_obj):
+        res = yield from coro
+        timeout_obj.coro = None
+        # Drop the pending timeout so it doesn't hold a waitq slot
+        _event_loop.waitq.remove(timeout_func)
+        return res
+
+    timeout_obj = TimeoutObj(_event_loop.cur_task)
+    _event_loop.call_later_ms(timeout, timeout_func, timeout_obj)
+    return (yield from waiter(coro, timeout_obj))
+
+
+def wait_for(coro, timeout):
+    return wait_for_ms(coro, int(timeout * 1000))
+
+
+def coroutine(f):
+    return f
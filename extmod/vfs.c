@@ -42,6 +42,11 @@
 #include "extmod/vfs_posix.h"
 #endif
 
+#if MICROPY_VFS_LOG
+#include "py/stream.h"
+#include "extmod/vfs_log.h"
+#endif
+
 // For mp_vfs_proxy_call, the maximum number of additional args that can be passed.
 // A fixed maximum size is used to avoid the need for a costly variable array.
 #define PROXY_MAX_ARGS (2)
@@ -177,10 +182,15 @@ mp_import_stat_t mp_vfs_import_stat(const char *path) {
 }
 
 mp_obj_t mp_vfs_mount(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_readonly, ARG_mkfs };
+    // readonly and mkfs go on to the mount method
+    enum { ARG_readonly, ARG_mkfs, ARG_cache, ARG_readahead };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_readonly, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_PTR(&mp_const_false_obj)} },
         { MP_QSTR_mkfs, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_PTR(&mp_const_false_obj)} },
+        #if MICROPY_VFS_BLOCKCACHE
+        { MP_QSTR_cache, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = MICROPY_VFS_BLOCKCACHE_BLOCKS} },
+        { MP_QSTR_readahead, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = MICROPY_VFS_BLOCKCACHE_READAHEAD} },
+        #endif
     };
 
     // parse args
@@ -226,6 +236,15 @@ mp_obj_t mp_vfs_mount(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args
         }
     }
 
+    #if MICROPY_VFS_BLOCKCACHE && MICROPY_VFS_FAT
+    if (mp_obj_get_type(vfs_obj) == &mp_fat_vfs_type) {
+        if (args[ARG_cache].u_int < 0 || args[ARG_readahead].u_int < 0) {
+            mp_raise_ValueError(NULL);
+        }
+        fat_vfs_set_cache(MP_OBJ_TO_PTR(vfs_obj), args[ARG_cache].u_int, args[ARG_readahead].u_int);
+    }
+    #endif
+
     // insert the vfs into the mount table
     mp_vfs_mount_t **vfsp = &MP_STATE_VM(vfs_mount_table);
     while (*vfsp != NULL) {
@@ -274,9 +293,9 @@ mp_obj_t mp_vfs_umount(mp_obj_t mnt_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_umount_obj, mp_vfs_umount);
 
-// Note: buffering and encoding args are currently ignored
+// Note: encoding is currently ignored, and buffering but for log files
 mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_file, ARG_mode, ARG_encoding };
+    enum { ARG_file, ARG_mode, ARG_buffering, ARG_encoding };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
         { MP_QSTR_mode, MP_ARG_OBJ, {.u_rom_obj = MP_ROM_QSTR(MP_QSTR_r)} },
@@ -296,6 +315,13 @@ mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
     #endif
 
     mp_vfs_mount_t *vfs = lookup_path(args[ARG_file].u_obj, &args[ARG_file].u_obj);
+    #if MICROPY_VFS_LOG
+    // the file systems that take it make log files, see extmod/vfs_log.h
+    if (args[ARG_buffering].u_int != -1) {
+        mp_obj_t open_args[3] = { args[ARG_file].u_obj, args[ARG_mode].u_obj, MP_OBJ_NEW_SMALL_INT(args[ARG_buffering].u_int) };
+        return mp_vfs_proxy_call(vfs, MP_QSTR_open, 3, open_args);
+    }
+    #endif
     return mp_vfs_proxy_call(vfs, MP_QSTR_open, 2, (mp_obj_t*)&args);
 }
 MP_DEFINE_CONST_FUN_OBJ_KW(mp_vfs_open_obj, 0, mp_vfs_open);
@@ -349,10 +375,27 @@ typedef struct _mp_vfs_ilistdir_it_t {
         mp_vfs_mount_t *vfs;
         mp_obj_t iter;
     } cur;
+    bool with_stat;
     bool is_str;
     bool is_iter;
 } mp_vfs_ilistdir_it_t;
 
+bool mp_vfs_ilistdir_with_stat(size_t n_args, const mp_obj_t *args, size_t stat_arg) {
+    return n_args > stat_arg && mp_obj_is_true(args[stat_arg]);
+}
+
+mp_obj_t mp_vfs_ilistdir_entry(bool with_stat, mp_obj_t name, mp_int_t type, mp_uint_t size, mp_uint_t mtime) {
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(with_stat ? 5 : 4, NULL));
+    t->items[0] = name;
+    t->items[1] = MP_OBJ_NEW_SMALL_INT(type);
+    t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
+    t->items[3] = mp_obj_new_int_from_uint(size);
+    if (with_stat) {
+        t->items[4] = mp_obj_new_int_from_uint(mtime);
+    }
+    return MP_OBJ_FROM_PTR(t);
+}
+
 STATIC mp_obj_t mp_vfs_ilistdir_it_iternext(mp_obj_t self_in) {
     mp_vfs_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
     if (self->is_iter) {
@@ -367,10 +410,15 @@ STATIC mp_obj_t mp_vfs_ilistdir_it_iternext(mp_obj_t self_in) {
         self->cur.vfs = vfs->next;
         if (vfs->len == 1) {
             // vfs is mounted at root dir, delegate to it
-            mp_obj_t root = MP_OBJ_NEW_QSTR(MP_QSTR__slash_);
+            mp_obj_t args[2] = { MP_OBJ_NEW_QSTR(MP_QSTR__slash_), mp_const_true };
             self->is_iter = true;
-            self->cur.iter = mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 1, &root);
+            self->cur.iter = mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, self->with_stat ? 2 : 1, args);
             return mp_iternext(self->cur.iter);
+        } else if (self->with_stat) {
+            // a mounted directory, with the stat of ilistdir(path, True)
+            return mp_vfs_ilistdir_entry(self->with_stat, mp_obj_new_str_of_type(
+                self->is_str ? &mp_type_str : &mp_type_bytes,
+                (const byte*)vfs->str + 1, vfs->len - 1), MP_S_IFDIR, 0, 0);
         } else {
             // a mounted directory
             mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
@@ -386,7 +434,7 @@ STATIC mp_obj_t mp_vfs_ilistdir_it_iternext(mp_obj_t self_in) {
 
 mp_obj_t mp_vfs_ilistdir(size_t n_args, const mp_obj_t *args) {
     mp_obj_t path_in;
-    if (n_args == 1) {
+    if (n_args >= 1) {
         path_in = args[0];
     } else {
         path_in = MP_OBJ_NEW_QSTR(MP_QSTR_);
@@ -401,14 +449,20 @@ mp_obj_t mp_vfs_ilistdir(size_t n_args, const mp_obj_t *args) {
         iter->base.type = &mp_type_polymorph_iter;
         iter->iternext = mp_vfs_ilistdir_it_iternext;
         iter->cur.vfs = MP_STATE_VM(vfs_mount_table);
+        iter->with_stat = mp_vfs_ilistdir_with_stat(n_args, args, 1);
         iter->is_str = mp_obj_get_type(path_in) == &mp_type_str;
         iter->is_iter = false;
         return MP_OBJ_FROM_PTR(iter);
     }
 
+    if (n_args == 2) {
+        // the stat flag goes to the file system
+        mp_obj_t fs_args[2] = { path_out, args[1] };
+        return mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 2, fs_args);
+    }
     return mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 1, &path_out);
 }
-MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_ilistdir_obj, 0, 1, mp_vfs_ilistdir);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_ilistdir_obj, 0, 2, mp_vfs_ilistdir);
 
 mp_obj_t mp_vfs_listdir(size_t n_args, const mp_obj_t *args) {
     mp_obj_t iter = mp_vfs_ilistdir(n_args, args);
@@ -421,6 +475,79 @@ mp_obj_t mp_vfs_listdir(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_listdir_obj, 0, 1, mp_vfs_listdir);
 
+#if MICROPY_VFS_LOG
+typedef struct _mp_vfs_logrecords_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_t file;          // MP_OBJ_NULL once closed
+    byte *buf;
+    size_t size;
+    size_t start;
+    size_t end;
+    bool eof;
+} mp_vfs_logrecords_it_t;
+
+STATIC mp_obj_t mp_vfs_logrecords_it_iternext(mp_obj_t self_in) {
+    mp_vfs_logrecords_it_t *self = MP_OBJ_TO_PTR(self_in);
+
+    while (self->file != MP_OBJ_NULL) {
+        size_t avail = self->end - self->start;
+        int32_t n = vfs_log_parse(self->buf + self->start, avail);
+
+        if (n > 0) {
+            mp_obj_t record = mp_obj_new_bytes(self->buf + self->start + VFS_LOG_HEADER_SIZE, n - VFS_LOG_HEADER_SIZE);
+            self->start += n;
+            return record;
+        }
+        if (n < 0 || (self->eof && avail > 0)) {
+            // not a record, or one cut short: look for the next one from the byte after
+            self->start++;
+            continue;
+        }
+        if (self->eof) {
+            mp_stream_close(self->file);
+            self->file = MP_OBJ_NULL;
+            break;
+        }
+
+        // read on, with room for the longest record
+        memmove(self->buf, self->buf + self->start, avail);
+        self->start = 0;
+        self->end = avail;
+        if (self->end == self->size) {
+            size_t size = MIN(self->size * 2, VFS_LOG_HEADER_SIZE + VFS_LOG_RECORD_MAX);
+            self->buf = m_renew(byte, self->buf, self->size, size);
+            self->size = size;
+        }
+        int errcode;
+        mp_uint_t got = mp_stream_rw(self->file, self->buf + self->end, self->size - self->end, &errcode, MP_STREAM_RW_READ);
+        if (errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+        self->end += got;
+        self->eof = (got < self->size - avail);
+    }
+    return MP_OBJ_STOP_ITERATION;
+}
+
+// the records of a log file, skipping what isn't one
+mp_obj_t mp_vfs_logrecords(mp_obj_t path_in) {
+    mp_obj_t open_args[2] = { path_in, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+    mp_vfs_logrecords_it_t *iter = m_new_obj(mp_vfs_logrecords_it_t);
+
+    iter->base.type = &mp_type_polymorph_iter;
+    iter->iternext = mp_vfs_logrecords_it_iternext;
+    iter->file = mp_vfs_open(2, open_args, (mp_map_t*)&mp_const_empty_map);
+    iter->size = 512;
+    iter->buf = m_new(byte, iter->size);
+    iter->start = 0;
+    iter->end = 0;
+    iter->eof = false;
+    return MP_OBJ_FROM_PTR(iter);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_logrecords_obj, mp_vfs_logrecords);
+#endif
+
 mp_obj_t mp_vfs_mkdir(mp_obj_t path_in) {
     mp_obj_t path_out;
     mp_vfs_mount_t *vfs = lookup_path(path_in, &path_out);
@@ -525,8 +652,63 @@ mp_obj_t mp_vfs_getfree(mp_obj_t path_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_getfree_obj, mp_vfs_getfree);
 
-mp_obj_t mp_vfs_fsformat(mp_obj_t path_in)
+#if MICROPY_VFS_MMAP
+mp_obj_t mp_vfs_mmap(mp_obj_t path_in) {
+    mp_obj_t path_out;
+    mp_vfs_mount_t *vfs = lookup_path(path_in, &path_out);
+    if (vfs == MP_VFS_NONE || vfs == MP_VFS_ROOT) {
+        return mp_vfs_proxy_call(vfs, MP_QSTR_mmap, 1, &path_out);
+    }
+    // a file system whose files can't be mapped
+    mp_obj_t meth[3];
+    mp_load_method_maybe(vfs->obj, MP_QSTR_mmap, meth);
+    if (meth[0] == MP_OBJ_NULL) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+    meth[2] = path_out;
+    return mp_call_method_n_kw(1, 0, meth);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_mmap_obj, mp_vfs_mmap);
+#endif
+
+#if MICROPY_VFS_BLOCKCACHE
+// (hits, misses, read ahead, written back, device reads, device writes) counted
+// in blocks but for the requests, or None for a mount without a cache
+mp_obj_t mp_vfs_cachestats(mp_obj_t path_in) {
+    mp_obj_t path_out;
+    mp_vfs_mount_t *vfs = lookup_path(path_in, &path_out);
+    if (vfs == MP_VFS_NONE || vfs == MP_VFS_ROOT) {
+        mp_raise_OSError(MP_ENODEV);
+    }
+
+    #if MICROPY_VFS_FAT
+    if (mp_obj_get_type(vfs->obj) == &mp_fat_vfs_type) {
+        vfs_blockcache_t *cache = ((fs_user_mount_t*)MP_OBJ_TO_PTR(vfs->obj))->cache;
+        if (cache != NULL) {
+            mp_obj_t t[6] = {
+                mp_obj_new_int_from_uint(cache->hits),
+                mp_obj_new_int_from_uint(cache->misses),
+                mp_obj_new_int_from_uint(cache->read_ahead),
+                mp_obj_new_int_from_uint(cache->written_back),
+                mp_obj_new_int_from_uint(cache->device_reads),
+                mp_obj_new_int_from_uint(cache->device_writes),
+            };
+            return mp_obj_new_tuple(6, t);
+        }
+    }
+    #endif
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_cachestats_obj, mp_vfs_cachestats);
+#endif
+
+// the options of the file system, if any, as keywords
+#define FSFORMAT_KW_MAX (4)
+
+mp_obj_t mp_vfs_fsformat(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
+	(void)n_args;
+	mp_obj_t path_in = args[0];
 	if (path_in != NULL)
 	{
 		if (MP_OBJ_IS_STR_OR_BYTES(path_in))
@@ -548,7 +730,20 @@ mp_obj_t mp_vfs_fsformat(mp_obj_t path_in)
 				{
 					if(!strcmp(vfs->str, path))
 					{
-						return mp_vfs_proxy_call(vfs, MP_QSTR_fsformat, 0, NULL);
+						mp_obj_t meth[2 + 2 * FSFORMAT_KW_MAX];
+						size_t n_kw = 0;
+						mp_load_method(vfs->obj, MP_QSTR_fsformat, meth);
+						for (size_t i = 0; i < kw_args->alloc; i++) {
+							if (MP_MAP_SLOT_IS_FILLED(kw_args, i)) {
+								if (n_kw == FSFORMAT_KW_MAX) {
+									mp_raise_TypeError("too many options");
+								}
+								meth[2 + 2 * n_kw] = kw_args->table[i].key;
+								meth[3 + 2 * n_kw] = kw_args->table[i].value;
+								n_kw++;
+							}
+						}
+						return mp_call_method_n_kw(0, n_kw, meth);
 					}
 				}
 				mp_raise_OSError(MP_ENODEV);
@@ -562,6 +757,6 @@ mp_obj_t mp_vfs_fsformat(mp_obj_t path_in)
 
 	return MP_VFS_NONE;
 }
-MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_fsformat_obj, mp_vfs_fsformat);
+MP_DEFINE_CONST_FUN_OBJ_KW(mp_vfs_fsformat_obj, 1, mp_vfs_fsformat);
 
 #endif // MICROPY_VFS
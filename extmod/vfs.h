@@ -30,6 +30,7 @@
 #include "py/obj.h"
 #include "lib/oofatfs/ff.h"
 #include "esp32/littlefs/vfs_littlefs.h"
+#include "extmod/vfs_blockcache.h"
 
 // return values of mp_vfs_lookup_path
 // ROOT is 0 so that the default current directory is the root directory
@@ -65,6 +66,9 @@ typedef struct _fs_user_mount_t {
         FATFS fatfs;
         vfs_lfs_struct_t littlefs;
     } fs;
+    #if MICROPY_VFS_BLOCKCACHE
+    vfs_blockcache_t *cache; // NULL if the blocks go straight to the device
+    #endif
 } fs_user_mount_t;
 
 typedef struct _mp_vfs_proto_t {
@@ -90,6 +94,12 @@ mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 mp_obj_t mp_vfs_chdir(mp_obj_t path_in);
 mp_obj_t mp_vfs_getcwd(void);
 mp_obj_t mp_vfs_ilistdir(size_t n_args, const mp_obj_t *args);
+// ilistdir(path) gives a 4-tuple (name, type, inode, size) for each entry,
+// ilistdir(path, True) a 5-tuple with the mtime, so that no stat() is
+// needed. The file systems take the flag as args[stat_arg].
+bool mp_vfs_ilistdir_with_stat(size_t n_args, const mp_obj_t *args, size_t stat_arg);
+mp_obj_t mp_vfs_ilistdir_entry(bool with_stat, mp_obj_t name, mp_int_t type, mp_uint_t size, mp_uint_t mtime);
+mp_obj_t mp_vfs_logrecords(mp_obj_t path_in);
 mp_obj_t mp_vfs_listdir(size_t n_args, const mp_obj_t *args);
 mp_obj_t mp_vfs_mkdir(mp_obj_t path_in);
 mp_obj_t mp_vfs_remove(mp_obj_t path_in);
@@ -98,7 +108,9 @@ mp_obj_t mp_vfs_rmdir(mp_obj_t path_in);
 mp_obj_t mp_vfs_stat(mp_obj_t path_in);
 mp_obj_t mp_vfs_statvfs(mp_obj_t path_in);
 mp_obj_t mp_vfs_getfree(mp_obj_t path_in);
-mp_obj_t mp_vfs_fsformat(mp_obj_t path_in);
+mp_obj_t mp_vfs_cachestats(mp_obj_t path_in);
+mp_obj_t mp_vfs_mmap(mp_obj_t path_in);
+mp_obj_t mp_vfs_fsformat(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args);
 
 MP_DECLARE_CONST_FUN_OBJ_KW(mp_vfs_mount_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_umount_obj);
@@ -106,6 +118,9 @@ MP_DECLARE_CONST_FUN_OBJ_KW(mp_vfs_open_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_chdir_obj);
 MP_DECLARE_CONST_FUN_OBJ_0(mp_vfs_getcwd_obj);
 MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_ilistdir_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_logrecords_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_cachestats_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_mmap_obj);
 MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_listdir_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_mkdir_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_remove_obj);
@@ -114,6 +129,6 @@ MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_rmdir_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_stat_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_statvfs_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_getfree_obj);
-MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_fsformat_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(mp_vfs_fsformat_obj);
 
 #endif // MICROPY_INCLUDED_EXTMOD_VFS_H
@@ -0,0 +1,297 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+
+#if MICROPY_VFS_BLOCKCACHE
+
+#include "extmod/vfs_blockcache.h"
+
+#define ENTRY_VALID (0x01)
+#define ENTRY_DIRTY (0x02)
+
+size_t vfs_blockcache_mem_size(uint32_t n_entries, uint32_t block_size, uint32_t readahead) {
+    if (readahead >= n_entries) {
+        readahead = n_entries - 1;
+    }
+    return n_entries * sizeof(vfs_blockcache_entry_t) + (n_entries + VFS_BLOCKCACHE_WINDOW(readahead)) * block_size;
+}
+
+void vfs_blockcache_init(vfs_blockcache_t *cache, void *mem, uint32_t n_entries, uint32_t block_size,
+    uint32_t block_count, uint32_t readahead, const vfs_blockcache_io_t *io, void *ctx) {
+    memset(cache, 0, sizeof(*cache));
+    if (readahead >= n_entries) {
+        readahead = n_entries - 1;
+    }
+    cache->entries = mem;
+    cache->data = (uint8_t*)mem + n_entries * sizeof(vfs_blockcache_entry_t);
+    cache->window_buf = cache->data + n_entries * block_size;
+    cache->n_entries = n_entries;
+    cache->window = VFS_BLOCKCACHE_WINDOW(readahead);
+    cache->readahead = readahead;
+    cache->block_size = block_size;
+    cache->block_count = block_count;
+    cache->next_block = UINT32_MAX;
+    cache->io = io;
+    cache->ctx = ctx;
+    memset(cache->entries, 0, n_entries * sizeof(vfs_blockcache_entry_t));
+}
+
+STATIC vfs_blockcache_entry_t *vfs_blockcache_find(vfs_blockcache_t *cache, uint32_t block) {
+    for (uint32_t i = 0; i < cache->n_entries; i++) {
+        vfs_blockcache_entry_t *e = &cache->entries[i];
+        if ((e->flags & ENTRY_VALID) && e->block == block) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+STATIC uint8_t *vfs_blockcache_data(vfs_blockcache_t *cache, vfs_blockcache_entry_t *e) {
+    return cache->data + (e - cache->entries) * cache->block_size;
+}
+
+STATIC uint32_t vfs_blockcache_missing(vfs_blockcache_t *cache, uint32_t block, uint32_t count) {
+    uint32_t run = 1;
+    while (run < count && vfs_blockcache_find(cache, block + run) == NULL) {
+        run++;
+    }
+    return run;
+}
+
+STATIC uint32_t vfs_blockcache_clean(vfs_blockcache_t *cache) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < cache->n_entries; i++) {
+        n += (cache->entries[i].flags & ENTRY_DIRTY) == 0;
+    }
+    return n;
+}
+
+// An entry for block: a free one, or the clean one used least recently. The
+// blocks changed stay until there are no others, and are then written out
+// all together. That uses the window buffer.
+STATIC int vfs_blockcache_take(vfs_blockcache_t *cache, uint32_t block, vfs_blockcache_entry_t **out) {
+    vfs_blockcache_entry_t *victim = NULL;
+
+    for (;;) {
+        for (uint32_t i = 0; i < cache->n_entries; i++) {
+            vfs_blockcache_entry_t *e = &cache->entries[i];
+            if (!(e->flags & ENTRY_VALID)) {
+                victim = e;
+                break;
+            }
+            if (!(e->flags & ENTRY_DIRTY) && (victim == NULL || (int32_t)(e->used - victim->used) < 0)) {
+                victim = e;
+            }
+        }
+        if (victim != NULL) {
+            break;
+        }
+        // all changed
+        int err = vfs_blockcache_sync(cache);
+        if (err != 0) {
+            return err;
+        }
+    }
+    victim->block = block;
+    victim->flags = ENTRY_VALID;
+    victim->used = ++cache->clock;
+    *out = victim;
+    return 0;
+}
+
+int vfs_blockcache_read(vfs_blockcache_t *cache, uint8_t *buf, uint32_t block, uint32_t count) {
+    const uint32_t bs = cache->block_size;
+    // reading on from where the last one ended, each miss reads ahead twice
+    // as far as the one before, up to readahead
+    bool sequential = (block == cache->next_block);
+    cache->next_block = block + count;
+    if (!sequential) {
+        cache->ahead = 0;
+    }
+
+    while (count > 0) {
+        vfs_blockcache_entry_t *e = vfs_blockcache_find(cache, block);
+        if (e != NULL) {
+            memcpy(buf, vfs_blockcache_data(cache, e), bs);
+            e->used = ++cache->clock;
+            cache->hits++;
+            buf += bs;
+            block++;
+            count--;
+            continue;
+        }
+
+        uint32_t run = vfs_blockcache_missing(cache, block, count);
+        int err;
+        cache->misses += run;
+
+        if (run >= cache->window) {
+            // would only push out the rest
+            err = cache->io->read(cache->ctx, buf, block, run);
+            if (err != 0) {
+                return err;
+            }
+            cache->device_reads++;
+        } else {
+            uint32_t n = run;
+            if (sequential && cache->readahead > 0) {
+                cache->ahead = (cache->ahead == 0) ? 1 : cache->ahead * 2;
+                if (cache->ahead > cache->readahead) {
+                    cache->ahead = cache->readahead;
+                }
+                n = run + cache->ahead;
+                if (n > cache->window) {
+                    n = cache->window;
+                }
+                if (cache->block_count != 0 && block + n > cache->block_count) {
+                    n = (cache->block_count - block > run) ? cache->block_count - block : run;
+                }
+            }
+            // so that taking the entries below doesn't write into the window buffer
+            if (vfs_blockcache_clean(cache) < n) {
+                err = vfs_blockcache_sync(cache);
+                if (err != 0) {
+                    return err;
+                }
+            }
+            err = cache->io->read(cache->ctx, cache->window_buf, block, n);
+            if (err != 0 && n > run) {
+                // maybe past the end of the device
+                n = run;
+                err = cache->io->read(cache->ctx, cache->window_buf, block, n);
+            }
+            if (err != 0) {
+                return err;
+            }
+            cache->device_reads++;
+            cache->read_ahead += n - run;
+
+            for (uint32_t i = 0; i < n; i++) {
+                if (i >= run && vfs_blockcache_find(cache, block + i) != NULL) {
+                    // here already, and maybe changed
+                    continue;
+                }
+                // a clean one, so it can't fail
+                vfs_blockcache_take(cache, block + i, &e);
+                memcpy(vfs_blockcache_data(cache, e), cache->window_buf + i * bs, bs);
+            }
+            memcpy(buf, cache->window_buf, run * bs);
+        }
+        buf += run * bs;
+        block += run;
+        count -= run;
+    }
+    return 0;
+}
+
+int vfs_blockcache_write(vfs_blockcache_t *cache, const uint8_t *buf, uint32_t block, uint32_t count) {
+    const uint32_t bs = cache->block_size;
+
+    while (count > 0) {
+        vfs_blockcache_entry_t *e = vfs_blockcache_find(cache, block);
+        uint32_t n = 1;
+        if (e == NULL) {
+            n = vfs_blockcache_missing(cache, block, count);
+            if (n >= cache->window) {
+                int err = cache->io->write(cache->ctx, buf, block, n);
+                if (err != 0) {
+                    return err;
+                }
+                cache->device_writes++;
+                buf += n * bs;
+                block += n;
+                count -= n;
+                continue;
+            }
+            n = 1;
+            int err = vfs_blockcache_take(cache, block, &e);
+            if (err != 0) {
+                return err;
+            }
+        }
+        memcpy(vfs_blockcache_data(cache, e), buf, bs);
+        e->flags |= ENTRY_DIRTY;
+        e->used = ++cache->clock;
+        buf += bs;
+        block++;
+        count--;
+    }
+    return 0;
+}
+
+int vfs_blockcache_sync(vfs_blockcache_t *cache) {
+    const uint32_t bs = cache->block_size;
+
+    for (;;) {
+        // the first block changed, and those right after it
+        vfs_blockcache_entry_t *first = NULL;
+        for (uint32_t i = 0; i < cache->n_entries; i++) {
+            vfs_blockcache_entry_t *e = &cache->entries[i];
+            if ((e->flags & ENTRY_DIRTY) && (first == NULL || e->block < first->block)) {
+                first = e;
+            }
+        }
+        if (first == NULL) {
+            return 0;
+        }
+
+        uint32_t block = first->block;
+        uint32_t n = 0;
+        vfs_blockcache_entry_t *e;
+        while (n < cache->window && (e = vfs_blockcache_find(cache, block + n)) != NULL && (e->flags & ENTRY_DIRTY)) {
+            memcpy(cache->window_buf + n * bs, vfs_blockcache_data(cache, e), bs);
+            n++;
+        }
+        int err = cache->io->write(cache->ctx, cache->window_buf, block, n);
+        if (err != 0) {
+            return err;
+        }
+        cache->device_writes++;
+        cache->written_back += n;
+        for (uint32_t i = 0; i < n; i++) {
+            vfs_blockcache_find(cache, block + i)->flags &= ~ENTRY_DIRTY;
+        }
+    }
+}
+
+void vfs_blockcache_invalidate(vfs_blockcache_t *cache, uint32_t block, uint32_t count) {
+    for (uint32_t i = 0; i < cache->n_entries; i++) {
+        vfs_blockcache_entry_t *e = &cache->entries[i];
+        if ((e->flags & ENTRY_VALID) && e->block - block < count) {
+            e->flags = 0;
+        }
+    }
+    if (cache->next_block - block < count) {
+        cache->next_block = UINT32_MAX;
+    }
+}
+
+#endif // MICROPY_VFS_BLOCKCACHE
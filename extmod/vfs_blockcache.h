@@ -0,0 +1,94 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_BLOCKCACHE_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_BLOCKCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// A cache of the blocks of a mounted device, the least recently used going
+// first. A read that misses and carries on from where the previous one ended
+// reads the next blocks too, in the same request. Writes stay in the cache
+// until vfs_blockcache_sync(), or until the block is evicted, and are written
+// out in runs of consecutive blocks. Runs of blocks not in the cache as long
+// as the window go straight to the device.
+
+#define VFS_BLOCKCACHE_WINDOW_MIN   (4)
+
+// blocks read or written in one request at most, with the readahead given
+#define VFS_BLOCKCACHE_WINDOW(readahead) \
+    ((readahead) + 1 > VFS_BLOCKCACHE_WINDOW_MIN ? (readahead) + 1 : VFS_BLOCKCACHE_WINDOW_MIN)
+
+typedef struct _vfs_blockcache_io_t {
+    // both return 0 or an error, that's passed on
+    int (*read)(void *ctx, uint8_t *buf, uint32_t block, uint32_t count);
+    int (*write)(void *ctx, const uint8_t *buf, uint32_t block, uint32_t count);
+} vfs_blockcache_io_t;
+
+typedef struct _vfs_blockcache_entry_t {
+    uint32_t block;
+    uint32_t used;              // when, for the LRU
+    uint8_t flags;
+} vfs_blockcache_entry_t;
+
+typedef struct _vfs_blockcache_t {
+    vfs_blockcache_entry_t *entries;
+    uint8_t *data;              // entries * block_size
+    uint8_t *window_buf;        // window * block_size
+    uint32_t n_entries;
+    uint32_t window;
+    uint32_t readahead;
+    uint32_t block_size;
+    uint32_t block_count;       // 0 if not known, the readahead then stops at errors
+    uint32_t clock;
+    uint32_t next_block;        // where a sequential read goes on
+    uint32_t ahead;             // blocks read ahead at the last miss
+    const vfs_blockcache_io_t *io;
+    void *ctx;
+
+    // counters, in blocks but for the requests to the device
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t read_ahead;        // read before they were asked for
+    uint32_t written_back;
+    uint32_t device_reads;
+    uint32_t device_writes;
+} vfs_blockcache_t;
+
+// the bytes needed for a cache of n_entries, handed to init in one piece
+size_t vfs_blockcache_mem_size(uint32_t n_entries, uint32_t block_size, uint32_t readahead);
+void vfs_blockcache_init(vfs_blockcache_t *cache, void *mem, uint32_t n_entries, uint32_t block_size,
+    uint32_t block_count, uint32_t readahead, const vfs_blockcache_io_t *io, void *ctx);
+
+int vfs_blockcache_read(vfs_blockcache_t *cache, uint8_t *buf, uint32_t block, uint32_t count);
+int vfs_blockcache_write(vfs_blockcache_t *cache, const uint8_t *buf, uint32_t block, uint32_t count);
+// writes out the blocks changed
+int vfs_blockcache_sync(vfs_blockcache_t *cache);
+// forgets the blocks given, changed or not, for a device written around the cache
+void vfs_blockcache_invalidate(vfs_blockcache_t *cache, uint32_t block, uint32_t count);
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_BLOCKCACHE_H
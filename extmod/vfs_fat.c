@@ -36,7 +36,9 @@
 #include "py/runtime.h"
 #include "py/mperrno.h"
 #include "lib/oofatfs/ff.h"
+#include "lib/oofatfs/diskio.h"
 #include "extmod/vfs_fat.h"
+#include "extmod/vfs_mmap.h"
 #include "lib/timeutils/timeutils.h"
 
 #if FF_MAX_SS == FF_MIN_SS
@@ -72,6 +74,9 @@ STATIC mp_obj_t fat_vfs_make_new(const mp_obj_type_t *type, size_t n_args, size_
     vfs->base.type = type;
     vfs->flags = FSUSER_FREE_OBJ;
     vfs->fs.fatfs.drv = vfs;
+    #if MICROPY_VFS_BLOCKCACHE
+    vfs->cache = NULL;
+    #endif
 
     // load block protocol methods
     mp_load_method(args[0], MP_QSTR_readblocks, vfs->readblocks);
@@ -158,10 +163,22 @@ STATIC FRESULT fat_format(fs_user_mount_t* vfs)
 typedef struct _mp_vfs_fat_ilistdir_it_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
+    bool with_stat;
     bool is_str;
     FF_DIR dir;
 } mp_vfs_fat_ilistdir_it_t;
 
+STATIC mp_uint_t fat_vfs_seconds(const FILINFO *fno) {
+    return timeutils_seconds_since_2000(
+        1980 + ((fno->fdate >> 9) & 0x7f),
+        (fno->fdate >> 5) & 0x0f,
+        fno->fdate & 0x1f,
+        (fno->ftime >> 11) & 0x1f,
+        (fno->ftime >> 5) & 0x3f,
+        2 * (fno->ftime & 0x1f)
+    );
+}
+
 STATIC mp_obj_t mp_vfs_fat_ilistdir_it_iternext(mp_obj_t self_in) {
     mp_vfs_fat_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
 
@@ -176,24 +193,16 @@ STATIC mp_obj_t mp_vfs_fat_ilistdir_it_iternext(mp_obj_t self_in) {
 
         // Note that FatFS already filters . and .., so we don't need to
 
-        // make 4-tuple with info about this entry
-        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(4, NULL));
+        // the directory entry has the date too, stat() would look it up again
+        mp_obj_t name;
         if (self->is_str) {
-            t->items[0] = mp_obj_new_str(fn, strlen(fn));
+            name = mp_obj_new_str(fn, strlen(fn));
         } else {
-            t->items[0] = mp_obj_new_bytes((const byte*)fn, strlen(fn));
+            name = mp_obj_new_bytes((const byte*)fn, strlen(fn));
         }
-        if (fno.fattrib & AM_DIR) {
-            // dir
-            t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR);
-        } else {
-            // file
-            t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFREG);
-        }
-        t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
-        t->items[3] = mp_obj_new_int_from_uint(fno.fsize);
-
-        return MP_OBJ_FROM_PTR(t);
+        return mp_vfs_ilistdir_entry(self->with_stat, name,
+            (fno.fattrib & AM_DIR) ? MP_S_IFDIR : MP_S_IFREG, fno.fsize,
+            self->with_stat ? fat_vfs_seconds(&fno) : 0);
     }
 
     // ignore error because we may be closing a second time
@@ -206,7 +215,7 @@ STATIC mp_obj_t fat_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
     mp_obj_fat_vfs_t *self = MP_OBJ_TO_PTR(args[0]);
     bool is_str_type = true;
     const char *path;
-    if (n_args == 2) {
+    if (n_args >= 2) {
         if (mp_obj_get_type(args[1]) == &mp_type_bytes) {
             is_str_type = false;
         }
@@ -219,6 +228,7 @@ STATIC mp_obj_t fat_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
     mp_vfs_fat_ilistdir_it_t *iter = m_new_obj(mp_vfs_fat_ilistdir_it_t);
     iter->base.type = &mp_type_polymorph_iter;
     iter->iternext = mp_vfs_fat_ilistdir_it_iternext;
+    iter->with_stat = mp_vfs_ilistdir_with_stat(n_args, args, 2);
     iter->is_str = is_str_type;
     FRESULT res = f_opendir(&self->fs.fatfs, &iter->dir, path);
     if (res != FR_OK) {
@@ -227,7 +237,7 @@ STATIC mp_obj_t fat_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
 
     return MP_OBJ_FROM_PTR(iter);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_ilistdir_obj, 1, 2, fat_vfs_ilistdir_func);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_ilistdir_obj, 1, 3, fat_vfs_ilistdir_func);
 
 STATIC mp_obj_t fat_vfs_remove_internal(mp_obj_t vfs_in, mp_obj_t path_in, mp_int_t attr) {
     mp_obj_fat_vfs_t *self = MP_OBJ_TO_PTR(vfs_in);
@@ -350,14 +360,7 @@ STATIC mp_obj_t fat_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_in) {
     } else {
         mode |= MP_S_IFREG;
     }
-    mp_int_t seconds = timeutils_seconds_since_2000(
-        1980 + ((fno.fdate >> 9) & 0x7f),
-        (fno.fdate >> 5) & 0x0f,
-        fno.fdate & 0x1f,
-        (fno.ftime >> 11) & 0x1f,
-        (fno.ftime >> 5) & 0x3f,
-        2 * (fno.ftime & 0x1f)
-    );
+    mp_int_t seconds = fat_vfs_seconds(&fno);
     t->items[0] = MP_OBJ_NEW_SMALL_INT(mode); // st_mode
     t->items[1] = MP_OBJ_NEW_SMALL_INT(0); // st_ino
     t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // st_dev
@@ -426,6 +429,61 @@ STATIC mp_obj_t fat_vfs_getfree(mp_obj_t vfs_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(fat_vfs_getfree_obj, fat_vfs_getfree);
 
+#if MICROPY_VFS_MMAP
+// A file whose clusters follow each other, on a block device that maps its
+// blocks with mmap(block, len)
+STATIC mp_obj_t fat_vfs_mmap(mp_obj_t vfs_in, mp_obj_t path_in) {
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
+    FATFS *fatfs = &self->fs.fatfs;
+    const char *path = mp_obj_str_get_str(path_in);
+    mp_obj_t meth[4];
+
+    // readblocks[1] is the block device
+    mp_load_method_maybe(self->readblocks[1], MP_QSTR_mmap, meth);
+    if (meth[0] == MP_OBJ_NULL) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+
+    FIL fp;
+    FRESULT res = f_open(fatfs, &fp, path, FA_READ);
+    if (res != FR_OK) {
+        mp_raise_OSError(fresult_to_errno_table[res]);
+    }
+    #if FF_MAX_SS != FF_MIN_SS
+    FSIZE_t cluster_size = (FSIZE_t)fatfs->csize * fatfs->ssize;
+    #else
+    FSIZE_t cluster_size = (FSIZE_t)fatfs->csize * FF_MIN_SS;
+    #endif
+    FSIZE_t size = f_size(&fp);
+    DWORD first = fp.obj.sclust;
+    bool contiguous = true;
+    // just past the start of each cluster, where f_lseek() takes it on
+    for (FSIZE_t ofs = cluster_size; ofs < size && contiguous && res == FR_OK; ofs += cluster_size) {
+        res = f_lseek(&fp, ofs + 1);
+        contiguous = (fp.clust == first + ofs / cluster_size);
+    }
+    f_close(&fp);
+    if (res != FR_OK) {
+        mp_raise_OSError(fresult_to_errno_table[res]);
+    }
+    if (!contiguous) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+    if (size == 0) {
+        return mp_vfs_mmap_new("", 0, NULL, 0);
+    }
+
+    // what's in the caches goes to the device first
+    if (disk_ioctl(self, CTRL_SYNC, NULL) != RES_OK) {
+        mp_raise_OSError(MP_EIO);
+    }
+    meth[2] = mp_obj_new_int_from_uint(fatfs->database + (first - 2) * fatfs->csize);
+    meth[3] = mp_obj_new_int_from_uint(size);
+    return mp_call_method_n_kw(2, 0, meth);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(fat_vfs_mmap_obj, fat_vfs_mmap);
+#endif
+
 STATIC mp_obj_t vfs_fat_mount(mp_obj_t self_in, mp_obj_t readonly, mp_obj_t mkfs) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
 
@@ -454,7 +512,12 @@ STATIC mp_obj_t vfs_fat_mount(mp_obj_t self_in, mp_obj_t readonly, mp_obj_t mkfs
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(vfs_fat_mount_obj, vfs_fat_mount);
 
 STATIC mp_obj_t vfs_fat_umount(mp_obj_t self_in) {
+    #if MICROPY_VFS_BLOCKCACHE
+    // write out what the cache holds, and go without it from now on
+    fat_vfs_set_cache(MP_OBJ_TO_PTR(self_in), 0, 0);
+    #else
     (void)self_in;
+    #endif
     // keep the FAT filesystem mounted internally so the VFS methods can still be used
     return mp_const_none;
 }
@@ -491,6 +554,9 @@ STATIC const mp_rom_map_elem_t fat_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_stat), MP_ROM_PTR(&fat_vfs_stat_obj) },
     { MP_ROM_QSTR(MP_QSTR_statvfs), MP_ROM_PTR(&fat_vfs_statvfs_obj) },
     { MP_ROM_QSTR(MP_QSTR_getfree), MP_ROM_PTR(&fat_vfs_getfree_obj) },
+    #if MICROPY_VFS_MMAP
+    { MP_ROM_QSTR(MP_QSTR_mmap), MP_ROM_PTR(&fat_vfs_mmap_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_mount), MP_ROM_PTR(&vfs_fat_mount_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount), MP_ROM_PTR(&fat_vfs_umount_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_fsformat), MP_ROM_PTR(&fat_vfs_fsformat_obj) },
@@ -42,6 +42,11 @@ extern const mp_obj_type_t mp_fat_vfs_type;
 extern const mp_obj_type_t mp_type_vfs_fat_fileio;
 extern const mp_obj_type_t mp_type_vfs_fat_textio;
 
-MP_DECLARE_CONST_FUN_OBJ_3(fat_vfs_open_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_open_obj);
+
+#if MICROPY_VFS_BLOCKCACHE
+// blocks == 0 goes without, the blocks changed are written out first
+void fat_vfs_set_cache(fs_user_mount_t *vfs, mp_uint_t blocks, mp_uint_t readahead);
+#endif
 
 #endif // MICROPY_INCLUDED_EXTMOD_VFS_FAT_H
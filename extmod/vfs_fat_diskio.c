@@ -36,6 +36,7 @@
 #include "py/mphal.h"
 
 #include "py/runtime.h"
+#include "py/mperrno.h"
 #include "py/binary.h"
 #include "py/objarray.h"
 #include "lib/oofatfs/ff.h"
@@ -53,6 +54,81 @@ STATIC fs_user_mount_t *disk_get_device(void *bdev) {
     return (fs_user_mount_t*)bdev;
 }
 
+STATIC DRESULT disk_read_device(fs_user_mount_t *vfs, BYTE *buff, DWORD sector, UINT count) {
+    if (vfs->flags & FSUSER_NATIVE) {
+        mp_uint_t (*f)(uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->readblocks[2];
+        if (f(buff, sector, count) != 0) {
+            return RES_ERROR;
+        }
+    } else {
+        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fs.fatfs), buff};
+        vfs->readblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
+        vfs->readblocks[3] = MP_OBJ_FROM_PTR(&ar);
+        mp_call_method_n_kw(2, 0, vfs->readblocks);
+        // TODO handle error return
+    }
+
+    return RES_OK;
+}
+
+STATIC DRESULT disk_write_device(fs_user_mount_t *vfs, const BYTE *buff, DWORD sector, UINT count) {
+    if (vfs->flags & FSUSER_NATIVE) {
+        mp_uint_t (*f)(const uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->writeblocks[2];
+        if (f(buff, sector, count) != 0) {
+            return RES_ERROR;
+        }
+    } else {
+        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fs.fatfs), (void*)buff};
+        vfs->writeblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
+        vfs->writeblocks[3] = MP_OBJ_FROM_PTR(&ar);
+        mp_call_method_n_kw(2, 0, vfs->writeblocks);
+        // TODO handle error return
+    }
+
+    return RES_OK;
+}
+
+#if MICROPY_VFS_BLOCKCACHE
+
+STATIC int disk_cache_read(void *ctx, uint8_t *buf, uint32_t block, uint32_t count) {
+    return disk_read_device(ctx, buf, block, count);
+}
+
+STATIC int disk_cache_write(void *ctx, const uint8_t *buf, uint32_t block, uint32_t count) {
+    return disk_write_device(ctx, buf, block, count);
+}
+
+STATIC const vfs_blockcache_io_t disk_cache_io = {
+    .read = disk_cache_read,
+    .write = disk_cache_write,
+};
+
+void fat_vfs_set_cache(fs_user_mount_t *vfs, mp_uint_t blocks, mp_uint_t readahead) {
+    if (vfs->cache != NULL) {
+        if (vfs_blockcache_sync(vfs->cache) != 0) {
+            mp_raise_OSError(MP_EIO);
+        }
+        vfs->cache = NULL;
+    }
+    if (blocks == 0) {
+        return;
+    }
+
+    // blocks past the end aren't read ahead, it stops at the sector count
+    DWORD sector_count = 0;
+    if (disk_ioctl(vfs, GET_SECTOR_COUNT, &sector_count) != RES_OK) {
+        sector_count = 0;
+    }
+    uint32_t sector_size = SECSIZE(&vfs->fs.fatfs);
+
+    vfs_blockcache_t *cache = m_new_obj(vfs_blockcache_t);
+    void *mem = m_new(uint8_t, vfs_blockcache_mem_size(blocks, sector_size, readahead));
+    vfs_blockcache_init(cache, mem, blocks, sector_size, sector_count, readahead, &disk_cache_io, vfs);
+    vfs->cache = cache;
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
@@ -69,20 +145,13 @@ DRESULT disk_read (
         return RES_PARERR;
     }
 
-    if (vfs->flags & FSUSER_NATIVE) {
-        mp_uint_t (*f)(uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->readblocks[2];
-        if (f(buff, sector, count) != 0) {
-            return RES_ERROR;
-        }
-    } else {
-        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), buff};
-        vfs->readblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
-        vfs->readblocks[3] = MP_OBJ_FROM_PTR(&ar);
-        mp_call_method_n_kw(2, 0, vfs->readblocks);
-        // TODO handle error return
+    #if MICROPY_VFS_BLOCKCACHE
+    if (vfs->cache != NULL) {
+        return vfs_blockcache_read(vfs->cache, buff, sector, count);
     }
+    #endif
 
-    return RES_OK;
+    return disk_read_device(vfs, buff, sector, count);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -106,20 +175,13 @@ DRESULT disk_write (
         return RES_WRPRT;
     }
 
-    if (vfs->flags & FSUSER_NATIVE) {
-        mp_uint_t (*f)(const uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->writeblocks[2];
-        if (f(buff, sector, count) != 0) {
-            return RES_ERROR;
-        }
-    } else {
-        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), (void*)buff};
-        vfs->writeblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
-        vfs->writeblocks[3] = MP_OBJ_FROM_PTR(&ar);
-        mp_call_method_n_kw(2, 0, vfs->writeblocks);
-        // TODO handle error return
+    #if MICROPY_VFS_BLOCKCACHE
+    if (vfs->cache != NULL) {
+        return vfs_blockcache_write(vfs->cache, buff, sector, count);
     }
+    #endif
 
-    return RES_OK;
+    return disk_write_device(vfs, buff, sector, count);
 }
 
 
@@ -138,6 +200,13 @@ DRESULT disk_ioctl (
         return RES_PARERR;
     }
 
+    #if MICROPY_VFS_BLOCKCACHE
+    // the blocks changed go first
+    if (cmd == CTRL_SYNC && vfs->cache != NULL && vfs_blockcache_sync(vfs->cache) != 0) {
+        return RES_ERROR;
+    }
+    #endif
+
     // First part: call the relevant method of the underlying block device
     mp_obj_t ret = mp_const_none;
     if (vfs->flags & FSUSER_HAVE_IOCTL) {
@@ -196,7 +265,7 @@ DRESULT disk_ioctl (
             }
             #if FF_MAX_SS != FF_MIN_SS
             // need to store ssize because we use it in disk_read/disk_write
-            vfs->fatfs.ssize = *((WORD*)buff);
+            vfs->fs.fatfs.ssize = *((WORD*)buff);
             #endif
             return RES_OK;
         }
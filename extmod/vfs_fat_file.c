@@ -32,8 +32,10 @@
 #include "py/runtime.h"
 #include "py/stream.h"
 #include "py/mperrno.h"
+#include "py/mphal.h"
 #include "lib/oofatfs/ff.h"
 #include "extmod/vfs_fat.h"
+#include "extmod/vfs_log.h"
 
 // this table converts from FRESULT to POSIX errno
 const byte fresult_to_errno_table[20] = {
@@ -62,6 +64,9 @@ const byte fresult_to_errno_table[20] = {
 typedef struct _pyb_file_obj_t {
     mp_obj_base_t base;
     FIL fp;
+    #if MICROPY_VFS_LOG
+    vfs_log_t log;
+    #endif
 } pyb_file_obj_t;
 
 STATIC void file_obj_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
@@ -80,8 +85,46 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
     return sz_out;
 }
 
+#if MICROPY_VFS_LOG
+STATIC int file_log_write(void *ctx, const void *buf, size_t len, size_t *written) {
+    pyb_file_obj_t *self = ctx;
+    UINT sz_out = 0;
+    FRESULT res = f_write(&self->fp, buf, len, &sz_out);
+    *written = sz_out;
+    if (res != FR_OK) {
+        return fresult_to_errno_table[res];
+    }
+    return (sz_out == len) ? 0 : MP_ENOSPC;
+}
+
+STATIC int file_log_sync(void *ctx) {
+    pyb_file_obj_t *self = ctx;
+    return fresult_to_errno_table[f_sync(&self->fp)];
+}
+
+STATIC const vfs_log_io_t file_log_io = {
+    .write = file_log_write,
+    .sync = file_log_sync,
+};
+#endif
+
 STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    #if MICROPY_VFS_LOG
+    if (self->log.buf != NULL) {
+        // one write() is one record
+        if (size > VFS_LOG_RECORD_MAX) {
+            *errcode = MP_EINVAL;
+            return MP_STREAM_ERROR;
+        }
+        int res = (size == 0) ? 0 : vfs_log_append(&self->log, buf, size, mp_hal_ticks_ms());
+        if (res != 0) {
+            *errcode = res;
+            return MP_STREAM_ERROR;
+        }
+        return size;
+    }
+    #endif
     UINT sz_out;
     FRESULT res = f_write(&self->fp, buf, size, &sz_out);
     if (res != FR_OK) {
@@ -106,6 +149,28 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(file_obj___exit___obj, 4, 4, file_obj
 STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode) {
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(o_in);
 
+    #if MICROPY_VFS_LOG
+    // the records buffered are written out before a seek, flush or close
+    if (self->log.buf != NULL && (request == MP_STREAM_SEEK || request == MP_STREAM_FLUSH || request == MP_STREAM_CLOSE)) {
+        int res = vfs_log_flush(&self->log);
+        if (request == MP_STREAM_CLOSE) {
+            m_del(byte, self->log.buf, self->log.size);
+            self->log.buf = NULL;
+        }
+        if (res != 0) {
+            if (request == MP_STREAM_CLOSE) {
+                f_close(&self->fp);
+            }
+            *errcode = res;
+            return MP_STREAM_ERROR;
+        }
+        if (request == MP_STREAM_FLUSH) {
+            // the log has synced already
+            return 0;
+        }
+    }
+    #endif
+
     if (request == MP_STREAM_SEEK) {
         struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
@@ -160,8 +225,9 @@ STATIC const mp_arg_t file_open_args[] = {
 };
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
 
-STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args) {
+STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args, mp_int_t buffering) {
     int mode = 0;
+    bool binary = false;
     const char *mode_s = mp_obj_str_get_str(args[1].u_obj);
     // TODO make sure only one of r, w, x, a, and b, t are specified
     while (*mode_s) {
@@ -184,6 +250,7 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
             #if MICROPY_PY_IO_FILEIO
             case 'b':
                 type = &mp_type_vfs_fat_fileio;
+                binary = true;
                 break;
             #endif
             case 't':
@@ -208,13 +275,24 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
         f_lseek(&o->fp, f_size(&o->fp));
     }
 
+    #if MICROPY_VFS_LOG
+    // open(path, 'ab', buffering=N) makes a log file, see extmod/vfs_log.h
+    o->log.buf = NULL;
+    if (binary && (mode & (FA_OPEN_ALWAYS | FA_READ)) == FA_OPEN_ALWAYS && buffering >= VFS_LOG_BUFFER_MIN) {
+        vfs_log_init(&o->log, m_new(byte, buffering), buffering, MICROPY_VFS_LOG_INTERVAL_MS, &file_log_io, o);
+    }
+    #else
+    (void)binary;
+    (void)buffering;
+    #endif
+
     return MP_OBJ_FROM_PTR(o);
 }
 
 STATIC mp_obj_t file_obj_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
     mp_arg_parse_all_kw_array(n_args, n_kw, args, FILE_OPEN_NUM_ARGS, file_open_args, arg_vals);
-    return file_open(NULL, type, arg_vals);
+    return file_open(NULL, type, arg_vals, -1);
 }
 
 // TODO gc hook to close the file if not already closed
@@ -274,15 +352,15 @@ const mp_obj_type_t mp_type_vfs_fat_textio = {
 };
 
 // Factory function for I/O stream classes
-STATIC mp_obj_t fatfs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-    // TODO: analyze buffering args and instantiate appropriate type
-    fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+STATIC mp_obj_t fatfs_builtin_open_self(size_t n_args, const mp_obj_t *args) {
+    // TODO: analyze buffering args and instantiate appropriate type, only log files use it
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
-    arg_vals[0].u_obj = path;
-    arg_vals[1].u_obj = mode;
+    arg_vals[0].u_obj = args[1];
+    arg_vals[1].u_obj = args[2];
     arg_vals[2].u_obj = mp_const_none;
-    return file_open(self, &mp_type_vfs_fat_textio, arg_vals);
+    return file_open(self, &mp_type_vfs_fat_textio, arg_vals, (n_args > 3) ? mp_obj_get_int(args[3]) : -1);
 }
-MP_DEFINE_CONST_FUN_OBJ_3(fat_vfs_open_obj, fatfs_builtin_open_self);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_open_obj, 3, 4, fatfs_builtin_open_self);
 
 #endif // MICROPY_VFS && MICROPY_VFS_FAT
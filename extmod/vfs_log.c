@@ -0,0 +1,160 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/mpconfig.h"
+
+#if MICROPY_VFS_LOG
+
+#include "extmod/vfs_log.h"
+
+STATIC uint16_t vfs_log_crc16(uint16_t crc, const uint8_t *p, size_t len) {
+    while (len--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void vfs_log_init(vfs_log_t *log, uint8_t *buf, size_t size, uint32_t interval_ms, const vfs_log_io_t *io, void *ctx) {
+    log->buf = buf;
+    log->size = size;
+    log->len = 0;
+    log->written = 0;
+    log->unsynced = false;
+    log->oldest_ms = 0;
+    log->interval_ms = interval_ms;
+    log->io = io;
+    log->ctx = ctx;
+}
+
+void vfs_log_header(uint8_t *hdr, const void *data, size_t len) {
+    hdr[0] = VFS_LOG_SYNC;
+    hdr[1] = len;
+    hdr[2] = len >> 8;
+    uint16_t crc = vfs_log_crc16(0xffff, hdr + 1, 2);
+    crc = vfs_log_crc16(crc, data, len);
+    hdr[3] = crc;
+    hdr[4] = crc >> 8;
+}
+
+int32_t vfs_log_parse(const uint8_t *p, size_t avail) {
+    if (avail < 1) {
+        return 0;
+    }
+    if (p[0] != VFS_LOG_SYNC) {
+        return -1;
+    }
+    if (avail < VFS_LOG_HEADER_SIZE) {
+        return 0;
+    }
+    size_t len = p[1] | (p[2] << 8);
+    if (avail < VFS_LOG_HEADER_SIZE + len) {
+        return 0;
+    }
+    uint16_t crc = vfs_log_crc16(0xffff, p + 1, 2);
+    crc = vfs_log_crc16(crc, p + VFS_LOG_HEADER_SIZE, len);
+    if (crc != (p[3] | (p[4] << 8))) {
+        return -1;
+    }
+    return VFS_LOG_HEADER_SIZE + len;
+}
+
+int vfs_log_flush(vfs_log_t *log) {
+    if (log->len != 0) {
+        // after a failure, on from what went to the file already
+        size_t n = 0;
+        int err = log->io->write(log->ctx, log->buf + log->written, log->len - log->written, &n);
+        log->written += n;
+        if (err != 0) {
+            return err;
+        }
+        log->len = 0;
+        log->written = 0;
+        log->unsynced = true;
+    }
+    if (!log->unsynced) {
+        return 0;
+    }
+    int err = log->io->sync(log->ctx);
+    if (err == 0) {
+        log->unsynced = false;
+    }
+    return err;
+}
+
+int vfs_log_append(vfs_log_t *log, const void *data, size_t len, uint32_t now_ms) {
+    size_t total = VFS_LOG_HEADER_SIZE + len;
+    int err;
+
+    if (log->len + total > log->size) {
+        // the room is made once the records are written, committed or not
+        err = vfs_log_flush(log);
+        if (err != 0 && log->len != 0) {
+            return err;
+        }
+    }
+
+    if (total > log->size) {
+        // larger than the buffer, straight to the file; torn, the readers skip it
+        uint8_t hdr[VFS_LOG_HEADER_SIZE];
+        size_t n;
+        vfs_log_header(hdr, data, len);
+        err = log->io->write(log->ctx, hdr, sizeof(hdr), &n);
+        if (err == 0) {
+            err = log->io->write(log->ctx, data, len, &n);
+        }
+        if (err != 0) {
+            return err;
+        }
+        log->unsynced = true;
+        return vfs_log_flush(log);
+    }
+
+    if (log->len == 0) {
+        log->oldest_ms = now_ms;
+    }
+    vfs_log_header(log->buf + log->len, data, len);
+    memcpy(log->buf + log->len + VFS_LOG_HEADER_SIZE, data, len);
+    log->len += total;
+
+    // no room for another record, or the first one waited long enough
+    if (log->len + VFS_LOG_HEADER_SIZE > log->size || now_ms - log->oldest_ms >= log->interval_ms) {
+        err = vfs_log_flush(log);
+        if (err != 0 && log->len != 0 && log->written <= log->len - total) {
+            // none of it in the file, not taken then, so that writing it
+            // again doesn't log it twice
+            log->len -= total;
+            return err;
+        }
+    }
+    return 0;
+}
+
+#endif // MICROPY_VFS_LOG
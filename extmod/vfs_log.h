@@ -0,0 +1,83 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_LOG_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Log files: open(path, 'ab', buffering=N) keeps the records written in a
+// buffer of N bytes and writes them out, and commits, in one go when the
+// buffer is full, when the first of them is MICROPY_VFS_LOG_INTERVAL_MS old
+// at the next write, on flush() and on close(). Each write() is one record:
+//
+//     0xA5 | length (16 bits LE) | CRC-16/CCITT of length and data (LE) | data
+//
+// so a record torn by a reset is recognised, skipped, and the ones after it
+// are found again, see uos.logrecords().
+
+#define VFS_LOG_SYNC            (0xA5)
+#define VFS_LOG_HEADER_SIZE     (5)
+#define VFS_LOG_RECORD_MAX      (0xffff)
+#define VFS_LOG_BUFFER_MIN      (64)
+
+typedef struct _vfs_log_io_t {
+    // both return 0 or an errno, write() sets *written to the bytes that went
+    // to the file, failing or not
+    int (*write)(void *ctx, const void *buf, size_t len, size_t *written);
+    int (*sync)(void *ctx);
+} vfs_log_io_t;
+
+typedef struct _vfs_log_t {
+    uint8_t *buf;               // NULL if the file isn't a log
+    size_t size;
+    size_t len;                 // of the records in the buffer
+    size_t written;             // of those, the bytes in the file already
+    bool unsynced;              // written out, not committed yet
+    uint32_t oldest_ms;         // when the first of them came
+    uint32_t interval_ms;
+    const vfs_log_io_t *io;
+    void *ctx;
+} vfs_log_t;
+
+void vfs_log_init(vfs_log_t *log, uint8_t *buf, size_t size, uint32_t interval_ms, const vfs_log_io_t *io, void *ctx);
+// len up to VFS_LOG_RECORD_MAX. A record that fits the buffer is taken unless
+// an error is returned, and then no part of it went to the file; once a part
+// did, the rest goes on the next flush, and a commit that failed is done again
+// then. A larger record is written straight to the file and committed: an
+// error means it may be there torn, which the readers skip, or whole but not
+// committed.
+int vfs_log_append(vfs_log_t *log, const void *data, size_t len, uint32_t now_ms);
+int vfs_log_flush(vfs_log_t *log);
+
+void vfs_log_header(uint8_t *hdr, const void *data, size_t len);
+// the size of the record at p, header included, 0 if more than avail bytes
+// are needed to tell, -1 if no record starts at p
+int32_t vfs_log_parse(const uint8_t *p, size_t avail);
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_LOG_H
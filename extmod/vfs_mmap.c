@@ -0,0 +1,170 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mperrno.h"
+
+#if MICROPY_VFS_MMAP
+
+#include "extmod/vfs_mmap.h"
+
+#if MICROPY_VFS_MMAP_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+mp_obj_t mp_vfs_mmap_new(const void *data, size_t len,
+    void (*unmap)(const uint8_t *data, size_t len, uintptr_t handle), uintptr_t handle) {
+    mp_obj_vfs_mmap_t *self = m_new_obj_with_finaliser(mp_obj_vfs_mmap_t);
+    self->base.type = &mp_type_vfs_mmap;
+    self->data = data;
+    self->len = len;
+    self->unmap = unmap;
+    self->handle = handle;
+    self->closed = false;
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC void vfs_mmap_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    (void)kind;
+    mp_obj_vfs_mmap_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->closed) {
+        mp_print_str(print, "<mmap closed>");
+    } else {
+        mp_printf(print, "<mmap %u bytes at %p>", (unsigned)self->len, self->data);
+    }
+}
+
+STATIC mp_obj_t vfs_mmap_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    mp_obj_vfs_mmap_t *self = MP_OBJ_TO_PTR(self_in);
+    size_t len = self->closed ? 0 : self->len;
+    switch (op) {
+        case MP_UNARY_OP_BOOL: return mp_obj_new_bool(len != 0);
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+STATIC mp_int_t vfs_mmap_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags) {
+    mp_obj_vfs_mmap_t *self = MP_OBJ_TO_PTR(self_in);
+    if ((flags & MP_BUFFER_WRITE) || self->closed) {
+        // closed
+        return 1;
+    }
+    bufinfo->buf = (void*)self->data;
+    bufinfo->len = self->len;
+    bufinfo->typecode = 'B';
+    return 0;
+}
+
+STATIC mp_obj_t vfs_mmap_close(mp_obj_t self_in) {
+    mp_obj_vfs_mmap_t *self = MP_OBJ_TO_PTR(self_in);
+    // views taken before still read the map, it goes with the finaliser
+    self->closed = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(vfs_mmap_close_obj, vfs_mmap_close);
+
+STATIC mp_obj_t vfs_mmap___del__(mp_obj_t self_in) {
+    mp_obj_vfs_mmap_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->unmap != NULL) {
+        self->unmap(self->data, self->len, self->handle);
+        self->unmap = NULL;
+    }
+    self->closed = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(vfs_mmap___del___obj, vfs_mmap___del__);
+
+STATIC mp_obj_t vfs_mmap___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return vfs_mmap_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(vfs_mmap___exit___obj, 4, 4, vfs_mmap___exit__);
+
+STATIC const mp_rom_map_elem_t vfs_mmap_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&vfs_mmap_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&vfs_mmap___del___obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&vfs_mmap___exit___obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(vfs_mmap_locals_dict, vfs_mmap_locals_dict_table);
+
+const mp_obj_type_t mp_type_vfs_mmap = {
+    { &mp_type_type },
+    .name = MP_QSTR_mmap,
+    .print = vfs_mmap_print,
+    .unary_op = vfs_mmap_unary_op,
+    .buffer_p = { .get_buffer = vfs_mmap_get_buffer },
+    .locals_dict = (mp_obj_dict_t*)&vfs_mmap_locals_dict,
+};
+
+#if MICROPY_VFS_MMAP_POSIX
+
+STATIC void vfs_mmap_posix_unmap(const uint8_t *data, size_t len, uintptr_t handle) {
+    (void)handle;
+    munmap((void*)data, len);
+}
+
+mp_obj_t mp_vfs_mmap_posix(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        mp_raise_OSError(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        mp_raise_OSError(err);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        mp_raise_OSError(MP_EINVAL);
+    }
+    if (st.st_size == 0) {
+        // mmap(2) won't take it
+        close(fd);
+        return mp_vfs_mmap_new("", 0, NULL, 0);
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    // the map holds the file open
+    close(fd);
+    if (data == MAP_FAILED) {
+        mp_raise_OSError(err);
+    }
+    return mp_vfs_mmap_new(data, st.st_size, vfs_mmap_posix_unmap, 0);
+}
+
+#endif // MICROPY_VFS_MMAP_POSIX
+
+#endif // MICROPY_VFS_MMAP
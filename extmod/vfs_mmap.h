@@ -0,0 +1,60 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_MMAP_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_MMAP_H
+
+#include "py/obj.h"
+
+// A file mapped read-only by uos.mmap(path): the bytes are read where they
+// are, through the buffer protocol (memoryview(m), hashing, sending...), and
+// never copied into the heap. A memoryview holds the map it was taken from
+// (MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ), so the map is only released by the
+// finaliser, once it and all its views are gone; close() just stops it from
+// giving out its bytes. The map doesn't see the file changed, so the file
+// isn't written or removed while the map or a view of it is around.
+
+typedef struct _mp_obj_vfs_mmap_t {
+    mp_obj_base_t base;
+    const uint8_t *data;
+    size_t len;
+    // releases the map, NULL if there's nothing to release
+    void (*unmap)(const uint8_t *data, size_t len, uintptr_t handle);
+    uintptr_t handle;
+    bool closed;
+} mp_obj_vfs_mmap_t;
+
+extern const mp_obj_type_t mp_type_vfs_mmap;
+
+mp_obj_t mp_vfs_mmap_new(const void *data, size_t len,
+    void (*unmap)(const uint8_t *data, size_t len, uintptr_t handle), uintptr_t handle);
+
+#if MICROPY_VFS_MMAP_POSIX
+// the whole file, with mmap(2)
+mp_obj_t mp_vfs_mmap_posix(const char *path);
+#endif
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_MMAP_H
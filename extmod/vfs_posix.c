@@ -28,6 +28,7 @@
 #include "py/mperrno.h"
 #include "extmod/vfs.h"
 #include "extmod/vfs_posix.h"
+#include "extmod/vfs_mmap.h"
 
 #if MICROPY_VFS_POSIX
 
@@ -157,6 +158,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(vfs_posix_getcwd_obj, vfs_posix_getcwd);
 typedef struct _vfs_posix_ilistdir_it_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
+    bool with_stat;
     bool is_str;
     DIR *dir;
 } vfs_posix_ilistdir_it_t;
@@ -182,15 +184,31 @@ STATIC mp_obj_t vfs_posix_ilistdir_it_iternext(mp_obj_t self_in) {
             continue;
         }
 
-        // make 3-tuple with info about this entry
-        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
+        // relative to the directory, the path isn't walked again
+        struct stat st;
+        if (self->with_stat && fstatat(dirfd(self->dir), fn, &st, 0) != 0) {
+            if (errno == ENOENT) {
+                // removed since
+                continue;
+            }
+            mp_raise_OSError(errno);
+        }
 
+        mp_obj_t name;
         if (self->is_str) {
-            t->items[0] = mp_obj_new_str(fn, strlen(fn));
+            name = mp_obj_new_str(fn, strlen(fn));
         } else {
-            t->items[0] = mp_obj_new_bytes((const byte*)fn, strlen(fn));
+            name = mp_obj_new_bytes((const byte*)fn, strlen(fn));
         }
 
+        if (self->with_stat) {
+            return mp_vfs_ilistdir_entry(self->with_stat, name, st.st_mode, st.st_size, st.st_mtime);
+        }
+
+        // make 3-tuple with info about this entry
+        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
+        t->items[0] = name;
+
         #ifdef _DIRENT_HAVE_D_TYPE
         #ifdef DTTOIF
         t->items[1] = MP_OBJ_NEW_SMALL_INT(DTTOIF(dirent->d_type));
@@ -218,11 +236,13 @@ STATIC mp_obj_t vfs_posix_ilistdir_it_iternext(mp_obj_t self_in) {
     }
 }
 
-STATIC mp_obj_t vfs_posix_ilistdir(mp_obj_t self_in, mp_obj_t path_in) {
-    mp_obj_vfs_posix_t *self = MP_OBJ_TO_PTR(self_in);
+STATIC mp_obj_t vfs_posix_ilistdir(size_t n_args, const mp_obj_t *args) {
+    mp_obj_vfs_posix_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t path_in = args[1];
     vfs_posix_ilistdir_it_t *iter = m_new_obj(vfs_posix_ilistdir_it_t);
     iter->base.type = &mp_type_polymorph_iter;
     iter->iternext = vfs_posix_ilistdir_it_iternext;
+    iter->with_stat = mp_vfs_ilistdir_with_stat(n_args, args, 2);
     iter->is_str = mp_obj_get_type(path_in) == &mp_type_str;
     const char *path = vfs_posix_get_path_str(self, path_in);
     if (path[0] == '\0') {
@@ -234,7 +254,7 @@ STATIC mp_obj_t vfs_posix_ilistdir(mp_obj_t self_in, mp_obj_t path_in) {
     }
     return MP_OBJ_FROM_PTR(iter);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_posix_ilistdir_obj, vfs_posix_ilistdir);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(vfs_posix_ilistdir_obj, 2, 3, vfs_posix_ilistdir);
 
 typedef struct _mp_obj_listdir_t {
     mp_obj_base_t base;
@@ -339,6 +359,14 @@ STATIC mp_obj_t vfs_posix_statvfs(mp_obj_t self_in, mp_obj_t path_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_posix_statvfs_obj, vfs_posix_statvfs);
 
+#if MICROPY_VFS_MMAP_POSIX
+STATIC mp_obj_t vfs_posix_mmap(mp_obj_t self_in, mp_obj_t path_in) {
+    mp_obj_vfs_posix_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_vfs_mmap_posix(vfs_posix_get_path_str(self, path_in));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_posix_mmap_obj, vfs_posix_mmap);
+#endif
+
 STATIC const mp_rom_map_elem_t vfs_posix_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_mount), MP_ROM_PTR(&vfs_posix_mount_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount), MP_ROM_PTR(&vfs_posix_umount_obj) },
@@ -353,6 +381,9 @@ STATIC const mp_rom_map_elem_t vfs_posix_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_rmdir), MP_ROM_PTR(&vfs_posix_rmdir_obj) },
     { MP_ROM_QSTR(MP_QSTR_stat), MP_ROM_PTR(&vfs_posix_stat_obj) },
     { MP_ROM_QSTR(MP_QSTR_statvfs), MP_ROM_PTR(&vfs_posix_statvfs_obj) },
+    #if MICROPY_VFS_MMAP_POSIX
+    { MP_ROM_QSTR(MP_QSTR_mmap), MP_ROM_PTR(&vfs_posix_mmap_obj) },
+    #endif
 };
 STATIC MP_DEFINE_CONST_DICT(vfs_posix_locals_dict, vfs_posix_locals_dict_table);
 
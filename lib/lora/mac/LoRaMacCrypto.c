@@ -19,10 +19,12 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 */
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "board.h"
 #include "utilities.h"
 
 #include "lora/system/crypto/aes.h"
-#include "lora/system/crypto/cmac.h"
 
 #include "LoRaMacCrypto.h"
 
@@ -32,171 +34,340 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define LORAMAC_MIC_BLOCK_B0_SIZE                   16
 
 /*!
- * MIC field computation initial data
+ * Number of key schedules kept, NwkSKey, AppSKey and AppKey fit. A frame
+ * holds two at most, in the task and in the radio interrupt at once.
  */
-static uint8_t MicBlockB0[] = { 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-                              };
+#define LORAMAC_CRYPTO_KEY_CACHE_SIZE               4
 
 /*!
- * Contains the computed MIC field.
- *
- * \remark Only the 4 first bytes are used
+ * AES key schedule and CMAC subkeys of a key, computed once per key
  */
-static uint8_t Mic[16];
+typedef struct sLoRaMacCryptoKey
+{
+    uint8_t Key[16];
+    aes_context Aes;
+    uint8_t K1[16];
+    uint8_t K2[16];
+    uint32_t LastUse;
+    uint8_t Users;
+    bool Valid;
+}LoRaMacCryptoKey_t;
 
 /*!
- * Encryption aBlock and sBlock
+ * CMAC computation state
  */
-static uint8_t aBlock[] = { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-                          };
-static uint8_t sBlock[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-                          };
+typedef struct sLoRaMacCmac
+{
+    const LoRaMacCryptoKey_t *Key;
+    uint8_t X[16];
+    uint8_t M[16];
+    uint8_t Len;
+}LoRaMacCmac_t;
 
 /*!
- * AES computation context variable
+ * Key schedules cache, the least recently used one not in use is replaced.
+ * Shared by the task and the radio interrupt, taken and given back in an
+ * atomic section.
  */
-static aes_context AesContext;
+static LoRaMacCryptoKey_t KeyCache[LORAMAC_CRYPTO_KEY_CACHE_SIZE];
+static uint32_t KeyCacheUse = 0;
+
+static void Xor16( uint8_t *dst, const uint8_t *src )
+{
+    uint8_t i;
+
+    for( i = 0; i < 16; i++ )
+    {
+        dst[i] ^= src[i];
+    }
+}
 
 /*!
- * CMAC computation context variable
+ * CMAC subkey derivation, doubling in GF(2^128)
  */
-static AES_CMAC_CTX AesCmacCtx[1];
+static void CmacDouble( const uint8_t *in, uint8_t *out )
+{
+    uint8_t msb = in[0] & 0x80;
+    uint8_t i;
+
+    for( i = 0; i < 15; i++ )
+    {
+        out[i] = ( in[i] << 1 ) | ( in[i + 1] >> 7 );
+    }
+    out[15] = ( in[15] << 1 ) ^ ( msb ? 0x87 : 0x00 );
+}
 
 /*!
- * \brief Computes the LoRaMAC frame MIC field
+ * \brief Returns the key schedule of a key, computing it if not cached. It
+ *        isn't replaced until given back with LoRaMacCryptoPutKey.
  *
- * \param [IN]  buffer          Data buffer
- * \param [IN]  size            Data buffer size
- * \param [IN]  key             AES key to be used
- * \param [IN]  address         Frame address
- * \param [IN]  dir             Frame direction [0: uplink, 1: downlink]
- * \param [IN]  sequenceCounter Frame sequence counter
- * \param [OUT] mic Computed MIC field
+ * \param [IN]  key             AES key
+ * \retval                      Cached key schedule and CMAC subkeys
  */
-void LoRaMacComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint32_t *mic )
+static const LoRaMacCryptoKey_t *LoRaMacCryptoGetKey( const uint8_t *key )
 {
-    MicBlockB0[5] = dir;
+    LoRaMacCryptoKey_t *entry = NULL;
+    uint8_t l[16];
+    uint8_t i;
 
-    MicBlockB0[6] = ( address ) & 0xFF;
-    MicBlockB0[7] = ( address >> 8 ) & 0xFF;
-    MicBlockB0[8] = ( address >> 16 ) & 0xFF;
-    MicBlockB0[9] = ( address >> 24 ) & 0xFF;
-
-    MicBlockB0[10] = ( sequenceCounter ) & 0xFF;
-    MicBlockB0[11] = ( sequenceCounter >> 8 ) & 0xFF;
-    MicBlockB0[12] = ( sequenceCounter >> 16 ) & 0xFF;
-    MicBlockB0[13] = ( sequenceCounter >> 24 ) & 0xFF;
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    KeyCacheUse++;
+    for( i = 0; i < LORAMAC_CRYPTO_KEY_CACHE_SIZE; i++ )
+    {
+        if( ( KeyCache[i].Valid == true ) && ( memcmp( KeyCache[i].Key, key, 16 ) == 0 ) )
+        {
+            KeyCache[i].LastUse = KeyCacheUse;
+            KeyCache[i].Users++;
+            MICROPY_END_ATOMIC_SECTION( ilevel );
+            return &KeyCache[i];
+        }
+        if( ( KeyCache[i].Users == 0 ) &&
+            ( ( entry == NULL ) || ( KeyCache[i].Valid == false ) ||
+              ( ( entry->Valid == true ) && ( ( int32_t )( KeyCache[i].LastUse - entry->LastUse ) < 0 ) ) ) )
+        {
+            entry = &KeyCache[i];
+        }
+    }
+    // taken while computed, and not found until then
+    entry->Valid = false;
+    entry->Users = 1;
+    MICROPY_END_ATOMIC_SECTION( ilevel );
+
+    memcpy1( entry->Key, key, 16 );
+    memset1( ( uint8_t * )&entry->Aes, '\0', sizeof( aes_context ) );
+    aes_set_key_lora( key, 16, &entry->Aes );
+
+    memset1( l, 0, 16 );
+    aes_encrypt_lora( l, l, &entry->Aes );
+    CmacDouble( l, entry->K1 );
+    CmacDouble( entry->K1, entry->K2 );
+    memset1( l, 0, 16 );
+
+    ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    entry->LastUse = KeyCacheUse;
+    entry->Valid = true;
+    MICROPY_END_ATOMIC_SECTION( ilevel );
+    return entry;
+}
 
-    MicBlockB0[15] = size & 0xFF;
+static void LoRaMacCryptoPutKey( const LoRaMacCryptoKey_t *key )
+{
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    ( ( LoRaMacCryptoKey_t * )key )->Users--;
+    MICROPY_END_ATOMIC_SECTION( ilevel );
+}
 
-    AES_CMAC_Init( AesCmacCtx );
+static void LoRaMacCmacInit( LoRaMacCmac_t *cmac, const LoRaMacCryptoKey_t *key )
+{
+    cmac->Key = key;
+    memset1( cmac->X, 0, 16 );
+    cmac->Len = 0;
+}
 
-    AES_CMAC_SetKey( AesCmacCtx, key );
+static void LoRaMacCmacUpdate( LoRaMacCmac_t *cmac, const uint8_t *data, uint16_t size )
+{
+    uint8_t n;
 
-    AES_CMAC_Update( AesCmacCtx, MicBlockB0, LORAMAC_MIC_BLOCK_B0_SIZE );
+    // the last block gets the final subkey, so a full block is only processed
+    // once more data follows it
+    while( size > 0 )
+    {
+        if( cmac->Len == 16 )
+        {
+            Xor16( cmac->X, cmac->M );
+            aes_encrypt_lora( cmac->X, cmac->X, &cmac->Key->Aes );
+            cmac->Len = 0;
+        }
+        if( ( cmac->Len == 0 ) && ( size > 16 ) )
+        {
+            Xor16( cmac->X, data );
+            aes_encrypt_lora( cmac->X, cmac->X, &cmac->Key->Aes );
+            data += 16;
+            size -= 16;
+            continue;
+        }
+        n = MIN( 16 - cmac->Len, size );
+        memcpy1( cmac->M + cmac->Len, data, n );
+        cmac->Len += n;
+        data += n;
+        size -= n;
+    }
+}
 
-    AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
+static uint32_t LoRaMacCmacFinal( LoRaMacCmac_t *cmac )
+{
+    if( cmac->Len == 16 )
+    {
+        Xor16( cmac->M, cmac->Key->K1 );
+    }
+    else
+    {
+        cmac->M[cmac->Len] = 0x80;
+        memset1( cmac->M + cmac->Len + 1, 0, 15 - cmac->Len );
+        Xor16( cmac->M, cmac->Key->K2 );
+    }
+    Xor16( cmac->X, cmac->M );
+    aes_encrypt_lora( cmac->X, cmac->X, &cmac->Key->Aes );
 
-    AES_CMAC_Final( Mic, AesCmacCtx );
+    return ( uint32_t )( ( uint32_t )cmac->X[3] << 24 | ( uint32_t )cmac->X[2] << 16 | ( uint32_t )cmac->X[1] << 8 | ( uint32_t )cmac->X[0] );
+}
 
-    *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
+/*!
+ * Fills the B0 block of the MIC, or the A block of the payload encryption
+ */
+static void LoRaMacCryptoBlock( uint8_t *block, uint8_t first, uint8_t dir, uint32_t address, uint32_t sequenceCounter, uint8_t last )
+{
+    block[0] = first;
+    block[1] = 0x00;
+    block[2] = 0x00;
+    block[3] = 0x00;
+    block[4] = 0x00;
+    block[5] = dir;
+
+    block[6] = ( address ) & 0xFF;
+    block[7] = ( address >> 8 ) & 0xFF;
+    block[8] = ( address >> 16 ) & 0xFF;
+    block[9] = ( address >> 24 ) & 0xFF;
+
+    block[10] = ( sequenceCounter ) & 0xFF;
+    block[11] = ( sequenceCounter >> 8 ) & 0xFF;
+    block[12] = ( sequenceCounter >> 16 ) & 0xFF;
+    block[13] = ( sequenceCounter >> 24 ) & 0xFF;
+
+    block[14] = 0x00;
+    block[15] = last;
 }
 
-void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer )
+/*!
+ * Payload encryption, in counter mode. Each 16 bytes block encrypted is also
+ * passed to the CMAC if one is given.
+ */
+static void LoRaMacPayloadCrypt( const uint8_t *buffer, uint16_t size, const LoRaMacCryptoKey_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer, LoRaMacCmac_t *cmac )
 {
+    uint8_t aBlock[16];
+    uint8_t sBlock[16];
     uint16_t i;
-    uint8_t bufferIndex = 0;
-    uint16_t ctr = 1;
-
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
-
-    aBlock[5] = dir;
-
-    aBlock[6] = ( address ) & 0xFF;
-    aBlock[7] = ( address >> 8 ) & 0xFF;
-    aBlock[8] = ( address >> 16 ) & 0xFF;
-    aBlock[9] = ( address >> 24 ) & 0xFF;
+    uint16_t n;
+    uint16_t bufferIndex = 0;
+    uint8_t ctr = 1;
 
-    aBlock[10] = ( sequenceCounter ) & 0xFF;
-    aBlock[11] = ( sequenceCounter >> 8 ) & 0xFF;
-    aBlock[12] = ( sequenceCounter >> 16 ) & 0xFF;
-    aBlock[13] = ( sequenceCounter >> 24 ) & 0xFF;
+    LoRaMacCryptoBlock( aBlock, 0x01, dir, address, sequenceCounter, 0 );
 
-    while( size >= 16 )
+    while( size > 0 )
     {
-        aBlock[15] = ( ( ctr ) & 0xFF );
-        ctr++;
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
-        for( i = 0; i < 16; i++ )
+        aBlock[15] = ctr++;
+        aes_encrypt_lora( aBlock, sBlock, &key->Aes );
+        n = MIN( 16, size );
+        for( i = 0; i < n; i++ )
         {
             encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
         }
-        size -= 16;
-        bufferIndex += 16;
-    }
-
-    if( size > 0 )
-    {
-        aBlock[15] = ( ( ctr ) & 0xFF );
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
-        for( i = 0; i < size; i++ )
+        if( cmac != NULL )
         {
-            encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
+            LoRaMacCmacUpdate( cmac, encBuffer + bufferIndex, n );
         }
+        size -= n;
+        bufferIndex += n;
     }
 }
 
-void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer )
+/*!
+ * \brief Computes the LoRaMAC frame MIC field
+ *
+ * \param [IN]  buffer          Data buffer
+ * \param [IN]  size            Data buffer size
+ * \param [IN]  key             AES key to be used
+ * \param [IN]  address         Frame address
+ * \param [IN]  dir             Frame direction [0: uplink, 1: downlink]
+ * \param [IN]  sequenceCounter Frame sequence counter
+ * \param [OUT] mic Computed MIC field
+ */
+void LoRaMacComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint32_t *mic )
 {
-    LoRaMacPayloadEncrypt( buffer, size, key, address, dir, sequenceCounter, decBuffer );
+    LoRaMacCmac_t cmac;
+    uint8_t micBlockB0[LORAMAC_MIC_BLOCK_B0_SIZE];
+
+    LoRaMacCryptoBlock( micBlockB0, 0x49, dir, address, sequenceCounter, size & 0xFF );
+
+    LoRaMacCmacInit( &cmac, LoRaMacCryptoGetKey( key ) );
+    LoRaMacCmacUpdate( &cmac, micBlockB0, LORAMAC_MIC_BLOCK_B0_SIZE );
+    LoRaMacCmacUpdate( &cmac, buffer, size & 0xFF );
+    *mic = LoRaMacCmacFinal( &cmac );
+    LoRaMacCryptoPutKey( cmac.Key );
 }
 
-void LoRaMacJoinComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t *mic )
+void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer )
 {
-    AES_CMAC_Init( AesCmacCtx );
+    const LoRaMacCryptoKey_t *sched = LoRaMacCryptoGetKey( key );
 
-    AES_CMAC_SetKey( AesCmacCtx, key );
+    LoRaMacPayloadCrypt( buffer, size, sched, address, dir, sequenceCounter, encBuffer, NULL );
+    LoRaMacCryptoPutKey( sched );
+}
 
-    AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
+void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer )
+{
+    LoRaMacPayloadEncrypt( buffer, size, key, address, dir, sequenceCounter, decBuffer );
+}
 
-    AES_CMAC_Final( Mic, AesCmacCtx );
+void LoRaMacPayloadEncryptComputeMic( uint8_t *frame, uint16_t headerSize, const uint8_t *payload, uint16_t payloadSize,
+                                      const uint8_t *encKey, const uint8_t *micKey, uint32_t address, uint8_t dir,
+                                      uint32_t sequenceCounter, uint32_t *mic )
+{
+    LoRaMacCmac_t cmac;
+    uint8_t micBlockB0[LORAMAC_MIC_BLOCK_B0_SIZE];
+    const LoRaMacCryptoKey_t *encSched = LoRaMacCryptoGetKey( encKey );
+    const LoRaMacCryptoKey_t *micSched = LoRaMacCryptoGetKey( micKey );
+
+    LoRaMacCryptoBlock( micBlockB0, 0x49, dir, address, sequenceCounter, ( headerSize + payloadSize ) & 0xFF );
+
+    LoRaMacCmacInit( &cmac, micSched );
+    LoRaMacCmacUpdate( &cmac, micBlockB0, LORAMAC_MIC_BLOCK_B0_SIZE );
+    LoRaMacCmacUpdate( &cmac, frame, headerSize );
+    LoRaMacPayloadCrypt( payload, payloadSize, encSched, address, dir, sequenceCounter, frame + headerSize, &cmac );
+    *mic = LoRaMacCmacFinal( &cmac );
+    LoRaMacCryptoPutKey( micSched );
+    LoRaMacCryptoPutKey( encSched );
+}
 
-    *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
+void LoRaMacJoinComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t *mic )
+{
+    LoRaMacCmac_t cmac;
+
+    LoRaMacCmacInit( &cmac, LoRaMacCryptoGetKey( key ) );
+    LoRaMacCmacUpdate( &cmac, buffer, size & 0xFF );
+    *mic = LoRaMacCmacFinal( &cmac );
+    LoRaMacCryptoPutKey( cmac.Key );
 }
 
 void LoRaMacJoinDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint8_t *decBuffer )
 {
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
-    aes_encrypt_lora( buffer, decBuffer, &AesContext );
+    const LoRaMacCryptoKey_t *sched = LoRaMacCryptoGetKey( key );
+
+    aes_encrypt_lora( buffer, decBuffer, &sched->Aes );
     // Check if optional CFList is included
     if( size >= 16 )
     {
-        aes_encrypt_lora( buffer + 16, decBuffer + 16, &AesContext );
+        aes_encrypt_lora( buffer + 16, decBuffer + 16, &sched->Aes );
     }
+    LoRaMacCryptoPutKey( sched );
 }
 
 void LoRaMacJoinComputeSKeys( const uint8_t *key, const uint8_t *appNonce, uint16_t devNonce, uint8_t *nwkSKey, uint8_t *appSKey )
 {
     uint8_t nonce[16];
     uint8_t *pDevNonce = ( uint8_t * )&devNonce;
-
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
+    const LoRaMacCryptoKey_t *sched = LoRaMacCryptoGetKey( key );
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x01;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, nwkSKey, &AesContext );
+    aes_encrypt_lora( nonce, nwkSKey, &sched->Aes );
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x02;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, appSKey, &AesContext );
+    aes_encrypt_lora( nonce, appSKey, &sched->Aes );
+    LoRaMacCryptoPutKey( sched );
 }
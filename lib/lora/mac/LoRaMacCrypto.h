@@ -75,6 +75,25 @@ void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t
  */
 void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer );
 
+/*!
+ * Encrypts the LoRaMAC frame payload and computes the frame MIC field in one
+ * pass, each encrypted block goes through the MIC computation straight away
+ *
+ * \param [IN/OUT] frame         - Frame buffer, holds the header, receives the encrypted payload after it
+ * \param [IN]  headerSize       - Frame header size, up to and including the port
+ * \param [IN]  payload          - Payload to be encrypted
+ * \param [IN]  payloadSize      - Payload size
+ * \param [IN]  encKey           - AES key to be used for the payload
+ * \param [IN]  micKey           - AES key to be used for the MIC
+ * \param [IN]  address          - Frame address
+ * \param [IN]  dir              - Frame direction [0: uplink, 1: downlink]
+ * \param [IN]  sequenceCounter  - Frame sequence counter
+ * \param [OUT] mic              - Computed MIC field
+ */
+void LoRaMacPayloadEncryptComputeMic( uint8_t *frame, uint16_t headerSize, const uint8_t *payload, uint16_t payloadSize,
+                                      const uint8_t *encKey, const uint8_t *micKey, uint32_t address, uint8_t dir,
+                                      uint32_t sequenceCounter, uint32_t *mic );
+
 /*!
  * Computes the LoRaMAC Join Request frame MIC field
  *
@@ -114,47 +114,6 @@ static bool VerifyTxFreq( uint32_t freq )
     return true;
 }
 
-static uint8_t CountNbOfEnabledChannels( bool joined, uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx )
-{
-    uint8_t nbEnabledChannels = 0;
-    uint8_t delayTransmission = 0;
-
-    for( uint8_t i = 0, k = 0; i < AS923_MAX_NB_CHANNELS; i += 16, k++ )
-    {
-        for( uint8_t j = 0; j < 16; j++ )
-        {
-            if( ( channelsMask[k] & ( 1 << j ) ) != 0 )
-            {
-                if( channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( joined == false )
-                {
-                    if( ( AS923_JOIN_CHANNELS & ( 1 << j ) ) == 0 )
-                    {
-                        continue;
-                    }
-                }
-                if( RegionCommonValueInRange( datarate, channels[i + j].DrRange.Fields.Min,
-                                              channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( bands[channels[i + j].Band].TimeOff > 0 )
-                { // Check if the band is available for transmission
-                    delayTransmission++;
-                    continue;
-                }
-                enabledChannels[nbEnabledChannels++] = i + j;
-            }
-        }
-    }
-
-    *delayTx = delayTransmission;
-    return nbEnabledChannels;
-}
-
 PhyParam_t RegionAS923GetPhyParam( GetPhyParams_t* getPhy )
 {
     PhyParam_t phyParam = { 0 };
@@ -919,7 +878,8 @@ bool RegionAS923NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     uint8_t channelNext = 0;
     uint8_t nbEnabledChannels = 0;
     uint8_t delayTx = 0;
-    uint8_t enabledChannels[AS923_MAX_NB_CHANNELS] = { 0 };
+    uint16_t enabledChannels[CHANNELS_MASK_SIZE] = { 0 };
+    RegionCommonCountNbOfEnabledChannelsParams_t countChannelsParams;
     TimerTime_t nextTxDelay = 0;
 
     if( RegionCommonCountChannels( ChannelsMask, 0, 1 ) == 0 )
@@ -936,9 +896,14 @@ bool RegionAS923NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
         nextTxDelay = RegionCommonUpdateBandTimeOff( nextChanParams->Joined, nextChanParams->DutyCycleEnabled, Bands, AS923_MAX_NB_BANDS );
 
         // Search how many channels are enabled
-        nbEnabledChannels = CountNbOfEnabledChannels( nextChanParams->Joined, nextChanParams->Datarate,
-                                                      ChannelsMask, Channels,
-                                                      Bands, enabledChannels, &delayTx );
+        countChannelsParams.Joined = nextChanParams->Joined;
+        countChannelsParams.Datarate = nextChanParams->Datarate;
+        countChannelsParams.ChannelsMask = ChannelsMask;
+        countChannelsParams.Channels = Channels;
+        countChannelsParams.Bands = Bands;
+        countChannelsParams.MaxNbChannels = AS923_MAX_NB_CHANNELS;
+        countChannelsParams.JoinChannels = AS923_JOIN_CHANNELS;
+        nbEnabledChannels = RegionCommonCountNbOfEnabledChannels( &countChannelsParams, enabledChannels, &delayTx );
     }
     else
     {
@@ -950,7 +915,7 @@ bool RegionAS923NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     {
         for( uint8_t  i = 0, j = randr( 0, nbEnabledChannels - 1 ); i < AS923_MAX_NB_CHANNELS; i++ )
         {
-            channelNext = enabledChannels[j];
+            channelNext = RegionCommonChanMaskSelect( enabledChannels, CHANNELS_MASK_SIZE, j );
             j = ( j + 1 ) % nbEnabledChannels;
 
             // Perform carrier sense for AS923_CARRIER_SENSE_TIME
@@ -104,40 +104,6 @@ static int8_t LimitTxPower( int8_t txPower, int8_t maxBandTxPower, int8_t datara
     return txPowerResult;
 }
 
-static uint8_t CountNbOfEnabledChannels( uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx )
-{
-    uint8_t nbEnabledChannels = 0;
-    uint8_t delayTransmission = 0;
-
-    for( uint8_t i = 0, k = 0; i < AU915_MAX_NB_CHANNELS; i += 16, k++ )
-    {
-        for( uint8_t j = 0; j < 16; j++ )
-        {
-            if( ( channelsMask[k] & ( 1 << j ) ) != 0 )
-            {
-                if( channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( RegionCommonValueInRange( datarate, channels[i + j].DrRange.Fields.Min,
-                                              channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( bands[channels[i + j].Band].TimeOff > 0 )
-                { // Check if the band is available for transmission
-                    delayTransmission++;
-                    continue;
-                }
-                enabledChannels[nbEnabledChannels++] = i + j;
-            }
-        }
-    }
-
-    *delayTx = delayTransmission;
-    return nbEnabledChannels;
-}
-
 PhyParam_t RegionAU915GetPhyParam( GetPhyParams_t* getPhy )
 {
     PhyParam_t phyParam = { 0 };
@@ -765,7 +731,8 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
 {
     uint8_t nbEnabledChannels = 0;
     uint8_t delayTx = 0;
-    uint8_t enabledChannels[AU915_MAX_NB_CHANNELS] = { 0 };
+    uint16_t enabledChannels[CHANNELS_MASK_SIZE] = { 0 };
+    RegionCommonCountNbOfEnabledChannelsParams_t countChannelsParams;
     TimerTime_t nextTxDelay = 0;
 
     // Count 125kHz channels
@@ -791,9 +758,14 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
         nextTxDelay = RegionCommonUpdateBandTimeOff( nextChanParams->Joined, nextChanParams->DutyCycleEnabled, Bands, AU915_MAX_NB_BANDS );
 
         // Search how many channels are enabled
-        nbEnabledChannels = CountNbOfEnabledChannels( nextChanParams->Datarate,
-                                                      ChannelsMaskRemaining, Channels,
-                                                      Bands, enabledChannels, &delayTx );
+        countChannelsParams.Joined = nextChanParams->Joined;
+        countChannelsParams.Datarate = nextChanParams->Datarate;
+        countChannelsParams.ChannelsMask = ChannelsMaskRemaining;
+        countChannelsParams.Channels = Channels;
+        countChannelsParams.Bands = Bands;
+        countChannelsParams.MaxNbChannels = AU915_MAX_NB_CHANNELS;
+        countChannelsParams.JoinChannels = 0xFFFF;
+        nbEnabledChannels = RegionCommonCountNbOfEnabledChannels( &countChannelsParams, enabledChannels, &delayTx );
     }
     else
     {
@@ -804,7 +776,7 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     if( nbEnabledChannels > 0 )
     {
         // We found a valid channel
-        *channel = enabledChannels[randr( 0, nbEnabledChannels - 1 )];
+        *channel = RegionCommonChanMaskSelect( enabledChannels, CHANNELS_MASK_SIZE, randr( 0, nbEnabledChannels - 1 ) );
         // Disable the channel in the mask
         RegionCommonChanDisable( ChannelsMaskRemaining, *channel, AU915_MAX_NB_CHANNELS - 8 );
 
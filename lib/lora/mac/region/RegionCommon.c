@@ -39,16 +39,11 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 
 static uint8_t CountChannels( uint16_t mask, uint8_t nbBits )
 {
-    uint8_t nbActiveBits = 0;
-
-    for( uint8_t j = 0; j < nbBits; j++ )
+    if( nbBits < 16 )
     {
-        if( ( mask & ( 1 << j ) ) == ( 1 << j ) )
-        {
-            nbActiveBits++;
-        }
+        mask &= ( 1 << nbBits ) - 1;
     }
-    return nbActiveBits;
+    return __builtin_popcount( mask );
 }
 
 
@@ -81,16 +76,17 @@ bool RegionCommonChanVerifyDr( uint8_t nbChannels, uint16_t* channelsMask, int8_
 
     for( uint8_t i = 0, k = 0; i < nbChannels; i += 16, k++ )
     {
-        for( uint8_t j = 0; j < 16; j++ )
+        // Only the enabled channels are visited
+        for( uint16_t mask = channelsMask[k]; mask != 0; mask &= mask - 1 )
         {
-            if( ( ( channelsMask[k] & ( 1 << j ) ) != 0 ) )
-            {// Check datarate validity for enabled channels
-                if( RegionCommonValueInRange( dr, ( channels[i + j].DrRange.Fields.Min & 0x0F ),
-                                                  ( channels[i + j].DrRange.Fields.Max & 0x0F ) ) == 1 )
-                {
-                    // At least 1 channel has been found we can return OK.
-                    return true;
-                }
+            uint8_t j = __builtin_ctz( mask );
+
+            // Check datarate validity for enabled channels
+            if( RegionCommonValueInRange( dr, ( channels[i + j].DrRange.Fields.Min & 0x0F ),
+                                              ( channels[i + j].DrRange.Fields.Max & 0x0F ) ) == 1 )
+            {
+                // At least 1 channel has been found we can return OK.
+                return true;
             }
         }
     }
@@ -138,6 +134,73 @@ uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uin
     return nbChannels;
 }
 
+uint8_t RegionCommonCountNbOfEnabledChannels( RegionCommonCountNbOfEnabledChannelsParams_t* countParams,
+                                              uint16_t* enabledChannels, uint8_t* delayTx )
+{
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTransmission = 0;
+
+    for( uint8_t i = 0, k = 0; i < countParams->MaxNbChannels; i += 16, k++ )
+    {
+        uint16_t mask = countParams->ChannelsMask[k];
+
+        if( countParams->Joined == false )
+        {
+            mask &= countParams->JoinChannels;
+        }
+        enabledChannels[k] = 0;
+
+        // Only the channels of the mask are visited
+        for( ; mask != 0; mask &= mask - 1 )
+        {
+            uint8_t j = __builtin_ctz( mask );
+            ChannelParams_t* channel = &countParams->Channels[i + j];
+
+            if( channel->Frequency == 0 )
+            { // Check if the channel is enabled
+                continue;
+            }
+            if( RegionCommonValueInRange( countParams->Datarate, channel->DrRange.Fields.Min,
+                                          channel->DrRange.Fields.Max ) == false )
+            { // Check if the current channel selection supports the given datarate
+                continue;
+            }
+            if( countParams->Bands[channel->Band].TimeOff > 0 )
+            { // Check if the band is available for transmission
+                delayTransmission++;
+                continue;
+            }
+            enabledChannels[k] |= 1 << j;
+        }
+        nbEnabledChannels += __builtin_popcount( enabledChannels[k] );
+    }
+
+    *delayTx = delayTransmission;
+    return nbEnabledChannels;
+}
+
+uint8_t RegionCommonChanMaskSelect( uint16_t* channelsMask, uint8_t len, uint8_t nth )
+{
+    for( uint8_t k = 0; k < len; k++ )
+    {
+        uint8_t nbChannels = __builtin_popcount( channelsMask[k] );
+
+        if( nth < nbChannels )
+        {
+            uint16_t mask = channelsMask[k];
+
+            // Clear the lower channels of the word
+            while( nth-- > 0 )
+            {
+                mask &= mask - 1;
+            }
+            return ( k * 16 ) + __builtin_ctz( mask );
+        }
+        nth -= nbChannels;
+    }
+    return 0;
+}
+
 void RegionCommonChanMaskCopy( uint16_t* channelsMaskDest, uint16_t* channelsMaskSrc, uint8_t len )
 {
     if( ( channelsMaskDest != NULL ) && ( channelsMaskSrc != NULL ) )
@@ -159,6 +159,39 @@ typedef struct sRegionCommonCalcBackOffParams
     TimerTime_t TxTimeOnAir;
 }RegionCommonCalcBackOffParams_t;
 
+typedef struct sRegionCommonCountNbOfEnabledChannelsParams
+{
+    /*!
+     * Set to true, if the node is joined.
+     */
+    bool Joined;
+    /*!
+     * The datarate to transmit with.
+     */
+    int8_t Datarate;
+    /*!
+     * Pointer to the first element of the channels mask.
+     */
+    uint16_t* ChannelsMask;
+    /*!
+     * A pointer to region specific channels.
+     */
+    ChannelParams_t* Channels;
+    /*!
+     * A pointer to region specific bands.
+     */
+    Band_t* Bands;
+    /*!
+     * The number of channels of the region.
+     */
+    uint8_t MaxNbChannels;
+    /*!
+     * The channels allowed before the node is joined, applied to each
+     * 16 channels of the mask.
+     */
+    uint16_t JoinChannels;
+}RegionCommonCountNbOfEnabledChannelsParams_t;
+
 /*!
  * \brief Calculates the join duty cycle.
  *        This is a generic function and valid for all regions.
@@ -232,6 +265,37 @@ bool RegionCommonChanDisable( uint16_t* channelsMask, uint8_t id, uint8_t maxCha
  */
 uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uint8_t stopIdx );
 
+/*!
+ * \brief Finds the channels which can be used for the next transmission.
+ *        This is a generic function and valid for all regions.
+ *
+ * \param [IN] countParams The channels, bands and datarate to check.
+ *
+ * \param [OUT] enabledChannels Channels mask of the channels found, it has
+ *              as many elements as countParams->ChannelsMask.
+ *
+ * \param [OUT] delayTx Number of channels waiting for a band time off.
+ *
+ * \retval Returns the number of channels found.
+ */
+uint8_t RegionCommonCountNbOfEnabledChannels( RegionCommonCountNbOfEnabledChannelsParams_t* countParams,
+                                              uint16_t* enabledChannels, uint8_t* delayTx );
+
+/*!
+ * \brief Returns the id of the nth active channel of a channels mask, in
+ *        increasing order of id.
+ *        This is a generic function and valid for all regions.
+ *
+ * \param [IN] channelsMask The channels mask.
+ *
+ * \param [IN] len The channels mask length.
+ *
+ * \param [IN] nth Index of the channel, lower than the number of active channels.
+ *
+ * \retval Returns the channel id.
+ */
+uint8_t RegionCommonChanMaskSelect( uint16_t* channelsMask, uint8_t len, uint8_t nth );
+
 /*!
  * \brief Copy a channels mask.
  *        This is a generic function and valid for all regions.
@@ -55,6 +55,12 @@
 #  define USE_TABLES
 #endif
 
+/* define to encrypt with one 1 kB table of 32-bit words (T-table) instead
+   of the byte oriented rounds, needs USE_TABLES and HAVE_UINT_32T */
+#if !defined( AES_BYTE_ROUNDS )
+#  define USE_TTABLES
+#endif
+
 /*  On Intel Core 2 duo VERSION_1 is faster */
 
 /* alternative versions (test for performance on your system) */
@@ -62,6 +68,10 @@
 #  define VERSION_1
 #endif
 
+#if defined( USE_TTABLES ) && ( !defined( USE_TABLES ) || !defined( HAVE_UINT_32T ) )
+#  undef USE_TTABLES
+#endif
+
 #include "aes.h"
 
 //#if defined( HAVE_UINT_32T )
@@ -197,8 +207,16 @@ static const uint8_t sbox[256]  =  sb_data(f1);
 static const uint8_t isbox[256] = isb_data(f1);
 #endif
 
+#if !defined( USE_TTABLES )
 static const uint8_t gfm2_sbox[256] = sb_data(f2);
 static const uint8_t gfm3_sbox[256] = sb_data(f3);
+#else
+/* the column (2.s, s, s, 3.s) as a little endian word, the other rows are
+   rotations of it */
+#define te_le(x)    ( ( uint32_t )f2(x) | ( ( uint32_t )(x) << 8 ) \
+                    | ( ( uint32_t )(x) << 16 ) | ( ( uint32_t )f3(x) << 24 ) )
+static const uint32_t t_enc[256] = sb_data(te_le);
+#endif
 
 #if defined( AES_DEC_PREKEYED )
 static const uint8_t gfmul_9[256] = mm_data(f9);
@@ -373,6 +391,8 @@ static void xor_block( void *d, const void *s )
 #endif
 }
 
+#if !defined( USE_TTABLES ) || defined( AES_DEC_PREKEYED )
+
 static void copy_and_key( void *d, const void *s, const void *k )
 {
 #if defined( HAVE_UINT_32T )
@@ -408,6 +428,10 @@ static void add_round_key( uint8_t d[N_BLOCK], const uint8_t k[N_BLOCK] )
     xor_block(d, k);
 }
 
+#endif
+
+#if !defined( USE_TTABLES )
+
 static void shift_sub_rows( uint8_t st[N_BLOCK] )
 {   uint8_t tt;
 
@@ -424,6 +448,8 @@ static void shift_sub_rows( uint8_t st[N_BLOCK] )
     st[ 7] = s_box(st[ 3]); st[ 3] = s_box( tt );
 }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
@@ -444,6 +470,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
 
 #endif
 
+#if !defined( USE_TTABLES )
+
 #if defined( VERSION_1 )
   static void mix_sub_columns( uint8_t dt[N_BLOCK] )
   { uint8_t st[N_BLOCK];
@@ -473,6 +501,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
     dt[15] = gfm3_sb(st[12]) ^ s_box(st[1]) ^ s_box(st[6]) ^ gfm2_sb(st[11]);
   }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 #if defined( VERSION_1 )
@@ -565,6 +595,64 @@ return_type aes_set_key_lora( const uint8_t key[], length_type keylen, aes_conte
 
 /*  Encrypt a single block of 16 bytes */
 
+#if defined( USE_TTABLES )
+
+/*  The state is held as four little endian column words, so the key schedule
+    bytes can be used as round keys as they are */
+
+#define rotl32(x, n)    ( ( ( x ) << ( n ) ) | ( ( x ) >> ( 32 - ( n ) ) ) )
+
+#define load_le32(p)    ( ( uint32_t )( p )[0] | ( ( uint32_t )( p )[1] << 8 ) \
+                        | ( ( uint32_t )( p )[2] << 16 ) | ( ( uint32_t )( p )[3] << 24 ) )
+
+#define t_col(a, b, c, d)   ( t_enc[( a ) & 0xff] ^ rotl32( t_enc[( ( b ) >> 8 ) & 0xff], 8 ) \
+                            ^ rotl32( t_enc[( ( c ) >> 16 ) & 0xff], 16 ) ^ rotl32( t_enc[( d ) >> 24], 24 ) )
+
+#define s_col(a, b, c, d)   ( ( uint32_t )s_box( ( a ) & 0xff ) | ( ( uint32_t )s_box( ( ( b ) >> 8 ) & 0xff ) << 8 ) \
+                            | ( ( uint32_t )s_box( ( ( c ) >> 16 ) & 0xff ) << 16 ) | ( ( uint32_t )s_box( ( d ) >> 24 ) << 24 ) )
+
+static void store_le32( uint8_t *p, uint32_t v )
+{
+    p[0] = ( uint8_t )v;
+    p[1] = ( uint8_t )( v >> 8 );
+    p[2] = ( uint8_t )( v >> 16 );
+    p[3] = ( uint8_t )( v >> 24 );
+}
+
+return_type aes_encrypt_lora( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
+{
+    const uint8_t *rk = ctx->ksch;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    uint8_t r;
+
+    if( ctx->rnd == 0 )
+        return ( uint8_t )-1;
+
+    s0 = load_le32( in      ) ^ load_le32( rk      );
+    s1 = load_le32( in +  4 ) ^ load_le32( rk +  4 );
+    s2 = load_le32( in +  8 ) ^ load_le32( rk +  8 );
+    s3 = load_le32( in + 12 ) ^ load_le32( rk + 12 );
+
+    for( r = 1 ; r < ctx->rnd ; ++r )
+    {
+        rk += N_BLOCK;
+        t0 = t_col( s0, s1, s2, s3 ) ^ load_le32( rk      );
+        t1 = t_col( s1, s2, s3, s0 ) ^ load_le32( rk +  4 );
+        t2 = t_col( s2, s3, s0, s1 ) ^ load_le32( rk +  8 );
+        t3 = t_col( s3, s0, s1, s2 ) ^ load_le32( rk + 12 );
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += N_BLOCK;
+    store_le32( out     , s_col( s0, s1, s2, s3 ) ^ load_le32( rk      ) );
+    store_le32( out +  4, s_col( s1, s2, s3, s0 ) ^ load_le32( rk +  4 ) );
+    store_le32( out +  8, s_col( s2, s3, s0, s1 ) ^ load_le32( rk +  8 ) );
+    store_le32( out + 12, s_col( s3, s0, s1, s2 ) ^ load_le32( rk + 12 ) );
+    return 0;
+}
+
+#else
+
 return_type aes_encrypt_lora( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
 {
     if( ctx->rnd )
@@ -592,6 +680,8 @@ return_type aes_encrypt_lora( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK],
     return 0;
 }
 
+#endif
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type aes_cbc_encrypt_lora( const uint8_t *in, uint8_t *out,
@@ -22,36 +22,45 @@ Maintainer: Miguel Luis and Gregory Cristian
 volatile uint8_t HasLoopedThroughMain = 0;
 
 /*!
- * Timers list head pointer
+ * Running timers, a binary min-heap ordered on the expiry time. The heap head
+ * always contains the next timer to expire.
  */
-static TimerEvent_t *TimerListHead = NULL;
+static TimerEvent_t *TimerHeap[TIMER_HEAP_SIZE];
+static uint16_t TimerHeapCount = 0;
 
 /*!
- * \brief Adds or replace the head timer of the list.
- *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
- *
- * \param [IN]  obj Timer object to be become the new head
- * \param [IN]  remainingTime Remaining time of the previous head to be replaced
+ * Timer the hardware timer is currently set for
+ */
+static TimerEvent_t *TimerArmed = NULL;
+
+/*!
+ * Incremented on each start, to keep the start order of timers expiring together
  */
-static void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime );
+static uint32_t TimerSequence = 0;
 
 /*!
- * \brief Adds a timer to the list.
+ * \brief Adds a timer to the heap.
  *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
+ * \param [IN]  obj Timer object to be added, its expiry time already set
+ */
+static void TimerHeapInsert( TimerEvent_t *obj );
+
+/*!
+ * \brief Removes a timer from the heap.
  *
- * \param [IN]  obj Timer object to be added to the list
- * \param [IN]  remainingTime Remaining time of the running head after which the object may be added
+ * \param [IN]  obj Timer object to be removed
+ */
+static void TimerHeapRemove( TimerEvent_t *obj );
+
+/*!
+ * \brief Sets the hardware timer for the heap head, if it changed
  */
-static void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime );
+static void TimerArmHead( void );
 
 /*!
- * \brief Sets a timeout with the duration "timestamp"
+ * \brief Sets a timeout at the expiry time of the timer
  *
- * \param [IN] timestamp Delay duration
+ * \param [IN] obj Timer object
  */
 static void TimerSetTimeout( TimerEvent_t *obj );
 
@@ -73,158 +82,147 @@ TimerTime_t TimerGetValue( void );
 
 void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) )
 {
+    TimerStop( obj );
     obj->Timestamp = 0;
     obj->ReloadValue = 0;
+    obj->Sequence = 0;
     obj->IsRunning = false;
+    obj->HeapIndex = 0;
     obj->Callback = callback;
-    obj->Next = NULL;
 }
 
 IRAM_ATTR void TimerStart( TimerEvent_t *obj )
 {
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
-
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
 
-    if( ( obj == NULL ) || ( TimerExists( obj ) == true ) )
+    if( ( obj == NULL ) || ( TimerExists( obj ) == true ) || ( TimerHeapCount >= TIMER_HEAP_SIZE ) )
     {
         MICROPY_END_ATOMIC_SECTION(ilevel);
         return;
     }
 
-    obj->Timestamp = obj->ReloadValue;
-    obj->IsRunning = false;
+    obj->Timestamp = TimerGetCurrentTime( ) + obj->ReloadValue;
+    obj->Sequence = TimerSequence++;
+    obj->IsRunning = true;
+    TimerHeapInsert( obj );
+    TimerArmHead( );
+
+    MICROPY_END_ATOMIC_SECTION(ilevel);
+}
+
+/*!
+ * Timer ordering, on the expiry time, which may wrap around, then on the start order
+ */
+static inline IRAM_ATTR bool TimerIsBefore( TimerEvent_t *a, TimerEvent_t *b )
+{
+    int32_t diff = ( int32_t )( a->Timestamp - b->Timestamp );
 
-    if( TimerListHead == NULL )
+    if( diff != 0 )
     {
-        TimerInsertNewHeadTimer( obj, obj->Timestamp );
+        return diff < 0;
     }
-    else
+    return ( int32_t )( a->Sequence - b->Sequence ) < 0;
+}
+
+static inline IRAM_ATTR void TimerHeapSet( uint16_t i, TimerEvent_t *obj )
+{
+    TimerHeap[i] = obj;
+    obj->HeapIndex = i;
+}
+
+static IRAM_ATTR void TimerHeapSiftUp( uint16_t i )
+{
+    TimerEvent_t *obj = TimerHeap[i];
+
+    while( i > 0 )
     {
-        if( TimerListHead->IsRunning == true )
+        uint16_t parent = ( i - 1 ) / 2;
+        if( TimerIsBefore( obj, TimerHeap[parent] ) == false )
         {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > TimerListHead->Timestamp )
-            {
-                elapsedTime = TimerListHead->Timestamp; // security but should never occur
-            }
-            remainingTime = TimerListHead->Timestamp - elapsedTime;
+            break;
         }
-        else
+        TimerHeapSet( i, TimerHeap[parent] );
+        i = parent;
+    }
+    TimerHeapSet( i, obj );
+}
+
+static IRAM_ATTR void TimerHeapSiftDown( uint16_t i )
+{
+    TimerEvent_t *obj = TimerHeap[i];
+
+    for( ; ; )
+    {
+        uint16_t child = 2 * i + 1;
+        if( child >= TimerHeapCount )
         {
-            remainingTime = TimerListHead->Timestamp;
+            break;
         }
-
-        if( obj->Timestamp < remainingTime )
+        if( ( child + 1 < TimerHeapCount ) && TimerIsBefore( TimerHeap[child + 1], TimerHeap[child] ) )
         {
-            TimerInsertNewHeadTimer( obj, remainingTime );
+            child++;
         }
-        else
+        if( TimerIsBefore( TimerHeap[child], obj ) == false )
         {
-             TimerInsertTimer( obj, remainingTime );
+            break;
         }
+        TimerHeapSet( i, TimerHeap[child] );
+        i = child;
     }
-    MICROPY_END_ATOMIC_SECTION(ilevel);
+    TimerHeapSet( i, obj );
 }
 
-static IRAM_ATTR void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime )
+static IRAM_ATTR void TimerHeapInsert( TimerEvent_t *obj )
 {
-    uint32_t aggregatedTimestamp = 0;      // hold the sum of timestamps
-    uint32_t aggregatedTimestampNext = 0;  // hold the sum of timestamps up to the next event
+    TimerHeapSet( TimerHeapCount, obj );
+    TimerHeapCount++;
+    TimerHeapSiftUp( obj->HeapIndex );
+}
 
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead->Next;
+static IRAM_ATTR void TimerHeapRemove( TimerEvent_t *obj )
+{
+    uint16_t i = obj->HeapIndex;
+    TimerEvent_t *last = TimerHeap[--TimerHeapCount];
 
-    if( cur == NULL )
-    { // obj comes just after the head
-        obj->Timestamp -= remainingTime;
-        prev->Next = obj;
-        obj->Next = NULL;
-    }
-    else
+    obj->IsRunning = false;
+    if( last != obj )
     {
-        aggregatedTimestamp = remainingTime;
-        aggregatedTimestampNext = remainingTime + cur->Timestamp;
-
-        while( prev != NULL )
-        {
-            if( aggregatedTimestampNext > obj->Timestamp )
-            {
-                obj->Timestamp -= aggregatedTimestamp;
-                if( cur != NULL )
-                {
-                    cur->Timestamp -= obj->Timestamp;
-                }
-                prev->Next = obj;
-                obj->Next = cur;
-                break;
-            }
-            else
-            {
-                prev = cur;
-                cur = cur->Next;
-                if( cur == NULL )
-                { // obj comes at the end of the list
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    obj->Timestamp -= aggregatedTimestamp;
-                    prev->Next = obj;
-                    obj->Next = NULL;
-                    break;
-                }
-                else
-                {
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    aggregatedTimestampNext = aggregatedTimestampNext + cur->Timestamp;
-                }
-            }
-        }
+        // the last timer fills the hole, then moves up or down to its place
+        TimerHeapSet( i, last );
+        TimerHeapSiftUp( i );
+        TimerHeapSiftDown( last->HeapIndex );
     }
 }
 
-static IRAM_ATTR void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime )
+static IRAM_ATTR void TimerArmHead( void )
 {
-    TimerEvent_t* cur = TimerListHead;
-
-    if( cur != NULL )
+    if( TimerHeapCount == 0 )
     {
-        cur->Timestamp = remainingTime - obj->Timestamp;
-        cur->IsRunning = false;
+        TimerArmed = NULL;
+    }
+    else if( TimerHeap[0] != TimerArmed )
+    {
+        TimerArmed = TimerHeap[0];
+        TimerSetTimeout( TimerArmed );
     }
-
-    obj->Next = cur;
-    obj->IsRunning = true;
-    TimerListHead = obj;
-    TimerSetTimeout( TimerListHead );
 }
 
 IRAM_ATTR void TimerIrqHandler( void )
 {
-    uint32_t elapsedTime = 0;
+    TimerTime_t now;
 
-    // when all timers are stopped or expired, TimerListHead is NULL
-    if( TimerListHead == NULL )
+    // when all timers are stopped or expired, the heap is empty
+    if( TimerHeapCount == 0 )
     {
         return;
     }
 
-    elapsedTime = TimerGetValue( );
-
-    if( elapsedTime >= TimerListHead->Timestamp )
-    {
-        TimerListHead->Timestamp = 0;
-    }
-    else
-    {
-        TimerListHead->Timestamp -= elapsedTime;
-    }
-
-    TimerListHead->IsRunning = false;
+    now = TimerGetCurrentTime( );
 
-    while( ( TimerListHead != NULL ) && ( TimerListHead->Timestamp == 0 ) )
+    while( ( TimerHeapCount > 0 ) && ( ( int32_t )( now - TimerHeap[0]->Timestamp ) >= 0 ) )
     {
-        TimerEvent_t* elapsedTimer = TimerListHead;
-        TimerListHead = TimerListHead->Next;
+        TimerEvent_t* elapsedTimer = TimerHeap[0];
+        TimerHeapRemove( elapsedTimer );
 
         if( elapsedTimer->Callback != NULL )
         {
@@ -233,117 +231,31 @@ IRAM_ATTR void TimerIrqHandler( void )
         }
     }
 
-    // start the next TimerListHead if it exists
-    if( TimerListHead != NULL )
-    {
-        if( TimerListHead->IsRunning != true )
-        {
-            TimerListHead->IsRunning = true;
-            TimerSetTimeout( TimerListHead );
-        }
-    }
+    // start the next heap head if it exists
+    TimerArmed = NULL;
+    TimerArmHead( );
 }
 
 IRAM_ATTR void TimerStop( TimerEvent_t *obj )
 {
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
 
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
-
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead;
-
-    // List is empty or the Obj to stop does not exist
-    if( ( TimerListHead == NULL ) || ( obj == NULL ) )
+    // the heap is empty or the Obj to stop is not running
+    if( ( obj == NULL ) || ( TimerExists( obj ) == false ) )
     {
         MICROPY_END_ATOMIC_SECTION(ilevel);
         return;
     }
 
-    if( TimerListHead == obj ) // Stop the Head
-    {
-        if( TimerListHead->IsRunning == true ) // The head is already running
-        {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > obj->Timestamp )
-            {
-                elapsedTime = obj->Timestamp;
-            }
-
-            remainingTime = obj->Timestamp - elapsedTime;
-
-            if( TimerListHead->Next != NULL )
-            {
-                TimerListHead->IsRunning = false;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
-                TimerListHead->IsRunning = true;
-                TimerSetTimeout( TimerListHead );
-            }
-            else
-            {
-                TimerListHead = NULL;
-            }
-        }
-        else // Stop the head before it is started
-        {
-            if( TimerListHead->Next != NULL )
-            {
-                remainingTime = obj->Timestamp;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
-            }
-            else
-            {
-                TimerListHead = NULL;
-            }
-        }
-    }
-    else // Stop an object within the list
-    {
-        remainingTime = obj->Timestamp;
+    TimerHeapRemove( obj );
+    TimerArmHead( );
 
-        while( cur != NULL )
-        {
-            if( cur == obj )
-            {
-                if( cur->Next != NULL )
-                {
-                    cur = cur->Next;
-                    prev->Next = cur;
-                    cur->Timestamp += remainingTime;
-                }
-                else
-                {
-                    cur = NULL;
-                    prev->Next = cur;
-                }
-                break;
-            }
-            else
-            {
-                prev = cur;
-                cur = cur->Next;
-            }
-        }
-    }
     MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
 static IRAM_ATTR bool TimerExists( TimerEvent_t *obj )
 {
-    TimerEvent_t* cur = TimerListHead;
-
-    while( cur != NULL )
-    {
-        if( cur == obj )
-        {
-            return true;
-        }
-        cur = cur->Next;
-    }
-    return false;
+    return ( obj->IsRunning == true ) && ( obj->HeapIndex < TimerHeapCount ) && ( TimerHeap[obj->HeapIndex] == obj );
 }
 
 void TimerReset( TimerEvent_t *obj )
@@ -371,8 +283,10 @@ IRAM_ATTR TimerTime_t TimerGetCurrentTime( void )
 
 static IRAM_ATTR void TimerSetTimeout( TimerEvent_t *obj )
 {
+    int32_t remainingTime = ( int32_t )( obj->Timestamp - TimerGetCurrentTime( ) );
+
     HasLoopedThroughMain = 0;
-    TimerHwStart( obj->Timestamp );
+    TimerHwStart( ( remainingTime > 0 ) ? remainingTime : 0 );
 }
 
 IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
@@ -382,7 +296,7 @@ IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
 
 void TimerLowPowerHandler( void )
 {
-    if( ( TimerListHead != NULL ) && ( TimerListHead->IsRunning == true ) )
+    if( TimerHeapCount > 0 )
     {
         if( HasLoopedThroughMain < 5 )
         {
@@ -20,13 +20,21 @@ Maintainer: Miguel Luis and Gregory Cristian
  */
 typedef struct TimerEvent_s
 {
-    uint32_t Timestamp;         //! Current timer value
+    uint32_t Timestamp;         //! Expiry time, absolute, while the timer is running
     uint32_t ReloadValue;       //! Timer delay value
-    bool IsRunning;             //! Is the timer currently running
+    uint32_t Sequence;          //! Start order, timers expiring together fire in this order
+    bool IsRunning;             //! Is the timer started and not expired yet
+    uint16_t HeapIndex;         //! Position in the timer heap while running
     void ( *Callback )( void ); //! Timer IRQ callback function
-    struct TimerEvent_s *Next;  //! Pointer to the next Timer object.
 }TimerEvent_t;
 
+/*!
+ * \brief Maximum number of timers running at the same time
+ */
+#ifndef TIMER_HEAP_SIZE
+#define TIMER_HEAP_SIZE         16
+#endif
+
 /*!
  * \brief Timer time variable definition
  */
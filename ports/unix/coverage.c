@@ -135,6 +135,77 @@ STATIC const mp_obj_type_t mp_type_stest_textio2 = {
     .locals_dict = (mp_obj_dict_t*)&rawfile_locals_dict2,
 };
 
+#if MICROPY_STREAMS_POLL_NOTIFY
+
+// stream whose readiness is set from Python, and pushed to uselect unless
+// created with PollStream(False)
+typedef struct _mp_obj_polltest_t {
+    mp_obj_base_t base;
+    mp_uint_t ready;
+    bool push;
+    mp_stream_poll_notify_t *notify;
+} mp_obj_polltest_t;
+
+STATIC mp_obj_t ptest_set_ready(mp_obj_t o_in, mp_obj_t events_in) {
+    mp_obj_polltest_t *o = MP_OBJ_TO_PTR(o_in);
+    o->ready = mp_obj_get_int(events_in);
+    if (o->ready != 0) {
+        mp_stream_poll_signal(o->notify, o->ready);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(ptest_set_ready_obj, ptest_set_ready);
+
+STATIC mp_uint_t ptest_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    mp_obj_polltest_t *o = MP_OBJ_TO_PTR(o_in);
+    if (request == MP_STREAM_POLL) {
+        return arg & o->ready;
+    } else if (request == MP_STREAM_POLL_NOTIFY && o->push) {
+        mp_stream_poll_notify_t *notify = (mp_stream_poll_notify_t*)arg;
+        if (notify != NULL && o->notify != NULL) {
+            *errcode = MP_EBUSY;
+            return MP_STREAM_ERROR;
+        }
+        if (notify != NULL) {
+            notify->mask = MP_STREAM_POLL_RD | MP_STREAM_POLL_WR;
+        }
+        o->notify = notify;
+        return 0;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+STATIC mp_obj_t ptest_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 1, false);
+    mp_obj_polltest_t *o = m_new_obj(mp_obj_polltest_t);
+    o->base.type = type;
+    o->ready = 0;
+    o->push = (n_args == 0) || mp_obj_is_true(args[0]);
+    o->notify = NULL;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC const mp_rom_map_elem_t polltest_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_set_ready), MP_ROM_PTR(&ptest_set_ready_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(polltest_locals_dict, polltest_locals_dict_table);
+
+STATIC const mp_stream_p_t polltest_stream_p = {
+    .ioctl = ptest_ioctl,
+};
+
+const mp_obj_type_t mp_type_stest_pollable = {
+    { &mp_type_type },
+    .name = MP_QSTR_PollStream,
+    .make_new = ptest_make_new,
+    .protocol = &polltest_stream_p,
+    .locals_dict = (mp_obj_dict_t*)&polltest_locals_dict,
+};
+
+#endif
+
 // str/bytes objects without a valid hash
 STATIC const mp_obj_str_t str_no_hash_obj = {{&mp_type_str}, 0, 10, (const byte*)"0123456789"};
 STATIC const mp_obj_str_t bytes_no_hash_obj = {{&mp_type_bytes}, 0, 10, (const byte*)"0123456789"};
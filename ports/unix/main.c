@@ -498,6 +498,10 @@ MP_NOINLINE int main_(int argc, char **argv) {
     {
         MP_DECLARE_CONST_FUN_OBJ_0(extra_coverage_obj);
         mp_store_global(QSTR_FROM_STR_STATIC("extra_coverage"), MP_OBJ_FROM_PTR(&extra_coverage_obj));
+        #if MICROPY_STREAMS_POLL_NOTIFY
+        extern const mp_obj_type_t mp_type_stest_pollable;
+        mp_store_global(MP_QSTR_PollStream, MP_OBJ_FROM_PTR(&mp_type_stest_pollable));
+        #endif
     }
     #endif
 
@@ -38,6 +38,7 @@
 #include "py/objtuple.h"
 #include "py/mphal.h"
 #include "extmod/misc.h"
+#include "extmod/vfs_mmap.h"
 
 #ifdef __ANDROID__
 #define USE_STATFS 1
@@ -153,6 +154,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_os_mkdir_obj, mod_os_mkdir);
 typedef struct _mp_obj_listdir_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
+    // ilistdir(path, True): (name, mode, inode, size, mtime)
+    bool with_stat;
     DIR *dir;
 } mp_obj_listdir_t;
 
@@ -162,12 +165,27 @@ STATIC mp_obj_t listdir_next(mp_obj_t self_in) {
     if (self->dir == NULL) {
         goto done;
     }
-    struct dirent *dirent = readdir(self->dir);
-    if (dirent == NULL) {
-        closedir(self->dir);
-        self->dir = NULL;
-    done:
-        return MP_OBJ_STOP_ITERATION;
+    struct dirent *dirent;
+    struct stat st;
+    do {
+        dirent = readdir(self->dir);
+        if (dirent == NULL) {
+            closedir(self->dir);
+            self->dir = NULL;
+        done:
+            return MP_OBJ_STOP_ITERATION;
+        }
+        // with the stat, relative to the directory; skip what was removed since
+    } while (self->with_stat && fstatat(dirfd(self->dir), dirent->d_name, &st, 0) != 0);
+
+    if (self->with_stat) {
+        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(5, NULL));
+        t->items[0] = mp_obj_new_str(dirent->d_name, strlen(dirent->d_name));
+        t->items[1] = MP_OBJ_NEW_SMALL_INT(st.st_mode);
+        t->items[2] = MP_OBJ_NEW_SMALL_INT(st.st_ino);
+        t->items[3] = mp_obj_new_int_from_uint(st.st_size);
+        t->items[4] = MP_OBJ_NEW_SMALL_INT(st.st_mtime);
+        return MP_OBJ_FROM_PTR(t);
     }
 
     mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
@@ -195,9 +213,17 @@ STATIC mp_obj_t mod_os_ilistdir(size_t n_args, const mp_obj_t *args) {
     o->base.type = &mp_type_polymorph_iter;
     o->dir = opendir(path);
     o->iternext = listdir_next;
+    o->with_stat = n_args > 1 && mp_obj_is_true(args[1]);
     return MP_OBJ_FROM_PTR(o);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_os_ilistdir_obj, 0, 1, mod_os_ilistdir);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_os_ilistdir_obj, 0, 2, mod_os_ilistdir);
+
+#if MICROPY_VFS_MMAP
+STATIC mp_obj_t mod_os_mmap(mp_obj_t path_in) {
+    return mp_vfs_mmap_posix(mp_obj_str_get_str(path_in));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_os_mmap_obj, mod_os_mmap);
+#endif
 
 STATIC mp_obj_t mod_os_errno(size_t n_args, const mp_obj_t *args) {
     if (n_args == 0) {
@@ -221,6 +247,9 @@ STATIC const mp_rom_map_elem_t mp_module_os_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_getenv), MP_ROM_PTR(&mod_os_getenv_obj) },
     { MP_ROM_QSTR(MP_QSTR_mkdir), MP_ROM_PTR(&mod_os_mkdir_obj) },
     { MP_ROM_QSTR(MP_QSTR_ilistdir), MP_ROM_PTR(&mod_os_ilistdir_obj) },
+    #if MICROPY_VFS_MMAP
+    { MP_ROM_QSTR(MP_QSTR_mmap), MP_ROM_PTR(&mod_os_mmap_obj) },
+    #endif
     #if MICROPY_PY_OS_DUPTERM
     { MP_ROM_QSTR(MP_QSTR_dupterm), MP_ROM_PTR(&mp_uos_dupterm_obj) },
     #endif
@@ -37,6 +37,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <poll.h>
 
 #include "py/objtuple.h"
 #include "py/objstr.h"
@@ -110,7 +111,6 @@ STATIC mp_uint_t socket_write(mp_obj_t o_in, const void *buf, mp_uint_t size, in
 
 STATIC mp_uint_t socket_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode) {
     mp_obj_socket_t *self = MP_OBJ_TO_PTR(o_in);
-    (void)arg;
     switch (request) {
         case MP_STREAM_CLOSE:
             // There's a POSIX drama regarding return value of close in general,
@@ -123,6 +123,35 @@ STATIC mp_uint_t socket_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, i
             close(self->fd);
             return 0;
 
+        case MP_STREAM_POLL: {
+            // for the extmod uselect, the POSIX one polls the fd itself
+            struct pollfd pfd = { .fd = self->fd, .events = 0 };
+            if (arg & MP_STREAM_POLL_RD) {
+                pfd.events |= POLLIN;
+            }
+            if (arg & MP_STREAM_POLL_WR) {
+                pfd.events |= POLLOUT;
+            }
+            if (poll(&pfd, 1, 0) < 0) {
+                *errcode = errno;
+                return MP_STREAM_ERROR;
+            }
+            mp_uint_t ret = 0;
+            if (pfd.revents & POLLIN) {
+                ret |= MP_STREAM_POLL_RD;
+            }
+            if (pfd.revents & POLLOUT) {
+                ret |= MP_STREAM_POLL_WR;
+            }
+            if (pfd.revents & POLLHUP) {
+                ret |= MP_STREAM_POLL_HUP;
+            }
+            if (pfd.revents & (POLLERR | POLLNVAL)) {
+                ret |= MP_STREAM_POLL_ERR;
+            }
+            return ret;
+        }
+
         default:
             *errcode = MP_EINVAL;
             return MP_STREAM_ERROR;
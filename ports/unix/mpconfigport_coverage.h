@@ -29,6 +29,11 @@
 
 #define MICROPY_VFS                    (1)
 #define MICROPY_PY_UOS_VFS             (1)
+// the uselect of extmod, with streams pushing their readiness
+#define MICROPY_PY_USELECT             (1)
+#define MICROPY_PY_USELECT_POSIX       (0)
+#define MICROPY_STREAMS_POLL_NOTIFY    (1)
+#define MICROPY_EVENT_POLL_HOOK        mp_hal_delay_us(500);
 
 #include <mpconfigport.h>
 
@@ -45,5 +50,6 @@
 #define MICROPY_PY_IO_RESOURCE_STREAM (1)
 #undef MICROPY_VFS_FAT
 #define MICROPY_VFS_FAT                (1)
+#define MICROPY_VFS_BLOCKCACHE         (1)
 #define MICROPY_PY_FRAMEBUF            (1)
 #define MICROPY_PY_COLLECTIONS_NAMEDTUPLE__ASDICT (1)
@@ -30,6 +30,7 @@
 #endif
 
 void mp_hal_set_interrupt_char(char c);
+void mp_hal_set_reset_char(int c);
 
 void mp_hal_stdio_mode_raw(void);
 void mp_hal_stdio_mode_orig(void);
@@ -81,6 +81,11 @@ void mp_hal_set_interrupt_char(char c) {
     }
 }
 
+void mp_hal_set_reset_char(int c) {
+    // soft-reset via the terminal is not supported on this port
+    (void)c;
+}
+
 #if MICROPY_USE_READLINE == 1
 
 #include <termios.h>
@@ -199,6 +199,223 @@ STATIC const mp_obj_type_t bufwriter_type = {
 };
 #endif // MICROPY_PY_IO_BUFFEREDWRITER
 
+#if MICROPY_PY_IO_BUFFEREDREADER
+typedef struct _mp_obj_bufreader_t {
+    mp_obj_base_t base;
+    mp_obj_t stream;
+    byte *buf; // NULL once closed
+    size_t alloc;
+    size_t pos;
+    size_t len;
+} mp_obj_bufreader_t;
+
+STATIC mp_obj_t bufreader_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 2, false);
+    mp_get_stream_raise(args[0], MP_STREAM_OP_READ);
+    size_t alloc = MICROPY_PY_IO_BUFFEREDREADER_SIZE;
+    if (n_args > 1) {
+        alloc = mp_obj_get_int(args[1]);
+        if (alloc == 0) {
+            mp_raise_ValueError(NULL);
+        }
+    }
+    mp_obj_bufreader_t *o = m_new_obj(mp_obj_bufreader_t);
+    o->base.type = type;
+    o->stream = args[0];
+    o->buf = mp_stream_buf_alloc(alloc);
+    o->alloc = alloc;
+    o->pos = 0;
+    o->len = 0;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+// Refill the (empty) buffer with a single read of the underlying stream.
+// Returns number of bytes available, 0 on EOF, or MP_STREAM_ERROR.
+STATIC mp_uint_t bufreader_fill(mp_obj_bufreader_t *self, int *errcode) {
+    if (self->buf == NULL) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    self->pos = 0;
+    self->len = 0;
+    mp_uint_t out_sz = mp_get_stream(self->stream)->read(self->stream, self->buf, self->alloc, errcode);
+    if (out_sz == MP_STREAM_ERROR) {
+        return MP_STREAM_ERROR;
+    }
+    self->len = out_sz;
+    return out_sz;
+}
+
+STATIC mp_uint_t bufreader_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
+    mp_obj_bufreader_t *self = MP_OBJ_TO_PTR(self_in);
+
+    if (self->pos == self->len) {
+        if (size >= self->alloc && self->buf != NULL) {
+            // Buffer is empty and the caller wants at least a buffer's
+            // worth, so read straight into the caller's memory
+            return mp_get_stream(self->stream)->read(self->stream, buf, size, errcode);
+        }
+        mp_uint_t out_sz = bufreader_fill(self, errcode);
+        if (out_sz == MP_STREAM_ERROR || out_sz == 0) {
+            return out_sz;
+        }
+    }
+
+    mp_uint_t n = MIN(size, self->len - self->pos);
+    memcpy(buf, self->buf + self->pos, n);
+    self->pos += n;
+    return n;
+}
+
+STATIC mp_obj_t bufreader_readline(size_t n_args, const mp_obj_t *args) {
+    mp_obj_bufreader_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    size_t max_size = (size_t)-1;
+    if (n_args > 1) {
+        mp_int_t sz = mp_obj_get_int(args[1]);
+        if (sz >= 0) {
+            max_size = sz;
+        }
+    }
+
+    // The line is scanned for in the buffer and copied out in chunks, and
+    // the common case of a line which is already buffered is returned with
+    // a single allocation.
+    vstr_t vstr;
+    bool have_vstr = false;
+    size_t got = 0;
+    while (got < max_size) {
+        if (self->pos == self->len) {
+            int error;
+            mp_uint_t out_sz = bufreader_fill(self, &error);
+            if (out_sz == MP_STREAM_ERROR) {
+                if (mp_is_nonblocking_error(error)) {
+                    if (got == 0) {
+                        // Same as read() and unbuffered readline()
+                        return mp_const_none;
+                    }
+                    break;
+                }
+                mp_raise_OSError(error);
+            }
+            if (out_sz == 0) {
+                break;
+            }
+        }
+
+        const byte *start = self->buf + self->pos;
+        size_t n = MIN(self->len - self->pos, max_size - got);
+        const byte *nl = memchr(start, '\n', n);
+        if (nl != NULL) {
+            n = nl - start + 1;
+        }
+        bool done = nl != NULL || got + n == max_size;
+        if (done && !have_vstr) {
+            self->pos += n;
+            return mp_obj_new_bytes(start, n);
+        }
+        if (!have_vstr) {
+            vstr_init(&vstr, n + 16);
+            have_vstr = true;
+        }
+        vstr_add_strn(&vstr, (const char*)start, n);
+        self->pos += n;
+        got += n;
+        if (done) {
+            break;
+        }
+    }
+
+    if (!have_vstr) {
+        return mp_const_empty_bytes;
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bufreader_readline_obj, 1, 2, bufreader_readline);
+
+STATIC mp_obj_t bufreader_iternext(mp_obj_t self_in) {
+    mp_obj_t line = bufreader_readline(1, &self_in);
+    if (line == mp_const_none || !mp_obj_is_true(line)) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    return line;
+}
+
+STATIC mp_uint_t bufreader_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    mp_obj_bufreader_t *self = MP_OBJ_TO_PTR(self_in);
+    const mp_stream_p_t *stream_p = mp_get_stream(self->stream);
+
+    if (request == MP_STREAM_CLOSE) {
+        if (self->buf == NULL) {
+            return 0;
+        }
+        // Nothing else refers to the buffer, so it can go back to the pool
+        mp_stream_buf_free(self->buf, self->alloc);
+        self->buf = NULL;
+        self->pos = self->len = 0;
+    } else if (request == MP_STREAM_POLL) {
+        if (self->pos != self->len && (arg & MP_STREAM_POLL_RD)) {
+            // Buffered data can be read without touching the stream
+            mp_uint_t ret = MP_STREAM_POLL_RD;
+            if ((arg & ~MP_STREAM_POLL_RD) && stream_p->ioctl != NULL) {
+                mp_uint_t r = stream_p->ioctl(self->stream, request, arg & ~MP_STREAM_POLL_RD, errcode);
+                if (r != MP_STREAM_ERROR) {
+                    ret |= r;
+                }
+            }
+            return ret;
+        }
+    } else if (request == MP_STREAM_SEEK) {
+        // Account for what was read ahead, then drop it
+        struct mp_stream_seek_t *seek_s = (struct mp_stream_seek_t*)arg;
+        if (seek_s->whence == 1) {
+            seek_s->offset -= self->len - self->pos;
+        }
+        self->pos = self->len = 0;
+    }
+
+    if (stream_p->ioctl == NULL) {
+        *errcode = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    return stream_p->ioctl(self->stream, request, arg, errcode);
+}
+
+STATIC mp_obj_t bufreader___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return mp_stream_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bufreader___exit___obj, 4, 4, bufreader___exit__);
+
+STATIC const mp_rom_map_elem_t bufreader_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read1), MP_ROM_PTR(&mp_stream_read1_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readline), MP_ROM_PTR(&bufreader_readline_obj) },
+    { MP_ROM_QSTR(MP_QSTR_seek), MP_ROM_PTR(&mp_stream_seek_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tell), MP_ROM_PTR(&mp_stream_tell_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&bufreader___exit___obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(bufreader_locals_dict, bufreader_locals_dict_table);
+
+STATIC const mp_stream_p_t bufreader_stream_p = {
+    .read = bufreader_read,
+    .ioctl = bufreader_ioctl,
+};
+
+STATIC const mp_obj_type_t bufreader_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_BufferedReader,
+    .make_new = bufreader_make_new,
+    .getiter = mp_identity_getiter,
+    .iternext = bufreader_iternext,
+    .protocol = &bufreader_stream_p,
+    .locals_dict = (mp_obj_dict_t*)&bufreader_locals_dict,
+};
+#endif // MICROPY_PY_IO_BUFFEREDREADER
+
 #if MICROPY_PY_IO_RESOURCE_STREAM
 STATIC mp_obj_t resource_stream(mp_obj_t package_in, mp_obj_t path_in) {
     VSTR_FIXED(path_buf, MICROPY_ALLOC_PATH_MAX);
@@ -274,6 +491,9 @@ STATIC const mp_rom_map_elem_t mp_module_io_globals_table[] = {
     #if MICROPY_PY_IO_BUFFEREDWRITER
     { MP_ROM_QSTR(MP_QSTR_BufferedWriter), MP_ROM_PTR(&bufwriter_type) },
     #endif
+    #if MICROPY_PY_IO_BUFFEREDREADER
+    { MP_ROM_QSTR(MP_QSTR_BufferedReader), MP_ROM_PTR(&bufreader_type) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_io_globals, mp_module_io_globals_table);
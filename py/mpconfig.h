@@ -679,6 +679,24 @@ typedef double mp_float_t;
 #define MICROPY_STREAMS_POSIX_API (0)
 #endif
 
+// Whether streams can push readiness events to uselect.poll (see
+// MP_STREAM_POLL_NOTIFY), so polling cost scales with ready objects only
+#ifndef MICROPY_STREAMS_POLL_NOTIFY
+#define MICROPY_STREAMS_POLL_NOTIFY (0)
+#endif
+
+// Attribute for mp_stream_poll_signal(), eg to place it in RAM when it's
+// called from interrupts that run while the code in flash can't be read
+#ifndef MICROPY_STREAMS_POLL_SIGNAL_ATTR
+#define MICROPY_STREAMS_POLL_SIGNAL_ATTR
+#endif
+
+// Number of released stream buffers kept for reuse by buffered streams
+// (see mp_stream_buf_alloc), 0 disables the pool
+#ifndef MICROPY_STREAMS_BUF_POOL_DEPTH
+#define MICROPY_STREAMS_BUF_POOL_DEPTH (MICROPY_PY_IO_BUFFEREDREADER ? 4 : 0)
+#endif
+
 // Whether to call __init__ when importing builtin modules for the first time
 #ifndef MICROPY_MODULE_BUILTIN_INIT
 #define MICROPY_MODULE_BUILTIN_INIT (0)
@@ -758,6 +776,39 @@ typedef double mp_float_t;
 #define MICROPY_VFS_FAT (0)
 #endif
 
+// Support for log files, open(path, 'ab', buffering=N), see extmod/vfs_log.h
+#ifndef MICROPY_VFS_LOG
+#define MICROPY_VFS_LOG (0)
+#endif
+
+// Longest a record waits in the buffer of a log file, checked on the next write
+#ifndef MICROPY_VFS_LOG_INTERVAL_MS
+#define MICROPY_VFS_LOG_INTERVAL_MS (1000)
+#endif
+
+// Support for a cache of blocks on FAT mounts, mount(..., cache=N), see extmod/vfs_blockcache.h
+#ifndef MICROPY_VFS_BLOCKCACHE
+#define MICROPY_VFS_BLOCKCACHE (0)
+#endif
+
+// Blocks cached, and read ahead at most, for a mount that doesn't say
+#ifndef MICROPY_VFS_BLOCKCACHE_BLOCKS
+#define MICROPY_VFS_BLOCKCACHE_BLOCKS (16)
+#endif
+#ifndef MICROPY_VFS_BLOCKCACHE_READAHEAD
+#define MICROPY_VFS_BLOCKCACHE_READAHEAD (8)
+#endif
+
+// Support for read-only maps of files, uos.mmap(path), see extmod/vfs_mmap.h
+#ifndef MICROPY_VFS_MMAP
+#define MICROPY_VFS_MMAP (0)
+#endif
+
+// Maps of files with mmap(2), for vfs_posix and the unix port
+#ifndef MICROPY_VFS_MMAP_POSIX
+#define MICROPY_VFS_MMAP_POSIX (0)
+#endif
+
 /*****************************************************************************/
 /* Fine control over Python builtins, classes, modules, etc                  */
 
@@ -861,6 +912,12 @@ typedef double mp_float_t;
 #define MICROPY_PY_BUILTINS_MEMORYVIEW_ITEMSIZE (0)
 #endif
 
+// Whether a memoryview holds the object it was taken from, needed when a
+// buffer lives outside the heap (eg a uos.mmap() map), at one word per view
+#ifndef MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ
+#define MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ (MICROPY_VFS_MMAP)
+#endif
+
 // Whether to support set object
 #ifndef MICROPY_PY_BUILTINS_SET
 #define MICROPY_PY_BUILTINS_SET (1)
@@ -1126,6 +1183,16 @@ typedef double mp_float_t;
 #define MICROPY_PY_IO_BUFFEREDWRITER (0)
 #endif
 
+// Whether to provide "io.BufferedReader" class
+#ifndef MICROPY_PY_IO_BUFFEREDREADER
+#define MICROPY_PY_IO_BUFFEREDREADER (0)
+#endif
+
+// Default buffer size of "io.BufferedReader"
+#ifndef MICROPY_PY_IO_BUFFEREDREADER_SIZE
+#define MICROPY_PY_IO_BUFFEREDREADER_SIZE (256)
+#endif
+
 // Whether to provide "struct" module
 #ifndef MICROPY_PY_STRUCT
 #define MICROPY_PY_STRUCT (1)
@@ -178,6 +178,12 @@ typedef struct _mp_state_vm_t {
     mp_obj_t lwip_slip_stream;
     #endif
 
+    #if MICROPY_STREAMS_BUF_POOL_DEPTH
+    // released stream buffers, chained through their first word
+    void *stream_buf_pool;
+    size_t stream_buf_pool_len;
+    #endif
+
     #if MICROPY_VFS
     struct _mp_vfs_mount_t *vfs_cur;
     struct _mp_vfs_mount_t *vfs_mount_table;
@@ -47,12 +47,20 @@
 //  - free is the offset in elements to the first item in the memoryview
 //  - len is the length in elements
 //  - items points to the start of the original buffer
+// A buffer that isn't in the heap (eg a mapped file) goes away with the object
+// that owns it, so with MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ the memoryview also
+// holds that object, in mp_obj_memoryview_t.
 // Note that we don't handle the case where the original buffer might change
 // size due to a resize of the original parent object.
 
 #if MICROPY_PY_BUILTINS_MEMORYVIEW
 #define TYPECODE_MASK (0x7f)
 #define memview_offset free
+#if MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ
+#define MEMORYVIEW_SIZE (sizeof(mp_obj_memoryview_t))
+#else
+#define MEMORYVIEW_SIZE (sizeof(mp_obj_array_t))
+#endif
 #else
 // make (& TYPECODE_MASK) a null operation if memorview not enabled
 #define TYPECODE_MASK (~(size_t)0)
@@ -200,7 +208,10 @@ STATIC mp_obj_t bytearray_make_new(const mp_obj_type_t *type_in, size_t n_args,
 #if MICROPY_PY_BUILTINS_MEMORYVIEW
 
 mp_obj_t mp_obj_new_memoryview(byte typecode, size_t nitems, void *items) {
-    mp_obj_array_t *self = m_new_obj(mp_obj_array_t);
+    mp_obj_array_t *self = m_malloc(MEMORYVIEW_SIZE);
+    #if MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ
+    ((mp_obj_memoryview_t*)self)->obj = MP_OBJ_NULL;
+    #endif
     self->base.type = &mp_type_memoryview;
     self->typecode = typecode;
     self->memview_offset = 0;
@@ -229,6 +240,10 @@ STATIC mp_obj_t memoryview_make_new(const mp_obj_type_t *type_in, size_t n_args,
         self->typecode |= MP_OBJ_ARRAY_TYPECODE_FLAG_RW; // indicate writable buffer
     }
 
+    #if MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ
+    ((mp_obj_memoryview_t*)self)->obj = args[0];
+    #endif
+
     return MP_OBJ_FROM_PTR(self);
 }
 
@@ -470,8 +485,8 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
             assert(sz > 0);
             #if MICROPY_PY_BUILTINS_MEMORYVIEW
             if (o->base.type == &mp_type_memoryview) {
-                res = m_new_obj(mp_obj_array_t);
-                *res = *o;
+                res = m_malloc(MEMORYVIEW_SIZE);
+                memcpy(res, o, MEMORYVIEW_SIZE);
                 res->memview_offset += slice.start;
                 res->len = slice.stop - slice.start;
             } else
@@ -49,4 +49,13 @@ typedef struct _mp_obj_array_t {
     void *items;
 } mp_obj_array_t;
 
+#if MICROPY_PY_BUILTINS_MEMORYVIEW_OBJ
+// memoryview with the object its buffer came from, so that object (and so a
+// buffer outside the heap that it owns) lives as long as the view does
+typedef struct _mp_obj_memoryview_t {
+    mp_obj_array_t array;
+    mp_obj_t obj;
+} mp_obj_memoryview_t;
+#endif
+
 #endif // MICROPY_INCLUDED_PY_OBJARRAY_H
@@ -26,6 +26,10 @@
 #ifndef MICROPY_INCLUDED_PY_RINGBUF_H
 #define MICROPY_INCLUDED_PY_RINGBUF_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 typedef struct _ringbuf_t {
     uint8_t *buf;
     uint16_t size;
@@ -69,4 +73,74 @@ static inline int ringbuf_put(ringbuf_t *r, uint8_t v) {
     return 0;
 }
 
+// Bulk access, for one producer and one consumer that may run concurrently
+// (eg an IRQ handler and a task).  The producer copies data past iput and then
+// publishes it by advancing iput, the consumer reads data past iget and then
+// releases the space by advancing iget.  Each side only writes its own index.
+// Note: size-1 bytes can be stored.
+
+// Bytes the consumer can read.
+static inline size_t ringbuf_avail(ringbuf_t *r) {
+    uint16_t iput = __atomic_load_n(&r->iput, __ATOMIC_ACQUIRE);
+    return (r->size + iput - r->iget) % r->size;
+}
+
+// Bytes the producer can write.
+static inline size_t ringbuf_free(ringbuf_t *r) {
+    uint16_t iget = __atomic_load_n(&r->iget, __ATOMIC_ACQUIRE);
+    return (r->size + iget - r->iput - 1) % r->size;
+}
+
+// Copy len bytes at offset bytes past iput, not visible to the consumer until
+// ringbuf_put_commit().  The caller checks ringbuf_free() first.
+static inline void ringbuf_write_at(ringbuf_t *r, size_t offset, const uint8_t *data, size_t len) {
+    size_t pos = (r->iput + offset) % r->size;
+    size_t n = r->size - pos;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(r->buf + pos, data, n);
+    memcpy(r->buf, data + n, len - n);
+}
+
+static inline void ringbuf_put_commit(ringbuf_t *r, size_t len) {
+    __atomic_store_n(&r->iput, (uint16_t)((r->iput + len) % r->size), __ATOMIC_RELEASE);
+}
+
+// Copy len bytes at offset bytes past iget, they stay in the buffer until
+// ringbuf_get_commit().  The caller checks ringbuf_avail() first.
+static inline void ringbuf_read_at(ringbuf_t *r, size_t offset, uint8_t *data, size_t len) {
+    size_t pos = (r->iget + offset) % r->size;
+    size_t n = r->size - pos;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(data, r->buf + pos, n);
+    memcpy(data + n, r->buf, len - n);
+}
+
+static inline void ringbuf_get_commit(ringbuf_t *r, size_t len) {
+    __atomic_store_n(&r->iget, (uint16_t)((r->iget + len) % r->size), __ATOMIC_RELEASE);
+}
+
+// Put all of data or nothing, returns -1 if there is not enough space.
+static inline int ringbuf_put_bytes(ringbuf_t *r, const uint8_t *data, size_t len) {
+    if (ringbuf_free(r) < len) {
+        return -1;
+    }
+    ringbuf_write_at(r, 0, data, len);
+    ringbuf_put_commit(r, len);
+    return 0;
+}
+
+// Get exactly len bytes or nothing, returns -1 if fewer are available.
+static inline int ringbuf_get_bytes(ringbuf_t *r, uint8_t *data, size_t len) {
+    if (ringbuf_avail(r) < len) {
+        return -1;
+    }
+    ringbuf_read_at(r, 0, data, len);
+    ringbuf_get_commit(r, len);
+    return 0;
+}
+
 #endif // MICROPY_INCLUDED_PY_RINGBUF_H
@@ -112,6 +112,11 @@ void mp_init(void) {
     }
     #endif
 
+    #if MICROPY_STREAMS_BUF_POOL_DEPTH
+    MP_STATE_VM(stream_buf_pool) = NULL;
+    MP_STATE_VM(stream_buf_pool_len) = 0;
+    #endif
+
     #if MICROPY_VFS
     // initialise the VFS sub-system
     MP_STATE_VM(vfs_cur) = NULL;
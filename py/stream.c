@@ -494,6 +494,60 @@ STATIC mp_obj_t stream_ioctl(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_stream_ioctl_obj, 2, 3, stream_ioctl);
 
+#if MICROPY_STREAMS_BUF_POOL_DEPTH
+
+typedef struct _stream_buf_free_t {
+    struct _stream_buf_free_t *next;
+    size_t len;
+} stream_buf_free_t;
+
+byte *mp_stream_buf_alloc(size_t len) {
+    stream_buf_free_t **b = (stream_buf_free_t**)&MP_STATE_VM(stream_buf_pool);
+    for (; *b != NULL; b = &(*b)->next) {
+        if ((*b)->len == len) {
+            stream_buf_free_t *buf = *b;
+            *b = buf->next;
+            MP_STATE_VM(stream_buf_pool_len) -= 1;
+            return (byte*)buf;
+        }
+    }
+    return m_new(byte, len);
+}
+
+void mp_stream_buf_free(byte *buf, size_t len) {
+    if (len < sizeof(stream_buf_free_t) || MP_STATE_VM(stream_buf_pool_len) >= MICROPY_STREAMS_BUF_POOL_DEPTH) {
+        m_del(byte, buf, len);
+        return;
+    }
+    stream_buf_free_t *b = (stream_buf_free_t*)buf;
+    b->next = MP_STATE_VM(stream_buf_pool);
+    b->len = len;
+    MP_STATE_VM(stream_buf_pool) = b;
+    MP_STATE_VM(stream_buf_pool_len) += 1;
+}
+
+#endif
+
+#if MICROPY_STREAMS_POLL_NOTIFY
+
+MICROPY_STREAMS_POLL_SIGNAL_ATTR
+void mp_stream_poll_signal(mp_stream_poll_notify_t *notify, mp_uint_t events) {
+    if (notify == NULL) {
+        return;
+    }
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    notify->events |= events;
+    if (!notify->queued) {
+        // link onto the poller's ready list, it is drained on the next poll
+        notify->queued = 1;
+        notify->next = notify->ready->head;
+        notify->ready->head = notify;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+#endif
+
 #if MICROPY_STREAMS_POSIX_API
 /*
  * POSIX-like functions
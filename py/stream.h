@@ -43,6 +43,7 @@
 #define MP_STREAM_GET_DATA_OPTS (8)  // Get data/message options
 #define MP_STREAM_SET_DATA_OPTS (9)  // Set data/message options
 #define MP_STREAM_GET_FILENO    (10) // Get fileno of underlying file
+#define MP_STREAM_POLL_NOTIFY   (11) // Attach/detach readiness notifier
 
 // These poll ioctl values are compatible with Linux
 #define MP_STREAM_POLL_RD  (0x0001)
@@ -64,6 +65,29 @@ struct mp_stream_seek_t {
 #define MP_SEEK_CUR (1)
 #define MP_SEEK_END (2)
 
+#if MICROPY_STREAMS_POLL_NOTIFY
+// Argument structure for MP_STREAM_POLL_NOTIFY. A stream that can detect
+// state changes itself (eg from a network or UART interrupt) keeps the
+// pointer it is given (NULL detaches), sets "mask" to the events it will
+// report and calls mp_stream_poll_signal() whenever one of them may have
+// become ready. A stream holds at most one notifier: return MP_EBUSY if
+// another one is already attached.
+typedef struct _mp_stream_poll_ready_t {
+    struct _mp_stream_poll_notify_t *head;
+} mp_stream_poll_ready_t;
+
+typedef struct _mp_stream_poll_notify_t {
+    struct _mp_stream_poll_notify_t *next;
+    mp_stream_poll_ready_t *ready;
+    volatile uint16_t events;
+    volatile uint16_t queued;
+    uint16_t mask;
+} mp_stream_poll_notify_t;
+
+// Can be called from interrupt context
+void mp_stream_poll_signal(mp_stream_poll_notify_t *notify, mp_uint_t events);
+#endif
+
 // Stream protocol
 typedef struct _mp_stream_p_t {
     // On error, functions should return MP_STREAM_ERROR and fill in *errcode (values
@@ -115,6 +139,17 @@ mp_uint_t mp_stream_rw(mp_obj_t stream, void *buf, mp_uint_t size, int *errcode,
 
 void mp_stream_write_adaptor(void *self, const char *buf, size_t len);
 
+// Buffers for buffered streams. A released buffer is kept for reuse by the
+// next allocation of the same size, so short-lived readers (e.g. one per
+// socket) don't churn the heap. Only release a buffer nothing else refers to.
+#if MICROPY_STREAMS_BUF_POOL_DEPTH
+byte *mp_stream_buf_alloc(size_t len);
+void mp_stream_buf_free(byte *buf, size_t len);
+#else
+#define mp_stream_buf_alloc(len) m_new(byte, len)
+#define mp_stream_buf_free(buf, len) m_del(byte, buf, len)
+#endif
+
 #if MICROPY_STREAMS_POSIX_API
 // Functions with POSIX-compatible signatures
 // "stream" is assumed to be a pointer to a concrete object with the stream protocol
@@ -0,0 +1,64 @@
+try:
+    import uio as io
+except ImportError:
+    import io
+
+try:
+    io.BytesIO
+    io.BufferedReader
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+data = b"line1\nline two\n\nlast line without newline"
+
+# readline across buffer refills, including a line longer than the buffer
+buf = io.BufferedReader(io.BytesIO(data), 4)
+while True:
+    l = buf.readline()
+    print(l)
+    if not l:
+        break
+
+# readline with a size limit
+buf = io.BufferedReader(io.BytesIO(data), 8)
+print(buf.readline(3))
+print(buf.readline(10))
+print(buf.readline(-1))
+
+# read() and readinto() mixed with readline()
+buf = io.BufferedReader(io.BytesIO(data), 8)
+print(buf.read(2))
+print(buf.readline())
+ba = bytearray(6)
+print(buf.readinto(ba), ba)
+# a read larger than the buffer bypasses it
+print(buf.read(20))
+print(buf.read())
+print(buf.read())
+
+# iteration
+print(list(io.BufferedReader(io.BytesIO(data), 16)))
+
+# seek/tell account for data read ahead into the buffer
+buf = io.BufferedReader(io.BytesIO(data), 16)
+print(buf.readline())
+print(buf.seek(0, 1))
+print(buf.read(4))
+buf.seek(2)
+print(buf.read(3))
+
+# closing releases the buffer, and the buffer is reused by the next reader
+with io.BufferedReader(io.BytesIO(data), 16) as buf:
+    print(buf.read(5))
+try:
+    buf.read(1)
+except (OSError, ValueError):
+    print('closed')
+buf = io.BufferedReader(io.BytesIO(b"reused\n"), 16)
+print(buf.readline())
+
+try:
+    io.BufferedReader(io.BytesIO(), 0)
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,20 @@
+# Inserting time-series records into a btree in arbitrary order
+import bench
+import btree
+import uio
+
+N_PAGES = 8
+
+def keys(n):
+    return [("%08d" % i).encode() for i in range(n)]
+
+def test(num):
+    ks = keys(num // 20000)
+    # deterministic shuffle
+    ks = ks[1::2] + ks[::2]
+    db = btree.open(uio.BytesIO(), pagesize=1024, cachepages=N_PAGES)
+    for k in ks:
+        db[k] = b"x" * 32
+    db.close()
+
+bench.run(test)
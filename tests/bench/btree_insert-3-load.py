@@ -0,0 +1,17 @@
+# Inserting time-series records into a btree with a sorted bulk load
+import bench
+import btree
+import uio
+
+N_PAGES = 8
+
+def keys(n):
+    return [("%08d" % i).encode() for i in range(n)]
+
+def test(num):
+    db = btree.open(uio.BytesIO(), pagesize=1024, cachepages=N_PAGES)
+    v = b"x" * 32
+    db.load((k, v) for k in keys(num // 20000))
+    db.close()
+
+bench.run(test)
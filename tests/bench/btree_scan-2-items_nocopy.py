@@ -0,0 +1,20 @@
+# Range scan over a btree, with memoryviews into the page cache
+import bench
+import btree
+import uio
+
+N_PAGES = 8
+
+def keys(n):
+    return [("%08d" % i).encode() for i in range(n)]
+
+def test(num):
+    db = btree.open(uio.BytesIO(), pagesize=1024, cachepages=N_PAGES)
+    v = b"x" * 32
+    db.load((k, v) for k in keys(1000))
+    for i in range(num // 2000000):
+        for k, v in db.items(b"00000100", b"00000900", btree.NOCOPY):
+            pass
+    db.close()
+
+bench.run(test)
@@ -0,0 +1,11 @@
+# Blitting a 32x32 RGB565 sprite with a transparent colour (per pixel)
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 * 2), 128, 64, framebuf.RGB565)
+    sprite = framebuf.FrameBuffer(bytearray(32 * 32 * 2), 32, 32, framebuf.RGB565)
+    for i in range(num // 20000):
+        fb.blit(sprite, i & 63, 16, 0)
+
+bench.run(test)
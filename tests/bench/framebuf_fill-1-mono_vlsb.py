@@ -0,0 +1,10 @@
+# Filling rectangles on a 128x64 MONO_VLSB framebuffer (eg SSD1306)
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 // 8), 128, 64, framebuf.MONO_VLSB)
+    for i in range(num // 2000):
+        fb.fill_rect(3, 5, 100, 50, i & 1)
+
+bench.run(test)
@@ -0,0 +1,10 @@
+# Filling rectangles on a 128x64 RGB565 framebuffer
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 * 2), 128, 64, framebuf.RGB565)
+    for i in range(num // 2000):
+        fb.fill_rect(3, 5, 100, 50, 0xf800 + i & 0xffff)
+
+bench.run(test)
@@ -0,0 +1,10 @@
+# Filling rectangles on a 128x64 GS2_HMSB framebuffer
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 // 4), 128, 64, framebuf.GS2_HMSB)
+    for i in range(num // 2000):
+        fb.fill_rect(3, 5, 100, 50, i & 3)
+
+bench.run(test)
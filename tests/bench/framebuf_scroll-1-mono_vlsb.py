@@ -0,0 +1,11 @@
+# Scrolling a 128x64 MONO_VLSB framebuffer sideways and by a text line
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 // 8), 128, 64, framebuf.MONO_VLSB)
+    for i in range(num // 20000):
+        fb.scroll(-1, 0)
+        fb.scroll(0, -8)
+
+bench.run(test)
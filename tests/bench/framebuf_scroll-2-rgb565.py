@@ -0,0 +1,11 @@
+# Scrolling a 128x64 RGB565 framebuffer by one pixel each way
+import bench
+import framebuf
+
+def test(num):
+    fb = framebuf.FrameBuffer(bytearray(128 * 64 * 2), 128, 64, framebuf.RGB565)
+    for i in range(num // 20000):
+        fb.scroll(-1, 0)
+        fb.scroll(0, 1)
+
+bench.run(test)
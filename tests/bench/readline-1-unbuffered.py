@@ -0,0 +1,13 @@
+# Reading lines with the generic readline(), which reads a byte at a time
+import bench
+import uio as io
+
+DATA = b"GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n" * 20
+
+def test(num):
+    for i in range(num // 20000):
+        f = io.BytesIO(DATA)
+        while f.readline():
+            pass
+
+bench.run(test)
@@ -0,0 +1,15 @@
+# Reading lines through io.BufferedReader, which scans its buffer for the
+# newline and returns a buffered line with a single allocation
+import bench
+import uio as io
+
+DATA = b"GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n" * 20
+
+def test(num):
+    for i in range(num // 20000):
+        f = io.BufferedReader(io.BytesIO(DATA), 256)
+        while f.readline():
+            pass
+        f.close()
+
+bench.run(test)
@@ -0,0 +1,18 @@
+# Latency of uselect.poll() with 32 registered streams, one of them ready.
+# Streams pushing their readiness: only the signalled one is checked.
+# Needs the unix coverage build, which has PollStream and the uselect of extmod.
+import bench
+import uselect as select
+
+N = 32
+
+def test(num):
+    poller = select.poll()
+    objs = [PollStream(True) for i in range(N)]
+    for o in objs:
+        poller.register(o, select.POLLIN)
+    objs[N - 1].set_ready(select.POLLIN)
+    for i in range(num // 200):
+        poller.poll(0)
+
+bench.run(test)
@@ -0,0 +1,45 @@
+# Test FrameBuffer.dirty() region tracking
+try:
+    import framebuf
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+w, h = 32, 16
+buf = bytearray(w * h // 8)
+fbuf = framebuf.FrameBuffer(buf, w, h, framebuf.MONO_VLSB)
+
+print(fbuf.dirty())
+fbuf.pixel(3, 4, 1)
+print(fbuf.dirty())
+print(fbuf.dirty())
+
+# regions are merged, and clipped to the framebuffer
+fbuf.fill_rect(-5, 2, 8, 3, 1)
+fbuf.hline(20, 10, 100, 1)
+print(fbuf.dirty())
+
+# drawing entirely outside changes nothing
+fbuf.fill_rect(40, 0, 5, 5, 1)
+fbuf.text("x", -20, 0, 1)
+fbuf.pixel(-1, 0, 1)
+print(fbuf.dirty())
+
+fbuf.line(30, 1, 2, 14, 1)
+print(fbuf.dirty())
+fbuf.text("ab", 8, 12, 1)
+print(fbuf.dirty())
+
+src = framebuf.FrameBuffer(bytearray(8), 8, 8, framebuf.MONO_VLSB)
+fbuf.blit(src, 28, -2)
+print(fbuf.dirty())
+
+fbuf.fill(0)
+print(fbuf.dirty())
+
+# scrolling by more than the size moves nothing
+fbuf.scroll(w, 0)
+fbuf.scroll(0, -h)
+print(fbuf.dirty())
+fbuf.scroll(1, 0)
+print(fbuf.dirty())
@@ -0,0 +1,46 @@
+# Test uasyncio scheduling: sleep ordering, native ms sleeps and sub-coroutines
+try:
+    import uasyncio as asyncio
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+log = []
+
+
+def sub(n):
+    yield
+    return n * 2
+
+
+def task(name, delay_ms, n):
+    for i in range(n):
+        yield from asyncio.sleep_ms(delay_ms)
+        log.append((name, i))
+    # a plain integer yield is a native sleep in ms
+    yield delay_ms
+    log.append((name, "done"))
+
+
+def main():
+    loop = asyncio.get_event_loop()
+    loop.create_task(task("a", 100, 2))
+    loop.create_task(task("b", 20, 2))
+    res = yield from sub(21)
+    print("sub", res)
+    yield from asyncio.sleep(0.4)
+    return "main done"
+
+
+loop = asyncio.get_event_loop()
+print(loop.run_until_complete(main()))
+for entry in log:
+    print(entry)
+
+# call_soon/call_later with plain callbacks
+def cb(tag):
+    print("cb", tag)
+
+loop.call_later_ms(20, cb, "later")
+loop.call_soon(cb, "soon")
+loop.run_until_complete(asyncio.sleep_ms(50))
@@ -0,0 +1,42 @@
+# Test uasyncio task cancellation and wait_for timeouts
+try:
+    import uasyncio as asyncio
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+
+def sleeper(name, ms):
+    try:
+        yield from asyncio.sleep_ms(ms)
+        print(name, "woke")
+    except asyncio.CancelledError:
+        print(name, "cancelled")
+
+
+def slow(ms):
+    yield from asyncio.sleep_ms(ms)
+    return "slow result"
+
+
+def main():
+    loop = asyncio.get_event_loop()
+    t = sleeper("t1", 10000)
+    loop.create_task(t)
+    loop.create_task(sleeper("t2", 20))
+    yield from asyncio.sleep_ms(10)
+    # cancelling a long sleeper must wake it straight away
+    asyncio.cancel(t)
+    yield from asyncio.sleep_ms(30)
+
+    print((yield from asyncio.wait_for_ms(slow(10), 100)))
+    try:
+        yield from asyncio.wait_for_ms(slow(10000), 20)
+    except asyncio.TimeoutError:
+        print("timeout")
+    # finished timeouts must not linger in the wait queue
+    print(len(loop.waitq))
+
+
+loop = asyncio.get_event_loop()
+loop.run_until_complete(main())
@@ -0,0 +1,35 @@
+# test uos.ilistdir(path, True), entries with the size and mtime
+
+try:
+    import uos
+    next(uos.ilistdir(".", True))
+except (ImportError, AttributeError, TypeError):
+    print("SKIP")
+    raise SystemExit
+
+prefix = "uos_ilistdir_stat_"
+for i in range(5):
+    with open(prefix + str(i), "wb") as f:
+        f.write(b"x" * (i * 10))
+
+# the entries match what stat() says
+found = []
+for e in uos.ilistdir(".", True):
+    if e[0].startswith(prefix):
+        st = uos.stat(e[0])
+        found.append((e[0], len(e), e[1] == st[0], e[3], e[4] == st[8]))
+for e in sorted(found):
+    print(*e)
+
+# each entry is a tuple of its own, they can be kept
+it = uos.ilistdir(".", True)
+print(next(it) is next(it))
+kept = [e for e in uos.ilistdir(".", True) if e[0].startswith(prefix)]
+print(sorted(e[0] for e in kept))
+print(sorted(e[3] for e in kept))
+
+for i in range(5):
+    try:
+        uos.remove(prefix + str(i))
+    except AttributeError:
+        uos.unlink(prefix + str(i))
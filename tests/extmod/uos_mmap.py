@@ -0,0 +1,62 @@
+# test uos.mmap, read-only maps of files
+
+try:
+    import gc
+    import uos
+    uos.mmap
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+name = "uos_mmap.tmp"
+data = bytes(range(256)) * 4 + b"end"
+
+with open(name, "wb") as f:
+    f.write(data)
+
+m = uos.mmap(name)
+print(len(m), bool(m))
+print(bytes(memoryview(m)) == data)
+print(memoryview(m)[-3:] == b"end")
+m.close()
+try:
+    memoryview(m)
+except TypeError:
+    print("TypeError")
+m.close()
+
+# a view keeps the map alive, with no reference left to the map
+v = memoryview(uos.mmap(name))
+gc.collect()
+print(v[0], v[255], bytes(v[-3:]))
+
+# and after the map is closed
+m = uos.mmap(name)
+v = memoryview(m)[1024:]
+m.close()
+del m
+gc.collect()
+print(bytes(v), bytes(memoryview(v)[1:]))
+v = None
+gc.collect()
+
+# the context manager closes it
+with uos.mmap(name) as m:
+    print(bytes(memoryview(m)[:4]))
+print(bool(m))
+
+# an empty file
+with open(name, "wb") as f:
+    pass
+with uos.mmap(name) as m:
+    print(len(m), bool(m), bytes(memoryview(m)))
+
+try:
+    uos.mmap(name + ".missing")
+except OSError:
+    print("OSError")
+
+try:
+    uos.remove(name)
+except AttributeError:
+    uos.unlink(name)
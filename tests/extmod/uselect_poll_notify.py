@@ -0,0 +1,64 @@
+# uselect.poll with streams pushing their readiness (MICROPY_STREAMS_POLL_NOTIFY)
+try:
+    import uselect as select
+    PollStream
+except (ImportError, NameError):
+    print("SKIP")
+    raise SystemExit
+
+push = [PollStream() for i in range(4)]
+scan = [PollStream(False) for i in range(2)]
+objs = push + scan
+
+poller = select.poll()
+for o in objs:
+    poller.register(o, select.POLLIN)
+
+def ready(flags=0):
+    return sorted(objs.index(o) for o, ev in poller.ipoll(0, flags))
+
+print(ready())
+
+# level-triggered, reported until drained
+push[1].set_ready(select.POLLIN)
+scan[0].set_ready(select.POLLIN)
+print(ready())
+print(ready())
+push[1].set_ready(0)
+print(ready())
+
+# only the events asked for
+push[2].set_ready(select.POLLOUT)
+print(ready())
+poller.modify(push[2], select.POLLIN | select.POLLOUT)
+print(ready())
+print([(objs.index(o), ev) for o, ev in poller.poll(0)])
+push[2].set_ready(0)
+scan[0].set_ready(0)
+
+# edge-triggered, reported once per signal
+push[3].set_ready(select.POLLIN)
+print(ready(select.POLLEDGE))
+print(ready(select.POLLEDGE))
+push[3].set_ready(select.POLLIN)
+print(ready(select.POLLEDGE))
+push[3].set_ready(0)
+
+# one shot, registering it again re-arms it
+push[0].set_ready(select.POLLIN)
+print(ready(1))
+print(ready(1))
+poller.register(push[0], select.POLLIN)
+print(ready(1))
+
+# unregistered while signalled
+poller.unregister(push[0])
+print(ready())
+
+# a stream pushes to one poller, the next one scans it
+p2 = select.poll()
+p2.register(push[1], select.POLLIN)
+push[1].set_ready(select.POLLIN)
+print(ready(), [objs.index(o) for o, ev in p2.poll(0)])
+push[1].set_ready(0)
+print(ready(), [objs.index(o) for o, ev in p2.poll(0)])
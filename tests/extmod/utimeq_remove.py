@@ -0,0 +1,27 @@
+# Test utimeq.remove(), used by schedulers to cancel pending entries
+try:
+    from utimeq import utimeq
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+h = utimeq(10)
+cbs = [object() for i in range(8)]
+for i, t in enumerate((50, 10, 70, 30, 20, 60, 40, 80)):
+    h.push(t, cbs[i], i)
+
+# removing an entry that isn't queued is a no-op
+print(h.remove(object()))
+print(len(h))
+
+# remove from the root, the middle and the last slot of the heap
+print(h.remove(cbs[1]))
+print(h.remove(cbs[3]))
+print(h.remove(cbs[7]))
+print(len(h))
+
+# remaining entries must still pop in time order
+res = [0, 0, 0]
+while h:
+    h.pop(res)
+    print(res[0], res[2])
@@ -0,0 +1,83 @@
+# test the block cache of FAT mounts, see extmod/vfs_blockcache.h
+
+try:
+    import uos_vfs as uos
+    uos.VfsFat
+    uos.cachestats
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+class RAMBlockDevice:
+
+    SEC_SIZE = 512
+
+    def __init__(self, blocks):
+        self.data = bytearray(blocks * self.SEC_SIZE)
+        self.reads = 0
+        self.writes = 0
+
+    def readblocks(self, n, buf):
+        self.reads += 1
+        for i in range(len(buf)):
+            buf[i] = self.data[n * self.SEC_SIZE + i]
+
+    def writeblocks(self, n, buf):
+        self.writes += 1
+        for i in range(len(buf)):
+            self.data[n * self.SEC_SIZE + i] = buf[i]
+
+    def ioctl(self, op, arg):
+        if op == 4:  # BP_IOCTL_SEC_COUNT
+            return len(self.data) // self.SEC_SIZE
+        if op == 5:  # BP_IOCTL_SEC_SIZE
+            return self.SEC_SIZE
+
+
+def content(i):
+    return bytes((i * 7 + j) & 0xff for j in range(700 + i * 300))
+
+
+def check(path, n):
+    print(sorted(uos.listdir(path)))
+    for i in range(n):
+        with uos.vfs_open('%s/f%d' % (path, i), 'rb') as f:
+            print(i, f.read() == content(i))
+
+
+bdev = RAMBlockDevice(128)
+uos.VfsFat.mkfs(bdev)
+
+# without the cache the blocks go straight to the device
+uos.mount(bdev, '/ramdisk', cache=0)
+print(uos.cachestats('/ramdisk'))
+writes = bdev.writes
+with uos.vfs_open('/ramdisk/f0', 'wb') as f:
+    f.write(content(0))
+print(bdev.writes > writes)
+check('/ramdisk', 1)
+uos.umount('/ramdisk')
+
+# with it, what FatFS writes is what it reads back, the FAT and the directory
+# going in and out of its window
+uos.mount(bdev, '/ramdisk', cache=4, readahead=2)
+check('/ramdisk', 1)
+for i in range(1, 6):
+    with uos.vfs_open('/ramdisk/f%d' % i, 'wb') as f:
+        f.write(content(i))
+check('/ramdisk', 6)
+uos.remove('/ramdisk/f2')
+print(sorted(uos.listdir('/ramdisk')))
+stats = uos.cachestats('/ramdisk')
+print(len(stats), stats[0] > 0, stats[1] > 0)
+
+# the blocks changed reach the device on sync, and on umount at the latest,
+# read without the cache it has it all
+uos.umount('/ramdisk')
+uos.mount(bdev, '/ramdisk', cache=0)
+print(sorted(uos.listdir('/ramdisk')))
+for i in (0, 1, 3, 4, 5):
+    with uos.vfs_open('/ramdisk/f%d' % i, 'rb') as f:
+        print(i, f.read() == content(i))
+uos.umount('/ramdisk')
@@ -0,0 +1,43 @@
+# Test uasyncio stream reader/writer with a local echo server
+try:
+    import uasyncio as asyncio
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+PORT = 8266
+
+
+def echo(reader, writer):
+    while True:
+        line = yield from reader.readline()
+        if not line:
+            break
+        yield from writer.awrite(line.upper())
+    yield from reader.aclose()
+
+
+def client(n):
+    reader, writer = yield from asyncio.open_connection("127.0.0.1", PORT)
+    for i in range(n):
+        yield from writer.awrite(b"line %d\n" % i)
+        print((yield from reader.readline()))
+    buf = bytearray(9)
+    yield from writer.awrite(b"readinto\n")
+    n = yield from reader.readinto(buf)
+    print(n, buf)
+    yield from writer.aclose()
+
+
+def main():
+    loop = asyncio.get_event_loop()
+    server = asyncio.start_server(echo, "127.0.0.1", PORT)
+    loop.create_task(server)
+    yield from asyncio.sleep_ms(10)
+    yield from client(3)
+    asyncio.cancel(server)
+    yield from asyncio.sleep_ms(10)
+
+
+asyncio.get_event_loop().run_until_complete(main())
+print("done")
@@ -4,11 +4,12 @@
 #
 # Usage:
 #
-# Have a directory with modules to be frozen (only modules, not packages
-# supported so far):
+# Have a directory with modules and packages to be frozen (symlinks to
+# directories are followed, so shared packages can be linked in):
 #
 # frozen/foo.py
 # frozen/bar.py
+# frozen/baz/__init__.py
 #
 # Run script, passing path to the directory above:
 #
@@ -30,7 +31,7 @@ modules = []
 root = sys.argv[1].rstrip("/")
 root_len = len(root)
 
-for dirpath, dirnames, filenames in os.walk(root):
+for dirpath, dirnames, filenames in os.walk(root, followlinks=True):
     for f in filenames:
         fullpath = dirpath + "/" + f
         st = os.stat(fullpath)